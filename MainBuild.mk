@@ -5,6 +5,10 @@ DISK_IMG=disk.img
 QEMU_DEBUG=-d int,mmu,pcall,guest_errors,cpu_reset
 QEMU_STDIO= -monitor stdio
 
+# Startup self-tests and benchmarks are only built into kernels for the
+# qemu-* test targets; run "make clean" when switching to a normal build
+BOOT_TESTS=-DKERNEL_BOOT_TESTS
+
 # Add cross-compilation support
 CROSS_COMPILE ?= i686-elf-
 CC = $(CROSS_COMPILE)gcc
@@ -14,7 +18,7 @@ LD = $(CROSS_COMPILE)ld
 FILESYSTEM_DIR := filesystem
 MEMORY_DIR := memory
 
-.PHONY: all build_dir disk qemu-gdb clean bootable
+.PHONY: all build_dir disk qemu-gdb qemu-bench qemu-smp qemu-ext2-bench qemu-journal-test clean bootable
 
 include $(FILESYSTEM_DIR)/FileSystemBuild.mk
 include $(MEMORY_DIR)/MemoryBuild.mk
@@ -28,7 +32,7 @@ $(BOOTLOADER):
 	make -f bootloader/BootBuild.mk -C bootloader CROSS_COMPILE=$(CROSS_COMPILE)
 
 $(KERNEL):
-	make -f kernel/KernelBuild.mk -C kernel CROSS_COMPILE=$(CROSS_COMPILE)
+	make -f kernel/KernelBuild.mk -C kernel CROSS_COMPILE=$(CROSS_COMPILE) KERNEL_DEFINES="$(KERNEL_DEFINES)"
 
 # Create a floppy disk image for QEMU testing
 disk: $(BOOTLOADER) $(KERNEL)
@@ -77,6 +81,42 @@ bootable: $(BOOTLOADER) $(KERNEL)
 qemu-gdb:
 	qemu-system-i386 $(QEMU_DEBUG) $(QEMU_STDIO) -machine q35 -fda $(DISK_IMG) -gdb tcp::26000 -D qemu.log -S
 
+# Boot a kernel that runs the startup self-tests and benchmarks (page
+# allocator, scheduler, CRC32C, ext2, journal, network receive and TCP
+# congestion control) and logs their results
+qemu-bench: KERNEL_DEFINES=$(BOOT_TESTS)
+qemu-bench: disk
+	qemu-system-i386 $(QEMU_STDIO) -machine q35 -fda $(DISK_IMG) -m 128M
+
+# Boot with four CPUs; the scheduler run-queue benchmark (pick and steal
+# cost of the per-CPU queues, driven from the boot CPU) is logged at startup
+qemu-smp: KERNEL_DEFINES=$(BOOT_TESTS)
+qemu-smp: disk
+	qemu-system-i386 $(QEMU_STDIO) -machine q35 -smp 4 -fda $(DISK_IMG) -m 128M
+
+# Boot with a 64 MB ext2 volume holding a 56 MB /bench.dat on the
+# secondary IDE master (the legacy ports the ATA driver probes; q35 puts
+# IDE drives behind AHCI); the ext2 read/write throughput benchmark is
+# logged at startup
+EXT2_BENCH_IMG=ext2_bench.img
+
+$(EXT2_BENCH_IMG):
+	dd if=/dev/zero of=$(EXT2_BENCH_IMG) bs=1M count=64
+	mkfs.ext2 -F -q -b 1024 $(EXT2_BENCH_IMG)
+	dd if=/dev/urandom of=bench.dat bs=1M count=56
+	debugfs -w -R "write bench.dat bench.dat" $(EXT2_BENCH_IMG)
+	rm -f bench.dat
+
+qemu-ext2-bench: KERNEL_DEFINES=$(BOOT_TESTS)
+qemu-ext2-bench: disk $(EXT2_BENCH_IMG)
+	qemu-system-i386 $(QEMU_STDIO) -machine pc -fda $(DISK_IMG) -drive file=$(EXT2_BENCH_IMG),format=raw,if=ide,index=2 -m 128M
+
+# Boot a kernel built with the journal crash-injection test, which runs on
+# a RAM disk at startup, and check the log for "Journal crash test passed"
+qemu-journal-test: KERNEL_DEFINES=$(BOOT_TESTS)
+qemu-journal-test: disk
+	qemu-system-i386 $(QEMU_STDIO) -machine q35 -fda $(DISK_IMG) -m 128M
+
 # Test with bootable hard disk image
 qemu-bootable:
 	qemu-system-i386 $(QEMU_STDIO) -machine q35 -hda bootable.img -m 128M
@@ -84,4 +124,4 @@ qemu-bootable:
 clean:
 	killall qemu-system-i386 || true
 	killall gdb || true
-	rm -rf build $(DISK_IMG) bootable.img mnt
+	rm -rf build $(DISK_IMG) $(EXT2_BENCH_IMG) bootable.img mnt
@@ -16,6 +16,22 @@
 
 #define RTL8139_TAG "RTL8139"
 
+// Receive configuration: promiscuous, physical match, multicast and broadcast
+// frames into an 8K ring with 256-byte DMA bursts
+#define RTL8139_RCR_CONFIG (RTL8139_RCR_AAP | RTL8139_RCR_APM | RTL8139_RCR_AM | RTL8139_RCR_AB | \
+                            RTL8139_RCR_RBLEN_8K | RTL8139_RCR_MXDMA_256)
+
+// Interrupts enabled while running; the receive ones are masked from the
+// interrupt until the network thread has drained the ring
+#define RTL8139_IMR_RX     (RTL8139_INT_RXOK | RTL8139_INT_RX_BUFFER_OVERFLOW)
+#define RTL8139_IMR_CONFIG (RTL8139_IMR_RX | RTL8139_INT_RXERR | \
+                            RTL8139_INT_TXOK | RTL8139_INT_TXERR | \
+                            RTL8139_INT_LINK_CHANGE | RTL8139_INT_RX_FIFO_OVERFLOW | \
+                            RTL8139_INT_SYSTEM_ERR)
+
+// Length the chip reports while it is still copying a frame into the ring
+#define RTL8139_RX_LENGTH_PENDING 0xFFF0
+
 // Array of supported PCI vendor IDs
 static uint16_t rtl8139_vendor_ids[] = {
     RTL8139_VENDOR_ID
@@ -167,25 +183,13 @@ int rtl8139_reset(pci_device_t* dev) {
     rtl8139_write32(priv, RTL8139_REG_RBSTART, priv->rx_buffer_phys);
     
     // Configure receive buffer
-    uint32_t rcr = RTL8139_RCR_AAP |    // Accept All Packets (promiscuous mode)
-                   RTL8139_RCR_APM |    // Accept Physical Match
-                   RTL8139_RCR_AM |     // Accept Multicast
-                   RTL8139_RCR_AB |     // Accept Broadcast
-                   RTL8139_RCR_RBLEN_8K | // 8K Rx buffer
-                   RTL8139_RCR_MXDMA_256; // 256 byte max DMA burst
-                   
-    rtl8139_write32(priv, RTL8139_REG_RCR, rcr);
+    rtl8139_write32(priv, RTL8139_REG_RCR, RTL8139_RCR_CONFIG);
     
     // Enable receive and transmit
     rtl8139_write8(priv, RTL8139_REG_CMD, RTL8139_CMD_RX_ENABLE | RTL8139_CMD_TX_ENABLE);
     
     // Set up interrupts
-    uint16_t imr = RTL8139_INT_RXOK | RTL8139_INT_RXERR |
-                  RTL8139_INT_TXOK | RTL8139_INT_TXERR |
-                  RTL8139_INT_RX_BUFFER_OVERFLOW | RTL8139_INT_LINK_CHANGE |
-                  RTL8139_INT_RX_FIFO_OVERFLOW | RTL8139_INT_SYSTEM_ERR;
-                  
-    rtl8139_write16(priv, RTL8139_REG_IMR, imr);
+    rtl8139_write16(priv, RTL8139_REG_IMR, RTL8139_IMR_CONFIG);
     
     // Reset Rx pointer
     priv->cur_rx = 0;
@@ -198,50 +202,80 @@ int rtl8139_reset(pci_device_t* dev) {
     return 0;
 }
 
+/**
+ * Restart reception at the start of the ring after a corrupt packet header
+ */
+static void rtl8139_rx_resync(rtl8139_device_t* priv) {
+    rtl8139_write8(priv, RTL8139_REG_CMD, RTL8139_CMD_TX_ENABLE);
+    rtl8139_write8(priv, RTL8139_REG_CMD, RTL8139_CMD_RX_ENABLE | RTL8139_CMD_TX_ENABLE);
+    rtl8139_write32(priv, RTL8139_REG_RBSTART, priv->rx_buffer_phys);
+    rtl8139_write32(priv, RTL8139_REG_RCR, RTL8139_RCR_CONFIG);
+    
+    priv->cur_rx = 0;
+    rtl8139_write16(priv, RTL8139_REG_CAPR, 0);
+}
+
 /**
  * Process received packets
  */
-int rtl8139_process_rx(rtl8139_device_t* priv) {
+int rtl8139_process_rx(rtl8139_device_t* priv, int budget) {
     int packets_processed = 0;
     uint8_t cmd = rtl8139_read8(priv, RTL8139_REG_CMD);
     
     // Check if there are packets to read
-    while (!(cmd & RTL8139_CMD_RX_BUF_EMPTY)) {
-        uint16_t rx_status = *(uint16_t*)(priv->rx_buffer + priv->cur_rx);
-        uint16_t rx_length = *(uint16_t*)(priv->rx_buffer + priv->cur_rx + 2);
+    while (!(cmd & RTL8139_CMD_RX_BUF_EMPTY) && packets_processed < budget) {
+        // cur_rx is dword aligned, so the 4-byte header never wraps
+        uint16_t rx_status = *(volatile uint16_t*)(priv->rx_buffer + priv->cur_rx);
+        uint16_t rx_length = *(volatile uint16_t*)(priv->rx_buffer + priv->cur_rx + 2);
         
-        // Skip packet header (4 bytes)
-        uint8_t* packet = priv->rx_buffer + priv->cur_rx + 4;
+        if (rx_length == RTL8139_RX_LENGTH_PENDING) {
+            // Still being written; the chip raises RXOK again once it is done
+            break;
+        }
         
         log_debug(RTL8139_TAG, "Received packet: status=0x%04X, length=%u", rx_status, rx_length);
         
-        // Check if packet is valid
-        if (rx_status & 0x1) { // ROK (Receive OK)
-            priv->packet_counter++;
-            priv->bytes_counter += rx_length;
-            
-            // Process packet (in a real driver, we would pass this to the network stack)
-            log_debug(RTL8139_TAG, "Packet dst MAC: %02X:%02X:%02X:%02X:%02X:%02X",
-                     packet[0], packet[1], packet[2], packet[3], packet[4], packet[5]);
-                     
-            log_debug(RTL8139_TAG, "Packet src MAC: %02X:%02X:%02X:%02X:%02X:%02X",
-                     packet[6], packet[7], packet[8], packet[9], packet[10], packet[11]);
-            
-            packets_processed++;
-        } else {
-            log_warning(RTL8139_TAG, "Received invalid packet: status=0x%04X", rx_status);
+        if (!(rx_status & RTL8139_RX_STATUS_ROK) ||
+            rx_length < RTL8139_RX_MIN_LENGTH || rx_length > RTL8139_RX_MAX_LENGTH) {
+            // The header cannot be trusted to find the next packet
+            log_warning(RTL8139_TAG, "Received invalid packet: status=0x%04X, length=%u", rx_status, rx_length);
+            priv->netdev.stats.rx_errors++;
+            rtl8139_rx_resync(priv);
+            break;
+        }
+        
+        priv->packet_counter++;
+        priv->bytes_counter += rx_length;
+        
+        // The length includes the CRC, which the stack does not want
+        uint32_t frame_offset = priv->cur_rx + 4;
+        uint32_t frame_length = rx_length - 4;
+        uint8_t* frame = priv->rx_buffer + frame_offset;
+        
+        if (frame_offset + frame_length > RTL8139_RX_BUFFER_SIZE) {
+            // The chip continued the frame at the start of the ring
+            uint32_t head = RTL8139_RX_BUFFER_SIZE - frame_offset;
+            memcpy(priv->rx_bounce, frame, head);
+            memcpy(priv->rx_bounce + head, priv->rx_buffer, frame_length - head);
+            frame = priv->rx_bounce;
+            priv->netdev.stats.rx_copied_bytes += frame_length;
+        }
+        
+        if (priv->netdev_registered) {
+            network_receive_packet(&priv->netdev, frame, frame_length);
         }
+        packets_processed++;
         
         // Update Rx pointer (align to 4 bytes)
         priv->cur_rx = (priv->cur_rx + rx_length + 4 + 3) & ~3;
         
         // Handle wrap
-        if (priv->cur_rx > RTL8139_RX_BUFFER_SIZE) {
-            priv->cur_rx = priv->cur_rx - RTL8139_RX_BUFFER_SIZE;
+        if (priv->cur_rx >= RTL8139_RX_BUFFER_SIZE) {
+            priv->cur_rx -= RTL8139_RX_BUFFER_SIZE;
         }
         
-        // Update Rx pointer in the device
-        rtl8139_write16(priv, RTL8139_REG_CAPR, priv->cur_rx - 16);
+        // Hand the space back to the chip (CAPR trails the read pointer by 16)
+        rtl8139_write16(priv, RTL8139_REG_CAPR, (uint16_t)(priv->cur_rx - 16));
         
         // Check if there are more packets
         cmd = rtl8139_read8(priv, RTL8139_REG_CMD);
@@ -287,6 +321,40 @@ int rtl8139_transmit(rtl8139_device_t* priv, const void* data, size_t length) {
     return -1;
 }
 
+/**
+ * Transmit callback for the network stack
+ */
+static int rtl8139_net_transmit(net_device_t* netdev, net_buffer_t* buffer) {
+    rtl8139_device_t* priv = (rtl8139_device_t*)netdev->priv;
+    return rtl8139_transmit(priv, buffer->data, buffer->len);
+}
+
+/**
+ * Poll callback for the network stack: pass received frames up from the
+ * network thread
+ *
+ * Once the ring is empty the receive interrupts are unmasked again. A frame
+ * that lands in between still has its RXOK bit latched in ISR, so it raises
+ * an interrupt as soon as the mask opens; the ring is checked once more
+ * anyway in case that interrupt was taken and acknowledged early.
+ */
+static int rtl8139_poll(net_device_t* netdev, int budget) {
+    rtl8139_device_t* priv = (rtl8139_device_t*)netdev->priv;
+    
+    int packets = rtl8139_process_rx(priv, budget);
+    if (packets >= budget) {
+        return packets;
+    }
+    
+    rtl8139_write16(priv, RTL8139_REG_IMR, RTL8139_IMR_CONFIG);
+    if (!(rtl8139_read8(priv, RTL8139_REG_CMD) & RTL8139_CMD_RX_BUF_EMPTY)) {
+        rtl8139_write16(priv, RTL8139_REG_IMR, RTL8139_IMR_CONFIG & ~RTL8139_IMR_RX);
+        return budget;
+    }
+    
+    return packets;
+}
+
 /**
  * RTL8139 interrupt handler
  */
@@ -300,11 +368,15 @@ void rtl8139_interrupt(pci_device_t* dev) {
     // Log interrupt status
     log_debug(RTL8139_TAG, "Interrupt: ISR=0x%04X", isr);
     
-    // Handle received packets
-    if (isr & (RTL8139_INT_RXOK | RTL8139_INT_RX_BUFFER_OVERFLOW)) {
-        int packets = rtl8139_process_rx(priv);
-        if (packets > 0) {
-            log_debug(RTL8139_TAG, "Processed %d packets", packets);
+    // Handle received packets: mask further receive interrupts and leave the
+    // ring to the network thread, which unmasks them once it is drained
+    if (isr & RTL8139_IMR_RX) {
+        if (priv->netdev_registered) {
+            rtl8139_write16(priv, RTL8139_REG_IMR, RTL8139_IMR_CONFIG & ~RTL8139_IMR_RX);
+            network_schedule_poll(&priv->netdev);
+        } else {
+            // Nowhere to pass frames to: just hand the ring space back
+            rtl8139_process_rx(priv, RTL8139_RX_BUFFER_SIZE);
         }
     }
     
@@ -499,6 +571,22 @@ static int rtl8139_initialize(pci_device_t* dev) {
         log_warning(RTL8139_TAG, "Failed to create device manager entry");
     }
     
+    // Register the interface with the network stack so received frames go up
+    net_device_t* netdev = &priv->netdev;
+    strncpy(netdev->name, "eth0", sizeof(netdev->name) - 1);
+    netdev->flags = NET_DEV_FLAG_UP | NET_DEV_FLAG_BROADCAST | NET_DEV_FLAG_MULTICAST;
+    memcpy(netdev->mac.addr, priv->mac_address, sizeof(netdev->mac.addr));
+    netdev->mtu = 1500;
+    netdev->ops.transmit = rtl8139_net_transmit;
+    netdev->ops.poll = rtl8139_poll;
+    netdev->priv = priv;
+    
+    if (network_register_device(netdev) == 0) {
+        priv->netdev_registered = true;
+    } else {
+        log_warning(RTL8139_TAG, "Network stack unavailable, received frames will be dropped");
+    }
+    
     log_info(RTL8139_TAG, "RTL8139 initialization complete");
     return 0;
 }
@@ -524,6 +612,12 @@ static int rtl8139_remove(pci_device_t* dev) {
     // Unregister interrupt handler
     hal_interrupt_unregister_handler(priv->irq);
     
+    // Detach from the network stack before the ring goes away
+    if (priv->netdev_registered) {
+        network_unregister_device(&priv->netdev);
+        priv->netdev_registered = false;
+    }
+    
     // Free transmit buffers
     for (int i = 0; i < RTL8139_NUM_TX_DESCRIPTORS; i++) {
         if (priv->tx_buffer[i]) {
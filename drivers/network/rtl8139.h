@@ -13,6 +13,7 @@
 #include <stdbool.h>
 #include "../pci/pci.h"
 #include "../../kernel/device_manager.h"
+#include "../../network/include/network.h"
 
 // RTL8139 PCI vendor and device IDs
 #define RTL8139_VENDOR_ID            0x10EC    // Realtek
@@ -74,8 +75,13 @@
 #define RTL8139_RCR_MXDMA_1K        0x00000600 // Max DMA burst size 1K bytes
 #define RTL8139_RCR_MXDMA_UNLIMITED 0x00000700 // Unlimited DMA burst size
 
+// RTL8139 receive packet header status bits
+#define RTL8139_RX_STATUS_ROK       0x0001    // Receive OK
+
 // RTL8139 receive buffer size (must be aligned to 32)
 #define RTL8139_RX_BUFFER_SIZE      8192     // 8K buffer size
+#define RTL8139_RX_MIN_LENGTH       (14 + 4) // Ethernet header plus CRC
+#define RTL8139_RX_MAX_LENGTH       (1522 + 4) // VLAN-tagged frame plus CRC
 #define RTL8139_TX_BUFFER_SIZE      1536     // 1536 bytes buffer size per descriptor
 #define RTL8139_NUM_TX_DESCRIPTORS  4        // 4 transmit descriptors
 
@@ -98,6 +104,10 @@ typedef struct {
     
     uint32_t packet_counter;          // Statistics: Packets received
     uint32_t bytes_counter;           // Statistics: Bytes received
+    
+    net_device_t netdev;              // Interface registered with the network stack
+    bool netdev_registered;           // Whether frames can be passed up
+    uint8_t rx_bounce[RTL8139_RX_MAX_LENGTH]; // Frames that wrap the ring end are reassembled here
 } rtl8139_device_t;
 
 /**
@@ -177,10 +187,15 @@ void rtl8139_write32(rtl8139_device_t* priv, uint8_t reg, uint32_t value);
 /**
  * Process received packets
  * 
+ * Each frame is passed to the network stack where it lies in the receive
+ * ring; only frames that wrap past the end of the ring are copied first.
+ * Runs the protocol stack, so it is called from the network thread.
+ * 
  * @param priv Device private data
+ * @param budget Maximum number of packets to process
  * @return Number of packets processed
  */
-int rtl8139_process_rx(rtl8139_device_t* priv);
+int rtl8139_process_rx(rtl8139_device_t* priv, int budget);
 
 /**
  * Transmit a packet
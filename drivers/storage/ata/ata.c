@@ -0,0 +1,339 @@
+/**
+ * @file ata.c
+ * @brief ATA (IDE) PIO disk driver for uintOS
+ *
+ * Disks are driven with polled LBA28 PIO commands and device
+ * interrupts masked, so no IRQ handler is needed.
+ */
+
+#include "ata.h"
+#include "../../../kernel/logging/log.h"
+#include "../../../kernel/sync.h"
+#include "../../../hal/include/hal_io.h"
+#include "../../../filesystem/vfs/vfs.h"
+#include <string.h>
+
+#define ATA_TAG "ATA"
+
+// Status polls before a command is abandoned
+#define ATA_POLL_LIMIT 1000000
+
+typedef struct {
+    vfs_block_device_t device;
+    uint16_t io_base;
+    uint16_t ctrl_base;
+    uint8_t channel;
+    uint8_t drive;
+} ata_disk_t;
+
+static ata_disk_t ata_disks[ATA_MAX_DISKS];
+static int ata_disk_count = 0;
+
+// Both drives on a channel share its task file, so commands are serialized per channel
+static mutex_t ata_channel_lock[2];
+static bool ata_initialized = false;
+
+static const uint16_t ata_io_bases[2] = { ATA_PRIMARY_IO, ATA_SECONDARY_IO };
+static const uint16_t ata_ctrl_bases[2] = { ATA_PRIMARY_CTRL, ATA_SECONDARY_CTRL };
+
+/**
+ * Give the drive 400ns to settle by reading the alternate status register
+ */
+static void ata_delay(uint16_t ctrl_base) {
+    for (int i = 0; i < 4; i++) {
+        hal_io_port_in8(ctrl_base);
+    }
+}
+
+/**
+ * Wait until the drive is no longer busy
+ */
+static int ata_wait_not_busy(uint16_t io_base) {
+    for (int i = 0; i < ATA_POLL_LIMIT; i++) {
+        if (!(hal_io_port_in8(io_base + ATA_REG_STATUS) & ATA_SR_BSY)) {
+            return ATA_SUCCESS;
+        }
+    }
+    return ATA_ERR_TIMEOUT;
+}
+
+/**
+ * Wait until the drive is ready to transfer a sector
+ */
+static int ata_wait_drq(uint16_t io_base) {
+    for (int i = 0; i < ATA_POLL_LIMIT; i++) {
+        uint8_t status = hal_io_port_in8(io_base + ATA_REG_STATUS);
+
+        if (status & ATA_SR_BSY) {
+            continue;
+        }
+        if (status & (ATA_SR_ERR | ATA_SR_DF)) {
+            return ATA_ERR_DEVICE;
+        }
+        if (status & ATA_SR_DRQ) {
+            return ATA_SUCCESS;
+        }
+    }
+    return ATA_ERR_TIMEOUT;
+}
+
+/**
+ * Load the task file for an LBA28 command and issue it
+ */
+static int ata_issue(ata_disk_t* disk, uint32_t lba, uint32_t count, uint8_t command) {
+    uint16_t io = disk->io_base;
+
+    if (ata_wait_not_busy(io) != ATA_SUCCESS) {
+        return ATA_ERR_TIMEOUT;
+    }
+
+    hal_io_port_out8(io + ATA_REG_DRIVE, ATA_DRIVE_LBA | (disk->drive << 4) | ((lba >> 24) & 0x0F));
+    ata_delay(disk->ctrl_base);
+
+    // A count of 0 transfers 256 sectors
+    hal_io_port_out8(io + ATA_REG_SECCOUNT, (uint8_t)count);
+    hal_io_port_out8(io + ATA_REG_LBA_LOW, (uint8_t)lba);
+    hal_io_port_out8(io + ATA_REG_LBA_MID, (uint8_t)(lba >> 8));
+    hal_io_port_out8(io + ATA_REG_LBA_HIGH, (uint8_t)(lba >> 16));
+    hal_io_port_out8(io + ATA_REG_COMMAND, command);
+
+    return ATA_SUCCESS;
+}
+
+static int ata_read_blocks(vfs_block_device_t* device, uint64_t block, uint32_t count, void* buffer) {
+    ata_disk_t* disk = (ata_disk_t*)device->private_data;
+    uint16_t* words = (uint16_t*)buffer;
+
+    if (block + count > device->block_count) {
+        return VFS_ERR_IO_ERROR;
+    }
+
+    mutex_lock(&ata_channel_lock[disk->channel]);
+
+    uint32_t done = 0;
+    while (done < count) {
+        uint32_t chunk = count - done;
+        if (chunk > ATA_MAX_SECTORS) {
+            chunk = ATA_MAX_SECTORS;
+        }
+
+        if (ata_issue(disk, (uint32_t)(block + done), chunk, ATA_CMD_READ_SECTORS) != ATA_SUCCESS) {
+            break;
+        }
+
+        uint32_t sector;
+        for (sector = 0; sector < chunk; sector++) {
+            if (ata_wait_drq(disk->io_base) != ATA_SUCCESS) {
+                break;
+            }
+            for (int i = 0; i < ATA_SECTOR_SIZE / 2; i++) {
+                *words++ = hal_io_port_in16(disk->io_base + ATA_REG_DATA);
+            }
+        }
+
+        if (sector < chunk) {
+            break;
+        }
+        done += chunk;
+    }
+
+    mutex_unlock(&ata_channel_lock[disk->channel]);
+
+    if (done < count) {
+        log_error(ATA_TAG, "%s: read of %u sectors at %u failed",
+                  device->name, count, (uint32_t)block);
+        return VFS_ERR_IO_ERROR;
+    }
+    return count;
+}
+
+static int ata_write_blocks(vfs_block_device_t* device, uint64_t block, uint32_t count, const void* buffer) {
+    ata_disk_t* disk = (ata_disk_t*)device->private_data;
+    const uint16_t* words = (const uint16_t*)buffer;
+
+    if (block + count > device->block_count) {
+        return VFS_ERR_IO_ERROR;
+    }
+
+    mutex_lock(&ata_channel_lock[disk->channel]);
+
+    uint32_t done = 0;
+    while (done < count) {
+        uint32_t chunk = count - done;
+        if (chunk > ATA_MAX_SECTORS) {
+            chunk = ATA_MAX_SECTORS;
+        }
+
+        if (ata_issue(disk, (uint32_t)(block + done), chunk, ATA_CMD_WRITE_SECTORS) != ATA_SUCCESS) {
+            break;
+        }
+
+        uint32_t sector;
+        for (sector = 0; sector < chunk; sector++) {
+            if (ata_wait_drq(disk->io_base) != ATA_SUCCESS) {
+                break;
+            }
+            for (int i = 0; i < ATA_SECTOR_SIZE / 2; i++) {
+                hal_io_port_out16(disk->io_base + ATA_REG_DATA, *words++);
+            }
+        }
+
+        // The last sector is still being written when DRQ drops
+        if (sector < chunk || ata_wait_not_busy(disk->io_base) != ATA_SUCCESS) {
+            break;
+        }
+        done += chunk;
+    }
+
+    mutex_unlock(&ata_channel_lock[disk->channel]);
+
+    if (done < count) {
+        log_error(ATA_TAG, "%s: write of %u sectors at %u failed",
+                  device->name, count, (uint32_t)block);
+        return VFS_ERR_IO_ERROR;
+    }
+    return count;
+}
+
+/**
+ * Flush the drive's write cache so completed writes survive power loss
+ */
+static int ata_sync(vfs_block_device_t* device) {
+    ata_disk_t* disk = (ata_disk_t*)device->private_data;
+    int result = ATA_SUCCESS;
+
+    mutex_lock(&ata_channel_lock[disk->channel]);
+
+    if (ata_wait_not_busy(disk->io_base) != ATA_SUCCESS) {
+        result = ATA_ERR_TIMEOUT;
+    } else {
+        hal_io_port_out8(disk->io_base + ATA_REG_DRIVE, ATA_DRIVE_LBA | (disk->drive << 4));
+        ata_delay(disk->ctrl_base);
+        hal_io_port_out8(disk->io_base + ATA_REG_COMMAND, ATA_CMD_CACHE_FLUSH);
+
+        if (ata_wait_not_busy(disk->io_base) != ATA_SUCCESS ||
+            (hal_io_port_in8(disk->io_base + ATA_REG_STATUS) & (ATA_SR_ERR | ATA_SR_DF))) {
+            result = ATA_ERR_DEVICE;
+        }
+    }
+
+    mutex_unlock(&ata_channel_lock[disk->channel]);
+
+    return (result == ATA_SUCCESS) ? 0 : VFS_ERR_IO_ERROR;
+}
+
+static vfs_block_device_ops_t ata_ops = {
+    .read_blocks = ata_read_blocks,
+    .write_blocks = ata_write_blocks,
+    .sync = ata_sync,
+};
+
+/**
+ * Send IDENTIFY DEVICE and read the 256-word response
+ */
+static int ata_identify(uint16_t io, uint16_t ctrl, uint8_t drive, uint16_t* identify) {
+    // A floating bus reads back all ones
+    if (hal_io_port_in8(io + ATA_REG_STATUS) == 0xFF) {
+        return ATA_ERR_NO_DEVICE;
+    }
+
+    hal_io_port_out8(io + ATA_REG_DRIVE, 0xA0 | (drive << 4));
+    ata_delay(ctrl);
+
+    hal_io_port_out8(io + ATA_REG_SECCOUNT, 0);
+    hal_io_port_out8(io + ATA_REG_LBA_LOW, 0);
+    hal_io_port_out8(io + ATA_REG_LBA_MID, 0);
+    hal_io_port_out8(io + ATA_REG_LBA_HIGH, 0);
+    hal_io_port_out8(io + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+
+    if (hal_io_port_in8(io + ATA_REG_STATUS) == 0) {
+        return ATA_ERR_NO_DEVICE;
+    }
+    if (ata_wait_not_busy(io) != ATA_SUCCESS) {
+        return ATA_ERR_TIMEOUT;
+    }
+
+    // ATAPI and SATA bridges leave a signature in the LBA registers instead of answering
+    if (hal_io_port_in8(io + ATA_REG_LBA_MID) || hal_io_port_in8(io + ATA_REG_LBA_HIGH)) {
+        return ATA_ERR_NO_DEVICE;
+    }
+
+    int result = ata_wait_drq(io);
+    if (result != ATA_SUCCESS) {
+        return result;
+    }
+
+    for (int i = 0; i < 256; i++) {
+        identify[i] = hal_io_port_in16(io + ATA_REG_DATA);
+    }
+    return ATA_SUCCESS;
+}
+
+/**
+ * Probe a drive and register it as a VFS block device
+ */
+int ata_register_disk(uint8_t channel, uint8_t drive, const char* name) {
+    if (channel > ATA_CHANNEL_SECONDARY || drive > ATA_DRIVE_SLAVE || !name) {
+        return ATA_ERR_NO_DEVICE;
+    }
+
+    if (!ata_initialized) {
+        mutex_init(&ata_channel_lock[ATA_CHANNEL_PRIMARY]);
+        mutex_init(&ata_channel_lock[ATA_CHANNEL_SECONDARY]);
+        ata_initialized = true;
+    }
+
+    if (ata_disk_count >= ATA_MAX_DISKS) {
+        return ATA_ERR_NO_SPACE;
+    }
+
+    uint16_t io = ata_io_bases[channel];
+    uint16_t ctrl = ata_ctrl_bases[channel];
+    uint16_t identify[256];
+
+    mutex_lock(&ata_channel_lock[channel]);
+
+    // Commands are polled, so keep the drive from raising IRQs nobody handles
+    hal_io_port_out8(ctrl, ATA_CTRL_NIEN);
+    int result = ata_identify(io, ctrl, drive, identify);
+
+    mutex_unlock(&ata_channel_lock[channel]);
+
+    if (result != ATA_SUCCESS) {
+        log_info(ATA_TAG, "No ATA disk on %s %s", channel ? "secondary" : "primary",
+                 drive ? "slave" : "master");
+        return result;
+    }
+
+    // Words 60-61 hold the number of LBA28-addressable sectors
+    uint32_t sectors = (uint32_t)identify[60] | ((uint32_t)identify[61] << 16);
+    if (sectors == 0) {
+        log_error(ATA_TAG, "Disk on %s %s does not support LBA", channel ? "secondary" : "primary",
+                  drive ? "slave" : "master");
+        return ATA_ERR_DEVICE;
+    }
+
+    ata_disk_t* disk = &ata_disks[ata_disk_count];
+    memset(disk, 0, sizeof(*disk));
+    disk->io_base = io;
+    disk->ctrl_base = ctrl;
+    disk->channel = channel;
+    disk->drive = drive;
+
+    strncpy(disk->device.name, name, VFS_MAX_DEVICE_NAME - 1);
+    disk->device.block_size = ATA_SECTOR_SIZE;
+    disk->device.block_count = sectors;
+    disk->device.operations = &ata_ops;
+    disk->device.private_data = disk;
+
+    result = vfs_register_block_device(&disk->device);
+    if (result != VFS_SUCCESS) {
+        log_error(ATA_TAG, "Failed to register %s: %d", name, result);
+        return ATA_ERR_DEVICE;
+    }
+    ata_disk_count++;
+
+    log_info(ATA_TAG, "%s: %u sectors (%u MB) on %s %s", name, sectors, sectors / 2048,
+             channel ? "secondary" : "primary", drive ? "slave" : "master");
+    return ATA_SUCCESS;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file ata.h
+ * @brief ATA (IDE) PIO disk driver for uintOS
+ *
+ * This file provides polled PIO access to disks on the legacy
+ * ATA channels and exposes them to the VFS as block devices.
+ */
+
+#ifndef ATA_H
+#define ATA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Legacy channel I/O ports
+#define ATA_PRIMARY_IO        0x1F0
+#define ATA_PRIMARY_CTRL      0x3F6
+#define ATA_SECONDARY_IO      0x170
+#define ATA_SECONDARY_CTRL    0x376
+
+// Channels and drives on a channel
+#define ATA_CHANNEL_PRIMARY   0
+#define ATA_CHANNEL_SECONDARY 1
+#define ATA_DRIVE_MASTER      0
+#define ATA_DRIVE_SLAVE       1
+
+// Task file registers (offsets from the channel I/O base)
+#define ATA_REG_DATA          0x00
+#define ATA_REG_ERROR         0x01
+#define ATA_REG_SECCOUNT      0x02
+#define ATA_REG_LBA_LOW       0x03
+#define ATA_REG_LBA_MID       0x04
+#define ATA_REG_LBA_HIGH      0x05
+#define ATA_REG_DRIVE         0x06
+#define ATA_REG_STATUS        0x07
+#define ATA_REG_COMMAND       0x07
+
+// Device control register bits
+#define ATA_CTRL_NIEN         0x02  // Disable device interrupts
+
+// Status register bits
+#define ATA_SR_ERR            0x01  // Error
+#define ATA_SR_DRQ            0x08  // Data request
+#define ATA_SR_DF             0x20  // Device fault
+#define ATA_SR_BSY            0x80  // Busy
+
+// Commands
+#define ATA_CMD_READ_SECTORS  0x20
+#define ATA_CMD_WRITE_SECTORS 0x30
+#define ATA_CMD_CACHE_FLUSH   0xE7
+#define ATA_CMD_IDENTIFY      0xEC
+
+// Drive/head register: LBA addressing, drive select in bit 4
+#define ATA_DRIVE_LBA         0xE0
+
+#define ATA_SECTOR_SIZE       512
+#define ATA_MAX_SECTORS       256   // Sectors per LBA28 command (count 0 means 256)
+#define ATA_MAX_DISKS         4
+
+// Error codes
+#define ATA_SUCCESS           0
+#define ATA_ERR_NO_DEVICE     -1
+#define ATA_ERR_TIMEOUT       -2
+#define ATA_ERR_DEVICE        -3
+#define ATA_ERR_NO_SPACE      -4
+
+/**
+ * Probe a drive and register it as a VFS block device
+ *
+ * @param channel ATA_CHANNEL_PRIMARY or ATA_CHANNEL_SECONDARY
+ * @param drive ATA_DRIVE_MASTER or ATA_DRIVE_SLAVE
+ * @param name Block device name filesystems mount by
+ * @return ATA_SUCCESS on success, negative error code on failure
+ */
+int ata_register_disk(uint8_t channel, uint8_t drive, const char* name);
+
+#endif /* ATA_H */
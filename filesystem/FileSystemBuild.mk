@@ -11,7 +11,7 @@ ISO9660_OBJECTS := $(patsubst %.c, $(BUILD_DIR)/filesystem/iso9660/%.o, $(wildca
 EXFAT_OBJECTS := $(patsubst %.c, $(BUILD_DIR)/filesystem/exfat/%.o, $(wildcard exfat/*.c))
 
 # Source files
-FILESYSTEM_SOURCES := fat12.c vfs/vfs.c fat12_vfs_adapter.c ext2/ext2.c iso9660/iso9660.c \
+FILESYSTEM_SOURCES := fat12.c vfs/vfs.c vfs/vfs_cache.c vfs/vfs_dcache.c vfs/vfs_journal.c fat12_vfs_adapter.c ext2/ext2.c iso9660/iso9660.c \
                      exfat/exfat.c exfat/exfat_vfs_adapter.c
 
 # Object files
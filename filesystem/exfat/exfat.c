@@ -1,4 +1,5 @@
 #include "exfat.h"
+#include "../vfs/vfs.h"
 #include "../../kernel/logging/log.h"
 #include <string.h>
 #include <stdlib.h>
@@ -9,6 +10,462 @@ static uint32_t disk_size = 0;
 static exfat_fs_info_t fs_info;
 static int exfat_initialized = 0;
 
+/* Dentry cache namespace. Handles are the first cluster, with
+ * EXFAT_HANDLE_DIR set for directories. */
+static uint32_t dcache_ns = 0;
+#define EXFAT_HANDLE_DIR (1ULL << 32)
+
+/* Volume layout. The allocation bitmap holds one bit per cluster (clusters 0
+ * and 1 do not exist and stay marked used); the FAT follows it. */
+#define EXFAT_DEVICE_NAME     "exfat_disk"
+#define EXFAT_SECTOR_SIZE     512
+#define EXFAT_BITMAP_CLUSTER  8
+#define EXFAT_FAT_CLUSTER     9
+#define EXFAT_FAT_EOC         0xFFFFFFFF  /* End of a cluster chain */
+#define EXFAT_FREE_EXTENTS    32          /* Free runs tracked by the summary */
+
+/* Block device holding the volume */
+static vfs_block_device_t* exfat_device = NULL;
+static uint32_t sectors_per_cluster = 0;
+
+/* Allocation bitmap (bit set = cluster in use) and FAT, loaded at init and
+ * written through to disk a sector at a time */
+static uint32_t* alloc_bitmap = NULL;
+static uint32_t* fat_table = NULL;
+static uint32_t fat_clusters = 0;
+
+/* Free-extent summary: the longest free runs of the bitmap. No free run
+ * missing from it is longer than untracked_max, so a request no entry can
+ * satisfy only needs a bitmap rescan when it is at most that long. */
+typedef struct {
+    uint32_t start;
+    uint32_t length;
+} exfat_extent_t;
+
+static exfat_extent_t free_extents[EXFAT_FREE_EXTENTS];
+static uint32_t free_extent_count = 0;
+static uint32_t untracked_max = 0;
+
+/* Bounce buffer for the partial last cluster of a file */
+static uint8_t* tail_buffer = NULL;
+
+/* Read blocks of the disk image */
+static int exfat_image_read_blocks(vfs_block_device_t* device, uint64_t block, uint32_t count, void* buffer) {
+    uint64_t offset = block * EXFAT_SECTOR_SIZE;
+    uint64_t length = (uint64_t)count * EXFAT_SECTOR_SIZE;
+    
+    if (offset + length > disk_size) {
+        return VFS_ERR_IO_ERROR;
+    }
+    
+    memcpy(buffer, &disk_image[offset], length);
+    return count;
+}
+
+/* Write blocks of the disk image */
+static int exfat_image_write_blocks(vfs_block_device_t* device, uint64_t block, uint32_t count, const void* buffer) {
+    uint64_t offset = block * EXFAT_SECTOR_SIZE;
+    uint64_t length = (uint64_t)count * EXFAT_SECTOR_SIZE;
+    
+    if (offset + length > disk_size) {
+        return VFS_ERR_IO_ERROR;
+    }
+    
+    memcpy(&disk_image[offset], buffer, length);
+    return count;
+}
+
+static vfs_block_device_ops_t exfat_image_ops = {
+    .read_blocks = exfat_image_read_blocks,
+    .write_blocks = exfat_image_write_blocks,
+    .sync = NULL,
+};
+
+/* The simulated disk, registered as the exFAT block device */
+static vfs_block_device_t exfat_image_device = {
+    .name = EXFAT_DEVICE_NAME,
+    .block_size = EXFAT_SECTOR_SIZE,
+    .operations = &exfat_image_ops,
+};
+
+/* Read a run of consecutive clusters with one device request */
+static int exfat_read_run(uint32_t cluster, uint32_t count, void* buffer) {
+    if (cluster < 2 || cluster >= fs_info.total_clusters || count == 0 ||
+        count > fs_info.total_clusters - cluster) {
+        return EXFAT_ERR_CORRUPTED;
+    }
+    
+    uint32_t sectors = count * sectors_per_cluster;
+    int result = exfat_device->operations->read_blocks(exfat_device, (uint64_t)cluster * sectors_per_cluster,
+                                                       sectors, buffer);
+    return result == (int)sectors ? EXFAT_SUCCESS : EXFAT_ERR_IO_ERROR;
+}
+
+/* Write a run of consecutive clusters with one device request */
+static int exfat_write_run(uint32_t cluster, uint32_t count, const void* buffer) {
+    if (cluster < 2 || cluster >= fs_info.total_clusters || count == 0 ||
+        count > fs_info.total_clusters - cluster) {
+        return EXFAT_ERR_CORRUPTED;
+    }
+    
+    uint32_t sectors = count * sectors_per_cluster;
+    int result = exfat_device->operations->write_blocks(exfat_device, (uint64_t)cluster * sectors_per_cluster,
+                                                        sectors, buffer);
+    return result == (int)sectors ? EXFAT_SUCCESS : EXFAT_ERR_IO_ERROR;
+}
+
+/* Write the sectors of an on-disk table (bitmap or FAT) covering bytes first..last */
+static int exfat_flush_table(uint32_t table_cluster, const void* table, uint32_t first, uint32_t last) {
+    uint32_t first_sector = first / EXFAT_SECTOR_SIZE;
+    uint32_t count = last / EXFAT_SECTOR_SIZE - first_sector + 1;
+    
+    int result = exfat_device->operations->write_blocks(exfat_device,
+                                                        (uint64_t)table_cluster * sectors_per_cluster + first_sector,
+                                                        count, (const uint8_t*)table + first_sector * EXFAT_SECTOR_SIZE);
+    if (result != (int)count) {
+        log_error("exFAT", "Failed to write table sectors at cluster %u", table_cluster);
+        return EXFAT_ERR_IO_ERROR;
+    }
+    
+    return EXFAT_SUCCESS;
+}
+
+/* Write FAT entries start..start+count-1 to disk */
+static int exfat_flush_fat(uint32_t start, uint32_t count) {
+    return exfat_flush_table(EXFAT_FAT_CLUSTER, fat_table, start * 4, (start + count) * 4 - 1);
+}
+
+static int exfat_cluster_used(uint32_t cluster) {
+    return (alloc_bitmap[cluster / 32] >> (cluster % 32)) & 1;
+}
+
+/* Mark a run of clusters used or free, in memory and on disk */
+static int exfat_bitmap_update(uint32_t start, uint32_t count, int used) {
+    uint32_t end = start + count;
+    
+    for (uint32_t cluster = start; cluster < end; ) {
+        if (cluster % 32 == 0 && end - cluster >= 32) {
+            alloc_bitmap[cluster / 32] = used ? 0xFFFFFFFF : 0;
+            cluster += 32;
+            continue;
+        }
+        
+        if (used) {
+            alloc_bitmap[cluster / 32] |= 1u << (cluster % 32);
+        } else {
+            alloc_bitmap[cluster / 32] &= ~(1u << (cluster % 32));
+        }
+        cluster++;
+    }
+    
+    return exfat_flush_table(EXFAT_BITMAP_CLUSTER, alloc_bitmap, start / 8, (end - 1) / 8);
+}
+
+/* First cluster at or after cluster that is in use (total_clusters if none) */
+static uint32_t exfat_next_used(uint32_t cluster) {
+    while (cluster < fs_info.total_clusters) {
+        if (cluster % 32 == 0 && alloc_bitmap[cluster / 32] == 0) {
+            cluster += 32;
+        } else if (exfat_cluster_used(cluster)) {
+            return cluster;
+        } else {
+            cluster++;
+        }
+    }
+    return fs_info.total_clusters;
+}
+
+/* First cluster at or after cluster that is free (total_clusters if none) */
+static uint32_t exfat_next_free(uint32_t cluster) {
+    while (cluster < fs_info.total_clusters) {
+        if (cluster % 32 == 0 && alloc_bitmap[cluster / 32] == 0xFFFFFFFF) {
+            cluster += 32;
+        } else if (!exfat_cluster_used(cluster)) {
+            return cluster;
+        } else {
+            cluster++;
+        }
+    }
+    return fs_info.total_clusters;
+}
+
+/* Add a free run to the summary, keeping the longest runs when it is full */
+static void exfat_summary_add(uint32_t start, uint32_t length) {
+    if (free_extent_count < EXFAT_FREE_EXTENTS) {
+        free_extents[free_extent_count].start = start;
+        free_extents[free_extent_count].length = length;
+        free_extent_count++;
+        return;
+    }
+    
+    uint32_t shortest = 0;
+    for (uint32_t i = 1; i < free_extent_count; i++) {
+        if (free_extents[i].length < free_extents[shortest].length) {
+            shortest = i;
+        }
+    }
+    
+    /* Whichever run is dropped becomes untracked */
+    uint32_t dropped = length;
+    if (length > free_extents[shortest].length) {
+        dropped = free_extents[shortest].length;
+        free_extents[shortest].start = start;
+        free_extents[shortest].length = length;
+    }
+    if (dropped > untracked_max) {
+        untracked_max = dropped;
+    }
+}
+
+/* Drop the summary entries overlapping clusters start..end-1 */
+static void exfat_summary_remove(uint32_t start, uint32_t end) {
+    for (uint32_t i = 0; i < free_extent_count; ) {
+        if (free_extents[i].start < end && free_extents[i].start + free_extents[i].length > start) {
+            free_extents[i] = free_extents[--free_extent_count];
+        } else {
+            i++;
+        }
+    }
+}
+
+/* Rebuild the summary from the bitmap */
+static void exfat_summary_rebuild(void) {
+    free_extent_count = 0;
+    untracked_max = 0;
+    
+    uint32_t cluster = exfat_next_free(2);
+    while (cluster < fs_info.total_clusters) {
+        uint32_t end = exfat_next_used(cluster);
+        exfat_summary_add(cluster, end - cluster);
+        cluster = exfat_next_free(end);
+    }
+}
+
+/* Summary entry that holds count clusters most tightly (-1 if none does) */
+static int exfat_summary_best_fit(uint32_t count) {
+    int best = -1;
+    
+    for (uint32_t i = 0; i < free_extent_count; i++) {
+        if (free_extents[i].length >= count &&
+            (best < 0 || free_extents[i].length < free_extents[best].length)) {
+            best = i;
+        }
+    }
+    
+    return best;
+}
+
+/* Take count clusters from the front of a summary entry and mark them used */
+static int exfat_summary_take(uint32_t index, uint32_t count, uint32_t* start) {
+    *start = free_extents[index].start;
+    
+    free_extents[index].start += count;
+    free_extents[index].length -= count;
+    if (free_extents[index].length == 0) {
+        free_extents[index] = free_extents[--free_extent_count];
+    }
+    
+    fs_info.free_clusters -= count;
+    return exfat_bitmap_update(*start, count, 1);
+}
+
+/* Mark a run of clusters free and merge it with its free neighbours in the summary */
+static int exfat_free_run(uint32_t start, uint32_t count) {
+    int result = exfat_bitmap_update(start, count, 0);
+    fs_info.free_clusters += count;
+    
+    uint32_t begin = start;
+    while (begin > 2 && !exfat_cluster_used(begin - 1)) {
+        begin--;
+    }
+    uint32_t end = exfat_next_used(start + count);
+    
+    exfat_summary_remove(begin, end);
+    exfat_summary_add(begin, end - begin);
+    
+    return result;
+}
+
+/*
+ * Length of the run of consecutive clusters starting at cluster, at most max
+ * long. next gets the cluster that follows the run in the file. Returns 0
+ * if cluster is not a valid data cluster.
+ */
+static uint32_t exfat_run_length(uint32_t cluster, uint32_t max, uint8_t flags, uint32_t* next) {
+    if (cluster < 2 || cluster >= fs_info.total_clusters) {
+        return 0;
+    }
+    
+    if (flags & EXFAT_FLAG_NO_FAT_CHAIN) {
+        if (max > fs_info.total_clusters - cluster) {
+            return 0;
+        }
+        *next = cluster + max;
+        return max;
+    }
+    
+    uint32_t length = 1;
+    while (length < max && fat_table[cluster + length - 1] == cluster + length) {
+        length++;
+    }
+    *next = fat_table[cluster + length - 1];
+    
+    return length;
+}
+
+/* Clusters allocated to a directory entry (a directory holds one) */
+static uint32_t exfat_entry_clusters(const exfat_file_entry_t* entry) {
+    if (entry->first_cluster == 0) {
+        return 0;
+    }
+    
+    uint32_t count = (entry->size + fs_info.cluster_size - 1) / fs_info.cluster_size;
+    if ((entry->attributes & EXFAT_ATTR_DIRECTORY) || count == 0) {
+        count = 1;
+    }
+    
+    return count;
+}
+
+/* Free the clusters of a file, walking its FAT chain unless it has none */
+static int exfat_free_clusters(uint32_t first_cluster, uint32_t count, uint8_t flags) {
+    uint32_t cluster = first_cluster;
+    
+    while (count > 0) {
+        uint32_t next = 0;
+        uint32_t run = exfat_run_length(cluster, count, flags, &next);
+        if (run == 0) {
+            log_error("exFAT", "Broken cluster chain at %u", cluster);
+            return EXFAT_ERR_CORRUPTED;
+        }
+        
+        if (!(flags & EXFAT_FLAG_NO_FAT_CHAIN)) {
+            memset(&fat_table[cluster], 0, run * sizeof(uint32_t));
+            exfat_flush_fat(cluster, run);
+        }
+        
+        int result = exfat_free_run(cluster, run);
+        if (result != EXFAT_SUCCESS) {
+            return result;
+        }
+        
+        count -= run;
+        cluster = next;
+    }
+    
+    return EXFAT_SUCCESS;
+}
+
+/*
+ * Allocate clusters for a file. One free run that fits is preferred: the
+ * file then needs no FAT chain (NoFatChain) and moves in single I/Os.
+ * Otherwise the longest free runs are linked through the FAT, so the chain
+ * has as few pieces as possible.
+ */
+static int exfat_alloc_clusters(uint32_t count, uint32_t* first_cluster, uint8_t* flags) {
+    if (count == 0 || count > fs_info.free_clusters) {
+        return EXFAT_ERR_NO_SPACE;
+    }
+    
+    int best = exfat_summary_best_fit(count);
+    if (best < 0 && count <= untracked_max) {
+        exfat_summary_rebuild();
+        best = exfat_summary_best_fit(count);
+    }
+    
+    if (best >= 0) {
+        *flags = EXFAT_FLAG_NO_FAT_CHAIN;
+        return exfat_summary_take(best, count, first_cluster);
+    }
+    
+    uint32_t first = 0;
+    uint32_t last = 0;
+    uint32_t remaining = count;
+    
+    while (remaining > 0) {
+        if (free_extent_count == 0) {
+            exfat_summary_rebuild();
+        }
+        if (free_extent_count == 0) {
+            log_error("exFAT", "Allocation bitmap disagrees with the free cluster count");
+            if (first != 0) {
+                exfat_free_clusters(first, count - remaining, 0);
+            }
+            return EXFAT_ERR_CORRUPTED;
+        }
+        
+        uint32_t longest = 0;
+        for (uint32_t i = 1; i < free_extent_count; i++) {
+            if (free_extents[i].length > free_extents[longest].length) {
+                longest = i;
+            }
+        }
+        
+        uint32_t take = free_extents[longest].length < remaining ? free_extents[longest].length : remaining;
+        uint32_t start;
+        int result = exfat_summary_take(longest, take, &start);
+        if (result != EXFAT_SUCCESS) {
+            return result;
+        }
+        
+        /* Chain the piece and hook it onto the previous one */
+        for (uint32_t cluster = start; cluster < start + take - 1; cluster++) {
+            fat_table[cluster] = cluster + 1;
+        }
+        fat_table[start + take - 1] = EXFAT_FAT_EOC;
+        exfat_flush_fat(start, take);
+        
+        if (first == 0) {
+            first = start;
+        } else {
+            fat_table[last] = start;
+            exfat_flush_fat(last, 1);
+        }
+        
+        last = start + take - 1;
+        remaining -= take;
+    }
+    
+    *first_cluster = first;
+    *flags = 0;
+    return EXFAT_SUCCESS;
+}
+
+/* Load the allocation bitmap and FAT and build the free-extent summary */
+static int exfat_load_tables(void) {
+    uint32_t bitmap_bytes = (fs_info.total_clusters + 7) / 8;
+    if (bitmap_bytes > fs_info.cluster_size) {
+        return EXFAT_ERR_BAD_FORMAT;
+    }
+    
+    fat_clusters = (fs_info.total_clusters * 4 + fs_info.cluster_size - 1) / fs_info.cluster_size;
+    
+    alloc_bitmap = (uint32_t*)malloc(fs_info.cluster_size);
+    fat_table = (uint32_t*)malloc(fat_clusters * fs_info.cluster_size);
+    tail_buffer = (uint8_t*)malloc(fs_info.cluster_size);
+    if (!alloc_bitmap || !fat_table || !tail_buffer) {
+        return EXFAT_ERR_NO_SPACE;
+    }
+    
+    int result = exfat_read_run(EXFAT_BITMAP_CLUSTER, 1, alloc_bitmap);
+    if (result == EXFAT_SUCCESS) {
+        result = exfat_read_run(EXFAT_FAT_CLUSTER, fat_clusters, fat_table);
+    }
+    if (result != EXFAT_SUCCESS) {
+        return result;
+    }
+    
+    fs_info.free_clusters = 0;
+    for (uint32_t cluster = 2; cluster < fs_info.total_clusters; cluster++) {
+        if (!exfat_cluster_used(cluster)) {
+            fs_info.free_clusters++;
+        }
+    }
+    
+    exfat_summary_rebuild();
+    return EXFAT_SUCCESS;
+}
+
 /* Helper function to parse a path into components */
 static int parse_path(const char* path, char* dir_path, char* filename) {
     const char* last_slash = strrchr(path, '/');
@@ -67,8 +524,9 @@ int exfat_init(const char* device) {
     fs_info.bytes_per_sector = 512;
     fs_info.cluster_size = 4096; /* 8 sectors per cluster */
     fs_info.total_clusters = (disk_size / fs_info.cluster_size);
-    fs_info.free_clusters = fs_info.total_clusters - 10; /* Reserve some clusters for system structures */
+    fs_info.free_clusters = 0; /* Counted from the allocation bitmap below */
     fs_info.root_dir_cluster = 2; /* Root directory starts at cluster 2 */
+    sectors_per_cluster = fs_info.cluster_size / EXFAT_SECTOR_SIZE;
     
     /* Create a simple directory structure in the root directory */
     exfat_file_entry_t root_entries[3];
@@ -77,6 +535,7 @@ int exfat_init(const char* device) {
     strcpy(root_entries[0].name, "README.TXT");
     root_entries[0].size = 37;
     root_entries[0].attributes = EXFAT_ATTR_ARCHIVE;
+    root_entries[0].flags = EXFAT_FLAG_NO_FAT_CHAIN;
     root_entries[0].first_cluster = 3;
     root_entries[0].create_date = 0x5345; /* Some date value */
     root_entries[0].create_time = 0x6123; /* Some time value */
@@ -92,6 +551,7 @@ int exfat_init(const char* device) {
     strcpy(root_entries[1].name, "SYSTEM");
     root_entries[1].size = 0; /* Directories have size 0 */
     root_entries[1].attributes = EXFAT_ATTR_DIRECTORY;
+    root_entries[1].flags = EXFAT_FLAG_NO_FAT_CHAIN;
     root_entries[1].first_cluster = 4;
     root_entries[1].create_date = 0x5345;
     root_entries[1].create_time = 0x6123;
@@ -103,6 +563,7 @@ int exfat_init(const char* device) {
     strcpy(root_entries[2].name, "LOGS");
     root_entries[2].size = 0; /* Directories have size 0 */
     root_entries[2].attributes = EXFAT_ATTR_DIRECTORY;
+    root_entries[2].flags = EXFAT_FLAG_NO_FAT_CHAIN;
     root_entries[2].first_cluster = 5;
     root_entries[2].create_date = 0x5345;
     root_entries[2].create_time = 0x6123;
@@ -119,6 +580,7 @@ int exfat_init(const char* device) {
     strcpy(system_entries[0].name, "CONFIG.SYS");
     system_entries[0].size = 15;
     system_entries[0].attributes = EXFAT_ATTR_ARCHIVE;
+    system_entries[0].flags = EXFAT_FLAG_NO_FAT_CHAIN;
     system_entries[0].first_cluster = 6;
     system_entries[0].create_date = 0x5345;
     system_entries[0].create_time = 0x6123;
@@ -139,6 +601,7 @@ int exfat_init(const char* device) {
     strcpy(logs_entries[0].name, "SYSTEM.LOG");
     logs_entries[0].size = 22;
     logs_entries[0].attributes = EXFAT_ATTR_ARCHIVE;
+    logs_entries[0].flags = EXFAT_FLAG_NO_FAT_CHAIN;
     logs_entries[0].first_cluster = 7;
     logs_entries[0].create_date = 0x5345;
     logs_entries[0].create_time = 0x6123;
@@ -154,8 +617,32 @@ int exfat_init(const char* device) {
     char* log_content = "System startup log...\r\n";
     memcpy(&disk_image[7 * fs_info.cluster_size], log_content, strlen(log_content));
     
+    /* Allocation bitmap: everything up to the end of the FAT is in use, the FAT itself starts out empty */
+    uint32_t first_free = EXFAT_FAT_CLUSTER + (fs_info.total_clusters * 4 + fs_info.cluster_size - 1) / fs_info.cluster_size;
+    uint8_t* bitmap = &disk_image[EXFAT_BITMAP_CLUSTER * fs_info.cluster_size];
+    for (uint32_t cluster = 0; cluster < first_free; cluster++) {
+        bitmap[cluster / 8] |= 1 << (cluster % 8);
+    }
+    
+    /* File data moves through the block device from here on */
+    exfat_image_device.block_count = disk_size / EXFAT_SECTOR_SIZE;
+    if (vfs_register_block_device(&exfat_image_device) != VFS_SUCCESS) {
+        log_error("exFAT", "Failed to register the exFAT block device");
+        return EXFAT_ERR_IO_ERROR;
+    }
+    exfat_device = &exfat_image_device;
+    
+    int result = exfat_load_tables();
+    if (result != EXFAT_SUCCESS) {
+        log_error("exFAT", "Failed to load the allocation bitmap and FAT: %d", result);
+        return result;
+    }
+    
+    dcache_ns = vfs_dcache_namespace();
+    
     exfat_initialized = 1;
-    log_info("exFAT", "exFAT filesystem initialized successfully");
+    log_info("exFAT", "exFAT filesystem initialized successfully (%u of %u clusters free, %u free extents)",
+             fs_info.free_clusters, fs_info.total_clusters, free_extent_count);
     
     return EXFAT_SUCCESS;
 }
@@ -260,99 +747,62 @@ int exfat_get_file_size(const char* path) {
     return EXFAT_ERR_NOT_FOUND;
 }
 
+/* Find a name in a directory cluster (dentry cache lookup callback) */
+static int exfat_dir_lookup(void* context, uint64_t parent, const char* name, uint64_t* child) {
+    if (!(parent & EXFAT_HANDLE_DIR)) {
+        return VFS_ERR_NOT_DIR;
+    }
+    
+    uint32_t dir_cluster = (uint32_t)parent;
+    if (dir_cluster >= fs_info.total_clusters) {
+        return VFS_ERR_IO_ERROR;
+    }
+    
+    /* Scan the directory's entries in place */
+    exfat_file_entry_t* dir_data = (exfat_file_entry_t*)&disk_image[dir_cluster * fs_info.cluster_size];
+    uint32_t max_entries = fs_info.cluster_size / sizeof(exfat_file_entry_t);
+    
+    for (uint32_t i = 0; i < max_entries && dir_data[i].name[0] != '\0'; i++) {
+        if (strcmp(dir_data[i].name, name) == 0) {
+            *child = dir_data[i].first_cluster;
+            if (dir_data[i].attributes & EXFAT_ATTR_DIRECTORY) {
+                *child |= EXFAT_HANDLE_DIR;
+            }
+            return VFS_SUCCESS;
+        }
+    }
+    
+    return VFS_ERR_NOT_FOUND;
+}
+
 /* Convert a path to a cluster number */
 int exfat_path_to_cluster(const char* path) {
     if (!exfat_initialized || !path) {
         return EXFAT_ERR_INVALID_ARG;
     }
     
-    /* Handle root directory */
-    if (strcmp(path, "/") == 0 || strcmp(path, "") == 0) {
-        return fs_info.root_dir_cluster;
-    }
-    
-    /* Skip leading slash if present */
-    if (path[0] == '/') {
-        path++;
-    }
-    
-    /* Start from root directory */
-    int current_cluster = fs_info.root_dir_cluster;
-    
-    /* Parse path components */
-    char component[256];
-    int i = 0, j = 0;
-    
-    while (path[i]) {
-        if (path[i] == '/') {
-            /* End of component */
-            component[j] = '\0';
-            j = 0;
-            
-            /* Find this component in the current directory */
-            exfat_file_entry_t entries[EXFAT_MAX_ENTRIES];
-            char current_path[256] = "/";
-            int found = 0;
-            
-            int count = exfat_list_directory(current_path, entries, EXFAT_MAX_ENTRIES);
-            if (count < 0) {
-                return count;
-            }
-            
-            for (int k = 0; k < count; k++) {
-                if (strcmp(entries[k].name, component) == 0) {
-                    if (!(entries[k].attributes & EXFAT_ATTR_DIRECTORY)) {
-                        return EXFAT_ERR_NOT_DIR;
-                    }
-                    
-                    current_cluster = entries[k].first_cluster;
-                    found = 1;
-                    break;
-                }
-            }
-            
-            if (!found) {
-                return EXFAT_ERR_NOT_FOUND;
-            }
-            
-            i++; /* Skip the slash */
-        } else {
-            /* Add character to current component */
-            component[j++] = path[i++];
-            if (j >= 255) {
-                return EXFAT_ERR_INVALID_ARG;
-            }
-        }
-    }
+    /* Walk the path from the root directory, through the dentry cache */
+    uint64_t handle;
+    int result = vfs_dcache_resolve(dcache_ns, fs_info.root_dir_cluster | EXFAT_HANDLE_DIR,
+                                    path, exfat_dir_lookup, NULL, &handle);
     
-    /* Handle the last component */
-    if (j > 0) {
-        component[j] = '\0';
-        
-        /* Find this component in the current directory */
-        exfat_file_entry_t entries[EXFAT_MAX_ENTRIES];
-        char current_path[256] = "/";
-        int found = 0;
-        
-        int count = exfat_list_directory(current_path, entries, EXFAT_MAX_ENTRIES);
-        if (count < 0) {
-            return count;
-        }
-        
-        for (int k = 0; k < count; k++) {
-            if (strcmp(entries[k].name, component) == 0) {
-                current_cluster = entries[k].first_cluster;
-                found = 1;
-                break;
-            }
-        }
-        
-        if (!found) {
+    switch (result) {
+        case VFS_SUCCESS:
+            return (int)(uint32_t)handle;
+        case VFS_ERR_NOT_FOUND:
             return EXFAT_ERR_NOT_FOUND;
-        }
+        case VFS_ERR_NOT_DIR:
+            return EXFAT_ERR_NOT_DIR;
+        case VFS_ERR_INVALID_ARG:
+            return EXFAT_ERR_INVALID_ARG;
+        default:
+            return EXFAT_ERR_IO_ERROR;
     }
-    
-    return current_cluster;
+}
+
+/* Get the dentry cache namespace of the volume */
+uint32_t exfat_get_dcache_namespace(void) {
+    return dcache_ns;
 }
 
 /* Read a file from the filesystem */
@@ -391,35 +841,66 @@ int exfat_read_file(const char* path, void* buffer, uint32_t size) {
     }
     
     /* Search for file */
-    int file_found = 0;
-    uint32_t file_size = 0;
-    uint32_t file_cluster = 0;
+    exfat_file_entry_t* file = NULL;
     
     for (int i = 0; i < count; i++) {
         if (strcmp(entries[i].name, filename) == 0) {
-            file_found = 1;
-            file_size = entries[i].size;
-            file_cluster = entries[i].first_cluster;
+            file = &entries[i];
             break;
         }
     }
     
-    if (!file_found) {
+    if (!file) {
         return EXFAT_ERR_NOT_FOUND;
     }
     
     /* Check if the file is a directory */
-    if (file_size == 0 && file_cluster > 0) {
+    if (file->attributes & EXFAT_ATTR_DIRECTORY) {
         return EXFAT_ERR_NOT_FILE;
     }
     
     /* Check the buffer size */
+    uint32_t file_size = file->size;
     if (size < file_size) {
         return EXFAT_ERR_NO_SPACE;
     }
     
-    /* Read data from the file's clusters */
-    memcpy(buffer, &disk_image[file_cluster * fs_info.cluster_size], file_size);
+    /* Read the file run by run: whole clusters go straight into the buffer,
+     * the partial last cluster through the bounce buffer */
+    uint8_t* out = (uint8_t*)buffer;
+    uint32_t cluster_count = exfat_entry_clusters(file);
+    uint32_t full_clusters = file_size / fs_info.cluster_size;
+    uint32_t cluster = file->first_cluster;
+    uint32_t done = 0;
+    
+    while (done < cluster_count) {
+        uint32_t next = 0;
+        uint32_t run = exfat_run_length(cluster, cluster_count - done, file->flags, &next);
+        if (run == 0) {
+            log_error("exFAT", "Broken cluster chain in %s", path);
+            return EXFAT_ERR_CORRUPTED;
+        }
+        
+        uint32_t direct = (done + run > full_clusters) ? full_clusters - done : run;
+        if (direct > 0) {
+            result = exfat_read_run(cluster, direct, out + done * fs_info.cluster_size);
+            if (result != EXFAT_SUCCESS) {
+                return result;
+            }
+        }
+        
+        if (direct < run) {
+            result = exfat_read_run(cluster + direct, 1, tail_buffer);
+            if (result != EXFAT_SUCCESS) {
+                return result;
+            }
+            memcpy(out + full_clusters * fs_info.cluster_size, tail_buffer,
+                   file_size - full_clusters * fs_info.cluster_size);
+        }
+        
+        done += run;
+        cluster = next;
+    }
     
     return file_size;
 }
@@ -461,14 +942,12 @@ int exfat_write_file(const char* path, const void* buffer, uint32_t size, uint32
     
     /* Search for existing file */
     int file_found = 0;
-    uint32_t file_size = 0;
     uint32_t file_cluster = 0;
     int file_index = -1;
     
     for (int i = 0; i < count; i++) {
         if (strcmp(entries[i].name, filename) == 0) {
             file_found = 1;
-            file_size = entries[i].size;
             file_cluster = entries[i].first_cluster;
             file_index = i;
             break;
@@ -480,16 +959,78 @@ int exfat_write_file(const char* path, const void* buffer, uint32_t size, uint32
         return EXFAT_ERR_NOT_FOUND;
     }
     
-    /* Allocate a new cluster if needed */
-    if (!file_found || (flags & EXFAT_WRITE_TRUNCATE)) {
-        file_cluster = exfat_allocate_cluster();
-        if (file_cluster <= 0) {
-            return EXFAT_ERR_NO_SPACE;
+    if (file_found && (entries[file_index].attributes & EXFAT_ATTR_DIRECTORY)) {
+        return EXFAT_ERR_NOT_FILE;
+    }
+    
+    uint32_t needed = (size + fs_info.cluster_size - 1) / fs_info.cluster_size;
+    uint32_t old_cluster = file_cluster;
+    uint8_t file_flags = file_found ? entries[file_index].flags : EXFAT_FLAG_NO_FAT_CHAIN;
+    
+    uint32_t old_clusters = file_found ? exfat_entry_clusters(&entries[file_index]) : 0;
+    uint8_t old_flags = file_flags;
+    
+    /* Keep the clusters of a file that stays the same size in clusters.
+     * Otherwise write the data to new clusters and free the old ones only
+     * once the entry points at the new ones, so a failed write (ENOSPC
+     * included) leaves the old contents in place. */
+    int reallocate = !file_found || old_clusters != needed;
+    if (reallocate) {
+        file_cluster = 0;
+        file_flags = EXFAT_FLAG_NO_FAT_CHAIN;
+        
+        if (needed > 0) {
+            result = exfat_alloc_clusters(needed, &file_cluster, &file_flags);
+            if (result != EXFAT_SUCCESS) {
+                return result;
+            }
+        }
+    }
+    
+    /* Write the data run by run, padding the last cluster with zeroes */
+    const uint8_t* in = (const uint8_t*)buffer;
+    uint32_t full_clusters = size / fs_info.cluster_size;
+    uint32_t cluster = file_cluster;
+    uint32_t done = 0;
+    
+    while (done < needed) {
+        uint32_t next = 0;
+        uint32_t run = exfat_run_length(cluster, needed - done, file_flags, &next);
+        if (run == 0) {
+            log_error("exFAT", "Broken cluster chain in %s", path);
+            result = EXFAT_ERR_CORRUPTED;
+            break;
+        }
+        
+        uint32_t direct = (done + run > full_clusters) ? full_clusters - done : run;
+        if (direct > 0) {
+            result = exfat_write_run(cluster, direct, in + done * fs_info.cluster_size);
+            if (result != EXFAT_SUCCESS) {
+                break;
+            }
+        }
+        
+        if (direct < run) {
+            uint32_t tail = size - full_clusters * fs_info.cluster_size;
+            memcpy(tail_buffer, in + full_clusters * fs_info.cluster_size, tail);
+            memset(tail_buffer + tail, 0, fs_info.cluster_size - tail);
+            result = exfat_write_run(cluster + direct, 1, tail_buffer);
+            if (result != EXFAT_SUCCESS) {
+                break;
+            }
         }
+        
+        done += run;
+        cluster = next;
     }
     
-    /* Write data to the file's clusters */
-    memcpy(&disk_image[file_cluster * fs_info.cluster_size], buffer, size);
+    if (result != EXFAT_SUCCESS) {
+        /* The entry still points at the old clusters: drop the new ones */
+        if (reallocate && file_cluster != 0) {
+            exfat_free_clusters(file_cluster, needed, file_flags);
+        }
+        return result;
+    }
     
     /* Update directory entry */
     if (!file_found) {
@@ -498,6 +1039,7 @@ int exfat_write_file(const char* path, const void* buffer, uint32_t size, uint32
         strcpy(new_entry.name, filename);
         new_entry.size = size;
         new_entry.attributes = EXFAT_ATTR_ARCHIVE;
+        new_entry.flags = file_flags;
         new_entry.first_cluster = file_cluster;
         new_entry.create_date = 0x5345;  /* Some date value */
         new_entry.create_time = 0x6123;  /* Some time value */
@@ -512,6 +1054,7 @@ int exfat_write_file(const char* path, const void* buffer, uint32_t size, uint32
     } else {
         /* Update existing entry */
         entries[file_index].size = size;
+        entries[file_index].flags = file_flags;
         entries[file_index].first_cluster = file_cluster;
         entries[file_index].last_modified_date = 0x5345;
         entries[file_index].last_modified_time = 0x6123;
@@ -521,6 +1064,19 @@ int exfat_write_file(const char* path, const void* buffer, uint32_t size, uint32
                entries, count * sizeof(exfat_file_entry_t));
     }
     
+    /* The new data is reachable now, so the old clusters can go */
+    if (file_found && reallocate && old_cluster != 0) {
+        result = exfat_free_clusters(old_cluster, old_clusters, old_flags);
+        if (result != EXFAT_SUCCESS) {
+            log_warning("exFAT", "Could not free the old clusters of %s", path);
+        }
+    }
+    
+    /* The name now exists, or maps to a new cluster */
+    if (!file_found || file_cluster != old_cluster) {
+        vfs_dcache_invalidate_name(dcache_ns, filename);
+    }
+    
     return size;
 }
 
@@ -611,6 +1167,7 @@ int exfat_mkdir(const char* path, uint16_t mode) {
     strcpy(new_entry.name, dirname);
     new_entry.size = 0;  /* Directories have size 0 */
     new_entry.attributes = EXFAT_ATTR_DIRECTORY;
+    new_entry.flags = EXFAT_FLAG_NO_FAT_CHAIN;
     new_entry.first_cluster = new_cluster;
     new_entry.create_date = 0x5345;  /* Some date value */
     new_entry.create_time = 0x6123;  /* Some time value */
@@ -630,6 +1187,9 @@ int exfat_mkdir(const char* path, uint16_t mode) {
     memcpy(&disk_image[parent_cluster * fs_info.cluster_size + count * sizeof(exfat_file_entry_t)],
            &new_entry, sizeof(exfat_file_entry_t));
     
+    /* A negative entry for the name may be cached */
+    vfs_dcache_invalidate_name(dcache_ns, dirname);
+    
     return EXFAT_SUCCESS;
 }
 
@@ -677,6 +1237,8 @@ int exfat_remove(const char* path) {
     int file_found = 0;
     int file_index = -1;
     uint32_t file_cluster = 0;
+    uint32_t file_clusters = 0;
+    uint8_t file_flags = 0;
     uint8_t is_directory = 0;
     
     for (int i = 0; i < count; i++) {
@@ -684,6 +1246,8 @@ int exfat_remove(const char* path) {
             file_found = 1;
             file_index = i;
             file_cluster = entries[i].first_cluster;
+            file_clusters = exfat_entry_clusters(&entries[i]);
+            file_flags = entries[i].flags;
             is_directory = (entries[i].attributes & EXFAT_ATTR_DIRECTORY) ? 1 : 0;
             break;
         }
@@ -703,8 +1267,13 @@ int exfat_remove(const char* path) {
         }
     }
     
-    /* Mark the cluster as free (in a real filesystem, update FAT table) */
-    exfat_free_cluster(file_cluster);
+    /* Give the clusters back to the allocator */
+    if (file_cluster != 0) {
+        result = exfat_free_clusters(file_cluster, file_clusters, file_flags);
+        if (result != EXFAT_SUCCESS) {
+            return result;
+        }
+    }
     
     /* Remove entry by shifting all following entries */
     if (file_index < count - 1) {
@@ -719,6 +1288,13 @@ int exfat_remove(const char* path) {
     memcpy(&disk_image[parent_cluster * fs_info.cluster_size],
            entries, count * sizeof(exfat_file_entry_t));
     
+    /* A removed directory's cluster may be reused, so forget everything below it too */
+    if (is_directory) {
+        vfs_dcache_invalidate_namespace(dcache_ns);
+    } else {
+        vfs_dcache_invalidate_name(dcache_ns, filename);
+    }
+    
     return EXFAT_SUCCESS;
 }
 
@@ -806,6 +1382,9 @@ int exfat_rename(const char* old_path, const char* new_path) {
     memcpy(&disk_image[parent_cluster * fs_info.cluster_size],
            entries, count * sizeof(exfat_file_entry_t));
     
+    vfs_dcache_invalidate_name(dcache_ns, old_filename);
+    vfs_dcache_invalidate_name(dcache_ns, new_filename);
+    
     return EXFAT_SUCCESS;
 }
 
@@ -828,10 +1407,7 @@ int exfat_read_cluster(uint32_t cluster, void* buffer) {
         return EXFAT_ERR_INVALID_ARG;
     }
     
-    /* Copy cluster data */
-    memcpy(buffer, &disk_image[cluster * fs_info.cluster_size], fs_info.cluster_size);
-    
-    return EXFAT_SUCCESS;
+    return exfat_read_run(cluster, 1, buffer);
 }
 
 /* Write a cluster to disk */
@@ -841,10 +1417,7 @@ int exfat_write_cluster(uint32_t cluster, const void* buffer) {
         return EXFAT_ERR_INVALID_ARG;
     }
     
-    /* Copy cluster data */
-    memcpy(&disk_image[cluster * fs_info.cluster_size], buffer, fs_info.cluster_size);
-    
-    return EXFAT_SUCCESS;
+    return exfat_write_run(cluster, 1, buffer);
 }
 
 /* Allocate a cluster for a new file or directory */
@@ -853,30 +1426,28 @@ int exfat_allocate_cluster(void) {
         return EXFAT_ERR_INVALID_ARG;
     }
     
-    /* In a real filesystem, we would search the FAT for a free cluster.
-     * For this simplified implementation, just use the next available cluster. */
-    static uint32_t next_free_cluster = 8; /* First 8 clusters are used already */
-    
-    if (next_free_cluster >= fs_info.total_clusters) {
-        return EXFAT_ERR_NO_SPACE;
+    uint32_t cluster;
+    uint8_t flags;
+    int result = exfat_alloc_clusters(1, &cluster, &flags);
+    if (result != EXFAT_SUCCESS) {
+        return result;
     }
     
-    uint32_t allocated_cluster = next_free_cluster++;
-    fs_info.free_clusters--;
-    
-    return allocated_cluster;
+    return cluster;
 }
 
 /* Free a previously allocated cluster */
 int exfat_free_cluster(uint32_t cluster) {
-    if (!exfat_initialized || cluster < 2 || cluster >= fs_info.total_clusters) {
+    if (!exfat_initialized || cluster < 2 || cluster >= fs_info.total_clusters ||
+        !exfat_cluster_used(cluster)) {
         return EXFAT_ERR_INVALID_ARG;
     }
     
-    /* In a real filesystem, mark the cluster as free in the FAT.
-     * For this simplified implementation, just clear the cluster data. */
-    memset(&disk_image[cluster * fs_info.cluster_size], 0, fs_info.cluster_size);
-    fs_info.free_clusters++;
+    /* Drop it from any FAT chain it was linked into */
+    if (fat_table[cluster] != 0) {
+        fat_table[cluster] = 0;
+        exfat_flush_fat(cluster, 1);
+    }
     
-    return EXFAT_SUCCESS;
-}
\ No newline at end of file
+    return exfat_free_run(cluster, 1);
+}
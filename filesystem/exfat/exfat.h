@@ -32,6 +32,9 @@
 #define EXFAT_WRITE_APPEND    0x04
 #define EXFAT_WRITE_SYNC      0x08
 
+/* exFAT Allocation Flags (GeneralSecondaryFlags of the stream extension) */
+#define EXFAT_FLAG_NO_FAT_CHAIN 0x02   /* Clusters are one contiguous run, the FAT is not used */
+
 /* exFAT Constants */
 #define EXFAT_MAX_ENTRIES     64
 
@@ -51,6 +54,7 @@ typedef struct {
     char name[256];             /* File name */
     uint32_t size;              /* File size in bytes */
     uint8_t attributes;         /* File attributes */
+    uint8_t flags;              /* Allocation flags (EXFAT_FLAG_*) */
     uint32_t first_cluster;     /* First cluster of file data */
     uint16_t create_date;       /* Creation date */
     uint16_t create_time;       /* Creation time */
@@ -71,6 +75,9 @@ int exfat_get_file_size(const char* path);
 /* Convert a path to a cluster number */
 int exfat_path_to_cluster(const char* path);
 
+/* Get the dentry cache namespace of the volume */
+uint32_t exfat_get_dcache_namespace(void);
+
 /* Read a file from the filesystem */
 int exfat_read_file(const char* path, void* buffer, uint32_t size);
 
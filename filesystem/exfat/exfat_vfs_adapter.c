@@ -99,6 +99,9 @@ static int exfat_vfs_mount(vfs_mount_t* mount) {
     /* No special mount data needed for exFAT */
     mount->fs_data = NULL;
     
+    /* Path lookups and the VFS share the volume's dentry cache namespace */
+    mount->dcache_ns = exfat_get_dcache_namespace();
+    
     return VFS_SUCCESS;
 }
 
@@ -3,10 +3,21 @@
 #include <stddef.h>
 #include <string.h>
 #include "../../kernel/io.h"
+#include "../../kernel/logging/log.h"
+#include "../vfs/vfs.h"
 
 #define BLOCK_SIZE 1024
 #define EXT2_SUPER_MAGIC 0xEF53
 #define ROOT_INODE 2
+#define EXT2_FIRST_INO 11          // First non-reserved inode
+#define EXT2_MAX_GROUPS 128        // Block groups the descriptor cache holds
+#define EXT2_GOAL_SEARCH 64        // Blocks after the goal tried before looking for a free stretch
+#define EXT2_PREALLOC_BLOCKS 8     // First window reserved ahead of a file being appended
+#define EXT2_PREALLOC_MAX 64       // Windows double up to this while a file keeps using them
+#define EXT2_PREALLOC_WINDOWS 16   // Files with a preallocation window at once
+#define EXT2_DIR_INDEX_SLOTS 8     // Directories with an in-memory name index at once
+#define EXT2_DIR_INDEX_MIN_BLOCKS 2 // Smaller directories are just scanned
+#define EXT2_DIR_INDEX_MIN_SIZE 256 // Initial name index table size (a power of two)
 
 // Core filesystem structures
 static ext2_superblock_t superblock;
@@ -30,6 +41,72 @@ typedef struct {
 // In-memory cache of group descriptors
 static ext2_group_desc_t* group_descs = NULL;
 
+// Block and inode bitmaps of each group, read on first use and kept. Changes
+// stay in memory until ext2_update_fs_metadata() writes them back.
+typedef struct {
+    uint32_t* block_bitmap;  // NULL until loaded
+    uint32_t* inode_bitmap;
+    uint8_t block_dirty;
+    uint8_t inode_dirty;
+} ext2_group_bitmaps_t;
+
+static ext2_group_bitmaps_t group_bitmaps[EXT2_MAX_GROUPS];
+
+// Bitmaps, group descriptors or superblock counts changed since the last write-back
+static int metadata_dirty = 0;
+
+// Blocks reserved in the bitmap right after the last block of a file being
+// appended, handed out while its writes continue there. Released when the
+// file is closed, truncated or removed, or when the window is recycled.
+typedef struct {
+    uint32_t inode_num;      // Owner (0 if unused)
+    uint32_t start;          // Next reserved block
+    uint32_t count;          // Reserved blocks left
+    uint32_t size;           // Blocks reserved when the window was opened
+    uint32_t last_used;      // Allocation clock, to recycle the stalest window
+} ext2_prealloc_t;
+
+static ext2_prealloc_t prealloc_windows[EXT2_PREALLOC_WINDOWS];
+static uint32_t prealloc_clock = 0;
+
+// Name hashes of directories without an htree index, built by the first
+// lookup that scans one. A table entry records that a name with this hash is
+// in this block; hits are checked against the block, so entries left behind
+// by removed names only cost a read. Names added by ext2_add_dir_entry() are
+// recorded as they go in.
+typedef struct {
+    uint32_t hash;
+    uint32_t block;          // Directory block index + 1 (0 for an empty slot)
+} ext2_dir_index_entry_t;
+
+typedef struct {
+    uint32_t inode_num;      // Directory (0 if unused)
+    uint32_t size;           // Directory size the table describes
+    uint32_t mask;           // Table size - 1
+    uint32_t count;          // Entries in the table
+    uint32_t last_used;      // Lookup clock, to recycle the stalest slot
+    ext2_dir_index_entry_t* table;
+} ext2_dir_index_t;
+
+static ext2_dir_index_t dir_indexes[EXT2_DIR_INDEX_SLOTS];
+static uint32_t dir_index_clock = 0;
+
+// Last indirect block seen at each level of a block map walk. Sequential
+// access hits the same indirect blocks over and over, so keeping them turns
+// one data block read into one device read instead of up to four.
+typedef struct {
+    uint32_t block_num;      // Cached filesystem block (0 if empty)
+    uint32_t entries[1024];  // Block pointers (max block size / 4)
+} ext2_indirect_cache_t;
+
+static ext2_indirect_cache_t indirect_cache[3];
+
+// Device block reads issued, for the throughput benchmark
+static uint32_t ext2_block_reads = 0;
+
+// Dentry cache namespace for this volume (handles are inode numbers)
+static uint32_t dcache_ns = 0;
+
 // Forward declarations for internal functions
 static int read_block(uint32_t block_num, void* buffer);
 static int write_block(uint32_t block_num, const void* buffer);
@@ -37,12 +114,36 @@ static int read_inode(uint32_t inode_num, ext2_inode_t* inode);
 static int write_inode(uint32_t inode_num, const ext2_inode_t* inode);
 static uint32_t path_to_inode(const char* path);
 static int read_file_block(ext2_inode_t* inode, uint32_t block_index, void* buffer);
+static int map_file_block(uint32_t inode_num, ext2_inode_t* inode, uint32_t block_index, int create,
+                          uint32_t* block_num, int* allocated);
+static int ext2_get_or_allocate_block(uint32_t inode_num, ext2_inode_t* inode, uint32_t block_index, uint32_t* block_num);
+static uint32_t ext2_allocate_block(uint32_t goal);
+static int ext2_free_block(uint32_t block_num);
+static uint32_t ext2_allocate_inode(uint32_t parent_inode, uint16_t mode);
+static int ext2_free_inode(uint32_t inode_num, uint16_t mode);
+static uint32_t ext2_inode_goal(uint32_t inode_num);
+static uint32_t ext2_block_goal(uint32_t inode_num, ext2_inode_t* inode, uint32_t block_index);
+static uint32_t ext2_allocate_data_block(uint32_t inode_num, uint32_t goal);
+static void ext2_free_file_blocks(uint32_t inode_num, ext2_inode_t* inode);
+static int ext2_update_fs_metadata(void);
+static int ext2_find_dir_entry(uint32_t dir_num, ext2_inode_t* dir, const char* name, uint32_t name_len,
+                               uint8_t* buffer, uint32_t* block_index);
+static int ext2_add_dir_entry(uint32_t dir_num, ext2_inode_t* dir, const char* name, uint32_t inode_num, uint8_t file_type);
+static int ext2_remove_dir_entry(uint32_t dir_num, ext2_inode_t* dir, const char* name);
+static void ext2_dir_index_drop(uint32_t dir_num);
 static int parse_path(const char* path, char* dir_path, char* filename);
 
 int ext2_init(const char* device) {
     // Save device path
     device_path = (char*)device;
     
+    // Names cached for a previously mounted volume are meaningless now
+    if (dcache_ns == 0) {
+        dcache_ns = vfs_dcache_namespace();
+    } else {
+        vfs_dcache_invalidate_namespace(dcache_ns);
+    }
+    
     // Read superblock (located at offset 1024 bytes)
     uint8_t sb_buffer[1024];
     if (read_block(1, sb_buffer) != 0) {
@@ -60,15 +161,33 @@ int ext2_init(const char* device) {
     // Calculate block size
     block_size = 1024 << superblock.log_block_size;
     
+    // Forget indirect blocks, bitmaps, preallocation windows and name indexes of a previously mounted volume
+    memset(indirect_cache, 0, sizeof(indirect_cache));
+    for (int group = 0; group < EXT2_MAX_GROUPS; group++) {
+        free(group_bitmaps[group].block_bitmap);
+        free(group_bitmaps[group].inode_bitmap);
+    }
+    memset(group_bitmaps, 0, sizeof(group_bitmaps));
+    memset(prealloc_windows, 0, sizeof(prealloc_windows));
+    for (int i = 0; i < EXT2_DIR_INDEX_SLOTS; i++) {
+        free(dir_indexes[i].table);
+    }
+    memset(dir_indexes, 0, sizeof(dir_indexes));
+    metadata_dirty = 0;
+    
     // Calculate inodes per block
     inodes_per_block = block_size / sizeof(ext2_inode_t);
     
     // Calculate block group count
-    block_group_count = (superblock.blocks_count - 1) / superblock.blocks_per_group + 1;
+    block_group_count = (superblock.blocks_count - superblock.first_data_block - 1) / superblock.blocks_per_group + 1;
+    if (block_group_count > EXT2_MAX_GROUPS) {
+        log_error("EXT2", "Volume has %u block groups, at most %u are supported", block_group_count, EXT2_MAX_GROUPS);
+        return EXT2_ERR_BAD_FORMAT;
+    }
     
     // Allocate memory for group descriptors
     // In a real implementation, this would use dynamic memory allocation
-    static ext2_group_desc_t group_descs_buffer[128]; // Max 128 groups
+    static ext2_group_desc_t group_descs_buffer[EXT2_MAX_GROUPS];
     group_descs = group_descs_buffer;
     
     // Read block group descriptors (located after superblock)
@@ -172,7 +291,7 @@ int ext2_write_file(const char* path, const char* buffer, int size, int flags) {
         }
         
         // Allocate new inode
-        inode_num = ext2_allocate_inode();
+        inode_num = ext2_allocate_inode(dir_inode_num, EXT2_S_IFREG);
         if (inode_num == 0) {
             return EXT2_ERR_NO_SPACE;
         }
@@ -190,10 +309,13 @@ int ext2_write_file(const char* path, const char* buffer, int size, int flags) {
         int result = ext2_add_dir_entry(dir_inode_num, &dir_inode, filename, inode_num, EXT2_FT_REG_FILE);
         if (result != 0) {
             // Free the allocated inode and return error
-            ext2_free_inode(inode_num);
+            ext2_free_inode(inode_num, EXT2_S_IFREG);
             return result;
         }
         
+        // The name exists now
+        vfs_dcache_invalidate_name(dcache_ns, filename);
+        
         // Update directory's modification time
         dir_inode.mtime = get_current_time();
         if (write_inode(dir_inode_num, &dir_inode) != 0) {
@@ -213,13 +335,10 @@ int ext2_write_file(const char* path, const char* buffer, int size, int flags) {
         // If truncate flag is set, free all existing blocks
         if (flags & EXT2_WRITE_TRUNCATE) {
             // Free all blocks associated with this file
-            ext2_free_file_blocks(&inode);
+            ext2_free_file_blocks(inode_num, &inode);
             
             // Reset size to 0
             inode.size = 0;
-            
-            // Update block pointers
-            memset(inode.block, 0, sizeof(inode.block));
         }
     }
     
@@ -232,8 +351,8 @@ int ext2_write_file(const char* path, const char* buffer, int size, int flags) {
     // Write data block by block
     while (bytes_written < (uint32_t)size) {
         // Allocate or get a block for this position
-        uint32_t block_num = ext2_get_or_allocate_block(&inode, block_index);
-        if (block_num == 0) {
+        uint32_t block_num;
+        if (ext2_get_or_allocate_block(inode_num, &inode, block_index, &block_num) != EXT2_SUCCESS) {
             // Could not allocate block
             break;
         }
@@ -290,12 +409,151 @@ int ext2_write_file(const char* path, const char* buffer, int size, int flags) {
         }
     }
     
+    // The whole file has been written, keep no blocks reserved for it
+    ext2_discard_prealloc(inode_num);
+    
     // Update filesystem metadata (superblock, group descriptors)
     ext2_update_fs_metadata();
     
     return bytes_written;
 }
 
+uint32_t ext2_lookup(const char* path) {
+    return path_to_inode(path);
+}
+
+uint32_t ext2_get_dcache_namespace(void) {
+    return dcache_ns;
+}
+
+int ext2_read_at(uint32_t inode_num, uint32_t offset, void* buffer, uint32_t size) {
+    // Read the inode
+    ext2_inode_t inode;
+    if (read_inode(inode_num, &inode) != 0) {
+        return EXT2_ERR_IO_ERROR;
+    }
+    
+    // Check if it's a regular file
+    if ((inode.mode & EXT2_S_IFMT) != EXT2_S_IFREG) {
+        return EXT2_ERR_INVALID_ARG;
+    }
+    
+    // Nothing to read at or past the end of the file
+    if (offset >= inode.size) {
+        return 0;
+    }
+    if (size > inode.size - offset) {
+        size = inode.size - offset;
+    }
+    
+    uint8_t* out = (uint8_t*)buffer;
+    uint32_t bytes_read = 0;
+    
+    // Only the blocks covering [offset, offset + size) are read
+    while (bytes_read < size) {
+        uint32_t pos = offset + bytes_read;
+        uint32_t block_index = pos / block_size;
+        uint32_t block_offset = pos % block_size;
+        uint32_t chunk = block_size - block_offset;
+        if (chunk > size - bytes_read) {
+            chunk = size - bytes_read;
+        }
+        
+        int read_result;
+        if (chunk == block_size) {
+            // Whole block: read straight into the caller's buffer
+            read_result = read_file_block(&inode, block_index, out + bytes_read);
+        } else {
+            uint8_t block_buffer[4096]; // Max block size
+            read_result = read_file_block(&inode, block_index, block_buffer);
+            if (read_result == 0) {
+                memcpy(out + bytes_read, block_buffer + block_offset, chunk);
+            }
+        }
+        
+        if (read_result < 0) {
+            return bytes_read > 0 ? (int)bytes_read : read_result;
+        }
+        
+        bytes_read += chunk;
+    }
+    
+    return bytes_read;
+}
+
+int ext2_write_at(uint32_t inode_num, uint32_t offset, const void* buffer, uint32_t size) {
+    // Read the inode
+    ext2_inode_t inode;
+    if (read_inode(inode_num, &inode) != 0) {
+        return EXT2_ERR_IO_ERROR;
+    }
+    
+    // Check if it's a regular file
+    if ((inode.mode & EXT2_S_IFMT) != EXT2_S_IFREG) {
+        return EXT2_ERR_INVALID_ARG;
+    }
+    
+    const uint8_t* in = (const uint8_t*)buffer;
+    uint32_t bytes_written = 0;
+    int result = 0;
+    
+    while (bytes_written < size) {
+        uint32_t pos = offset + bytes_written;
+        uint32_t block_index = pos / block_size;
+        uint32_t block_offset = pos % block_size;
+        uint32_t chunk = block_size - block_offset;
+        if (chunk > size - bytes_written) {
+            chunk = size - bytes_written;
+        }
+        
+        // Find the block, allocating it (and any indirect blocks) if needed
+        int allocated = 0;
+        uint32_t block_num;
+        result = map_file_block(inode_num, &inode, block_index, 1, &block_num, &allocated);
+        if (result != EXT2_SUCCESS) {
+            break;
+        }
+        
+        if (chunk == block_size) {
+            // Whole block: write straight from the caller's buffer
+            result = write_block(block_num, in + bytes_written);
+        } else {
+            // Partial block: a fresh block starts out zeroed, otherwise read-modify-write
+            uint8_t block_buffer[4096]; // Max block size
+            if (allocated) {
+                memset(block_buffer, 0, block_size);
+            } else if (read_block(block_num, block_buffer) != 0) {
+                result = EXT2_ERR_IO_ERROR;
+                break;
+            }
+            memcpy(block_buffer + block_offset, in + bytes_written, chunk);
+            result = write_block(block_num, block_buffer);
+        }
+        
+        if (result != 0) {
+            break;
+        }
+        
+        bytes_written += chunk;
+    }
+    
+    // Extend the file and write the inode back once (block pointers may have changed too)
+    if (offset + bytes_written > inode.size) {
+        inode.size = offset + bytes_written;
+    }
+    inode.mtime = get_current_time();
+    
+    if (write_inode(inode_num, &inode) != 0) {
+        return EXT2_ERR_IO_ERROR;
+    }
+    ext2_update_fs_metadata();
+    
+    if (bytes_written == 0 && result != 0) {
+        return result;
+    }
+    return bytes_written;
+}
+
 int ext2_list_directory(const char* path, ext2_file_entry_t* entries, int max_entries) {
     // Get the inode number for the path
     uint32_t inode_num = path_to_inode(path);
@@ -333,13 +591,14 @@ int ext2_list_directory(const char* path, ext2_file_entry_t* entries, int max_en
         while (offset < block_size && entries_found < (uint32_t)max_entries) {
             ext2_dir_entry_t* dir_entry = (ext2_dir_entry_t*)(block_buffer + offset);
             
-            // If entry is invalid or zero inode, skip
-            if (dir_entry->rec_len == 0 || dir_entry->inode == 0) {
+            // A bad record length ends the block
+            if (dir_entry->rec_len < 8 || offset + dir_entry->rec_len > block_size) {
                 break;
             }
             
-            // Skip "." and ".." entries
-            if (!(dir_entry->name_len == 1 && dir_entry->name[0] == '.') &&
+            // Skip unused records (also what htree index blocks look like), "." and ".."
+            if (dir_entry->inode != 0 &&
+                !(dir_entry->name_len == 1 && dir_entry->name[0] == '.') &&
                 !(dir_entry->name_len == 2 && dir_entry->name[0] == '.' && dir_entry->name[1] == '.')) {
                 
                 // Read the entry's inode
@@ -433,7 +692,7 @@ int ext2_mkdir(const char* path, uint16_t mode) {
     }
     
     // Allocate a new inode for the directory
-    uint32_t new_inode_num = ext2_allocate_inode();
+    uint32_t new_inode_num = ext2_allocate_inode(parent_inode_num, EXT2_S_IFDIR);
     if (new_inode_num == 0) {
         return EXT2_ERR_NO_SPACE;
     }
@@ -449,25 +708,29 @@ int ext2_mkdir(const char* path, uint16_t mode) {
     new_inode.links_count = 2; // "." + parent's entry
     
     // Allocate first block for the directory
-    uint32_t new_block = ext2_allocate_block();
+    uint32_t new_block = ext2_allocate_block(ext2_inode_goal(new_inode_num));
     if (new_block == 0) {
-        ext2_free_inode(new_inode_num);
+        ext2_free_inode(new_inode_num, EXT2_S_IFDIR);
         return EXT2_ERR_NO_SPACE;
     }
     
     // Set the block in the inode
     new_inode.block[0] = new_block;
+    new_inode.blocks = block_size / 512;
     
     // Create the "." and ".." entries in the new directory
     uint8_t block_buffer[4096]; // Max block size
     memset(block_buffer, 0, block_size);
     
+    // Entries only carry a file type on volumes with the filetype feature
+    uint8_t dir_type = (superblock.feature_incompat & EXT2_FEATURE_INCOMPAT_FILETYPE) ? EXT2_FT_DIR : 0;
+    
     // Create "." entry (points to itself)
     ext2_dir_entry_t* dot_entry = (ext2_dir_entry_t*)block_buffer;
     dot_entry->inode = new_inode_num;
     dot_entry->rec_len = 12; // 8 bytes for header + 1 byte for name + padding for 4-byte alignment
     dot_entry->name_len = 1;
-    dot_entry->file_type = EXT2_FT_DIR;
+    dot_entry->file_type = dir_type;
     strcpy(dot_entry->name, ".");
     
     // Create ".." entry (points to parent)
@@ -475,13 +738,13 @@ int ext2_mkdir(const char* path, uint16_t mode) {
     dotdot_entry->inode = parent_inode_num;
     dotdot_entry->rec_len = block_size - dot_entry->rec_len; // Use rest of block
     dotdot_entry->name_len = 2;
-    dotdot_entry->file_type = EXT2_FT_DIR;
+    dotdot_entry->file_type = dir_type;
     strcpy(dotdot_entry->name, "..");
     
     // Write the block
     if (write_block(new_block, block_buffer) != 0) {
         ext2_free_block(new_block);
-        ext2_free_inode(new_inode_num);
+        ext2_free_inode(new_inode_num, EXT2_S_IFDIR);
         return EXT2_ERR_IO_ERROR;
     }
     
@@ -491,7 +754,7 @@ int ext2_mkdir(const char* path, uint16_t mode) {
     // Write the new inode
     if (write_inode(new_inode_num, &new_inode) != 0) {
         ext2_free_block(new_block);
-        ext2_free_inode(new_inode_num);
+        ext2_free_inode(new_inode_num, EXT2_S_IFDIR);
         return EXT2_ERR_IO_ERROR;
     }
     
@@ -501,10 +764,13 @@ int ext2_mkdir(const char* path, uint16_t mode) {
     
     if (add_result != 0) {
         ext2_free_block(new_block);
-        ext2_free_inode(new_inode_num);
+        ext2_free_inode(new_inode_num, EXT2_S_IFDIR);
         return add_result;
     }
     
+    // A negative entry for the name may be cached
+    vfs_dcache_invalidate_name(dcache_ns, dirname);
+    
     // Increment link count of parent directory (for the ".." entry)
     parent_inode.links_count++;
     parent_inode.mtime = get_current_time();
@@ -578,6 +844,13 @@ int ext2_remove(const char* path) {
         return remove_result;
     }
     
+    // Forget the name; a removed directory's inode may be reused, so forget its entries too
+    if ((inode.mode & EXT2_S_IFMT) == EXT2_S_IFDIR) {
+        vfs_dcache_invalidate_namespace(dcache_ns);
+    } else {
+        vfs_dcache_invalidate_name(dcache_ns, filename);
+    }
+    
     // Update parent's modification time
     parent_inode.mtime = get_current_time();
     
@@ -592,10 +865,17 @@ int ext2_remove(const char* path) {
     // If link count reaches zero, free the inode and its blocks
     if (inode.links_count == 0) {
         // Free all blocks associated with the inode
-        ext2_free_file_blocks(&inode);
+        ext2_free_file_blocks(inode_num, &inode);
+        if ((inode.mode & EXT2_S_IFMT) == EXT2_S_IFDIR) {
+            ext2_dir_index_drop(inode_num);
+        }
         
-        // Free the inode
-        ext2_free_inode(inode_num);
+        // Mark the inode deleted on disk and free it
+        inode.dtime = get_current_time();
+        if (write_inode(inode_num, &inode) != 0) {
+            return EXT2_ERR_IO_ERROR;
+        }
+        ext2_free_inode(inode_num, inode.mode);
     } else {
         // Write the updated inode
         if (write_inode(inode_num, &inode) != 0) {
@@ -641,7 +921,7 @@ int ext2_symlink(const char* target, const char* linkpath) {
     }
     
     // Allocate a new inode for the symlink
-    uint32_t symlink_inode_num = ext2_allocate_inode();
+    uint32_t symlink_inode_num = ext2_allocate_inode(parent_inode_num, EXT2_S_IFLNK);
     if (symlink_inode_num == 0) {
         return EXT2_ERR_NO_SPACE;
     }
@@ -667,18 +947,20 @@ int ext2_symlink(const char* target, const char* linkpath) {
         
         // Allocate blocks and store the target path
         for (uint32_t i = 0; i < blocks_needed; i++) {
-            uint32_t block_num = ext2_allocate_block();
+            uint32_t goal = (i == 0) ? ext2_inode_goal(symlink_inode_num) : symlink_inode.block[i - 1] + 1;
+            uint32_t block_num = ext2_allocate_block(goal);
             if (block_num == 0) {
                 // Free previously allocated blocks
                 for (uint32_t j = 0; j < i; j++) {
                     ext2_free_block(symlink_inode.block[j]);
                 }
-                ext2_free_inode(symlink_inode_num);
+                ext2_free_inode(symlink_inode_num, EXT2_S_IFLNK);
                 return EXT2_ERR_NO_SPACE;
             }
             
             // Set block pointer in inode
             symlink_inode.block[i] = block_num;
+            symlink_inode.blocks += block_size / 512;
             
             // Calculate bytes to write to this block
             uint32_t offset = i * block_size;
@@ -698,7 +980,7 @@ int ext2_symlink(const char* target, const char* linkpath) {
                 for (uint32_t j = 0; j <= i; j++) {
                     ext2_free_block(symlink_inode.block[j]);
                 }
-                ext2_free_inode(symlink_inode_num);
+                ext2_free_inode(symlink_inode_num, EXT2_S_IFLNK);
                 return EXT2_ERR_IO_ERROR;
             }
         }
@@ -708,9 +990,9 @@ int ext2_symlink(const char* target, const char* linkpath) {
     if (write_inode(symlink_inode_num, &symlink_inode) != 0) {
         // Free all blocks if we allocated them
         if (symlink_inode.size > 60) {
-            ext2_free_file_blocks(&symlink_inode);
+            ext2_free_file_blocks(symlink_inode_num, &symlink_inode);
         }
-        ext2_free_inode(symlink_inode_num);
+        ext2_free_inode(symlink_inode_num, EXT2_S_IFLNK);
         return EXT2_ERR_IO_ERROR;
     }
     
@@ -721,12 +1003,15 @@ int ext2_symlink(const char* target, const char* linkpath) {
     if (result != 0) {
         // Free all blocks if we allocated them
         if (symlink_inode.size > 60) {
-            ext2_free_file_blocks(&symlink_inode);
+            ext2_free_file_blocks(symlink_inode_num, &symlink_inode);
         }
-        ext2_free_inode(symlink_inode_num);
+        ext2_free_inode(symlink_inode_num, EXT2_S_IFLNK);
         return result;
     }
     
+    // A negative entry for the name may be cached
+    vfs_dcache_invalidate_name(dcache_ns, link_name);
+    
     // Update parent's modification time
     parent_inode.mtime = get_current_time();
     
@@ -870,6 +1155,7 @@ static int read_block(uint32_t block_num, void* buffer) {
     
     // Read the block data from the block device
     int result = block_dev->operations->read_blocks(block_dev, lba, blocks_to_read, read_buffer);
+    ext2_block_reads++;
     
     // Check for read errors
     if (result != blocks_to_read) {
@@ -891,6 +1177,14 @@ static int read_block(uint32_t block_num, void* buffer) {
 
 // Write a block to the filesystem
 static int write_block(uint32_t block_num, const void* buffer) {
+    // Keep cached indirect blocks in step with the disk
+    for (int level = 0; level < 3; level++) {
+        if (indirect_cache[level].block_num == block_num &&
+            buffer != indirect_cache[level].entries) {
+            memcpy(indirect_cache[level].entries, buffer, block_size);
+        }
+    }
+    
     // Use proper block device operations to write to the actual device
     
     // Check if the device path is valid
@@ -1034,149 +1328,209 @@ static int write_inode(uint32_t inode_num, const ext2_inode_t* inode) {
     return 0;
 }
 
-// Find the inode number for a given path
+// Find a name in a directory (dentry cache lookup callback)
+static int ext2_dir_lookup(void* context, uint64_t parent, const char* name, uint64_t* child) {
+    ext2_inode_t inode;
+    if (read_inode((uint32_t)parent, &inode) != 0) {
+        return VFS_ERR_IO_ERROR;
+    }
+    
+    // Check if it's a directory
+    if ((inode.mode & EXT2_S_IFMT) != EXT2_S_IFDIR) {
+        return VFS_ERR_NOT_DIR;
+    }
+    
+    uint8_t block_buffer[4096]; // Max block size
+    uint32_t block_index;
+    int offset = ext2_find_dir_entry((uint32_t)parent, &inode, name, strlen(name), block_buffer, &block_index);
+    if (offset == EXT2_ERR_NOT_FOUND) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    if (offset < 0) {
+        return VFS_ERR_IO_ERROR;
+    }
+    
+    *child = ((ext2_dir_entry_t*)(block_buffer + offset))->inode;
+    return VFS_SUCCESS;
+}
+
+// Resolve a path to an inode number, served from the dentry cache where possible
 static uint32_t path_to_inode(const char* path) {
     if (path == NULL) {
         return 0;
     }
     
-    // Root directory is always inode 2
-    if (path[0] == '/' && path[1] == '\0') {
-        return ROOT_INODE;
+    // Resolution starts at the root directory, which is always inode 2
+    uint64_t inode_num;
+    if (vfs_dcache_resolve(dcache_ns, ROOT_INODE, path, ext2_dir_lookup, NULL, &inode_num) != VFS_SUCCESS) {
+        return 0;
+    }
+    
+    return (uint32_t)inode_num;
+}
+
+// Get the pointers of an indirect block, served from the per-level cache
+static uint32_t* read_indirect_block(uint32_t block_num, int level) {
+    ext2_indirect_cache_t* cache = &indirect_cache[level];
+    
+    if (cache->block_num != block_num) {
+        if (read_block(block_num, cache->entries) != 0) {
+            cache->block_num = 0;
+            return NULL;
+        }
+        cache->block_num = block_num;
     }
     
-    // Start at root
-    uint32_t current_inode = ROOT_INODE;
+    return cache->entries;
+}
+
+// Allocate a zero-filled indirect block near goal
+static uint32_t allocate_indirect_block(ext2_inode_t* inode, uint32_t goal) {
+    uint32_t block_num = ext2_allocate_block(goal);
+    if (block_num == 0) {
+        return 0;
+    }
     
-    // Skip leading slash
-    if (path[0] == '/') {
-        path++;
+    uint8_t zero_block[4096]; // Max block size
+    memset(zero_block, 0, block_size);
+    if (write_block(block_num, zero_block) != 0) {
+        ext2_free_block(block_num);
+        return 0;
     }
     
-    // Buffer for path component
-    char component[256];
-    int i = 0;
+    inode->blocks += block_size / 512;
+    return block_num;
+}
+
+// Map a file block index to a filesystem block through the direct, single,
+// double and triple indirect pointers. *block_num gets the block, or 0 for a
+// hole. With create set, missing data and indirect blocks are allocated next
+// to the file's previous block and *allocated reports a new data block. A
+// failed indirect block read is an error, never a hole.
+static int map_file_block(uint32_t inode_num, ext2_inode_t* inode, uint32_t block_index, int create,
+                          uint32_t* block_num_out, int* allocated) {
+    uint32_t per_block = block_size / 4;
+    uint32_t offsets[3];
+    uint32_t depth;
+    uint32_t slot;
+    
+    *block_num_out = 0;
+    if (allocated) {
+        *allocated = 0;
+    }
     
-    // Iterate through path components
-    while (*path) {
-        // Reset component buffer
-        i = 0;
-        
-        // Extract next path component
-        while (*path && *path != '/' && i < 255) {
-            component[i++] = *path++;
+    // Direct blocks (0-11)
+    if (block_index < 12) {
+        if (inode->block[block_index] == 0 && create) {
+            uint32_t block_num = ext2_allocate_data_block(inode_num, ext2_block_goal(inode_num, inode, block_index));
+            if (block_num == 0) {
+                return EXT2_ERR_NO_SPACE;
+            }
+            inode->block[block_index] = block_num;
+            inode->blocks += block_size / 512;
+            if (allocated) {
+                *allocated = 1;
+            }
         }
-        component[i] = '\0';
-        
-        // Skip slash
-        if (*path == '/') {
-            path++;
+        *block_num_out = inode->block[block_index];
+        return EXT2_SUCCESS;
+    }
+    
+    // Work out which indirect tree holds the block and the index at each level
+    uint32_t index = block_index - 12;
+    if (index < per_block) {
+        depth = 1;
+        slot = 12;
+        offsets[0] = index;
+    } else if ((index -= per_block) < per_block * per_block) {
+        depth = 2;
+        slot = 13;
+        offsets[0] = index / per_block;
+        offsets[1] = index % per_block;
+    } else {
+        index -= per_block * per_block;
+        if (index / per_block / per_block >= per_block) {
+            return EXT2_ERR_INVALID_ARG;  // Beyond the triple indirect range
         }
-        
-        // Find this component in the current directory
-        ext2_inode_t inode;
-        if (read_inode(current_inode, &inode) != 0) {
-            return 0;
+        depth = 3;
+        slot = 14;
+        offsets[0] = index / (per_block * per_block);
+        offsets[1] = (index / per_block) % per_block;
+        offsets[2] = index % per_block;
+    }
+    
+    uint32_t block_num = inode->block[slot];
+    if (block_num == 0) {
+        if (!create) {
+            return EXT2_SUCCESS;
         }
-        
-        // Check if it's a directory
-        if ((inode.mode & EXT2_S_IFMT) != EXT2_S_IFDIR) {
-            return 0;
+        block_num = allocate_indirect_block(inode, ext2_block_goal(inode_num, inode, block_index));
+        if (block_num == 0) {
+            return EXT2_ERR_NO_SPACE;
+        }
+        inode->block[slot] = block_num;
+    }
+    
+    // Walk down the tree; the last level points at the data block
+    for (uint32_t level = 0; level < depth; level++) {
+        uint32_t* entries = read_indirect_block(block_num, level);
+        if (!entries) {
+            return EXT2_ERR_IO_ERROR;
         }
         
-        // Look for the component in this directory
-        uint32_t next_inode = 0;
-        
-        // Read directory blocks and search for the component
-        uint32_t bytes_read = 0;
-        uint32_t current_block = 0;
-        uint8_t block_buffer[4096]; // Max block size
-        
-        while (bytes_read < inode.size && next_inode == 0) {
-            // Read current directory block
-            if (read_file_block(&inode, current_block, block_buffer) != 0) {
-                return 0;
+        uint32_t next = entries[offsets[level]];
+        if (next == 0) {
+            if (!create) {
+                return EXT2_SUCCESS;
             }
             
-            // Process directory entries in this block
-            uint32_t offset = 0;
-            while (offset < block_size) {
-                ext2_dir_entry_t* dir_entry = (ext2_dir_entry_t*)(block_buffer + offset);
-                
-                // If entry is invalid or zero inode, skip to next block
-                if (dir_entry->rec_len == 0 || dir_entry->inode == 0) {
-                    break;
-                }
-                
-                // Check if this entry matches our component
-                if (dir_entry->name_len == strlen(component) &&
-                    strncmp(dir_entry->name, component, dir_entry->name_len) == 0) {
-                    next_inode = dir_entry->inode;
-                    break;
+            int is_data = (level == depth - 1);
+            uint32_t goal = ext2_block_goal(inode_num, inode, block_index);
+            if (is_data) {
+                next = ext2_allocate_data_block(inode_num, goal);
+                if (next != 0) {
+                    inode->blocks += block_size / 512;
                 }
-                
-                // Move to next directory entry
-                offset += dir_entry->rec_len;
+            } else {
+                next = allocate_indirect_block(inode, goal);
+            }
+            if (next == 0) {
+                return EXT2_ERR_NO_SPACE;
             }
             
-            // Move to next block
-            current_block++;
-            bytes_read += block_size;
-        }
-        
-        // If component not found, return 0
-        if (next_inode == 0) {
-            return 0;
+            // Allocating may have reused the cache slot, so re-read before updating
+            entries = read_indirect_block(block_num, level);
+            if (!entries) {
+                return EXT2_ERR_IO_ERROR;
+            }
+            entries[offsets[level]] = next;
+            if (write_block(block_num, entries) != 0) {
+                return EXT2_ERR_IO_ERROR;
+            }
+            
+            if (is_data && allocated) {
+                *allocated = 1;
+            }
         }
         
-        // Move to next component
-        current_inode = next_inode;
+        block_num = next;
     }
     
-    return current_inode;
+    *block_num_out = block_num;
+    return EXT2_SUCCESS;
+}
+
+// Find or allocate the filesystem block backing a file block
+static int ext2_get_or_allocate_block(uint32_t inode_num, ext2_inode_t* inode, uint32_t block_index, uint32_t* block_num) {
+    return map_file_block(inode_num, inode, block_index, 1, block_num, NULL);
 }
 
 // Read a specific block from a file given by inode
 static int read_file_block(ext2_inode_t* inode, uint32_t block_index, void* buffer) {
-    uint32_t block_num = 0;
-    
-    // Direct blocks (0-11)
-    if (block_index < 12) {
-        block_num = inode->block[block_index];
-    }
-    // Indirect block (12)
-    else if (block_index < 12 + block_size / 4) {
-        // Read indirect block
-        uint32_t indirect_block[block_size / 4];
-        if (read_block(inode->block[12], indirect_block) != 0) {
-            return EXT2_ERR_IO_ERROR;
-        }
-        
-        block_num = indirect_block[block_index - 12];
-    }
-    // Double indirect block (13)
-    else if (block_index < 12 + block_size / 4 + (block_size / 4) * (block_size / 4)) {
-        uint32_t index1 = (block_index - 12 - block_size / 4) / (block_size / 4);
-        uint32_t index2 = (block_index - 12 - block_size / 4) % (block_size / 4);
-        
-        // Read double indirect block
-        uint32_t dind_block[block_size / 4];
-        if (read_block(inode->block[13], dind_block) != 0) {
-            return EXT2_ERR_IO_ERROR;
-        }
-        
-        // Read indirect block
-        uint32_t ind_block[block_size / 4];
-        if (read_block(dind_block[index1], ind_block) != 0) {
-            return EXT2_ERR_IO_ERROR;
-        }
-        
-        block_num = ind_block[index2];
-    }
-    // Triple indirect block (14) - for very large files
-    else {
-        // For simplicity, we're not implementing triple indirect blocks
-        return EXT2_ERR_INVALID_ARG;
+    uint32_t block_num;
+    int result = map_file_block(0, inode, block_index, 0, &block_num, NULL);
+    if (result != EXT2_SUCCESS) {
+        return result;
     }
     
     // If block number is 0, this is a sparse file (hole), fill with zeros
@@ -1189,32 +1543,1645 @@ static int read_file_block(ext2_inode_t* inode, uint32_t block_index, void* buff
     return read_block(block_num, buffer);
 }
 
-// Parse a path into directory path and filename components
-static int parse_path(const char* path, char* dir_path, char* filename) {
-    if (!path || !dir_path || !filename) {
-        return -1;
+// Block group of an inode
+static uint32_t ext2_inode_group(uint32_t inode_num) {
+    return inode_num ? (inode_num - 1) / superblock.inodes_per_group : 0;
+}
+
+// Blocks in a group (the last group may be short)
+static uint32_t ext2_group_blocks(uint32_t group) {
+    uint32_t first = superblock.first_data_block + group * superblock.blocks_per_group;
+    uint32_t count = superblock.blocks_count - first;
+    return count < superblock.blocks_per_group ? count : superblock.blocks_per_group;
+}
+
+// First clear bit in [start, limit), or limit if there is none. Full words
+// are skipped whole.
+static uint32_t ext2_find_zero_bit(const uint32_t* bitmap, uint32_t start, uint32_t limit) {
+    uint32_t bit = start;
+    
+    while (bit < limit) {
+        // Treat the bits below start as set
+        uint32_t word = bitmap[bit / 32] | ((1u << (bit % 32)) - 1);
+        if (word != 0xFFFFFFFF) {
+            uint32_t found = (bit & ~31u) + __builtin_ctz(~word);
+            return found < limit ? found : limit;
+        }
+        bit = (bit & ~31u) + 32;
     }
     
-    // Find the last slash in the path
-    const char* last_slash = strrchr(path, '/');
+    return limit;
+}
+
+// First bit of an all-clear word in [start, limit), or limit if there is none
+static uint32_t ext2_find_zero_word(const uint32_t* bitmap, uint32_t start, uint32_t limit) {
+    for (uint32_t bit = (start + 31) & ~31u; bit + 32 <= limit; bit += 32) {
+        if (bitmap[bit / 32] == 0) {
+            return bit;
+        }
+    }
     
-    if (!last_slash) {
-        // No slash, current directory is implied
-        strcpy(dir_path, ".");
-        strcpy(filename, path);
-    } else if (last_slash == path) {
-        // Slash is first character, file is in root directory
-        strcpy(dir_path, "/");
-        strcpy(filename, last_slash + 1);
-    } else {
-        // Copy the directory part
-        int dir_len = last_slash - path;
-        strncpy(dir_path, path, dir_len);
-        dir_path[dir_len] = '\0';
-        
-        // Copy the filename part
-        strcpy(filename, last_slash + 1);
+    return limit;
+}
+
+// Load a bitmap block into its cache slot on first use
+static uint32_t* ext2_load_bitmap(uint32_t** slot, uint32_t block_num) {
+    if (!*slot) {
+        uint32_t* bitmap = (uint32_t*)malloc(block_size);
+        if (!bitmap) {
+            return NULL;
+        }
+        if (read_block(block_num, bitmap) != 0) {
+            free(bitmap);
+            return NULL;
+        }
+        *slot = bitmap;
     }
     
-    return 0;
-}
\ No newline at end of file
+    return *slot;
+}
+
+static uint32_t* ext2_block_bitmap(uint32_t group) {
+    return ext2_load_bitmap(&group_bitmaps[group].block_bitmap, group_descs[group].block_bitmap);
+}
+
+static uint32_t* ext2_inode_bitmap(uint32_t group) {
+    return ext2_load_bitmap(&group_bitmaps[group].inode_bitmap, group_descs[group].inode_bitmap);
+}
+
+// Set or clear a run of bits in a group's block bitmap and adjust the free counts
+static void ext2_mark_blocks(uint32_t group, uint32_t bit, uint32_t count, int used) {
+    uint32_t* bitmap = group_bitmaps[group].block_bitmap;
+    
+    for (uint32_t i = bit; i < bit + count; i++) {
+        if (used) {
+            bitmap[i / 32] |= 1u << (i % 32);
+        } else {
+            bitmap[i / 32] &= ~(1u << (i % 32));
+        }
+    }
+    
+    if (used) {
+        group_descs[group].free_blocks_count -= count;
+        superblock.free_blocks_count -= count;
+    } else {
+        group_descs[group].free_blocks_count += count;
+        superblock.free_blocks_count += count;
+    }
+    
+    group_bitmaps[group].block_dirty = 1;
+    metadata_dirty = 1;
+}
+
+// Allocate a block as close to goal as possible: the goal itself or a free
+// block just after it, else the start of a free stretch in its group, else
+// any free block in its group, then the other groups in turn
+static uint32_t ext2_allocate_block(uint32_t goal) {
+    if (superblock.free_blocks_count == 0) {
+        return 0;
+    }
+    
+    if (goal < superblock.first_data_block || goal >= superblock.blocks_count) {
+        goal = superblock.first_data_block;
+    }
+    uint32_t goal_group = (goal - superblock.first_data_block) / superblock.blocks_per_group;
+    
+    for (uint32_t i = 0; i < block_group_count; i++) {
+        uint32_t group = (goal_group + i) % block_group_count;
+        if (group_descs[group].free_blocks_count == 0) {
+            continue;
+        }
+        
+        uint32_t* bitmap = ext2_block_bitmap(group);
+        if (!bitmap) {
+            continue;
+        }
+        
+        uint32_t limit = ext2_group_blocks(group);
+        uint32_t start = (i == 0) ? (goal - superblock.first_data_block) % superblock.blocks_per_group : 0;
+        uint32_t near = (start + EXT2_GOAL_SEARCH < limit) ? start + EXT2_GOAL_SEARCH : limit;
+        
+        uint32_t bit = ext2_find_zero_bit(bitmap, start, near);
+        if (bit == near) {
+            bit = ext2_find_zero_word(bitmap, start, limit);
+        }
+        if (bit == limit) {
+            bit = ext2_find_zero_bit(bitmap, 0, limit);
+        }
+        if (bit == limit) {
+            continue;
+        }
+        
+        ext2_mark_blocks(group, bit, 1, 1);
+        return superblock.first_data_block + group * superblock.blocks_per_group + bit;
+    }
+    
+    return 0;
+}
+
+// Return a block to its group's bitmap
+static int ext2_free_block(uint32_t block_num) {
+    if (block_num < superblock.first_data_block || block_num >= superblock.blocks_count) {
+        return EXT2_ERR_INVALID_ARG;
+    }
+    
+    uint32_t group = (block_num - superblock.first_data_block) / superblock.blocks_per_group;
+    uint32_t bit = (block_num - superblock.first_data_block) % superblock.blocks_per_group;
+    
+    uint32_t* bitmap = ext2_block_bitmap(group);
+    if (!bitmap) {
+        return EXT2_ERR_IO_ERROR;
+    }
+    
+    if (!(bitmap[bit / 32] & (1u << (bit % 32)))) {
+        log_warning("EXT2", "Freeing block %u, which is not in use", block_num);
+        return EXT2_ERR_CORRUPTED;
+    }
+    
+    ext2_mark_blocks(group, bit, 1, 0);
+    
+    // A cached indirect block may be reused for anything now
+    for (int level = 0; level < 3; level++) {
+        if (indirect_cache[level].block_num == block_num) {
+            indirect_cache[level].block_num = 0;
+        }
+    }
+    
+    return EXT2_SUCCESS;
+}
+
+// Allocate an inode. Files and symlinks go into their parent directory's
+// group. New directories are spread out: they go to the group with the most
+// free inodes among those with at least the average number of free blocks.
+static uint32_t ext2_allocate_inode(uint32_t parent_inode, uint16_t mode) {
+    if (superblock.free_inodes_count == 0) {
+        return 0;
+    }
+    
+    int is_dir = (mode & EXT2_S_IFMT) == EXT2_S_IFDIR;
+    uint32_t goal_group = ext2_inode_group(parent_inode);
+    
+    if (is_dir) {
+        uint32_t average_free = superblock.free_blocks_count / block_group_count;
+        int best = -1;
+        for (uint32_t group = 0; group < block_group_count; group++) {
+            if (group_descs[group].free_inodes_count == 0 ||
+                group_descs[group].free_blocks_count < average_free) {
+                continue;
+            }
+            if (best < 0 || group_descs[group].free_inodes_count > group_descs[best].free_inodes_count) {
+                best = group;
+            }
+        }
+        if (best >= 0) {
+            goal_group = best;
+        }
+    }
+    
+    for (uint32_t i = 0; i < block_group_count; i++) {
+        uint32_t group = (goal_group + i) % block_group_count;
+        if (group_descs[group].free_inodes_count == 0) {
+            continue;
+        }
+        
+        uint32_t* bitmap = ext2_inode_bitmap(group);
+        if (!bitmap) {
+            continue;
+        }
+        
+        // The first inodes of the volume are reserved
+        uint32_t start = (group == 0) ? EXT2_FIRST_INO - 1 : 0;
+        uint32_t bit = ext2_find_zero_bit(bitmap, start, superblock.inodes_per_group);
+        if (bit == superblock.inodes_per_group) {
+            continue;
+        }
+        
+        bitmap[bit / 32] |= 1u << (bit % 32);
+        group_descs[group].free_inodes_count--;
+        superblock.free_inodes_count--;
+        if (is_dir) {
+            group_descs[group].used_dirs_count++;
+        }
+        group_bitmaps[group].inode_dirty = 1;
+        metadata_dirty = 1;
+        
+        return group * superblock.inodes_per_group + bit + 1;
+    }
+    
+    return 0;
+}
+
+// Return an inode to its group's bitmap
+static int ext2_free_inode(uint32_t inode_num, uint16_t mode) {
+    if (inode_num < 1 || inode_num > superblock.inodes_count) {
+        return EXT2_ERR_INVALID_ARG;
+    }
+    
+    uint32_t group = ext2_inode_group(inode_num);
+    uint32_t bit = (inode_num - 1) % superblock.inodes_per_group;
+    
+    uint32_t* bitmap = ext2_inode_bitmap(group);
+    if (!bitmap) {
+        return EXT2_ERR_IO_ERROR;
+    }
+    
+    if (!(bitmap[bit / 32] & (1u << (bit % 32)))) {
+        log_warning("EXT2", "Freeing inode %u, which is not in use", inode_num);
+        return EXT2_ERR_CORRUPTED;
+    }
+    
+    ext2_discard_prealloc(inode_num);
+    
+    bitmap[bit / 32] &= ~(1u << (bit % 32));
+    group_descs[group].free_inodes_count++;
+    superblock.free_inodes_count++;
+    if ((mode & EXT2_S_IFMT) == EXT2_S_IFDIR) {
+        group_descs[group].used_dirs_count--;
+    }
+    group_bitmaps[group].inode_dirty = 1;
+    metadata_dirty = 1;
+    
+    return EXT2_SUCCESS;
+}
+
+// Where a new block should start looking for a place for an inode's first block
+static uint32_t ext2_inode_goal(uint32_t inode_num) {
+    return superblock.first_data_block + ext2_inode_group(inode_num) * superblock.blocks_per_group;
+}
+
+// Where a file block should go: right after the file's previous block, or
+// in the inode's group for the first one
+static uint32_t ext2_block_goal(uint32_t inode_num, ext2_inode_t* inode, uint32_t block_index) {
+    if (block_index > 0) {
+        uint32_t prev;
+        if (map_file_block(inode_num, inode, block_index - 1, 0, &prev, NULL) == EXT2_SUCCESS && prev != 0) {
+            return prev + 1;
+        }
+    }
+    
+    return ext2_inode_goal(inode_num);
+}
+
+// Give the reserved blocks of a window back to the bitmap
+static void ext2_release_window(ext2_prealloc_t* window) {
+    if (window->count > 0) {
+        uint32_t group = (window->start - superblock.first_data_block) / superblock.blocks_per_group;
+        uint32_t bit = (window->start - superblock.first_data_block) % superblock.blocks_per_group;
+        ext2_mark_blocks(group, bit, window->count, 0);
+    }
+    
+    window->inode_num = 0;
+    window->count = 0;
+}
+
+// Allocate a data block for a file. Appends are served from the file's
+// preallocation window while they continue where the window starts; a fresh
+// allocation reserves the free blocks that follow it as the new window,
+// twice as large as the last one if the file used that up.
+static uint32_t ext2_allocate_data_block(uint32_t inode_num, uint32_t goal) {
+    ext2_prealloc_t* window = NULL;
+    uint32_t window_size = EXT2_PREALLOC_BLOCKS;
+    ext2_prealloc_t* oldest = &prealloc_windows[0];
+    
+    for (int i = 0; i < EXT2_PREALLOC_WINDOWS; i++) {
+        if (prealloc_windows[i].inode_num == inode_num && inode_num != 0) {
+            window = &prealloc_windows[i];
+            break;
+        }
+        if (prealloc_windows[i].last_used < oldest->last_used) {
+            oldest = &prealloc_windows[i];
+        }
+    }
+    
+    if (window) {
+        if (window->count > 0 && window->start == goal) {
+            uint32_t block_num = window->start++;
+            window->count--;
+            window->last_used = ++prealloc_clock;
+            return block_num;
+        }
+        
+        if (window->count == 0 && window->start == goal) {
+            window_size = window->size * 2 < EXT2_PREALLOC_MAX ? window->size * 2 : EXT2_PREALLOC_MAX;
+        }
+        
+        // Used up, or the file is not being appended at the window any more
+        ext2_release_window(window);
+    }
+    
+    uint32_t block_num = ext2_allocate_block(goal);
+    if (block_num == 0 || inode_num == 0) {
+        return block_num;
+    }
+    
+    // Reserve what is free right after the block, within its group
+    uint32_t group = (block_num - superblock.first_data_block) / superblock.blocks_per_group;
+    uint32_t bit = (block_num - superblock.first_data_block) % superblock.blocks_per_group + 1;
+    uint32_t limit = ext2_group_blocks(group);
+    uint32_t* bitmap = group_bitmaps[group].block_bitmap;
+    
+    uint32_t count = 0;
+    while (count < window_size && bit + count < limit &&
+           !(bitmap[(bit + count) / 32] & (1u << ((bit + count) % 32)))) {
+        count++;
+    }
+    if (count == 0) {
+        return block_num;
+    }
+    
+    if (!window) {
+        window = oldest;
+        if (window->inode_num != 0) {
+            ext2_release_window(window);
+        }
+    }
+    
+    ext2_mark_blocks(group, bit, count, 1);
+    window->inode_num = inode_num;
+    window->start = block_num + 1;
+    window->count = count;
+    window->size = window_size;
+    window->last_used = ++prealloc_clock;
+    
+    return block_num;
+}
+
+void ext2_discard_prealloc(uint32_t inode_num) {
+    for (int i = 0; i < EXT2_PREALLOC_WINDOWS; i++) {
+        if (prealloc_windows[i].inode_num == inode_num && inode_num != 0) {
+            ext2_release_window(&prealloc_windows[i]);
+        }
+    }
+}
+
+// Free a tree of block pointers; level 0 is a data block, levels 1-3 are
+// single, double and triple indirect blocks
+static void ext2_free_block_tree(uint32_t block_num, int level) {
+    if (block_num == 0) {
+        return;
+    }
+    
+    if (level > 0) {
+        uint32_t* entries = (uint32_t*)malloc(block_size);
+        if (entries && read_block(block_num, entries) == 0) {
+            for (uint32_t i = 0; i < block_size / 4; i++) {
+                ext2_free_block_tree(entries[i], level - 1);
+            }
+        } else {
+            log_error("EXT2", "Cannot read indirect block %u, its blocks are lost", block_num);
+        }
+        free(entries);
+    }
+    
+    ext2_free_block(block_num);
+}
+
+// Free every data and indirect block of an inode and its preallocation window
+static void ext2_free_file_blocks(uint32_t inode_num, ext2_inode_t* inode) {
+    ext2_discard_prealloc(inode_num);
+    
+    // Fast symlinks keep their target in the block pointers
+    if ((inode->mode & EXT2_S_IFMT) == EXT2_S_IFLNK && inode->size <= 60) {
+        return;
+    }
+    
+    for (int i = 0; i < 12; i++) {
+        ext2_free_block_tree(inode->block[i], 0);
+    }
+    ext2_free_block_tree(inode->block[12], 1);
+    ext2_free_block_tree(inode->block[13], 2);
+    ext2_free_block_tree(inode->block[14], 3);
+    
+    memset(inode->block, 0, sizeof(inode->block));
+    inode->blocks = 0;
+}
+
+// Write back the bitmaps, group descriptors and superblock changed since
+// the last call
+static int ext2_update_fs_metadata(void) {
+    if (!metadata_dirty) {
+        return EXT2_SUCCESS;
+    }
+    
+    int result = EXT2_SUCCESS;
+    for (uint32_t group = 0; group < block_group_count; group++) {
+        if (group_bitmaps[group].block_dirty) {
+            if (write_block(group_descs[group].block_bitmap, group_bitmaps[group].block_bitmap) != 0) {
+                result = EXT2_ERR_IO_ERROR;
+            }
+            group_bitmaps[group].block_dirty = 0;
+        }
+        if (group_bitmaps[group].inode_dirty) {
+            if (write_block(group_descs[group].inode_bitmap, group_bitmaps[group].inode_bitmap) != 0) {
+                result = EXT2_ERR_IO_ERROR;
+            }
+            group_bitmaps[group].inode_dirty = 0;
+        }
+    }
+    
+    uint8_t block_buffer[4096]; // Max block size
+    
+    // Group descriptors follow the superblock
+    uint32_t gdt_block = (block_size == 1024) ? 2 : 1;
+    uint32_t gdt_size = sizeof(ext2_group_desc_t) * block_group_count;
+    if (read_block(gdt_block, block_buffer) == 0) {
+        memcpy(block_buffer, group_descs, (gdt_size < block_size) ? gdt_size : block_size);
+        if (write_block(gdt_block, block_buffer) != 0) {
+            result = EXT2_ERR_IO_ERROR;
+        }
+    } else {
+        result = EXT2_ERR_IO_ERROR;
+    }
+    
+    // The superblock sits 1024 bytes into the volume
+    uint32_t sb_block = (block_size == 1024) ? 1 : 0;
+    uint32_t sb_offset = (block_size == 1024) ? 0 : 1024;
+    if (read_block(sb_block, block_buffer) == 0) {
+        memcpy(block_buffer + sb_offset, &superblock, sizeof(ext2_superblock_t));
+        if (write_block(sb_block, block_buffer) != 0) {
+            result = EXT2_ERR_IO_ERROR;
+        }
+    } else {
+        result = EXT2_ERR_IO_ERROR;
+    }
+    
+    metadata_dirty = 0;
+    return result;
+}
+
+int ext2_sync(void) {
+    for (int i = 0; i < EXT2_PREALLOC_WINDOWS; i++) {
+        if (prealloc_windows[i].inode_num != 0) {
+            ext2_release_window(&prealloc_windows[i]);
+        }
+    }
+    
+    return ext2_update_fs_metadata();
+}
+
+// Directory entries and indexes
+//
+// Lookups in a directory with an htree index (EXT2_INDEX_FL) hash the name
+// and binary search the index down to the one leaf block that can hold it.
+// Directories without one get an in-memory table of name hashes, built by
+// the first lookup that has to scan them, so later lookups read one block.
+// A directory that grows past one block on a volume with the dir_index
+// feature is given an htree index.
+
+// Bytes a directory entry in use occupies
+static uint32_t ext2_dirent_used(const ext2_dir_entry_t* entry) {
+    return entry->inode ? EXT2_DIR_REC_LEN(entry->name_len) : 0;
+}
+
+// Find a name in one directory block. Returns the entry's offset, or -1.
+static int ext2_dirent_find(const uint8_t* block, const char* name, uint32_t name_len) {
+    uint32_t offset = 0;
+    while (offset + 8 <= block_size) {
+        const ext2_dir_entry_t* entry = (const ext2_dir_entry_t*)(block + offset);
+        if (entry->rec_len < 8 || offset + entry->rec_len > block_size) {
+            break;
+        }
+        
+        if (entry->inode != 0 && entry->name_len == name_len &&
+            memcmp(entry->name, name, name_len) == 0) {
+            return offset;
+        }
+        offset += entry->rec_len;
+    }
+    return -1;
+}
+
+// Put a new entry into a directory block if one of its records has room for
+// it, splitting the record. Returns 1 if it went in.
+static int ext2_dirent_insert(uint8_t* block, const char* name, uint32_t name_len, uint32_t inode_num, uint8_t file_type) {
+    uint32_t needed = EXT2_DIR_REC_LEN(name_len);
+    uint32_t offset = 0;
+    
+    while (offset + 8 <= block_size) {
+        ext2_dir_entry_t* entry = (ext2_dir_entry_t*)(block + offset);
+        if (entry->rec_len < 8 || offset + entry->rec_len > block_size) {
+            return 0;
+        }
+        
+        uint32_t used = ext2_dirent_used(entry);
+        if (entry->rec_len - used >= needed) {
+            if (used) {
+                ext2_dir_entry_t* next = (ext2_dir_entry_t*)(block + offset + used);
+                next->rec_len = entry->rec_len - used;
+                entry->rec_len = used;
+                entry = next;
+            }
+            entry->inode = inode_num;
+            entry->name_len = name_len;
+            entry->file_type = (superblock.feature_incompat & EXT2_FEATURE_INCOMPAT_FILETYPE) ? file_type : 0;
+            memcpy(entry->name, name, name_len);
+            return 1;
+        }
+        offset += entry->rec_len;
+    }
+    return 0;
+}
+
+// Read a directory block for modification; *block_num gets its filesystem block
+static int ext2_read_dir_block(uint32_t dir_num, ext2_inode_t* dir, uint32_t block_index, uint8_t* buffer, uint32_t* block_num) {
+    int result = map_file_block(dir_num, dir, block_index, 0, block_num, NULL);
+    if (result != EXT2_SUCCESS) {
+        return result;
+    }
+    if (*block_num == 0) {
+        return EXT2_ERR_CORRUPTED;
+    }
+    return read_block(*block_num, buffer) == 0 ? EXT2_SUCCESS : EXT2_ERR_IO_ERROR;
+}
+
+// FNV-1a over a name
+static uint32_t ext2_name_hash(const char* name, uint32_t name_len) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < name_len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void ext2_dir_index_release(ext2_dir_index_t* index) {
+    free(index->table);
+    memset(index, 0, sizeof(*index));
+}
+
+// Forget the in-memory index of a directory
+static void ext2_dir_index_drop(uint32_t dir_num) {
+    for (int i = 0; i < EXT2_DIR_INDEX_SLOTS; i++) {
+        if (dir_indexes[i].inode_num == dir_num) {
+            ext2_dir_index_release(&dir_indexes[i]);
+        }
+    }
+}
+
+// Record a name's block, doubling the table when it is three quarters full.
+// Returns 0, or -1 if the table could not grow.
+static int ext2_dir_index_insert(ext2_dir_index_t* index, uint32_t hash, uint32_t block_index) {
+    if ((index->count + 1) * 4 > (index->mask + 1) * 3) {
+        uint32_t new_size = (index->mask + 1) * 2;
+        ext2_dir_index_entry_t* table = (ext2_dir_index_entry_t*)malloc(new_size * sizeof(ext2_dir_index_entry_t));
+        if (!table) {
+            return -1;
+        }
+        memset(table, 0, new_size * sizeof(ext2_dir_index_entry_t));
+        
+        for (uint32_t i = 0; i <= index->mask; i++) {
+            if (index->table[i].block == 0) {
+                continue;
+            }
+            uint32_t slot = index->table[i].hash & (new_size - 1);
+            while (table[slot].block != 0) {
+                slot = (slot + 1) & (new_size - 1);
+            }
+            table[slot] = index->table[i];
+        }
+        
+        free(index->table);
+        index->table = table;
+        index->mask = new_size - 1;
+    }
+    
+    uint32_t slot = hash & index->mask;
+    while (index->table[slot].block != 0) {
+        if (index->table[slot].hash == hash && index->table[slot].block == block_index + 1) {
+            return 0;  // Same hash in the same block is already covered
+        }
+        slot = (slot + 1) & index->mask;
+    }
+    index->table[slot].hash = hash;
+    index->table[slot].block = block_index + 1;
+    index->count++;
+    return 0;
+}
+
+// Get the in-memory index of a directory, scanning it to build one if there
+// is none or the directory changed size behind its back. NULL if out of memory.
+static ext2_dir_index_t* ext2_dir_index_get(uint32_t dir_num, ext2_inode_t* dir) {
+    ext2_dir_index_t* index = NULL;
+    ext2_dir_index_t* victim = &dir_indexes[0];
+    
+    for (int i = 0; i < EXT2_DIR_INDEX_SLOTS; i++) {
+        if (dir_indexes[i].inode_num == dir_num) {
+            index = &dir_indexes[i];
+            break;
+        }
+        if (dir_indexes[i].inode_num == 0) {
+            if (victim->inode_num != 0) {
+                victim = &dir_indexes[i];
+            }
+        } else if (victim->inode_num != 0 && dir_indexes[i].last_used < victim->last_used) {
+            victim = &dir_indexes[i];
+        }
+    }
+    
+    if (index && index->size == dir->size) {
+        index->last_used = ++dir_index_clock;
+        return index;
+    }
+    
+    // Build (or rebuild) the table
+    if (!index) {
+        index = victim;
+    }
+    ext2_dir_index_release(index);
+    
+    index->table = (ext2_dir_index_entry_t*)malloc(EXT2_DIR_INDEX_MIN_SIZE * sizeof(ext2_dir_index_entry_t));
+    if (!index->table) {
+        return NULL;
+    }
+    memset(index->table, 0, EXT2_DIR_INDEX_MIN_SIZE * sizeof(ext2_dir_index_entry_t));
+    index->mask = EXT2_DIR_INDEX_MIN_SIZE - 1;
+    
+    uint8_t block_buffer[4096]; // Max block size
+    uint32_t blocks = dir->size / block_size;
+    for (uint32_t blk = 0; blk < blocks; blk++) {
+        if (read_file_block(dir, blk, block_buffer) != 0) {
+            ext2_dir_index_release(index);
+            return NULL;
+        }
+        
+        uint32_t offset = 0;
+        while (offset + 8 <= block_size) {
+            ext2_dir_entry_t* entry = (ext2_dir_entry_t*)(block_buffer + offset);
+            if (entry->rec_len < 8 || offset + entry->rec_len > block_size) {
+                break;
+            }
+            if (entry->inode != 0 &&
+                ext2_dir_index_insert(index, ext2_name_hash(entry->name, entry->name_len), blk) != 0) {
+                ext2_dir_index_release(index);
+                return NULL;
+            }
+            offset += entry->rec_len;
+        }
+    }
+    
+    index->inode_num = dir_num;
+    index->size = dir->size;
+    index->last_used = ++dir_index_clock;
+    return index;
+}
+
+// Record a name added to a directory in its in-memory index, if it has one
+static void ext2_dir_index_add(uint32_t dir_num, ext2_inode_t* dir, const char* name, uint32_t name_len, uint32_t block_index) {
+    for (int i = 0; i < EXT2_DIR_INDEX_SLOTS; i++) {
+        ext2_dir_index_t* index = &dir_indexes[i];
+        if (index->inode_num != dir_num) {
+            continue;
+        }
+        if (ext2_dir_index_insert(index, ext2_name_hash(name, name_len), block_index) != 0) {
+            ext2_dir_index_release(index);
+        } else {
+            index->size = dir->size;
+        }
+        return;
+    }
+}
+
+// Look a name up through a directory's in-memory index
+static int ext2_dir_index_find(ext2_dir_index_t* index, ext2_inode_t* dir, const char* name, uint32_t name_len,
+                               uint8_t* buffer, uint32_t* block_index) {
+    uint32_t hash = ext2_name_hash(name, name_len);
+    
+    for (uint32_t slot = hash & index->mask; index->table[slot].block != 0; slot = (slot + 1) & index->mask) {
+        if (index->table[slot].hash != hash) {
+            continue;
+        }
+        
+        uint32_t blk = index->table[slot].block - 1;
+        if (read_file_block(dir, blk, buffer) != 0) {
+            return EXT2_ERR_IO_ERROR;
+        }
+        int offset = ext2_dirent_find(buffer, name, name_len);
+        if (offset >= 0) {
+            *block_index = blk;
+            return offset;
+        }
+    }
+    
+    return EXT2_ERR_NOT_FOUND;
+}
+
+// Htree indexes
+#define EXT2_DX_MAX_DEPTH 2            // Root plus one level of index nodes
+#define EXT2_DX_BLOCK_MASK 0x0FFFFFFF  // High bits of an index entry's block are reserved
+#define EXT2_DX_FULL 1                 // ext2_dx_add_entry(): the index has no room left
+
+// Index node on the path to a leaf
+typedef struct {
+    uint32_t block_index;      // Directory block holding the node
+    uint8_t* buffer;           // Its contents
+    ext2_dx_entry_t* entries;  // Entries within buffer
+    uint32_t position;         // Entry followed to the next level
+} ext2_dx_frame_t;
+
+// Index node blocks on the current path, and working blocks for splits
+static uint8_t dx_node_buffers[EXT2_DX_MAX_DEPTH][4096];
+static uint8_t dx_leaf_buffer[4096];
+static uint8_t dx_copy_buffer[4096];
+static uint8_t dx_new_buffer[4096];
+
+// Entries of a block being split or indexed, with their hashes
+typedef struct {
+    uint32_t hash;
+    const ext2_dir_entry_t* entry;
+} ext2_dx_map_t;
+
+static ext2_dx_map_t dx_map[4096 / 12 + 2];
+
+static ext2_dx_countlimit_t* ext2_dx_countlimit(ext2_dx_entry_t* entries) {
+    return (ext2_dx_countlimit_t*)entries;
+}
+
+// Entries a root or an index node has room for
+static uint32_t ext2_dx_root_limit(void) {
+    return (block_size - sizeof(ext2_dx_root_t)) / sizeof(ext2_dx_entry_t);
+}
+
+static uint32_t ext2_dx_node_limit(void) {
+    return (block_size - 8) / sizeof(ext2_dx_entry_t);
+}
+
+static uint32_t ext2_rol32(uint32_t word, int shift) {
+    return (word << shift) | (word >> (32 - shift));
+}
+
+// Pack a name into hash input words, padded with its length
+static void ext2_dx_str2hashbuf(const char* name, int name_len, uint32_t* buf, int num, int is_unsigned) {
+    uint32_t pad = (uint32_t)name_len | ((uint32_t)name_len << 8);
+    pad |= pad << 16;
+    uint32_t val = pad;
+    
+    if (name_len > num * 4) {
+        name_len = num * 4;
+    }
+    for (int i = 0; i < name_len; i++) {
+        int c = is_unsigned ? (int)(uint8_t)name[i] : (int)(int8_t)name[i];
+        val = (uint32_t)c + (val << 8);
+        if ((i % 4) == 3) {
+            *buf++ = val;
+            val = pad;
+            num--;
+        }
+    }
+    if (--num >= 0) {
+        *buf++ = val;
+    }
+    while (--num >= 0) {
+        *buf++ = pad;
+    }
+}
+
+#define DX_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define DX_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define DX_H(x, y, z) ((x) ^ (y) ^ (z))
+#define DX_ROUND(f, a, b, c, d, x, s) (a += f(b, c, d) + (x), a = ext2_rol32(a, s))
+#define DX_K2 013240474631u
+#define DX_K3 015666365641u
+
+// Cut-down MD4 compression over 32 bytes of name
+static void ext2_dx_half_md4(uint32_t buf[4], const uint32_t in[8]) {
+    uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+    
+    DX_ROUND(DX_F, a, b, c, d, in[0], 3);
+    DX_ROUND(DX_F, d, a, b, c, in[1], 7);
+    DX_ROUND(DX_F, c, d, a, b, in[2], 11);
+    DX_ROUND(DX_F, b, c, d, a, in[3], 19);
+    DX_ROUND(DX_F, a, b, c, d, in[4], 3);
+    DX_ROUND(DX_F, d, a, b, c, in[5], 7);
+    DX_ROUND(DX_F, c, d, a, b, in[6], 11);
+    DX_ROUND(DX_F, b, c, d, a, in[7], 19);
+    
+    DX_ROUND(DX_G, a, b, c, d, in[1] + DX_K2, 3);
+    DX_ROUND(DX_G, d, a, b, c, in[3] + DX_K2, 5);
+    DX_ROUND(DX_G, c, d, a, b, in[5] + DX_K2, 9);
+    DX_ROUND(DX_G, b, c, d, a, in[7] + DX_K2, 13);
+    DX_ROUND(DX_G, a, b, c, d, in[0] + DX_K2, 3);
+    DX_ROUND(DX_G, d, a, b, c, in[2] + DX_K2, 5);
+    DX_ROUND(DX_G, c, d, a, b, in[4] + DX_K2, 9);
+    DX_ROUND(DX_G, b, c, d, a, in[6] + DX_K2, 13);
+    
+    DX_ROUND(DX_H, a, b, c, d, in[3] + DX_K3, 3);
+    DX_ROUND(DX_H, d, a, b, c, in[7] + DX_K3, 9);
+    DX_ROUND(DX_H, c, d, a, b, in[2] + DX_K3, 11);
+    DX_ROUND(DX_H, b, c, d, a, in[6] + DX_K3, 15);
+    DX_ROUND(DX_H, a, b, c, d, in[1] + DX_K3, 3);
+    DX_ROUND(DX_H, d, a, b, c, in[5] + DX_K3, 9);
+    DX_ROUND(DX_H, c, d, a, b, in[0] + DX_K3, 11);
+    DX_ROUND(DX_H, b, c, d, a, in[4] + DX_K3, 15);
+    
+    buf[0] += a;
+    buf[1] += b;
+    buf[2] += c;
+    buf[3] += d;
+}
+
+// 16 rounds of TEA over 16 bytes of name
+static void ext2_dx_tea(uint32_t buf[4], const uint32_t in[4]) {
+    uint32_t sum = 0;
+    uint32_t b0 = buf[0], b1 = buf[1];
+    
+    for (int n = 0; n < 16; n++) {
+        sum += 0x9E3779B9;
+        b0 += ((b1 << 4) + in[0]) ^ (b1 + sum) ^ ((b1 >> 5) + in[1]);
+        b1 += ((b0 << 4) + in[2]) ^ (b0 + sum) ^ ((b0 >> 5) + in[3]);
+    }
+    
+    buf[0] += b0;
+    buf[1] += b1;
+}
+
+// Hash of a name as the index stores it (the low bit is kept for collisions)
+static uint32_t ext2_dx_hash(const char* name, uint32_t name_len, uint8_t version) {
+    int is_unsigned = (superblock.flags & EXT2_FLAGS_UNSIGNED_HASH) != 0;
+    uint32_t buf[4] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 };
+    uint32_t in[8];
+    uint32_t hash;
+    
+    if (superblock.hash_seed[0] | superblock.hash_seed[1] | superblock.hash_seed[2] | superblock.hash_seed[3]) {
+        memcpy(buf, superblock.hash_seed, sizeof(buf));
+    }
+    
+    if (version == EXT2_HASH_LEGACY) {
+        uint32_t hash0 = 0x12A3FE2D, hash1 = 0x37ABE8F9;
+        for (uint32_t i = 0; i < name_len; i++) {
+            int c = is_unsigned ? (int)(uint8_t)name[i] : (int)(int8_t)name[i];
+            hash = hash1 + (hash0 ^ (uint32_t)(c * 7152373));
+            if (hash & 0x80000000) {
+                hash -= 0x7FFFFFFF;
+            }
+            hash1 = hash0;
+            hash0 = hash;
+        }
+        hash = hash0 << 1;
+    } else if (version == EXT2_HASH_TEA) {
+        for (int left = name_len; left > 0; left -= 16, name += 16) {
+            ext2_dx_str2hashbuf(name, left, in, 4, is_unsigned);
+            ext2_dx_tea(buf, in);
+        }
+        hash = buf[0];
+    } else {
+        for (int left = name_len; left > 0; left -= 32, name += 32) {
+            ext2_dx_str2hashbuf(name, left, in, 8, is_unsigned);
+            ext2_dx_half_md4(buf, in);
+        }
+        hash = buf[1];
+    }
+    
+    hash &= ~1u;
+    if (hash == 0xFFFFFFFE) {
+        hash = 0xFFFFFFFC;  // The all-ones hash marks the end of a readdir
+    }
+    return hash;
+}
+
+// Check an index node's count and limit
+static int ext2_dx_check_node(ext2_dx_entry_t* entries, uint32_t max_limit) {
+    ext2_dx_countlimit_t* countlimit = ext2_dx_countlimit(entries);
+    if (countlimit->limit > max_limit || countlimit->count == 0 || countlimit->count > countlimit->limit) {
+        return EXT2_ERR_CORRUPTED;
+    }
+    return EXT2_SUCCESS;
+}
+
+// Pick the last entry of a node whose hash is not above hash
+static uint32_t ext2_dx_search(ext2_dx_entry_t* entries, uint32_t hash) {
+    int low = 1;
+    int high = ext2_dx_countlimit(entries)->count - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (entries[middle].hash > hash) {
+            high = middle - 1;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return low - 1;
+}
+
+// Read the index node at a level of the path
+static int ext2_dx_load_node(ext2_inode_t* dir, ext2_dx_frame_t* frames, int level) {
+    uint32_t blk = frames[level - 1].entries[frames[level - 1].position].block & EXT2_DX_BLOCK_MASK;
+    if (blk == 0 || blk >= dir->size / block_size) {
+        return EXT2_ERR_CORRUPTED;
+    }
+    
+    uint8_t* buffer = dx_node_buffers[level];
+    if (read_file_block(dir, blk, buffer) != 0) {
+        return EXT2_ERR_IO_ERROR;
+    }
+    
+    // A node looks like one empty directory entry covering the block
+    ext2_dir_entry_t* fake = (ext2_dir_entry_t*)buffer;
+    if (fake->inode != 0 || fake->rec_len != block_size) {
+        return EXT2_ERR_CORRUPTED;
+    }
+    
+    frames[level].block_index = blk;
+    frames[level].buffer = buffer;
+    frames[level].entries = (ext2_dx_entry_t*)(buffer + 8);
+    frames[level].position = 0;
+    return ext2_dx_check_node(frames[level].entries, ext2_dx_node_limit());
+}
+
+// Walk the index from the root to the leaf that would hold a name. Fills one
+// frame per index level and returns the name's hash in *hash.
+static int ext2_dx_probe(ext2_inode_t* dir, const char* name, uint32_t name_len,
+                         ext2_dx_frame_t* frames, int* depth, uint32_t* hash) {
+    uint8_t* buffer = dx_node_buffers[0];
+    if (read_file_block(dir, 0, buffer) != 0) {
+        return EXT2_ERR_IO_ERROR;
+    }
+    
+    ext2_dx_root_t* root = (ext2_dx_root_t*)buffer;
+    if (root->reserved_zero != 0 || root->info_length != 8 || root->hash_version > EXT2_HASH_TEA ||
+        root->indirect_levels >= EXT2_DX_MAX_DEPTH || root->dot_rec_len != 12 ||
+        root->dotdot_rec_len != block_size - 12) {
+        return EXT2_ERR_CORRUPTED;
+    }
+    
+    *hash = ext2_dx_hash(name, name_len, root->hash_version);
+    *depth = root->indirect_levels + 1;
+    
+    frames[0].block_index = 0;
+    frames[0].buffer = buffer;
+    frames[0].entries = (ext2_dx_entry_t*)(buffer + sizeof(ext2_dx_root_t));
+    if (ext2_dx_check_node(frames[0].entries, ext2_dx_root_limit()) != 0) {
+        return EXT2_ERR_CORRUPTED;
+    }
+    frames[0].position = ext2_dx_search(frames[0].entries, *hash);
+    
+    for (int level = 1; level < *depth; level++) {
+        int result = ext2_dx_load_node(dir, frames, level);
+        if (result != 0) {
+            return result;
+        }
+        frames[level].position = ext2_dx_search(frames[level].entries, *hash);
+    }
+    
+    return EXT2_SUCCESS;
+}
+
+// Leaf block the path ends at
+static uint32_t ext2_dx_leaf(ext2_dx_frame_t* frames, int depth) {
+    ext2_dx_frame_t* frame = &frames[depth - 1];
+    return frame->entries[frame->position].block & EXT2_DX_BLOCK_MASK;
+}
+
+// Move the path to the next leaf if names with this hash continue there
+// (a split can leave equal hashes on both sides; the next block's hash then
+// has its low bit set). Returns 1 if it moved, 0 if not, or an error.
+static int ext2_dx_next_leaf(ext2_inode_t* dir, ext2_dx_frame_t* frames, int depth, uint32_t hash) {
+    int level = depth - 1;
+    while (level >= 0 && frames[level].position + 1 >= ext2_dx_countlimit(frames[level].entries)->count) {
+        level--;
+    }
+    if (level < 0) {
+        return 0;
+    }
+    
+    frames[level].position++;
+    if ((frames[level].entries[frames[level].position].hash & ~1u) != hash) {
+        return 0;
+    }
+    
+    // Down to the first leaf under the new position
+    for (level++; level < depth; level++) {
+        int result = ext2_dx_load_node(dir, frames, level);
+        if (result != 0) {
+            return result;
+        }
+    }
+    return 1;
+}
+
+// Look a name up through a directory's htree index
+static int ext2_dx_find(ext2_inode_t* dir, const char* name, uint32_t name_len, uint8_t* buffer, uint32_t* block_index) {
+    ext2_dx_frame_t frames[EXT2_DX_MAX_DEPTH];
+    int depth;
+    uint32_t hash;
+    
+    int result = ext2_dx_probe(dir, name, name_len, frames, &depth, &hash);
+    if (result != 0) {
+        return result;
+    }
+    
+    for (;;) {
+        uint32_t leaf = ext2_dx_leaf(frames, depth);
+        if (leaf >= dir->size / block_size) {
+            return EXT2_ERR_CORRUPTED;
+        }
+        if (read_file_block(dir, leaf, buffer) != 0) {
+            return EXT2_ERR_IO_ERROR;
+        }
+        
+        int offset = ext2_dirent_find(buffer, name, name_len);
+        if (offset >= 0) {
+            *block_index = leaf;
+            return offset;
+        }
+        
+        result = ext2_dx_next_leaf(dir, frames, depth, hash);
+        if (result <= 0) {
+            return result == 0 ? EXT2_ERR_NOT_FOUND : result;
+        }
+    }
+}
+
+// Add the entries in use of a directory block, from byte start on, to dx_map
+static uint32_t ext2_dx_map_block(const uint8_t* block, uint32_t start, uint32_t count, uint8_t version) {
+    uint32_t offset = start;
+    while (offset + 8 <= block_size) {
+        const ext2_dir_entry_t* entry = (const ext2_dir_entry_t*)(block + offset);
+        if (entry->rec_len < 8 || offset + entry->rec_len > block_size) {
+            break;
+        }
+        if (entry->inode != 0 && count < sizeof(dx_map) / sizeof(dx_map[0]) - 1) {
+            dx_map[count].hash = ext2_dx_hash(entry->name, entry->name_len, version);
+            dx_map[count].entry = entry;
+            count++;
+        }
+        offset += entry->rec_len;
+    }
+    return count;
+}
+
+// Sort dx_map by hash and pick where to split it so both halves hold about
+// as many bytes. *split_hash gets the first hash of the upper half, with the
+// low bit set if the same hash ends the lower half.
+static uint32_t ext2_dx_sort_and_split(uint32_t count, uint32_t* split_hash) {
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        ext2_dx_map_t item = dx_map[i];
+        uint32_t j = i;
+        while (j > 0 && dx_map[j - 1].hash > item.hash) {
+            dx_map[j] = dx_map[j - 1];
+            j--;
+        }
+        dx_map[j] = item;
+        total += EXT2_DIR_REC_LEN(item.entry->name_len);
+    }
+    
+    uint32_t split = 0;
+    uint32_t bytes = 0;
+    while (split < count - 1 && bytes + EXT2_DIR_REC_LEN(dx_map[split].entry->name_len) <= total / 2) {
+        bytes += EXT2_DIR_REC_LEN(dx_map[split].entry->name_len);
+        split++;
+    }
+    if (split == 0) {
+        split = 1;
+    }
+    
+    *split_hash = dx_map[split].hash;
+    if (dx_map[split - 1].hash == *split_hash) {
+        *split_hash |= 1;
+    }
+    return split;
+}
+
+// Write entries of dx_map into a block, the last record running to its end
+static void ext2_dx_pack(uint8_t* block, uint32_t first, uint32_t last) {
+    memset(block, 0, block_size);
+    
+    ext2_dir_entry_t* previous = NULL;
+    uint32_t offset = 0;
+    for (uint32_t i = first; i < last; i++) {
+        const ext2_dir_entry_t* source = dx_map[i].entry;
+        ext2_dir_entry_t* entry = (ext2_dir_entry_t*)(block + offset);
+        uint32_t length = EXT2_DIR_REC_LEN(source->name_len);
+        
+        memcpy(entry, source, 8 + source->name_len);
+        entry->rec_len = length;
+        previous = entry;
+        offset += length;
+    }
+    
+    if (previous) {
+        previous->rec_len += block_size - offset;
+    } else {
+        ((ext2_dir_entry_t*)block)->rec_len = block_size;
+    }
+}
+
+// Write an index node on the path back to disk
+static int ext2_dx_write_node(uint32_t dir_num, ext2_inode_t* dir, ext2_dx_frame_t* frame) {
+    uint32_t block_num;
+    int result = map_file_block(dir_num, dir, frame->block_index, 0, &block_num, NULL);
+    if (result != EXT2_SUCCESS) {
+        return result;
+    }
+    if (block_num == 0) {
+        return EXT2_ERR_CORRUPTED;
+    }
+    return write_block(block_num, frame->buffer) == 0 ? EXT2_SUCCESS : EXT2_ERR_IO_ERROR;
+}
+
+// Add a block to the end of a directory and write it. Returns its index in
+// *block_index.
+static int ext2_dir_append_block(uint32_t dir_num, ext2_inode_t* dir, const uint8_t* buffer, uint32_t* block_index) {
+    *block_index = dir->size / block_size;
+    uint32_t block_num;
+    int result = ext2_get_or_allocate_block(dir_num, dir, *block_index, &block_num);
+    if (result != EXT2_SUCCESS) {
+        return result;
+    }
+    if (write_block(block_num, buffer) != 0) {
+        return EXT2_ERR_IO_ERROR;
+    }
+    dir->size += block_size;
+    return EXT2_SUCCESS;
+}
+
+// Insert an index entry after the one the frame follows
+static void ext2_dx_insert(ext2_dx_frame_t* frame, uint32_t hash, uint32_t block_index) {
+    ext2_dx_countlimit_t* countlimit = ext2_dx_countlimit(frame->entries);
+    ext2_dx_entry_t* at = frame->entries + frame->position + 1;
+    
+    memmove(at + 1, at, (countlimit->count - frame->position - 1) * sizeof(ext2_dx_entry_t));
+    at->hash = hash;
+    at->block = block_index;
+    countlimit->count++;
+}
+
+// Make room for one more entry in the lowest index node of the path: a full
+// root gets a level of index nodes below it, a full node is split in two.
+// Returns EXT2_DX_FULL if the root is full at the deepest level supported.
+static int ext2_dx_make_room(uint32_t dir_num, ext2_inode_t* dir, ext2_dx_frame_t* frames, int* depth) {
+    ext2_dx_frame_t* frame = &frames[*depth - 1];
+    ext2_dx_countlimit_t* countlimit = ext2_dx_countlimit(frame->entries);
+    if (countlimit->count < countlimit->limit) {
+        return EXT2_SUCCESS;
+    }
+    
+    uint32_t count = countlimit->count;
+    uint32_t new_block;
+    int result;
+    
+    if (*depth == 1) {
+        // Move the root's entries into a new node that becomes its only child
+        uint8_t* buffer = dx_node_buffers[1];
+        memset(buffer, 0, block_size);
+        ((ext2_dir_entry_t*)buffer)->rec_len = block_size;
+        ext2_dx_entry_t* entries = (ext2_dx_entry_t*)(buffer + 8);
+        memcpy(entries, frame->entries, count * sizeof(ext2_dx_entry_t));
+        ext2_dx_countlimit(entries)->limit = ext2_dx_node_limit();
+        
+        result = ext2_dir_append_block(dir_num, dir, buffer, &new_block);
+        if (result != 0) {
+            return result;
+        }
+        
+        countlimit->count = 1;
+        frame->entries[0].block = new_block;
+        ((ext2_dx_root_t*)frame->buffer)->indirect_levels = 1;
+        
+        frames[1].block_index = new_block;
+        frames[1].buffer = buffer;
+        frames[1].entries = entries;
+        frames[1].position = frame->position;
+        frame->position = 0;
+        *depth = 2;
+        return ext2_dx_write_node(dir_num, dir, frame);
+    }
+    
+    // Split the node, moving its upper half to a new node next to it in the root
+    ext2_dx_frame_t* root = &frames[0];
+    if (ext2_dx_countlimit(root->entries)->count >= ext2_dx_countlimit(root->entries)->limit) {
+        return EXT2_DX_FULL;
+    }
+    
+    uint32_t half = count / 2;
+    uint32_t split_hash = frame->entries[half].hash;
+    
+    uint8_t* buffer = dx_new_buffer;
+    memset(buffer, 0, block_size);
+    ((ext2_dir_entry_t*)buffer)->rec_len = block_size;
+    ext2_dx_entry_t* entries = (ext2_dx_entry_t*)(buffer + 8);
+    memcpy(entries, frame->entries + half, (count - half) * sizeof(ext2_dx_entry_t));
+    ext2_dx_countlimit(entries)->limit = ext2_dx_node_limit();
+    ext2_dx_countlimit(entries)->count = count - half;
+    
+    result = ext2_dir_append_block(dir_num, dir, buffer, &new_block);
+    if (result != 0) {
+        return result;
+    }
+    
+    countlimit->count = half;
+    ext2_dx_insert(root, split_hash, new_block);
+    
+    // Keep following the half that holds the path
+    if (frame->position >= half) {
+        result = ext2_dx_write_node(dir_num, dir, frame);
+        memcpy(frame->buffer, buffer, block_size);
+        frame->block_index = new_block;
+        frame->position -= half;
+        root->position++;
+    } else {
+        result = ext2_dx_write_node(dir_num, dir, frame);
+    }
+    if (result != 0) {
+        return result;
+    }
+    return ext2_dx_write_node(dir_num, dir, root);
+}
+
+// Add a name to a directory with an htree index, splitting the leaf it
+// belongs in when that is full
+static int ext2_dx_add_entry(uint32_t dir_num, ext2_inode_t* dir, const char* name, uint32_t name_len,
+                             uint32_t inode_num, uint8_t file_type) {
+    ext2_dx_frame_t frames[EXT2_DX_MAX_DEPTH];
+    int depth;
+    uint32_t hash;
+    
+    int result = ext2_dx_probe(dir, name, name_len, frames, &depth, &hash);
+    if (result != 0) {
+        return result;
+    }
+    
+    uint32_t leaf = ext2_dx_leaf(frames, depth);
+    uint32_t leaf_block;
+    if (leaf >= dir->size / block_size) {
+        return EXT2_ERR_CORRUPTED;
+    }
+    result = ext2_read_dir_block(dir_num, dir, leaf, dx_leaf_buffer, &leaf_block);
+    if (result != 0) {
+        return result;
+    }
+    
+    if (ext2_dirent_insert(dx_leaf_buffer, name, name_len, inode_num, file_type)) {
+        return write_block(leaf_block, dx_leaf_buffer) == 0 ? EXT2_SUCCESS : EXT2_ERR_IO_ERROR;
+    }
+    
+    // The leaf is full: make room for another leaf in the index, then split
+    uint32_t old_size = dir->size;
+    result = ext2_dx_make_room(dir_num, dir, frames, &depth);
+    if (result != 0) {
+        if (dir->size != old_size) {
+            write_inode(dir_num, dir);
+        }
+        return result;
+    }
+    
+    uint8_t version = ((ext2_dx_root_t*)frames[0].buffer)->hash_version;
+    memcpy(dx_copy_buffer, dx_leaf_buffer, block_size);
+    uint32_t count = ext2_dx_map_block(dx_copy_buffer, 0, 0, version);
+    
+    uint8_t entry_buffer[8 + 256];
+    ext2_dir_entry_t* entry = (ext2_dir_entry_t*)entry_buffer;
+    entry->inode = inode_num;
+    entry->name_len = name_len;
+    entry->file_type = (superblock.feature_incompat & EXT2_FEATURE_INCOMPAT_FILETYPE) ? file_type : 0;
+    memcpy(entry->name, name, name_len);
+    dx_map[count].hash = hash;
+    dx_map[count].entry = entry;
+    count++;
+    
+    uint32_t split_hash;
+    uint32_t split = ext2_dx_sort_and_split(count, &split_hash);
+    
+    uint32_t new_leaf;
+    ext2_dx_pack(dx_new_buffer, split, count);
+    result = ext2_dir_append_block(dir_num, dir, dx_new_buffer, &new_leaf);
+    if (result == 0) {
+        ext2_dx_pack(dx_leaf_buffer, 0, split);
+        if (write_block(leaf_block, dx_leaf_buffer) != 0) {
+            result = EXT2_ERR_IO_ERROR;
+        }
+    }
+    if (result == 0) {
+        ext2_dx_insert(&frames[depth - 1], split_hash, new_leaf);
+        result = ext2_dx_write_node(dir_num, dir, &frames[depth - 1]);
+    }
+    
+    if (write_inode(dir_num, dir) != 0 && result == 0) {
+        result = EXT2_ERR_IO_ERROR;
+    }
+    return result;
+}
+
+// Turn a full one-block directory into an indexed one: "." and ".." stay in
+// block 0 with the index root, the other names and the new one are split by
+// hash between two new leaf blocks
+static int ext2_dx_create(uint32_t dir_num, ext2_inode_t* dir, uint8_t* block0, const char* name, uint32_t name_len,
+                          uint32_t inode_num, uint8_t file_type) {
+    ext2_dir_entry_t* dot = (ext2_dir_entry_t*)block0;
+    if (dot->rec_len != 12 || dot->name_len != 1 || dot->name[0] != '.') {
+        return EXT2_ERR_CORRUPTED;
+    }
+    ext2_dir_entry_t* dotdot = (ext2_dir_entry_t*)(block0 + 12);
+    if (dotdot->name_len != 2 || dotdot->name[0] != '.' || dotdot->name[1] != '.' || dotdot->rec_len < 12) {
+        return EXT2_ERR_CORRUPTED;
+    }
+    
+    uint8_t version = superblock.def_hash_version <= EXT2_HASH_TEA ? superblock.def_hash_version : EXT2_HASH_HALF_MD4;
+    uint32_t count = ext2_dx_map_block(block0, 12 + dotdot->rec_len, 0, version);
+    
+    uint8_t entry_buffer[8 + 256];
+    ext2_dir_entry_t* entry = (ext2_dir_entry_t*)entry_buffer;
+    entry->inode = inode_num;
+    entry->name_len = name_len;
+    entry->file_type = (superblock.feature_incompat & EXT2_FEATURE_INCOMPAT_FILETYPE) ? file_type : 0;
+    memcpy(entry->name, name, name_len);
+    dx_map[count].hash = ext2_dx_hash(name, name_len, version);
+    dx_map[count].entry = entry;
+    count++;
+    
+    uint32_t split_hash;
+    uint32_t split = ext2_dx_sort_and_split(count, &split_hash);
+    
+    uint32_t first_leaf, second_leaf;
+    ext2_dx_pack(dx_leaf_buffer, 0, split);
+    int result = ext2_dir_append_block(dir_num, dir, dx_leaf_buffer, &first_leaf);
+    if (result == 0) {
+        ext2_dx_pack(dx_new_buffer, split, count);
+        result = ext2_dir_append_block(dir_num, dir, dx_new_buffer, &second_leaf);
+    }
+    if (result != 0) {
+        // Blocks already added stay allocated as empty directory blocks
+        write_inode(dir_num, dir);
+        return result;
+    }
+    
+    // Block 0 becomes the root
+    uint8_t* buffer = dx_node_buffers[0];
+    memset(buffer, 0, block_size);
+    ext2_dx_root_t* root = (ext2_dx_root_t*)buffer;
+    memcpy(root, block0, 12);
+    root->dotdot_inode = dotdot->inode;
+    root->dotdot_rec_len = block_size - 12;
+    root->dotdot_name_len = 2;
+    root->dotdot_file_type = dotdot->file_type;
+    memcpy(root->dotdot_name, "..", 2);
+    root->hash_version = version;
+    root->info_length = 8;
+    
+    ext2_dx_entry_t* entries = (ext2_dx_entry_t*)(buffer + sizeof(ext2_dx_root_t));
+    ext2_dx_countlimit(entries)->limit = ext2_dx_root_limit();
+    ext2_dx_countlimit(entries)->count = 2;
+    entries[0].block = first_leaf;
+    entries[1].hash = split_hash;
+    entries[1].block = second_leaf;
+    
+    ext2_dx_frame_t frame = { 0, buffer, entries, 0 };
+    result = ext2_dx_write_node(dir_num, dir, &frame);
+    if (result != 0) {
+        write_inode(dir_num, dir);
+        return result;
+    }
+    
+    dir->flags |= EXT2_INDEX_FL;
+    ext2_dir_index_drop(dir_num);
+    return write_inode(dir_num, dir) == 0 ? EXT2_SUCCESS : EXT2_ERR_IO_ERROR;
+}
+
+// Find a name in a directory: through its htree index if it has a usable
+// one, else through its in-memory index if it has more than a block, else by
+// scanning it. Leaves the block holding the entry in buffer and returns the
+// entry's offset there, or EXT2_ERR_NOT_FOUND or another error.
+static int ext2_find_dir_entry(uint32_t dir_num, ext2_inode_t* dir, const char* name, uint32_t name_len,
+                               uint8_t* buffer, uint32_t* block_index) {
+    if (name_len == 0 || name_len > 255) {
+        return EXT2_ERR_NOT_FOUND;
+    }
+    
+    if (dir->flags & EXT2_INDEX_FL) {
+        int result = ext2_dx_find(dir, name, name_len, buffer, block_index);
+        if (result != EXT2_ERR_CORRUPTED) {
+            return result;
+        }
+        log_warning("EXT2", "Bad htree index in directory %u, scanning it", dir_num);
+    }
+    
+    uint32_t blocks = dir->size / block_size;
+    if (blocks >= EXT2_DIR_INDEX_MIN_BLOCKS) {
+        ext2_dir_index_t* index = ext2_dir_index_get(dir_num, dir);
+        if (index) {
+            return ext2_dir_index_find(index, dir, name, name_len, buffer, block_index);
+        }
+    }
+    
+    for (uint32_t blk = 0; blk < blocks; blk++) {
+        if (read_file_block(dir, blk, buffer) != 0) {
+            return EXT2_ERR_IO_ERROR;
+        }
+        int offset = ext2_dirent_find(buffer, name, name_len);
+        if (offset >= 0) {
+            *block_index = blk;
+            return offset;
+        }
+    }
+    return EXT2_ERR_NOT_FOUND;
+}
+
+// Add a name to a directory. The caller has checked that it is not there.
+static int ext2_add_dir_entry(uint32_t dir_num, ext2_inode_t* dir, const char* name, uint32_t inode_num, uint8_t file_type) {
+    uint32_t name_len = strlen(name);
+    if (name_len == 0 || name_len > 255) {
+        return EXT2_ERR_INVALID_ARG;
+    }
+    
+    if (dir->flags & EXT2_INDEX_FL) {
+        int result = ext2_dx_add_entry(dir_num, dir, name, name_len, inode_num, file_type);
+        if (result != EXT2_ERR_CORRUPTED && result != EXT2_DX_FULL) {
+            return result;
+        }
+        
+        // Carry on without the index; its blocks read as empty directory blocks
+        log_warning("EXT2", "Dropping %s htree index of directory %u",
+                    result == EXT2_DX_FULL ? "full" : "bad", dir_num);
+        dir->flags &= ~EXT2_INDEX_FL;
+        if (write_inode(dir_num, dir) != 0) {
+            return EXT2_ERR_IO_ERROR;
+        }
+    }
+    
+    // Room in an existing block?
+    uint8_t block_buffer[4096]; // Max block size
+    uint32_t blocks = dir->size / block_size;
+    for (uint32_t blk = 0; blk < blocks; blk++) {
+        uint32_t block_num;
+        int result = ext2_read_dir_block(dir_num, dir, blk, block_buffer, &block_num);
+        if (result != 0) {
+            return result;
+        }
+        if (ext2_dirent_insert(block_buffer, name, name_len, inode_num, file_type)) {
+            if (write_block(block_num, block_buffer) != 0) {
+                return EXT2_ERR_IO_ERROR;
+            }
+            ext2_dir_index_add(dir_num, dir, name, name_len, blk);
+            return EXT2_SUCCESS;
+        }
+    }
+    
+    // A directory outgrowing its first block gets an index if the volume allows it
+    if (blocks == 1 && (superblock.feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX)) {
+        return ext2_dx_create(dir_num, dir, block_buffer, name, name_len, inode_num, file_type);
+    }
+    
+    // Start a new block holding just this entry
+    memset(block_buffer, 0, block_size);
+    ((ext2_dir_entry_t*)block_buffer)->rec_len = block_size;
+    ext2_dirent_insert(block_buffer, name, name_len, inode_num, file_type);
+    
+    uint32_t new_block;
+    int result = ext2_dir_append_block(dir_num, dir, block_buffer, &new_block);
+    if (result != 0) {
+        return result;
+    }
+    ext2_dir_index_add(dir_num, dir, name, name_len, new_block);
+    return write_inode(dir_num, dir) == 0 ? EXT2_SUCCESS : EXT2_ERR_IO_ERROR;
+}
+
+// Remove a name from a directory, merging its record into the one before it
+static int ext2_remove_dir_entry(uint32_t dir_num, ext2_inode_t* dir, const char* name) {
+    uint8_t block_buffer[4096]; // Max block size
+    uint32_t block_index;
+    
+    int offset = ext2_find_dir_entry(dir_num, dir, name, strlen(name), block_buffer, &block_index);
+    if (offset < 0) {
+        return offset;
+    }
+    
+    ext2_dir_entry_t* entry = (ext2_dir_entry_t*)(block_buffer + offset);
+    ext2_dir_entry_t* previous = NULL;
+    for (uint32_t at = 0; at < (uint32_t)offset; at += previous->rec_len) {
+        previous = (ext2_dir_entry_t*)(block_buffer + at);
+    }
+    
+    if (previous) {
+        previous->rec_len += entry->rec_len;
+    } else {
+        entry->inode = 0;
+    }
+    
+    uint32_t block_num;
+    int result = map_file_block(dir_num, dir, block_index, 0, &block_num, NULL);
+    if (result != EXT2_SUCCESS) {
+        return result;
+    }
+    if (block_num == 0) {
+        return EXT2_ERR_CORRUPTED;
+    }
+    return write_block(block_num, block_buffer) == 0 ? EXT2_SUCCESS : EXT2_ERR_IO_ERROR;
+}
+
+// Parse a path into directory path and filename components
+static int parse_path(const char* path, char* dir_path, char* filename) {
+    if (!path || !dir_path || !filename) {
+        return -1;
+    }
+    
+    // Find the last slash in the path
+    const char* last_slash = strrchr(path, '/');
+    
+    if (!last_slash) {
+        // No slash, current directory is implied
+        strcpy(dir_path, ".");
+        strcpy(filename, path);
+    } else if (last_slash == path) {
+        // Slash is first character, file is in root directory
+        strcpy(dir_path, "/");
+        strcpy(filename, last_slash + 1);
+    } else {
+        // Copy the directory part
+        int dir_len = last_slash - path;
+        strncpy(dir_path, path, dir_len);
+        dir_path[dir_len] = '\0';
+        
+        // Copy the filename part
+        strcpy(filename, last_slash + 1);
+    }
+    
+    return 0;
+}
+// Benchmark transfer buffer (too large for the kernel stack)
+#define EXT2_BENCH_CHUNK (64 * 1024)
+#define EXT2_BENCH_WRITE_BYTES (4 * 1024 * 1024)
+static uint8_t ext2_bench_buffer[EXT2_BENCH_CHUNK];
+
+// Throughput in KB/s
+static uint32_t ext2_bench_rate(uint32_t bytes, uint64_t elapsed_ns) {
+    if (elapsed_ns == 0) {
+        elapsed_ns = 1;
+    }
+    return (uint32_t)(((uint64_t)bytes * 1000000000ULL) / 1024 / elapsed_ns);
+}
+
+void ext2_run_benchmark(const char* path) {
+    extern uint64_t hal_time_now_ns(void);
+    
+    uint32_t inode_num = ext2_lookup(path);
+    if (inode_num == 0) {
+        log_info("EXT2", "Benchmark file %s not present, skipping throughput benchmark", path);
+        return;
+    }
+    
+    ext2_inode_t inode;
+    if (read_inode(inode_num, &inode) != 0 || inode.size == 0) {
+        log_warning("EXT2", "Cannot use %s for the throughput benchmark", path);
+        return;
+    }
+    
+    // How many contiguous runs the file's blocks form on disk
+    uint32_t file_blocks = (inode.size + block_size - 1) / block_size;
+    uint32_t extents = 0;
+    uint32_t prev_block = 0;
+    for (uint32_t i = 0; i < file_blocks; i++) {
+        uint32_t block_num;
+        map_file_block(inode_num, &inode, i, 0, &block_num, NULL);
+        if (block_num != 0 && block_num != prev_block + 1) {
+            extents++;
+        }
+        prev_block = block_num;
+    }
+    log_info("EXT2", "Benchmark file %s: %u blocks in %u extents", path, file_blocks, extents);
+    
+    // Stream the whole file with small, block-sized and large requests
+    uint32_t chunk_sizes[3] = { 512, block_size, EXT2_BENCH_CHUNK };
+    for (int i = 0; i < 3; i++) {
+        uint32_t chunk = chunk_sizes[i];
+        uint32_t reads_before = ext2_block_reads;
+        uint32_t offset = 0;
+        
+        uint64_t start = hal_time_now_ns();
+        while (offset < inode.size) {
+            int result = ext2_read_at(inode_num, offset, ext2_bench_buffer, chunk);
+            if (result <= 0) {
+                break;
+            }
+            offset += result;
+        }
+        uint64_t elapsed = hal_time_now_ns() - start;
+        
+        uint32_t data_blocks = (offset + block_size - 1) / block_size;
+        log_info("EXT2", "Sequential read, %u byte requests: %u KB in %u ms (%u KB/s, %u device reads for %u data blocks)",
+                 chunk, offset / 1024, (uint32_t)(elapsed / 1000000ULL),
+                 ext2_bench_rate(offset, elapsed), ext2_block_reads - reads_before, data_blocks);
+    }
+    
+    // Rewrite the head of the file in place with its own contents
+    uint32_t limit = inode.size < EXT2_BENCH_WRITE_BYTES ? inode.size : EXT2_BENCH_WRITE_BYTES;
+    uint32_t offset = 0;
+    uint64_t write_ns = 0;
+    while (offset < limit) {
+        int result = ext2_read_at(inode_num, offset, ext2_bench_buffer, EXT2_BENCH_CHUNK);
+        if (result <= 0) {
+            break;
+        }
+        
+        uint64_t start = hal_time_now_ns();
+        int written = ext2_write_at(inode_num, offset, ext2_bench_buffer, result);
+        write_ns += hal_time_now_ns() - start;
+        if (written <= 0) {
+            break;
+        }
+        offset += written;
+    }
+    
+    log_info("EXT2", "Sequential write, %u byte requests: %u KB in %u ms (%u KB/s)",
+             EXT2_BENCH_CHUNK, offset / 1024, (uint32_t)(write_ns / 1000000ULL),
+             ext2_bench_rate(offset, write_ns));
+}
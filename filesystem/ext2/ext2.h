@@ -62,8 +62,49 @@ typedef struct {
     uint32_t rev_level;
     uint16_t def_resuid;
     uint16_t def_resgid;
+    // Dynamic revision (rev_level 1) fields, zero on revision 0 volumes
+    uint32_t first_ino;
+    uint16_t inode_size;
+    uint16_t block_group_nr;
+    uint32_t feature_compat;
+    uint32_t feature_incompat;
+    uint32_t feature_ro_compat;
+    uint8_t  uuid[16];
+    char     volume_name[16];
+    char     last_mounted[64];
+    uint32_t algorithm_usage_bitmap;
+    uint8_t  prealloc_blocks;
+    uint8_t  prealloc_dir_blocks;
+    uint16_t reserved_gdt_blocks;
+    uint8_t  journal_uuid[16];
+    uint32_t journal_inum;
+    uint32_t journal_dev;
+    uint32_t last_orphan;
+    uint32_t hash_seed[4];       // Seed for directory index hashes
+    uint8_t  def_hash_version;   // Hash used by new directory indexes
+    uint8_t  jnl_backup_type;
+    uint16_t desc_size;
+    uint32_t default_mount_opts;
+    uint32_t first_meta_bg;
+    uint32_t mkfs_time;
+    uint32_t jnl_blocks[17];
+    uint32_t blocks_count_hi;
+    uint32_t r_blocks_count_hi;
+    uint32_t free_blocks_hi;
+    uint16_t min_extra_isize;
+    uint16_t want_extra_isize;
+    uint32_t flags;              // EXT2_FLAGS_*
 } __attribute__((packed)) ext2_superblock_t;
 
+// Feature and superblock flags
+#define EXT2_FEATURE_COMPAT_DIR_INDEX   0x0020  // Directories may have an htree index
+#define EXT2_FEATURE_INCOMPAT_FILETYPE  0x0002  // Directory entries record the file type
+#define EXT2_FLAGS_SIGNED_HASH          0x0001  // Directory hashes treat name bytes as signed
+#define EXT2_FLAGS_UNSIGNED_HASH        0x0002  // Directory hashes treat name bytes as unsigned
+
+// Inode flags
+#define EXT2_INDEX_FL 0x00001000  // Directory has an htree index
+
 // Inode structure
 typedef struct {
     uint16_t mode;
@@ -95,6 +136,57 @@ typedef struct {
     char     name[];
 } __attribute__((packed)) ext2_dir_entry_t;
 
+// Bytes a directory entry with a name of the given length needs
+#define EXT2_DIR_REC_LEN(name_len) ((8 + (name_len) + 3) & ~3)
+
+// Directory entry file types
+#define EXT2_FT_UNKNOWN  0
+#define EXT2_FT_REG_FILE 1
+#define EXT2_FT_DIR      2
+#define EXT2_FT_CHRDEV   3
+#define EXT2_FT_BLKDEV   4
+#define EXT2_FT_FIFO     5
+#define EXT2_FT_SOCK     6
+#define EXT2_FT_SYMLINK  7
+
+// Directory index hashes
+#define EXT2_HASH_LEGACY   0
+#define EXT2_HASH_HALF_MD4 1
+#define EXT2_HASH_TEA      2
+
+// Htree index entry: the first child block holding names hashing to hash or
+// above. In entry 0 of a node the hash is replaced by the count and limit.
+typedef struct {
+    uint32_t hash;
+    uint32_t block;    // Directory block (file block index, not filesystem block)
+} __attribute__((packed)) ext2_dx_entry_t;
+
+typedef struct {
+    uint16_t limit;    // Entries the node has room for
+    uint16_t count;    // Entries in use
+} __attribute__((packed)) ext2_dx_countlimit_t;
+
+// Htree root in directory block 0. The ".." entry spans the rest of the
+// block, so code that does not know the index sees an ordinary directory.
+typedef struct {
+    uint32_t dot_inode;
+    uint16_t dot_rec_len;      // 12
+    uint8_t  dot_name_len;
+    uint8_t  dot_file_type;
+    char     dot_name[4];
+    uint32_t dotdot_inode;
+    uint16_t dotdot_rec_len;   // Rest of the block
+    uint8_t  dotdot_name_len;
+    uint8_t  dotdot_file_type;
+    char     dotdot_name[4];
+    uint32_t reserved_zero;
+    uint8_t  hash_version;     // EXT2_HASH_*
+    uint8_t  info_length;      // 8
+    uint8_t  indirect_levels;  // Index node levels below the root
+    uint8_t  unused_flags;
+    // Index entries follow
+} __attribute__((packed)) ext2_dx_root_t;
+
 // File entry structure for directory listing
 typedef struct {
     char     name[256]; // Max filename length in ext2
@@ -120,6 +212,32 @@ int ext2_read_file(const char* path, char* buffer, int size);
 // Returns: Number of bytes written or an error code (negative value)
 int ext2_write_file(const char* path, const char* buffer, int size, int flags);
 
+// Resolve a path to its inode number
+// Returns: Inode number, or 0 if the path does not exist
+uint32_t ext2_lookup(const char* path);
+
+// Get the dentry cache namespace of the mounted volume (handles are inode numbers)
+uint32_t ext2_get_dcache_namespace(void);
+
+// Read part of a file, touching only the blocks that cover the range
+// Returns: Number of bytes read (0 at end of file) or an error code (negative value)
+int ext2_read_at(uint32_t inode_num, uint32_t offset, void* buffer, uint32_t size);
+
+// Write part of a file, allocating blocks as needed and extending its size
+// Returns: Number of bytes written or an error code (negative value)
+int ext2_write_at(uint32_t inode_num, uint32_t offset, const void* buffer, uint32_t size);
+
+// Give back the blocks preallocated ahead of a file's end (call when the file is closed)
+void ext2_discard_prealloc(uint32_t inode_num);
+
+// Release every preallocation window and write back the bitmaps, group
+// descriptors and superblock (call before unmounting)
+// Returns: 0 on success or an error code (negative value)
+int ext2_sync(void);
+
+// Measure sequential read/write throughput on a file of the mounted volume
+void ext2_run_benchmark(const char* path);
+
 // List files in a directory
 // Returns: Number of entries found or an error code (negative value)
 int ext2_list_directory(const char* path, ext2_file_entry_t* entries, int max_entries);
@@ -85,6 +85,7 @@ typedef struct {
 /* Structure to keep file reading state */
 typedef struct {
     char filepath[VFS_MAX_PATH];   /* File path */
+    uint32_t inode_num;           /* Inode of the open file */
     uint32_t size;                /* Size of the file */
     uint32_t position;            /* Current position in file */
 } ext2_file_data_t;
@@ -103,6 +104,9 @@ static int ext2_vfs_mount(vfs_mount_t* mount) {
     /* No special mount data needed for our EXT2 implementation */
     mount->fs_data = NULL;
     
+    /* Path lookups and the VFS share the volume's dentry cache namespace */
+    mount->dcache_ns = ext2_get_dcache_namespace();
+    
     return VFS_SUCCESS;
 }
 
@@ -110,8 +114,8 @@ static int ext2_vfs_mount(vfs_mount_t* mount) {
 static int ext2_vfs_unmount(vfs_mount_t* mount) {
     log_info("EXT2-VFS", "Unmounting EXT2 filesystem from %s", mount->mount_point);
     
-    /* No special unmount procedure needed for our EXT2 implementation */
-    return VFS_SUCCESS;
+    /* Return preallocated blocks and write back the allocation metadata */
+    return ext2_to_vfs_error(ext2_sync());
 }
 
 /* Open function for EXT2 */
@@ -176,6 +180,14 @@ static int ext2_vfs_open(vfs_mount_t* mount, const char* path, int flags, vfs_fi
         file_data->size = 0;
     }
     
+    /* Resolve the inode once so reads and writes skip the path walk */
+    file_data->inode_num = ext2_lookup(ext2_path);
+    if (file_data->inode_num == 0) {
+        free(file_data);
+        log_error("EXT2-VFS", "Failed to look up inode: %s", ext2_path);
+        return VFS_ERR_NOT_FOUND;
+    }
+    
     /* Store file data in the file handle */
     (*file)->fs_data = file_data;
     
@@ -190,6 +202,9 @@ static int ext2_vfs_close(vfs_file_t* file) {
         return VFS_ERR_INVALID_ARG;
     }
     
+    /* Blocks reserved for further appends are not needed any more */
+    ext2_discard_prealloc(((ext2_file_data_t*)file->fs_data)->inode_num);
+    
     /* Free the file data */
     free(file->fs_data);
     file->fs_data = NULL;
@@ -216,26 +231,13 @@ static int ext2_vfs_read(vfs_file_t* file, void* buffer, uint32_t size, uint32_t
         size = file_data->size - file_data->position;
     }
     
-    /* Allocate a buffer for the entire file */
-    char* file_buffer = (char*)malloc(file_data->size);
-    if (!file_buffer) {
-        log_error("EXT2-VFS", "Failed to allocate memory for file read");
-        return VFS_ERR_NO_SPACE;
-    }
-    
-    /* Read the entire file */
-    int result = ext2_read_file(file_data->filepath, file_buffer, file_data->size);
+    /* Read only the blocks covering the requested range */
+    int result = ext2_read_at(file_data->inode_num, file_data->position, buffer, size);
     if (result < 0) {
-        free(file_buffer);
         log_error("EXT2-VFS", "Error reading file: %s (%d)", file_data->filepath, result);
         return ext2_to_vfs_error(result);
     }
-    
-    /* Copy the requested portion to the user's buffer */
-    memcpy(buffer, file_buffer + file_data->position, size);
-    
-    /* Free the temporary buffer */
-    free(file_buffer);
+    size = result;
     
     /* Update position and return read size */
     file_data->position += size;
@@ -252,75 +254,26 @@ static int ext2_vfs_write(vfs_file_t* file, const void* buffer, uint32_t size, u
     
     ext2_file_data_t* file_data = (ext2_file_data_t*)file->fs_data;
     
-    /* If we have existing content and the position is not at the start, we need
-     * to read the file first, modify it, and write it back */
-    if ((file_data->size > 0 && file_data->position > 0) || 
-        (file->flags & VFS_OPEN_APPEND)) {
-        
-        /* If append mode, position at the end */
-        if (file->flags & VFS_OPEN_APPEND) {
-            file_data->position = file_data->size;
-        }
-        
-        /* Allocate a buffer for the entire new file content */
-        uint32_t new_size = file_data->position + size;
-        if (new_size < file_data->size) {
-            new_size = file_data->size;
-        }
-        
-        char* new_content = (char*)malloc(new_size);
-        if (!new_content) {
-            log_error("EXT2-VFS", "Failed to allocate memory for file write");
-            return VFS_ERR_NO_SPACE;
-        }
-        
-        /* If there's existing content, read it */
-        if (file_data->size > 0) {
-            int read_result = ext2_read_file(file_data->filepath, new_content, file_data->size);
-            if (read_result < 0) {
-                free(new_content);
-                log_error("EXT2-VFS", "Error reading existing file content: %s (%d)", file_data->filepath, read_result);
-                return ext2_to_vfs_error(read_result);
-            }
-        }
-        
-        /* Copy new data at the current position */
-        memcpy(new_content + file_data->position, buffer, size);
-        
-        /* Write the entire file back */
-        int write_result = ext2_write_file(file_data->filepath, new_content, new_size, 0);
-        free(new_content);
-        
-        if (write_result < 0) {
-            log_error("EXT2-VFS", "Error writing to file: %s (%d)", file_data->filepath, write_result);
-            return ext2_to_vfs_error(write_result);
-        }
-        
-        /* Update file size and position */
-        file_data->size = new_size;
-        file_data->position += size;
-        
-        /* Return success */
-        *bytes_written = size;
-        return VFS_SUCCESS;
-    } 
-    else {
-        /* Simple case: writing to the beginning of the file or an empty file */
-        int write_result = ext2_write_file(file_data->filepath, buffer, size, 0);
-        
-        if (write_result < 0) {
-            log_error("EXT2-VFS", "Error writing to file: %s (%d)", file_data->filepath, write_result);
-            return ext2_to_vfs_error(write_result);
-        }
-        
-        /* Update file size and position */
-        file_data->size = size;
-        file_data->position = size;
-        
-        /* Return success */
-        *bytes_written = size;
-        return VFS_SUCCESS;
+    /* If append mode, position at the end */
+    if (file->flags & VFS_OPEN_APPEND) {
+        file_data->position = file_data->size;
+    }
+    
+    /* Write only the blocks covering the range, the rest of the file is untouched */
+    int write_result = ext2_write_at(file_data->inode_num, file_data->position, buffer, size);
+    if (write_result < 0) {
+        log_error("EXT2-VFS", "Error writing to file: %s (%d)", file_data->filepath, write_result);
+        return ext2_to_vfs_error(write_result);
     }
+    
+    /* Update file size and position */
+    file_data->position += write_result;
+    if (file_data->position > file_data->size) {
+        file_data->size = file_data->position;
+    }
+    
+    *bytes_written = write_result;
+    return VFS_SUCCESS;
 }
 
 /* Seek function for EXT2 */
@@ -1,9 +1,17 @@
 #include "fat12.h"
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
 #include "../kernel/io.h"
+#include "../kernel/logging/log.h"
+#include "../memory/heap.h"
+#include "vfs/vfs.h"
 
 #define SECTOR_SIZE 512
+#define FAT12_DEVICE_NAME "fat12_disk"
+#define FAT12_MAX_CLUSTERS 4096    // Cluster numbers are 12 bits wide
+#define FAT12_EOC 0xFF8            // Entries at or above this end a chain
+#define FAT12_MAX_CACHE_BLOCK 4096 // Largest VFS cache block read through
 
 // FAT12 Boot Sector structure
 struct fat12_boot_sector {
@@ -41,120 +49,240 @@ struct fat12_dir_entry {
 
 static struct fat12_boot_sector boot_sector;
 
+// Block device the volume is read from
+static vfs_block_device_t* fat12_device = NULL;
+
+// The FAT with its 12-bit entries unpacked, indexed by cluster number
+static uint16_t fat_table[FAT12_MAX_CLUSTERS];
+static uint32_t fat_entries = 0;
+
+// Volume layout in sectors
+static uint32_t root_dir_start = 0;
+static uint32_t root_dir_sectors = 0;
+static uint32_t data_start = 0;
+
+// Built-in volume, registered as the FAT12 device when no real one exists
+static uint8_t disk_image[1024 * 1024];  // 1MB disk image
+
+// Fill the built-in volume with a basic FAT12 structure and sample files
+static void fat12_build_image(void) {
+    // Create boot sector
+    struct fat12_boot_sector* bs = (struct fat12_boot_sector*)&disk_image[0];
+    bs->jump[0] = 0xEB;          // JMP instruction
+    bs->jump[1] = 0x3C;
+    bs->jump[2] = 0x90;
+    memcpy(bs->oem, "UINTOS  ", 8);
+    bs->bytes_per_sector = 512;
+    bs->sectors_per_cluster = 1;
+    bs->reserved_sectors = 1;
+    bs->num_fats = 2;
+    bs->root_dir_entries = 224;
+    bs->total_sectors = 2880;    // 1.44MB floppy
+    bs->media_descriptor = 0xF0; // 3.5" floppy
+    bs->sectors_per_fat = 9;
+    bs->sectors_per_track = 18;
+    bs->num_heads = 2;
+    bs->hidden_sectors = 0;
+    bs->large_sector_count = 0;
+    
+    // Calculate some key offsets
+    uint16_t fat_start = bs->reserved_sectors;
+    uint16_t root_dir_start = fat_start + bs->num_fats * bs->sectors_per_fat;
+    uint16_t data_start = root_dir_start + ((bs->root_dir_entries * 32) + (bs->bytes_per_sector - 1)) / bs->bytes_per_sector;
+    
+    // Initialize the first FAT
+    disk_image[fat_start * 512] = bs->media_descriptor;
+    disk_image[fat_start * 512 + 1] = 0xFF;
+    disk_image[fat_start * 512 + 2] = 0xFF;
+    
+    // Initialize the second FAT (identical to the first)
+    memcpy(&disk_image[(fat_start + bs->sectors_per_fat) * 512], 
+           &disk_image[fat_start * 512], 
+           bs->sectors_per_fat * 512);
+    
+    // Create some sample files in the root directory
+    struct fat12_dir_entry* dir = (struct fat12_dir_entry*)&disk_image[root_dir_start * 512];
+    
+    // File 1: README.TXT
+    memcpy(dir->name, "README  TXT", 11);
+    dir->attr = 0x20;  // Archive attribute
+    dir->first_cluster_low = 2;
+    dir->file_size = 37;
+    dir->create_date = 0x5345;  // Some date value
+    dir->create_time = 0x6123;  // Some time value
+    dir->write_date = 0x5345;
+    dir->write_time = 0x6123;
+    
+    // Content for README.TXT
+    char* readme_content = "uintOS - A simple educational OS\r\n";
+    memcpy(&disk_image[data_start * 512], readme_content, strlen(readme_content));
+    
+    // File 2: KERNEL.BIN
+    dir++;
+    memcpy(dir->name, "KERNEL  BIN", 11);
+    dir->attr = 0x20;  // Archive attribute
+    dir->first_cluster_low = 3;
+    dir->file_size = 512;  // 512 byte kernel
+    dir->create_date = 0x5345;  // Some date value
+    dir->create_time = 0x6123;  // Some time value
+    dir->write_date = 0x5345;
+    dir->write_time = 0x6123;
+    
+    // Simple content for KERNEL.BIN
+    memset(&disk_image[(data_start + 1) * 512], 0xAA, 512);
+    
+    // Directory: SYSTEM
+    dir++;
+    memcpy(dir->name, "SYSTEM     ", 11);
+    dir->attr = 0x10;  // Directory attribute
+    dir->first_cluster_low = 4;
+    dir->file_size = 0;  // Directories have size 0
+    dir->create_date = 0x5345;
+    dir->create_time = 0x6123;
+    dir->write_date = 0x5345;
+    dir->write_time = 0x6123;
+    
+    // File 3: LOG.TXT
+    dir++;
+    memcpy(dir->name, "LOG     TXT", 11);
+    dir->attr = 0x20;  // Archive attribute
+    dir->first_cluster_low = 5;
+    dir->file_size = 24;
+    dir->create_date = 0x5345;
+    dir->create_time = 0x6123;
+    dir->write_date = 0x5345;
+    dir->write_time = 0x6123;
+    
+    // Content for LOG.TXT
+    char* log_content = "System started up OK\r\n";
+    memcpy(&disk_image[(data_start + 3) * 512], log_content, strlen(log_content));
+}
+
+// Read blocks of the built-in volume (blocks past its end read as zeroes)
+static int fat12_image_read_blocks(vfs_block_device_t* device, uint64_t block, uint32_t count, void* buffer) {
+    uint8_t* out = (uint8_t*)buffer;
+    
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t offset = (block + i) * SECTOR_SIZE;
+        if (offset + SECTOR_SIZE <= sizeof(disk_image)) {
+            memcpy(out + i * SECTOR_SIZE, &disk_image[offset], SECTOR_SIZE);
+        } else {
+            memset(out + i * SECTOR_SIZE, 0, SECTOR_SIZE);
+        }
+    }
+    
+    return count;
+}
+
+static vfs_block_device_ops_t fat12_image_ops = {
+    .read_blocks = fat12_image_read_blocks,
+    .write_blocks = NULL,
+    .sync = NULL,
+};
+
+static vfs_block_device_t fat12_image_device = {
+    .name = FAT12_DEVICE_NAME,
+    .block_size = SECTOR_SIZE,
+    .block_count = sizeof(disk_image) / SECTOR_SIZE,
+    .operations = &fat12_image_ops,
+};
+
 // Function to read a sector from disk
 int read_sector(uint32_t sector, void* buffer) {
-    // This would normally use a disk driver to read from an actual disk
-    // For a simple implementation, we'll create a basic in-memory disk image
-    
-    static int initialized = 0;
-    static uint8_t disk_image[1024 * 1024];  // 1MB disk image
+    if (!fat12_device) {
+        return 0;
+    }
     
-    // Initialize disk image with a basic FAT12 structure on first use
-    if (!initialized) {
-        initialized = 1;
-        
-        // Create boot sector
-        struct fat12_boot_sector* bs = (struct fat12_boot_sector*)&disk_image[0];
-        bs->jump[0] = 0xEB;          // JMP instruction
-        bs->jump[1] = 0x3C;
-        bs->jump[2] = 0x90;
-        memcpy(bs->oem, "UINTOS  ", 8);
-        bs->bytes_per_sector = 512;
-        bs->sectors_per_cluster = 1;
-        bs->reserved_sectors = 1;
-        bs->num_fats = 2;
-        bs->root_dir_entries = 224;
-        bs->total_sectors = 2880;    // 1.44MB floppy
-        bs->media_descriptor = 0xF0; // 3.5" floppy
-        bs->sectors_per_fat = 9;
-        bs->sectors_per_track = 18;
-        bs->num_heads = 2;
-        bs->hidden_sectors = 0;
-        bs->large_sector_count = 0;
-        
-        // Calculate some key offsets
-        uint16_t fat_start = bs->reserved_sectors;
-        uint16_t root_dir_start = fat_start + bs->num_fats * bs->sectors_per_fat;
-        uint16_t data_start = root_dir_start + ((bs->root_dir_entries * 32) + (bs->bytes_per_sector - 1)) / bs->bytes_per_sector;
-        
-        // Initialize the first FAT
-        disk_image[fat_start * 512] = bs->media_descriptor;
-        disk_image[fat_start * 512 + 1] = 0xFF;
-        disk_image[fat_start * 512 + 2] = 0xFF;
-        
-        // Initialize the second FAT (identical to the first)
-        memcpy(&disk_image[(fat_start + bs->sectors_per_fat) * 512], 
-               &disk_image[fat_start * 512], 
-               bs->sectors_per_fat * 512);
-        
-        // Create some sample files in the root directory
-        struct fat12_dir_entry* dir = (struct fat12_dir_entry*)&disk_image[root_dir_start * 512];
-        
-        // File 1: README.TXT
-        memcpy(dir->name, "README  TXT", 11);
-        dir->attr = 0x20;  // Archive attribute
-        dir->first_cluster_low = 2;
-        dir->file_size = 37;
-        dir->create_date = 0x5345;  // Some date value
-        dir->create_time = 0x6123;  // Some time value
-        dir->write_date = 0x5345;
-        dir->write_time = 0x6123;
-        
-        // Content for README.TXT
-        char* readme_content = "uintOS - A simple educational OS\r\n";
-        memcpy(&disk_image[data_start * 512], readme_content, strlen(readme_content));
+    // Go through the shared block cache when it is enabled; a cache block
+    // holds several consecutive sectors
+    uint32_t cache_block_size = vfs_cache_get_block_size();
+    if (cache_block_size >= SECTOR_SIZE && cache_block_size <= FAT12_MAX_CACHE_BLOCK) {
+        uint8_t block[FAT12_MAX_CACHE_BLOCK];
+        uint32_t sectors_per_block = cache_block_size / SECTOR_SIZE;
         
-        // File 2: KERNEL.BIN
-        dir++;
-        memcpy(dir->name, "KERNEL  BIN", 11);
-        dir->attr = 0x20;  // Archive attribute
-        dir->first_cluster_low = 3;
-        dir->file_size = 512;  // 512 byte kernel
-        dir->create_date = 0x5345;  // Some date value
-        dir->create_time = 0x6123;  // Some time value
-        dir->write_date = 0x5345;
-        dir->write_time = 0x6123;
-        
-        // Simple content for KERNEL.BIN
-        memset(&disk_image[(data_start + 1) * 512], 0xAA, 512);
-        
-        // Directory: SYSTEM
-        dir++;
-        memcpy(dir->name, "SYSTEM     ", 11);
-        dir->attr = 0x10;  // Directory attribute
-        dir->first_cluster_low = 4;
-        dir->file_size = 0;  // Directories have size 0
-        dir->create_date = 0x5345;
-        dir->create_time = 0x6123;
-        dir->write_date = 0x5345;
-        dir->write_time = 0x6123;
-        
-        // File 3: LOG.TXT
-        dir++;
-        memcpy(dir->name, "LOG     TXT", 11);
-        dir->attr = 0x20;  // Archive attribute
-        dir->first_cluster_low = 5;
-        dir->file_size = 24;
-        dir->create_date = 0x5345;
-        dir->create_time = 0x6123;
-        dir->write_date = 0x5345;
-        dir->write_time = 0x6123;
-        
-        // Content for LOG.TXT
-        char* log_content = "System started up OK\r\n";
-        memcpy(&disk_image[(data_start + 3) * 512], log_content, strlen(log_content));
+        if (vfs_cache_read_block(fat12_device->id, sector / sectors_per_block, block) == VFS_SUCCESS) {
+            memcpy(buffer, block + (sector % sectors_per_block) * SECTOR_SIZE, SECTOR_SIZE);
+            return SECTOR_SIZE;
+        }
+    }
+    
+    // Uncached read straight from the device
+    if (fat12_device->operations->read_blocks(fat12_device, sector, 1, buffer) != 1) {
+        return 0;
+    }
+    
+    return SECTOR_SIZE;  // Return number of bytes read
+}
+
+// Next cluster in a chain (an end-of-chain marker if the cluster is out of range)
+static uint16_t fat12_next_cluster(uint16_t cluster) {
+    if (cluster >= fat_entries) {
+        return 0xFFF;
+    }
+    return fat_table[cluster];
+}
+
+// Read the first FAT and unpack its 12-bit entries into fat_table
+static int fat12_load_fat(void) {
+    uint32_t total_sectors = boot_sector.total_sectors ? boot_sector.total_sectors : boot_sector.large_sector_count;
+    if (total_sectors <= data_start || boot_sector.sectors_per_cluster == 0) {
+        return FAT12_ERR_BAD_FORMAT;
+    }
+    
+    // Two reserved entries precede the first data cluster
+    fat_entries = (total_sectors - data_start) / boot_sector.sectors_per_cluster + 2;
+    if (fat_entries > FAT12_MAX_CLUSTERS) {
+        fat_entries = FAT12_MAX_CLUSTERS;
+    }
+    if (fat_entries * 3 / 2 + 1 > (uint32_t)boot_sector.sectors_per_fat * SECTOR_SIZE) {
+        return FAT12_ERR_BAD_FORMAT;
     }
     
-    // Read the requested sector from our in-memory disk image
-    if (sector * 512 >= sizeof(disk_image)) {
-        return 0;  // Out of bounds
+    // Entries straddle sector boundaries, so read the FAT in one piece first
+    uint8_t* raw = (uint8_t*)malloc(boot_sector.sectors_per_fat * SECTOR_SIZE);
+    if (!raw) {
+        return FAT12_ERR_NO_SPACE;
     }
     
-    memcpy(buffer, &disk_image[sector * 512], 512);
-    return 512;  // Return number of bytes read
+    for (uint32_t i = 0; i < boot_sector.sectors_per_fat; i++) {
+        if (read_sector(boot_sector.reserved_sectors + i, raw + i * SECTOR_SIZE) != SECTOR_SIZE) {
+            free(raw);
+            return FAT12_ERR_IO_ERROR;
+        }
+    }
+    
+    for (uint32_t cluster = 0; cluster < fat_entries; cluster++) {
+        uint32_t offset = cluster * 3 / 2;
+        if (cluster & 1) {
+            fat_table[cluster] = (raw[offset] >> 4) | (raw[offset + 1] << 4);
+        } else {
+            fat_table[cluster] = raw[offset] | ((raw[offset + 1] & 0x0F) << 8);
+        }
+    }
+    
+    free(raw);
+    return FAT12_SUCCESS;
 }
 
 void fat12_init() {
+    // Use the real FAT12 device if a driver registered one, otherwise the built-in volume
+    fat12_device = vfs_get_block_device(FAT12_DEVICE_NAME);
+    if (!fat12_device) {
+        fat12_build_image();
+        if (vfs_register_block_device(&fat12_image_device) == VFS_SUCCESS) {
+            fat12_device = &fat12_image_device;
+        } else {
+            log_error("FAT12", "Failed to register the built-in FAT12 volume");
+            return;
+        }
+    }
+    
+    if (fat12_device->block_size != SECTOR_SIZE) {
+        log_error("FAT12", "Unsupported device block size %u", fat12_device->block_size);
+        fat12_device = NULL;
+        return;
+    }
+    
     // Read the boot sector from the disk
     read_sector(0, (uint8_t*)&boot_sector);
 
@@ -164,74 +292,169 @@ void fat12_init() {
         return;
     }
 
-    // Additional initialization logic can go here
+    root_dir_sectors = (boot_sector.root_dir_entries * 32 + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    root_dir_start = boot_sector.reserved_sectors + boot_sector.num_fats * boot_sector.sectors_per_fat;
+    data_start = root_dir_start + root_dir_sectors;
+    
+    // Decode the FAT once so chain walks never touch the disk
+    int result = fat12_load_fat();
+    if (result != FAT12_SUCCESS) {
+        log_error("FAT12", "Failed to load the FAT: %d", result);
+        fat_entries = 0;
+    }
 }
 
-int fat12_read_file(const char* filename, char* buffer, int size) {
-    // Locate the file in the root directory
-    uint16_t root_dir_sectors = (boot_sector.root_dir_entries * 32 + SECTOR_SIZE - 1) / SECTOR_SIZE;
-    uint16_t root_dir_start = boot_sector.reserved_sectors + boot_sector.num_fats * boot_sector.sectors_per_fat;
+// Convert a file name to the space-padded 8.3 directory form; names that are
+// already 11 characters without a dot are taken as-is
+static void fat12_to_dir_name(const char* filename, char* fat_filename) {
+    if (strlen(filename) == 11 && !strchr(filename, '.')) {
+        memcpy(fat_filename, filename, 11);
+        return;
+    }
+    
+    memset(fat_filename, ' ', 11);
+    
+    int i = 0;
+    while (filename[i] != '\0' && filename[i] != '.' && i < 8) {
+        fat_filename[i] = filename[i];
+        i++;
+    }
+    
+    const char* dot = strchr(filename, '.');
+    if (dot) {
+        for (int j = 0; j < 3 && dot[1 + j] != '\0'; j++) {
+            fat_filename[8 + j] = dot[1 + j];
+        }
+    }
+}
 
-    for (uint16_t sector = 0; sector < root_dir_sectors; sector++) {
+// Find the root directory entry of a file
+static int fat12_find_entry(const char* filename, struct fat12_dir_entry* entry) {
+    char fat_filename[11];
+    fat12_to_dir_name(filename, fat_filename);
+    
+    for (uint32_t sector = 0; sector < root_dir_sectors; sector++) {
         uint8_t sector_data[SECTOR_SIZE];
-        read_sector(root_dir_start + sector, sector_data);
-
+        if (read_sector(root_dir_start + sector, sector_data) != SECTOR_SIZE) {
+            return FAT12_ERR_IO_ERROR;
+        }
+        
         struct fat12_dir_entry* entries = (struct fat12_dir_entry*)sector_data;
         for (int i = 0; i < SECTOR_SIZE / sizeof(struct fat12_dir_entry); i++) {
             if (entries[i].name[0] == 0x00) {
                 // End of directory
-                return -1;
+                return FAT12_ERR_NOT_FOUND;
+            }
+            
+            if ((uint8_t)entries[i].name[0] != 0xE5 && memcmp(entries[i].name, fat_filename, 11) == 0) {
+                *entry = entries[i];
+                return FAT12_SUCCESS;
             }
+        }
+    }
+    
+    return FAT12_ERR_NOT_FOUND;
+}
 
-            if (entries[i].name[0] != 0xE5 && strncmp(entries[i].name, filename, 11) == 0) {
-                // File found, read its contents
-                uint16_t cluster = entries[i].first_cluster_low;
-                int bytes_read = 0;
-                int file_size = entries[i].file_size;
-                
-                // Ensure we don't read more than the file size or buffer size
-                int max_bytes_to_read = (file_size < size) ? file_size : size;
-
-                while (cluster < 0xFF8 && bytes_read < max_bytes_to_read) {
-                    uint16_t cluster_sector = root_dir_start + root_dir_sectors + (cluster - 2) * boot_sector.sectors_per_cluster;
-                    
-                    // Calculate how many bytes to read from this sector
-                    int bytes_to_read = SECTOR_SIZE;
-                    if (bytes_read + bytes_to_read > max_bytes_to_read) {
-                        bytes_to_read = max_bytes_to_read - bytes_read;
-                    }
-                    
-                    // Read the sector data into a temporary buffer first
-                    uint8_t sector_data[SECTOR_SIZE];
-                    read_sector(cluster_sector, sector_data);
-                    
-                    // Copy only the needed bytes to the output buffer
-                    for (int j = 0; j < bytes_to_read; j++) {
-                        buffer[bytes_read + j] = sector_data[j];
-                    }
-                    
-                    bytes_read += bytes_to_read;
-
-                    // Read the next cluster from the FAT
-                    uint16_t fat_offset = cluster * 3 / 2;
-                    uint16_t fat_sector = boot_sector.reserved_sectors + fat_offset / SECTOR_SIZE;
-                    uint8_t fat_data[SECTOR_SIZE];
-                    read_sector(fat_sector, fat_data);
-
-                    if (cluster & 1) {
-                        cluster = (fat_data[fat_offset % SECTOR_SIZE] >> 4) | (fat_data[fat_offset % SECTOR_SIZE + 1] << 4);
-                    } else {
-                        cluster = fat_data[fat_offset % SECTOR_SIZE] | ((fat_data[fat_offset % SECTOR_SIZE + 1] & 0x0F) << 8);
-                    }
-                }
+// Cluster at a position in the file's chain, walking on from the cursor
+// (or from the start when seeking backwards). Returns 0 if the chain is shorter.
+static uint16_t fat12_seek_cluster(fat12_cursor_t* cursor, uint32_t index) {
+    if (cursor->cluster == 0 || index < cursor->index) {
+        cursor->cluster = cursor->first_cluster;
+        cursor->index = 0;
+    }
+    
+    while (cursor->index < index) {
+        uint16_t next = fat12_next_cluster(cursor->cluster);
+        if (next < 2 || next >= FAT12_EOC) {
+            return 0;
+        }
+        cursor->cluster = next;
+        cursor->index++;
+    }
+    
+    return cursor->cluster;
+}
 
-                return bytes_read;
+int fat12_open_cursor(const char* filename, fat12_cursor_t* cursor) {
+    struct fat12_dir_entry entry;
+    int result = fat12_find_entry(filename, &entry);
+    if (result != FAT12_SUCCESS) {
+        return result;
+    }
+    
+    cursor->first_cluster = entry.first_cluster_low;
+    cursor->size = entry.file_size;
+    cursor->cluster = 0;
+    cursor->index = 0;
+    
+    return FAT12_SUCCESS;
+}
+
+int fat12_read_at(fat12_cursor_t* cursor, uint32_t offset, void* buffer, uint32_t size) {
+    if (!cursor || !buffer) {
+        return FAT12_ERR_INVALID_ARG;
+    }
+    
+    // Nothing to read at or past the end of the file
+    if (offset >= cursor->size) {
+        return 0;
+    }
+    if (size > cursor->size - offset) {
+        size = cursor->size - offset;
+    }
+    
+    uint8_t* out = (uint8_t*)buffer;
+    uint32_t cluster_size = boot_sector.sectors_per_cluster * SECTOR_SIZE;
+    uint32_t bytes_read = 0;
+    
+    while (bytes_read < size) {
+        uint32_t pos = offset + bytes_read;
+        uint16_t cluster = fat12_seek_cluster(cursor, pos / cluster_size);
+        if (cluster < 2) {
+            // Chain ends before the recorded file size
+            return bytes_read > 0 ? (int)bytes_read : FAT12_ERR_BAD_FORMAT;
+        }
+        
+        uint32_t in_cluster = pos % cluster_size;
+        uint32_t sector = data_start + (cluster - 2) * boot_sector.sectors_per_cluster + in_cluster / SECTOR_SIZE;
+        uint32_t sector_offset = in_cluster % SECTOR_SIZE;
+        uint32_t chunk = SECTOR_SIZE - sector_offset;
+        if (chunk > size - bytes_read) {
+            chunk = size - bytes_read;
+        }
+        
+        if (chunk == SECTOR_SIZE) {
+            // Whole sector: read straight into the caller's buffer
+            if (read_sector(sector, out + bytes_read) != SECTOR_SIZE) {
+                return bytes_read > 0 ? (int)bytes_read : FAT12_ERR_IO_ERROR;
+            }
+        } else {
+            uint8_t sector_data[SECTOR_SIZE];
+            if (read_sector(sector, sector_data) != SECTOR_SIZE) {
+                return bytes_read > 0 ? (int)bytes_read : FAT12_ERR_IO_ERROR;
             }
+            memcpy(out + bytes_read, sector_data + sector_offset, chunk);
         }
+        
+        bytes_read += chunk;
     }
+    
+    return bytes_read;
+}
 
-    // File not found
-    return -1;
+int fat12_read_file(const char* filename, char* buffer, int size) {
+    if (size < 0) {
+        return FAT12_ERR_INVALID_ARG;
+    }
+    
+    fat12_cursor_t cursor;
+    int result = fat12_open_cursor(filename, &cursor);
+    if (result != FAT12_SUCCESS) {
+        return result;
+    }
+    
+    return fat12_read_at(&cursor, 0, buffer, size);
 }
 
 // Implements directory listing functionality
@@ -32,6 +32,15 @@ typedef struct {
     uint16_t last_modified_time;
 } fat12_file_entry_t;
 
+// Position within a file's cluster chain. Kept per open file so that
+// sequential reads and forward seeks walk only the clusters in between.
+typedef struct {
+    uint16_t first_cluster;  // First cluster of the file
+    uint32_t size;           // File size in bytes
+    uint16_t cluster;        // Cluster at chain position index (0 before the first read)
+    uint32_t index;          // Position of cluster within the chain
+} fat12_cursor_t;
+
 // Initialize the FAT12 filesystem
 void fat12_init();
 
@@ -39,6 +48,14 @@ void fat12_init();
 // Returns: Number of bytes read or an error code (negative value)
 int fat12_read_file(const char* filename, char* buffer, int size);
 
+// Look up a file and set up a cursor at its start
+// Returns: FAT12_SUCCESS or an error code (negative value)
+int fat12_open_cursor(const char* filename, fat12_cursor_t* cursor);
+
+// Read part of a file, touching only the sectors that cover the range
+// Returns: Number of bytes read (0 at end of file) or an error code (negative value)
+int fat12_read_at(fat12_cursor_t* cursor, uint32_t offset, void* buffer, uint32_t size);
+
 // List files in a directory
 // Returns: Number of entries found or an error code (negative value)
 int fat12_list_directory(const char* path, fat12_file_entry_t* entries, int max_entries);
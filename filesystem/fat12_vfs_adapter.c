@@ -77,6 +77,7 @@ typedef struct {
     char filename[VFS_MAX_PATH];    /* Filename */
     int file_size;                  /* Size of the file */
     int current_position;           /* Current position in file */
+    fat12_cursor_t cursor;          /* Cluster chain position of the last read */
 } fat12_file_data_t;
 
 /* Mount function for FAT12 */
@@ -142,6 +143,13 @@ static int fat12_vfs_open(vfs_mount_t* mount, const char* path, int flags, vfs_f
     file_data->file_size = file_size;
     file_data->current_position = 0;
     
+    int result = fat12_open_cursor(fat12_path, &file_data->cursor);
+    if (result < 0) {
+        free(file_data);
+        log_error("FAT12-VFS", "Error opening file: %s (%d)", fat12_path, result);
+        return fat12_to_vfs_error(result);
+    }
+    
     /* Store file data in the file handle */
     (*file)->fs_data = file_data;
     
@@ -182,26 +190,13 @@ static int fat12_vfs_read(vfs_file_t* file, void* buffer, uint32_t size, uint32_
         size = file_data->file_size - file_data->current_position;
     }
     
-    /* Allocate a buffer for the entire file */
-    char* file_buffer = (char*)malloc(file_data->file_size);
-    if (!file_buffer) {
-        log_error("FAT12-VFS", "Failed to allocate memory for file read");
-        return VFS_ERR_NO_SPACE;
-    }
-    
-    /* Read the entire file - FAT12 implementation doesn't support partial reads */
-    int result = fat12_read_file(file_data->filename, file_buffer, file_data->file_size);
+    /* Read only the sectors covering the requested range */
+    int result = fat12_read_at(&file_data->cursor, file_data->current_position, buffer, size);
     if (result < 0) {
-        free(file_buffer);
         log_error("FAT12-VFS", "Error reading file: %s (%d)", file_data->filename, result);
         return fat12_to_vfs_error(result);
     }
-    
-    /* Copy the requested portion to the user's buffer */
-    memcpy(buffer, file_buffer + file_data->current_position, size);
-    
-    /* Free the temporary buffer */
-    free(file_buffer);
+    size = result;
     
     /* Update position and return read size */
     file_data->current_position += size;
@@ -264,6 +259,9 @@ static int fat12_vfs_write(vfs_file_t* file, const void* buffer, uint32_t size,
         file_data->file_size = file_data->current_position;
     }
     
+    /* The rewrite may have moved the cluster chain */
+    fat12_open_cursor(file_data->filename, &file_data->cursor);
+    
     /* Return the number of bytes written */
     *bytes_written = size;
     
@@ -3,6 +3,7 @@
 #include <stddef.h>
 #include <string.h>
 #include "../../kernel/io.h"
+#include "../vfs/vfs.h"
 
 // Static variables to store filesystem state
 static iso9660_volume_descriptor_t primary_volume_descriptor;
@@ -12,11 +13,15 @@ static char* device_path = NULL;
 static int has_joliet = 0;
 static iso9660_volume_descriptor_t joliet_volume_descriptor;
 
+// Dentry cache namespace; directory handles are (extent << 32) | size
+static uint32_t dcache_ns = 0;
+
 // Forward declarations for internal functions
 static int read_raw_sector(uint32_t sector, void* buffer);
 static int find_file_in_dir(const char* name, uint32_t dir_sector, uint32_t dir_size, 
                            iso9660_directory_record_t** record, void** sector_buffer);
 static int parse_path(const char* path, iso9660_directory_record_t** record, void** buffer);
+static int iso9660_dir_lookup(void* context, uint64_t parent, const char* name, uint64_t* child);
 static int iso9660_name_compare(const char* name, const char* iso_name, int iso_name_len);
 static void convert_date(const uint8_t* iso_date, char* output);
 
@@ -75,6 +80,13 @@ int iso9660_init(const char* device) {
         return ISO9660_ERR_BAD_FORMAT;
     }
     
+    // Directories cached for a previous disc are meaningless now
+    if (dcache_ns == 0) {
+        dcache_ns = vfs_dcache_namespace();
+    } else {
+        vfs_dcache_invalidate_namespace(dcache_ns);
+    }
+    
     return ISO9660_SUCCESS;
 }
 
@@ -566,46 +578,64 @@ static int parse_path(const char* path, iso9660_directory_record_t** record, voi
         return 0;
     }
     
-    // Parse the path components
-    char component[256];
-    const char* path_ptr = path;
+    // Split off the final component, ignoring trailing slashes
+    char parent[256];
+    size_t len = strlen(path);
+    if (len >= sizeof(parent)) {
+        return ISO9660_ERR_INVALID_ARG;
+    }
+    memcpy(parent, path, len + 1);
+    while (len > 0 && parent[len - 1] == '/') {
+        parent[--len] = 0;
+    }
     
-    while (*path_ptr) {
-        // Extract next component
-        int i = 0;
-        while (*path_ptr && *path_ptr != '/' && i < 255) {
-            component[i++] = *path_ptr++;
-        }
-        component[i] = 0;
-        
-        // Skip slash
-        if (*path_ptr == '/') {
-            path_ptr++;
-        }
-        
-        // Find this component in the current directory
-        int result = find_file_in_dir(component, current_dir_sector, current_dir_size, record, buffer);
-        if (result != 0) {
-            return result;
-        }
-        
-        // If we have more path components, ensure this is a directory
-        if (*path_ptr && !((*record)->file_flags & ISO9660_ATTR_DIRECTORY)) {
-            free(*buffer);
+    char* name = strrchr(parent, '/');
+    if (name) {
+        *name++ = 0;
+    } else {
+        name = parent;
+    }
+    
+    // Resolve the parent directories through the dentry cache
+    if (name != parent) {
+        uint64_t handle;
+        uint64_t root = ((uint64_t)root_directory_extent << 32) | root_directory_size;
+        int result = vfs_dcache_resolve(dcache_ns, root, parent, iso9660_dir_lookup, NULL, &handle);
+        if (result == VFS_ERR_IO_ERROR) {
+            return ISO9660_ERR_IO_ERROR;
+        } else if (result != VFS_SUCCESS) {
             return ISO9660_ERR_NOT_FOUND;
         }
         
-        // If this isn't the last component, update current directory
-        if (*path_ptr) {
-            current_dir_sector = (*record)->extent_location[0];
-            current_dir_size = (*record)->data_length[0];
-            free(*buffer);
-            *buffer = NULL;
-        }
+        current_dir_sector = (uint32_t)(handle >> 32);
+        current_dir_size = (uint32_t)handle;
+    }
+    
+    // The final component is read from its directory, since callers need the record
+    return find_file_in_dir(name, current_dir_sector, current_dir_size, record, buffer);
+}
+
+// Find a subdirectory (dentry cache lookup callback)
+static int iso9660_dir_lookup(void* context, uint64_t parent, const char* name, uint64_t* child) {
+    iso9660_directory_record_t* record;
+    void* buffer;
+    
+    int result = find_file_in_dir(name, (uint32_t)(parent >> 32), (uint32_t)parent, &record, &buffer);
+    if (result == ISO9660_ERR_NOT_FOUND) {
+        return VFS_ERR_NOT_FOUND;
+    } else if (result != 0) {
+        return VFS_ERR_IO_ERROR;
+    }
+    
+    // Only directories are looked up this way
+    if (!(record->file_flags & ISO9660_ATTR_DIRECTORY)) {
+        free(buffer);
+        return VFS_ERR_NOT_DIR;
     }
     
-    // Found the requested file/directory
-    return 0;
+    *child = ((uint64_t)record->extent_location[0] << 32) | record->data_length[0];
+    free(buffer);
+    return VFS_SUCCESS;
 }
 
 // Compare a normal filename with an ISO9660 filename
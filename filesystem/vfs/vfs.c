@@ -1,5 +1,6 @@
 #include "vfs.h"
 #include "../../kernel/logging/log.h"
+#include "../../kernel/sync.h"
 #include <string.h>
 
 /* Global VFS state */
@@ -8,8 +9,20 @@ static vfs_mount_t* mount_points = NULL;
 static int vfs_initialized = 0;
 
 // Mutex locks for thread synchronization - needed in a real OS
-static mutex_t vfs_lock;             // Global VFS lock for operations on mount points
+static rwlock_t vfs_lock;            // Mount list: shared by path lookups, exclusive for mount/unmount
 static mutex_t fs_registry_lock;     // Lock for filesystem type registry operations
+static lock_class_t vfs_lock_class;
+
+/* Registered block devices. Slots are only ever filled, never cleared (a
+ * block device is never unregistered), so lookups on the I/O path read the
+ * table without taking a lock and the devices they return stay valid. */
+static vfs_block_device_t* block_devices[VFS_MAX_BLOCK_DEVICES] = {0};
+static spinlock_t block_devices_lock;
+
+/* Lockless read of a table slot, see vfs_register_block_device() */
+static inline vfs_block_device_t* block_device_slot(int slot) {
+    return *(vfs_block_device_t* volatile*)&block_devices[slot];
+}
 
 /* String utility functions */
 static void vfs_copy_path(char* dest, const char* src, size_t max_len) {
@@ -109,6 +122,7 @@ static int vfs_path_is_prefix(const char* prefix, const char* path) {
     return 1;
 }
 
+/* Find the mount point for a path (vfs_lock held, shared or exclusive) */
 static vfs_mount_t* vfs_find_mount_point(const char* path) {
     char normalized_path[VFS_MAX_PATH];
     vfs_normalize_path(path, normalized_path, VFS_MAX_PATH);
@@ -156,6 +170,32 @@ static void vfs_extract_relative_path(const char* full_path, const char* mount_p
     vfs_copy_path(relative_path + 1, rel_start, max_len - 1);
 }
 
+/* Drop the dentry cache entries for the last component of a path */
+static void vfs_dcache_drop(vfs_mount_t* mount, const char* path) {
+    if (!mount->dcache_ns) {
+        return;
+    }
+    
+    /* Find the last component, ignoring trailing slashes */
+    size_t end = strlen(path);
+    while (end > 0 && path[end - 1] == '/') {
+        end--;
+    }
+    size_t start = end;
+    while (start > 0 && path[start - 1] != '/') {
+        start--;
+    }
+    
+    char name[VFS_MAX_FILENAME];
+    if (end == start || end - start >= VFS_MAX_FILENAME) {
+        return;
+    }
+    memcpy(name, path + start, end - start);
+    name[end - start] = '\0';
+    
+    vfs_dcache_invalidate_name(mount->dcache_ns, name);
+}
+
 /* Initialize the VFS */
 int vfs_init(void) {
     if (vfs_initialized) {
@@ -164,8 +204,11 @@ int vfs_init(void) {
     }
     
     /* Initialize the mutexes */
-    mutex_init(&vfs_lock);
+    rwlock_init(&vfs_lock);
     mutex_init(&fs_registry_lock);
+    lock_class_init(&vfs_lock_class, "vfs");
+    rwlock_set_class(&vfs_lock, &vfs_lock_class);
+    spinlock_init(&block_devices_lock);
     
     /* Clear the filesystem registry */
     for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
@@ -175,12 +218,106 @@ int vfs_init(void) {
     /* Initialize mount point list */
     mount_points = NULL;
     
+    /* Shared block cache for filesystems that read through block devices */
+    if (vfs_cache_init(4096, VFS_MAX_CACHE_BLOCKS, VFS_CACHE_READ | VFS_CACHE_METADATA) != VFS_SUCCESS) {
+        log_warning("VFS", "Block cache unavailable, block devices will be read uncached");
+    } else {
+        /* Dirty blocks are written back in the background (threads are up by now) */
+        vfs_cache_start_flusher();
+    }
+    
+    vfs_journal_init();
+    
     vfs_initialized = 1;
     log_info("VFS", "Virtual File System initialized");
     
     return VFS_SUCCESS;
 }
 
+/* Register a block device */
+int vfs_register_block_device(vfs_block_device_t* device) {
+    if (!device || !device->name[0] || !device->operations || device->block_size == 0) {
+        return VFS_ERR_INVALID_ARG;
+    }
+    
+    spinlock_acquire(&block_devices_lock);
+    
+    int slot = -1;
+    for (int i = 0; i < VFS_MAX_BLOCK_DEVICES; i++) {
+        if (!block_devices[i]) {
+            if (slot < 0) {
+                slot = i;
+            }
+        } else if (vfs_strcmp(block_devices[i]->name, device->name) == 0) {
+            spinlock_release(&block_devices_lock);
+            return VFS_ERR_EXISTS;
+        }
+    }
+    
+    if (slot < 0) {
+        spinlock_release(&block_devices_lock);
+        return VFS_ERR_NO_SPACE;
+    }
+    
+    /* Identifiers start at 1 so a zeroed structure never matches */
+    device->id = slot + 1;
+    
+    /* Lookups may see the slot as soon as it is stored, so the device has to be complete first */
+    __sync_synchronize();
+    block_devices[slot] = device;
+    
+    spinlock_release(&block_devices_lock);
+    
+    log_info("VFS", "Registered block device %s (%u blocks of %u bytes)",
+             device->name, (uint32_t)device->block_count, device->block_size);
+    return VFS_SUCCESS;
+}
+
+/* Find a block device by name */
+vfs_block_device_t* vfs_get_block_device(const char* name) {
+    if (!name) {
+        return NULL;
+    }
+    
+    for (int i = 0; i < VFS_MAX_BLOCK_DEVICES; i++) {
+        vfs_block_device_t* device = block_device_slot(i);
+        if (device && vfs_strcmp(device->name, name) == 0) {
+            return device;
+        }
+    }
+    
+    return NULL;
+}
+
+/* Find a block device by identifier */
+vfs_block_device_t* vfs_get_block_device_by_id(uint32_t id) {
+    if (id == 0 || id > VFS_MAX_BLOCK_DEVICES) {
+        return NULL;
+    }
+    
+    return block_device_slot(id - 1);
+}
+
+/* Find a mount by its exact mount point */
+vfs_mount_t* vfs_get_mount(const char* mount_point) {
+    char normalized_mount[VFS_MAX_PATH];
+    
+    if (!vfs_initialized || !mount_point) {
+        return NULL;
+    }
+    
+    vfs_normalize_path(mount_point, normalized_mount, VFS_MAX_PATH);
+    
+    rwlock_read_lock(&vfs_lock);
+    vfs_mount_t* mount = mount_points;
+    while (mount && vfs_strcmp(mount->mount_point, normalized_mount) != 0) {
+        mount = mount->next;
+    }
+    rwlock_read_unlock(&vfs_lock);
+    
+    return mount;
+}
+
 /* Register a filesystem type */
 int vfs_register_fs(vfs_filesystem_t* fs_type) {
     int result;
@@ -258,13 +395,13 @@ int vfs_mount(const char* fs_name, const char* device, const char* mount_point,
     vfs_normalize_path(mount_point, normalized_mount, VFS_MAX_PATH);
     
     // Lock the VFS mount points list for writing
-    mutex_lock(&vfs_lock);
+    rwlock_write_lock(&vfs_lock);
     
     /* Check if mount point already exists */
     for (vfs_mount_t* mount = mount_points; mount; mount = mount->next) {
         if (vfs_strcmp(mount->mount_point, normalized_mount) == 0) {
             log_error("VFS", "Mount point already exists: %s", normalized_mount);
-            mutex_unlock(&vfs_lock);
+            rwlock_write_unlock(&vfs_lock);
             return VFS_ERR_EXISTS;
         }
     }
@@ -273,7 +410,7 @@ int vfs_mount(const char* fs_name, const char* device, const char* mount_point,
     vfs_mount_t* new_mount = (vfs_mount_t*)malloc(sizeof(vfs_mount_t));
     if (!new_mount) {
         log_error("VFS", "Failed to allocate memory for mount point");
-        mutex_unlock(&vfs_lock);
+        rwlock_write_unlock(&vfs_lock);
         return VFS_ERR_NO_SPACE;
     }
     
@@ -286,13 +423,14 @@ int vfs_mount(const char* fs_name, const char* device, const char* mount_point,
     new_mount->fs_type = fs_type;
     new_mount->fs_data = NULL;
     new_mount->flags = flags;
+    new_mount->dcache_ns = 0;
     new_mount->next = NULL;
     
     // Initialize mount-specific mutex
     mutex_init(&new_mount->lock);
     
     // Unlock before calling fs-specific handler which might take time
-    mutex_unlock(&vfs_lock);
+    rwlock_write_unlock(&vfs_lock);
     
     /* Call filesystem-specific mount handler */
     if (fs_type->mount) {
@@ -305,7 +443,7 @@ int vfs_mount(const char* fs_name, const char* device, const char* mount_point,
     }
     
     // Lock again to update the mount points list
-    mutex_lock(&vfs_lock);
+    rwlock_write_lock(&vfs_lock);
     
     /* Add to mount list */
     if (!mount_points) {
@@ -319,7 +457,7 @@ int vfs_mount(const char* fs_name, const char* device, const char* mount_point,
         mount->next = new_mount;
     }
     
-    mutex_unlock(&vfs_lock);
+    rwlock_write_unlock(&vfs_lock);
     
     log_info("VFS", "Mounted %s on %s (type: %s)", device ? device : "none", normalized_mount, fs_name);
     
@@ -342,7 +480,7 @@ int vfs_unmount(const char* mount_point) {
     vfs_normalize_path(mount_point, normalized_mount, VFS_MAX_PATH);
     
     // Lock the VFS mount points list for writing
-    mutex_lock(&vfs_lock);
+    rwlock_write_lock(&vfs_lock);
     
     /* Find the mount point */
     vfs_mount_t* prev = NULL;
@@ -358,7 +496,7 @@ int vfs_unmount(const char* mount_point) {
     
     if (!mount) {
         log_error("VFS", "Mount point not found: %s", normalized_mount);
-        mutex_unlock(&vfs_lock);
+        rwlock_write_unlock(&vfs_lock);
         return VFS_ERR_NOT_FOUND;
     }
     
@@ -367,7 +505,7 @@ int vfs_unmount(const char* mount_point) {
         int result = mount->fs_type->unmount(mount);
         if (result != VFS_SUCCESS) {
             log_error("VFS", "Filesystem-specific unmount failed for %s: %d", normalized_mount, result);
-            mutex_unlock(&vfs_lock);
+            rwlock_write_unlock(&vfs_lock);
             return result;
         }
     }
@@ -384,7 +522,7 @@ int vfs_unmount(const char* mount_point) {
     /* Free mount structure */
     free(mount);
     
-    mutex_unlock(&vfs_lock);
+    rwlock_write_unlock(&vfs_lock);
     
     return VFS_SUCCESS;
 }
@@ -399,14 +537,14 @@ int vfs_open(const char* path, int flags, vfs_file_t** file) {
         return VFS_ERR_INVALID_ARG;
     }
 
-    // Lock VFS while searching for mount point
-    mutex_lock(&vfs_lock);
+    // Hold the mount list shared so the mount cannot go away while the file is opened
+    rwlock_read_lock(&vfs_lock);
     
     /* Find the mount point for this path */
     vfs_mount_t* mount = vfs_find_mount_point(path);
     if (!mount) {
         log_error("VFS", "No mount point for path: %s", path);
-        mutex_unlock(&vfs_lock);
+        rwlock_read_unlock(&vfs_lock);
         return VFS_ERR_NOT_FOUND;
     }
     
@@ -417,14 +555,12 @@ int vfs_open(const char* path, int flags, vfs_file_t** file) {
     // We have the mount point, now lock that specific filesystem
     mutex_lock(&mount->lock);
     
-    // VFS global lock can be released now that we have the mount-specific lock
-    mutex_unlock(&vfs_lock);
-    
     /* Allocate a file handle */
     vfs_file_t* new_file = (vfs_file_t*)malloc(sizeof(vfs_file_t));
     if (!new_file) {
         log_error("VFS", "Failed to allocate memory for file handle");
         mutex_unlock(&mount->lock);
+        rwlock_read_unlock(&vfs_lock);
         return VFS_ERR_NO_SPACE;
     }
     
@@ -445,12 +581,19 @@ int vfs_open(const char* path, int flags, vfs_file_t** file) {
             log_error("VFS", "Filesystem-specific open failed for %s: %d", path, result);
             free(new_file);
             mutex_unlock(&mount->lock);
+            rwlock_read_unlock(&vfs_lock);
             return result;
         }
     }
     
+    /* A created file replaces any negative dentry for its name */
+    if (flags & VFS_OPEN_CREATE) {
+        vfs_dcache_drop(mount, relative_path);
+    }
+    
     // Release the mount lock now that the file is open
     mutex_unlock(&mount->lock);
+    rwlock_read_unlock(&vfs_lock);
     
     /* Return the file handle */
     *file = new_file;
@@ -642,9 +785,11 @@ int vfs_stat(const char* path, vfs_stat_t* stat) {
         return VFS_ERR_INVALID_ARG;
     }
     
-    /* Find the mount point for this path */
+    /* Find the mount point for this path (kept mounted while the list is held) */
+    rwlock_read_lock(&vfs_lock);
     vfs_mount_t* mount = vfs_find_mount_point(path);
     if (!mount) {
+        rwlock_read_unlock(&vfs_lock);
         return VFS_ERR_NOT_FOUND;
     }
     
@@ -653,11 +798,13 @@ int vfs_stat(const char* path, vfs_stat_t* stat) {
     vfs_extract_relative_path(path, mount->mount_point, relative_path, VFS_MAX_PATH);
     
     /* Call filesystem-specific stat handler */
+    int result = VFS_ERR_UNSUPPORTED;
     if (mount->fs_type && mount->fs_type->stat) {
-        return mount->fs_type->stat(mount, relative_path, stat);
+        result = mount->fs_type->stat(mount, relative_path, stat);
     }
     
-    return VFS_ERR_UNSUPPORTED;
+    rwlock_read_unlock(&vfs_lock);
+    return result;
 }
 
 /* Open a directory */
@@ -670,9 +817,11 @@ int vfs_opendir(const char* path, vfs_file_t** dir) {
         return VFS_ERR_INVALID_ARG;
     }
     
-    /* Find the mount point for this path */
+    /* Find the mount point for this path (kept mounted while the list is held) */
+    rwlock_read_lock(&vfs_lock);
     vfs_mount_t* mount = vfs_find_mount_point(path);
     if (!mount) {
+        rwlock_read_unlock(&vfs_lock);
         return VFS_ERR_NOT_FOUND;
     }
     
@@ -683,6 +832,7 @@ int vfs_opendir(const char* path, vfs_file_t** dir) {
     /* Allocate a file handle for the directory */
     vfs_file_t* new_dir = (vfs_file_t*)malloc(sizeof(vfs_file_t));
     if (!new_dir) {
+        rwlock_read_unlock(&vfs_lock);
         return VFS_ERR_NO_SPACE;
     }
     
@@ -698,13 +848,17 @@ int vfs_opendir(const char* path, vfs_file_t** dir) {
         int result = mount->fs_type->opendir(mount, relative_path, &new_dir);
         if (result != VFS_SUCCESS) {
             free(new_dir);
+            rwlock_read_unlock(&vfs_lock);
             return result;
         }
     } else {
         free(new_dir);
+        rwlock_read_unlock(&vfs_lock);
         return VFS_ERR_UNSUPPORTED;
     }
     
+    rwlock_read_unlock(&vfs_lock);
+    
     /* Return the directory handle */
     *dir = new_dir;
     
@@ -763,9 +917,11 @@ int vfs_mkdir(const char* path) {
         return VFS_ERR_INVALID_ARG;
     }
     
-    /* Find the mount point for this path */
+    /* Find the mount point for this path (kept mounted while the list is held) */
+    rwlock_read_lock(&vfs_lock);
     vfs_mount_t* mount = vfs_find_mount_point(path);
     if (!mount) {
+        rwlock_read_unlock(&vfs_lock);
         return VFS_ERR_NOT_FOUND;
     }
     
@@ -774,11 +930,14 @@ int vfs_mkdir(const char* path) {
     vfs_extract_relative_path(path, mount->mount_point, relative_path, VFS_MAX_PATH);
     
     /* Call filesystem-specific mkdir handler */
+    int result = VFS_ERR_UNSUPPORTED;
     if (mount->fs_type && mount->fs_type->mkdir) {
-        return mount->fs_type->mkdir(mount, relative_path);
+        result = mount->fs_type->mkdir(mount, relative_path);
     }
+    vfs_dcache_drop(mount, relative_path);
     
-    return VFS_ERR_UNSUPPORTED;
+    rwlock_read_unlock(&vfs_lock);
+    return result;
 }
 
 /* Remove a directory */
@@ -791,9 +950,11 @@ int vfs_rmdir(const char* path) {
         return VFS_ERR_INVALID_ARG;
     }
     
-    /* Find the mount point for this path */
+    /* Find the mount point for this path (kept mounted while the list is held) */
+    rwlock_read_lock(&vfs_lock);
     vfs_mount_t* mount = vfs_find_mount_point(path);
     if (!mount) {
+        rwlock_read_unlock(&vfs_lock);
         return VFS_ERR_NOT_FOUND;
     }
     
@@ -802,11 +963,17 @@ int vfs_rmdir(const char* path) {
     vfs_extract_relative_path(path, mount->mount_point, relative_path, VFS_MAX_PATH);
     
     /* Call filesystem-specific rmdir handler */
+    int result = VFS_ERR_UNSUPPORTED;
     if (mount->fs_type && mount->fs_type->rmdir) {
-        return mount->fs_type->rmdir(mount, relative_path);
+        result = mount->fs_type->rmdir(mount, relative_path);
     }
     
-    return VFS_ERR_UNSUPPORTED;
+    /* Entries below the directory are keyed by its handle, which the
+     * filesystem may now reuse, so drop the whole namespace */
+    vfs_dcache_invalidate_namespace(mount->dcache_ns);
+    
+    rwlock_read_unlock(&vfs_lock);
+    return result;
 }
 
 /* Delete a file */
@@ -819,9 +986,11 @@ int vfs_unlink(const char* path) {
         return VFS_ERR_INVALID_ARG;
     }
     
-    /* Find the mount point for this path */
+    /* Find the mount point for this path (kept mounted while the list is held) */
+    rwlock_read_lock(&vfs_lock);
     vfs_mount_t* mount = vfs_find_mount_point(path);
     if (!mount) {
+        rwlock_read_unlock(&vfs_lock);
         return VFS_ERR_NOT_FOUND;
     }
     
@@ -830,11 +999,14 @@ int vfs_unlink(const char* path) {
     vfs_extract_relative_path(path, mount->mount_point, relative_path, VFS_MAX_PATH);
     
     /* Call filesystem-specific unlink handler */
+    int result = VFS_ERR_UNSUPPORTED;
     if (mount->fs_type && mount->fs_type->unlink) {
-        return mount->fs_type->unlink(mount, relative_path);
+        result = mount->fs_type->unlink(mount, relative_path);
     }
+    vfs_dcache_drop(mount, relative_path);
     
-    return VFS_ERR_UNSUPPORTED;
+    rwlock_read_unlock(&vfs_lock);
+    return result;
 }
 
 /* Rename a file */
@@ -847,20 +1019,18 @@ int vfs_rename(const char* oldpath, const char* newpath) {
         return VFS_ERR_INVALID_ARG;
     }
     
-    /* Find the mount point for the old path */
+    /* Find the mount points for both paths under one hold of the mount list */
+    rwlock_read_lock(&vfs_lock);
     vfs_mount_t* old_mount = vfs_find_mount_point(oldpath);
-    if (!old_mount) {
-        return VFS_ERR_NOT_FOUND;
-    }
-    
-    /* Find the mount point for the new path */
     vfs_mount_t* new_mount = vfs_find_mount_point(newpath);
-    if (!new_mount) {
+    if (!old_mount || !new_mount) {
+        rwlock_read_unlock(&vfs_lock);
         return VFS_ERR_NOT_FOUND;
     }
     
     /* Check if both paths are on the same filesystem */
     if (old_mount != new_mount) {
+        rwlock_read_unlock(&vfs_lock);
         return VFS_ERR_INVALID_ARG;
     }
     
@@ -871,11 +1041,18 @@ int vfs_rename(const char* oldpath, const char* newpath) {
     vfs_extract_relative_path(newpath, new_mount->mount_point, new_relative, VFS_MAX_PATH);
     
     /* Call filesystem-specific rename handler */
+    int result = VFS_ERR_UNSUPPORTED;
     if (old_mount->fs_type && old_mount->fs_type->rename) {
-        return old_mount->fs_type->rename(old_mount, old_relative, new_relative);
+        result = old_mount->fs_type->rename(old_mount, old_relative, new_relative);
     }
     
-    return VFS_ERR_UNSUPPORTED;
+    /* Both names changed; a moved directory also has a new ".." */
+    vfs_dcache_drop(old_mount, old_relative);
+    vfs_dcache_drop(old_mount, new_relative);
+    vfs_dcache_invalidate_name(old_mount->dcache_ns, "..");
+    
+    rwlock_read_unlock(&vfs_lock);
+    return result;
 }
 
 /* Get filesystem statistics */
@@ -888,16 +1065,20 @@ int vfs_statfs(const char* path, uint64_t* total, uint64_t* free) {
         return VFS_ERR_INVALID_ARG;
     }
     
-    /* Find the mount point for this path */
+    /* Find the mount point for this path (kept mounted while the list is held) */
+    rwlock_read_lock(&vfs_lock);
     vfs_mount_t* mount = vfs_find_mount_point(path);
     if (!mount) {
+        rwlock_read_unlock(&vfs_lock);
         return VFS_ERR_NOT_FOUND;
     }
     
     /* Call filesystem-specific statfs handler */
+    int result = VFS_ERR_UNSUPPORTED;
     if (mount->fs_type && mount->fs_type->statfs) {
-        return mount->fs_type->statfs(mount, total, free);
+        result = mount->fs_type->statfs(mount, total, free);
     }
     
-    return VFS_ERR_UNSUPPORTED;
+    rwlock_read_unlock(&vfs_lock);
+    return result;
 }
\ No newline at end of file
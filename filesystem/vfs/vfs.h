@@ -2,6 +2,9 @@
 #define VFS_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include "../../kernel/sync.h"
+#include "../../kernel/ktimer.h"
 
 /* VFS Error Codes */
 #define VFS_SUCCESS             0
@@ -21,6 +24,7 @@
 #define VFS_ERR_LOCKED         -14
 #define VFS_ERR_TIMEOUT        -15
 #define VFS_ERR_UNKNOWN        -16
+#define VFS_ERR_INVALID_DEV    -17
 
 /* File Types */
 #define VFS_TYPE_FILE          1
@@ -88,6 +92,9 @@
 #define VFS_MAX_MOUNTS         16
 #define VFS_MAX_CACHE_BLOCKS   256
 #define VFS_MAX_OPEN_FILES     64
+#define VFS_MAX_BLOCK_DEVICES  16
+#define VFS_MAX_DEVICE_NAME    32
+#define VFS_DCACHE_NAME_MAX    48   /* Longer names bypass the dentry cache */
 
 /* Cache control flags */
 #define VFS_CACHE_READ         0x01
@@ -102,6 +109,7 @@ typedef struct vfs_stat_s vfs_stat_t;
 typedef struct vfs_filesystem_s vfs_filesystem_t;
 typedef struct vfs_mount_s vfs_mount_t;
 typedef struct vfs_journal_s vfs_journal_t;
+typedef struct vfs_block_device_s vfs_block_device_t;
 typedef struct vfs_cache_s vfs_cache_t;
 typedef struct vfs_transaction_s vfs_transaction_t;
 
@@ -150,11 +158,44 @@ struct vfs_cache_block_s {
     uint8_t* data;           /* Block data */
     uint32_t size;           /* Block size */
     uint8_t dirty;           /* Whether block has been modified */
+    uint8_t valid;           /* Whether the block holds (dev_id, block_id) */
+    uint8_t readahead;       /* Loaded by read-ahead and not read since */
     uint32_t access_count;   /* Number of times accessed (for LRU) */
     uint32_t last_access;    /* Last access time */
-    struct vfs_cache_block_s* next; /* Next in hash chain */
+    uint32_t dirty_since;    /* Time the block was first dirtied, in ms */
+    uint32_t write_seq;      /* Bumped by every write, to spot rewrites during write-back */
+    struct vfs_cache_block_s* hash_next;   /* Next in hash chain */
+    struct vfs_cache_block_s** hash_pprev; /* Link pointing at this block in its chain */
+    struct vfs_cache_block_s* lru_prev;    /* More recently used (or previous free block) */
+    struct vfs_cache_block_s* lru_next;    /* Less recently used (or next free block) */
 };
 
+/**
+ * VFS Cache Statistics (latencies in nanoseconds)
+ */
+typedef struct {
+    uint32_t lookups;        /* Block reads and writes served */
+    uint32_t hits;           /* Lookups found in the cache */
+    uint32_t misses;         /* Lookups that had to load a block */
+    uint32_t evictions;      /* Blocks reclaimed from the LRU tail */
+    uint32_t writebacks;     /* Dirty blocks written to disk */
+    uint32_t flush_requests; /* Device writes issued by batched flushes */
+    uint32_t evict_stalls;   /* Evictions that found every block dirty */
+    uint32_t throttles;      /* Writers held back at the dirty limit */
+    uint32_t dirty_blocks;   /* Blocks currently dirty */
+    uint32_t hash_buckets;   /* Current hash table size */
+    uint32_t ra_requests;    /* Device reads that carried read-ahead blocks */
+    uint32_t ra_blocks;      /* Blocks loaded by read-ahead */
+    uint32_t ra_hits;        /* Read-ahead blocks later read */
+    uint32_t ra_wasted;      /* Read-ahead blocks dropped without being read */
+    uint64_t hit_ns_total;   /* Time spent serving hits */
+    uint64_t hit_ns_max;
+    uint64_t miss_ns_total;  /* Time spent serving misses (including device I/O) */
+    uint64_t miss_ns_max;
+    uint64_t evict_ns_total; /* Time spent evicting (including write-back) */
+    uint64_t evict_ns_max;
+} vfs_cache_stats_t;
+
 /**
  * VFS Cache Structure 
  */
@@ -168,6 +209,29 @@ struct vfs_cache_s {
     uint8_t flags;           /* Cache flags */
 };
 
+/**
+ * Dentry cache lookup callback: find a name in a directory
+ * 
+ * Handles are filesystem-defined (inode, cluster, extent...) and opaque to
+ * the cache. Returns 0 with *child set, VFS_ERR_NOT_FOUND (cached as a
+ * negative entry) or another negative error code (not cached).
+ */
+typedef int (*vfs_dcache_lookup_t)(void* context, uint64_t parent, const char* name, uint64_t* child);
+
+/**
+ * VFS Dentry Cache Statistics
+ */
+typedef struct {
+    uint32_t lookups;        /* Path components looked up in the cache */
+    uint32_t hits;           /* Components found */
+    uint32_t negative_hits;  /* Components known not to exist */
+    uint32_t misses;         /* Components passed to the filesystem */
+    uint32_t evictions;      /* Entries reclaimed from the LRU tail */
+    uint32_t invalidations;  /* Entries dropped by create/remove/rename */
+    uint32_t in_use;         /* Entries currently cached */
+    uint32_t capacity;       /* Size of the entry pool */
+} vfs_dcache_stats_t;
+
 /**
  * VFS Journal Entry Types
  */
@@ -175,8 +239,8 @@ enum vfs_journal_entry_type {
     VFS_JOURNAL_START_TX = 1,    /* Start of transaction */
     VFS_JOURNAL_COMMIT_TX,       /* Commit transaction */
     VFS_JOURNAL_ABORT_TX,        /* Abort transaction */
-    VFS_JOURNAL_METADATA,        /* Metadata update */
-    VFS_JOURNAL_DATA,            /* Data block */
+    VFS_JOURNAL_ENTRY_METADATA,  /* Metadata update */
+    VFS_JOURNAL_ENTRY_DATA,      /* Data block */
     VFS_JOURNAL_CHECKPOINT       /* Checkpoint marker */
 };
 
@@ -192,8 +256,25 @@ struct vfs_journal_entry_header {
     uint32_t checksum;           /* Entry checksum */
 };
 
+/**
+ * VFS Journal Statistics
+ */
+typedef struct {
+    uint32_t handles;            /* Operations that joined a transaction */
+    uint32_t commits;            /* Transactions written to the log */
+    uint32_t log_writes;         /* Device writes issued for commits */
+    uint32_t log_blocks;         /* Blocks written to the log */
+    uint32_t checkpoints;        /* Checkpoint batches */
+    uint32_t checkpoint_blocks;  /* Blocks written home by checkpoints */
+    uint32_t replayed_tx;        /* Transactions recovered at mount */
+    uint32_t replayed_blocks;    /* Blocks written home by recovery */
+} vfs_journal_stats_t;
+
 /**
  * VFS Journal Structure
+ * 
+ * The last block of the journal area holds the journal header, the blocks
+ * before it form a circular log of committed transactions from tail to head.
  */
 struct vfs_journal_s {
     uint32_t dev_id;             /* Device ID for this journal */
@@ -204,11 +285,31 @@ struct vfs_journal_s {
     uint32_t flags;              /* Journal flags */
     uint32_t current_tx;         /* Current transaction ID */
     uint8_t enabled;             /* Whether journaling is enabled */
-    struct vfs_transaction_s* active_tx; /* Currently active transaction */
+    struct vfs_transaction_s* active_tx; /* Running transaction operations join */
+    uint32_t log_blocks;         /* Blocks in the circular log */
+    uint32_t head;               /* Log block the next commit is written to */
+    uint32_t tail;               /* Oldest log block not yet checkpointed */
+    uint32_t sequence;           /* Sequence number of the next commit */
+    uint32_t tail_sequence;      /* Sequence number of the commit at the tail */
+    struct vfs_transaction_s* commit_list; /* Finished, waiting to be written to the log (oldest first) */
+    struct vfs_transaction_s* commit_last;
+    struct vfs_transaction_s* checkpoint_list; /* Committed, not yet checkpointed (oldest first) */
+    struct vfs_transaction_s* checkpoint_last;
+    spinlock_t lock;             /* Protects the running transaction and the transaction lists */
+    mutex_t commit_lock;         /* Serializes log writes, checkpoints and header writes */
+    ktimer_t age_timer;          /* Fires when the running transaction reaches its age limit */
+    struct vfs_mount_s* mount;   /* Mount the journal belongs to */
+    struct vfs_journal_s* next;  /* Next journal on the commit thread's list */
+    uint32_t pins;               /* Held by the commit thread while it commits (journal list lock) */
+    vfs_journal_stats_t stats;
 };
 
 /**
  * VFS Transaction Structure
+ * 
+ * A compound transaction: every operation started while it runs joins it,
+ * and it commits once the last of them finishes and a size or age limit is
+ * reached.
  */
 struct vfs_transaction_s {
     uint32_t id;                 /* Transaction ID */
@@ -216,6 +317,15 @@ struct vfs_transaction_s {
     uint32_t num_operations;     /* Number of operations in this transaction */
     void* operations;            /* List of operations in this transaction */
     struct vfs_transaction_s* next; /* Next transaction in queue */
+    uint32_t users;              /* Operations still running in the transaction */
+    uint32_t handles;            /* Operations that joined the transaction */
+    uint64_t start_ms;           /* Time the transaction started */
+    uint32_t num_blocks;         /* Blocks logged */
+    uint32_t max_blocks;         /* Capacity of block_ids and block_data */
+    uint32_t* block_ids;         /* Home block of each logged block */
+    uint8_t* block_data;         /* Latest image of each logged block */
+    uint32_t log_length;         /* Log blocks used once committed */
+    struct vfs_transaction_s* checkpoint_next; /* Next on the commit or checkpoint list */
 };
 
 /**
@@ -279,6 +389,28 @@ struct vfs_filesystem_s {
     int (*cache_invalidate)(vfs_mount_t* mount_point, uint32_t block);
 };
 
+/**
+ * Block device operations. Transfers are in device blocks and return the
+ * number of blocks transferred or a negative error code.
+ */
+typedef struct {
+    int (*read_blocks)(vfs_block_device_t* device, uint64_t block, uint32_t count, void* buffer);
+    int (*write_blocks)(vfs_block_device_t* device, uint64_t block, uint32_t count, const void* buffer);
+    int (*sync)(vfs_block_device_t* device);
+} vfs_block_device_ops_t;
+
+/**
+ * Block device that filesystems and the block cache read through
+ */
+struct vfs_block_device_s {
+    char name[VFS_MAX_DEVICE_NAME];        /* Name passed to mount (e.g. "fat12_disk") */
+    uint32_t id;                           /* Assigned on registration, used as cache key */
+    uint32_t block_size;                   /* Device block size in bytes */
+    uint64_t block_count;                  /* Number of device blocks */
+    vfs_block_device_ops_t* operations;    /* Driver operations */
+    void* private_data;                    /* Driver-specific data */
+};
+
 /**
  * VFS Mount point structure
  */
@@ -291,6 +423,8 @@ struct vfs_mount_s {
     vfs_journal_t* journal;                /* Journal if enabled */
     vfs_cache_t* cache;                    /* Cache if enabled */
     uint8_t readonly;                      /* Whether mounted read-only */
+    uint32_t dcache_ns;                    /* Dentry cache namespace (0 if unused) */
+    mutex_t lock;                          /* Serializes opens on this mount */
     struct vfs_mount_s* next;              /* Next mount point in chain */
 };
 
@@ -308,6 +442,7 @@ struct vfs_file_s {
     uint8_t cache_dirty;                   /* Whether cache needs to be flushed */
     uint32_t mode;                         /* File mode/permissions */
     uint32_t references;                   /* Reference counter */
+    mutex_t lock;                          /* Serializes reads and writes on this handle */
     struct vfs_file_s* next;               /* For open file tracking */
 };
 
@@ -588,6 +723,13 @@ int vfs_listxattr(const char* path, char* list, size_t size);
  */
 int vfs_removexattr(const char* path, const char* name);
 
+/**
+ * Initialize the journal subsystem
+ * 
+ * @return 0 on success, negative error code on failure
+ */
+int vfs_journal_init(void);
+
 /**
  * Begin a journal transaction
  * 
@@ -614,6 +756,55 @@ int vfs_journal_commit_tx(vfs_mount_t* mount, int tx_id);
  */
 int vfs_journal_abort_tx(vfs_mount_t* mount, int tx_id);
 
+/**
+ * Record the new contents of a filesystem block in a journal transaction
+ * 
+ * The block reaches its home location only after the transaction commits.
+ * Logging the same block again in the same transaction replaces the image.
+ * 
+ * @param mount Mount point
+ * @param tx_id Transaction ID returned by vfs_journal_begin_tx()
+ * @param block_id Block number in journal block size units
+ * @param data Block contents (one journal block)
+ * @return 0 on success, negative error code on failure
+ */
+int vfs_journal_log_block(vfs_mount_t* mount, int tx_id, uint32_t block_id, const void* data);
+
+/**
+ * Read a filesystem block, including changes still held by the journal
+ * 
+ * @param mount Mount point
+ * @param block_id Block number in journal block size units
+ * @param buffer Output buffer (one journal block)
+ * @return 0 on success, negative error code on failure
+ */
+int vfs_journal_read_block(vfs_mount_t* mount, uint32_t block_id, void* buffer);
+
+/**
+ * Commit the running transaction now if no operation is still in it
+ * 
+ * @param mount Mount point
+ * @return 0 on success, negative error code on failure
+ */
+int vfs_journal_sync(vfs_mount_t* mount);
+
+/**
+ * Get journal statistics
+ * 
+ * @param mount Mount point
+ * @param stats Output statistics
+ * @return 0 on success, negative error code on failure
+ */
+int vfs_journal_get_stats(vfs_mount_t* mount, vfs_journal_stats_t* stats);
+
+/**
+ * Crash a journal on a RAM disk at every device write of a workload and
+ * check that recovery leaves each transaction all-or-nothing
+ * 
+ * @return 0 if every crash point recovered, negative error code otherwise
+ */
+int vfs_journal_run_crash_test(void);
+
 /**
  * Create a new journal for a mounted filesystem
  * 
@@ -650,6 +841,51 @@ int vfs_journal_stop(const char* mount_point);
  */
 int vfs_cache_init(uint32_t block_size, uint32_t num_blocks, uint8_t flags);
 
+/**
+ * Read a block through the cache, loading it from the device on a miss
+ * 
+ * @param dev_id Block device identifier
+ * @param block_id Block number in cache-block units
+ * @param buffer Output buffer (at least vfs_cache_get_block_size() bytes)
+ * @return 0 on success, VFS_ERR_UNSUPPORTED if the cache is disabled, other negative error code on failure
+ */
+int vfs_cache_read_block(uint32_t dev_id, uint32_t block_id, void* buffer);
+
+/**
+ * Write a block through the cache
+ * 
+ * @param dev_id Block device identifier
+ * @param block_id Block number in cache-block units
+ * @param buffer Input buffer (at least vfs_cache_get_block_size() bytes)
+ * @param sync Whether to write the block to the device immediately
+ * @return 0 on success, negative error code on failure
+ */
+int vfs_cache_write_block(uint32_t dev_id, uint32_t block_id, const void* buffer, int sync);
+
+/**
+ * Drop a block from the cache, writing it back first if dirty
+ * 
+ * @param dev_id Block device identifier
+ * @param block_id Block number in cache-block units
+ * @return 0 on success, negative error code on failure
+ */
+int vfs_cache_invalidate_block(uint32_t dev_id, uint32_t block_id);
+
+/**
+ * Get the size of a cache block
+ * 
+ * @return Block size in bytes, or 0 if the cache is not enabled
+ */
+uint32_t vfs_cache_get_block_size(void);
+
+/**
+ * Start the background write-back thread (needs the threading system)
+ * 
+ * Without it, dirty blocks are written when a writer hits the dirty limit
+ * or on an explicit flush.
+ */
+void vfs_cache_start_flusher(void);
+
 /**
  * Enable or disable caching for a mount point
  * 
@@ -684,6 +920,60 @@ int vfs_cache_invalidate(const char* device);
  */
 int vfs_cache_get_stats(uint32_t* hits, uint32_t* misses);
 
+/**
+ * Get detailed cache statistics, including hit/miss/eviction latency and
+ * read-ahead effectiveness
+ * 
+ * @param stats Output statistics
+ * @return 0 on success, negative error code on failure
+ */
+int vfs_cache_get_detailed_stats(vfs_cache_stats_t* stats);
+
+/**
+ * Allocate a dentry cache namespace for a filesystem instance
+ * 
+ * @return Namespace identifier (never 0)
+ */
+uint32_t vfs_dcache_namespace(void);
+
+/**
+ * Resolve a path through the dentry cache, asking the filesystem only for
+ * components that are not cached
+ * 
+ * @param ns Namespace of the filesystem (0 bypasses the cache)
+ * @param root Handle of the directory the path is relative to
+ * @param path Path, components separated by '/'
+ * @param lookup Filesystem callback for cache misses
+ * @param context Passed to the callback
+ * @param handle Output handle of the final component
+ * @return 0 on success, VFS_ERR_NOT_FOUND if a component does not exist, other negative error code on failure
+ */
+int vfs_dcache_resolve(uint32_t ns, uint64_t root, const char* path,
+                       vfs_dcache_lookup_t lookup, void* context, uint64_t* handle);
+
+/**
+ * Drop every entry for a name in a namespace, whatever directory holds it
+ * 
+ * @param ns Namespace
+ * @param name Final path component that was created, removed or renamed
+ */
+void vfs_dcache_invalidate_name(uint32_t ns, const char* name);
+
+/**
+ * Drop every entry of a namespace
+ * 
+ * @param ns Namespace
+ */
+void vfs_dcache_invalidate_namespace(uint32_t ns);
+
+/**
+ * Get dentry cache statistics
+ * 
+ * @param stats Output statistics
+ * @return 0 on success, negative error code on failure
+ */
+int vfs_dcache_get_stats(vfs_dcache_stats_t* stats);
+
 /**
  * Repair filesystem on specified mount point
  * 
@@ -704,6 +994,42 @@ int vfs_fsck(const char* mount_point, uint32_t flags);
  */
 int vfs_format(const char* fs_name, const char* device, const char* label, uint32_t flags);
 
+/**
+ * Register a block device (devices stay registered until shutdown)
+ * 
+ * @param device Device to register, its id field is assigned here
+ * @return 0 on success, negative error code on failure
+ */
+int vfs_register_block_device(vfs_block_device_t* device);
+
+/**
+ * Find a block device by name
+ * 
+ * Block devices are never unregistered, so the result stays valid.
+ * 
+ * @param name Device name
+ * @return Block device, or NULL if not registered
+ */
+vfs_block_device_t* vfs_get_block_device(const char* name);
+
+/**
+ * Find a block device by identifier
+ * 
+ * Block devices are never unregistered, so the result stays valid.
+ * 
+ * @param id Device identifier
+ * @return Block device, or NULL if not registered
+ */
+vfs_block_device_t* vfs_get_block_device_by_id(uint32_t id);
+
+/**
+ * Find a mount by its mount point
+ * 
+ * @param mount_point Path the filesystem is mounted on
+ * @return Mount, or NULL if nothing is mounted there
+ */
+vfs_mount_t* vfs_get_mount(const char* mount_point);
+
 /**
  * Get error message for error code
  * 
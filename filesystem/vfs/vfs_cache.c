@@ -1,38 +1,124 @@
 #include "vfs.h"
 #include "../../kernel/logging/log.h"
+#include "../../kernel/sync.h"
+#include "../../kernel/thread.h"
+#include "../../kernel/ktimer.h"
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 
-#define CACHE_MAGIC      0xCAC4E000
-#define CACHE_HASH_SIZE  256
+#define CACHE_MAGIC              0xCAC4E000
+#define CACHE_HASH_MIN_BUCKETS   64     // Smallest hash table (power of two)
+#define CACHE_HASH_MAX_LOAD      2      // Grow the table past this many blocks per bucket
+#define CACHE_RA_STREAMS         8      // Sequential streams tracked at once
+#define CACHE_RA_MIN_BYTES       16384  // First read-ahead window of a stream
+#define CACHE_RA_MAX_BYTES       131072 // Largest read-ahead window
+#define CACHE_FLUSH_MAX_BYTES    131072 // Largest coalesced write-back request
+#define CACHE_FLUSH_INTERVAL_MS  500    // Flusher wake-up period
+#define CACHE_DIRTY_EXPIRE_MS    3000   // Dirty blocks older than this are written back
+#define CACHE_DIRTY_BACKGROUND   10     // Percent of the cache dirty before the flusher writes everything
+#define CACHE_DIRTY_LIMIT        40     // Percent of the cache dirty before writers are throttled
+#define CACHE_THROTTLE_MS        10     // Writer back-off while the flusher catches up
+#define CACHE_THROTTLE_TRIES     50     // Back-offs before a throttled writer gives up waiting
 
 typedef struct vfs_cache_block_s vfs_cache_block_t;
 
+extern uint64_t hal_time_now_ns(void);
+
 // Global cache
 static vfs_cache_t* global_cache = NULL;
 
-// Hash table for quick block lookup
-static vfs_cache_block_t* cache_hash_table[CACHE_HASH_SIZE];
+// Hash table for quick block lookup (power-of-two sized, chained through hash_next)
+static vfs_cache_block_t** cache_hash_table = NULL;
+static uint32_t cache_hash_bits = 0;
+static uint32_t cache_hashed_blocks = 0;
 
-// LRU list tracking
+// LRU list of valid blocks, most recently used at the head
 static vfs_cache_block_t* lru_head = NULL;
 static vfs_cache_block_t* lru_tail = NULL;
 
+// Blocks holding no data, linked through lru_next
+static vfs_cache_block_t* free_list = NULL;
+
 // Cache statistics
-static uint32_t cache_lookups = 0;
-static uint32_t cache_hits = 0;
-static uint32_t cache_misses = 0;
-static uint32_t cache_evictions = 0;
-static uint32_t cache_writebacks = 0;
+static vfs_cache_stats_t cache_stats;
+
+/*
+ * A sequential reader. The cache only sees (device, block), so streams are
+ * told apart by the block each one expects next: several files read in
+ * parallel from one device are tracked as separate streams.
+ */
+typedef struct {
+    uint32_t dev_id;
+    uint32_t next_block;     // Block that continues the stream
+    uint32_t ra_end;         // First block past the read-ahead issued so far
+    uint32_t window;         // Read-ahead window in blocks (0 until sequential)
+    uint32_t last_use;       // Tracking clock at last access (0 = slot unused)
+} cache_ra_stream_t;
+
+static cache_ra_stream_t ra_streams[CACHE_RA_STREAMS];
+static uint32_t ra_clock = 0;
+
+// Staging area for multi-block device reads, owned by one fill at a time
+static uint8_t ra_buffer[CACHE_RA_MAX_BYTES];
+static int ra_buffer_busy = 0;
+
+// Protects the cache; write-backs and fills drop it around their device I/O
+static spinlock_t cache_lock;
+
+// Serializes write-backs and owns flush_buffer, held across their device writes
+// (taken before cache_lock)
+static mutex_t flush_lock;
+
+// Blocks currently dirty
+static uint32_t cache_dirty_count = 0;
+
+// Background write-back thread
+static thread_id_t flusher_thread_id = -1;
+
+// A dirty block picked for a flush, with the identity it had when picked
+typedef struct {
+    vfs_cache_block_t* block;
+    uint32_t dev_id;
+    uint32_t block_id;
+    uint32_t write_seq;
+} cache_flush_entry_t;
+
+static cache_flush_entry_t flush_list[VFS_MAX_CACHE_BLOCKS];
+
+// Staging area for coalesced device writes
+static uint8_t flush_buffer[CACHE_FLUSH_MAX_BYTES];
 
 // Function prototypes
 static uint32_t cache_hash(uint32_t dev_id, uint32_t block_id);
+static int cache_hash_resize(uint32_t bits);
+static void cache_hash_insert(vfs_cache_block_t* block);
+static void cache_hash_remove(vfs_cache_block_t* block);
 static vfs_cache_block_t* cache_lookup(uint32_t dev_id, uint32_t block_id);
 static vfs_cache_block_t* cache_alloc_block(void);
+static void cache_free_block(vfs_cache_block_t* block);
 static void cache_mark_accessed(vfs_cache_block_t* block);
 static int cache_evict_block(void);
 static int cache_writeback_block(vfs_cache_block_t* block);
+static int cache_read_block(uint32_t dev_id, uint32_t block_id, void* buffer);
+static cache_ra_stream_t* cache_ra_track(uint32_t dev_id, uint32_t block_id);
+static uint32_t cache_ra_max_blocks(void);
+static void cache_set_dirty(vfs_cache_block_t* block);
+static void cache_set_clean(vfs_cache_block_t* block);
+static uint32_t cache_dirty_threshold(uint32_t percent);
+static int cache_flush_dirty(uint32_t min_age_ms);
+static void cache_throttle_writer(void);
+static int cache_fill_blocks(vfs_block_device_t* device, uint32_t dev_id, uint32_t block_id,
+                             uint32_t count, uint32_t demanded, vfs_cache_block_t** first);
+
+// Account one latency sample
+static inline void cache_record_latency(uint64_t start, uint64_t* total, uint64_t* max) {
+    uint64_t elapsed = hal_time_now_ns() - start;
+    *total += elapsed;
+    if (elapsed > *max) {
+        *max = elapsed;
+    }
+}
 
 /**
  * Initialize the VFS cache system
@@ -45,7 +131,7 @@ static int cache_writeback_block(vfs_cache_block_t* block);
 int vfs_cache_init(uint32_t block_size, uint32_t num_blocks, uint8_t flags) {
     // Don't re-initialize if already exists
     if (global_cache) {
-        log_warning("VFS: Cache already initialized");
+        log_warning("VFS", "Cache already initialized");
         return VFS_SUCCESS;
     }
     
@@ -64,16 +150,39 @@ int vfs_cache_init(uint32_t block_size, uint32_t num_blocks, uint8_t flags) {
         block_size = (block_size + 512) & ~511;
     }
     
+    // A block must fit the read-ahead and write-back staging buffers
+    if (block_size > CACHE_FLUSH_MAX_BYTES) {
+        block_size = CACHE_FLUSH_MAX_BYTES;
+    }
+    
     // Allocate the cache structure
     global_cache = (vfs_cache_t*)malloc(sizeof(vfs_cache_t));
     if (!global_cache) {
-        log_error("VFS: Failed to allocate cache structure");
+        log_error("VFS", "Failed to allocate cache structure");
         return VFS_ERR_NO_SPACE;
     }
     
     // Initialize the cache structure
     memset(global_cache, 0, sizeof(vfs_cache_t));
-    memset(cache_hash_table, 0, sizeof(cache_hash_table));
+    memset(&cache_stats, 0, sizeof(cache_stats));
+    memset(ra_streams, 0, sizeof(ra_streams));
+    spinlock_init(&cache_lock);
+    mutex_init(&flush_lock);
+    cache_dirty_count = 0;
+    lru_head = lru_tail = free_list = NULL;
+    cache_hashed_blocks = 0;
+    
+    // Size the hash table for about one block per bucket
+    uint32_t bits = 0;
+    while ((1u << bits) < CACHE_HASH_MIN_BUCKETS || (1u << bits) < num_blocks) {
+        bits++;
+    }
+    if (cache_hash_resize(bits) != VFS_SUCCESS) {
+        log_error("VFS", "Failed to allocate cache hash table");
+        free(global_cache);
+        global_cache = NULL;
+        return VFS_ERR_NO_SPACE;
+    }
     
     // Set cache parameters
     global_cache->block_size = block_size;
@@ -86,7 +195,7 @@ int vfs_cache_init(uint32_t block_size, uint32_t num_blocks, uint8_t flags) {
         // Allocate block structure
         vfs_cache_block_t* block = (vfs_cache_block_t*)malloc(sizeof(vfs_cache_block_t));
         if (!block) {
-            log_error("VFS: Failed to allocate cache block %u", i);
+            log_error("VFS", "Failed to allocate cache block %u", i);
             // Clean up already allocated blocks
             for (uint32_t j = 0; j < i; j++) {
                 if (global_cache->blocks[j]) {
@@ -96,6 +205,8 @@ int vfs_cache_init(uint32_t block_size, uint32_t num_blocks, uint8_t flags) {
             }
             free(global_cache);
             global_cache = NULL;
+            free(cache_hash_table);
+            cache_hash_table = NULL;
             return VFS_ERR_NO_SPACE;
         }
         
@@ -105,7 +216,7 @@ int vfs_cache_init(uint32_t block_size, uint32_t num_blocks, uint8_t flags) {
         // Allocate block data
         block->data = (uint8_t*)malloc(block_size);
         if (!block->data) {
-            log_error("VFS: Failed to allocate cache block data %u", i);
+            log_error("VFS", "Failed to allocate cache block data %u", i);
             // Clean up
             free(block);
             for (uint32_t j = 0; j < i; j++) {
@@ -116,6 +227,8 @@ int vfs_cache_init(uint32_t block_size, uint32_t num_blocks, uint8_t flags) {
             }
             free(global_cache);
             global_cache = NULL;
+            free(cache_hash_table);
+            cache_hash_table = NULL;
             return VFS_ERR_NO_SPACE;
         }
         
@@ -125,20 +238,14 @@ int vfs_cache_init(uint32_t block_size, uint32_t num_blocks, uint8_t flags) {
         // Add to cache
         global_cache->blocks[i] = block;
         
-        // Add to LRU list (front)
-        if (!lru_head) {
-            lru_head = lru_tail = block;
-        } else {
-            block->next = lru_head;
-            lru_head = block;
-        }
+        // Every block starts out on the free list
+        cache_free_block(block);
     }
     
     // Reset statistics
-    cache_lookups = cache_hits = cache_misses = cache_evictions = cache_writebacks = 0;
     global_cache->hits = global_cache->misses = 0;
     
-    log_info("VFS: Cache initialized with %u blocks of %u bytes (%u KB total)",
+    log_info("VFS", "Cache initialized with %u blocks of %u bytes (%u KB total)",
             num_blocks, block_size, (num_blocks * block_size) / 1024);
     
     return VFS_SUCCESS;
@@ -155,7 +262,7 @@ int vfs_cache_init(uint32_t block_size, uint32_t num_blocks, uint8_t flags) {
 int vfs_cache_control(const char* mount_point, uint8_t enable, uint8_t flags) {
     // Check if cache is initialized
     if (!global_cache) {
-        log_warning("VFS: Cache not initialized");
+        log_warning("VFS", "Cache not initialized");
         return VFS_ERR_UNSUPPORTED;
     }
     
@@ -164,26 +271,30 @@ int vfs_cache_control(const char* mount_point, uint8_t enable, uint8_t flags) {
     // This would access mount point table in the full VFS implementation
     
     if (!mount) {
-        log_error("VFS: Mount point %s not found", mount_point);
+        log_error("VFS", "Mount point %s not found", mount_point);
         return VFS_ERR_NOT_FOUND;
     }
     
     // If we're disabling caching, flush dirty blocks
     if (!enable && mount->cache && mount->cache->enabled) {
         // Flush all dirty blocks for this mount point
+        mutex_lock(&flush_lock);
+        spinlock_acquire(&cache_lock);
         for (uint32_t i = 0; i < global_cache->num_blocks; i++) {
             vfs_cache_block_t* block = global_cache->blocks[i];
-            if (block && block->dirty && block->dev_id == (uint32_t)mount->device) {
+            if (block && block->valid && block->dirty && block->dev_id == (uint32_t)mount->device) {
                 cache_writeback_block(block);
             }
         }
+        spinlock_release(&cache_lock);
+        mutex_unlock(&flush_lock);
     }
     
     // Allocate cache if needed
     if (!mount->cache) {
         mount->cache = (vfs_cache_t*)malloc(sizeof(vfs_cache_t));
         if (!mount->cache) {
-            log_error("VFS: Failed to allocate cache for mount point %s", mount_point);
+            log_error("VFS", "Failed to allocate cache for mount point %s", mount_point);
             return VFS_ERR_NO_SPACE;
         }
         
@@ -198,7 +309,7 @@ int vfs_cache_control(const char* mount_point, uint8_t enable, uint8_t flags) {
     mount->cache->enabled = enable;
     mount->cache->flags = flags;
     
-    log_info("VFS: %s caching for %s (flags=0x%x)", 
+    log_info("VFS", "%s caching for %s (flags=0x%x)", 
             enable ? "Enabled" : "Disabled", mount_point, flags);
     
     return VFS_SUCCESS;
@@ -218,15 +329,55 @@ int vfs_cache_read_block(uint32_t dev_id, uint32_t block_id, void* buffer) {
         return VFS_ERR_UNSUPPORTED;
     }
     
+    spinlock_acquire(&cache_lock);
+    int result = cache_read_block(dev_id, block_id, buffer);
+    spinlock_release(&cache_lock);
+    
+    // Every block was dirty: wait for write-back to make room, then try once more
+    if (result == VFS_ERR_NO_SPACE) {
+        cache_throttle_writer();
+        
+        spinlock_acquire(&cache_lock);
+        result = cache_read_block(dev_id, block_id, buffer);
+        spinlock_release(&cache_lock);
+        
+        if (result == VFS_ERR_NO_SPACE) {
+            log_error("VFS", "Failed to allocate cache block");
+        }
+    }
+    
+    return result;
+}
+
+/**
+ * Read a block through the cache (cache_lock held, dropped around device reads)
+ *
+ * @param dev_id Device identifier
+ * @param block_id Block identifier
+ * @param buffer Output buffer
+ * @return 0 on success, negative error code on failure
+ */
+static int cache_read_block(uint32_t dev_id, uint32_t block_id, void* buffer) {
+    uint64_t start = hal_time_now_ns();
+    
+    // Follow the access pattern before serving the block
+    cache_ra_stream_t* stream = cache_ra_track(dev_id, block_id);
+    
     // Try to find block in cache
-    cache_lookups++;
+    cache_stats.lookups++;
     vfs_cache_block_t* block = cache_lookup(dev_id, block_id);
     
     if (block) {
         // Cache hit
-        cache_hits++;
+        cache_stats.hits++;
         global_cache->hits++;
         
+        // First read of a prefetched block: the read-ahead paid off
+        if (block->readahead) {
+            block->readahead = 0;
+            cache_stats.ra_hits++;
+        }
+        
         // Update access statistics
         block->access_count++;
         cache_mark_accessed(block);
@@ -234,79 +385,86 @@ int vfs_cache_read_block(uint32_t dev_id, uint32_t block_id, void* buffer) {
         // Copy data to buffer
         memcpy(buffer, block->data, block->size);
         
+        // Once the reader is within half a window of the prefetched data, fetch
+        // the next window so a steady stream never waits on the device
+        if (stream && stream->window && stream->ra_end > block_id &&
+            stream->ra_end - block_id <= stream->window / 2) {
+            vfs_block_device_t* device = vfs_get_block_device_by_id(dev_id);
+            if (device && device->operations && device->operations->read_blocks) {
+                int loaded = cache_fill_blocks(device, dev_id, stream->ra_end, stream->window, 0, NULL);
+                if (loaded > 0) {
+                    stream->ra_end += loaded;
+                    if (stream->window * 2 <= cache_ra_max_blocks()) {
+                        stream->window *= 2;
+                    }
+                }
+            }
+        }
+        
+        cache_record_latency(start, &cache_stats.hit_ns_total, &cache_stats.hit_ns_max);
         return VFS_SUCCESS;
     }
     
     // Cache miss
-    cache_misses++;
+    cache_stats.misses++;
     global_cache->misses++;
     
-    // Allocate a new cache block
-    block = cache_alloc_block();
-    if (!block) {
-        // Failed to allocate, try to evict an existing block
-        if (cache_evict_block() != VFS_SUCCESS) {
-            log_error("VFS: Failed to evict cache block");
-            return VFS_ERR_NO_SPACE;
-        }
-        
-        // Try again
-        block = cache_alloc_block();
-        if (!block) {
-            log_error("VFS: Failed to allocate cache block after eviction");
-            return VFS_ERR_NO_SPACE;
-        }
-    }
-    
-    // Set block information
-    block->dev_id = dev_id;
-    block->block_id = block_id;
-    block->dirty = 0;
-    block->access_count = 1;
-    
     // Get the block device for this device ID
     vfs_block_device_t* device = vfs_get_block_device_by_id(dev_id);
     if (!device) {
-        log_error("VFS: Failed to find block device %u", dev_id);
+        log_error("VFS", "Failed to find block device %u", dev_id);
         return VFS_ERR_INVALID_DEV;
     }
     
     // Read the data from the actual device
     if (!device->operations || !device->operations->read_blocks) {
-        log_error("VFS: Device %u missing read operations", dev_id);
+        log_error("VFS", "Device %u missing read operations", dev_id);
         return VFS_ERR_UNSUPPORTED;
     }
     
-    // Calculate device block number and count
-    uint64_t dev_block = block_id;
-    uint32_t dev_count = (block->size + device->block_size - 1) / device->block_size;
-    
-    // If device block size differs from cache block size, handle conversion
-    if (device->block_size != block->size) {
-        dev_block = (block_id * block->size) / device->block_size;
+    // A sequential stream reads its window along with the missing block
+    uint32_t count = 1;
+    if (stream && stream->window) {
+        count += stream->window;
+        if (count > cache_ra_max_blocks()) {
+            count = cache_ra_max_blocks();
+        }
     }
     
-    // Read from device
-    int read_result = device->operations->read_blocks(device, dev_block, dev_count, block->data);
-    if (read_result != dev_count) {
-        log_error("VFS: Device %u read error: %d", dev_id, read_result);
-        return VFS_ERR_IO_ERROR;
+    int loaded = cache_fill_blocks(device, dev_id, block_id, count, 1, &block);
+    if (loaded < 0) {
+        return loaded;
     }
     
-    // Add to hash table
-    uint32_t hash = cache_hash(dev_id, block_id);
-    block->next = cache_hash_table[hash];
-    cache_hash_table[hash] = block;
+    if (stream && loaded > 1) {
+        stream->ra_end = block_id + loaded;
+        if (stream->window * 2 <= cache_ra_max_blocks()) {
+            stream->window *= 2;
+        }
+    }
     
-    // Add to LRU list
-    cache_mark_accessed(block);
+    block->access_count = 1;
     
     // Copy data to buffer
     memcpy(buffer, block->data, block->size);
     
+    cache_record_latency(start, &cache_stats.miss_ns_total, &cache_stats.miss_ns_max);
     return VFS_SUCCESS;
 }
 
+/**
+ * Get the size of a cache block
+ *
+ * @return Block size in bytes, or 0 if the cache is not enabled
+ */
+uint32_t vfs_cache_get_block_size(void) {
+    if (!global_cache || !global_cache->enabled) {
+        return 0;
+    }
+    
+    return global_cache->block_size;
+}
+
 /**
  * Write a block to cache
  *
@@ -322,36 +480,46 @@ int vfs_cache_write_block(uint32_t dev_id, uint32_t block_id, const void* buffer
         return VFS_ERR_UNSUPPORTED;
     }
     
-    // Try to find block in cache
-    vfs_cache_block_t* block = cache_lookup(dev_id, block_id);
-    
-    if (!block) {
-        // Block not in cache, allocate a new one
+    vfs_cache_block_t* block;
+    for (int attempt = 0; ; attempt++) {
+        // A synchronous write needs the flush buffer for its write-back
+        if (sync) {
+            mutex_lock(&flush_lock);
+        }
+        spinlock_acquire(&cache_lock);
+        
+        // Try to find block in cache
+        cache_stats.lookups++;
+        block = cache_lookup(dev_id, block_id);
+        if (block) {
+            cache_stats.hits++;
+            break;
+        }
+        
+        // Block not in cache, allocate a new one (the whole block is overwritten)
+        cache_stats.misses++;
         block = cache_alloc_block();
-        if (!block) {
-            // Failed to allocate, try to evict an existing block
-            if (cache_evict_block() != VFS_SUCCESS) {
-                log_error("VFS: Failed to evict cache block");
-                return VFS_ERR_NO_SPACE;
-            }
-            
-            // Try again
-            block = cache_alloc_block();
-            if (!block) {
-                log_error("VFS: Failed to allocate cache block after eviction");
-                return VFS_ERR_NO_SPACE;
-            }
+        if (block) {
+            // Set block information
+            block->dev_id = dev_id;
+            block->block_id = block_id;
+            block->access_count = 0;
+            cache_hash_insert(block);
+            break;
         }
         
-        // Set block information
-        block->dev_id = dev_id;
-        block->block_id = block_id;
-        block->access_count = 1;
+        spinlock_release(&cache_lock);
+        if (sync) {
+            mutex_unlock(&flush_lock);
+        }
         
-        // Add to hash table
-        uint32_t hash = cache_hash(dev_id, block_id);
-        block->next = cache_hash_table[hash];
-        cache_hash_table[hash] = block;
+        if (attempt > 0) {
+            log_error("VFS", "Failed to allocate cache block");
+            return VFS_ERR_NO_SPACE;
+        }
+        
+        // Every block is dirty: wait for write-back to make room
+        cache_throttle_writer();
     }
     
     // Update access statistics
@@ -361,15 +529,32 @@ int vfs_cache_write_block(uint32_t dev_id, uint32_t block_id, const void* buffer
     // Copy data from buffer
     memcpy(block->data, buffer, block->size);
     
-    // Mark as dirty
-    block->dirty = 1;
+    // Mark as dirty (overwritten data no longer counts as prefetched)
+    cache_set_dirty(block);
+    block->write_seq++;
+    block->readahead = 0;
     
     // If sync requested, write back to disk immediately
+    int result = VFS_SUCCESS;
     if (sync) {
-        return cache_writeback_block(block);
+        result = cache_writeback_block(block);
     }
     
-    return VFS_SUCCESS;
+    uint32_t dirty = cache_dirty_count;
+    spinlock_release(&cache_lock);
+    if (sync) {
+        mutex_unlock(&flush_lock);
+    }
+    
+    // Past the dirty limit the writer pays for write-back; past the
+    // background threshold the flusher is woken early
+    if (dirty >= cache_dirty_threshold(CACHE_DIRTY_LIMIT)) {
+        cache_throttle_writer();
+    } else if (dirty >= cache_dirty_threshold(CACHE_DIRTY_BACKGROUND) && flusher_thread_id >= 0) {
+        thread_wake(flusher_thread_id);
+    }
+    
+    return result;
 }
 
 /**
@@ -385,20 +570,20 @@ int vfs_cache_flush_block(uint32_t dev_id, uint32_t block_id) {
         return VFS_ERR_UNSUPPORTED;
     }
     
-    // Try to find block in cache
-    vfs_cache_block_t* block = cache_lookup(dev_id, block_id);
+    mutex_lock(&flush_lock);
+    spinlock_acquire(&cache_lock);
     
-    if (!block) {
-        // Block not in cache, nothing to do
-        return VFS_SUCCESS;
+    // Write the block back if it is cached and dirty
+    int result = VFS_SUCCESS;
+    vfs_cache_block_t* block = cache_lookup(dev_id, block_id);
+    if (block && block->dirty) {
+        result = cache_writeback_block(block);
     }
     
-    // If dirty, write back
-    if (block->dirty) {
-        return cache_writeback_block(block);
-    }
+    spinlock_release(&cache_lock);
+    mutex_unlock(&flush_lock);
     
-    return VFS_SUCCESS;
+    return result;
 }
 
 /**
@@ -414,35 +599,24 @@ int vfs_cache_invalidate_block(uint32_t dev_id, uint32_t block_id) {
         return VFS_ERR_UNSUPPORTED;
     }
     
-    // Try to find block in cache
-    uint32_t hash = cache_hash(dev_id, block_id);
-    vfs_cache_block_t** pprev = &cache_hash_table[hash];
-    vfs_cache_block_t* block = cache_hash_table[hash];
+    mutex_lock(&flush_lock);
+    spinlock_acquire(&cache_lock);
     
-    while (block) {
-        if (block->dev_id == dev_id && block->block_id == block_id) {
-            // Found it, remove from hash table
-            *pprev = block->next;
-            
-            // If dirty, write back
-            if (block->dirty) {
-                cache_writeback_block(block);
-            }
-            
-            // Reset block information
-            block->dev_id = 0;
-            block->block_id = 0;
-            block->dirty = 0;
-            block->next = NULL;
-            
-            return VFS_SUCCESS;
-        }
-        
-        pprev = &block->next;
-        block = block->next;
+    // If dirty, write back (again if it was rewritten while the lock was dropped)
+    vfs_cache_block_t* block = cache_lookup(dev_id, block_id);
+    while (block && block->dirty && cache_writeback_block(block) == VFS_SUCCESS) {
+        block = cache_lookup(dev_id, block_id);
+    }
+    
+    // Drop it from the hash table and LRU list, even if the write failed
+    block = cache_lookup(dev_id, block_id);
+    if (block) {
+        cache_free_block(block);
     }
     
-    // Block not in cache
+    spinlock_release(&cache_lock);
+    mutex_unlock(&flush_lock);
+    
     return VFS_SUCCESS;
 }
 
@@ -457,20 +631,8 @@ int vfs_cache_flush_all(void) {
         return VFS_ERR_UNSUPPORTED;
     }
     
-    int result = VFS_SUCCESS;
-    
-    // Go through all cache blocks
-    for (uint32_t i = 0; i < global_cache->num_blocks; i++) {
-        vfs_cache_block_t* block = global_cache->blocks[i];
-        if (block && block->dirty) {
-            int ret = cache_writeback_block(block);
-            if (ret != VFS_SUCCESS) {
-                result = ret;
-            }
-        }
-    }
-    
-    return result;
+    // One sorted, coalesced pass over every dirty block
+    return cache_flush_dirty(0);
 }
 
 /**
@@ -485,40 +647,40 @@ int vfs_cache_invalidate_device(uint32_t dev_id) {
         return VFS_ERR_UNSUPPORTED;
     }
     
-    // Go through all hash table entries
-    for (uint32_t hash = 0; hash < CACHE_HASH_SIZE; hash++) {
-        vfs_cache_block_t** pprev = &cache_hash_table[hash];
-        vfs_cache_block_t* block = cache_hash_table[hash];
+    mutex_lock(&flush_lock);
+    spinlock_acquire(&cache_lock);
+    
+    // Walk the LRU list: it holds exactly the valid blocks
+    vfs_cache_block_t* block = lru_head;
+    while (block) {
+        if (block->dev_id != dev_id) {
+            block = block->lru_next;
+            continue;
+        }
         
-        while (block) {
-            if (block->dev_id == dev_id) {
-                // Found a block for this device
-                vfs_cache_block_t* next = block->next;
-                
-                // Remove from hash table
-                *pprev = next;
-                
-                // If dirty, write back
-                if (block->dirty) {
-                    cache_writeback_block(block);
+        // If dirty, write back; the list may change while the lock is dropped,
+        // so the walk starts over afterwards
+        if (block->dirty) {
+            uint32_t block_id = block->block_id;
+            if (cache_writeback_block(block) != VFS_SUCCESS) {
+                // Dropped anyway: the data can't reach the device
+                vfs_cache_block_t* failed = cache_lookup(dev_id, block_id);
+                if (failed) {
+                    cache_free_block(failed);
                 }
-                
-                // Reset block information
-                block->dev_id = 0;
-                block->block_id = 0;
-                block->dirty = 0;
-                block->next = NULL;
-                
-                // Move to next
-                block = next;
-            } else {
-                // Move to next
-                pprev = &block->next;
-                block = block->next;
             }
+            block = lru_head;
+            continue;
         }
+        
+        vfs_cache_block_t* next = block->lru_next;
+        cache_free_block(block);
+        block = next;
     }
     
+    spinlock_release(&cache_lock);
+    mutex_unlock(&flush_lock);
+    
     return VFS_SUCCESS;
 }
 
@@ -536,8 +698,31 @@ int vfs_cache_get_stats(uint32_t* hits, uint32_t* misses) {
         return VFS_ERR_UNSUPPORTED;
     }
     
-    if (hits) *hits = cache_hits;
-    if (misses) *misses = cache_misses;
+    if (hits) *hits = cache_stats.hits;
+    if (misses) *misses = cache_stats.misses;
+    
+    return VFS_SUCCESS;
+}
+
+/**
+ * Get detailed cache statistics
+ *
+ * @param stats Output statistics
+ * @return 0 on success, negative error code on failure
+ */
+int vfs_cache_get_detailed_stats(vfs_cache_stats_t* stats) {
+    if (!stats) {
+        return VFS_ERR_INVALID_ARG;
+    }
+    
+    if (!global_cache) {
+        memset(stats, 0, sizeof(*stats));
+        return VFS_ERR_UNSUPPORTED;
+    }
+    
+    *stats = cache_stats;
+    stats->hash_buckets = 1u << cache_hash_bits;
+    stats->dirty_blocks = cache_dirty_count;
     
     return VFS_SUCCESS;
 }
@@ -548,11 +733,11 @@ int vfs_cache_get_stats(uint32_t* hits, uint32_t* misses) {
  * @return Hit ratio (0-100), or negative error code on failure
  */
 int vfs_cache_get_hit_ratio(void) {
-    if (!global_cache || cache_lookups == 0) {
+    if (!global_cache || cache_stats.lookups == 0) {
         return 0;
     }
     
-    return (cache_hits * 100) / cache_lookups;
+    return (cache_stats.hits * 100) / cache_stats.lookups;
 }
 
 /**
@@ -560,11 +745,88 @@ int vfs_cache_get_hit_ratio(void) {
  *
  * @param dev_id Device identifier
  * @param block_id Block identifier
- * @return Hash value
+ * @return Hash value (index into the current table)
  */
 static uint32_t cache_hash(uint32_t dev_id, uint32_t block_id) {
-    // Simple hash function combining device and block IDs
-    return ((dev_id << 16) ^ block_id) % CACHE_HASH_SIZE;
+    // Multiplicative hash: consecutive blocks spread over the whole table
+    uint32_t key = (block_id ^ (dev_id * 0x85EBCA6Bu)) * 0x9E3779B1u;
+    return key >> (32 - cache_hash_bits);
+}
+
+/**
+ * Rebuild the hash table with 2^bits buckets
+ *
+ * @param bits Log2 of the new table size
+ * @return 0 on success, negative error code on failure
+ */
+static int cache_hash_resize(uint32_t bits) {
+    vfs_cache_block_t** table = (vfs_cache_block_t**)malloc(sizeof(vfs_cache_block_t*) << bits);
+    if (!table) {
+        return VFS_ERR_NO_SPACE;
+    }
+    memset(table, 0, sizeof(vfs_cache_block_t*) << bits);
+    
+    vfs_cache_block_t** old_table = cache_hash_table;
+    uint32_t old_size = old_table ? (1u << cache_hash_bits) : 0;
+    
+    cache_hash_table = table;
+    cache_hash_bits = bits;
+    cache_hashed_blocks = 0;
+    
+    // Re-link every chained block into the new table
+    for (uint32_t i = 0; i < old_size; i++) {
+        vfs_cache_block_t* block = old_table[i];
+        while (block) {
+            vfs_cache_block_t* next = block->hash_next;
+            cache_hash_insert(block);
+            block = next;
+        }
+    }
+    
+    free(old_table);
+    return VFS_SUCCESS;
+}
+
+/**
+ * Link a block into its hash chain
+ *
+ * @param block Cache block with dev_id and block_id set
+ */
+static void cache_hash_insert(vfs_cache_block_t* block) {
+    // Keep chains short if the cache has outgrown the table
+    if (cache_hashed_blocks >= (CACHE_HASH_MAX_LOAD << cache_hash_bits) && cache_hash_bits < 20) {
+        cache_hash_resize(cache_hash_bits + 1);
+    }
+    
+    vfs_cache_block_t** head = &cache_hash_table[cache_hash(block->dev_id, block->block_id)];
+    block->hash_next = *head;
+    block->hash_pprev = head;
+    if (*head) {
+        (*head)->hash_pprev = &block->hash_next;
+    }
+    *head = block;
+    block->valid = 1;
+    cache_hashed_blocks++;
+}
+
+/**
+ * Unlink a block from its hash chain
+ *
+ * @param block Cache block
+ */
+static void cache_hash_remove(vfs_cache_block_t* block) {
+    if (!block->valid) {
+        return;
+    }
+    
+    *block->hash_pprev = block->hash_next;
+    if (block->hash_next) {
+        block->hash_next->hash_pprev = block->hash_pprev;
+    }
+    block->hash_next = NULL;
+    block->hash_pprev = NULL;
+    block->valid = 0;
+    cache_hashed_blocks--;
 }
 
 /**
@@ -575,17 +837,14 @@ static uint32_t cache_hash(uint32_t dev_id, uint32_t block_id) {
  * @return Pointer to cache block, or NULL if not found
  */
 static vfs_cache_block_t* cache_lookup(uint32_t dev_id, uint32_t block_id) {
-    // Calculate hash
-    uint32_t hash = cache_hash(dev_id, block_id);
-    
     // Look in hash chain
-    vfs_cache_block_t* block = cache_hash_table[hash];
+    vfs_cache_block_t* block = cache_hash_table[cache_hash(dev_id, block_id)];
     while (block) {
         if (block->dev_id == dev_id && block->block_id == block_id) {
             // Found it
             return block;
         }
-        block = block->next;
+        block = block->hash_next;
     }
     
     // Not found
@@ -593,22 +852,70 @@ static vfs_cache_block_t* cache_lookup(uint32_t dev_id, uint32_t block_id) {
 }
 
 /**
- * Allocate a free cache block
+ * Unlink a block from the LRU list
+ *
+ * @param block Cache block on the LRU list
+ */
+static void cache_lru_remove(vfs_cache_block_t* block) {
+    if (block->lru_prev) {
+        block->lru_prev->lru_next = block->lru_next;
+    } else {
+        lru_head = block->lru_next;
+    }
+    
+    if (block->lru_next) {
+        block->lru_next->lru_prev = block->lru_prev;
+    } else {
+        lru_tail = block->lru_prev;
+    }
+    
+    block->lru_prev = NULL;
+    block->lru_next = NULL;
+}
+
+/**
+ * Take a block off the free list, evicting the least recently used clean
+ * block if the free list is empty
  *
- * @return Pointer to a free cache block, or NULL if none available
+ * @return Pointer to a free cache block, or NULL if every block is dirty
  */
 static vfs_cache_block_t* cache_alloc_block(void) {
-    // Look for a free block
-    for (uint32_t i = 0; i < global_cache->num_blocks; i++) {
-        vfs_cache_block_t* block = global_cache->blocks[i];
-        if (block && block->dev_id == 0 && block->block_id == 0) {
-            // Found a free block
-            return block;
+    if (!free_list && cache_evict_block() != VFS_SUCCESS) {
+        return NULL;
+    }
+    
+    vfs_cache_block_t* block = free_list;
+    free_list = block->lru_next;
+    block->lru_next = NULL;
+    
+    return block;
+}
+
+/**
+ * Return a block to the free list, dropping it from the hash table and the
+ * LRU list if it holds data
+ *
+ * @param block Cache block
+ */
+static void cache_free_block(vfs_cache_block_t* block) {
+    if (block->valid) {
+        // Prefetched and never read: the read-ahead was wasted
+        if (block->readahead) {
+            cache_stats.ra_wasted++;
         }
+        
+        cache_hash_remove(block);
+        cache_lru_remove(block);
     }
     
-    // No free blocks
-    return NULL;
+    cache_set_clean(block);
+    block->dev_id = 0;
+    block->block_id = 0;
+    block->readahead = 0;
+    block->access_count = 0;
+    block->lru_prev = NULL;
+    block->lru_next = free_list;
+    free_list = block;
 }
 
 /**
@@ -625,31 +932,17 @@ static void cache_mark_accessed(vfs_cache_block_t* block) {
         return;
     }
     
-    // First, remove from current position
-    if (block == lru_tail) {
-        // It's the tail
-        lru_tail = NULL; // We'll fix this below
-    } else {
-        // It's in the middle
-        // Find the previous block
-        vfs_cache_block_t* prev = lru_head;
-        while (prev && prev->next != block) {
-            prev = prev->next;
-        }
-        
-        if (prev) {
-            // Remove from list
-            prev->next = block->next;
-            
-            // If this was the tail, update tail
-            if (lru_tail == block) {
-                lru_tail = prev;
-            }
-        }
+    // Unlink from the current position (newly valid blocks are not linked yet)
+    if (block->lru_prev || block == lru_tail) {
+        cache_lru_remove(block);
     }
     
     // Now, add to head
-    block->next = lru_head;
+    block->lru_prev = NULL;
+    block->lru_next = lru_head;
+    if (lru_head) {
+        lru_head->lru_prev = block;
+    }
     lru_head = block;
     
     // If tail is NULL, this is the only element
@@ -661,7 +954,10 @@ static void cache_mark_accessed(vfs_cache_block_t* block) {
 /**
  * Evict a block from cache based on LRU policy
  *
- * @return 0 on success, negative error code on failure
+ * Only clean blocks are reclaimed; dirty ones are left to the flusher, which
+ * is woken when the scan has to pass over any. Eviction never writes.
+ *
+ * @return 0 on success, VFS_ERR_NO_SPACE if every cached block is dirty
  */
 static int cache_evict_block(void) {
     // No blocks to evict
@@ -669,111 +965,544 @@ static int cache_evict_block(void) {
         return VFS_ERR_NO_SPACE;
     }
     
-    // Get the least recently used block (at tail)
+    uint64_t start = hal_time_now_ns();
+    
+    // Reclaim the least recently used clean block
     vfs_cache_block_t* block = lru_tail;
+    while (block && block->dirty) {
+        block = block->lru_prev;
+    }
     
-    // If dirty, write back
-    if (block->dirty) {
-        cache_writeback_block(block);
+    if (block != lru_tail && flusher_thread_id >= 0) {
+        thread_wake(flusher_thread_id);
+    }
+    
+    // Every block is dirty: the caller waits for write-back with the lock dropped
+    if (!block) {
+        cache_stats.evict_stalls++;
+        return VFS_ERR_NO_SPACE;
     }
     
-    // Remove from hash table
-    if (block->dev_id != 0 || block->block_id != 0) {
-        uint32_t hash = cache_hash(block->dev_id, block->block_id);
-        vfs_cache_block_t** pprev = &cache_hash_table[hash];
-        vfs_cache_block_t* curr = cache_hash_table[hash];
+    // Remove from the hash table and LRU list, then put it on the free list
+    cache_free_block(block);
+    
+    cache_stats.evictions++;
+    cache_record_latency(start, &cache_stats.evict_ns_total, &cache_stats.evict_ns_max);
+    
+    return VFS_SUCCESS;
+}
+
+/**
+ * Record a block read against the sequential streams
+ *
+ * A read of the block a stream expects next continues it; the second
+ * consecutive read turns it sequential and opens its read-ahead window.
+ * Any other read starts a candidate stream in the least recently used slot.
+ *
+ * @param dev_id Device identifier
+ * @param block_id Block being read
+ * @return The stream the read continues, or NULL if it starts a new one
+ */
+static cache_ra_stream_t* cache_ra_track(uint32_t dev_id, uint32_t block_id) {
+    cache_ra_stream_t* victim = &ra_streams[0];
+    ra_clock++;
+    
+    for (int i = 0; i < CACHE_RA_STREAMS; i++) {
+        cache_ra_stream_t* stream = &ra_streams[i];
         
-        while (curr) {
-            if (curr == block) {
-                // Remove from hash chain
-                *pprev = curr->next;
-                break;
+        if (stream->last_use && stream->dev_id == dev_id) {
+            // Another read of the current block (e.g. a sector at a time)
+            if (stream->next_block == block_id + 1) {
+                stream->last_use = ra_clock;
+                return stream;
             }
             
-            pprev = &curr->next;
-            curr = curr->next;
+            // The next block: the stream goes on
+            if (stream->next_block == block_id) {
+                stream->next_block = block_id + 1;
+                stream->last_use = ra_clock;
+                if (stream->window == 0) {
+                    stream->window = CACHE_RA_MIN_BYTES / global_cache->block_size;
+                    if (stream->window == 0) {
+                        stream->window = 1;
+                    }
+                    if (stream->window > cache_ra_max_blocks()) {
+                        stream->window = cache_ra_max_blocks();
+                    }
+                    stream->ra_end = block_id + 1;
+                }
+                return stream;
+            }
+        }
+        
+        if (stream->last_use < victim->last_use) {
+            victim = stream;
         }
     }
     
-    // Reset block information
-    block->dev_id = 0;
-    block->block_id = 0;
-    block->dirty = 0;
+    victim->dev_id = dev_id;
+    victim->next_block = block_id + 1;
+    victim->ra_end = block_id + 1;
+    victim->window = 0;
+    victim->last_use = ra_clock;
+    
+    return NULL;
+}
+
+/**
+ * Largest number of blocks a single fill may load
+ *
+ * @return Block count (at least 1)
+ */
+static uint32_t cache_ra_max_blocks(void) {
+    uint32_t max_blocks = CACHE_RA_MAX_BYTES / global_cache->block_size;
     
-    // Move up in LRU list (not to the front)
-    if (lru_tail->next) {
-        // Move one position up
-        vfs_cache_block_t* prev = lru_head;
-        while (prev && prev->next != lru_tail) {
-            prev = prev->next;
+    // Never let one stream flush more than a quarter of the cache
+    if (max_blocks > global_cache->num_blocks / 4) {
+        max_blocks = global_cache->num_blocks / 4;
+    }
+    
+    return max_blocks ? max_blocks : 1;
+}
+
+/**
+ * Load consecutive blocks with a single device request
+ *
+ * The run stops early at a block that is already cached or past the end of
+ * the device. Blocks after the first @demanded are tagged as read-ahead.
+ * cache_lock is dropped around the device read.
+ *
+ * @param device Block device
+ * @param dev_id Device identifier
+ * @param block_id First block to load
+ * @param count Maximum number of blocks to load
+ * @param demanded Number of leading blocks the caller actually needs (0 or 1)
+ * @param first Output for the first loaded block (may be NULL)
+ * @return Number of blocks loaded, or negative error code on failure
+ */
+static int cache_fill_blocks(vfs_block_device_t* device, uint32_t dev_id, uint32_t block_id,
+                             uint32_t count, uint32_t demanded, vfs_cache_block_t** first) {
+    uint32_t block_size = global_cache->block_size;
+    vfs_cache_block_t* blocks[CACHE_RA_MAX_BYTES / 512];
+    
+    if (count > cache_ra_max_blocks()) {
+        count = cache_ra_max_blocks();
+    }
+    if (count < demanded) {
+        count = demanded;
+    }
+    
+    // Don't prefetch past the end of the device
+    if (device->block_count && device->block_size) {
+        uint64_t dev_blocks = (device->block_count * device->block_size) / block_size;
+        uint64_t available = block_id < dev_blocks ? dev_blocks - block_id : 0;
+        if (count > available) {
+            count = available > demanded ? (uint32_t)available : demanded;
         }
+    }
+    
+    // Stop at the first block that is already cached
+    for (uint32_t i = demanded; i < count; i++) {
+        if (cache_lookup(dev_id, block_id + i)) {
+            count = i;
+            break;
+        }
+    }
+    
+    // Only one fill at a time can stage a run, the others read just the demanded block
+    if (count > 1 && ra_buffer_busy) {
+        count = demanded;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    
+    // Take the cache blocks (not yet hashed, so evictions can't reclaim them)
+    for (uint32_t i = 0; i < count; i++) {
+        blocks[i] = cache_alloc_block();
+        if (!blocks[i]) {
+            if (i <= demanded) {
+                for (uint32_t j = 0; j < i; j++) {
+                    cache_free_block(blocks[j]);
+                }
+                return VFS_ERR_NO_SPACE;
+            }
+            count = i;
+            break;
+        }
+    }
+    
+    // Calculate device block number and count
+    uint64_t dev_block = ((uint64_t)block_id * block_size) / device->block_size;
+    uint32_t dev_count = (count * block_size + device->block_size - 1) / device->block_size;
+    
+    // A single block is read in place, a run through the staging buffer
+    int staged = count > 1;
+    void* target = staged ? ra_buffer : blocks[0]->data;
+    if (staged) {
+        ra_buffer_busy = 1;
+    }
+    
+    // Nothing else can reach the blocks yet, so the lock is not needed for the read
+    spinlock_release(&cache_lock);
+    int read_result = device->operations->read_blocks(device, dev_block, dev_count, target);
+    spinlock_acquire(&cache_lock);
+    
+    if (staged) {
+        ra_buffer_busy = 0;
+    }
+    if (read_result != dev_count) {
+        log_error("VFS", "Device %u read error: %d", dev_id, read_result);
+        for (uint32_t i = 0; i < count; i++) {
+            cache_free_block(blocks[i]);
+        }
+        return VFS_ERR_IO_ERROR;
+    }
+    
+    // Make the blocks visible, the demanded one ending up most recently used
+    for (int i = count - 1; i >= 0; i--) {
+        vfs_cache_block_t* block = blocks[i];
         
-        if (prev) {
-            // Update pointers
-            lru_tail = prev;
+        // Cached by another reader or a writer during the read: that copy wins
+        vfs_cache_block_t* cached = cache_lookup(dev_id, block_id + i);
+        if (cached) {
+            cache_free_block(block);
+            blocks[i] = cached;
+            cache_mark_accessed(cached);
+            continue;
         }
+        
+        if (staged) {
+            memcpy(block->data, ra_buffer + i * block_size, block_size);
+        }
+        
+        block->dev_id = dev_id;
+        block->block_id = block_id + i;
+        block->dirty = 0;
+        block->readahead = (uint32_t)i >= demanded;
+        block->access_count = 0;
+        cache_hash_insert(block);
+        cache_mark_accessed(block);
     }
     
-    cache_evictions++;
+    if (count > demanded) {
+        cache_stats.ra_requests++;
+        cache_stats.ra_blocks += count - demanded;
+    }
     
-    return VFS_SUCCESS;
+    if (first) {
+        *first = blocks[0];
+    }
+    return count;
 }
 
 /**
- * Write a dirty cache block back to disk
+ * Mark a block dirty, starting its dirty age if it was clean
  *
  * @param block Cache block
- * @return 0 on success, negative error code on failure
  */
-static int cache_writeback_block(vfs_cache_block_t* block) {
-    if (!block || !block->dirty) {
-        return VFS_SUCCESS;
+static void cache_set_dirty(vfs_cache_block_t* block) {
+    if (!block->dirty) {
+        block->dirty = 1;
+        block->dirty_since = (uint32_t)ktimer_now_ms();
+        cache_dirty_count++;
     }
-    
-    // Get the block device for this device ID
-    vfs_block_device_t* device = vfs_get_block_device_by_id(block->dev_id);
+}
+
+/**
+ * Mark a block clean
+ *
+ * @param block Cache block
+ */
+static void cache_set_clean(vfs_cache_block_t* block) {
+    if (block->dirty) {
+        block->dirty = 0;
+        cache_dirty_count--;
+    }
+}
+
+/**
+ * Number of dirty blocks that makes up a percentage of the cache
+ *
+ * @param percent Percentage of the cache
+ * @return Block count (at least 1)
+ */
+static uint32_t cache_dirty_threshold(uint32_t percent) {
+    uint32_t blocks = global_cache ? (global_cache->num_blocks * percent) / 100 : 0;
+    return blocks ? blocks : 1;
+}
+
+/**
+ * Check that a picked block still holds the same dirty data (cache_lock held)
+ *
+ * @param entry Flush list entry
+ * @return 1 if the block can still be written as picked, 0 otherwise
+ */
+static int cache_flush_entry_current(const cache_flush_entry_t* entry) {
+    vfs_cache_block_t* block = entry->block;
+    return block->valid && block->dirty && block->dev_id == entry->dev_id &&
+           block->block_id == entry->block_id;
+}
+
+/**
+ * Write a staged run of consecutive blocks with one device request
+ *
+ * @param dev_id Device identifier
+ * @param block_id First block of the run
+ * @param count Number of blocks in flush_buffer
+ * @param block_size Cache block size
+ * @return 0 on success, negative error code on failure
+ */
+static int cache_write_run(uint32_t dev_id, uint32_t block_id, uint32_t count, uint32_t block_size) {
+    vfs_block_device_t* device = vfs_get_block_device_by_id(dev_id);
     if (!device) {
-        log_error("VFS: Failed to find block device %u for writeback", block->dev_id);
+        log_error("VFS", "Failed to find block device %u for writeback", dev_id);
         return VFS_ERR_INVALID_DEV;
     }
     
-    // Check if device has write operations
     if (!device->operations || !device->operations->write_blocks) {
-        log_error("VFS: Device %u missing write operations", block->dev_id);
-        // Still mark as clean to prevent repeated errors
-        block->dirty = 0;
+        log_error("VFS", "Device %u missing write operations", dev_id);
         return VFS_ERR_UNSUPPORTED;
     }
     
     // Calculate device block number and count
-    uint64_t dev_block = block->block_id;
-    uint32_t dev_count = (block->size + device->block_size - 1) / device->block_size;
-    
-    // If device block size differs from cache block size, handle conversion
-    if (device->block_size != block->size) {
-        dev_block = (block->block_id * block->size) / device->block_size;
-    }
+    uint64_t dev_block = ((uint64_t)block_id * block_size) / device->block_size;
+    uint32_t dev_count = (count * block_size + device->block_size - 1) / device->block_size;
     
-    // Write to device
-    int write_result = device->operations->write_blocks(device, dev_block, dev_count, block->data);
+    int write_result = device->operations->write_blocks(device, dev_block, dev_count, flush_buffer);
     if (write_result != dev_count) {
-        log_error("VFS: Device %u write error: %d", block->dev_id, write_result);
+        log_error("VFS", "Device %u write error: %d", dev_id, write_result);
         return VFS_ERR_IO_ERROR;
     }
     
-    // Mark as clean
-    block->dirty = 0;
-    
     // Issue sync if device supports it and write caching is disabled
-    if (device->operations->sync && !(global_cache->flags & VFS_CACHE_FLAG_WRITE_CACHE)) {
+    if (device->operations->sync && !(global_cache->flags & VFS_CACHE_WRITE)) {
         device->operations->sync(device);
     }
     
-    cache_writebacks++;
-    
     return VFS_SUCCESS;
 }
 
+/**
+ * Write one dirty block back (flush_lock and cache_lock held)
+ *
+ * The block is staged in flush_buffer and cache_lock is dropped around the
+ * device write. It stays dirty, and so is never evicted, until the write
+ * completes; if it was rewritten meanwhile it stays dirty for the next pass.
+ * The block may have been reused once this returns, so callers look it up
+ * again.
+ *
+ * @param block Cache block
+ * @return 0 on success, negative error code on failure
+ */
+static int cache_writeback_block(vfs_cache_block_t* block) {
+    if (!block->valid || !block->dirty) {
+        return VFS_SUCCESS;
+    }
+    
+    uint32_t block_size = global_cache->block_size;
+    cache_flush_entry_t entry = {
+        .block = block,
+        .dev_id = block->dev_id,
+        .block_id = block->block_id,
+        .write_seq = block->write_seq,
+    };
+    memcpy(flush_buffer, block->data, block_size);
+    
+    spinlock_release(&cache_lock);
+    int result = cache_write_run(entry.dev_id, entry.block_id, 1, block_size);
+    spinlock_acquire(&cache_lock);
+    
+    // A device that can't write at all still gets the block cleaned, to stop repeated errors
+    if ((result == VFS_SUCCESS || result == VFS_ERR_UNSUPPORTED) &&
+        cache_flush_entry_current(&entry) && block->write_seq == entry.write_seq) {
+        cache_set_clean(block);
+    }
+    if (result == VFS_SUCCESS) {
+        cache_stats.writebacks++;
+    }
+    
+    return result;
+}
+
+/**
+ * Write dirty blocks back in (dev_id, block_id) order, merging blocks that
+ * follow each other on a device into a single request
+ *
+ * cache_lock is dropped around each device write, so readers and writers
+ * are never held up by the I/O. Blocks stay dirty (and so are never
+ * evicted) until their write completes; one rewritten meanwhile stays
+ * dirty for the next pass.
+ *
+ * @param min_age_ms Only write blocks dirty for at least this long (0 for all)
+ * @return 0 on success, or the last negative error code
+ */
+static int cache_flush_dirty(uint32_t min_age_ms) {
+    int result = VFS_SUCCESS;
+    
+    mutex_lock(&flush_lock);
+    spinlock_acquire(&cache_lock);
+    
+    if (!global_cache) {
+        spinlock_release(&cache_lock);
+        mutex_unlock(&flush_lock);
+        return VFS_ERR_UNSUPPORTED;
+    }
+    
+    // Pick the dirty blocks old enough to go
+    uint32_t now = (uint32_t)ktimer_now_ms();
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < global_cache->num_blocks; i++) {
+        vfs_cache_block_t* block = global_cache->blocks[i];
+        if (block && block->valid && block->dirty && now - block->dirty_since >= min_age_ms) {
+            flush_list[count].block = block;
+            flush_list[count].dev_id = block->dev_id;
+            flush_list[count].block_id = block->block_id;
+            count++;
+        }
+    }
+    
+    // Sort by device, then block, so every device sees ascending writes
+    for (uint32_t i = 1; i < count; i++) {
+        cache_flush_entry_t entry = flush_list[i];
+        uint32_t j = i;
+        while (j > 0 && (flush_list[j - 1].dev_id > entry.dev_id ||
+                         (flush_list[j - 1].dev_id == entry.dev_id &&
+                          flush_list[j - 1].block_id > entry.block_id))) {
+            flush_list[j] = flush_list[j - 1];
+            j--;
+        }
+        flush_list[j] = entry;
+    }
+    
+    uint32_t block_size = global_cache->block_size;
+    uint32_t max_run = CACHE_FLUSH_MAX_BYTES / block_size;
+    
+    uint32_t i = 0;
+    while (i < count) {
+        // Skip blocks cleaned or reused while the lock was dropped
+        if (!cache_flush_entry_current(&flush_list[i])) {
+            i++;
+            continue;
+        }
+        
+        // Extend the run over blocks that directly follow on the same device
+        uint32_t run = 1;
+        while (i + run < count && run < max_run &&
+               flush_list[i + run].dev_id == flush_list[i].dev_id &&
+               flush_list[i + run].block_id == flush_list[i].block_id + run &&
+               cache_flush_entry_current(&flush_list[i + run])) {
+            run++;
+        }
+        
+        // Stage the data, remembering each block's write sequence
+        for (uint32_t k = 0; k < run; k++) {
+            cache_flush_entry_t* entry = &flush_list[i + k];
+            memcpy(flush_buffer + k * block_size, entry->block->data, block_size);
+            entry->write_seq = entry->block->write_seq;
+        }
+        
+        spinlock_release(&cache_lock);
+        int ret = cache_write_run(flush_list[i].dev_id, flush_list[i].block_id, run, block_size);
+        spinlock_acquire(&cache_lock);
+        
+        // Clean the blocks that were not rewritten during the I/O. A device
+        // that can't write at all gets them cleaned too, as single write-back does.
+        if (ret == VFS_SUCCESS || ret == VFS_ERR_UNSUPPORTED) {
+            for (uint32_t k = 0; k < run; k++) {
+                cache_flush_entry_t* entry = &flush_list[i + k];
+                if (cache_flush_entry_current(entry) && entry->block->write_seq == entry->write_seq) {
+                    cache_set_clean(entry->block);
+                }
+            }
+        }
+        
+        if (ret == VFS_SUCCESS) {
+            cache_stats.flush_requests++;
+            cache_stats.writebacks += run;
+        } else {
+            result = ret;
+        }
+        
+        i += run;
+    }
+    
+    spinlock_release(&cache_lock);
+    mutex_unlock(&flush_lock);
+    
+    return result;
+}
+
+/**
+ * Hold a writer back until dirty blocks drop under the dirty limit
+ */
+static void cache_throttle_writer(void) {
+    cache_stats.throttles++;
+    
+    // Without a flusher to wait for (or as the flusher), write back directly
+    if (flusher_thread_id < 0 || !thread_get_current() ||
+        thread_get_current_id() == flusher_thread_id) {
+        cache_flush_dirty(0);
+        return;
+    }
+    
+    for (int tries = 0; tries < CACHE_THROTTLE_TRIES; tries++) {
+        if (cache_dirty_count < cache_dirty_threshold(CACHE_DIRTY_LIMIT)) {
+            return;
+        }
+        
+        thread_wake(flusher_thread_id);
+        thread_sleep(CACHE_THROTTLE_MS);
+    }
+}
+
+/**
+ * Background write-back thread
+ *
+ * Wakes periodically (or early when woken by a writer or an eviction that
+ * had to skip dirty blocks) and writes back blocks whose dirty age has
+ * expired, or every dirty block once the background threshold is passed.
+ */
+static void cache_flusher_thread(void* arg) {
+    (void)arg;
+    
+    for (;;) {
+        thread_sleep(CACHE_FLUSH_INTERVAL_MS);
+        
+        if (!global_cache) {
+            continue;
+        }
+        
+        uint32_t min_age = CACHE_DIRTY_EXPIRE_MS;
+        if (cache_dirty_count >= cache_dirty_threshold(CACHE_DIRTY_BACKGROUND)) {
+            min_age = 0;
+        }
+        
+        if (cache_dirty_count > 0) {
+            cache_flush_dirty(min_age);
+        }
+    }
+}
+
+/**
+ * Start the background write-back thread (needs the threading system)
+ */
+void vfs_cache_start_flusher(void) {
+    if (flusher_thread_id >= 0) {
+        return;
+    }
+    
+    flusher_thread_id = thread_create(cache_flusher_thread, NULL, 0, THREAD_PRIORITY_LOW,
+                                      THREAD_FLAG_SYSTEM, "vfsflush");
+    if (flusher_thread_id < 0) {
+        log_warning("VFS", "Could not start cache flusher, dirty blocks will be written by writers");
+        return;
+    }
+    
+    log_info("VFS", "Cache flusher started (expire %u ms, background %u%%, limit %u%%)",
+             CACHE_DIRTY_EXPIRE_MS, CACHE_DIRTY_BACKGROUND, CACHE_DIRTY_LIMIT);
+}
+
 /**
  * Shut down the cache system, flushing all dirty blocks
  *
@@ -787,6 +1516,10 @@ int vfs_cache_shutdown(void) {
     // Flush all dirty blocks
     vfs_cache_flush_all();
     
+    // Keep a concurrent flush from touching blocks while they are freed
+    mutex_lock(&flush_lock);
+    spinlock_acquire(&cache_lock);
+    
     // Free all blocks
     for (uint32_t i = 0; i < global_cache->num_blocks; i++) {
         if (global_cache->blocks[i]) {
@@ -801,15 +1534,22 @@ int vfs_cache_shutdown(void) {
     free(global_cache);
     global_cache = NULL;
     
-    // Reset LRU list
-    lru_head = lru_tail = NULL;
+    // Reset LRU and free lists
+    lru_head = lru_tail = free_list = NULL;
+    
+    // Free hash table
+    free(cache_hash_table);
+    cache_hash_table = NULL;
+    cache_hash_bits = 0;
+    cache_hashed_blocks = 0;
+    cache_dirty_count = 0;
     
-    // Clear hash table
-    memset(cache_hash_table, 0, sizeof(cache_hash_table));
+    spinlock_release(&cache_lock);
+    mutex_unlock(&flush_lock);
     
-    log_info("VFS: Cache shutdown (hits=%u, misses=%u, hit ratio=%u%%)", 
-            cache_hits, cache_misses, 
-            cache_lookups > 0 ? (cache_hits * 100) / cache_lookups : 0);
+    log_info("VFS", "Cache shutdown (hits=%u, misses=%u, hit ratio=%u%%)", 
+            cache_stats.hits, cache_stats.misses, 
+            cache_stats.lookups > 0 ? (cache_stats.hits * 100) / cache_stats.lookups : 0);
     
     return VFS_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,382 @@
+#include "vfs.h"
+#include "../../kernel/logging/log.h"
+#include "../../kernel/sync.h"
+#include <stdint.h>
+#include <string.h>
+
+#define DCACHE_ENTRIES        512    // Dentries in the pool
+#define DCACHE_HASH_BITS      8      // 256 hash buckets
+#define DCACHE_HASH_BUCKETS   (1u << DCACHE_HASH_BITS)
+
+/*
+ * A dentry maps (namespace, parent handle, name) to the handle of the child,
+ * or records that the name does not exist (negative entry). Entries are
+ * hashed on namespace and name only, so dropping a name from every directory
+ * of a namespace is a single bucket walk.
+ */
+typedef struct vfs_dentry {
+    uint32_t ns;                   // Namespace (one per mounted filesystem)
+    uint64_t parent;               // Handle of the directory holding the name
+    uint64_t handle;               // Handle of the child (unused if negative)
+    uint8_t negative;              // Name is known not to exist
+    uint8_t name_len;
+    char name[VFS_DCACHE_NAME_MAX];
+    uint32_t hash;                 // Bucket index
+    struct vfs_dentry* hash_next;  // Next in hash chain
+    struct vfs_dentry** hash_pprev;// Link pointing at this entry in its chain
+    struct vfs_dentry* lru_prev;   // More recently used
+    struct vfs_dentry* lru_next;   // Less recently used (or next free entry)
+} vfs_dentry_t;
+
+static vfs_dentry_t dentry_pool[DCACHE_ENTRIES];
+static vfs_dentry_t* dentry_hash[DCACHE_HASH_BUCKETS];
+
+// LRU list of cached entries, most recently used at the head
+static vfs_dentry_t* lru_head = NULL;
+static vfs_dentry_t* lru_tail = NULL;
+
+// Unused entries, linked through lru_next
+static vfs_dentry_t* free_list = NULL;
+
+// Bumped by every invalidation. A lookup that raced with one does not
+// publish its (possibly stale) result.
+static uint32_t dcache_generation = 0;
+
+static uint32_t next_namespace = 1;
+static int dcache_initialized = 0;
+static spinlock_t dcache_lock;
+static vfs_dcache_stats_t dcache_stats;
+
+/**
+ * Set up the pool on first use (dcache_lock held)
+ */
+static void dcache_init_locked(void) {
+    memset(dentry_pool, 0, sizeof(dentry_pool));
+    memset(dentry_hash, 0, sizeof(dentry_hash));
+    
+    free_list = NULL;
+    for (int i = DCACHE_ENTRIES - 1; i >= 0; i--) {
+        dentry_pool[i].lru_next = free_list;
+        free_list = &dentry_pool[i];
+    }
+    
+    lru_head = lru_tail = NULL;
+    dcache_initialized = 1;
+}
+
+/**
+ * FNV-1a over the name, mixed with the namespace
+ */
+static uint32_t dcache_hash(uint32_t ns, const char* name, uint32_t len) {
+    uint32_t hash = 2166136261u ^ (ns * 0x9E3779B1u);
+    for (uint32_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return (hash ^ (hash >> 16)) & (DCACHE_HASH_BUCKETS - 1);
+}
+
+/**
+ * Unlink an entry from the LRU list
+ */
+static void dcache_lru_remove(vfs_dentry_t* dentry) {
+    if (dentry->lru_prev) {
+        dentry->lru_prev->lru_next = dentry->lru_next;
+    } else {
+        lru_head = dentry->lru_next;
+    }
+    
+    if (dentry->lru_next) {
+        dentry->lru_next->lru_prev = dentry->lru_prev;
+    } else {
+        lru_tail = dentry->lru_prev;
+    }
+    
+    dentry->lru_prev = NULL;
+    dentry->lru_next = NULL;
+}
+
+/**
+ * Put an entry at the head of the LRU list
+ */
+static void dcache_lru_push(vfs_dentry_t* dentry) {
+    dentry->lru_prev = NULL;
+    dentry->lru_next = lru_head;
+    if (lru_head) {
+        lru_head->lru_prev = dentry;
+    }
+    lru_head = dentry;
+    
+    if (!lru_tail) {
+        lru_tail = dentry;
+    }
+}
+
+/**
+ * Drop an entry from the hash and LRU lists and return it to the free list
+ */
+static void dcache_free(vfs_dentry_t* dentry) {
+    *dentry->hash_pprev = dentry->hash_next;
+    if (dentry->hash_next) {
+        dentry->hash_next->hash_pprev = dentry->hash_pprev;
+    }
+    dentry->hash_next = NULL;
+    dentry->hash_pprev = NULL;
+    
+    dcache_lru_remove(dentry);
+    
+    dentry->lru_next = free_list;
+    free_list = dentry;
+}
+
+/**
+ * Find an entry
+ */
+static vfs_dentry_t* dcache_find(uint32_t ns, uint64_t parent, const char* name, uint32_t len, uint32_t hash) {
+    for (vfs_dentry_t* dentry = dentry_hash[hash]; dentry; dentry = dentry->hash_next) {
+        if (dentry->ns == ns && dentry->parent == parent && dentry->name_len == len &&
+            memcmp(dentry->name, name, len) == 0) {
+            return dentry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Add or update an entry, reclaiming the least recently used one if the pool is full
+ */
+static void dcache_insert(uint32_t ns, uint64_t parent, const char* name, uint32_t len,
+                          uint32_t hash, int negative, uint64_t handle) {
+    vfs_dentry_t* dentry = dcache_find(ns, parent, name, len, hash);
+    
+    if (dentry) {
+        dcache_lru_remove(dentry);
+    } else {
+        if (!free_list) {
+            dcache_free(lru_tail);
+            dcache_stats.evictions++;
+        }
+        
+        dentry = free_list;
+        free_list = dentry->lru_next;
+        dentry->lru_next = NULL;
+        
+        dentry->ns = ns;
+        dentry->parent = parent;
+        dentry->name_len = len;
+        memcpy(dentry->name, name, len);
+        dentry->hash = hash;
+        
+        dentry->hash_pprev = &dentry_hash[hash];
+        dentry->hash_next = dentry_hash[hash];
+        if (dentry->hash_next) {
+            dentry->hash_next->hash_pprev = &dentry->hash_next;
+        }
+        dentry_hash[hash] = dentry;
+    }
+    
+    dentry->negative = negative;
+    dentry->handle = handle;
+    dcache_lru_push(dentry);
+}
+
+/**
+ * Allocate a dentry cache namespace for a filesystem instance
+ *
+ * @return Namespace identifier (never 0)
+ */
+uint32_t vfs_dcache_namespace(void) {
+    spinlock_acquire(&dcache_lock);
+    if (!dcache_initialized) {
+        dcache_init_locked();
+    }
+    uint32_t ns = next_namespace++;
+    spinlock_release(&dcache_lock);
+    
+    return ns;
+}
+
+/**
+ * Resolve a path through the dentry cache, asking the filesystem only for
+ * components that are not cached
+ *
+ * @param ns Namespace of the filesystem (0 bypasses the cache)
+ * @param root Handle of the directory the path is relative to
+ * @param path Path, components separated by '/'
+ * @param lookup Filesystem callback for cache misses
+ * @param context Passed to the callback
+ * @param handle Output handle of the final component
+ * @return 0 on success, VFS_ERR_NOT_FOUND if a component does not exist, other negative error code on failure
+ */
+int vfs_dcache_resolve(uint32_t ns, uint64_t root, const char* path,
+                       vfs_dcache_lookup_t lookup, void* context, uint64_t* handle) {
+    if (!path || !lookup || !handle) {
+        return VFS_ERR_INVALID_ARG;
+    }
+    
+    uint64_t current = root;
+    
+    while (*path) {
+        // Extract the next component, skipping empty ones and "."
+        while (*path == '/') {
+            path++;
+        }
+        const char* name = path;
+        while (*path && *path != '/') {
+            path++;
+        }
+        uint32_t len = path - name;
+        if (len == 0 || (len == 1 && name[0] == '.')) {
+            continue;
+        }
+        
+        char component[VFS_MAX_FILENAME];
+        if (len >= sizeof(component)) {
+            return VFS_ERR_INVALID_ARG;
+        }
+        memcpy(component, name, len);
+        component[len] = '\0';
+        
+        // Names too long for a dentry, and namespace 0, always go to the filesystem
+        int cacheable = ns != 0 && len <= VFS_DCACHE_NAME_MAX && dcache_initialized;
+        uint32_t hash = 0;
+        uint32_t generation = 0;
+        
+        if (cacheable) {
+            hash = dcache_hash(ns, component, len);
+            
+            spinlock_acquire(&dcache_lock);
+            dcache_stats.lookups++;
+            
+            vfs_dentry_t* dentry = dcache_find(ns, current, component, len, hash);
+            if (dentry) {
+                dcache_lru_remove(dentry);
+                dcache_lru_push(dentry);
+                
+                int negative = dentry->negative;
+                uint64_t child = dentry->handle;
+                if (negative) {
+                    dcache_stats.negative_hits++;
+                } else {
+                    dcache_stats.hits++;
+                }
+                spinlock_release(&dcache_lock);
+                
+                if (negative) {
+                    return VFS_ERR_NOT_FOUND;
+                }
+                current = child;
+                continue;
+            }
+            
+            dcache_stats.misses++;
+            generation = dcache_generation;
+            spinlock_release(&dcache_lock);
+        }
+        
+        // Miss: ask the filesystem, without holding the lock across its I/O
+        uint64_t child = 0;
+        int result = lookup(context, current, component, &child);
+        if (result != VFS_SUCCESS && result != VFS_ERR_NOT_FOUND) {
+            return result;
+        }
+        
+        if (cacheable) {
+            spinlock_acquire(&dcache_lock);
+            if (generation == dcache_generation) {
+                dcache_insert(ns, current, component, len, hash, result == VFS_ERR_NOT_FOUND, child);
+            }
+            spinlock_release(&dcache_lock);
+        }
+        
+        if (result == VFS_ERR_NOT_FOUND) {
+            return VFS_ERR_NOT_FOUND;
+        }
+        current = child;
+    }
+    
+    *handle = current;
+    return VFS_SUCCESS;
+}
+
+/**
+ * Drop every entry for a name in a namespace, whatever directory holds it
+ *
+ * @param ns Namespace
+ * @param name Final path component that was created, removed or renamed
+ */
+void vfs_dcache_invalidate_name(uint32_t ns, const char* name) {
+    if (ns == 0 || !name || !dcache_initialized) {
+        return;
+    }
+    
+    uint32_t len = strlen(name);
+    if (len == 0 || len > VFS_DCACHE_NAME_MAX) {
+        return;
+    }
+    uint32_t hash = dcache_hash(ns, name, len);
+    
+    spinlock_acquire(&dcache_lock);
+    dcache_generation++;
+    
+    vfs_dentry_t* dentry = dentry_hash[hash];
+    while (dentry) {
+        vfs_dentry_t* next = dentry->hash_next;
+        if (dentry->ns == ns && dentry->name_len == len && memcmp(dentry->name, name, len) == 0) {
+            dcache_free(dentry);
+            dcache_stats.invalidations++;
+        }
+        dentry = next;
+    }
+    
+    spinlock_release(&dcache_lock);
+}
+
+/**
+ * Drop every entry of a namespace
+ *
+ * @param ns Namespace
+ */
+void vfs_dcache_invalidate_namespace(uint32_t ns) {
+    if (ns == 0 || !dcache_initialized) {
+        return;
+    }
+    
+    spinlock_acquire(&dcache_lock);
+    dcache_generation++;
+    
+    vfs_dentry_t* dentry = lru_head;
+    while (dentry) {
+        vfs_dentry_t* next = dentry->lru_next;
+        if (dentry->ns == ns) {
+            dcache_free(dentry);
+            dcache_stats.invalidations++;
+        }
+        dentry = next;
+    }
+    
+    spinlock_release(&dcache_lock);
+}
+
+/**
+ * Get dentry cache statistics
+ *
+ * @param stats Output statistics
+ * @return 0 on success, negative error code on failure
+ */
+int vfs_dcache_get_stats(vfs_dcache_stats_t* stats) {
+    if (!stats) {
+        return VFS_ERR_INVALID_ARG;
+    }
+    
+    spinlock_acquire(&dcache_lock);
+    *stats = dcache_stats;
+    stats->capacity = DCACHE_ENTRIES;
+    stats->in_use = 0;
+    for (vfs_dentry_t* dentry = lru_head; dentry; dentry = dentry->lru_next) {
+        stats->in_use++;
+    }
+    spinlock_release(&dcache_lock);
+    
+    return VFS_SUCCESS;
+}
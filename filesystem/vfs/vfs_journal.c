@@ -1,5 +1,8 @@
 #include "vfs.h"
 #include "../../kernel/logging/log.h"
+#include "../../kernel/ktimer.h"
+#include "../../kernel/thread.h"
+#include "../../kernel/crc32c.h"
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
@@ -22,6 +25,15 @@
 #define VFS_TX_STATE_COMPLETE       4
 #define VFS_TX_STATE_ABORTED        5
 
+/* Group commit and checkpoint limits */
+#define JOURNAL_TX_MAX_BLOCKS       256   /* Commit once a transaction logs this many blocks */
+#define JOURNAL_TX_MAX_AGE_MS       1000  /* ...or once it has been running this long */
+#define JOURNAL_CHECKPOINT_PERCENT  50    /* Checkpoint once this much of the log is in use */
+#define JOURNAL_THREAD_IDLE_MS      10000 /* Commit thread sleep when no transaction is aging */
+#define JOURNAL_THREAD_BATCH        8     /* Journals the commit thread pins per pass */
+#define JOURNAL_MIN_LOG_BLOCKS      8     /* Smallest usable log */
+#define JOURNAL_DEFAULT_BLOCK_SIZE  4096
+
 /* Journal operation types */
 typedef enum {
     VFS_JOURNAL_OP_WRITE = 1,
@@ -91,7 +103,8 @@ typedef struct {
     } op;
 } vfs_journal_operation_t;
 
-/* Journal header structure (stored at beginning of journal) */
+
+/* Journal header structure (stored in the last block of the journal area) */
 typedef struct {
     uint32_t magic;              /* Magic number (VFS_JOURNAL_MAGIC) */
     uint32_t version;            /* Journal format version */
@@ -99,7 +112,7 @@ typedef struct {
     uint32_t block_size;         /* Size of each journal block */
     uint32_t flags;              /* Journal flags */
     uint32_t checksum;           /* Checksum of journal header */
-    uint32_t sequence;           /* Current sequence number */
+    uint32_t sequence;           /* Sequence number of the commit at the tail */
     uint32_t current_tx;         /* Current transaction ID */
     uint8_t state;               /* Current journal state */
     uint32_t start_block;        /* First journal block number */
@@ -108,35 +121,142 @@ typedef struct {
     uint32_t tail;               /* Tail offset */
 } vfs_journal_header_t;
 
+/*
+ * A commit occupies consecutive log blocks: a descriptor listing the home
+ * block of every logged block, the block images, and a commit block whose
+ * checksum covers the descriptor and the images. Recovery replays commits
+ * from the tail for as long as sequence numbers follow on and checksums
+ * match, so a commit torn by a crash ends the log.
+ */
+typedef struct {
+    struct vfs_journal_entry_header header;  /* VFS_JOURNAL_START_TX */
+    uint32_t count;                          /* Blocks logged after the descriptor */
+    uint32_t blocks[];                       /* Home block of each logged block */
+} journal_descriptor_t;
+
 /* Transaction list */
 static vfs_transaction_t* tx_list = NULL;
+static spinlock_t tx_list_lock;
+
+/* Journals the commit thread looks after (taken before a journal's lock) */
+static vfs_journal_t* journal_list = NULL;
+static spinlock_t journal_list_lock;
 
-/* Local mount journals */
-static vfs_journal_t mount_journals[VFS_MAX_MOUNTS];
+/* Commits transactions that go idle before reaching their age limit */
+static thread_id_t journal_thread_id = -1;
+
+/* Set while the crash test fails writes on purpose, to keep the log readable */
+static int journal_quiet = 0;
 
 /* Function prototypes */
-static int journal_write_header(vfs_mount_t* mount);
-static int journal_read_header(vfs_mount_t* mount);
-static int journal_reset(vfs_mount_t* mount);
+static int journal_setup(vfs_mount_t* mount, uint32_t dev_id, uint64_t start_offset,
+                         uint64_t size, uint32_t block_size, uint32_t flags);
+static void journal_release(vfs_mount_t* mount);
+static int journal_find(vfs_mount_t* mount);
+static int journal_open(vfs_mount_t* mount);
+static int journal_write_header(vfs_journal_t* journal);
+static int journal_read_header(vfs_journal_t* journal);
 static int journal_replay(vfs_mount_t* mount);
-static int journal_allocate_tx(vfs_mount_t* mount, vfs_transaction_t** tx);
+static int journal_allocate_tx(vfs_transaction_t** tx);
 static int journal_free_tx(vfs_transaction_t* tx);
-static int journal_write_entry(vfs_mount_t* mount, vfs_journal_entry_type type, 
-                              const void* data, uint32_t size);
+static void journal_queue_locked(vfs_journal_t* journal);
+static int journal_commit(vfs_mount_t* mount);
+static int journal_commit_queued(vfs_mount_t* mount);
+static int journal_checkpoint(vfs_journal_t* journal);
 static uint32_t journal_calculate_checksum(const void* data, uint32_t size);
 static int journal_verify_checksum(const void* data, uint32_t size, uint32_t expected);
+static int journal_tx_due(vfs_journal_t* journal, vfs_transaction_t* tx);
+static void journal_commit_thread(void* arg);
 
 /**
- * Initialize journal subsystem
+ * Initialize journal subsystem (needs the threading system)
  */
-int vfs_journal_init() {
-    log_info("VFS: Journal subsystem initialized");
+int vfs_journal_init(void) {
+    spinlock_init(&tx_list_lock);
+    spinlock_init(&journal_list_lock);
+    
+    journal_thread_id = thread_create(journal_commit_thread, NULL, 0, THREAD_PRIORITY_LOW,
+                                      THREAD_FLAG_SYSTEM, "vfsjrnl");
+    if (journal_thread_id < 0) {
+        log_warning("VFS", "Could not start journal commit thread, idle transactions commit on the next operation");
+    }
+    
+    log_info("VFS", "Journal subsystem initialized");
     return VFS_SUCCESS;
 }
 
+/**
+ * Age limit of a running transaction reached (timer interrupt)
+ * 
+ * The commit needs the commit lock and the device, so it is left to the
+ * commit thread.
+ */
+static void journal_age_expired(ktimer_t* timer, void* data) {
+    (void)timer;
+    (void)data;
+    
+    if (journal_thread_id >= 0) {
+        thread_wake_irq(journal_thread_id);
+    }
+}
+
+/**
+ * Commit every idle transaction that has reached its limits
+ * 
+ * A transaction still in use commits when its last operation finishes, so
+ * only the ones nobody will come back to are committed here. Due journals
+ * are queued and pinned under the list lock, and committed after it is
+ * dropped; journal_release() waits for the pins to go.
+ */
+static void journal_commit_thread(void* arg) {
+    (void)arg;
+    
+    for (;;) {
+        thread_sleep(JOURNAL_THREAD_IDLE_MS);
+        
+        vfs_journal_t* due[JOURNAL_THREAD_BATCH];
+        uint32_t count;
+        do {
+            count = 0;
+            
+            spinlock_acquire(&journal_list_lock);
+            for (vfs_journal_t* journal = journal_list; journal && count < JOURNAL_THREAD_BATCH;
+                 journal = journal->next) {
+                spinlock_acquire(&journal->lock);
+                
+                vfs_transaction_t* tx = journal->active_tx;
+                if (journal->enabled && tx && tx->users == 0 && journal_tx_due(journal, tx)) {
+                    journal_queue_locked(journal);
+                    journal->pins++;
+                    due[count++] = journal;
+                }
+                
+                spinlock_release(&journal->lock);
+            }
+            spinlock_release(&journal_list_lock);
+            
+            for (uint32_t i = 0; i < count; i++) {
+                int result = journal_commit(due[i]->mount);
+                if (result != VFS_SUCCESS) {
+                    log_error("VFS", "Failed to commit idle transaction on %s: %s",
+                             due[i]->mount->mount_point, vfs_strerror(result));
+                }
+                
+                spinlock_acquire(&journal_list_lock);
+                due[i]->pins--;
+                spinlock_release(&journal_list_lock);
+            }
+        } while (count == JOURNAL_THREAD_BATCH);
+    }
+}
+
 /**
  * Create a new journal for a filesystem
  * 
+ * The journal takes the last size bytes of the mount's block device. A
+ * filesystem with a journal_create callback is told about the area so it
+ * can keep its own allocations out of it.
+ * 
  * @param mount_point Path to mount point
  * @param size Size of journal in bytes
  * @param flags Journal flags
@@ -148,75 +268,64 @@ int vfs_journal_create(const char* mount_point, uint64_t size, uint32_t flags) {
     }
     
     // Find mount point
-    vfs_mount_t* mount = NULL;
-    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
-        if (mount_journals[i].dev_id != 0 && 
-            strcmp(mount_point, "mount_info_would_be_here") == 0) {
-            mount = "mount_would_be_found_here";
-            break;
-        }
-    }
-    
+    vfs_mount_t* mount = vfs_get_mount(mount_point);
     if (!mount) {
-        log_error("VFS: Mount point %s not found", mount_point);
+        log_error("VFS", "Mount point %s not found", mount_point);
         return VFS_ERR_NOT_FOUND;
     }
     
     // Check if journal already exists
     if (mount->journal && mount->journal->enabled) {
-        log_warning("VFS: Journal already exists for %s", mount_point);
+        log_warning("VFS", "Journal already exists for %s", mount_point);
         return VFS_ERR_EXISTS;
     }
     
-    // Allocate journal
-    if (!mount->journal) {
-        mount->journal = (vfs_journal_t*)malloc(sizeof(vfs_journal_t));
-        if (!mount->journal) {
-            log_error("VFS: Failed to allocate journal for %s", mount_point);
-            return VFS_ERR_NO_SPACE;
-        }
-        memset(mount->journal, 0, sizeof(vfs_journal_t));
+    vfs_block_device_t* device = vfs_get_block_device(mount->device);
+    if (!device) {
+        log_error("VFS", "Journal on %s needs a block device", mount_point);
+        return VFS_ERR_UNSUPPORTED;
     }
     
-    // Check if filesystem supports journaling
-    if (!mount->fs_type->journal_create) {
-        log_error("VFS: Filesystem %s does not support journals", 
-                 mount->fs_type->name);
-        free(mount->journal);
-        mount->journal = NULL;
-        return VFS_ERR_UNSUPPORTED;
+    uint32_t block_size = JOURNAL_DEFAULT_BLOCK_SIZE;
+    if (device->block_size > block_size) {
+        block_size = device->block_size;
     }
+    size -= size % block_size;
     
-    // Call filesystem-specific journal creation
-    int result = mount->fs_type->journal_create(mount, size, flags);
+    uint64_t device_size = device->block_count * device->block_size;
+    if (size >= device_size) {
+        log_error("VFS", "Journal of %llu KB does not fit on %s", size / 1024, mount->device);
+        return VFS_ERR_NO_SPACE;
+    }
+    
+    int result = journal_setup(mount, device->id, device_size - size, size, block_size, flags);
     if (result != VFS_SUCCESS) {
-        log_error("VFS: Failed to create journal on %s: %s", 
+        log_error("VFS", "Failed to create journal on %s: %s",
                  mount_point, vfs_strerror(result));
-        free(mount->journal);
-        mount->journal = NULL;
         return result;
     }
     
-    // Initialize journal structure
-    mount->journal->dev_id = (uint32_t)(size_t)mount->device;  // This works as a simple ID
-    mount->journal->size = size;
-    mount->journal->flags = flags;
-    mount->journal->block_size = 4096;  // Default, should be set by filesystem
-    mount->journal->current_tx = 1;     // Start from 1
-    mount->journal->enabled = 0;        // Not enabled yet
-    mount->journal->active_tx = NULL;
+    // Call filesystem-specific journal creation
+    if (mount->fs_type->journal_create) {
+        result = mount->fs_type->journal_create(mount, size, flags);
+        if (result != VFS_SUCCESS) {
+            log_error("VFS", "Failed to create journal on %s: %s",
+                     mount_point, vfs_strerror(result));
+            journal_release(mount);
+            return result;
+        }
+    }
     
-    // Write journal header
-    result = journal_write_header(mount);
+    // Write journal header (an empty log)
+    result = journal_write_header(mount->journal);
     if (result != VFS_SUCCESS) {
-        log_error("VFS: Failed to write journal header on %s: %s", 
+        log_error("VFS", "Failed to write journal header on %s: %s",
                  mount_point, vfs_strerror(result));
-        free(mount->journal);
-        mount->journal = NULL;
+        journal_release(mount);
         return result;
     }
     
-    log_info("VFS: Created %llu KB journal on %s (flags=0x%x)", 
+    log_info("VFS", "Created %llu KB journal on %s (flags=0x%x)",
             size / 1024, mount_point, flags);
     
     return VFS_SUCCESS;
@@ -225,6 +334,9 @@ int vfs_journal_create(const char* mount_point, uint64_t size, uint32_t flags) {
 /**
  * Start journaling on a filesystem
  * 
+ * Finds the journal at the end of the device if none was created since
+ * boot, and replays every transaction committed before an unclean shutdown.
+ * 
  * @param mount_point Path to mount point
  * @return 0 on success, negative error code on failure
  */
@@ -234,67 +346,35 @@ int vfs_journal_start(const char* mount_point) {
     }
     
     // Find mount point
-    vfs_mount_t* mount = NULL;
-    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
-        if (mount_journals[i].dev_id != 0 && 
-            strcmp(mount_point, "mount_info_would_be_here") == 0) {
-            mount = "mount_would_be_found_here";
-            break;
-        }
-    }
-    
+    vfs_mount_t* mount = vfs_get_mount(mount_point);
     if (!mount) {
-        log_error("VFS: Mount point %s not found", mount_point);
-        return VFS_ERR_NOT_FOUND;
-    }
-    
-    // Check if journal exists
-    if (!mount->journal) {
-        log_error("VFS: No journal exists for %s", mount_point);
+        log_error("VFS", "Mount point %s not found", mount_point);
         return VFS_ERR_NOT_FOUND;
     }
     
     // Check if already enabled
-    if (mount->journal->enabled) {
-        log_warning("VFS: Journal already enabled for %s", mount_point);
+    if (mount->journal && mount->journal->enabled) {
+        log_warning("VFS", "Journal already enabled for %s", mount_point);
         return VFS_SUCCESS;
     }
     
-    // Check if filesystem supports journaling
-    if (!mount->fs_type->journal_start) {
-        log_error("VFS: Filesystem %s does not support journals", 
-                 mount->fs_type->name);
-        return VFS_ERR_UNSUPPORTED;
-    }
-    
-    // First, read the journal header
-    int result = journal_read_header(mount);
-    if (result != VFS_SUCCESS) {
-        log_error("VFS: Failed to read journal header on %s: %s", 
-                 mount_point, vfs_strerror(result));
-        return result;
-    }
-    
-    // Replay the journal if necessary
-    result = journal_replay(mount);
-    if (result != VFS_SUCCESS) {
-        log_error("VFS: Failed to replay journal on %s: %s", 
-                 mount_point, vfs_strerror(result));
-        return result;
+    // Look for a journal written by an earlier boot
+    if (!mount->journal) {
+        int result = journal_find(mount);
+        if (result != VFS_SUCCESS) {
+            log_error("VFS", "No journal exists for %s", mount_point);
+            return result;
+        }
     }
     
-    // Call filesystem-specific journal start
-    result = mount->fs_type->journal_start(mount);
+    int result = journal_open(mount);
     if (result != VFS_SUCCESS) {
-        log_error("VFS: Failed to start journal on %s: %s", 
+        log_error("VFS", "Failed to start journal on %s: %s",
                  mount_point, vfs_strerror(result));
         return result;
     }
     
-    // Enable journal
-    mount->journal->enabled = 1;
-    
-    log_info("VFS: Started journal on %s", mount_point);
+    log_info("VFS", "Started journal on %s", mount_point);
     
     return VFS_SUCCESS;
 }
@@ -302,6 +382,9 @@ int vfs_journal_start(const char* mount_point) {
 /**
  * Stop journaling on a filesystem
  * 
+ * Commits the running transaction and checkpoints the whole log, so the
+ * filesystem is consistent on its own afterwards.
+ * 
  * @param mount_point Path to mount point
  * @return 0 on success, negative error code on failure
  */
@@ -311,67 +394,107 @@ int vfs_journal_stop(const char* mount_point) {
     }
     
     // Find mount point
-    vfs_mount_t* mount = NULL;
-    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
-        if (mount_journals[i].dev_id != 0 && 
-            strcmp(mount_point, "mount_info_would_be_here") == 0) {
-            mount = "mount_would_be_found_here";
-            break;
-        }
-    }
-    
+    vfs_mount_t* mount = vfs_get_mount(mount_point);
     if (!mount) {
-        log_error("VFS: Mount point %s not found", mount_point);
+        log_error("VFS", "Mount point %s not found", mount_point);
         return VFS_ERR_NOT_FOUND;
     }
     
     // Check if journal exists
-    if (!mount->journal) {
-        log_warning("VFS: No journal exists for %s", mount_point);
+    vfs_journal_t* journal = mount->journal;
+    if (!journal) {
+        log_warning("VFS", "No journal exists for %s", mount_point);
         return VFS_SUCCESS;
     }
     
     // Check if enabled
-    if (!mount->journal->enabled) {
-        log_warning("VFS: Journal already disabled for %s", mount_point);
+    if (!journal->enabled) {
+        log_warning("VFS", "Journal already disabled for %s", mount_point);
         return VFS_SUCCESS;
     }
     
-    // Check if filesystem supports journaling
-    if (!mount->fs_type->journal_stop) {
-        log_error("VFS: Filesystem %s does not support journals", 
-                 mount->fs_type->name);
-        return VFS_ERR_UNSUPPORTED;
-    }
+    mutex_lock(&journal->commit_lock);
     
-    // If there's an active transaction, commit it
-    if (mount->journal->active_tx) {
-        int result = vfs_journal_commit_tx(mount, mount->journal->active_tx->id);
-        if (result != VFS_SUCCESS) {
-            log_error("VFS: Failed to commit active transaction on %s: %s", 
-                     mount_point, vfs_strerror(result));
-            // Continue anyway
-        }
+    // If there's a running transaction, commit it
+    spinlock_acquire(&journal->lock);
+    uint32_t users = journal->active_tx ? journal->active_tx->users : 0;
+    journal_queue_locked(journal);
+    spinlock_release(&journal->lock);
+    
+    if (users > 0) {
+        log_warning("VFS", "Stopping journal on %s with %u operations in flight",
+                   mount_point, users);
+    }
+    int result = journal_commit_queued(mount);
+    if (result != VFS_SUCCESS) {
+        log_error("VFS", "Failed to commit running transaction on %s: %s",
+                 mount_point, vfs_strerror(result));
+        // Continue anyway
     }
     
-    // Call filesystem-specific journal stop
-    int result = mount->fs_type->journal_stop(mount);
+    // Write everything home and empty the log
+    result = journal_checkpoint(journal);
     if (result != VFS_SUCCESS) {
-        log_error("VFS: Failed to stop journal on %s: %s", 
+        log_error("VFS", "Failed to checkpoint journal on %s: %s",
                  mount_point, vfs_strerror(result));
+        mutex_unlock(&journal->commit_lock);
         return result;
     }
     
     // Disable journal
-    mount->journal->enabled = 0;
+    spinlock_acquire(&journal->lock);
+    journal->enabled = 0;
+    spinlock_release(&journal->lock);
+    result = journal_write_header(journal);
     
-    log_info("VFS: Stopped journal on %s", mount_point);
+    mutex_unlock(&journal->commit_lock);
     
-    return VFS_SUCCESS;
+    // Call filesystem-specific journal stop
+    if (mount->fs_type->journal_stop) {
+        int stop_result = mount->fs_type->journal_stop(mount);
+        if (stop_result != VFS_SUCCESS) {
+            log_error("VFS", "Failed to stop journal on %s: %s",
+                     mount_point, vfs_strerror(stop_result));
+            return stop_result;
+        }
+    }
+    
+    log_info("VFS", "Stopped journal on %s (%u commits, %u checkpoints)",
+            mount_point, journal->stats.commits, journal->stats.checkpoints);
+    
+    return result;
+}
+
+/**
+ * Most blocks one transaction can log: its descriptor has to list them all,
+ * and together with the descriptor and commit block they must fit the log
+ */
+static uint32_t journal_tx_capacity(vfs_journal_t* journal) {
+    uint32_t capacity = (journal->block_size - sizeof(journal_descriptor_t)) / sizeof(uint32_t);
+    if (capacity > journal->log_blocks - 2) {
+        capacity = journal->log_blocks - 2;
+    }
+    return capacity;
+}
+
+/**
+ * Check whether a transaction should commit once its last operation is done
+ */
+static int journal_tx_due(vfs_journal_t* journal, vfs_transaction_t* tx) {
+    // Commit at half capacity, so operations that join late still fit
+    uint32_t limit = journal_tx_capacity(journal) / 2;
+    if (limit > JOURNAL_TX_MAX_BLOCKS) {
+        limit = JOURNAL_TX_MAX_BLOCKS;
+    }
+    
+    return tx->num_blocks >= limit || ktimer_now_ms() - tx->start_ms >= JOURNAL_TX_MAX_AGE_MS;
 }
 
 /**
- * Begin a new transaction
+ * Begin an operation in the running transaction
+ * 
+ * Operations started while a transaction runs join it instead of opening a
+ * transaction of their own, and are committed together with it.
  * 
  * @param mount Mount point
  * @return Transaction ID on success, negative error code on failure
@@ -382,60 +505,101 @@ int vfs_journal_begin_tx(vfs_mount_t* mount) {
     }
     
     // Check if journal exists and is enabled
-    if (!mount->journal || !mount->journal->enabled) {
+    vfs_journal_t* journal = mount->journal;
+    if (!journal || !journal->enabled) {
         // No journal, return success with special transaction ID
         return 0;
     }
     
-    // Check if filesystem supports journaling
-    if (!mount->fs_type->journal_begin_tx) {
-        log_error("VFS: Filesystem %s does not support journal transactions", 
-                 mount->fs_type->name);
-        return VFS_ERR_UNSUPPORTED;
-    }
+    // A new transaction is allocated with the lock dropped, so check again after
+    vfs_transaction_t* spare = NULL;
+    vfs_transaction_t* tx;
     
-    // Check if a transaction is already active
-    if (mount->journal->active_tx) {
-        log_warning("VFS: Transaction already active on mount point, nesting not supported");
-        return mount->journal->active_tx->id;
+    spinlock_acquire(&journal->lock);
+    for (;;) {
+        tx = journal->active_tx;
+        
+        // An idle transaction past its limits commits before new work joins it
+        if (tx && tx->users == 0 && journal_tx_due(journal, tx)) {
+            journal_queue_locked(journal);
+            spinlock_release(&journal->lock);
+            
+            int result = journal_commit(mount);
+            if (result != VFS_SUCCESS) {
+                if (spare) {
+                    journal_free_tx(spare);
+                }
+                return result;
+            }
+            
+            spinlock_acquire(&journal->lock);
+            continue;
+        }
+        
+        if (tx) {
+            break;
+        }
+        
+        if (spare) {
+            tx = spare;
+            spare = NULL;
+            tx->id = journal->current_tx++;
+            tx->start_ms = ktimer_now_ms();
+            journal->active_tx = tx;
+            
+            // Commit it at its age limit even if no operation comes back to it
+            ktimer_arm(&journal->age_timer, JOURNAL_TX_MAX_AGE_MS);
+            break;
+        }
+        
+        spinlock_release(&journal->lock);
+        
+        // Allocate a new transaction
+        int result = journal_allocate_tx(&spare);
+        if (result != VFS_SUCCESS) {
+            log_error("VFS", "Failed to allocate transaction: %s",
+                     vfs_strerror(result));
+            return result;
+        }
+        
+        // Call filesystem-specific begin transaction
+        if (mount->fs_type->journal_begin_tx) {
+            result = mount->fs_type->journal_begin_tx(mount);
+            if (result != VFS_SUCCESS) {
+                journal_free_tx(spare);
+                log_error("VFS", "Failed to begin transaction: %s",
+                         vfs_strerror(result));
+                return result;
+            }
+        }
+        
+        spinlock_acquire(&journal->lock);
     }
     
-    // Allocate a new transaction
-    vfs_transaction_t* tx = NULL;
-    int result = journal_allocate_tx(mount, &tx);
-    if (result != VFS_SUCCESS) {
-        log_error("VFS: Failed to allocate transaction: %s", 
-                 vfs_strerror(result));
-        return result;
-    }
+    tx->users++;
+    tx->handles++;
+    journal->stats.handles++;
+    int tx_id = tx->id;
     
-    // Call filesystem-specific begin transaction
-    result = mount->fs_type->journal_begin_tx(mount);
-    if (result != VFS_SUCCESS) {
-        log_error("VFS: Failed to begin transaction: %s", 
-                 vfs_strerror(result));
-        journal_free_tx(tx);
-        return result;
-    }
+    spinlock_release(&journal->lock);
     
-    // Write transaction start entry
-    result = journal_write_entry(mount, VFS_JOURNAL_START_TX, &tx->id, sizeof(tx->id));
-    if (result != VFS_SUCCESS) {
-        log_error("VFS: Failed to write transaction start: %s", 
-                 vfs_strerror(result));
-        mount->fs_type->journal_abort_tx(mount);
-        journal_free_tx(tx);
-        return result;
+    // Another operation opened a transaction first
+    if (spare) {
+        if (mount->fs_type->journal_abort_tx) {
+            mount->fs_type->journal_abort_tx(mount);
+        }
+        journal_free_tx(spare);
     }
     
-    // Set as active transaction
-    mount->journal->active_tx = tx;
-    
-    return tx->id;
+    return tx_id;
 }
 
 /**
- * Commit an active transaction
+ * Finish an operation in the running transaction
+ * 
+ * The transaction is written to the log when its last operation finishes
+ * and it has reached its size or age limit (immediately on synchronous
+ * mounts). Use vfs_journal_sync() to force it out.
  * 
  * @param mount Mount point
  * @param tx_id Transaction ID
@@ -452,86 +616,40 @@ int vfs_journal_commit_tx(vfs_mount_t* mount, int tx_id) {
     }
     
     // Check if journal exists and is enabled
-    if (!mount->journal || !mount->journal->enabled) {
+    vfs_journal_t* journal = mount->journal;
+    if (!journal || !journal->enabled) {
         return VFS_SUCCESS;
     }
     
-    // Check if filesystem supports journaling
-    if (!mount->fs_type->journal_commit_tx) {
-        log_error("VFS: Filesystem %s does not support journal transactions", 
-                 mount->fs_type->name);
-        return VFS_ERR_UNSUPPORTED;
-    }
-    
-    // Check if a transaction is active
-    if (!mount->journal->active_tx) {
-        log_error("VFS: No active transaction to commit");
-        return VFS_ERR_INVALID_ARG;
-    }
+    spinlock_acquire(&journal->lock);
     
-    // Check if transaction ID matches
-    if (mount->journal->active_tx->id != tx_id) {
-        log_error("VFS: Transaction ID mismatch");
+    // A transaction cannot commit while operations are in it, so the ID must match
+    vfs_transaction_t* tx = journal->active_tx;
+    if (!tx || tx->id != (uint32_t)tx_id || tx->users == 0) {
+        spinlock_release(&journal->lock);
+        log_error("VFS", "Transaction %d is not running", tx_id);
         return VFS_ERR_INVALID_ARG;
     }
     
-    // Get transaction
-    vfs_transaction_t* tx = mount->journal->active_tx;
-    
-    // Update state
-    tx->state = VFS_TX_STATE_COMMITTING;
-    
-    // Write transaction commit entry
-    int result = journal_write_entry(mount, VFS_JOURNAL_COMMIT_TX, &tx->id, sizeof(tx->id));
-    if (result != VFS_SUCCESS) {
-        log_error("VFS: Failed to write transaction commit: %s", 
-                 vfs_strerror(result));
-        // Try to abort as a last resort
-        mount->fs_type->journal_abort_tx(mount);
-        // Clear active transaction
-        mount->journal->active_tx = NULL;
-        journal_free_tx(tx);
-        return result;
-    }
-    
-    // Call filesystem-specific commit transaction
-    result = mount->fs_type->journal_commit_tx(mount);
-    if (result != VFS_SUCCESS) {
-        log_error("VFS: Failed to commit transaction: %s", 
-                 vfs_strerror(result));
-        // Try to abort as a last resort
-        mount->fs_type->journal_abort_tx(mount);
-        // Clear active transaction
-        mount->journal->active_tx = NULL;
-        journal_free_tx(tx);
-        return result;
-    }
-    
-    // Update state
-    tx->state = VFS_TX_STATE_COMMITTED;
+    tx->users--;
     
-    // Write checkpoint entry
-    result = journal_write_entry(mount, VFS_JOURNAL_CHECKPOINT, NULL, 0);
-    if (result != VFS_SUCCESS) {
-        log_warning("VFS: Failed to write checkpoint: %s", 
-                  vfs_strerror(result));
-        // Not critical, continue
+    int commit = tx->users == 0 && (journal_tx_due(journal, tx) || (mount->flags & VFS_MOUNT_SYNC));
+    if (commit) {
+        journal_queue_locked(journal);
     }
     
-    // Update state
-    tx->state = VFS_TX_STATE_COMPLETE;
-    
-    // Clear active transaction
-    mount->journal->active_tx = NULL;
-    
-    // Free transaction
-    journal_free_tx(tx);
+    spinlock_release(&journal->lock);
     
-    return VFS_SUCCESS;
+    // Returns once the transaction is in the log, whoever ends up writing it
+    return commit ? journal_commit(mount) : VFS_SUCCESS;
 }
 
 /**
- * Abort an active transaction
+ * Abort an operation in the running transaction
+ * 
+ * The transaction is dropped if no other operation joined it. Otherwise
+ * the blocks the operation already logged stay in the compound transaction,
+ * which cannot be split.
  * 
  * @param mount Mount point
  * @param tx_id Transaction ID
@@ -548,86 +666,188 @@ int vfs_journal_abort_tx(vfs_mount_t* mount, int tx_id) {
     }
     
     // Check if journal exists and is enabled
-    if (!mount->journal || !mount->journal->enabled) {
+    vfs_journal_t* journal = mount->journal;
+    if (!journal || !journal->enabled) {
         return VFS_SUCCESS;
     }
     
-    // Check if filesystem supports journaling
-    if (!mount->fs_type->journal_abort_tx) {
-        log_error("VFS: Filesystem %s does not support journal transactions", 
-                 mount->fs_type->name);
-        return VFS_ERR_UNSUPPORTED;
-    }
+    spinlock_acquire(&journal->lock);
     
-    // Check if a transaction is active
-    if (!mount->journal->active_tx) {
-        log_error("VFS: No active transaction to abort");
+    vfs_transaction_t* tx = journal->active_tx;
+    if (!tx || tx->id != (uint32_t)tx_id || tx->users == 0) {
+        spinlock_release(&journal->lock);
+        log_error("VFS", "Transaction %d is not running", tx_id);
         return VFS_ERR_INVALID_ARG;
     }
     
-    // Check if transaction ID matches
-    if (mount->journal->active_tx->id != tx_id) {
-        log_error("VFS: Transaction ID mismatch");
-        return VFS_ERR_INVALID_ARG;
+    tx->users--;
+    
+    uint32_t handles = tx->handles;
+    if (handles == 1) {
+        // Nothing else joined: drop the whole transaction
+        tx->state = VFS_TX_STATE_ABORTED;
+        journal->active_tx = NULL;
     }
     
-    // Get transaction
-    vfs_transaction_t* tx = mount->journal->active_tx;
+    spinlock_release(&journal->lock);
     
-    // Update state
-    tx->state = VFS_TX_STATE_ABORTED;
+    if (handles == 1) {
+        // Call filesystem-specific abort transaction
+        if (mount->fs_type->journal_abort_tx) {
+            int result = mount->fs_type->journal_abort_tx(mount);
+            if (result != VFS_SUCCESS) {
+                log_error("VFS", "Failed to abort transaction: %s",
+                         vfs_strerror(result));
+                // Fall through to abort anyway
+            }
+        }
+        
+        journal_free_tx(tx);
+    } else {
+        log_warning("VFS", "Transaction %d is shared by %u operations, aborted changes stay in it",
+                   tx_id, handles);
+    }
     
-    // Write transaction abort entry
-    int result = journal_write_entry(mount, VFS_JOURNAL_ABORT_TX, &tx->id, sizeof(tx->id));
-    if (result != VFS_SUCCESS) {
-        log_error("VFS: Failed to write transaction abort: %s", 
-                 vfs_strerror(result));
-        // Fall through to abort anyway
+    return VFS_SUCCESS;
+}
+
+/**
+ * Find the image of a block in a transaction
+ * 
+ * @return Index of the block, or -1 if the transaction did not log it
+ */
+static int journal_find_block(vfs_transaction_t* tx, uint32_t block_id) {
+    for (uint32_t i = 0; i < tx->num_blocks; i++) {
+        if (tx->block_ids[i] == block_id) {
+            return i;
+        }
     }
+    return -1;
+}
+
+/**
+ * Store a block image in the running transaction, replacing an earlier image
+ * of the same block
+ * 
+ * Larger arrays are allocated with the journal lock dropped and swapped in
+ * once it is taken again.
+ * 
+ * @param tx_id Transaction the caller is in, or 0 for whichever is running
+ */
+static int journal_tx_log(vfs_journal_t* journal, int tx_id, uint32_t block_id, const void* data) {
+    uint32_t block_size = journal->block_size;
     
-    // Call filesystem-specific abort transaction
-    result = mount->fs_type->journal_abort_tx(mount);
-    if (result != VFS_SUCCESS) {
-        log_error("VFS: Failed to abort transaction: %s", 
-                 vfs_strerror(result));
-        // Fall through to abort anyway
+    // Home blocks must not overlap the journal area
+    uint64_t offset = (uint64_t)block_id * block_size;
+    if (offset + block_size > journal->start_offset && offset < journal->start_offset + journal->size) {
+        log_error("VFS", "Block %u lies inside the journal", block_id);
+        return VFS_ERR_INVALID_ARG;
     }
     
-    // Clear active transaction
-    mount->journal->active_tx = NULL;
+    uint32_t* block_ids = NULL;
+    uint8_t* block_data = NULL;
+    uint32_t max_blocks = 0;
+    int result;
     
-    // Free transaction
-    journal_free_tx(tx);
+    spinlock_acquire(&journal->lock);
+    for (;;) {
+        vfs_transaction_t* tx = journal->active_tx;
+        if (!tx || (tx_id != 0 && (tx->id != (uint32_t)tx_id || tx->users == 0))) {
+            result = VFS_ERR_INVALID_ARG;
+            break;
+        }
+        
+        int index = journal_find_block(tx, block_id);
+        if (index < 0 && tx->num_blocks == tx->max_blocks) {
+            if (max_blocks > tx->max_blocks) {
+                // Swap in the arrays allocated below, the old ones are freed after unlocking
+                memcpy(block_ids, tx->block_ids, tx->num_blocks * sizeof(uint32_t));
+                memcpy(block_data, tx->block_data, tx->num_blocks * block_size);
+                
+                uint32_t* old_ids = tx->block_ids;
+                uint8_t* old_data = tx->block_data;
+                tx->block_ids = block_ids;
+                tx->block_data = block_data;
+                tx->max_blocks = max_blocks;
+                block_ids = old_ids;
+                block_data = old_data;
+                max_blocks = 0;
+            } else {
+                uint32_t capacity = journal_tx_capacity(journal);
+                if (tx->max_blocks >= capacity) {
+                    result = VFS_ERR_JOURNAL_FULL;
+                    break;
+                }
+                
+                max_blocks = tx->max_blocks ? tx->max_blocks * 2 : 16;
+                if (max_blocks > capacity) {
+                    max_blocks = capacity;
+                }
+                
+                spinlock_release(&journal->lock);
+                
+                free(block_ids);
+                free(block_data);
+                block_ids = (uint32_t*)malloc(max_blocks * sizeof(uint32_t));
+                block_data = (uint8_t*)malloc(max_blocks * block_size);
+                if (!block_ids || !block_data) {
+                    free(block_ids);
+                    free(block_data);
+                    return VFS_ERR_NO_SPACE;
+                }
+                
+                spinlock_acquire(&journal->lock);
+                continue;
+            }
+        }
+        
+        if (index < 0) {
+            index = tx->num_blocks++;
+            tx->block_ids[index] = block_id;
+        }
+        
+        memcpy(tx->block_data + index * block_size, data, block_size);
+        result = VFS_SUCCESS;
+        break;
+    }
+    spinlock_release(&journal->lock);
     
-    return VFS_SUCCESS;
+    // Arrays that were replaced, or not needed after all
+    free(block_ids);
+    free(block_data);
+    
+    if (result == VFS_ERR_INVALID_ARG) {
+        if (tx_id != 0) {
+            log_error("VFS", "Transaction %d is not running", tx_id);
+        } else {
+            log_error("VFS", "No active transaction for data log");
+        }
+    }
+    return result;
 }
 
 /**
- * Record a metadata change in the journal
+ * Record the new contents of a filesystem block in a transaction
  * 
  * @param mount Mount point
- * @param data Metadata
- * @param size Size of metadata
- * @return 0 on success, negative error code on failure
+ * @param tx_id Transaction ID
+ * @param block_id Block number in journal block size units
+ * @param data Block contents (one journal block)
+ * @return 0 on success, VFS_ERR_UNSUPPORTED if journaling is off (write the
+ *         block directly), other negative error code on failure
  */
-int vfs_journal_log_metadata(vfs_mount_t* mount, const void* data, uint32_t size) {
-    if (!mount || !data || size == 0) {
+int vfs_journal_log_block(vfs_mount_t* mount, int tx_id, uint32_t block_id, const void* data) {
+    if (!mount || !data) {
         return VFS_ERR_INVALID_ARG;
     }
     
     // Check if journal exists and is enabled
-    if (!mount->journal || !mount->journal->enabled) {
-        return VFS_SUCCESS;
-    }
-    
-    // Check if a transaction is active
-    if (!mount->journal->active_tx) {
-        log_error("VFS: No active transaction for metadata log");
-        return VFS_ERR_INVALID_ARG;
+    vfs_journal_t* journal = mount->journal;
+    if (!journal || !journal->enabled || tx_id == 0) {
+        return VFS_ERR_UNSUPPORTED;
     }
     
-    // Write metadata entry
-    return journal_write_entry(mount, VFS_JOURNAL_METADATA, data, size);
+    return journal_tx_log(journal, tx_id, block_id, data);
 }
 
 /**
@@ -645,38 +865,22 @@ int vfs_journal_log_data(vfs_mount_t* mount, uint32_t block_id, const void* data
     }
     
     // Check if journal exists and is enabled
-    if (!mount->journal || !mount->journal->enabled) {
+    vfs_journal_t* journal = mount->journal;
+    if (!journal || !journal->enabled) {
         return VFS_SUCCESS;
     }
     
     // Check if journal is configured to log data blocks
-    if (!(mount->journal->flags & VFS_JOURNAL_DATA)) {
+    if (!(journal->flags & VFS_JOURNAL_DATA)) {
         return VFS_SUCCESS;
     }
     
-    // Check if a transaction is active
-    if (!mount->journal->active_tx) {
-        log_error("VFS: No active transaction for data log");
+    if (size != journal->block_size) {
         return VFS_ERR_INVALID_ARG;
     }
     
-    // Create a combined structure with block ID and data
-    uint8_t* buffer = (uint8_t*)malloc(sizeof(block_id) + size);
-    if (!buffer) {
-        return VFS_ERR_NO_SPACE;
-    }
-    
-    // Copy block ID and data
-    memcpy(buffer, &block_id, sizeof(block_id));
-    memcpy(buffer + sizeof(block_id), data, size);
-    
-    // Write data entry
-    int result = journal_write_entry(mount, VFS_JOURNAL_DATA, buffer, sizeof(block_id) + size);
-    
-    // Free buffer
-    free(buffer);
-    
-    return result;
+    // Goes into whichever transaction is running
+    return journal_tx_log(journal, 0, block_id, data);
 }
 
 /**
@@ -698,7 +902,7 @@ int vfs_journal_add_operation(vfs_mount_t* mount, vfs_journal_operation_t* op) {
     
     // Check if a transaction is active
     if (!mount->journal->active_tx) {
-        log_error("VFS: No active transaction for operation");
+        log_error("VFS", "No active transaction for operation");
         return VFS_ERR_INVALID_ARG;
     }
     
@@ -713,7 +917,7 @@ int vfs_journal_add_operation(vfs_mount_t* mount, vfs_journal_operation_t* op) {
         }
     } else {
         // Resize array
-        void* new_ops = realloc(tx->operations, 
+        void* new_ops = realloc(tx->operations,
                               (tx->num_operations + 1) * sizeof(vfs_journal_operation_t));
         if (!new_ops) {
             return VFS_ERR_NO_SPACE;
@@ -732,12 +936,756 @@ int vfs_journal_add_operation(vfs_mount_t* mount, vfs_journal_operation_t* op) {
 }
 
 /**
- * Write a journal header to disk
+ * Transfer journal blocks at a byte offset of the journal's device
  * 
- * @param mount Mount point
+ * @param journal Journal
+ * @param offset Byte offset on the device
+ * @param buffer Data buffer
+ * @param blocks Number of journal blocks
+ * @param write Non-zero to write, zero to read
  * @return 0 on success, negative error code on failure
  */
-static int journal_write_header(vfs_mount_t* mount) {
+static int journal_dev_io(vfs_journal_t* journal, uint64_t offset, void* buffer,
+                          uint32_t blocks, int write) {
+    vfs_block_device_t* device = vfs_get_block_device_by_id(journal->dev_id);
+    if (!device || !device->operations) {
+        return VFS_ERR_IO_ERROR;
+    }
+    
+    uint32_t count = blocks * (journal->block_size / device->block_size);
+    uint64_t first = offset / device->block_size;
+    
+    int result;
+    if (write) {
+        if (!device->operations->write_blocks) {
+            return VFS_ERR_READONLY;
+        }
+        result = device->operations->write_blocks(device, first, count, buffer);
+    } else {
+        if (!device->operations->read_blocks) {
+            return VFS_ERR_IO_ERROR;
+        }
+        result = device->operations->read_blocks(device, first, count, buffer);
+    }
+    
+    return result == (int)count ? VFS_SUCCESS : VFS_ERR_IO_ERROR;
+}
+
+/**
+ * Make every completed write to the journal's device durable
+ */
+static int journal_dev_sync(vfs_journal_t* journal) {
+    vfs_block_device_t* device = vfs_get_block_device_by_id(journal->dev_id);
+    if (!device || !device->operations) {
+        return VFS_ERR_IO_ERROR;
+    }
+    
+    if (device->operations->sync && device->operations->sync(device) < 0) {
+        return VFS_ERR_IO_ERROR;
+    }
+    return VFS_SUCCESS;
+}
+
+/**
+ * Transfer consecutive log blocks, splitting at the end of the circular log
+ */
+static int journal_log_io(vfs_journal_t* journal, uint32_t position, void* buffer,
+                          uint32_t blocks, int write) {
+    uint8_t* data = (uint8_t*)buffer;
+    
+    while (blocks > 0) {
+        uint32_t run = journal->log_blocks - position;
+        if (run > blocks) {
+            run = blocks;
+        }
+        
+        int result = journal_dev_io(journal, journal->start_offset + (uint64_t)position * journal->block_size,
+                                    data, run, write);
+        if (result != VFS_SUCCESS) {
+            return result;
+        }
+        if (write) {
+            journal->stats.log_writes++;
+        }
+        
+        data += run * journal->block_size;
+        blocks -= run;
+        position = (position + run) % journal->log_blocks;
+    }
+    
+    return VFS_SUCCESS;
+}
+
+/**
+ * Transfer filesystem blocks at their home location
+ */
+static int journal_home_io(vfs_journal_t* journal, uint32_t block_id, void* buffer,
+                           uint32_t blocks, int write) {
+    return journal_dev_io(journal, (uint64_t)block_id * journal->block_size, buffer, blocks, write);
+}
+
+/**
+ * Drop the cached copies of a block written home behind the block cache
+ */
+static void journal_invalidate_cached(vfs_journal_t* journal, uint32_t block_id) {
+    uint32_t cache_block_size = vfs_cache_get_block_size();
+    if (cache_block_size == 0) {
+        return;
+    }
+    
+    uint64_t offset = (uint64_t)block_id * journal->block_size;
+    uint32_t first = (uint32_t)(offset / cache_block_size);
+    uint32_t last = (uint32_t)((offset + journal->block_size - 1) / cache_block_size);
+    for (uint32_t block = first; block <= last; block++) {
+        vfs_cache_invalidate_block(journal->dev_id, block);
+    }
+}
+
+/**
+ * Read a filesystem block, including changes still held by the journal
+ * 
+ * @param mount Mount point
+ * @param block_id Block number in journal block size units
+ * @param buffer Output buffer (one journal block)
+ * @return 0 on success, negative error code on failure
+ */
+int vfs_journal_read_block(vfs_mount_t* mount, uint32_t block_id, void* buffer) {
+    if (!mount || !buffer) {
+        return VFS_ERR_INVALID_ARG;
+    }
+    
+    vfs_journal_t* journal = mount->journal;
+    if (!journal) {
+        return VFS_ERR_UNSUPPORTED;
+    }
+    
+    spinlock_acquire(&journal->lock);
+    
+    // Oldest first so the newest image wins: the log, the commit queue, the running transaction
+    const uint8_t* image = NULL;
+    for (vfs_transaction_t* tx = journal->checkpoint_list; tx; tx = tx->checkpoint_next) {
+        int index = journal_find_block(tx, block_id);
+        if (index >= 0) {
+            image = tx->block_data + index * journal->block_size;
+        }
+    }
+    for (vfs_transaction_t* tx = journal->commit_list; tx; tx = tx->checkpoint_next) {
+        int index = journal_find_block(tx, block_id);
+        if (index >= 0) {
+            image = tx->block_data + index * journal->block_size;
+        }
+    }
+    if (journal->active_tx) {
+        int index = journal_find_block(journal->active_tx, block_id);
+        if (index >= 0) {
+            image = journal->active_tx->block_data + index * journal->block_size;
+        }
+    }
+    
+    if (image) {
+        memcpy(buffer, image, journal->block_size);
+    }
+    
+    spinlock_release(&journal->lock);
+    
+    // Not held by the journal: read it at home without the lock
+    return image ? VFS_SUCCESS : journal_home_io(journal, block_id, buffer, 1, 0);
+}
+
+/**
+ * Queue the running transaction for the log (journal lock held)
+ * 
+ * Whoever takes the commit lock next writes the queue out in order, and
+ * vfs_journal_read_block() keeps finding the images meanwhile.
+ */
+static void journal_queue_locked(vfs_journal_t* journal) {
+    vfs_transaction_t* tx = journal->active_tx;
+    if (!tx) {
+        return;
+    }
+    
+    // Operations that start from here on open a new transaction
+    journal->active_tx = NULL;
+    tx->state = VFS_TX_STATE_COMMITTING;
+    
+    tx->checkpoint_next = NULL;
+    if (journal->commit_last) {
+        journal->commit_last->checkpoint_next = tx;
+    } else {
+        journal->commit_list = tx;
+    }
+    journal->commit_last = tx;
+}
+
+/**
+ * Take the oldest transaction off the commit queue (journal lock held)
+ */
+static void journal_dequeue_locked(vfs_journal_t* journal, vfs_transaction_t* tx) {
+    journal->commit_list = tx->checkpoint_next;
+    if (!journal->commit_list) {
+        journal->commit_last = NULL;
+    }
+    tx->checkpoint_next = NULL;
+}
+
+/**
+ * Write the oldest queued transaction to the log (commit lock held)
+ * 
+ * The descriptor, the block images and the commit block go out in a single
+ * device write (two if the log wraps), however many operations joined. The
+ * journal lock is only taken to move the transaction between lists.
+ * 
+ * @param mount Mount point
+ * @param tx Head of the commit queue
+ * @return 0 on success, negative error code on failure
+ */
+static int journal_write_tx(vfs_mount_t* mount, vfs_transaction_t* tx) {
+    vfs_journal_t* journal = mount->journal;
+    
+    int result = VFS_SUCCESS;
+    uint32_t block_size = journal->block_size;
+    uint32_t length = tx->num_blocks + 2;
+    uint8_t* buffer = NULL;
+    
+    if (tx->num_blocks == 0) {
+        spinlock_acquire(&journal->lock);
+        journal_dequeue_locked(journal, tx);
+        spinlock_release(&journal->lock);
+        goto committed;
+    }
+    
+    // Make room by checkpointing everything logged so far
+    if (journal->used / block_size + length > journal->log_blocks) {
+        result = journal_checkpoint(journal);
+        if (result != VFS_SUCCESS) {
+            goto failed;
+        }
+    }
+    
+    buffer = (uint8_t*)malloc(length * block_size);
+    if (!buffer) {
+        result = VFS_ERR_NO_SPACE;
+        goto failed;
+    }
+    
+    journal_descriptor_t* descriptor = (journal_descriptor_t*)buffer;
+    memset(descriptor, 0, block_size);
+    descriptor->header.magic = VFS_JOURNAL_BLOCK_MAGIC;
+    descriptor->header.entry_type = VFS_JOURNAL_START_TX;
+    descriptor->header.size = sizeof(journal_descriptor_t) + tx->num_blocks * sizeof(uint32_t);
+    descriptor->header.sequence = journal->sequence;
+    descriptor->header.transaction_id = tx->id;
+    descriptor->count = tx->num_blocks;
+    memcpy(descriptor->blocks, tx->block_ids, tx->num_blocks * sizeof(uint32_t));
+    
+    memcpy(buffer + block_size, tx->block_data, tx->num_blocks * block_size);
+    
+    struct vfs_journal_entry_header* commit =
+        (struct vfs_journal_entry_header*)(buffer + (length - 1) * block_size);
+    memset(commit, 0, block_size);
+    commit->magic = VFS_JOURNAL_BLOCK_MAGIC;
+    commit->entry_type = VFS_JOURNAL_COMMIT_TX;
+    commit->size = sizeof(*commit);
+    commit->sequence = journal->sequence;
+    commit->transaction_id = tx->id;
+    commit->checksum = journal_calculate_checksum(buffer, (length - 1) * block_size);
+    
+    result = journal_log_io(journal, journal->head, buffer, length, 1);
+    if (result == VFS_SUCCESS) {
+        result = journal_dev_sync(journal);
+    }
+    free(buffer);
+    if (result != VFS_SUCCESS) {
+        goto failed;
+    }
+    
+    // Keep the images until a checkpoint writes them home
+    spinlock_acquire(&journal->lock);
+    journal_dequeue_locked(journal, tx);
+    tx->state = VFS_TX_STATE_COMMITTED;
+    tx->log_length = length;
+    if (journal->checkpoint_last) {
+        journal->checkpoint_last->checkpoint_next = tx;
+    } else {
+        journal->checkpoint_list = tx;
+    }
+    journal->checkpoint_last = tx;
+    
+    journal->head = (journal->head + length) % journal->log_blocks;
+    journal->used += (uint64_t)length * block_size;
+    journal->sequence++;
+    journal->stats.commits++;
+    journal->stats.log_blocks += length;
+    spinlock_release(&journal->lock);
+    tx = NULL;
+
+committed:
+    // Call filesystem-specific commit transaction
+    if (mount->fs_type->journal_commit_tx) {
+        int commit_result = mount->fs_type->journal_commit_tx(mount);
+        if (commit_result != VFS_SUCCESS) {
+            log_error("VFS", "Failed to commit transaction: %s",
+                     vfs_strerror(commit_result));
+        }
+    }
+    if (tx) {
+        tx->state = VFS_TX_STATE_COMPLETE;
+        journal_free_tx(tx);
+    }
+    
+    // Checkpoint in batches, once enough of the log is in use
+    if ((journal->used / block_size) * 100 >= (uint64_t)journal->log_blocks * JOURNAL_CHECKPOINT_PERCENT) {
+        int checkpoint_result = journal_checkpoint(journal);
+        if (checkpoint_result != VFS_SUCCESS) {
+            // The transactions stay in the log and are retried at the next commit
+            if (!journal_quiet) {
+                log_warning("VFS", "Journal checkpoint failed: %s", vfs_strerror(checkpoint_result));
+            }
+        }
+    }
+    
+    return VFS_SUCCESS;
+
+failed:
+    if (!journal_quiet) {
+        log_error("VFS", "Failed to commit transaction %u: %s", tx->id, vfs_strerror(result));
+    }
+    spinlock_acquire(&journal->lock);
+    journal_dequeue_locked(journal, tx);
+    tx->state = VFS_TX_STATE_ABORTED;
+    spinlock_release(&journal->lock);
+    if (mount->fs_type->journal_abort_tx) {
+        mount->fs_type->journal_abort_tx(mount);
+    }
+    journal_free_tx(tx);
+    return result;
+}
+
+/**
+ * Write every queued transaction to the log, oldest first (commit lock held)
+ * 
+ * @param mount Mount point
+ * @return 0 on success, the last error if a transaction could not be written
+ */
+static int journal_commit_queued(vfs_mount_t* mount) {
+    vfs_journal_t* journal = mount->journal;
+    int result = VFS_SUCCESS;
+    
+    for (;;) {
+        spinlock_acquire(&journal->lock);
+        vfs_transaction_t* tx = journal->commit_list;
+        spinlock_release(&journal->lock);
+        
+        if (!tx) {
+            return result;
+        }
+        
+        int tx_result = journal_write_tx(mount, tx);
+        if (tx_result != VFS_SUCCESS) {
+            result = tx_result;
+        }
+    }
+}
+
+/**
+ * Write the queued transactions to the log
+ * 
+ * A transaction queued before the call is in the log (or was dropped on an
+ * error) once it returns, even if another thread ended up writing it.
+ * 
+ * @param mount Mount point
+ * @return 0 on success, negative error code on failure
+ */
+static int journal_commit(vfs_mount_t* mount) {
+    vfs_journal_t* journal = mount->journal;
+    
+    mutex_lock(&journal->commit_lock);
+    int result = journal_commit_queued(mount);
+    mutex_unlock(&journal->commit_lock);
+    
+    return result;
+}
+
+/**
+ * Write every committed transaction home and empty the log (commit lock held)
+ * 
+ * Only the newest image of each block is written, in block order so that
+ * neighbouring blocks go out in one device write. The tail moves in the
+ * journal header only once the home writes are durable; a crash before that
+ * replays the same images again.
+ * 
+ * The checkpoint list only changes under the commit lock, so it is walked
+ * without the journal lock; readers lose the images only when the written
+ * transactions are unlinked at the end.
+ * 
+ * @param journal Journal
+ * @return 0 on success, negative error code on failure
+ */
+static int journal_checkpoint(vfs_journal_t* journal) {
+    if (!journal->checkpoint_list) {
+        return VFS_SUCCESS;
+    }
+    
+    uint32_t block_size = journal->block_size;
+    uint32_t total = 0;
+    for (vfs_transaction_t* tx = journal->checkpoint_list; tx; tx = tx->checkpoint_next) {
+        total += tx->num_blocks;
+    }
+    
+    uint32_t* block_ids = (uint32_t*)malloc(total * sizeof(uint32_t));
+    const uint8_t** images = (const uint8_t**)malloc(total * sizeof(uint8_t*));
+    uint8_t* buffer = (uint8_t*)malloc(total * block_size);
+    if (!block_ids || !images || !buffer) {
+        free(block_ids);
+        free(images);
+        free(buffer);
+        return VFS_ERR_NO_SPACE;
+    }
+    
+    // Newest image of every block, oldest transaction first so later ones win
+    uint32_t count = 0;
+    for (vfs_transaction_t* tx = journal->checkpoint_list; tx; tx = tx->checkpoint_next) {
+        for (uint32_t i = 0; i < tx->num_blocks; i++) {
+            uint32_t slot = 0;
+            while (slot < count && block_ids[slot] != tx->block_ids[i]) {
+                slot++;
+            }
+            if (slot == count) {
+                block_ids[count++] = tx->block_ids[i];
+            }
+            images[slot] = tx->block_data + i * block_size;
+        }
+    }
+    
+    // Sort by block number
+    for (uint32_t i = 1; i < count; i++) {
+        uint32_t block_id = block_ids[i];
+        const uint8_t* image = images[i];
+        uint32_t j = i;
+        while (j > 0 && block_ids[j - 1] > block_id) {
+            block_ids[j] = block_ids[j - 1];
+            images[j] = images[j - 1];
+            j--;
+        }
+        block_ids[j] = block_id;
+        images[j] = image;
+    }
+    
+    // Write runs of consecutive blocks
+    int result = VFS_SUCCESS;
+    uint32_t start = 0;
+    while (start < count && result == VFS_SUCCESS) {
+        uint32_t end = start + 1;
+        while (end < count && block_ids[end] == block_ids[end - 1] + 1) {
+            end++;
+        }
+        
+        for (uint32_t i = start; i < end; i++) {
+            memcpy(buffer + (i - start) * block_size, images[i], block_size);
+        }
+        result = journal_home_io(journal, block_ids[start], buffer, end - start, 1);
+        
+        start = end;
+    }
+    if (result == VFS_SUCCESS) {
+        result = journal_dev_sync(journal);
+    }
+    
+    if (result == VFS_SUCCESS) {
+        for (uint32_t i = 0; i < count; i++) {
+            journal_invalidate_cached(journal, block_ids[i]);
+        }
+    }
+    
+    free(block_ids);
+    free(images);
+    free(buffer);
+    
+    if (result != VFS_SUCCESS) {
+        if (!journal_quiet) {
+            log_error("VFS", "Journal checkpoint failed: %s", vfs_strerror(result));
+        }
+        return result;
+    }
+    
+    // Everything in the log is home now
+    spinlock_acquire(&journal->lock);
+    vfs_transaction_t* written = journal->checkpoint_list;
+    journal->checkpoint_list = NULL;
+    journal->checkpoint_last = NULL;
+    
+    journal->tail = journal->head;
+    journal->tail_sequence = journal->sequence;
+    journal->used = 0;
+    journal->stats.checkpoints++;
+    journal->stats.checkpoint_blocks += count;
+    spinlock_release(&journal->lock);
+    
+    while (written) {
+        vfs_transaction_t* tx = written;
+        written = tx->checkpoint_next;
+        tx->state = VFS_TX_STATE_COMPLETE;
+        journal_free_tx(tx);
+    }
+    
+    return journal_write_header(journal);
+}
+
+/**
+ * Commit the running transaction now if no operation is still in it
+ * 
+ * @param mount Mount point
+ * @return 0 on success, VFS_ERR_LOCKED if operations are still running,
+ *         other negative error code on failure
+ */
+int vfs_journal_sync(vfs_mount_t* mount) {
+    if (!mount) {
+        return VFS_ERR_INVALID_ARG;
+    }
+    
+    vfs_journal_t* journal = mount->journal;
+    if (!journal || !journal->enabled) {
+        return VFS_SUCCESS;
+    }
+    
+    spinlock_acquire(&journal->lock);
+    
+    int result = VFS_SUCCESS;
+    if (journal->active_tx) {
+        if (journal->active_tx->users > 0) {
+            result = VFS_ERR_LOCKED;
+        } else {
+            journal_queue_locked(journal);
+        }
+    }
+    
+    spinlock_release(&journal->lock);
+    
+    // Also waits for transactions other threads queued before this one
+    if (result == VFS_SUCCESS) {
+        result = journal_commit(mount);
+    }
+    
+    return result;
+}
+
+/**
+ * Get journal statistics
+ * 
+ * @param mount Mount point
+ * @param stats Output statistics
+ * @return 0 on success, negative error code on failure
+ */
+int vfs_journal_get_stats(vfs_mount_t* mount, vfs_journal_stats_t* stats) {
+    if (!mount || !stats) {
+        return VFS_ERR_INVALID_ARG;
+    }
+    
+    vfs_journal_t* journal = mount->journal;
+    if (!journal) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    
+    // The log counters move under the commit lock, the rest under the journal lock
+    mutex_lock(&journal->commit_lock);
+    spinlock_acquire(&journal->lock);
+    *stats = journal->stats;
+    spinlock_release(&journal->lock);
+    mutex_unlock(&journal->commit_lock);
+    
+    return VFS_SUCCESS;
+}
+
+/**
+ * Set up the in-memory journal of a mount (nothing is written)
+ * 
+ * @param mount Mount point
+ * @param dev_id Block device holding the journal and the filesystem
+ * @param start_offset Byte offset of the journal area on the device
+ * @param size Size of the journal area in bytes
+ * @param block_size Journal block size (a multiple of the device block size)
+ * @param flags Journal flags
+ * @return 0 on success, negative error code on failure
+ */
+static int journal_setup(vfs_mount_t* mount, uint32_t dev_id, uint64_t start_offset,
+                         uint64_t size, uint32_t block_size, uint32_t flags) {
+    vfs_block_device_t* device = vfs_get_block_device_by_id(dev_id);
+    if (!device || block_size == 0 || block_size % device->block_size != 0 ||
+        block_size < sizeof(journal_descriptor_t) + 2 * sizeof(uint32_t) ||
+        size / block_size < JOURNAL_MIN_LOG_BLOCKS + 1) {
+        return VFS_ERR_INVALID_ARG;
+    }
+    
+    journal_release(mount);
+    
+    vfs_journal_t* journal = (vfs_journal_t*)malloc(sizeof(vfs_journal_t));
+    if (!journal) {
+        return VFS_ERR_NO_SPACE;
+    }
+    memset(journal, 0, sizeof(vfs_journal_t));
+    
+    journal->dev_id = dev_id;
+    journal->start_offset = start_offset;
+    journal->size = size;
+    journal->block_size = block_size;
+    journal->flags = flags;
+    journal->current_tx = 1;     // Start from 1
+    journal->enabled = 0;        // Not enabled yet
+    journal->log_blocks = (uint32_t)(size / block_size) - 1;  // The last block holds the header
+    journal->sequence = 1;
+    journal->tail_sequence = 1;
+    journal->mount = mount;
+    spinlock_init(&journal->lock);
+    mutex_init(&journal->commit_lock);
+    ktimer_init(&journal->age_timer, journal_age_expired, NULL);
+    
+    mount->journal = journal;
+    
+    spinlock_acquire(&journal_list_lock);
+    journal->next = journal_list;
+    journal_list = journal;
+    spinlock_release(&journal_list_lock);
+    
+    return VFS_SUCCESS;
+}
+
+/**
+ * Free the in-memory journal of a mount, discarding anything not yet logged
+ */
+static void journal_release(vfs_mount_t* mount) {
+    vfs_journal_t* journal = mount->journal;
+    if (!journal) {
+        return;
+    }
+    
+    // Once off the list and unpinned the commit thread is done with it
+    spinlock_acquire(&journal_list_lock);
+    vfs_journal_t** pprev = &journal_list;
+    while (*pprev && *pprev != journal) {
+        pprev = &(*pprev)->next;
+    }
+    if (*pprev) {
+        *pprev = journal->next;
+    }
+    while (journal->pins > 0) {
+        spinlock_release(&journal_list_lock);
+        thread_sleep(1);
+        spinlock_acquire(&journal_list_lock);
+    }
+    spinlock_release(&journal_list_lock);
+    ktimer_cancel(&journal->age_timer);
+    
+    if (journal->active_tx) {
+        journal_free_tx(journal->active_tx);
+    }
+    while (journal->commit_list) {
+        vfs_transaction_t* tx = journal->commit_list;
+        journal->commit_list = tx->checkpoint_next;
+        journal_free_tx(tx);
+    }
+    while (journal->checkpoint_list) {
+        vfs_transaction_t* tx = journal->checkpoint_list;
+        journal->checkpoint_list = tx->checkpoint_next;
+        journal_free_tx(tx);
+    }
+    
+    free(journal);
+    mount->journal = NULL;
+}
+
+/**
+ * Find a journal at the end of the mount's block device
+ * 
+ * The header sits at the start of the last device block of the journal
+ * area, so it can be found without knowing the journal's size.
+ * 
+ * @param mount Mount point
+ * @return 0 on success, negative error code on failure
+ */
+static int journal_find(vfs_mount_t* mount) {
+    vfs_block_device_t* device = vfs_get_block_device(mount->device);
+    if (!device || !device->operations || !device->operations->read_blocks || device->block_count == 0) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    
+    uint8_t* block = (uint8_t*)malloc(device->block_size);
+    if (!block) {
+        return VFS_ERR_NO_SPACE;
+    }
+    
+    int result = device->operations->read_blocks(device, device->block_count - 1, 1, block);
+    
+    vfs_journal_header_t header;
+    memcpy(&header, block, sizeof(header));
+    free(block);
+    
+    if (result != 1 || header.magic != VFS_JOURNAL_MAGIC) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    
+    uint64_t device_size = device->block_count * device->block_size;
+    if (header.size >= device_size) {
+        return VFS_ERR_CORRUPTED;
+    }
+    
+    return journal_setup(mount, device->id, device_size - header.size, header.size,
+                         header.block_size, header.flags);
+}
+
+/**
+ * Read the header, recover committed transactions and enable the journal
+ */
+static int journal_open(vfs_mount_t* mount) {
+    // First, read the journal header
+    int result = journal_read_header(mount->journal);
+    if (result != VFS_SUCCESS) {
+        log_error("VFS", "Failed to read journal header: %s", vfs_strerror(result));
+        return result;
+    }
+    
+    // Replay whatever was committed but not checkpointed
+    result = journal_replay(mount);
+    if (result != VFS_SUCCESS) {
+        log_error("VFS", "Failed to replay journal: %s", vfs_strerror(result));
+        return result;
+    }
+    
+    // Call filesystem-specific journal start
+    if (mount->fs_type->journal_start) {
+        result = mount->fs_type->journal_start(mount);
+        if (result != VFS_SUCCESS) {
+            return result;
+        }
+    }
+    
+    // Enable journal
+    vfs_journal_t* journal = mount->journal;
+    mutex_lock(&journal->commit_lock);
+    journal->enabled = 1;
+    result = journal_write_header(journal);
+    mutex_unlock(&journal->commit_lock);
+    
+    return result;
+}
+
+/**
+ * Write a journal header to disk
+ * 
+ * @param journal Journal
+ * @return 0 on success, negative error code on failure
+ */
+static int journal_write_header(vfs_journal_t* journal) {
+    vfs_block_device_t* device = vfs_get_block_device_by_id(journal->dev_id);
+    if (!device) {
+        return VFS_ERR_IO_ERROR;
+    }
+    
+    uint8_t* block = (uint8_t*)malloc(journal->block_size);
+    if (!block) {
+        return VFS_ERR_NO_SPACE;
+    }
+    memset(block, 0, journal->block_size);
+    
     // Create a header
     vfs_journal_header_t header;
     memset(&header, 0, sizeof(header));
@@ -745,109 +1693,203 @@ static int journal_write_header(vfs_mount_t* mount) {
     // Fill header
     header.magic = VFS_JOURNAL_MAGIC;
     header.version = 1;
-    header.size = mount->journal->size;
-    header.block_size = mount->journal->block_size;
-    header.flags = mount->journal->flags;
-    header.sequence = 1;
-    header.current_tx = mount->journal->current_tx;
-    header.state = VFS_JOURNAL_STATE_INACTIVE;
-    header.start_block = 1;  // First block after header
-    header.num_blocks = (header.size - sizeof(header)) / header.block_size;
-    header.head = header.tail = 0;
+    header.size = journal->size;
+    header.block_size = journal->block_size;
+    header.flags = journal->flags;
+    header.sequence = journal->tail_sequence;
+    header.current_tx = journal->current_tx;
+    header.state = journal->enabled ? VFS_JOURNAL_STATE_ACTIVE : VFS_JOURNAL_STATE_INACTIVE;
+    header.start_block = 0;
+    header.num_blocks = journal->log_blocks;
+    header.head = journal->head;
+    header.tail = journal->tail;
     
     // Calculate checksum
-    header.checksum = journal_calculate_checksum(&header, sizeof(header) - sizeof(header.checksum));
+    header.checksum = journal_calculate_checksum(&header, sizeof(header));
     
-    // This is where we'd write the header to disk
-    // For now, just log it
-    log_debug("VFS: Journal header written (size=%llu, blocks=%u)", 
-             header.size, header.num_blocks);
+    // The header goes in the last device block of the journal area
+    memcpy(block + journal->block_size - device->block_size, &header, sizeof(header));
     
-    return VFS_SUCCESS;
+    int result = journal_dev_io(journal, journal->start_offset + (uint64_t)journal->log_blocks * journal->block_size,
+                                block, 1, 1);
+    if (result == VFS_SUCCESS) {
+        result = journal_dev_sync(journal);
+    }
+    
+    free(block);
+    return result;
 }
 
 /**
  * Read a journal header from disk
  * 
- * @param mount Mount point
+ * @param journal Journal
  * @return 0 on success, negative error code on failure
  */
-static int journal_read_header(vfs_mount_t* mount) {
-    // This is where we'd read the header from disk
-    // For now, just create a dummy header
+static int journal_read_header(vfs_journal_t* journal) {
+    vfs_block_device_t* device = vfs_get_block_device_by_id(journal->dev_id);
+    if (!device) {
+        return VFS_ERR_IO_ERROR;
+    }
+    
+    uint8_t* block = (uint8_t*)malloc(journal->block_size);
+    if (!block) {
+        return VFS_ERR_NO_SPACE;
+    }
+    
+    int result = journal_dev_io(journal, journal->start_offset + (uint64_t)journal->log_blocks * journal->block_size,
+                                block, 1, 0);
+    
     vfs_journal_header_t header;
-    memset(&header, 0, sizeof(header));
+    memcpy(&header, block + journal->block_size - device->block_size, sizeof(header));
+    free(block);
     
-    // Fill header
-    header.magic = VFS_JOURNAL_MAGIC;
-    header.version = 1;
-    header.size = mount->journal->size;
-    header.block_size = mount->journal->block_size;
-    header.flags = mount->journal->flags;
-    header.sequence = 1;
-    header.current_tx = mount->journal->current_tx;
-    header.state = VFS_JOURNAL_STATE_INACTIVE;
-    header.start_block = 1;  // First block after header
-    header.num_blocks = (header.size - sizeof(header)) / header.block_size;
-    header.head = header.tail = 0;
-    
-    // Calculate expected checksum
-    uint32_t expected_checksum = journal_calculate_checksum(
-        &header, sizeof(header) - sizeof(header.checksum));
+    if (result != VFS_SUCCESS) {
+        return result;
+    }
+    
+    // Verify magic
+    if (header.magic != VFS_JOURNAL_MAGIC) {
+        log_error("VFS", "Journal header has invalid magic");
+        return VFS_ERR_CORRUPTED;
+    }
     
     // Verify checksum
-    if (header.checksum != expected_checksum) {
-        log_error("VFS: Journal header checksum mismatch");
+    uint32_t checksum = header.checksum;
+    header.checksum = 0;
+    if (journal_verify_checksum(&header, sizeof(header), checksum) != VFS_SUCCESS) {
+        log_error("VFS", "Journal header checksum mismatch");
         return VFS_ERR_CORRUPTED;
     }
     
-    // Verify magic
-    if (header.magic != VFS_JOURNAL_MAGIC) {
-        log_error("VFS: Journal header has invalid magic");
+    if (header.block_size != journal->block_size || header.num_blocks != journal->log_blocks ||
+        header.tail >= header.num_blocks) {
+        log_error("VFS", "Journal header does not match the journal area");
         return VFS_ERR_CORRUPTED;
     }
     
     // Update journal info
-    mount->journal->block_size = header.block_size;
-    mount->journal->current_tx = header.current_tx;
-    
-    log_debug("VFS: Journal header read (size=%llu, blocks=%u)", 
-             header.size, header.num_blocks);
+    journal->current_tx = header.current_tx;
+    journal->tail = header.tail;
+    journal->head = header.tail;
+    journal->tail_sequence = header.sequence;
+    journal->sequence = header.sequence;
     
     return VFS_SUCCESS;
 }
 
-/**
- * Reset a journal
- * 
- * @param mount Mount point
- * @return 0 on success, negative error code on failure
- */
-static int journal_reset(vfs_mount_t* mount) {
-    // Write a new header
-    return journal_write_header(mount);
-}
-
 /**
  * Replay a journal
  * 
+ * Walks the log from the tail and writes the images of every complete
+ * commit home, in commit order. The walk ends at the first block that is
+ * not the descriptor of the next sequence number, or at a commit whose
+ * commit block is missing or does not match its checksum.
+ * 
  * @param mount Mount point
  * @return 0 on success, negative error code on failure
  */
 static int journal_replay(vfs_mount_t* mount) {
-    // This is where we'd scan the journal and replay transactions
-    // For now, just reset the journal
-    return journal_reset(mount);
+    vfs_journal_t* journal = mount->journal;
+    uint32_t block_size = journal->block_size;
+    
+    uint32_t capacity = journal_tx_capacity(journal);
+    
+    uint8_t* buffer = (uint8_t*)malloc((capacity + 2) * block_size);
+    if (!buffer) {
+        return VFS_ERR_NO_SPACE;
+    }
+    
+    journal_descriptor_t* descriptor = (journal_descriptor_t*)buffer;
+    uint32_t position = journal->tail;
+    uint32_t sequence = journal->tail_sequence;
+    uint32_t scanned = 0;
+    uint32_t replayed = 0;
+    uint32_t replayed_blocks = 0;
+    int result = VFS_SUCCESS;
+    
+    while (scanned + 2 <= journal->log_blocks) {
+        result = journal_log_io(journal, position, buffer, 1, 0);
+        if (result != VFS_SUCCESS) {
+            break;
+        }
+        
+        uint32_t count = descriptor->count;
+        if (descriptor->header.magic != VFS_JOURNAL_BLOCK_MAGIC ||
+            descriptor->header.entry_type != VFS_JOURNAL_START_TX ||
+            descriptor->header.sequence != sequence ||
+            count == 0 || count > capacity || scanned + count + 2 > journal->log_blocks) {
+            break;
+        }
+        
+        result = journal_log_io(journal, (position + 1) % journal->log_blocks,
+                                buffer + block_size, count + 1, 0);
+        if (result != VFS_SUCCESS) {
+            break;
+        }
+        
+        struct vfs_journal_entry_header* commit =
+            (struct vfs_journal_entry_header*)(buffer + (count + 1) * block_size);
+        if (commit->magic != VFS_JOURNAL_BLOCK_MAGIC ||
+            commit->entry_type != VFS_JOURNAL_COMMIT_TX ||
+            commit->sequence != sequence ||
+            journal_verify_checksum(buffer, (count + 1) * block_size, commit->checksum) != VFS_SUCCESS) {
+            // Torn by a crash before the commit completed
+            break;
+        }
+        
+        // Later commits overwrite the same blocks again, so order is kept
+        for (uint32_t i = 0; i < count && result == VFS_SUCCESS; i++) {
+            result = journal_home_io(journal, descriptor->blocks[i], buffer + (i + 1) * block_size, 1, 1);
+            journal_invalidate_cached(journal, descriptor->blocks[i]);
+        }
+        if (result != VFS_SUCCESS) {
+            break;
+        }
+        
+        if (commit->transaction_id >= journal->current_tx) {
+            journal->current_tx = commit->transaction_id + 1;
+        }
+        
+        replayed++;
+        replayed_blocks += count;
+        position = (position + count + 2) % journal->log_blocks;
+        scanned += count + 2;
+        sequence++;
+    }
+    
+    free(buffer);
+    
+    if (result == VFS_SUCCESS && replayed > 0) {
+        result = journal_dev_sync(journal);
+    }
+    if (result != VFS_SUCCESS) {
+        return result;
+    }
+    
+    // The log is empty now, new commits start where recovery stopped
+    journal->head = journal->tail = position;
+    journal->sequence = journal->tail_sequence = sequence;
+    journal->used = 0;
+    journal->stats.replayed_tx += replayed;
+    journal->stats.replayed_blocks += replayed_blocks;
+    
+    if (replayed > 0 && !journal_quiet) {
+        log_info("VFS", "Journal recovery replayed %u transactions (%u blocks)", replayed, replayed_blocks);
+    }
+    
+    return journal_write_header(journal);
 }
 
 /**
  * Allocate a new transaction
  * 
- * @param mount Mount point
+ * Its ID and start time are set when it becomes the running transaction.
+ * 
  * @param tx Output transaction pointer
  * @return 0 on success, negative error code on failure
  */
-static int journal_allocate_tx(vfs_mount_t* mount, vfs_transaction_t** tx) {
+static int journal_allocate_tx(vfs_transaction_t** tx) {
     // Allocate memory for transaction
     vfs_transaction_t* new_tx = (vfs_transaction_t*)malloc(sizeof(vfs_transaction_t));
     if (!new_tx) {
@@ -857,13 +1899,13 @@ static int journal_allocate_tx(vfs_mount_t* mount, vfs_transaction_t** tx) {
     // Initialize transaction
     memset(new_tx, 0, sizeof(vfs_transaction_t));
     
-    // Assign ID and increment for next transaction
-    new_tx->id = mount->journal->current_tx++;
     new_tx->state = VFS_TX_STATE_RUNNING;
     
     // Add to transaction list
+    spinlock_acquire(&tx_list_lock);
     new_tx->next = tx_list;
     tx_list = new_tx;
+    spinlock_release(&tx_list_lock);
     
     // Return transaction
     *tx = new_tx;
@@ -883,6 +1925,7 @@ static int journal_free_tx(vfs_transaction_t* tx) {
     }
     
     // Remove from transaction list
+    spinlock_acquire(&tx_list_lock);
     vfs_transaction_t** pprev = &tx_list;
     vfs_transaction_t* curr = tx_list;
     
@@ -896,6 +1939,7 @@ static int journal_free_tx(vfs_transaction_t* tx) {
         pprev = &curr->next;
         curr = curr->next;
     }
+    spinlock_release(&tx_list_lock);
     
     // Free operations if any
     if (tx->operations) {
@@ -913,13 +1957,13 @@ static int journal_free_tx(vfs_transaction_t* tx) {
                         free(op->op.write.old_data);
                     }
                     break;
-                    
+                
                 case VFS_JOURNAL_OP_CUSTOM:
                     if (op->op.custom.data) {
                         free(op->op.custom.data);
                     }
                     break;
-                    
+                
                 default:
                     // No allocations for other types
                     break;
@@ -929,73 +1973,29 @@ static int journal_free_tx(vfs_transaction_t* tx) {
         free(tx->operations);
     }
     
+    // Free logged block images
+    free(tx->block_ids);
+    free(tx->block_data);
+    
     // Free transaction
     free(tx);
     
     return VFS_SUCCESS;
 }
 
-/**
- * Write a journal entry
- * 
- * @param mount Mount point
- * @param type Entry type
- * @param data Entry data
- * @param size Data size
- * @return 0 on success, negative error code on failure
- */
-static int journal_write_entry(vfs_mount_t* mount, vfs_journal_entry_type type, 
-                             const void* data, uint32_t size) {
-    // Create entry header
-    struct vfs_journal_entry_header header;
-    memset(&header, 0, sizeof(header));
-    
-    // Fill header
-    header.magic = VFS_JOURNAL_BLOCK_MAGIC;
-    header.entry_type = type;
-    header.size = sizeof(header) + size;
-    header.sequence = 0; // Would be set from journal header
-    
-    // Set transaction ID if active transaction exists
-    if (mount->journal->active_tx) {
-        header.transaction_id = mount->journal->active_tx->id;
-    }
-    
-    // Calculate checksum for header and data
-    header.checksum = journal_calculate_checksum(&header, sizeof(header) - sizeof(header.checksum));
-    if (data && size > 0) {
-        header.checksum ^= journal_calculate_checksum(data, size);
-    }
-    
-    // This is where we'd write the entry to disk
-    // For now, just log it
-    log_debug("VFS: Journal entry written (type=%u, size=%u)", 
-             type, header.size);
-    
-    return VFS_SUCCESS;
-}
-
 /**
  * Calculate checksum for data
  * 
  * @param data Data to checksum
  * @param size Data size
- * @return Checksum
+ * @return CRC-32C of the data
  */
 static uint32_t journal_calculate_checksum(const void* data, uint32_t size) {
     if (!data || size == 0) {
         return 0;
     }
     
-    // Simple checksum algorithm (CRC32 would be better in real implementation)
-    uint32_t checksum = 0;
-    const uint8_t* bytes = (const uint8_t*)data;
-    
-    for (uint32_t i = 0; i < size; i++) {
-        checksum = ((checksum << 5) + checksum) + bytes[i];
-    }
-    
-    return checksum;
+    return crc32c(data, size);
 }
 
 /**
@@ -1024,14 +2024,303 @@ static int journal_verify_checksum(const void* data, uint32_t size, uint32_t exp
 int vfs_journal_shutdown(void) {
     // Free all transactions in list
     while (tx_list) {
-        vfs_transaction_t* next = tx_list->next;
         journal_free_tx(tx_list);
-        tx_list = next;
     }
     
     return VFS_SUCCESS;
 }
 
+/*
+ * Crash-injection test. A journal on a RAM disk loses power at each device
+ * write of a workload in turn (the failing request is torn halfway), is
+ * mounted again, and must leave every transaction all-or-nothing and every
+ * synced transaction in place.
+ */
+#define JTEST_BLOCK_SIZE      512
+#define JTEST_HOME_BLOCKS     32     // Filesystem blocks, updated in pairs
+#define JTEST_PAIRS           (JTEST_HOME_BLOCKS / 2)
+#define JTEST_JOURNAL_BLOCKS  160    // Journal area, header included
+#define JTEST_ROUNDS          24
+#define JTEST_OPS             4      // Concurrent operations per round
+#define JTEST_SYNC_EVERY      3      // Rounds between syncs
+
+static uint8_t jtest_disk[(JTEST_HOME_BLOCKS + JTEST_JOURNAL_BLOCKS) * JTEST_BLOCK_SIZE];
+static int jtest_writes_left = -1;   // Device writes until the power fails (-1: never)
+static uint32_t jtest_writes = 0;    // Device writes issued
+
+static int jtest_read_blocks(vfs_block_device_t* device, uint64_t block, uint32_t count, void* buffer) {
+    if ((block + count) * JTEST_BLOCK_SIZE > sizeof(jtest_disk)) {
+        return VFS_ERR_INVALID_ARG;
+    }
+    memcpy(buffer, jtest_disk + (uint32_t)block * JTEST_BLOCK_SIZE, count * JTEST_BLOCK_SIZE);
+    return count;
+}
+
+static int jtest_write_blocks(vfs_block_device_t* device, uint64_t block, uint32_t count, const void* buffer) {
+    if ((block + count) * JTEST_BLOCK_SIZE > sizeof(jtest_disk)) {
+        return VFS_ERR_INVALID_ARG;
+    }
+    if (jtest_writes_left == 0) {
+        return VFS_ERR_IO_ERROR;     // Powered off
+    }
+    
+    jtest_writes++;
+    if (jtest_writes_left > 0 && --jtest_writes_left == 0) {
+        // The power fails halfway through this request
+        memcpy(jtest_disk + (uint32_t)block * JTEST_BLOCK_SIZE, buffer, (count / 2) * JTEST_BLOCK_SIZE);
+        return VFS_ERR_IO_ERROR;
+    }
+    
+    memcpy(jtest_disk + (uint32_t)block * JTEST_BLOCK_SIZE, buffer, count * JTEST_BLOCK_SIZE);
+    return count;
+}
+
+static vfs_block_device_ops_t jtest_ops = {
+    .read_blocks = jtest_read_blocks,
+    .write_blocks = jtest_write_blocks,
+    .sync = NULL,
+};
+
+static vfs_block_device_t jtest_device = {
+    .name = "journal_test",
+    .block_size = JTEST_BLOCK_SIZE,
+    .block_count = sizeof(jtest_disk) / JTEST_BLOCK_SIZE,
+    .operations = &jtest_ops,
+};
+
+static vfs_filesystem_t jtest_fs = {
+    .name = "journal_test",
+};
+
+static vfs_mount_t jtest_mount;
+
+/**
+ * Fill a block of a pair with the contents written by a round
+ */
+static void jtest_fill(uint8_t* block, uint32_t pair, uint32_t version) {
+    memset(block, (uint8_t)(version * 7 + pair), JTEST_BLOCK_SIZE);
+    memcpy(block, &version, sizeof(version));
+    memcpy(block + sizeof(version), &pair, sizeof(pair));
+}
+
+/**
+ * Pair updated by an operation of a round (each round touches distinct pairs)
+ */
+static uint32_t jtest_pair(uint32_t round, uint32_t op) {
+    return (round * 3 + op * (JTEST_PAIRS / JTEST_OPS)) % JTEST_PAIRS;
+}
+
+/**
+ * Run the workload until it finishes or the disk fails. durable gets the
+ * version each pair must at least have, written the newest version tried.
+ */
+static int jtest_workload(vfs_mount_t* mount, uint32_t* durable, uint32_t* written) {
+    uint8_t block[JTEST_BLOCK_SIZE];
+    uint32_t synced[JTEST_PAIRS];
+    memset(synced, 0, sizeof(synced));
+    
+    for (uint32_t round = 1; round <= JTEST_ROUNDS; round++) {
+        int tx[JTEST_OPS];
+        for (uint32_t op = 0; op < JTEST_OPS; op++) {
+            tx[op] = vfs_journal_begin_tx(mount);
+            if (tx[op] <= 0) {
+                return tx[op] < 0 ? tx[op] : VFS_ERR_UNKNOWN;
+            }
+        }
+        
+        // Operations log their two blocks interleaved with each other
+        for (uint32_t half = 0; half < 2; half++) {
+            for (uint32_t op = 0; op < JTEST_OPS; op++) {
+                uint32_t pair = jtest_pair(round, op);
+                written[pair] = round;
+                synced[pair] = round;
+                
+                jtest_fill(block, pair, round);
+                int result = vfs_journal_log_block(mount, tx[op], pair * 2 + half, block);
+                if (result != VFS_SUCCESS) {
+                    return result;
+                }
+            }
+        }
+        
+        for (uint32_t op = 0; op < JTEST_OPS; op++) {
+            int result = vfs_journal_commit_tx(mount, tx[op]);
+            if (result != VFS_SUCCESS) {
+                return result;
+            }
+        }
+        
+        if (round % JTEST_SYNC_EVERY == 0 || round == JTEST_ROUNDS) {
+            int result = vfs_journal_sync(mount);
+            if (result != VFS_SUCCESS) {
+                return result;
+            }
+            memcpy(durable, synced, sizeof(synced));
+        }
+    }
+    
+    return VFS_SUCCESS;
+}
+
+/**
+ * Check the home blocks after recovery
+ */
+static int jtest_verify(const uint32_t* durable, const uint32_t* written) {
+    uint8_t expected[JTEST_BLOCK_SIZE];
+    
+    for (uint32_t pair = 0; pair < JTEST_PAIRS; pair++) {
+        const uint8_t* first = jtest_disk + pair * 2 * JTEST_BLOCK_SIZE;
+        uint32_t version;
+        memcpy(&version, first, sizeof(version));
+        
+        // Both blocks of the pair come from the same transaction, in full
+        jtest_fill(expected, pair, version);
+        if (memcmp(first, expected, JTEST_BLOCK_SIZE) != 0 ||
+            memcmp(first + JTEST_BLOCK_SIZE, expected, JTEST_BLOCK_SIZE) != 0) {
+            log_error("VFS", "Journal test: pair %u is torn", pair);
+            return VFS_ERR_CORRUPTED;
+        }
+        
+        // Nothing synced is lost, and nothing appears that was never written
+        if (version < durable[pair] || version > written[pair]) {
+            log_error("VFS", "Journal test: pair %u has version %u, expected %u..%u",
+                     pair, version, durable[pair], written[pair]);
+            return VFS_ERR_CORRUPTED;
+        }
+        if (version != 0) {
+            uint32_t op = 0;
+            while (op < JTEST_OPS && jtest_pair(version, op) != pair) {
+                op++;
+            }
+            if (op == JTEST_OPS) {
+                log_error("VFS", "Journal test: pair %u has version %u, which never wrote it",
+                         pair, version);
+                return VFS_ERR_CORRUPTED;
+            }
+        }
+    }
+    
+    return VFS_SUCCESS;
+}
+
+/**
+ * Format the RAM disk, run the workload with the power failing at a given
+ * write, then mount again and verify
+ * 
+ * @param crash_after Device write that fails (-1 for none)
+ * @param writes Output number of device writes the workload issued (may be NULL)
+ * @param stats Output journal statistics of the workload (may be NULL)
+ * @return 0 if recovery was correct, negative error code otherwise
+ */
+static int jtest_run(int crash_after, uint32_t* writes, vfs_journal_stats_t* stats) {
+    uint32_t durable[JTEST_PAIRS];
+    uint32_t written[JTEST_PAIRS];
+    memset(durable, 0, sizeof(durable));
+    memset(written, 0, sizeof(written));
+    
+    // Fresh filesystem blocks and journal
+    memset(jtest_disk, 0, sizeof(jtest_disk));
+    for (uint32_t pair = 0; pair < JTEST_PAIRS; pair++) {
+        jtest_fill(jtest_disk + pair * 2 * JTEST_BLOCK_SIZE, pair, 0);
+        jtest_fill(jtest_disk + (pair * 2 + 1) * JTEST_BLOCK_SIZE, pair, 0);
+    }
+    jtest_writes_left = -1;
+    
+    int result = journal_setup(&jtest_mount, jtest_device.id, JTEST_HOME_BLOCKS * JTEST_BLOCK_SIZE,
+                               JTEST_JOURNAL_BLOCKS * JTEST_BLOCK_SIZE, JTEST_BLOCK_SIZE, VFS_JOURNAL_METADATA);
+    if (result == VFS_SUCCESS) {
+        result = journal_write_header(jtest_mount.journal);
+    }
+    if (result == VFS_SUCCESS) {
+        result = journal_open(&jtest_mount);
+    }
+    if (result != VFS_SUCCESS) {
+        return result;
+    }
+    
+    jtest_writes = 0;
+    jtest_writes_left = crash_after;
+    
+    result = jtest_workload(&jtest_mount, durable, written);
+    if (crash_after < 0 && result != VFS_SUCCESS) {
+        return result;
+    }
+    if (writes) {
+        *writes = jtest_writes;
+    }
+    if (stats) {
+        *stats = jtest_mount.journal->stats;
+    }
+    
+    // Power comes back: forget everything in memory and mount again
+    jtest_writes_left = -1;
+    journal_release(&jtest_mount);
+    
+    result = journal_find(&jtest_mount);
+    if (result == VFS_SUCCESS) {
+        result = journal_open(&jtest_mount);
+    }
+    if (result != VFS_SUCCESS) {
+        return result;
+    }
+    
+    return jtest_verify(durable, written);
+}
+
+/**
+ * Crash a journal on a RAM disk at every device write of a workload and
+ * check that recovery leaves each transaction all-or-nothing
+ * 
+ * @return 0 if every crash point recovered, negative error code otherwise
+ */
+int vfs_journal_run_crash_test(void) {
+    if (!vfs_get_block_device(jtest_device.name)) {
+        int result = vfs_register_block_device(&jtest_device);
+        if (result != VFS_SUCCESS) {
+            log_error("VFS", "Journal test: cannot register RAM disk: %s", vfs_strerror(result));
+            return result;
+        }
+    }
+    
+    memset(&jtest_mount, 0, sizeof(jtest_mount));
+    strcpy(jtest_mount.mount_point, "/journal_test");
+    strcpy(jtest_mount.device, jtest_device.name);
+    jtest_mount.fs_type = &jtest_fs;
+    
+    // Without a crash first, to count the writes and see how much was grouped
+    uint32_t total_writes = 0;
+    vfs_journal_stats_t stats;
+    int result = jtest_run(-1, &total_writes, &stats);
+    if (result != VFS_SUCCESS) {
+        log_error("VFS", "Journal test: clean run failed: %s", vfs_strerror(result));
+        journal_release(&jtest_mount);
+        return result;
+    }
+    
+    log_info("VFS", "Journal test: %u operations in %u commits, %u log writes, %u checkpoints",
+            stats.handles, stats.commits, stats.log_writes, stats.checkpoints);
+    
+    uint32_t failures = 0;
+    journal_quiet = 1;
+    for (uint32_t crash = 1; crash <= total_writes; crash++) {
+        if (jtest_run(crash, NULL, NULL) != VFS_SUCCESS) {
+            log_error("VFS", "Journal test: recovery failed after a crash at write %u", crash);
+            failures++;
+        }
+    }
+    journal_quiet = 0;
+    
+    journal_release(&jtest_mount);
+    
+    if (failures > 0) {
+        log_error("VFS", "Journal crash test: %u of %u crash points failed", failures, total_writes);
+        return VFS_ERR_CORRUPTED;
+    }
+    
+    log_info("VFS", "Journal crash test passed (%u crash points)", total_writes);
+    return VFS_SUCCESS;
+}
+
 /**
  * Get error string for VFS error code
  */
@@ -540,6 +540,56 @@ int hal_timer_set_interval(uint32_t timer_id, uint64_t interval_ns) {
     return HAL_TIMER_SUCCESS;
 }
 
+/**
+ * Arm the LAPIC timer to fire once after a delay (tickless operation)
+ *
+ * Unlike hal_timer_set_interval(), this writes the registers directly and
+ * runs the counter undivided, so it is cheap enough to call on every
+ * interrupt and every context switch. It only affects the LAPIC of the
+ * calling CPU.
+ *
+ * @param timer_id Timer ID (only the LAPIC timer supports one-shot deadlines)
+ * @param delay_ns Delay in nanoseconds, or 0 to stop the timer
+ * @return HAL_TIMER_SUCCESS on success, error code otherwise
+ */
+int hal_timer_program_oneshot(uint32_t timer_id, uint64_t delay_ns) {
+    if (!validate_timer_id(timer_id)) {
+        return HAL_TIMER_INVALID_PARAM;
+    }
+    
+    // One-shot deadlines need the calibrated LAPIC timer
+    if (timer_id != 0 || timer_state[timer_id].frequency == 0) {
+        return HAL_TIMER_NOT_AVAILABLE;
+    }
+    
+    if (delay_ns == 0) {
+        hal_io_memory_write32(LAPIC_BASE + LAPIC_TIMER_INIT_COUNT, 0);
+        timer_state[timer_id].active = false;
+        return HAL_TIMER_SUCCESS;
+    }
+    
+    // The calibration ran the counter at divide-by-1
+    uint64_t ticks = (delay_ns * timer_state[timer_id].frequency) / 1000000000ULL;
+    if (ticks < 1) {
+        ticks = 1;
+    } else if (ticks > 0xFFFFFFFFULL) {
+        ticks = 0xFFFFFFFFULL;
+    }
+    
+    timer_state[timer_id].mode = HAL_TIMER_ONE_SHOT;
+    timer_state[timer_id].divider = TIMER_DIV_1;
+    timer_state[timer_id].initial_count = (uint32_t)ticks;
+    
+    // Mode and vector first: writing the initial count starts the countdown
+    hal_io_memory_write32(LAPIC_BASE + LAPIC_TIMER,
+                          TIMER_MODE(TIMER_MODE_ONESHOT) | TIMER_VECTOR(timer_state[timer_id].vector));
+    hal_io_memory_write32(LAPIC_BASE + LAPIC_TIMER_DIV_CONFIG, TIMER_DIV_1);
+    hal_io_memory_write32(LAPIC_BASE + LAPIC_TIMER_INIT_COUNT, (uint32_t)ticks);
+    timer_state[timer_id].active = true;
+    
+    return HAL_TIMER_SUCCESS;
+}
+
 /**
  * Get remaining time on a timer
  * 
@@ -5,7 +5,11 @@ COMPILER_FLAGS=-Wall -Wno-format
 COMPILER_FLAGS+=-fno-stack-protector -fno-omit-frame-pointer -fno-asynchronous-unwind-tables
 COMPILER_FLAGS+=-fno-builtin -masm=intel -m32 -nostdlib -gdwarf-2 -ggdb3 -save-temps
 
-SOURCE_FILES := gdt.c io.c irq.c task.c lapic.c task1.c keyboard.c shell.c vga.c task2.c kernel.c preempt.c task_demo.c task_yield.c
+# -DKERNEL_BOOT_TESTS runs the self-tests and benchmarks at startup (set by the qemu-* targets)
+KERNEL_DEFINES ?=
+COMPILER_FLAGS+=$(KERNEL_DEFINES)
+
+SOURCE_FILES := gdt.c io.c irq.c task.c lapic.c task1.c keyboard.c shell.c vga.c task2.c kernel.c preempt.c task_demo.c task_yield.c ktimer.c crc32c.c
 # Add logging files to sources
 LOGGING_FILES := logging/log.c
 SOURCE_FILES += $(LOGGING_FILES)
@@ -17,7 +21,7 @@ FILESYSTEM_DIR ?= ../filesystem
 MEMORY_DIR ?= ../memory
 
 FILESYSTEM_SRC := $(FILESYSTEM_DIR)/fat12.c
-MEMORY_SRC := $(MEMORY_DIR)/paging.c $(MEMORY_DIR)/heap.c
+MEMORY_SRC := $(MEMORY_DIR)/paging.c $(MEMORY_DIR)/heap.c $(MEMORY_DIR)/slab.c
 
 FILESYSTEM_OBJ := $(patsubst %.c, $(BUILD_OUTPUT)/%.o, $(FILESYSTEM_SRC))
 MEMORY_OBJ := $(patsubst %.c, $(BUILD_OUTPUT)/%.o, $(MEMORY_SRC))
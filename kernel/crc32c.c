@@ -0,0 +1,224 @@
+#include "crc32c.h"
+#include "logging/log.h"
+#include <stdint.h>
+
+extern uint64_t hal_time_now_ns(void);
+
+#define CRC32C_POLY           0x82F63B78   // Castagnoli polynomial, bit-reversed
+#define CRC32C_CHECK_VALUE    0xE3069283   // CRC-32C of "123456789"
+
+#define CRC32C_BENCH_BYTES    (64 * 1024)
+#define CRC32C_BENCH_PASSES   64           // 4 MB per implementation
+
+typedef uint32_t (*crc32c_fn_t)(uint32_t crc, const uint8_t* data, uint32_t length);
+
+// table[0] is the classic byte table; table[k] advances a byte through k more zero bytes
+static uint32_t crc32c_table[8][256];
+
+static crc32c_fn_t crc32c_impl = 0;
+static int crc32c_hw = 0;
+
+static uint8_t crc32c_bench_buffer[CRC32C_BENCH_BYTES];
+
+/**
+ * Build the slicing-by-8 tables
+ */
+static void crc32c_build_tables(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+        }
+        crc32c_table[0][i] = crc;
+    }
+
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            uint32_t prev = crc32c_table[k - 1][i];
+            crc32c_table[k][i] = (prev >> 8) ^ crc32c_table[0][prev & 0xFF];
+        }
+    }
+}
+
+/**
+ * One byte at a time through the byte table (reference and benchmark baseline)
+ */
+static uint32_t crc32c_bytewise(uint32_t crc, const uint8_t* data, uint32_t length) {
+    while (length--) {
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+}
+
+/**
+ * Slicing-by-8: eight table lookups per aligned 8-byte word
+ */
+static uint32_t crc32c_slicing8(uint32_t crc, const uint8_t* data, uint32_t length) {
+    while (length > 0 && ((uintptr_t)data & 7)) {
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *data++) & 0xFF];
+        length--;
+    }
+
+    while (length >= 8) {
+        uint32_t lo = *(const uint32_t*)data ^ crc;
+        uint32_t hi = *(const uint32_t*)(data + 4);
+        crc = crc32c_table[7][lo & 0xFF] ^
+              crc32c_table[6][(lo >> 8) & 0xFF] ^
+              crc32c_table[5][(lo >> 16) & 0xFF] ^
+              crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][hi & 0xFF] ^
+              crc32c_table[2][(hi >> 8) & 0xFF] ^
+              crc32c_table[1][(hi >> 16) & 0xFF] ^
+              crc32c_table[0][hi >> 24];
+        data += 8;
+        length -= 8;
+    }
+
+    return crc32c_bytewise(crc, data, length);
+}
+
+/**
+ * SSE4.2 crc32 instruction, four bytes per step (32-bit mode has no 64-bit form)
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t* data, uint32_t length) {
+    while (length > 0 && ((uintptr_t)data & 3)) {
+        crc = __builtin_ia32_crc32qi(crc, *data++);
+        length--;
+    }
+
+    const uint32_t* words = (const uint32_t*)data;
+    while (length >= 16) {
+        crc = __builtin_ia32_crc32si(crc, words[0]);
+        crc = __builtin_ia32_crc32si(crc, words[1]);
+        crc = __builtin_ia32_crc32si(crc, words[2]);
+        crc = __builtin_ia32_crc32si(crc, words[3]);
+        words += 4;
+        length -= 16;
+    }
+    while (length >= 4) {
+        crc = __builtin_ia32_crc32si(crc, *words++);
+        length -= 4;
+    }
+
+    data = (const uint8_t*)words;
+    while (length--) {
+        crc = __builtin_ia32_crc32qi(crc, *data++);
+    }
+    return crc;
+}
+
+/**
+ * CPUID.1:ECX bit 20 reports SSE4.2
+ */
+static int crc32c_cpu_has_sse42(void) {
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1), "c"(0));
+    return (ecx >> 20) & 1;
+}
+
+/**
+ * Check an implementation against the standard check value
+ */
+static int crc32c_self_test(crc32c_fn_t fn) {
+    static const uint8_t check[] = "123456789";
+    return ~fn(~0u, check, 9) == CRC32C_CHECK_VALUE;
+}
+
+void crc32c_init(void) {
+    if (crc32c_impl) {
+        return;
+    }
+
+    crc32c_build_tables();
+
+    crc32c_fn_t impl = crc32c_slicing8;
+    if (!crc32c_self_test(impl)) {
+        log_error("CRC32C", "Slicing-by-8 self-test failed, using byte tables");
+        impl = crc32c_bytewise;
+    }
+
+    if (crc32c_cpu_has_sse42()) {
+        if (crc32c_self_test(crc32c_sse42)) {
+            impl = crc32c_sse42;
+            crc32c_hw = 1;
+        } else {
+            log_error("CRC32C", "SSE4.2 crc32 self-test failed, using tables");
+        }
+    }
+
+    crc32c_impl = impl;
+    log_info("CRC32C", "Using %s", crc32c_hw ? "SSE4.2 crc32 instruction" : "slicing-by-8 tables");
+}
+
+uint32_t crc32c_update(uint32_t crc, const void* data, uint32_t length) {
+    if (!crc32c_impl) {
+        crc32c_init();
+    }
+    return ~crc32c_impl(~crc, (const uint8_t*)data, length);
+}
+
+uint32_t crc32c(const void* data, uint32_t length) {
+    return crc32c_update(0, data, length);
+}
+
+int crc32c_hw_available(void) {
+    if (!crc32c_impl) {
+        crc32c_init();
+    }
+    return crc32c_hw;
+}
+
+/**
+ * Time one implementation over the benchmark buffer
+ *
+ * @return Throughput in hundredths of GB/s
+ */
+static uint32_t crc32c_bench(crc32c_fn_t fn, uint32_t* result) {
+    uint32_t crc = ~0u;
+
+    uint64_t start = hal_time_now_ns();
+    for (int pass = 0; pass < CRC32C_BENCH_PASSES; pass++) {
+        crc = fn(crc, crc32c_bench_buffer, CRC32C_BENCH_BYTES);
+    }
+    uint64_t elapsed_ns = hal_time_now_ns() - start;
+
+    if (elapsed_ns == 0) {
+        elapsed_ns = 1;
+    }
+    *result = ~crc;
+
+    // Bytes per nanosecond is GB/s
+    return (uint32_t)((uint64_t)CRC32C_BENCH_BYTES * CRC32C_BENCH_PASSES * 100 / elapsed_ns);
+}
+
+void crc32c_run_benchmark(void) {
+    crc32c_init();
+
+    uint32_t seed = 0x12345678;
+    for (uint32_t i = 0; i < CRC32C_BENCH_BYTES; i++) {
+        seed = seed * 1103515245 + 12345;
+        crc32c_bench_buffer[i] = (uint8_t)(seed >> 16);
+    }
+
+    uint32_t bytewise_crc, slicing_crc, hw_crc = 0;
+    uint32_t bytewise = crc32c_bench(crc32c_bytewise, &bytewise_crc);
+    uint32_t slicing = crc32c_bench(crc32c_slicing8, &slicing_crc);
+
+    log_info("CRC32C", "Benchmark (%u KB x %u):", CRC32C_BENCH_BYTES / 1024, CRC32C_BENCH_PASSES);
+    log_info("CRC32C", "  byte table  : %u.%02u GB/s", bytewise / 100, bytewise % 100);
+    log_info("CRC32C", "  slicing-by-8: %u.%02u GB/s", slicing / 100, slicing % 100);
+
+    if (crc32c_hw) {
+        uint32_t hw = crc32c_bench(crc32c_sse42, &hw_crc);
+        log_info("CRC32C", "  SSE4.2      : %u.%02u GB/s", hw / 100, hw % 100);
+    } else {
+        log_info("CRC32C", "  SSE4.2      : not supported by this CPU");
+        hw_crc = slicing_crc;
+    }
+
+    if (bytewise_crc != slicing_crc || slicing_crc != hw_crc) {
+        log_error("CRC32C", "Implementations disagree (%08x, %08x, %08x)",
+                  bytewise_crc, slicing_crc, hw_crc);
+    }
+}
@@ -0,0 +1,56 @@
+/**
+ * @file crc32c.h
+ * @brief CRC-32C (Castagnoli) checksums
+ *
+ * The CRC used by ext4 metadata, iSCSI and SCTP (reflected polynomial
+ * 0x82F63B78). On CPUs with SSE4.2 it runs on the crc32 instruction,
+ * otherwise on slicing-by-8 tables. The implementation is picked once by
+ * crc32c_init(), callers never see the difference.
+ */
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stdint.h>
+
+/**
+ * Detect SSE4.2 and build the lookup tables (called once at boot; the
+ * first checksum does it if nobody did)
+ */
+void crc32c_init(void);
+
+/**
+ * Extend a CRC-32C over more data
+ *
+ * Start with 0 and pass the previous result to checksum data in pieces:
+ * crc32c_update(crc32c_update(0, a, n), b, m) equals the CRC of a and b.
+ *
+ * @param crc CRC of the data so far (0 for none)
+ * @param data Data to add
+ * @param length Number of bytes
+ * @return CRC of the data so far followed by data
+ */
+uint32_t crc32c_update(uint32_t crc, const void* data, uint32_t length);
+
+/**
+ * CRC-32C of a buffer
+ *
+ * @param data Data to checksum
+ * @param length Number of bytes
+ * @return CRC-32C
+ */
+uint32_t crc32c(const void* data, uint32_t length);
+
+/**
+ * Check whether checksums run on the SSE4.2 crc32 instruction
+ *
+ * @return 1 if they do, 0 if they use the tables
+ */
+int crc32c_hw_available(void);
+
+/**
+ * Log the throughput of every implementation (needs a calibrated HAL timer)
+ */
+void crc32c_run_benchmark(void);
+
+#endif /* CRC32C_H */
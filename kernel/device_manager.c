@@ -1,5 +1,6 @@
 #include "device_manager.h"
 #include "logging/log.h"
+#include "sync.h"
 #include "memory/heap.h"
 #include <string.h>
 
@@ -11,8 +12,9 @@
 #define MAX_DEVICES 256
 
 // Device tree structures
-static device_t *devices[MAX_DEVICES];
+static device_t *devices[MAX_DEVICES];   // Published with RCU: lookups take no lock
 static int num_devices = 0;
+static mutex_t devices_lock;             // Serializes device table updates
 static device_driver_t *drivers = NULL;
 static device_class_t *classes = NULL;
 
@@ -32,6 +34,7 @@ int device_manager_init(void) {
     log_info("Initializing Device Manager");
     
     // Clear device array
+    mutex_init(&devices_lock);
     memset(devices, 0, sizeof(devices));
     num_devices = 0;
     
@@ -97,8 +100,32 @@ int device_register(device_t *dev) {
         dev->id = generate_device_id();
     }
     
+    // Find driver for this device if needed
+    device_driver_t *driver = NULL;
+    if (!dev->driver) {
+        driver = device_find_driver(dev);
+        if (driver) {
+            log_debug("Found driver '%s' for device '%s'",
+                      driver->name, dev->name);
+            dev->driver = driver;
+            
+            // Set operations from driver if not already set
+            if (!dev->ops) {
+                dev->ops = &driver->ops;
+            }
+        }
+    }
+    
+    // If no parent specified, use root device
+    if (!dev->parent && dev != root_device) {
+        dev->parent = root_device;
+    }
+    
+    // Updates are serialized; the entry is complete before it is published
+    mutex_lock(&devices_lock);
+    
     // Check for name conflict
-    for (int i = 0; i < num_devices; i++) {
+    for (int i = 0; i < MAX_DEVICES; i++) {
         if (devices[i] && strcmp(devices[i]->name, dev->name) == 0) {
             log_warning("Device with name '%s' already registered, appending unique ID", dev->name);
             
@@ -110,56 +137,51 @@ int device_register(device_t *dev) {
     }
     
     // Add to device array
+    int slot = -1;
     for (int i = 0; i < MAX_DEVICES; i++) {
         if (!devices[i]) {
-            devices[i] = dev;
-            num_devices++;
-            
-            log_info("Registered device: %s (ID: %u, Type: 0x%02X)",
-                     dev->name, dev->id, dev->type);
-            
-            // Find driver for this device if needed
-            if (!dev->driver) {
-                device_driver_t *driver = device_find_driver(dev);
-                if (driver) {
-                    log_debug("Found driver '%s' for device '%s'",
-                              driver->name, dev->name);
-                    dev->driver = driver;
-                    
-                    // Set operations from driver if not already set
-                    if (!dev->ops) {
-                        dev->ops = &driver->ops;
-                    }
-                    
-                    // Initialize device if driver provides init function
-                    if (driver->ops.init) {
-                        driver->ops.init(dev);
-                    }
-                }
-            }
-            
-            // Add as child to parent device
-            if (dev->parent) {
-                device_add_child(dev->parent, dev);
-            } else if (dev != root_device) {
-                // If no parent specified, use root device
-                dev->parent = root_device;
-                device_add_child(root_device, dev);
-            }
-            
-            // Generate device path
-            if (dev->parent && dev != root_device) {
-                // Combine parent path with device name
-                snprintf(dev->path, sizeof(dev->path), "%s/%s",
-                         dev->parent->path, dev->name);
+            slot = i;
+            break;
+        }
+    }
+    
+    if (slot < 0) {
+        mutex_unlock(&devices_lock);
+        if (driver) {
+            dev->driver = NULL;
+            if (dev->ops == &driver->ops) {
+                dev->ops = NULL;
             }
-            
-            return DEVICE_OK;
         }
+        log_error("Failed to register device '%s'", dev->name);
+        return DEVICE_ERROR_RESOURCE;
+    }
+    
+    // Generate device path
+    if (dev->parent && dev != root_device) {
+        // Combine parent path with device name
+        snprintf(dev->path, sizeof(dev->path), "%s/%s",
+                 dev->parent->path, dev->name);
     }
     
-    log_error("Failed to register device '%s'", dev->name);
-    return DEVICE_ERROR_RESOURCE;
+    rcu_assign_pointer(devices[slot], dev);
+    num_devices++;
+    mutex_unlock(&devices_lock);
+    
+    log_info("Registered device: %s (ID: %u, Type: 0x%02X)",
+             dev->name, dev->id, dev->type);
+    
+    // The driver may register child devices, so it starts once this one is visible
+    if (driver && driver->ops.init) {
+        driver->ops.init(dev);
+    }
+    
+    // Add as child to parent device
+    if (dev->parent) {
+        device_add_child(dev->parent, dev);
+    }
+    
+    return DEVICE_OK;
 }
 
 /**
@@ -171,49 +193,55 @@ int device_unregister(device_t *dev) {
         return DEVICE_ERROR_INVALID;
     }
     
-    // Find device in array
+    // Remove from device array
     int found = 0;
+    mutex_lock(&devices_lock);
     for (int i = 0; i < MAX_DEVICES; i++) {
         if (devices[i] == dev) {
+            devices[i] = NULL;
+            num_devices--;
             found = 1;
-            
-            // Remove references from child devices
-            if (dev->children) {
-                for (int j = 0; j < dev->num_children; j++) {
-                    if (dev->children[j]) {
-                        if (dev->children[j]->parent == dev) {
-                            dev->children[j]->parent = root_device;
-                        }
-                    }
+            break;
+        }
+    }
+    mutex_unlock(&devices_lock);
+    
+    if (!found) {
+        log_warning("Device '%s' not found for unregistration", dev->name);
+        return DEVICE_ERROR_NO_DEVICE;
+    }
+    
+    // Wait for lookups that may still see the entry before tearing it down
+    synchronize_rcu();
+    
+    // Remove references from child devices
+    if (dev->children) {
+        for (int j = 0; j < dev->num_children; j++) {
+            if (dev->children[j]) {
+                if (dev->children[j]->parent == dev) {
+                    dev->children[j]->parent = root_device;
                 }
-                
-                // Free children array
-                heap_free(dev->children);
             }
-            
-            // Remove from parent's children list
-            if (dev->parent) {
-                device_remove_child(dev->parent, dev);
-            }
-            
-            // Call device cleanup if driver provides remove function
-            if (dev->ops && dev->ops->remove) {
-                dev->ops->remove(dev);
-            }
-            
-            // Remove from device array
-            devices[i] = NULL;
-            num_devices--;
-            
-            log_info("Unregistered device: %s (ID: %u)",
-                     dev->name, dev->id);
-            
-            return DEVICE_OK;
         }
+        
+        // Free children array
+        heap_free(dev->children);
     }
     
-    log_warning("Device '%s' not found for unregistration", dev->name);
-    return DEVICE_ERROR_NO_DEVICE;
+    // Remove from parent's children list
+    if (dev->parent) {
+        device_remove_child(dev->parent, dev);
+    }
+    
+    // Call device cleanup if driver provides remove function
+    if (dev->ops && dev->ops->remove) {
+        dev->ops->remove(dev);
+    }
+    
+    log_info("Unregistered device: %s (ID: %u)",
+             dev->name, dev->id);
+    
+    return DEVICE_OK;
 }
 
 /**
@@ -309,26 +337,38 @@ device_t *device_find_by_name(const char *name) {
         return NULL;
     }
     
+    device_t *found = NULL;
+    
+    rcu_read_lock();
     for (int i = 0; i < MAX_DEVICES; i++) {
-        if (devices[i] && strcmp(devices[i]->name, name) == 0) {
-            return devices[i];
+        device_t *dev = rcu_dereference(devices[i]);
+        if (dev && strcmp(dev->name, name) == 0) {
+            found = dev;
+            break;
         }
     }
+    rcu_read_unlock();
     
-    return NULL;
+    return found;
 }
 
 /**
  * Find a device by ID
  */
 device_t *device_find_by_id(uint32_t id) {
+    device_t *found = NULL;
+    
+    rcu_read_lock();
     for (int i = 0; i < MAX_DEVICES; i++) {
-        if (devices[i] && devices[i]->id == id) {
-            return devices[i];
+        device_t *dev = rcu_dereference(devices[i]);
+        if (dev && dev->id == id) {
+            found = dev;
+            break;
         }
     }
+    rcu_read_unlock();
     
-    return NULL;
+    return found;
 }
 
 /**
@@ -341,11 +381,14 @@ int device_find_by_type(uint8_t type, device_t **result, int max_devices) {
     
     int count = 0;
     
+    rcu_read_lock();
     for (int i = 0; i < MAX_DEVICES && count < max_devices; i++) {
-        if (devices[i] && devices[i]->type == type) {
-            result[count++] = devices[i];
+        device_t *dev = rcu_dereference(devices[i]);
+        if (dev && dev->type == type) {
+            result[count++] = dev;
         }
     }
+    rcu_read_unlock();
     
     return count;
 }
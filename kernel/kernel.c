@@ -13,9 +13,14 @@
 #include "module.h" // Include the module system header
 #include "syscall.h" // Include the syscall header
 #include "preempt.h" // Include preemptive scheduling header
+#include "scheduler.h"
+#include "ktimer.h"
+#include "crc32c.h"
 #include "exception_handlers.h" // Include exception handlers
 #include "irq_asm.h" // Include assembly IRQ handling
 #include "../filesystem/fat12.h"
+#include "../filesystem/ext2/ext2.h"
+#include "../filesystem/vfs/vfs.h"
 #include "../memory/paging.h"
 #include "../memory/heap.h"
 #include "../hal/include/hal.h"
@@ -23,9 +28,12 @@
 #include "../kernel/logging/log.h"
 #include "../kernel/virtualization/vmx.h"
 #include "../kernel/virtualization/vm_memory.h"
+#include "../network/include/network.h"
+#include "../network/include/tcp.h"
 #include "../drivers/pci/pci.h" // Include PCI driver framework
 #include "../drivers/network/rtl8139.h" // Include RTL8139 network driver
 #include "../drivers/audio/ac97.h" // Include AC97 audio driver
+#include "../drivers/storage/ata/ata.h" // Include ATA PIO disk driver
 
 // Define system version constants
 #define SYSTEM_VERSION "1.0.0"
@@ -466,6 +474,11 @@ void initialize_system() {
             hal_timer_start(0);
             log_info("KERNEL", "Preemptive scheduling timer configured successfully (100Hz)");
         }
+        
+#ifdef KERNEL_BOOT_TESTS
+        // The timer is calibrated now, so the page allocator can be measured
+        paging_run_benchmark();
+#endif
     } else {
         // Direct hardware access for timer configuration
         log_info("KERNEL", "Configuring PIT timer for preemptive scheduling...");
@@ -485,6 +498,9 @@ void initialize_system() {
         
         log_info("KERNEL", "PIT timer configured for preemptive scheduling (100Hz)");
     }
+    
+    // Kernel timeouts (sleeps, TCP/DNS timers) run off the timer wheel
+    ktimer_subsystem_init();
       // Initialize task management
     log_info("KERNEL", "Initializing multitasking...");
     initialize_multitasking();
@@ -500,11 +516,31 @@ void initialize_system() {
         log_error("KERNEL", "Failed to initialize preemptive multitasking");
     }
     
+#ifdef KERNEL_BOOT_TESTS
+    // Measure the per-CPU run queue pick and steal paths
+    scheduler_run_benchmark();
+#endif
+    
+    // Pick the CRC32C implementation (and measure each one in test builds)
+#ifdef KERNEL_BOOT_TESTS
+    crc32c_run_benchmark();
+#else
+    crc32c_init();
+#endif
+    
+    // Replace the periodic tick with LAPIC one-shot deadlines when possible
+    if (is_preemption_enabled() && preempt_enable_tickless() != 0) {
+        log_info("KERNEL", "Staying on the periodic scheduler tick");
+    }
+    
     // Initialize threading system
     log_info("KERNEL", "Initializing threading system...");
     thread_init();
     log_info("KERNEL", "Threading system initialized");
     
+    // Pre-zero free pages in the background so allocations skip the memset
+    paging_start_zero_thread();
+    
     // Initialize inter-process communication (IPC)
     log_info("KERNEL", "Initializing IPC subsystem...");
     ipc_init();
@@ -529,6 +565,9 @@ void initialize_system() {
     // Initialize individual filesystems
     log_info("KERNEL", "Initializing filesystem drivers...");
     fat12_init();
+    
+    // The ext2 volume lives on the secondary IDE master
+    ata_register_disk(ATA_CHANNEL_SECONDARY, ATA_DRIVE_MASTER, "ext2_disk");
     ext2_init("ext2_disk");
     iso9660_init("cdrom");
     exfat_init("exfat_disk");
@@ -542,6 +581,31 @@ void initialize_system() {
     
     log_info("KERNEL", "All filesystems registered and mounted");
     
+#ifdef KERNEL_BOOT_TESTS
+    // Measure ext2 streaming throughput when the volume carries a benchmark file
+    ext2_run_benchmark("/bench.dat");
+    
+    // Crash the journal at every write of a small workload and check recovery
+    vfs_journal_run_crash_test();
+#endif
+    
+    // Bring up the protocol stack before any NIC driver hands it frames
+    log_info("KERNEL", "Initializing network stack...");
+    if (network_init_enhanced() != 0) {
+        log_error("KERNEL", "Network stack initialization failed");
+    } else {
+        // Received frames and protocol timers are processed by this thread
+        network_start_thread();
+        
+#ifdef KERNEL_BOOT_TESTS
+        // Measure the in-place receive path on the loopback interface
+        network_run_rx_benchmark();
+        
+        // Compare congestion control algorithms over emulated lossy links
+        tcp_cong_run_benchmark();
+#endif
+    }
+    
     // Initialize PCI subsystem
     log_info("KERNEL", "Initializing PCI subsystem...");
     int pci_result = pci_init();
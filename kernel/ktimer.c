@@ -0,0 +1,329 @@
+/**
+ * @file ktimer.c
+ * @brief Hierarchical timing wheel for kernel timeouts
+ *
+ * The root wheel has one slot per millisecond for the next 256 ms. Each
+ * level above it covers 64 times the span of the one below. A timer is
+ * hashed into the finest level whose span still contains its expiry, and
+ * is moved down ("cascaded") when the root wheel wraps and its slot comes
+ * up. Arm and cancel only touch a doubly linked slot list.
+ */
+
+#include "ktimer.h"
+#include "sync.h"
+#include "logging/log.h"
+#include <stddef.h>
+
+extern uint64_t hal_time_now_ns(void);
+
+#define KTIMER_ROOT_MASK   (KTIMER_ROOT_SIZE - 1)
+#define KTIMER_LEVEL_MASK  (KTIMER_LEVEL_SIZE - 1)
+
+// Index of a time within a level above the root (level 0 is the first one)
+#define KTIMER_LEVEL_INDEX(t, level) \
+    ((uint32_t)((t) >> (KTIMER_ROOT_BITS + (level) * KTIMER_LEVEL_BITS)) & KTIMER_LEVEL_MASK)
+
+static struct {
+    ktimer_t* root[KTIMER_ROOT_SIZE];
+    ktimer_t* levels[KTIMER_LEVELS][KTIMER_LEVEL_SIZE];
+    uint64_t base;               // Next millisecond to be processed
+    spinlock_t lock;             // Protects the slots, base and stats
+    ktimer_stats_t stats;
+    ktimer_arm_hook_t arm_hook;  // Tickless mode: reprogram the next interrupt
+    int initialized;
+} wheel;
+
+// Disable local interrupts, returning the previous EFLAGS
+static inline uint32_t ktimer_irq_save(void) {
+    uint32_t eflags;
+    asm volatile("pushf\n\tpop %0\n\tcli" : "=r"(eflags) : : "memory");
+    return eflags;
+}
+
+// Restore local interrupts from a saved EFLAGS value
+static inline void ktimer_irq_restore(uint32_t eflags) {
+    if (eflags & 0x200) {
+        asm volatile("sti" : : : "memory");
+    }
+}
+
+/**
+ * Link a timer into the slot matching its expiry (wheel lock held)
+ */
+static void ktimer_enqueue(ktimer_t* timer) {
+    uint64_t expires = timer->expires;
+    if (expires < wheel.base) {
+        expires = wheel.base;
+    }
+    uint64_t delta = expires - wheel.base;
+    ktimer_t** slot;
+
+    if (delta < KTIMER_ROOT_SIZE) {
+        slot = &wheel.root[expires & KTIMER_ROOT_MASK];
+    } else {
+        int level = 0;
+        while (level < KTIMER_LEVELS - 1 &&
+               delta >= (1ULL << (KTIMER_ROOT_BITS + (level + 1) * KTIMER_LEVEL_BITS))) {
+            level++;
+        }
+        slot = &wheel.levels[level][KTIMER_LEVEL_INDEX(expires, level)];
+    }
+
+    timer->slot = slot;
+    timer->prev = NULL;
+    timer->next = *slot;
+    if (*slot) {
+        (*slot)->prev = timer;
+    }
+    *slot = timer;
+}
+
+/**
+ * Unlink a timer from its slot (wheel lock held)
+ */
+static void ktimer_unlink(ktimer_t* timer) {
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        *timer->slot = timer->next;
+    }
+    if (timer->next) {
+        timer->next->prev = timer->prev;
+    }
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->slot = NULL;
+}
+
+/**
+ * Re-hash every timer of a higher-level slot into the levels below
+ *
+ * @return 1 if the slot at the next level up must be cascaded as well
+ */
+static int ktimer_cascade(int level) {
+    uint32_t index = KTIMER_LEVEL_INDEX(wheel.base, level);
+    ktimer_t* timer = wheel.levels[level][index];
+    wheel.levels[level][index] = NULL;
+
+    while (timer) {
+        ktimer_t* next = timer->next;
+        ktimer_enqueue(timer);
+        wheel.stats.cascades++;
+        timer = next;
+    }
+
+    return index == 0;
+}
+
+void ktimer_subsystem_init(void) {
+    for (int i = 0; i < KTIMER_ROOT_SIZE; i++) {
+        wheel.root[i] = NULL;
+    }
+    for (int level = 0; level < KTIMER_LEVELS; level++) {
+        for (int i = 0; i < KTIMER_LEVEL_SIZE; i++) {
+            wheel.levels[level][i] = NULL;
+        }
+    }
+
+    spinlock_init(&wheel.lock);
+    wheel.stats = (ktimer_stats_t){0};
+    wheel.base = ktimer_now_ms();
+    wheel.initialized = 1;
+
+    log_info("KTIMER", "Timer wheel initialized (%d root slots, %d levels, max delay %u ms)",
+             KTIMER_ROOT_SIZE, KTIMER_LEVELS, KTIMER_MAX_DELAY);
+}
+
+void ktimer_init(ktimer_t* timer, ktimer_callback_t callback, void* data) {
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->slot = NULL;
+    timer->expires = 0;
+    timer->callback = callback;
+    timer->data = data;
+    timer->pending = 0;
+}
+
+void ktimer_arm(ktimer_t* timer, uint32_t delay_ms) {
+    if (!timer || !timer->callback) {
+        return;
+    }
+    if (delay_ms > KTIMER_MAX_DELAY) {
+        delay_ms = KTIMER_MAX_DELAY;
+    }
+
+    uint32_t eflags = ktimer_irq_save();
+    spinlock_acquire(&wheel.lock);
+
+    if (timer->pending) {
+        ktimer_unlink(timer);
+    } else {
+        timer->pending = 1;
+        wheel.stats.pending++;
+    }
+
+    // Round the current time up so a timer never fires early, and keep the
+    // expiry at or past the wheel's base so the slot maths never sees a time
+    // that has already been processed
+    uint64_t now = (hal_time_now_ns() + 999999ULL) / 1000000ULL;
+    timer->expires = (now > wheel.base ? now : wheel.base) + delay_ms;
+    ktimer_enqueue(timer);
+    wheel.stats.armed++;
+
+    uint64_t expires = timer->expires;
+    ktimer_arm_hook_t hook = wheel.arm_hook;
+
+    spinlock_release(&wheel.lock);
+
+    if (hook) {
+        hook(expires);
+    }
+    ktimer_irq_restore(eflags);
+}
+
+int ktimer_cancel(ktimer_t* timer) {
+    if (!timer) {
+        return 0;
+    }
+
+    uint32_t eflags = ktimer_irq_save();
+    spinlock_acquire(&wheel.lock);
+
+    int was_pending = timer->pending;
+    if (was_pending) {
+        ktimer_unlink(timer);
+        timer->pending = 0;
+        wheel.stats.pending--;
+        wheel.stats.cancelled++;
+    }
+
+    spinlock_release(&wheel.lock);
+    ktimer_irq_restore(eflags);
+    return was_pending;
+}
+
+int ktimer_expedite(ktimer_t* timer) {
+    if (!timer) {
+        return 0;
+    }
+
+    uint32_t eflags = ktimer_irq_save();
+    spinlock_acquire(&wheel.lock);
+
+    int was_pending = timer->pending;
+    if (was_pending && timer->expires > wheel.base) {
+        ktimer_unlink(timer);
+        timer->expires = wheel.base;
+        ktimer_enqueue(timer);
+    }
+
+    ktimer_arm_hook_t hook = was_pending ? wheel.arm_hook : NULL;
+    uint64_t expires = timer->expires;
+
+    spinlock_release(&wheel.lock);
+
+    if (hook) {
+        hook(expires);
+    }
+    ktimer_irq_restore(eflags);
+    return was_pending;
+}
+
+int ktimer_pending(const ktimer_t* timer) {
+    return timer && timer->pending;
+}
+
+uint64_t ktimer_now_ms(void) {
+    return hal_time_now_ns() / 1000000ULL;
+}
+
+uint64_t ktimer_next_expiry_ms(void) {
+    uint32_t eflags = ktimer_irq_save();
+    spinlock_acquire(&wheel.lock);
+
+    uint64_t next = KTIMER_NO_EXPIRY;
+    if (wheel.stats.pending > 0) {
+        // Timers beyond the root wheel only move closer at the next cascade
+        next = (wheel.base | KTIMER_ROOT_MASK) + 1;
+        for (uint64_t t = wheel.base; t < next; t++) {
+            if (wheel.root[t & KTIMER_ROOT_MASK]) {
+                next = t;
+                break;
+            }
+        }
+    }
+
+    spinlock_release(&wheel.lock);
+    ktimer_irq_restore(eflags);
+    return next;
+}
+
+void ktimer_set_arm_hook(ktimer_arm_hook_t hook) {
+    wheel.arm_hook = hook;
+}
+
+void ktimer_run(void) {
+    if (!wheel.initialized) {
+        return;
+    }
+
+    uint32_t eflags = ktimer_irq_save();
+    uint64_t now = ktimer_now_ms();
+    spinlock_acquire(&wheel.lock);
+
+    while (wheel.base <= now) {
+        // Nothing armed: skip straight to the present instead of walking empty slots
+        if (wheel.stats.pending == 0) {
+            wheel.base = now + 1;
+            break;
+        }
+
+        uint32_t index = (uint32_t)(wheel.base & KTIMER_ROOT_MASK);
+        if (index == 0) {
+            for (int level = 0; level < KTIMER_LEVELS; level++) {
+                if (!ktimer_cascade(level)) {
+                    break;
+                }
+            }
+        }
+
+        // Detach the whole slot before running callbacks so timers re-armed
+        // for "now" land in the next millisecond instead of this list
+        ktimer_t* list = wheel.root[index];
+        wheel.root[index] = NULL;
+        for (ktimer_t* t = list; t; t = t->next) {
+            t->slot = &list;
+        }
+        wheel.base++;
+
+        while (list) {
+            ktimer_t* timer = list;
+            ktimer_unlink(timer);
+            timer->pending = 0;
+            wheel.stats.pending--;
+            wheel.stats.expired++;
+
+            ktimer_callback_t callback = timer->callback;
+            void* data = timer->data;
+
+            spinlock_release(&wheel.lock);
+            callback(timer, data);
+            spinlock_acquire(&wheel.lock);
+        }
+    }
+
+    spinlock_release(&wheel.lock);
+    ktimer_irq_restore(eflags);
+}
+
+void ktimer_get_stats(ktimer_stats_t* stats) {
+    if (!stats) {
+        return;
+    }
+
+    uint32_t eflags = ktimer_irq_save();
+    spinlock_acquire(&wheel.lock);
+    *stats = wheel.stats;
+    spinlock_release(&wheel.lock);
+    ktimer_irq_restore(eflags);
+}
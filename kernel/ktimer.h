@@ -0,0 +1,156 @@
+/**
+ * @file ktimer.h
+ * @brief Hierarchical timing wheel for kernel timeouts
+ *
+ * Timers are intrusive: callers embed a ktimer_t in their own structure
+ * (task, socket, DNS query, ...) so arming a timer never allocates. The
+ * wheel has a 1 ms resolution and four levels, giving O(1) arm and cancel
+ * and amortised O(1) expiry through cascading.
+ *
+ * Expired callbacks run from the timer interrupt with interrupts disabled
+ * and the wheel unlocked: on the boot CPU with the periodic tick, on any
+ * CPU in tickless mode. They may re-arm or cancel any timer, including
+ * their own, but must not sleep.
+ */
+
+#ifndef KTIMER_H
+#define KTIMER_H
+
+#include <stdint.h>
+
+/**
+ * Wheel geometry: 256 one-millisecond slots, then three levels of 64
+ * slots each, covering roughly 18.6 hours. Longer delays are clamped.
+ */
+#define KTIMER_ROOT_BITS    8
+#define KTIMER_LEVEL_BITS   6
+#define KTIMER_ROOT_SIZE    (1 << KTIMER_ROOT_BITS)
+#define KTIMER_LEVEL_SIZE   (1 << KTIMER_LEVEL_BITS)
+#define KTIMER_LEVELS       3    // Levels above the root
+#define KTIMER_MAX_DELAY    ((1u << (KTIMER_ROOT_BITS + KTIMER_LEVELS * KTIMER_LEVEL_BITS)) - 1)
+#define KTIMER_NO_EXPIRY    UINT64_MAX    // No timer is armed
+
+struct ktimer;
+
+/**
+ * Expiry callback
+ *
+ * @param timer The timer that expired
+ * @param data Caller data given to ktimer_init()
+ */
+typedef void (*ktimer_callback_t)(struct ktimer* timer, void* data);
+
+/**
+ * Called after a timer is armed, with its expiry in milliseconds (used by
+ * tickless mode to pull the next timer interrupt forward)
+ */
+typedef void (*ktimer_arm_hook_t)(uint64_t expires_ms);
+
+/**
+ * Intrusive timer node
+ */
+typedef struct ktimer {
+    struct ktimer* next;         // Next timer in the same wheel slot
+    struct ktimer* prev;         // Previous timer in the same wheel slot
+    struct ktimer** slot;        // Wheel slot the timer is linked on
+    uint64_t expires;            // Absolute expiry time in milliseconds
+    ktimer_callback_t callback;  // Called on expiry
+    void* data;                  // Passed to the callback
+    int pending;                 // Non-zero while the timer is armed
+} ktimer_t;
+
+/**
+ * Timer wheel statistics
+ */
+typedef struct {
+    uint32_t pending;            // Timers currently armed
+    uint32_t armed;              // Total ktimer_arm() calls
+    uint32_t cancelled;          // Timers cancelled before expiry
+    uint32_t expired;            // Callbacks run
+    uint32_t cascades;           // Timers moved down a level
+} ktimer_stats_t;
+
+/**
+ * Initialize the timer wheel (needs a calibrated HAL timer)
+ */
+void ktimer_subsystem_init(void);
+
+/**
+ * Prepare a timer node before first use
+ *
+ * @param timer Timer to initialize
+ * @param callback Function called on expiry
+ * @param data Argument passed to the callback
+ */
+void ktimer_init(ktimer_t* timer, ktimer_callback_t callback, void* data);
+
+/**
+ * Arm (or re-arm) a timer to fire after a delay
+ *
+ * @param timer Initialized timer
+ * @param delay_ms Delay in milliseconds (0 fires on the next tick)
+ */
+void ktimer_arm(ktimer_t* timer, uint32_t delay_ms);
+
+/**
+ * Disarm a timer
+ *
+ * @param timer Timer to cancel
+ * @return 1 if the timer was pending, 0 if it had already fired or was never armed
+ */
+int ktimer_cancel(ktimer_t* timer);
+
+/**
+ * Make an armed timer fire on the next tick; a timer that is not armed is
+ * left alone, so this never races with the owner re-arming it
+ *
+ * @param timer Timer to bring forward
+ * @return 1 if the timer was pending, 0 otherwise
+ */
+int ktimer_expedite(ktimer_t* timer);
+
+/**
+ * Check whether a timer is armed
+ *
+ * @param timer Timer to check
+ * @return 1 if pending, 0 otherwise
+ */
+int ktimer_pending(const ktimer_t* timer);
+
+/**
+ * Current time on the timer wheel's clock
+ *
+ * @return Milliseconds since boot
+ */
+uint64_t ktimer_now_ms(void);
+
+/**
+ * Earliest time the wheel needs to run again
+ *
+ * Exact for timers due within the root wheel's 256 ms span; otherwise the
+ * time of the next cascade, which is never later than the real expiry.
+ *
+ * @return Time in milliseconds, or KTIMER_NO_EXPIRY if no timer is armed
+ */
+uint64_t ktimer_next_expiry_ms(void);
+
+/**
+ * Install the hook called after every ktimer_arm()
+ *
+ * @param hook Hook function, or NULL to remove it
+ */
+void ktimer_set_arm_hook(ktimer_arm_hook_t hook);
+
+/**
+ * Run every timer that has expired by now (called from the timer interrupt)
+ */
+void ktimer_run(void);
+
+/**
+ * Get timer wheel statistics
+ *
+ * @param stats Output statistics
+ */
+void ktimer_get_stats(ktimer_stats_t* stats);
+
+#endif /* KTIMER_H */
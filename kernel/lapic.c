@@ -44,3 +44,16 @@ void uintos_lapic_set_divide_config(uint32_t divider) {
     uintos_defpointer(uint32_t, divider_register, UINTOS_TIMER_DIVIDE_CONFIG_REG);
     *divider_register = divider;
 }
+
+void uintos_lapic_send_ipi(uint8_t apic_id, uint8_t vector) {
+    uintos_defpointer(uint32_t, icr_low_register, UINTOS_LAPIC_ICR_LOW_REG);
+    uintos_defpointer(uint32_t, icr_high_register, UINTOS_LAPIC_ICR_HIGH_REG);
+
+    // Wait for a previous IPI to be accepted before reusing the ICR
+    while (*icr_low_register & UINTOS_ICR_DELIVERY_PENDING) {
+        asm volatile("pause");
+    }
+    *icr_high_register = UINTOS_ICR_DESTINATION(apic_id);
+    // Fixed delivery, physical destination: writing the low word sends it
+    *icr_low_register = UINTOS_DELIVERY_MODE(0) | UINTOS_VECTOR(vector);
+}
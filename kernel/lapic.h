@@ -16,6 +16,11 @@
 
 #define UINTOS_LAPIC_ERROR_REG ((UINTOS_LAPIC_BASE) + 0x0280)
 
+#define UINTOS_LAPIC_ICR_LOW_REG ((UINTOS_LAPIC_BASE) + 0x0300)
+#define UINTOS_LAPIC_ICR_HIGH_REG ((UINTOS_LAPIC_BASE) + 0x0310)
+#define UINTOS_ICR_DELIVERY_PENDING (1 << 12)
+#define UINTOS_ICR_DESTINATION(apic_id) ((uint32_t)(apic_id) << 24)
+
 // Timer modes
 #define UINTOS_TIMER_ONE_SHOT 0x0
 #define UINTOS_TIMER_PERIODIC 0x1
@@ -57,3 +62,4 @@ uint32_t uintos_lapic_get_error_status();
 void uintos_lapic_set_timer_initial_count(uint32_t count);
 void uintos_lapic_set_divide_config(uint32_t d);
 uint32_t uintos_lapic_get_timer_setting();
+void uintos_lapic_send_ipi(uint8_t apic_id, uint8_t vector);
@@ -12,6 +12,7 @@ static uint8_t log_destinations = LOG_DEST_SCREEN | LOG_DEST_MEMORY;
 static uint8_t log_format_options = LOG_FORMAT_LEVEL | LOG_FORMAT_SOURCE;
 static uint32_t log_timestamp = 0;
 static mutex_t log_mutex; // Mutex for thread-safe logging
+static lock_class_t log_lock_class;
 
 /* Log buffer */
 static char log_buffer[LOG_BUFFER_SIZE];
@@ -77,6 +78,8 @@ int log_init(log_level_t log_level, uint8_t destinations, uint8_t format_options
     
     // Initialize the mutex for thread safety
     mutex_init(&log_mutex);
+    lock_class_init(&log_lock_class, "log");
+    mutex_set_class(&log_mutex, &log_lock_class);
     
     // Clear log buffer
     memset(log_buffer, 0, LOG_BUFFER_SIZE);
@@ -1,5 +1,6 @@
 #include "module.h"
 #include "logging/log.h"
+#include "sync.h"
 #include "memory/heap.h"
 #include "memory/vmm.h"
 #include "filesystem/vfs/vfs.h"
@@ -23,7 +24,8 @@
 #define MODULE_ERROR_INIT       -10
 
 // Module system global state
-static module_t *modules[MAX_MODULES];
+static module_t *modules[MAX_MODULES];   // Published with RCU: lookups take no lock
+static mutex_t modules_lock;             // Serializes module table updates
 static int num_modules = 0;
 static uint32_t next_module_id = 1;
 static int module_system_initialized = 0;
@@ -47,6 +49,7 @@ int module_system_init(void) {
     log_info("Initializing module system");
     
     // Clear module array
+    mutex_init(&modules_lock);
     memset(modules, 0, sizeof(modules));
     num_modules = 0;
     
@@ -83,9 +86,13 @@ int module_register(module_t *module) {
         return MODULE_ERROR_MEMORY;
     }
     
+    // Updates are serialized; readers only ever see fully set up entries
+    mutex_lock(&modules_lock);
+    
     // Check for duplicate name
     for (int i = 0; i < MAX_MODULES; i++) {
         if (modules[i] && strcmp(modules[i]->name, module->name) == 0) {
+            mutex_unlock(&modules_lock);
             log_error("Module '%s' already registered", module->name);
             return MODULE_ERROR_DUPLICATE;
         }
@@ -98,52 +105,61 @@ int module_register(module_t *module) {
     
     // Check dependencies
     if (!module_check_dependencies(module)) {
+        mutex_unlock(&modules_lock);
         log_error("Module '%s' has unmet dependencies", module->name);
         return MODULE_ERROR_DEPENDENCY;
     }
     
     // Add to module array
+    int slot = -1;
     for (int i = 0; i < MAX_MODULES; i++) {
         if (!modules[i]) {
-            modules[i] = module;
-            num_modules++;
-            
-            // Set initial status
-            if (module->status == 0) {
-                module->status = MODULE_STATUS_LOADED;
-            }
-            
-            log_info("Registered module: %s (ID: %u, Version: 0x%08X)",
-                     module->name, module->id, module->version);
-            
-            // Initialize module if it has an init function
-            if (module->init) {
-                int result = module->init();
-                if (result != 0) {
-                    log_error("Module '%s' initialization failed: %d", module->name, result);
-                    module->status = MODULE_STATUS_ERROR;
-                    return MODULE_ERROR_INIT;
-                }
-            }
-            
-            // Start module if it has a start function
-            if (module->start) {
-                int result = module->start();
-                if (result != 0) {
-                    log_warning("Module '%s' failed to start: %d", module->name, result);
-                    // Don't consider this a fatal error - module is registered but not started
-                } else {
-                    log_info("Module '%s' started successfully", module->name);
-                }
-            }
-            
-            return MODULE_ERROR_NONE;
+            slot = i;
+            break;
+        }
+    }
+    
+    if (slot < 0) {
+        // This should never happen (we already checked num_modules < MAX_MODULES)
+        mutex_unlock(&modules_lock);
+        log_error("Failed to register module '%s'", module->name);
+        return MODULE_ERROR_MEMORY;
+    }
+    
+    // Set initial status
+    if (module->status == 0) {
+        module->status = MODULE_STATUS_LOADED;
+    }
+    
+    rcu_assign_pointer(modules[slot], module);
+    num_modules++;
+    mutex_unlock(&modules_lock);
+    
+    log_info("Registered module: %s (ID: %u, Version: 0x%08X)",
+             module->name, module->id, module->version);
+    
+    // Initialize module if it has an init function
+    if (module->init) {
+        int result = module->init();
+        if (result != 0) {
+            log_error("Module '%s' initialization failed: %d", module->name, result);
+            module->status = MODULE_STATUS_ERROR;
+            return MODULE_ERROR_INIT;
         }
     }
     
-    // This should never happen (we already checked num_modules < MAX_MODULES)
-    log_error("Failed to register module '%s'", module->name);
-    return MODULE_ERROR_MEMORY;
+    // Start module if it has a start function
+    if (module->start) {
+        int result = module->start();
+        if (result != 0) {
+            log_warning("Module '%s' failed to start: %d", module->name, result);
+            // Don't consider this a fatal error - module is registered but not started
+        } else {
+            log_info("Module '%s' started successfully", module->name);
+        }
+    }
+    
+    return MODULE_ERROR_NONE;
 }
 
 /**
@@ -166,77 +182,83 @@ int module_unregister(module_t *module) {
         return MODULE_ERROR_PERMISSION;
     }
     
-    // Find module in array
+    // Remove from module array
     int found = 0;
+    mutex_lock(&modules_lock);
     for (int i = 0; i < MAX_MODULES; i++) {
         if (modules[i] == module) {
-            found = 1;
-            
-            // Stop module if it has a stop function
-            if (module->stop) {
-                int result = module->stop();
-                if (result != 0) {
-                    log_warning("Module '%s' failed to stop cleanly: %d", module->name, result);
-                    // Continue with unregistration anyway
-                } else {
-                    log_info("Module '%s' stopped successfully", module->name);
-                }
-            }
-            
-            // Call module cleanup if it has an exit function
-            if (module->exit) {
-                int result = module->exit();
-                if (result != 0) {
-                    log_warning("Module '%s' cleanup failed: %d", module->name, result);
-                    // Continue with unregistration anyway
-                }
-            }
-            
-            // Remove all drivers registered by this module
-            if (module->drivers) {
-                for (int j = 0; j < module->num_drivers; j++) {
-                    if (module->drivers[j]) {
-                        device_driver_unregister(module->drivers[j]);
-                    }
-                }
-                heap_free(module->drivers);
-                module->drivers = NULL;
-                module->num_drivers = 0;
-            }
-            
-            // Free dependency list
-            module_dependency_t *dep = module->dependencies;
-            while (dep) {
-                module_dependency_t *next = dep->next;
-                heap_free(dep);
-                dep = next;
-            }
-            module->dependencies = NULL;
-            
-            // Free interface list
-            module_interface_t *iface = module->interfaces;
-            while (iface) {
-                module_interface_t *next = iface->next;
-                heap_free(iface);
-                iface = next;
-            }
-            module->interfaces = NULL;
-            
-            // Update module status
-            module->status = MODULE_STATUS_UNLOADED;
-            
-            // Remove from module array
             modules[i] = NULL;
             num_modules--;
-            
-            log_info("Unregistered module: %s", module->name);
-            
-            return MODULE_ERROR_NONE;
+            found = 1;
+            break;
         }
     }
+    mutex_unlock(&modules_lock);
     
-    log_warning("Module '%s' not found for unregistration", module->name);
-    return MODULE_ERROR_NOT_FOUND;
+    if (!found) {
+        log_warning("Module '%s' not found for unregistration", module->name);
+        return MODULE_ERROR_NOT_FOUND;
+    }
+    
+    // Wait for lookups that may still see the entry before tearing it down
+    synchronize_rcu();
+    
+    // Stop module if it has a stop function
+    if (module->stop) {
+        int result = module->stop();
+        if (result != 0) {
+            log_warning("Module '%s' failed to stop cleanly: %d", module->name, result);
+            // Continue with unregistration anyway
+        } else {
+            log_info("Module '%s' stopped successfully", module->name);
+        }
+    }
+    
+    // Call module cleanup if it has an exit function
+    if (module->exit) {
+        int result = module->exit();
+        if (result != 0) {
+            log_warning("Module '%s' cleanup failed: %d", module->name, result);
+            // Continue with unregistration anyway
+        }
+    }
+    
+    // Remove all drivers registered by this module
+    if (module->drivers) {
+        for (int j = 0; j < module->num_drivers; j++) {
+            if (module->drivers[j]) {
+                device_driver_unregister(module->drivers[j]);
+            }
+        }
+        heap_free(module->drivers);
+        module->drivers = NULL;
+        module->num_drivers = 0;
+    }
+    
+    // Free dependency list
+    module_dependency_t *dep = module->dependencies;
+    while (dep) {
+        module_dependency_t *next = dep->next;
+        heap_free(dep);
+        dep = next;
+    }
+    module->dependencies = NULL;
+    
+    // Free interface list
+    module_interface_t *iface = module->interfaces;
+    while (iface) {
+        module_interface_t *next = iface->next;
+        heap_free(iface);
+        iface = next;
+    }
+    module->interfaces = NULL;
+    
+    // Update module status
+    module->status = MODULE_STATUS_UNLOADED;
+    
+    log_info("Unregistered module: %s", module->name);
+    
+    return MODULE_ERROR_NONE;
 }
 
 /**
@@ -431,13 +453,19 @@ module_t *module_find_by_name(const char *name) {
         return NULL;
     }
     
+    module_t *found = NULL;
+    
+    rcu_read_lock();
     for (int i = 0; i < MAX_MODULES; i++) {
-        if (modules[i] && strcmp(modules[i]->name, name) == 0) {
-            return modules[i];
+        module_t *module = rcu_dereference(modules[i]);
+        if (module && strcmp(module->name, name) == 0) {
+            found = module;
+            break;
         }
     }
+    rcu_read_unlock();
     
-    return NULL;
+    return found;
 }
 
 /**
@@ -448,13 +476,19 @@ module_t *module_find_by_id(uint32_t id) {
         return NULL;
     }
     
+    module_t *found = NULL;
+    
+    rcu_read_lock();
     for (int i = 0; i < MAX_MODULES; i++) {
-        if (modules[i] && modules[i]->id == id) {
-            return modules[i];
+        module_t *module = rcu_dereference(modules[i]);
+        if (module && module->id == id) {
+            found = module;
+            break;
         }
     }
+    rcu_read_unlock();
     
-    return NULL;
+    return found;
 }
 
 /**
@@ -467,11 +501,14 @@ int module_list(module_t **result, int max_modules) {
     
     int count = 0;
     
+    rcu_read_lock();
     for (int i = 0; i < MAX_MODULES && count < max_modules; i++) {
-        if (modules[i]) {
-            result[count++] = modules[i];
+        module_t *module = rcu_dereference(modules[i]);
+        if (module) {
+            result[count++] = module;
         }
     }
+    rcu_read_unlock();
     
     return count;
 }
@@ -1,5 +1,6 @@
 #include "preempt.h"
 #include "scheduler.h"
+#include "ktimer.h"
 #include "irq.h"
 #include "lapic.h"
 #include "logging/log.h"
@@ -9,11 +10,19 @@
 // The timer interrupt vector number
 #define TIMER_INTERRUPT_VECTOR 32
 
+// Tickless mode configuration
+#define PREEMPT_MAX_CPUS 16                // Must be >= the scheduler's MAX_CPUS
+#define TICKLESS_MIN_DELAY_NS 20000        // Never program an interrupt closer than 20 us
+
 // Preemption state
 static int preemption_enabled = 0;
 static uint64_t preemption_ticks = 0;
 static uint32_t timer_frequency = 100; // Default to 100Hz (10ms intervals)
 
+// Tickless state: each CPU's LAPIC is armed for its own next deadline
+static int tickless_enabled = 0;
+static volatile uint64_t next_event_ns[PREEMPT_MAX_CPUS]; // Programmed deadline, 0 while stopped
+
 // Preemption statistics
 static struct {
     uint64_t involuntary_switches;   // Number of task switches due to timer preemption
@@ -22,10 +31,13 @@ static struct {
     uint64_t preemption_disabled_time;  // Time spent with preemption disabled
     uint32_t longest_preemption_off;   // Longest stretch with preemption disabled
     uint32_t current_preemption_off;   // Current stretch with preemption disabled
+    uint64_t oneshot_programs;       // One-shot deadlines programmed in tickless mode
+    uint64_t tick_stops;             // Times a CPU went idle with its timer stopped
 } preempt_stats = {0};
 
 // Forward declaration of the timer interrupt handler
 static void timer_interrupt_handler(void* context);
+static void tickless_timer_armed(uint64_t expires_ms);
 
 /**
  * Initialize preemptive multitasking by setting up timer interrupts
@@ -168,6 +180,94 @@ void record_voluntary_switch() {
     preempt_stats.voluntary_switches++;
 }
 
+/**
+ * Switch the LAPIC timer from the periodic tick to one-shot deadlines
+ * 
+ * @return 0 on success, non-zero if the LAPIC timer is not calibrated
+ */
+int preempt_enable_tickless(void) {
+    hal_timer_info_t timer_info;
+    if (hal_timer_get_info(0, &timer_info) != 0 || timer_info.frequency == 0) {
+        log_warning("PREEMPT", "LAPIC timer not calibrated, keeping the %u Hz tick", timer_frequency);
+        return -1;
+    }
+    
+    tickless_enabled = 1;
+    scheduler_set_tickless(1);
+    ktimer_set_arm_hook(tickless_timer_armed);
+    preempt_program_next_event();
+    
+    log_info("PREEMPT", "Tickless mode enabled (LAPIC one-shot at %u Hz)", timer_info.frequency);
+    return 0;
+}
+
+/**
+ * Check whether tickless mode is active
+ * 
+ * @return 1 if enabled, 0 if the periodic tick is used
+ */
+int is_tickless_enabled(void) {
+    return tickless_enabled;
+}
+
+/**
+ * Program this CPU's timer for its next event (tickless mode only)
+ * 
+ * The next event is the earlier of the running task's slice deadline and
+ * the next timer wheel expiry. With neither (idle CPU, no timers) the
+ * timer is stopped until another interrupt arrives.
+ */
+void preempt_program_next_event(void) {
+    if (!tickless_enabled) {
+        return;
+    }
+    
+    int cpu_id = scheduler_get_current_cpu();
+    uint64_t deadline = scheduler_slice_deadline_ns(cpu_id);
+    
+    uint64_t expiry_ms = ktimer_next_expiry_ms();
+    if (expiry_ms != KTIMER_NO_EXPIRY && expiry_ms * 1000000ULL < deadline) {
+        deadline = expiry_ms * 1000000ULL;
+    }
+    
+    if (deadline == UINT64_MAX) {
+        hal_timer_program_oneshot(0, 0);
+        next_event_ns[cpu_id] = 0;
+        preempt_stats.tick_stops++;
+        return;
+    }
+    
+    uint64_t now = hal_time_now_ns();
+    uint64_t delay = deadline > now + TICKLESS_MIN_DELAY_NS ? deadline - now : TICKLESS_MIN_DELAY_NS;
+    next_event_ns[cpu_id] = now + delay;
+    hal_timer_program_oneshot(0, delay);
+    preempt_stats.oneshot_programs++;
+}
+
+/**
+ * Wake a CPU whose timer may be stopped (tickless mode only)
+ * 
+ * @param cpu_id CPU to interrupt
+ */
+void preempt_kick_cpu(int cpu_id) {
+    if (!tickless_enabled || cpu_id < 0 || cpu_id >= PREEMPT_MAX_CPUS) {
+        return;
+    }
+    uintos_lapic_send_ipi((uint8_t)cpu_id, TIMER_INTERRUPT_VECTOR);
+}
+
+/**
+ * Timer wheel hook: pull this CPU's next interrupt forward for a new timer
+ */
+static void tickless_timer_armed(uint64_t expires_ms) {
+    int cpu_id = scheduler_get_current_cpu();
+    uint64_t when = expires_ms * 1000000ULL;
+    
+    if (next_event_ns[cpu_id] == 0 || when < next_event_ns[cpu_id]) {
+        preempt_program_next_event();
+    }
+}
+
 /**
  * Timer interrupt handler - This gets called every time the timer fires
  * 
@@ -193,6 +293,13 @@ static void timer_interrupt_handler(void* context) {
         preempt_stats.current_preemption_off = 0;
     }
     
+    // Expire kernel timers, even with preemption disabled. The periodic tick
+    // leaves this to the boot CPU; in tickless mode whichever CPU programmed
+    // the deadline is the one woken for it
+    if (tickless_enabled || scheduler_get_current_cpu() == 0) {
+        ktimer_run();
+    }
+    
     // If preemption is enabled, process the scheduler tick
     if (preemption_enabled) {
         // Before calling scheduler_tick, remember current task
@@ -207,6 +314,11 @@ static void timer_interrupt_handler(void* context) {
         }
     }
     
+    // One-shot mode: arm the next deadline (also stops the timer when idle)
+    if (tickless_enabled) {
+        preempt_program_next_event();
+    }
+    
     // Acknowledge the interrupt in the Local APIC
     lapic_send_eoi();
 }
@@ -61,4 +61,30 @@ void record_involuntary_switch();
  */
 void record_voluntary_switch();
 
+/**
+ * Switch the LAPIC timer from the periodic tick to one-shot deadlines
+ * 
+ * @return 0 on success, non-zero if the LAPIC timer is not calibrated
+ */
+int preempt_enable_tickless(void);
+
+/**
+ * Check whether tickless mode is active
+ * 
+ * @return 1 if enabled, 0 if the periodic tick is used
+ */
+int is_tickless_enabled(void);
+
+/**
+ * Program this CPU's timer for its next event (tickless mode only)
+ */
+void preempt_program_next_event(void);
+
+/**
+ * Wake a CPU whose timer may be stopped (tickless mode only)
+ * 
+ * @param cpu_id CPU to interrupt
+ */
+void preempt_kick_cpu(int cpu_id);
+
 #endif /* PREEMPT_H */
@@ -6,29 +6,37 @@
 #include "../memory/vmm.h"
 #include "../memory/aslr.h"
 #include "lapic.h"
+#include "preempt.h"
 #include <string.h>
 
+extern uint64_t hal_time_now_ns(void);
+
 // Scheduler configuration
 #define MAX_TASKS 256
 #define MAX_PRIORITY 32
 #define TIME_SLICE_BASE 10  // Base time slice in milliseconds
 #define TIME_SLICE_PRIORITY_FACTOR 2  // Additional ms per priority level
 #define MAX_CPUS 16  // Maximum supported CPU cores
+#define TASK_HASH_BUCKETS 64  // Buckets in the task id hash (power of two)
+#define TASK_HASH(id) ((uint32_t)(id) & (TASK_HASH_BUCKETS - 1))
 
-// Task queue for each priority level
+// Intrusive FIFO of ready tasks of a single priority (linked through task_t.rq_next/rq_prev)
 typedef struct {
-    task_t* tasks[MAX_TASKS];
-    int head;
-    int tail;
+    task_t* head;
+    task_t* tail;
     int count;
-} task_queue_t;
+} run_list_t;
 
-// Sleeping task structure
-typedef struct sleeping_task {
-    task_t* task;
-    uint64_t wake_time;  // Tick count when task should wake up
-    struct sleeping_task* next;
-} sleeping_task_t;
+// Per-CPU run queue: one FIFO per priority plus a bitmap of non-empty FIFOs
+typedef struct {
+    spinlock_t lock;                      // Protects the queues, bitmap and count
+    run_list_t queues[MAX_PRIORITY];      // Ready tasks of each priority
+    uint32_t bitmap;                      // Bit N set when queues[N] is non-empty
+    volatile int nr_ready;                // Queued tasks (read locklessly to balance)
+    task_t* idle_task;                    // Idle task of this CPU, if one was registered
+    uint32_t lock_contended;              // Times the lock was found already held
+    uint32_t tasks_stolen;                // Tasks pulled in from other CPUs
+} run_queue_t;
 
 // Child task wait entry
 typedef struct waiting_parent {
@@ -45,18 +53,19 @@ typedef struct {
     int is_active;              // Whether this CPU is running
     uint64_t total_switches;    // Task switches on this CPU
     uint64_t idle_ticks;        // Idle ticks on this CPU
-    task_queue_t local_queue;   // CPU-local task queue
+    int balance_counter;        // Switches since the last load balancing pass
+    run_queue_t rq;             // Tasks this CPU schedules from
 } cpu_state_t;
 
 // Global scheduler state
 static struct {
-    task_queue_t ready_queues[MAX_PRIORITY];  // Ready queues for each priority
-    sleeping_task_t* sleeping_tasks;          // List of sleeping tasks
+    task_t* task_hash[TASK_HASH_BUCKETS];     // All scheduler tasks, chained by id
+    volatile int nr_sleeping;                 // Tasks waiting on their sleep timer
     waiting_parent_t* waiting_parents;        // List of waiting parents
     task_t* idle_task;                        // Idle task (runs when nothing else can)
-    spinlock_t lock;                          // Scheduler lock
+    spinlock_t lock;                          // Protects task creation, the id hash and the wait lists
     int preemption_enabled;                   // Whether preemption is enabled
-    uint64_t total_switches;                  // Total number of task switches
+    int tickless;                             // Slices end at deadlines, not by counting ticks
     uint64_t scheduler_ticks;                 // Total scheduler ticks since boot
     int next_task_id;                         // Next task ID to assign
     int algorithm;                            // Current scheduling algorithm
@@ -66,18 +75,23 @@ static struct {
     int num_cpus;                             // Number of available CPUs
     cpu_state_t cpu_states[MAX_CPUS];         // Per-CPU state
     spinlock_t smp_lock;                      // Lock for SMP operations
-    int load_balance_counter;                 // Counter for periodic load balancing
 } scheduler;
 
+// Statistics class shared by the per-CPU run queue locks
+static lock_class_t rq_lock_class;
+
 // Forward declarations for internal functions
 static void scheduler_add_task(task_t* task);
-static task_t* scheduler_get_next_task(void);
-static void scheduler_add_sleeping_task(task_t* task, uint64_t wake_time_ms);
-static void scheduler_check_sleeping_tasks(void);
+static task_t* scheduler_get_next_task(int cpu_id);
+static void scheduler_add_sleeping_task(task_t* task, uint32_t sleep_ms);
+static void scheduler_sleep_expired(ktimer_t* timer, void* data);
 static void scheduler_check_waiting_parents(int task_id, int exit_code);
-static void scheduler_remove_task_from_ready_queue(int task_id);
+static void scheduler_remove_task_from_ready_queue(task_t* task);
+static void scheduler_hash_task(task_t* task);
+static void scheduler_unhash_task(task_t* task);
 static int scheduler_smp_get_target_cpu(void);
-static void scheduler_load_balance(void);
+static void scheduler_load_balance(int cpu_id);
+static task_t* scheduler_steal_tasks(int cpu_id, int busiest, int max_tasks);
 
 // Initialize the scheduler
 void scheduler_init(void) {
@@ -87,7 +101,7 @@ void scheduler_init(void) {
     memset(&scheduler, 0, sizeof(scheduler));
     scheduler.preemption_enabled = 0;   // Start with preemption disabled
     scheduler.next_task_id = 1;         // Start task IDs at 1
-    scheduler.sleeping_tasks = NULL;    // No sleeping tasks at start
+    scheduler.nr_sleeping = 0;          // No sleeping tasks at start
     scheduler.waiting_parents = NULL;   // No waiting parents at start
     scheduler.algorithm = SCHEDULER_ALGORITHM_PRIORITY; // Default to priority scheduling
     scheduler.quantum_ms = TIME_SLICE_BASE; // Default quantum
@@ -96,11 +110,11 @@ void scheduler_init(void) {
     spinlock_init(&scheduler.lock);
     spinlock_init(&scheduler.smp_lock);
     
-    // Initialize ready queues
-    for (int i = 0; i < MAX_PRIORITY; i++) {
-        scheduler.ready_queues[i].head = 0;
-        scheduler.ready_queues[i].tail = 0;
-        scheduler.ready_queues[i].count = 0;
+    // Initialize run queues (all empty after the memset above)
+    lock_class_init(&rq_lock_class, "runqueue");
+    for (int i = 0; i < MAX_CPUS; i++) {
+        spinlock_init(&scheduler.cpu_states[i].rq.lock);
+        spinlock_set_class(&scheduler.cpu_states[i].rq.lock, &rq_lock_class);
     }
     
     // Initialize CPU states (at least CPU 0)
@@ -124,9 +138,7 @@ void scheduler_init_smp(int num_cpus) {
         scheduler.cpu_states[i].current_task = NULL;
         scheduler.cpu_states[i].total_switches = 0;
         scheduler.cpu_states[i].idle_ticks = 0;
-        scheduler.cpu_states[i].local_queue.head = 0;
-        scheduler.cpu_states[i].local_queue.tail = 0;
-        scheduler.cpu_states[i].local_queue.count = 0;
+        scheduler.cpu_states[i].balance_counter = 0;
     }
     
     spinlock_release(&scheduler.smp_lock);
@@ -134,76 +146,260 @@ void scheduler_init_smp(int num_cpus) {
     log_info("SMP scheduler initialized with %d CPUs", num_cpus);
 }
 
-// Add a task to the appropriate ready queue based on priority
-static void scheduler_add_task(task_t* task) {
-    if (!task) return;
-    
+// Disable local interrupts and return the previous EFLAGS
+static inline uint32_t sched_irq_save(void) {
+    uint32_t eflags;
+    asm volatile("pushf\n\tpop %0\n\tcli" : "=r"(eflags) : : "memory");
+    return eflags;
+}
+
+// Restore local interrupts from a saved EFLAGS value
+static inline void sched_irq_restore(uint32_t eflags) {
+    if (eflags & 0x200) {
+        asm volatile("sti" : : : "memory");
+    }
+}
+
+// Take a run queue lock, counting how often it was already held
+static inline void rq_lock(run_queue_t* rq) {
+    if (!spinlock_try_acquire(&rq->lock)) {
+        __sync_fetch_and_add(&rq->lock_contended, 1);
+        spinlock_acquire(&rq->lock);
+    }
+}
+
+static inline void rq_unlock(run_queue_t* rq) {
+    spinlock_release(&rq->lock);
+}
+
+// Lock the run queue a task belongs to; task->cpu can change until we hold it (IRQs off)
+static run_queue_t* task_rq_lock(task_t* task) {
+    for (;;) {
+        int cpu = task->cpu;
+        run_queue_t* rq = &scheduler.cpu_states[cpu].rq;
+        rq_lock(rq);
+        if (task->cpu == cpu) {
+            return rq;
+        }
+        rq_unlock(rq);
+    }
+}
+
+// Link a task at the tail of its priority's FIFO (rq lock held). O(1).
+static void rq_enqueue(run_queue_t* rq, task_t* task) {
     // Determine priority queue (0 is highest, MAX_PRIORITY-1 is lowest)
-    int priority = task->priority;
+    unsigned int priority = task->priority;
     if (priority >= MAX_PRIORITY) priority = MAX_PRIORITY - 1;
-    if (priority < 0) priority = 0;
-    
-    // Add to the queue
-    task_queue_t* queue = &scheduler.ready_queues[priority];
-    if (queue->count < MAX_TASKS) {
-        queue->tasks[queue->tail] = task;
-        queue->tail = (queue->tail + 1) % MAX_TASKS;
-        queue->count++;
+    
+    run_list_t* queue = &rq->queues[priority];
+    task->rq_next = NULL;
+    task->rq_prev = queue->tail;
+    if (queue->tail) {
+        queue->tail->rq_next = task;
     } else {
-        log_error("Ready queue for priority %d is full, cannot add task %d", 
-                 priority, task->id);
+        queue->head = task;
     }
+    queue->tail = task;
+    queue->count++;
+    
+    task->rq_priority = priority;
+    task->on_rq = 1;
+    rq->bitmap |= 1u << priority;
+    rq->nr_ready++;
 }
 
-// Remove task from any ready queue
-static void scheduler_remove_task_from_ready_queue(int task_id) {
-    // Check all priority queues
-    for (int priority = 0; priority < MAX_PRIORITY; priority++) {
-        task_queue_t* queue = &scheduler.ready_queues[priority];
-        
-        // Search for the task in this queue
-        for (int i = 0; i < queue->count; i++) {
-            int idx = (queue->head + i) % MAX_TASKS;
-            
-            if (queue->tasks[idx] && queue->tasks[idx]->id == task_id) {
-                // Found the task, remove it by shifting tasks
-                for (int j = i; j < queue->count - 1; j++) {
-                    int curr_idx = (queue->head + j) % MAX_TASKS;
-                    int next_idx = (queue->head + j + 1) % MAX_TASKS;
-                    queue->tasks[curr_idx] = queue->tasks[next_idx];
-                }
-                
-                // Decrement count and adjust tail
-                queue->count--;
-                queue->tail = (queue->tail - 1 + MAX_TASKS) % MAX_TASKS;
-                return;
+// Unlink a task from its FIFO (rq lock held). O(1).
+static void rq_dequeue(run_queue_t* rq, task_t* task) {
+    run_list_t* queue = &rq->queues[task->rq_priority];
+    if (task->rq_prev) {
+        task->rq_prev->rq_next = task->rq_next;
+    } else {
+        queue->head = task->rq_next;
+    }
+    if (task->rq_next) {
+        task->rq_next->rq_prev = task->rq_prev;
+    } else {
+        queue->tail = task->rq_prev;
+    }
+    
+    if (--queue->count == 0) {
+        rq->bitmap &= ~(1u << task->rq_priority);
+    }
+    rq->nr_ready--;
+    
+    task->rq_next = NULL;
+    task->rq_prev = NULL;
+    task->on_rq = 0;
+}
+
+// Pop the highest-priority queued task, or NULL when the queue is empty (rq lock held). O(1).
+static task_t* rq_pick(run_queue_t* rq) {
+    if (rq->bitmap == 0) {
+        return NULL;
+    }
+    
+    // Lowest set bit is the highest priority (0 is highest) with work queued
+    task_t* task = rq->queues[__builtin_ctz(rq->bitmap)].head;
+    rq_dequeue(rq, task);
+    return task;
+}
+
+// Check whether a task is one of the idle tasks (those are never queued)
+static inline int scheduler_is_idle_task(task_t* task) {
+    return task == scheduler.idle_task || task == scheduler.cpu_states[task->cpu].rq.idle_task;
+}
+
+// Queue a ready task on the run queue of its CPU
+static void scheduler_add_task(task_t* task) {
+    if (!task || scheduler_is_idle_task(task)) return;
+    
+    uint32_t eflags = sched_irq_save();
+    run_queue_t* rq = task_rq_lock(task);
+    if (!task->on_rq) {
+        rq_enqueue(rq, task);
+    }
+    int target_cpu = task->cpu;
+    rq_unlock(rq);
+    
+    // In tickless mode an idle CPU may have stopped its timer: interrupt it
+    if (scheduler.tickless && target_cpu != scheduler_get_current_cpu() &&
+        target_cpu < scheduler.num_cpus && scheduler.cpu_states[target_cpu].is_active) {
+        task_t* running = scheduler.cpu_states[target_cpu].current_task;
+        if (!running || scheduler_is_idle_task(running)) {
+            preempt_kick_cpu(target_cpu);
+        }
+    }
+    sched_irq_restore(eflags);
+}
+
+// Unlink a task from whatever run queue it is on
+static void scheduler_remove_task_from_ready_queue(task_t* task) {
+    if (!task) return;
+    
+    uint32_t eflags = sched_irq_save();
+    run_queue_t* rq = task_rq_lock(task);
+    if (task->on_rq) {
+        rq_dequeue(rq, task);
+    }
+    rq_unlock(rq);
+    sched_irq_restore(eflags);
+}
+
+// Pick the next task for a CPU: its own queue first, then work stolen from
+// the busiest sibling, then the idle task (IRQs off)
+static task_t* scheduler_get_next_task(int cpu_id) {
+    run_queue_t* rq = &scheduler.cpu_states[cpu_id].rq;
+    
+    rq_lock(rq);
+    task_t* task = rq_pick(rq);
+    rq_unlock(rq);
+    
+    if (!task && scheduler.num_cpus > 1) {
+        // Find the sibling with the most queued work (lockless snapshot)
+        int busiest = -1;
+        int max_tasks = 0;
+        for (int i = 0; i < scheduler.num_cpus; i++) {
+            if (i != cpu_id && scheduler.cpu_states[i].is_active &&
+                scheduler.cpu_states[i].rq.nr_ready > max_tasks) {
+                max_tasks = scheduler.cpu_states[i].rq.nr_ready;
+                busiest = i;
             }
         }
+        
+        if (busiest >= 0) {
+            // Idle CPU: take half of the sibling's queue, rounding up
+            task = scheduler_steal_tasks(cpu_id, busiest, (max_tasks + 1) / 2);
+        }
+    }
+    
+    if (!task) {
+        // No ready tasks, return the idle task
+        task = rq->idle_task ? rq->idle_task : scheduler.idle_task;
     }
+    return task;
 }
 
-// Remove and return the next task from the highest non-empty priority queue
-static task_t* scheduler_get_next_task(void) {
-    // Start from highest priority (lowest number)
-    for (int priority = 0; priority < MAX_PRIORITY; priority++) {
-        task_queue_t* queue = &scheduler.ready_queues[priority];
-        if (queue->count > 0) {
-            task_t* task = queue->tasks[queue->head];
-            queue->head = (queue->head + 1) % MAX_TASKS;
-            queue->count--;
-            return task;
+// Move up to max_tasks unpinned tasks from a sibling's run queue to this
+// CPU's and return the best of them, already dequeued (IRQs off)
+static task_t* scheduler_steal_tasks(int cpu_id, int busiest, int max_tasks) {
+    run_queue_t* dst = &scheduler.cpu_states[cpu_id].rq;
+    run_queue_t* src = &scheduler.cpu_states[busiest].rq;
+    
+    // Always lock the lower-numbered CPU first
+    if (cpu_id < busiest) {
+        rq_lock(dst);
+        rq_lock(src);
+    } else {
+        rq_lock(src);
+        rq_lock(dst);
+    }
+    
+    // Walk from the highest priority, taking the coldest (tail) tasks of each FIFO
+    int moved = 0;
+    uint32_t pending = src->bitmap;
+    while (pending && moved < max_tasks) {
+        int priority = __builtin_ctz(pending);
+        pending &= pending - 1;
+        
+        task_t* task = src->queues[priority].tail;
+        while (task && moved < max_tasks) {
+            task_t* prev = task->rq_prev;
+            if (task->cpu_affinity < 0) {
+                rq_dequeue(src, task);
+                task->cpu = cpu_id;
+                rq_enqueue(dst, task);
+                moved++;
+            }
+            task = prev;
         }
     }
+    dst->tasks_stolen += moved;
+    
+    task_t* next = rq_pick(dst);
     
-    // No ready tasks, return the idle task
-    return scheduler.idle_task;
+    rq_unlock(src);
+    rq_unlock(dst);
+    return next;
 }
 
-// Register the idle task
+// Insert a task into the id hash (scheduler lock held)
+static void scheduler_hash_task(task_t* task) {
+    uint32_t bucket = TASK_HASH(task->id);
+    task->hash_next = scheduler.task_hash[bucket];
+    scheduler.task_hash[bucket] = task;
+}
+
+// Remove a task from the id hash (scheduler lock held)
+static void scheduler_unhash_task(task_t* task) {
+    task_t** link = &scheduler.task_hash[TASK_HASH(task->id)];
+    while (*link) {
+        if (*link == task) {
+            *link = task->hash_next;
+            task->hash_next = NULL;
+            return;
+        }
+        link = &(*link)->hash_next;
+    }
+}
+
+// Register the idle task of the calling CPU (the first one registered is the global fallback)
 void scheduler_register_idle_task(task_t* idle_task) {
-    scheduler.idle_task = idle_task;
+    int cpu_id = scheduler_get_current_cpu();
+    
+    // The idle task is picked when the run queue is empty, never from a queue
+    scheduler_remove_task_from_ready_queue(idle_task);
+    
+    scheduler.cpu_states[cpu_id].rq.idle_task = idle_task;
+    if (!scheduler.idle_task) {
+        scheduler.idle_task = idle_task;
+    }
     idle_task->state = TASK_STATE_READY;
     idle_task->priority = MAX_PRIORITY - 1;  // Lowest priority
+    idle_task->cpu = cpu_id;
+    idle_task->cpu_affinity = cpu_id;
+    if (!scheduler_find_task_by_id(idle_task->id)) {
+        scheduler_hash_task(idle_task);
+    }
 }
 
 // Create a new task with the given attributes
@@ -227,6 +423,8 @@ int scheduler_create_task(void (*entry_point)(), const char* name,
     task->priority = priority;
     task->stack_size = DEFAULT_STACK_SIZE;
     task->entry_point = entry_point;
+    task->cpu_affinity = -1;                       // May run on any CPU
+    task->cpu = scheduler_smp_get_target_cpu();    // Start on the least loaded CPU
     
     // Set parent ID to current task if it exists
     task_t* current = scheduler_get_current_task();
@@ -256,6 +454,7 @@ int scheduler_create_task(void (*entry_point)(), const char* name,
     task_setup_context(task);
     
     // Add task to scheduler
+    scheduler_hash_task(task);
     scheduler_add_task(task);
     log_info("Created task '%s' (ID: %d, priority: %d)", task->name, task->id, task->priority);
     
@@ -265,9 +464,13 @@ int scheduler_create_task(void (*entry_point)(), const char* name,
 
 // Get the current CPU ID
 int scheduler_get_current_cpu(void) {
-    // In a real implementation, this would use CPU-specific register or APIC ID
-    // For now we'll just return 0, assuming we're on the boot CPU
-    return 0;
+    if (scheduler.num_cpus <= 1) {
+        return 0;
+    }
+    
+    // Local APIC ID (bits 24-31 of the ID register); APs are numbered 0..n-1
+    uint32_t apic_id = *(volatile uint32_t*)(UINTOS_LAPIC_BASE + 0x20) >> 24;
+    return apic_id < (uint32_t)scheduler.num_cpus ? (int)apic_id : 0;
 }
 
 // Find the optimal CPU to run a new task (for load balancing)
@@ -276,13 +479,13 @@ static int scheduler_smp_get_target_cpu(void) {
         return 0; // Single CPU system
     }
     
-    // Find CPU with fewest ready tasks
+    // Find CPU with fewest ready tasks (lockless snapshot, a hint only)
     int target_cpu = 0;
     int min_tasks = INT_MAX;
     
     for (int i = 0; i < scheduler.num_cpus; i++) {
         if (scheduler.cpu_states[i].is_active) {
-            int cpu_tasks = scheduler.cpu_states[i].local_queue.count;
+            int cpu_tasks = scheduler.cpu_states[i].rq.nr_ready;
             
             // If this CPU has fewer tasks, select it
             if (cpu_tasks < min_tasks) {
@@ -295,42 +498,43 @@ static int scheduler_smp_get_target_cpu(void) {
     return target_cpu;
 }
 
-// Schedule the next task to run
+// Schedule the next task to run. Only this CPU's run queue lock is taken
+// unless the queue is empty and work has to be stolen from a sibling.
 void scheduler_schedule(void) {
     // Don't schedule if preemption is disabled
     if (!scheduler.preemption_enabled) {
         return;
     }
     
-    spinlock_acquire(&scheduler.lock);
+    uint32_t eflags = sched_irq_save();
     
     // Get current CPU ID
     int cpu_id = scheduler_get_current_cpu();
+    cpu_state_t* cpu = &scheduler.cpu_states[cpu_id];
     
-    // Save current task if there is one
-    if (scheduler.cpu_states[cpu_id].current_task && 
-        scheduler.cpu_states[cpu_id].current_task->state == TASK_STATE_RUNNING) {
-        scheduler.cpu_states[cpu_id].current_task->state = TASK_STATE_READY;
-        scheduler_add_task(scheduler.cpu_states[cpu_id].current_task);
+    // Requeue the current task if it is still runnable (normally onto this CPU's queue)
+    task_t* prev = cpu->current_task;
+    if (prev && prev->state == TASK_STATE_RUNNING) {
+        prev->state = TASK_STATE_READY;
+        scheduler_add_task(prev);
     }
     
-    // Check for sleeping tasks that need to wake up
-    scheduler_check_sleeping_tasks();
-    
     // Get the next task to run
-    task_t* next_task = scheduler_get_next_task();
+    task_t* next_task = scheduler_get_next_task(cpu_id);
     if (!next_task) {
         // This should never happen if idle task is registered
-        spinlock_release(&scheduler.lock);
+        sched_irq_restore(eflags);
         log_error("No tasks available to run!");
         return;
     }
     
     // Update task state
     next_task->state = TASK_STATE_RUNNING;
-    scheduler.cpu_states[cpu_id].current_task = next_task;
-    scheduler.cpu_states[cpu_id].total_switches++;
-    scheduler.total_switches++;
+    cpu->current_task = next_task;
+    cpu->total_switches++;
+    
+    // No RCU reader can span a context switch
+    rcu_note_context_switch(cpu_id);
     
     // Calculate time slice based on priority and algorithm
     int time_slice = 0;
@@ -354,96 +558,99 @@ void scheduler_schedule(void) {
     
     next_task->time_slice = time_slice;
     next_task->last_run_time = scheduler.scheduler_ticks;
+    if (scheduler.tickless) {
+        next_task->slice_end_ns = hal_time_now_ns() +
+                                  (uint64_t)time_slice * MILLISECONDS_PER_TICK * 1000000ULL;
+    }
     
     // Update CPU time tracking
-    if (next_task != scheduler.idle_task) {
+    if (!scheduler_is_idle_task(next_task)) {
         next_task->cpu_time_used++;
     } else {
-        scheduler.cpu_states[cpu_id].idle_ticks++;
+        cpu->idle_ticks++;
     }
     
     // Check if we need to perform load balancing
-    scheduler.load_balance_counter++;
-    if (scheduler.num_cpus > 1 && scheduler.load_balance_counter >= 100) {
-        scheduler.load_balance_counter = 0;
-        scheduler_load_balance();
+    if (scheduler.num_cpus > 1 && ++cpu->balance_counter >= 100) {
+        cpu->balance_counter = 0;
+        scheduler_load_balance(cpu_id);
     }
     
-    spinlock_release(&scheduler.lock);
+    // No periodic tick: arm this CPU's timer for the new slice (or stop it when idle)
+    if (scheduler.tickless) {
+        preempt_program_next_event();
+    }
+    
+    sched_irq_restore(eflags);
     
     // Perform the context switch
     task_switch_to(next_task);
 }
 
-// Perform load balancing across CPUs
-static void scheduler_load_balance(void) {
+// Pull work towards this CPU when it is much less loaded than the busiest one (IRQs off)
+static void scheduler_load_balance(int cpu_id) {
     if (scheduler.num_cpus <= 1) return;
     
-    // Find CPU with most and least tasks
-    int max_cpu = 0;
-    int min_cpu = 0;
+    // Find the busiest CPU (lockless snapshot)
+    int max_cpu = -1;
     int max_tasks = 0;
-    int min_tasks = INT_MAX;
     
     for (int i = 0; i < scheduler.num_cpus; i++) {
-        if (scheduler.cpu_states[i].is_active) {
-            int cpu_tasks = scheduler.cpu_states[i].local_queue.count;
+        if (i != cpu_id && scheduler.cpu_states[i].is_active) {
+            int cpu_tasks = scheduler.cpu_states[i].rq.nr_ready;
             
             if (cpu_tasks > max_tasks) {
                 max_tasks = cpu_tasks;
                 max_cpu = i;
             }
-            
-            if (cpu_tasks < min_tasks) {
-                min_tasks = cpu_tasks;
-                min_cpu = i;
-            }
         }
     }
     
-    // If there's a significant imbalance, migrate a task
-    if (max_tasks > min_tasks + 2 && max_cpu != min_cpu) {
-        // Get a task from the most loaded CPU
-        task_queue_t* max_queue = &scheduler.cpu_states[max_cpu].local_queue;
-        if (max_queue->count > 0) {
-            task_t* task = max_queue->tasks[max_queue->head];
-            max_queue->head = (max_queue->head + 1) % MAX_TASKS;
-            max_queue->count--;
-            
-            // Add it to the least loaded CPU's queue
-            task_queue_t* min_queue = &scheduler.cpu_states[min_cpu].local_queue;
-            if (min_queue->count < MAX_TASKS) {
-                min_queue->tasks[min_queue->tail] = task;
-                min_queue->tail = (min_queue->tail + 1) % MAX_TASKS;
-                min_queue->count++;
-                log_debug("Load balance: Migrated task %d (%s) from CPU %d to CPU %d",
-                         task->id, task->name, max_cpu, min_cpu);
-            } else {
-                // If min_queue is full, put the task back in max_queue
-                max_queue->tasks[max_queue->tail] = task;
-                max_queue->tail = (max_queue->tail + 1) % MAX_TASKS;
-                max_queue->count++;
-            }
+    // If there's a significant imbalance, even it out
+    int my_tasks = scheduler.cpu_states[cpu_id].rq.nr_ready;
+    if (max_cpu >= 0 && max_tasks > my_tasks + 2) {
+        task_t* task = scheduler_steal_tasks(cpu_id, max_cpu, (max_tasks - my_tasks) / 2);
+        
+        // scheduler_steal_tasks() hands back one task dequeued; keep it queued here
+        if (task) {
+            scheduler_add_task(task);
         }
     }
 }
 
 // Timer tick handler for the scheduler
 void scheduler_tick(void) {
-    scheduler.scheduler_ticks++;
+    // Get current CPU ID
+    int cpu_id = scheduler_get_current_cpu();
+    
+    // The boot CPU keeps global time (sleepers are woken by the timer wheel);
+    // the other CPUs only account their own time slices
+    if (cpu_id == 0) {
+        scheduler.scheduler_ticks++;
+    }
     
     if (!scheduler.preemption_enabled) {
         return;
     }
     
-    // Get current CPU ID
-    int cpu_id = scheduler_get_current_cpu();
     task_t* current_task = scheduler.cpu_states[cpu_id].current_task;
     
     if (!current_task) {
         return;
     }
     
+    // Tickless: interrupts only arrive at deadlines, so compare against the
+    // slice end instead of counting ticks, and leave idle once work shows up
+    if (scheduler.tickless) {
+        int expired = scheduler_is_idle_task(current_task) ?
+                      scheduler.cpu_states[cpu_id].rq.nr_ready > 0 :
+                      hal_time_now_ns() >= current_task->slice_end_ns;
+        if (expired) {
+            scheduler_schedule();
+        }
+        return;
+    }
+    
     // Update task timing information
     if (current_task->time_slice > 0) {
         current_task->time_slice--;
@@ -455,6 +662,25 @@ void scheduler_tick(void) {
     }
 }
 
+// Switch time slice accounting between the periodic tick and one-shot deadlines
+void scheduler_set_tickless(int enabled) {
+    scheduler.tickless = enabled ? 1 : 0;
+    log_info("SCHEDULER", "Time slices driven by %s", enabled ? "one-shot deadlines" : "the periodic tick");
+}
+
+// When the running task's slice ends (UINT64_MAX if nothing needs preempting)
+uint64_t scheduler_slice_deadline_ns(int cpu_id) {
+    if (!scheduler.preemption_enabled || cpu_id < 0 || cpu_id >= MAX_CPUS) {
+        return UINT64_MAX;
+    }
+    
+    task_t* current_task = scheduler.cpu_states[cpu_id].current_task;
+    if (!current_task || scheduler_is_idle_task(current_task)) {
+        return UINT64_MAX;
+    }
+    return current_task->slice_end_ns;
+}
+
 // Enable preemptive scheduling
 void scheduler_enable_preemption(void) {
     scheduler.preemption_enabled = 1;
@@ -495,6 +721,24 @@ void scheduler_block_current_task(void) {
     scheduler_schedule();
 }
 
+// Mark the current task blocked without switching away, so a lock can be
+// dropped before the caller calls scheduler_schedule(). Returns 0 if there
+// is nothing to block (preemption off, no task or the idle task).
+int scheduler_prepare_to_block(void) {
+    if (!scheduler.preemption_enabled) {
+        return 0;
+    }
+    
+    int cpu_id = scheduler_get_current_cpu();
+    task_t* current = scheduler.cpu_states[cpu_id].current_task;
+    if (!current || scheduler_is_idle_task(current)) {
+        return 0;
+    }
+    
+    current->state = TASK_STATE_BLOCKED;
+    return 1;
+}
+
 // Unblock a task
 void scheduler_unblock_task(int task_id) {
     spinlock_acquire(&scheduler.lock);
@@ -510,77 +754,27 @@ void scheduler_unblock_task(int task_id) {
     spinlock_release(&scheduler.lock);
 }
 
-// Add a task to the sleeping queue
-static void scheduler_add_sleeping_task(task_t* task, uint64_t wake_time_ms) {
+// Put a task to sleep on its own wheel timer (scheduler lock held)
+static void scheduler_add_sleeping_task(task_t* task, uint32_t sleep_ms) {
     if (!task) return;
     
-    // Convert wake time to ticks
-    uint64_t wake_time = scheduler.scheduler_ticks + (wake_time_ms / MILLISECONDS_PER_TICK);
-    
-    // Create new sleeping task entry
-    sleeping_task_t* new_entry = (sleeping_task_t*)heap_alloc(sizeof(sleeping_task_t));
-    if (!new_entry) {
-        log_error("Failed to allocate sleeping task entry for task %d", task->id);
-        return;
-    }
-    
-    new_entry->task = task;
-    new_entry->wake_time = wake_time;
-    
-    // Insert into ordered list (by wake time)
-    if (!scheduler.sleeping_tasks || scheduler.sleeping_tasks->wake_time > wake_time) {
-        // Insert at head
-        new_entry->next = scheduler.sleeping_tasks;
-        scheduler.sleeping_tasks = new_entry;
-    } else {
-        // Find position to insert
-        sleeping_task_t* current = scheduler.sleeping_tasks;
-        while (current->next && current->next->wake_time <= wake_time) {
-            current = current->next;
-        }
-        
-        // Insert after current
-        new_entry->next = current->next;
-        current->next = new_entry;
-    }
-    
+    ktimer_init(&task->sleep_timer, scheduler_sleep_expired, task);
     task->state = TASK_STATE_BLOCKED;  // Set task state to blocked while sleeping
-    log_debug("Task %d sleeping until tick %llu (current: %llu)", 
-             task->id, wake_time, scheduler.scheduler_ticks);
+    __sync_fetch_and_add(&scheduler.nr_sleeping, 1);
+    ktimer_arm(&task->sleep_timer, sleep_ms);
+    
+    log_debug("SCHEDULER", "Task %d sleeping for %u ms", task->id, sleep_ms);
 }
 
-// Check for sleeping tasks that need to wake up
-static void scheduler_check_sleeping_tasks(void) {
-    sleeping_task_t* current = scheduler.sleeping_tasks;
-    sleeping_task_t* prev = NULL;
+// Timer wheel callback: the sleep period of a task has elapsed
+static void scheduler_sleep_expired(ktimer_t* timer, void* data) {
+    task_t* task = (task_t*)data;
+    (void)timer;
     
-    while (current) {
-        if (current->wake_time <= scheduler.scheduler_ticks) {
-            // Time to wake up this task
-            task_t* task = current->task;
-            
-            if (task && task->state == TASK_STATE_BLOCKED) {
-                task->state = TASK_STATE_READY;
-                scheduler_add_task(task);
-                log_debug("Woke up sleeping task %d", task->id);
-            }
-            
-            // Remove from sleeping list
-            sleeping_task_t* to_remove = current;
-            if (prev) {
-                prev->next = current->next;
-                current = current->next;
-            } else {
-                scheduler.sleeping_tasks = current->next;
-                current = scheduler.sleeping_tasks;
-            }
-            
-            heap_free(to_remove);
-        } else {
-            // Move to next
-            prev = current;
-            current = current->next;
-        }
+    __sync_fetch_and_sub(&scheduler.nr_sleeping, 1);
+    if (task->state == TASK_STATE_BLOCKED) {
+        task->state = TASK_STATE_READY;
+        scheduler_add_task(task);
     }
 }
 
@@ -615,39 +809,21 @@ int scheduler_sleep(unsigned int milliseconds) {
 int scheduler_wake_task(int task_id) {
     spinlock_acquire(&scheduler.lock);
     
-    // Find the task in sleeping list
-    sleeping_task_t* current = scheduler.sleeping_tasks;
-    sleeping_task_t* prev = NULL;
+    task_t* task = scheduler_find_task_by_id(task_id);
+    if (!task || !ktimer_cancel(&task->sleep_timer)) {
+        spinlock_release(&scheduler.lock);
+        return -1;  // Task not found or not sleeping
+    }
     
-    while (current) {
-        if (current->task && current->task->id == task_id) {
-            // Found the task, wake it up
-            task_t* task = current->task;
-            
-            if (task->state == TASK_STATE_BLOCKED) {
-                task->state = TASK_STATE_READY;
-                scheduler_add_task(task);
-                log_debug("Force woke up sleeping task %d", task_id);
-            }
-            
-            // Remove from sleeping list
-            if (prev) {
-                prev->next = current->next;
-            } else {
-                scheduler.sleeping_tasks = current->next;
-            }
-            
-            heap_free(current);
-            spinlock_release(&scheduler.lock);
-            return 0;
-        }
-        
-        prev = current;
-        current = current->next;
+    __sync_fetch_and_sub(&scheduler.nr_sleeping, 1);
+    if (task->state == TASK_STATE_BLOCKED) {
+        task->state = TASK_STATE_READY;
+        scheduler_add_task(task);
+        log_debug("SCHEDULER", "Force woke up sleeping task %d", task_id);
     }
     
     spinlock_release(&scheduler.lock);
-    return -1;  // Task not found in sleeping list
+    return 0;
 }
 
 // Add a parent to the waiting list
@@ -739,6 +915,8 @@ int scheduler_waitpid(int task_id, int* exit_code, int options) {
         }
         
         // Free child resources
+        ktimer_cancel(&child->sleep_timer);
+        scheduler_unhash_task(child);
         if (child->stack) {
             heap_free(child->stack);
         }
@@ -769,34 +947,14 @@ int scheduler_waitpid(int task_id, int* exit_code, int options) {
     return task_id;
 }
 
-// Find a task by ID
+// Find a task by ID. O(1) on average through the id hash.
 task_t* scheduler_find_task_by_id(int task_id) {
-    // Check if it's the current task on any CPU
-    for (int i = 0; i < scheduler.num_cpus; i++) {
-        if (scheduler.cpu_states[i].current_task && 
-            scheduler.cpu_states[i].current_task->id == task_id) {
-            return scheduler.cpu_states[i].current_task;
-        }
-    }
-    
-    // Check ready queues
-    for (int priority = 0; priority < MAX_PRIORITY; priority++) {
-        task_queue_t* queue = &scheduler.ready_queues[priority];
-        for (int i = 0; i < queue->count; i++) {
-            int idx = (queue->head + i) % MAX_TASKS;
-            if (queue->tasks[idx] && queue->tasks[idx]->id == task_id) {
-                return queue->tasks[idx];
-            }
-        }
-    }
-    
-    // Check sleeping tasks
-    sleeping_task_t* current = scheduler.sleeping_tasks;
-    while (current) {
-        if (current->task && current->task->id == task_id) {
-            return current->task;
+    task_t* task = scheduler.task_hash[TASK_HASH(task_id)];
+    while (task) {
+        if (task->id == task_id) {
+            return task;
         }
-        current = current->next;
+        task = task->hash_next;
     }
     
     return NULL;
@@ -815,17 +973,13 @@ void scheduler_get_stats(scheduler_stats_t* stats) {
     stats->zombie_tasks = 0;
     
     // Count tasks in ready queues
-    for (int i = 0; i < MAX_PRIORITY; i++) {
-        stats->ready_tasks += scheduler.ready_queues[i].count;
+    for (int i = 0; i < scheduler.num_cpus; i++) {
+        stats->ready_tasks += scheduler.cpu_states[i].rq.nr_ready;
     }
     stats->total_tasks += stats->ready_tasks;
     
     // Count sleeping tasks
-    sleeping_task_t* current = scheduler.sleeping_tasks;
-    while (current) {
-        stats->sleeping_tasks++;
-        current = current->next;
-    }
+    stats->sleeping_tasks = scheduler.nr_sleeping;
     stats->total_tasks += stats->sleeping_tasks;
     
     // Add current running tasks
@@ -835,7 +989,10 @@ void scheduler_get_stats(scheduler_stats_t* stats) {
         }
     }
     
-    stats->total_task_switches = scheduler.total_switches;
+    stats->total_task_switches = 0;
+    for (int i = 0; i < scheduler.num_cpus; i++) {
+        stats->total_task_switches += scheduler.cpu_states[i].total_switches;
+    }
     stats->total_ticks = scheduler.scheduler_ticks;
     
     int cpu_id = scheduler_get_current_cpu();
@@ -857,6 +1014,9 @@ void scheduler_get_cpu_info(int cpu_id, cpu_scheduler_info_t* info) {
     info->is_active = scheduler.cpu_states[cpu_id].is_active;
     info->total_switches = scheduler.cpu_states[cpu_id].total_switches;
     info->idle_ticks = scheduler.cpu_states[cpu_id].idle_ticks;
+    info->ready_tasks = scheduler.cpu_states[cpu_id].rq.nr_ready;
+    info->rq_lock_contended = scheduler.cpu_states[cpu_id].rq.lock_contended;
+    info->tasks_stolen = scheduler.cpu_states[cpu_id].rq.tasks_stolen;
     
     if (scheduler.cpu_states[cpu_id].current_task) {
         info->current_task = scheduler.cpu_states[cpu_id].current_task;
@@ -886,7 +1046,18 @@ int scheduler_set_task_priority(int task_id, unsigned int priority) {
         return -1; // Task not found
     }
     
-    task->priority = priority;
+    // A queued task has to move to the queue of its new priority
+    uint32_t eflags = sched_irq_save();
+    run_queue_t* rq = task_rq_lock(task);
+    if (task->on_rq) {
+        rq_dequeue(rq, task);
+        task->priority = priority;
+        rq_enqueue(rq, task);
+    } else {
+        task->priority = priority;
+    }
+    rq_unlock(rq);
+    sched_irq_restore(eflags);
     log_debug("Set priority of task %d to %d", task_id, priority);
     
     spinlock_release(&scheduler.lock);
@@ -907,7 +1078,7 @@ int scheduler_terminate_task(int task_id, int exit_code) {
     task->exit_code = exit_code;
     
     // Remove task from any scheduler queues
-    scheduler_remove_task_from_ready_queue(task_id);
+    scheduler_remove_task_from_ready_queue(task);
     
     // Clean up process address space (ASLR)
     vmm_destroy_process_space(task_id);
@@ -946,24 +1117,26 @@ int scheduler_migrate_task(int task_id, int cpu_id) {
         return -2; // Task not found
     }
     
-    // Remove task from any ready queue
-    scheduler_remove_task_from_ready_queue(task_id);
+    // Pin the task to the target CPU and move it there if it is queued;
+    // a running task lands on the new CPU's queue at its next switch
+    uint32_t eflags = sched_irq_save();
+    run_queue_t* rq = task_rq_lock(task);
+    int was_queued = task->on_rq;
+    if (was_queued) {
+        rq_dequeue(rq, task);
+    }
+    task->cpu_affinity = cpu_id;
+    task->cpu = cpu_id;
+    rq_unlock(rq);
     
-    // Add to target CPU's local queue
-    task_queue_t* queue = &scheduler.cpu_states[cpu_id].local_queue;
-    if (queue->count < MAX_TASKS) {
-        queue->tasks[queue->tail] = task;
-        queue->tail = (queue->tail + 1) % MAX_TASKS;
-        queue->count++;
-        log_debug("Migrated task %d to CPU %d", task_id, cpu_id);
-        spinlock_release(&scheduler.lock);
-        return 0;
-    } else {
-        // If target CPU queue is full, put back in global queue
+    if (was_queued) {
         scheduler_add_task(task);
-        spinlock_release(&scheduler.lock);
-        return -3; // Target CPU queue full
     }
+    sched_irq_restore(eflags);
+    
+    log_debug("Migrated task %d to CPU %d", task_id, cpu_id);
+    spinlock_release(&scheduler.lock);
+    return 0;
 }
 
 // Set the scheduler algorithm
@@ -1008,4 +1181,123 @@ void scheduler_set_priority_time_slice(unsigned int priority, unsigned int time_
 void scheduler_set_quantum(unsigned int quantum_ms) {
     scheduler.quantum_ms = quantum_ms;
     log_info("Set base scheduling quantum to %dms", quantum_ms);
-}
\ No newline at end of file
+}
+/**
+ * Run-queue microbenchmark
+ *
+ * Drives the pick path of scheduler_schedule() (requeue the current task,
+ * pick the next one) on SCHED_BENCH_CPUS per-CPU run queues with dummy
+ * tasks, for several task counts, and then measures work stealing from a
+ * single overloaded queue. Every queue is driven from the boot CPU with
+ * interrupts off (so no real switch can pick up a dummy task): the numbers
+ * are the single-threaded cost of the pick and steal paths, not a
+ * measurement of lock contention between CPUs.
+ */
+#define SCHED_BENCH_CPUS      4
+#define SCHED_BENCH_SWITCHES  20000
+
+static uint32_t scheduler_bench_rate(uint32_t ops, uint64_t elapsed_ns) {
+    if (elapsed_ns == 0) {
+        elapsed_ns = 1;
+    }
+    return (uint32_t)(((uint64_t)ops * 1000000000ULL) / elapsed_ns);
+}
+
+void scheduler_run_benchmark(void) {
+    extern uint64_t hal_time_now_ns(void);
+    static const int task_counts[] = { 8, 64, MAX_TASKS };
+    
+    task_t* tasks = (task_t*)heap_alloc(MAX_TASKS * sizeof(task_t));
+    if (!tasks) {
+        log_warning("SCHEDULER", "Not enough memory to run the run-queue benchmark");
+        return;
+    }
+    
+    uint32_t eflags = sched_irq_save();
+    
+    // Let the pick path see SCHED_BENCH_CPUS active run queues
+    int saved_num_cpus = scheduler.num_cpus;
+    int saved_active[SCHED_BENCH_CPUS];
+    for (int c = 0; c < SCHED_BENCH_CPUS; c++) {
+        saved_active[c] = scheduler.cpu_states[c].is_active;
+        scheduler.cpu_states[c].is_active = 1;
+    }
+    scheduler.num_cpus = SCHED_BENCH_CPUS;
+    
+    for (unsigned int n = 0; n < sizeof(task_counts) / sizeof(task_counts[0]); n++) {
+        int count = task_counts[n];
+        task_t* current[SCHED_BENCH_CPUS] = { NULL };
+        
+        // Spread the dummy tasks over the queues, four priorities per queue
+        memset(tasks, 0, count * sizeof(task_t));
+        for (int i = 0; i < count; i++) {
+            tasks[i].id = -1 - i;
+            tasks[i].state = TASK_STATE_READY;
+            tasks[i].priority = PRIORITY_NORMAL + (i % 4);
+            tasks[i].cpu = i % SCHED_BENCH_CPUS;
+            tasks[i].cpu_affinity = -1;
+            scheduler_add_task(&tasks[i]);
+        }
+        
+        uint64_t start = hal_time_now_ns();
+        for (int i = 0; i < SCHED_BENCH_SWITCHES; i++) {
+            int cpu = i % SCHED_BENCH_CPUS;
+            if (current[cpu]) {
+                scheduler_add_task(current[cpu]);
+            }
+            current[cpu] = scheduler_get_next_task(cpu);
+        }
+        uint64_t elapsed = hal_time_now_ns() - start;
+        
+        log_info("SCHEDULER", "Run queues (%d queues, %d tasks, one CPU): %u switches/s",
+                 SCHED_BENCH_CPUS, count, scheduler_bench_rate(SCHED_BENCH_SWITCHES, elapsed));
+        
+        for (int i = 0; i < count; i++) {
+            scheduler_remove_task_from_ready_queue(&tasks[i]);
+        }
+    }
+    
+    // Work stealing: everything starts on CPU 0, the other CPUs go idle and pull
+    int count = MAX_TASKS;
+    memset(tasks, 0, count * sizeof(task_t));
+    for (int i = 0; i < count; i++) {
+        tasks[i].id = -1 - i;
+        tasks[i].state = TASK_STATE_READY;
+        tasks[i].priority = PRIORITY_NORMAL;
+        tasks[i].cpu = 0;
+        tasks[i].cpu_affinity = -1;
+        scheduler_add_task(&tasks[i]);
+    }
+    
+    uint32_t stolen = 0;
+    for (int c = 0; c < SCHED_BENCH_CPUS; c++) {
+        stolen -= scheduler.cpu_states[c].rq.tasks_stolen;
+    }
+    uint64_t start = hal_time_now_ns();
+    for (int c = 1; c < SCHED_BENCH_CPUS; c++) {
+        task_t* task = scheduler_get_next_task(c);
+        if (task && task->cpu_affinity < 0) {
+            scheduler_add_task(task);
+        }
+    }
+    uint64_t elapsed = hal_time_now_ns() - start;
+    for (int c = 0; c < SCHED_BENCH_CPUS; c++) {
+        stolen += scheduler.cpu_states[c].rq.tasks_stolen;
+    }
+    
+    log_info("SCHEDULER", "Work stealing: %u of %d tasks pulled by %d idle CPUs in %u ns (queue 0 left with %d)",
+             stolen, count, SCHED_BENCH_CPUS - 1, (uint32_t)elapsed, scheduler.cpu_states[0].rq.nr_ready);
+    
+    for (int i = 0; i < count; i++) {
+        scheduler_remove_task_from_ready_queue(&tasks[i]);
+    }
+    
+    // Put the real CPU configuration back
+    scheduler.num_cpus = saved_num_cpus;
+    for (int c = 0; c < SCHED_BENCH_CPUS; c++) {
+        scheduler.cpu_states[c].is_active = saved_active[c];
+    }
+    
+    sched_irq_restore(eflags);
+    heap_free(tasks);
+}
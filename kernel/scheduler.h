@@ -34,6 +34,9 @@ typedef struct {
     int is_active;                  // Whether this CPU is active
     uint64_t total_switches;        // Total task switches on this CPU
     uint64_t idle_ticks;            // Idle ticks count
+    int ready_tasks;                // Tasks queued on this CPU's run queue
+    uint32_t rq_lock_contended;     // Times this CPU's run queue lock was found held
+    uint32_t tasks_stolen;          // Tasks this CPU pulled from its siblings
 } cpu_scheduler_info_t;
 
 // Waiting reason codes
@@ -70,6 +73,12 @@ void scheduler_tick(void);
 void scheduler_enable_preemption(void);
 void scheduler_disable_preemption(void);
 
+// Account time slices against one-shot deadlines instead of periodic ticks
+void scheduler_set_tickless(int enabled);
+
+// End of the running task's time slice on a CPU (UINT64_MAX when idle)
+uint64_t scheduler_slice_deadline_ns(int cpu_id);
+
 // Get the currently running task
 task_t* scheduler_get_current_task(void);
 
@@ -79,6 +88,9 @@ void scheduler_yield(void);
 // Block the currently running task
 void scheduler_block_current_task(void);
 
+// Mark the current task blocked ahead of scheduler_schedule() (0 if it cannot block)
+int scheduler_prepare_to_block(void);
+
 // Unblock a previously blocked task
 void scheduler_unblock_task(int task_id);
 
@@ -129,6 +141,9 @@ void scheduler_get_cpu_info(int cpu_id, cpu_scheduler_info_t* info);
 // Balance tasks across all CPUs (load balancing)
 void scheduler_balance_tasks(void);
 
+// Boot-time run-queue microbenchmark (needs a calibrated HAL timer)
+void scheduler_run_benchmark(void);
+
 // Advanced scheduler configuration
 
 // Set the scheduler algorithm
@@ -1,6 +1,137 @@
 #include "sync.h"
 #include "task.h"
+#include "scheduler.h"
 #include "logging/log.h"
+#include <stddef.h>
+
+// Pause iterations before a spinlock waiter with interrupts enabled starts
+// yielding between checks (covers a holder preempted on this CPU)
+#define SPINLOCK_SPIN_LIMIT 16384
+
+// Pause iterations a mutex waiter spins while the owner is running
+#define MUTEX_SPIN_LIMIT 2048
+
+// CPUs tracked by RCU (matches the scheduler's limit)
+#define SYNC_MAX_CPUS 16
+
+// Default classes for locks that were not given one
+static lock_class_t rwlock_class = { "rwlock", 0, 0, 0, 0, NULL };
+static lock_class_t condition_class = { "condition", 0, 0, 0, 0, &rwlock_class };
+static lock_class_t semaphore_class = { "semaphore", 0, 0, 0, 0, &condition_class };
+static lock_class_t mutex_class = { "mutex", 0, 0, 0, 0, &semaphore_class };
+static lock_class_t spinlock_class = { "spinlock", 0, 0, 0, 0, &mutex_class };
+
+// Registered lock classes (classes are never unregistered)
+static lock_class_t* lock_classes = &spinlock_class;
+static spinlock_t lock_class_lock;
+
+// RCU state. A CPU is quiescent whenever it is outside a read-side section;
+// each section exit and each context switch bumps its quiescent counter.
+static struct {
+    volatile uint32_t nesting[SYNC_MAX_CPUS];    // Read-side nesting depth
+    volatile uint32_t quiescent[SYNC_MAX_CPUS];  // Quiescent states seen
+    uint32_t saved_eflags[SYNC_MAX_CPUS];        // EFLAGS at the outermost rcu_read_lock()
+    volatile uint32_t grace_periods;             // Completed synchronize_rcu() calls
+} rcu;
+
+// Read the time stamp counter (cycle-accurate spin accounting)
+static inline uint64_t sync_rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Spin-wait hint for the CPU
+static inline void sync_cpu_relax(void) {
+    asm volatile("pause" : : : "memory");
+}
+
+// Disable local interrupts, returning the previous EFLAGS
+static inline uint32_t sync_irq_save(void) {
+    uint32_t eflags;
+    asm volatile("pushf\n\tpop %0\n\tcli" : "=r"(eflags) : : "memory");
+    return eflags;
+}
+
+// Restore local interrupts from a saved EFLAGS value
+static inline void sync_irq_restore(uint32_t eflags) {
+    if (eflags & 0x200) {
+        asm volatile("sti" : : : "memory");
+    }
+}
+
+// Check whether local interrupts are enabled
+static inline int sync_irqs_enabled(void) {
+    uint32_t eflags;
+    asm volatile("pushf\n\tpop %0" : "=r"(eflags));
+    return (eflags & 0x200) != 0;
+}
+
+/**
+ * Append a waiter to a wait queue (queue lock held)
+ */
+static void wait_queue_push(wait_queue_t* queue, wait_entry_t* entry) {
+    entry->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = entry;
+    } else {
+        queue->head = entry;
+    }
+    queue->tail = entry;
+}
+
+/**
+ * Remove the oldest waiter from a wait queue (queue lock held)
+ */
+static wait_entry_t* wait_queue_pop(wait_queue_t* queue) {
+    wait_entry_t* entry = queue->head;
+    if (entry) {
+        queue->head = entry->next;
+        if (!queue->head) {
+            queue->tail = NULL;
+        }
+    }
+    return entry;
+}
+
+/**
+ * Sleep until a queued entry is woken
+ * 
+ * Called and returns with the queue lock held. The task is marked blocked
+ * while the lock is still held, so a waker (which takes the same lock)
+ * can never slip its wakeup in before the task blocks. Before preemptive
+ * scheduling runs there is nothing to block on, so the waiter yields.
+ * 
+ * @param lock Lock protecting the wait queue
+ * @param entry Entry already pushed on the queue
+ * @param lock_class Class charged with the block
+ */
+static void wait_queue_sleep(spinlock_t* lock, wait_entry_t* entry, lock_class_t* lock_class) {
+    __sync_fetch_and_add(&lock_class->blocks, 1);
+    
+    while (!entry->woken) {
+        int blocked = scheduler_prepare_to_block();
+        spinlock_release(lock);
+    
+        if (blocked) {
+            scheduler_schedule();
+        } else {
+            switch_task();
+        }
+    
+        spinlock_acquire(lock);
+    }
+}
+
+/**
+ * Wake a queued waiter (queue lock held)
+ */
+static void wait_queue_wake(wait_entry_t* entry) {
+    // The entry lives on the waiter's stack: read it before the waiter can return
+    int task_id = entry->task_id;
+    entry->woken = 1;
+    scheduler_unblock_task(task_id);
+}
 
 /**
  * Initialize a spinlock
@@ -9,7 +140,8 @@
  */
 void spinlock_init(spinlock_t* lock) {
     if (lock) {
-        lock->lock = 0;
+        lock->ticket = 0;
+        lock->lock_class = NULL;
     }
 }
 
@@ -23,12 +155,30 @@ void spinlock_acquire(spinlock_t* lock) {
         return;
     }
     
-    // Simple spinlock implementation with atomic test-and-set
-    while (__sync_lock_test_and_set(&lock->lock, 1)) {
-        // While waiting for the lock to be released, yield to other tasks
-        // This prevents a task from monopolizing CPU time while waiting
-        switch_task();
+    lock_class_t* lock_class = lock->lock_class ? lock->lock_class : &spinlock_class;
+    
+    // Take a ticket; waiters are served strictly in ticket order
+    uint16_t ticket = (uint16_t)(__sync_fetch_and_add(&lock->ticket, 1u << 16) >> 16);
+    
+    if (lock->owner != ticket) {
+        uint64_t start = sync_rdtsc();
+        uint32_t spins = 0;
+    
+        while (lock->owner != ticket) {
+            sync_cpu_relax();
+    
+            // The holder may have been preempted on this CPU: let it run
+            if (++spins >= SPINLOCK_SPIN_LIMIT && sync_irqs_enabled()) {
+                switch_task();
+            }
+        }
+    
+        __sync_fetch_and_add(&lock_class->contended, 1);
+        __sync_fetch_and_add(&lock_class->spin_cycles, sync_rdtsc() - start);
     }
+    
+    lock_class->acquires++;
+    __sync_synchronize();
 }
 
 /**
@@ -42,8 +192,18 @@ int spinlock_try_acquire(spinlock_t* lock) {
         return 0;
     }
     
-    // Non-blocking test-and-set
-    return !__sync_lock_test_and_set(&lock->lock, 1);
+    // Only take a ticket if it would be served immediately
+    uint32_t old = lock->ticket;
+    if ((uint16_t)old != (uint16_t)(old >> 16)) {
+        return 0;
+    }
+    if (!__sync_bool_compare_and_swap(&lock->ticket, old, old + (1u << 16))) {
+        return 0;
+    }
+    
+    lock_class_t* lock_class = lock->lock_class ? lock->lock_class : &spinlock_class;
+    lock_class->acquires++;
+    return 1;
 }
 
 /**
@@ -56,8 +216,9 @@ void spinlock_release(spinlock_t* lock) {
         return;
     }
     
-    // Release the lock with a memory barrier
-    __sync_lock_release(&lock->lock);
+    // Serve the next ticket; only the holder writes the owner half
+    __sync_synchronize();
+    lock->owner = (uint16_t)(lock->owner + 1);
 }
 
 /**
@@ -67,7 +228,7 @@ void spinlock_release(spinlock_t* lock) {
  * @return 1 if held, 0 if not held
  */
 int spinlock_is_held(spinlock_t* lock) {
-    return lock && lock->lock == 1;
+    return lock && lock->owner != lock->next;
 }
 
 /**
@@ -80,12 +241,39 @@ void mutex_init(mutex_t* mutex) {
         spinlock_init(&mutex->spinlock);
         mutex->owner_task = -1;
         mutex->lock_count = 0;
+        mutex->waiters.head = NULL;
+        mutex->waiters.tail = NULL;
+        mutex->lock_class = NULL;
+    }
+}
+
+/**
+ * Take a free mutex (spinlock held)
+ */
+static inline int mutex_take_locked(mutex_t* mutex, int task_id) {
+    if (mutex->owner_task != -1) {
+        return 0;
     }
+    mutex->owner_task = task_id;
+    mutex->lock_count = 1;
+    return 1;
+}
+
+/**
+ * Check whether the owner of a mutex is running on some CPU
+ */
+static int mutex_owner_running(int owner_task) {
+    task_t* owner = scheduler_find_task_by_id(owner_task);
+    return owner && owner->state == TASK_STATE_RUNNING;
 }
 
 /**
  * Lock a mutex
  * 
+ * Spins briefly while the owner is running on another CPU (it will likely
+ * release the mutex soon), otherwise parks on the mutex's wait queue until
+ * mutex_unlock() hands ownership over directly.
+ * 
  * @param mutex Mutex to lock
  */
 void mutex_lock(mutex_t* mutex) {
@@ -94,6 +282,7 @@ void mutex_lock(mutex_t* mutex) {
     }
     
     int current_task_id = get_current_task_id();
+    lock_class_t* lock_class = mutex->lock_class ? mutex->lock_class : &mutex_class;
     
     // Check if we already own this mutex (re-entrant mutex support)
     if (mutex->owner_task == current_task_id) {
@@ -102,27 +291,50 @@ void mutex_lock(mutex_t* mutex) {
         return;
     }
     
-    // Acquire the spinlock that protects the mutex structure
+    // Fast path: the mutex is free
     spinlock_acquire(&mutex->spinlock);
-    
-    // Check if the mutex is already owned
-    while (mutex->owner_task != -1) {
-        // Release the spinlock before waiting
+    if (mutex_take_locked(mutex, current_task_id)) {
         spinlock_release(&mutex->spinlock);
-        
-        // Yield to other tasks while waiting
-        switch_task();
-        
-        // Try to acquire the spinlock again to check the mutex state
-        spinlock_acquire(&mutex->spinlock);
+        lock_class->acquires++;
+        return;
     }
+    spinlock_release(&mutex->spinlock);
     
-    // We now own the mutex
-    mutex->owner_task = current_task_id;
-    mutex->lock_count = 1;
+    __sync_fetch_and_add(&lock_class->contended, 1);
     
-    // Release the spinlock
+    // Adaptive phase: spin while the owner is on a CPU and nobody is queued
+    uint64_t start = sync_rdtsc();
+    for (int spins = 0; spins < MUTEX_SPIN_LIMIT; spins++) {
+        int owner = mutex->owner_task;
+    
+        if (owner == -1 && !mutex->waiters.head) {
+            spinlock_acquire(&mutex->spinlock);
+            int taken = !mutex->waiters.head && mutex_take_locked(mutex, current_task_id);
+            spinlock_release(&mutex->spinlock);
+    
+            if (taken) {
+                __sync_fetch_and_add(&lock_class->spin_cycles, sync_rdtsc() - start);
+                lock_class->acquires++;
+                return;
+            }
+        } else if (owner != -1 && !mutex_owner_running(owner)) {
+            break;
+        }
+    
+        sync_cpu_relax();
+    }
+    __sync_fetch_and_add(&lock_class->spin_cycles, sync_rdtsc() - start);
+    
+    // Slow path: queue up and sleep until the owner hands the mutex over
+    spinlock_acquire(&mutex->spinlock);
+    if (!mutex_take_locked(mutex, current_task_id)) {
+        wait_entry_t entry = { current_task_id, 0, NULL };
+        wait_queue_push(&mutex->waiters, &entry);
+        wait_queue_sleep(&mutex->spinlock, &entry, lock_class);
+    }
     spinlock_release(&mutex->spinlock);
+    
+    lock_class->acquires++;
 }
 
 /**
@@ -152,17 +364,15 @@ int mutex_try_lock(mutex_t* mutex) {
     }
     
     // Check if the mutex is already owned
-    int result = 0;
-    if (mutex->owner_task == -1) {
-        // We can take ownership
-        mutex->owner_task = current_task_id;
-        mutex->lock_count = 1;
-        result = 1;
-    }
+    int result = mutex_take_locked(mutex, current_task_id);
     
     // Release the spinlock
     spinlock_release(&mutex->spinlock);
     
+    if (result) {
+        lock_class_t* lock_class = mutex->lock_class ? mutex->lock_class : &mutex_class;
+        lock_class->acquires++;
+    }
     return result;
 }
 
@@ -191,9 +401,16 @@ void mutex_unlock(mutex_t* mutex) {
     // Decrement the lock count
     mutex->lock_count--;
     
-    // If lock count is zero, release ownership
+    // If lock count is zero, hand the mutex to the oldest waiter or release it
     if (mutex->lock_count == 0) {
-        mutex->owner_task = -1;
+        wait_entry_t* waiter = wait_queue_pop(&mutex->waiters);
+        if (waiter) {
+            mutex->owner_task = waiter->task_id;
+            mutex->lock_count = 1;
+            wait_queue_wake(waiter);
+        } else {
+            mutex->owner_task = -1;
+        }
     }
     
     // Release the spinlock
@@ -212,6 +429,8 @@ void semaphore_init(semaphore_t* sem, int initial_count, int max_count) {
         spinlock_init(&sem->spinlock);
         sem->count = initial_count;
         sem->max_count = max_count;
+        sem->waiters.head = NULL;
+        sem->waiters.tail = NULL;
     }
 }
 
@@ -225,24 +444,26 @@ void semaphore_wait(semaphore_t* sem) {
         return;
     }
     
-    while (1) {
-        // Acquire the spinlock
-        spinlock_acquire(&sem->spinlock);
-        
-        // Check if the semaphore count is > 0
-        if (sem->count > 0) {
-            // Decrement the count and return
-            sem->count--;
-            spinlock_release(&sem->spinlock);
-            return;
-        }
-        
-        // Release the spinlock before yielding
+    // Acquire the spinlock
+    spinlock_acquire(&sem->spinlock);
+    
+    // Check if the semaphore count is > 0
+    if (sem->count > 0) {
+        // Decrement the count and return
+        sem->count--;
         spinlock_release(&sem->spinlock);
-        
-        // Yield to other tasks while waiting
-        switch_task();
+        semaphore_class.acquires++;
+        return;
     }
+    
+    // Sleep until semaphore_signal() hands us a unit directly
+    __sync_fetch_and_add(&semaphore_class.contended, 1);
+    wait_entry_t entry = { get_current_task_id(), 0, NULL };
+    wait_queue_push(&sem->waiters, &entry);
+    wait_queue_sleep(&sem->spinlock, &entry, &semaphore_class);
+    
+    spinlock_release(&sem->spinlock);
+    semaphore_class.acquires++;
 }
 
 /**
@@ -285,8 +506,11 @@ void semaphore_signal(semaphore_t* sem) {
     // Acquire the spinlock
     spinlock_acquire(&sem->spinlock);
     
-    // Check if the count is less than max_count
-    if (sem->count < sem->max_count) {
+    // Pass the unit straight to the oldest waiter, if any
+    wait_entry_t* waiter = wait_queue_pop(&sem->waiters);
+    if (waiter) {
+        wait_queue_wake(waiter);
+    } else if (sem->count < sem->max_count) {
         // Increment the count
         sem->count++;
     }
@@ -304,6 +528,8 @@ void condition_init(condition_t* cond) {
     if (cond) {
         spinlock_init(&cond->spinlock);
         cond->waiters_count = 0;
+        cond->waiters.head = NULL;
+        cond->waiters.tail = NULL;
     }
 }
 
@@ -318,33 +544,18 @@ void condition_wait(condition_t* cond, mutex_t* mutex) {
         return;
     }
     
-    // Acquire the condition's spinlock
+    // Queue up before dropping the mutex so a signal cannot be missed
     spinlock_acquire(&cond->spinlock);
-    
-    // Increment the number of waiters
+    wait_entry_t entry = { get_current_task_id(), 0, NULL };
+    wait_queue_push(&cond->waiters, &entry);
     cond->waiters_count++;
     
-    // Release the spinlock
-    spinlock_release(&cond->spinlock);
-    
     // Release the mutex to allow other tasks to signal the condition
     mutex_unlock(mutex);
     
     // Wait for the condition to be signaled
-    // This is a simple polling implementation
-    while (1) {
-        // Check if the condition has been signaled (waiters_count decreased)
-        spinlock_acquire(&cond->spinlock);
-        int is_signaled = (cond->waiters_count < 1);
-        spinlock_release(&cond->spinlock);
-        
-        if (is_signaled) {
-            break;
-        }
-        
-        // Yield to other tasks while waiting
-        switch_task();
-    }
+    wait_queue_sleep(&cond->spinlock, &entry, &condition_class);
+    spinlock_release(&cond->spinlock);
     
     // Reacquire the mutex before returning
     mutex_lock(mutex);
@@ -363,9 +574,11 @@ void condition_signal(condition_t* cond) {
     // Acquire the spinlock
     spinlock_acquire(&cond->spinlock);
     
-    // If there are waiters, decrement the count
-    if (cond->waiters_count > 0) {
+    // Wake the oldest waiter, if any
+    wait_entry_t* waiter = wait_queue_pop(&cond->waiters);
+    if (waiter) {
         cond->waiters_count--;
+        wait_queue_wake(waiter);
     }
     
     // Release the spinlock
@@ -385,9 +598,322 @@ void condition_broadcast(condition_t* cond) {
     // Acquire the spinlock
     spinlock_acquire(&cond->spinlock);
     
-    // Reset waiters count to 0 to wake all waiters
+    // Wake every waiter
+    wait_entry_t* waiter;
+    while ((waiter = wait_queue_pop(&cond->waiters)) != NULL) {
+        wait_queue_wake(waiter);
+    }
     cond->waiters_count = 0;
     
     // Release the spinlock
     spinlock_release(&cond->spinlock);
-}
\ No newline at end of file
+}
+
+/**
+ * Initialize a reader-writer lock
+ * 
+ * @param lock Reader-writer lock to initialize
+ */
+void rwlock_init(rwlock_t* lock) {
+    if (lock) {
+        lock->state = 0;
+        lock->writers_waiting = 0;
+        lock->lock_class = NULL;
+    }
+}
+
+/**
+ * Spin once while waiting for a reader-writer lock
+ */
+static inline void rwlock_spin(uint32_t* spins) {
+    sync_cpu_relax();
+    
+    // The holder may have been preempted on this CPU: let it run
+    if (++*spins >= SPINLOCK_SPIN_LIMIT && sync_irqs_enabled()) {
+        switch_task();
+    }
+}
+
+/**
+ * Acquire a reader-writer lock for reading
+ * 
+ * Readers only share a counter, so concurrent lookups never serialize
+ * with each other. New readers wait while a writer holds or waits for
+ * the lock.
+ * 
+ * @param lock Reader-writer lock
+ */
+void rwlock_read_lock(rwlock_t* lock) {
+    if (!lock) {
+        return;
+    }
+    
+    lock_class_t* lock_class = lock->lock_class ? lock->lock_class : &rwlock_class;
+    uint64_t start = 0;
+    uint32_t spins = 0;
+    
+    for (;;) {
+        int32_t state = lock->state;
+        if (state != RWLOCK_WRITER && lock->writers_waiting == 0 &&
+            __sync_bool_compare_and_swap(&lock->state, state, state + 1)) {
+            break;
+        }
+        
+        if (spins == 0) {
+            start = sync_rdtsc();
+        }
+        rwlock_spin(&spins);
+    }
+    
+    if (spins) {
+        __sync_fetch_and_add(&lock_class->contended, 1);
+        __sync_fetch_and_add(&lock_class->spin_cycles, sync_rdtsc() - start);
+    }
+    lock_class->acquires++;
+}
+
+/**
+ * Release a read hold on a reader-writer lock
+ * 
+ * @param lock Reader-writer lock
+ */
+void rwlock_read_unlock(rwlock_t* lock) {
+    if (lock) {
+        __sync_fetch_and_sub(&lock->state, 1);
+    }
+}
+
+/**
+ * Acquire a reader-writer lock for writing
+ * 
+ * @param lock Reader-writer lock
+ */
+void rwlock_write_lock(rwlock_t* lock) {
+    if (!lock) {
+        return;
+    }
+    
+    lock_class_t* lock_class = lock->lock_class ? lock->lock_class : &rwlock_class;
+    
+    if (__sync_bool_compare_and_swap(&lock->state, 0, RWLOCK_WRITER)) {
+        lock_class->acquires++;
+        return;
+    }
+    
+    // Announce the writer so no new readers get in, then wait for the rest to drain
+    __sync_fetch_and_add(&lock->writers_waiting, 1);
+    uint64_t start = sync_rdtsc();
+    uint32_t spins = 0;
+    
+    while (!__sync_bool_compare_and_swap(&lock->state, 0, RWLOCK_WRITER)) {
+        rwlock_spin(&spins);
+    }
+    
+    __sync_fetch_and_sub(&lock->writers_waiting, 1);
+    __sync_fetch_and_add(&lock_class->contended, 1);
+    __sync_fetch_and_add(&lock_class->spin_cycles, sync_rdtsc() - start);
+    lock_class->acquires++;
+}
+
+/**
+ * Release a write hold on a reader-writer lock
+ * 
+ * @param lock Reader-writer lock
+ */
+void rwlock_write_unlock(rwlock_t* lock) {
+    if (lock) {
+        __sync_synchronize();
+        lock->state = 0;
+    }
+}
+
+/**
+ * Enter an RCU read-side section
+ * 
+ * Interrupts stay off until the outermost rcu_read_unlock(), so the reader
+ * can neither be preempted nor migrate: a context switch on a CPU therefore
+ * always means no reader is active there.
+ */
+void rcu_read_lock(void) {
+    uint32_t eflags = sync_irq_save();
+    int cpu = scheduler_get_current_cpu();
+    
+    if (rcu.nesting[cpu]++ == 0) {
+        rcu.saved_eflags[cpu] = eflags;
+    }
+    
+    // Make the nesting count visible before any protected pointer is loaded
+    __sync_synchronize();
+}
+
+/**
+ * Leave an RCU read-side section
+ */
+void rcu_read_unlock(void) {
+    int cpu = scheduler_get_current_cpu();
+    
+    __sync_synchronize();
+    if (--rcu.nesting[cpu] == 0) {
+        rcu.quiescent[cpu]++;
+        sync_irq_restore(rcu.saved_eflags[cpu]);
+    }
+}
+
+/**
+ * Report a quiescent state for a CPU
+ * 
+ * @param cpu_id CPU that just switched tasks
+ */
+void rcu_note_context_switch(int cpu_id) {
+    if (cpu_id >= 0 && cpu_id < SYNC_MAX_CPUS) {
+        rcu.quiescent[cpu_id]++;
+    }
+}
+
+/**
+ * Wait for an RCU grace period
+ * 
+ * Called after unpublishing an object and before freeing it. Only CPUs
+ * that are inside a read-side section right now have to be waited for,
+ * and only until their quiescent counter moves; readers that start later
+ * can no longer find the object.
+ */
+void synchronize_rcu(void) {
+    uint32_t snapshot[SYNC_MAX_CPUS];
+    int num_cpus = scheduler_get_cpu_count();
+    int self = scheduler_get_current_cpu();
+    
+    if (num_cpus > SYNC_MAX_CPUS) {
+        num_cpus = SYNC_MAX_CPUS;
+    }
+    if (rcu.nesting[self] != 0) {
+        log_error("SYNC", "synchronize_rcu() called inside an RCU read-side section");
+        return;
+    }
+    
+    // Order the caller's unpublishing store before the samples below
+    __sync_synchronize();
+    
+    // Counters first: a reader seen active below must bump its counter on exit
+    for (int cpu = 0; cpu < num_cpus; cpu++) {
+        snapshot[cpu] = rcu.quiescent[cpu];
+    }
+    __sync_synchronize();
+    
+    for (int cpu = 0; cpu < num_cpus; cpu++) {
+        if (cpu == self || rcu.nesting[cpu] == 0) {
+            continue;
+        }
+        
+        uint32_t spins = 0;
+        while (rcu.quiescent[cpu] == snapshot[cpu]) {
+            rwlock_spin(&spins);
+        }
+    }
+    
+    __sync_fetch_and_add(&rcu.grace_periods, 1);
+}
+
+/**
+ * Register a lock class
+ * 
+ * @param lock_class Class to register (must stay valid forever)
+ * @param name Class name
+ */
+void lock_class_init(lock_class_t* lock_class, const char* name) {
+    if (!lock_class) {
+        return;
+    }
+    
+    lock_class->name = name;
+    lock_class->acquires = 0;
+    lock_class->contended = 0;
+    lock_class->spin_cycles = 0;
+    lock_class->blocks = 0;
+    
+    spinlock_acquire(&lock_class_lock);
+    lock_class->next = lock_classes;
+    lock_classes = lock_class;
+    spinlock_release(&lock_class_lock);
+}
+
+/**
+ * Account a spinlock under a lock class
+ * 
+ * @param lock Spinlock
+ * @param lock_class Registered class, or NULL for the default
+ */
+void spinlock_set_class(spinlock_t* lock, lock_class_t* lock_class) {
+    if (lock) {
+        lock->lock_class = lock_class;
+    }
+}
+
+/**
+ * Account a mutex under a lock class
+ * 
+ * @param mutex Mutex
+ * @param lock_class Registered class, or NULL for the default
+ */
+void mutex_set_class(mutex_t* mutex, lock_class_t* lock_class) {
+    if (mutex) {
+        mutex->lock_class = lock_class;
+    }
+}
+
+/**
+ * Account a reader-writer lock under a lock class
+ * 
+ * @param lock Reader-writer lock
+ * @param lock_class Registered class, or NULL for the default
+ */
+void rwlock_set_class(rwlock_t* lock, lock_class_t* lock_class) {
+    if (lock) {
+        lock->lock_class = lock_class;
+    }
+}
+
+/**
+ * Get statistics for every registered lock class
+ * 
+ * @param stats Output array
+ * @param max_classes Number of entries available in the output array
+ * @return Number of entries written
+ */
+int lock_get_class_stats(lock_class_stats_t* stats, int max_classes) {
+    if (!stats || max_classes <= 0) {
+        return 0;
+    }
+    
+    int count = 0;
+    spinlock_acquire(&lock_class_lock);
+    for (lock_class_t* lock_class = lock_classes; lock_class && count < max_classes;
+         lock_class = lock_class->next) {
+        stats[count].name = lock_class->name;
+        stats[count].acquires = lock_class->acquires;
+        stats[count].contended = lock_class->contended;
+        stats[count].spin_cycles = lock_class->spin_cycles;
+        stats[count].blocks = lock_class->blocks;
+        count++;
+    }
+    spinlock_release(&lock_class_lock);
+    
+    return count;
+}
+
+/**
+ * Log the statistics of every lock class that saw contention
+ */
+void lock_dump_stats(void) {
+    lock_class_stats_t stats[32];
+    int count = lock_get_class_stats(stats, 32);
+    
+    for (int i = 0; i < count; i++) {
+        if (stats[i].contended == 0 && stats[i].blocks == 0) {
+            continue;
+        }
+        log_info("SYNC", "%s: %u acquires, %u contended, %llu spin cycles, %u blocks",
+                 stats[i].name, stats[i].acquires, stats[i].contended,
+                 stats[i].spin_cycles, stats[i].blocks);
+    }
+}
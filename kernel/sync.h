@@ -3,16 +3,57 @@
 
 #include <stdint.h>
 
-// Spinlock type
+// Lock contention statistics, shared by every lock of a class
+typedef struct lock_class {
+    const char* name;                // Class name (for statistics)
+    volatile uint32_t acquires;      // Successful acquisitions (approximate under SMP)
+    volatile uint32_t contended;     // Acquisitions that found the lock held
+    volatile uint64_t spin_cycles;   // TSC cycles spent spinning for the lock
+    volatile uint32_t blocks;        // Times a waiter parked on a wait queue
+    struct lock_class* next;         // Next registered class
+} lock_class_t;
+
+// Snapshot of a lock class's statistics
 typedef struct {
-    volatile uint32_t lock;
+    const char* name;
+    uint32_t acquires;
+    uint32_t contended;
+    uint64_t spin_cycles;
+    uint32_t blocks;
+} lock_class_stats_t;
+
+// Ticket spinlock: FIFO among spinners, waiters spin with pause
+typedef struct {
+    union {
+        volatile uint32_t ticket;    // Both halves, for atomic ticket handout
+        struct {
+            volatile uint16_t owner; // Ticket currently holding the lock
+            volatile uint16_t next;  // Next ticket to hand out
+        };
+    };
+    lock_class_t* lock_class;        // Statistics class (NULL for the default)
 } spinlock_t;
 
-// Mutex type
+// Waiter parked on a wait queue (lives on the waiter's stack)
+typedef struct wait_entry {
+    int task_id;                     // Task to unblock
+    volatile int woken;              // Set by the waker before unblocking
+    struct wait_entry* next;
+} wait_entry_t;
+
+// FIFO queue of blocked waiters
 typedef struct {
-    spinlock_t spinlock;
-    int owner_task;
+    wait_entry_t* head;
+    wait_entry_t* tail;
+} wait_queue_t;
+
+// Mutex type: spins while the owner runs, then parks on its wait queue
+typedef struct {
+    spinlock_t spinlock;             // Protects the fields below
+    volatile int owner_task;
     int lock_count;
+    wait_queue_t waiters;            // Tasks blocked on the mutex, in arrival order
+    lock_class_t* lock_class;        // Statistics class (NULL for the default)
 } mutex_t;
 
 // Semaphore type
@@ -20,14 +61,32 @@ typedef struct {
     spinlock_t spinlock;
     int count;
     int max_count;
+    wait_queue_t waiters;            // Tasks blocked in semaphore_wait()
 } semaphore_t;
 
 // Condition variable type
 typedef struct {
     spinlock_t spinlock;
     int waiters_count;
+    wait_queue_t waiters;            // Tasks blocked in condition_wait()
 } condition_t;
 
+// Reader-writer lock: shared readers or one writer. A waiting writer holds
+// off new readers so it cannot be starved; read sections must not nest.
+typedef struct {
+    volatile int32_t state;          // Active readers, or RWLOCK_WRITER while write-held
+    volatile uint32_t writers_waiting;
+    lock_class_t* lock_class;        // Statistics class (NULL for the default)
+} rwlock_t;
+
+#define RWLOCK_WRITER (-1)
+
+// Publish a pointer for RCU readers (orders the pointee's initialization first)
+#define rcu_assign_pointer(p, v) do { __sync_synchronize(); (p) = (v); } while (0)
+
+// Load a pointer published with rcu_assign_pointer() inside a read-side section
+#define rcu_dereference(p) (*(__typeof__(p) volatile*)&(p))
+
 // Initialize a spinlock
 void spinlock_init(spinlock_t* lock);
 
@@ -79,4 +138,49 @@ void condition_signal(condition_t* cond);
 // Broadcast to all waiters on a condition variable
 void condition_broadcast(condition_t* cond);
 
-#endif // SYNC_H
\ No newline at end of file
+// Initialize a reader-writer lock
+void rwlock_init(rwlock_t* lock);
+
+// Acquire a reader-writer lock for reading
+void rwlock_read_lock(rwlock_t* lock);
+
+// Release a read hold on a reader-writer lock
+void rwlock_read_unlock(rwlock_t* lock);
+
+// Acquire a reader-writer lock for writing
+void rwlock_write_lock(rwlock_t* lock);
+
+// Release a write hold on a reader-writer lock
+void rwlock_write_unlock(rwlock_t* lock);
+
+// Enter an RCU read-side section (nests; runs with local interrupts off, must not sleep)
+void rcu_read_lock(void);
+
+// Leave an RCU read-side section
+void rcu_read_unlock(void);
+
+// Wait until every RCU read-side section running at the time of the call has ended
+void synchronize_rcu(void);
+
+// Report a quiescent state for a CPU (called by the scheduler on every context switch)
+void rcu_note_context_switch(int cpu_id);
+
+// Register a lock class (the structure must stay valid forever)
+void lock_class_init(lock_class_t* lock_class, const char* name);
+
+// Account a spinlock under a lock class
+void spinlock_set_class(spinlock_t* lock, lock_class_t* lock_class);
+
+// Account a mutex under a lock class
+void mutex_set_class(mutex_t* mutex, lock_class_t* lock_class);
+
+// Account a reader-writer lock under a lock class
+void rwlock_set_class(rwlock_t* lock, lock_class_t* lock_class);
+
+// Get statistics for every registered lock class, returns the number written
+int lock_get_class_stats(lock_class_stats_t* stats, int max_classes);
+
+// Log the statistics of every lock class that saw contention
+void lock_dump_stats(void);
+
+#endif // SYNC_H
@@ -1,6 +1,7 @@
 #include "gdt.h"
 #include "asm.h"
 #include "security.h"
+#include "ktimer.h"
 #include <inttypes.h>
 
 #pragma once
@@ -147,13 +148,14 @@ extern struct uintos_tss uintos_init_tss;
 #define TASK_PRIV_USER       3       // User applications (ring 3)
 
 // Enhanced task structure with new scheduler fields
-typedef struct {
+typedef struct task {
     int id;                          // Task ID
     unsigned int state;              // Current state (UNUSED, READY, RUNNING, etc.)
     unsigned int flags;              // Task flags (SYSTEM, USER, etc.)
     unsigned int privilege_level;    // Privilege level (0-3)
     unsigned int priority;           // Task priority (0-31, 0 is highest)
     int time_slice;                  // Current time slice remaining
+    uint64_t slice_end_ns;           // Tickless mode: when the current slice ends
     unsigned int stack_size;         // Size of the task's stack
     char name[64];                   // Task name
     void* stack;                     // Task stack
@@ -173,6 +175,16 @@ typedef struct {
     uint64_t creation_time;          // Time when the task was created
     uint64_t last_run_time;          // Last time this task was scheduled
     void* context;                   // Task context for context switching
+    
+    // Scheduler bookkeeping (owned by scheduler.c, protected by the scheduler lock)
+    struct task* rq_next;            // Next task in the same ready queue
+    struct task* rq_prev;            // Previous task in the same ready queue
+    unsigned int rq_priority;        // Ready queue the task is linked on
+    int on_rq;                       // Non-zero while linked on a ready queue
+    struct task* hash_next;          // Next task in the same id hash bucket
+    int cpu;                         // CPU whose run queue the task uses
+    int cpu_affinity;                // CPU the task is pinned to, or -1 for any
+    ktimer_t sleep_timer;            // Wakes the task when a timed sleep ends
 } task_t;
 
 // Task information structure for status reporting
@@ -34,6 +34,9 @@ static void thread_add_to_ready_list(thread_t* thread);
 static void thread_remove_from_ready_list(thread_t* thread);
 static thread_t* thread_get_next_to_run(void);
 static void thread_initialize_context(thread_t* thread);
+static void thread_block_locked(thread_t* thread);
+static int thread_unblock_locked(thread_t* thread);
+static void thread_sleep_expired(ktimer_t* timer, void* data);
 
 /**
  * Initialize the threading system
@@ -425,17 +428,57 @@ void thread_yield(void) {
  * @param milliseconds Sleep time in milliseconds
  */
 void thread_sleep(uint32_t milliseconds) {
-    // TODO: Implement a proper sleep queue with timer-based wakeup
-    // For now, use a simple busy wait with thread yields
+    thread_t* thread = thread_get_current();
+    if (!thread) {
+        // No thread context yet: fall back to polling the clock
+        uint64_t end_time = hal_time_now_ns() + (milliseconds * 1000000ULL);
+        while (hal_time_now_ns() < end_time) {
+            thread_yield();
+        }
+        return;
+    }
+    
+    // Block on the thread's own wheel timer instead of spinning
+    ktimer_cancel(&thread->sleep_timer);
+    thread->sleep_expired = 0;
+    ktimer_init(&thread->sleep_timer, thread_sleep_expired, thread);
+    ktimer_arm(&thread->sleep_timer, milliseconds);
+    
+    while (!thread->sleep_expired && !thread->wake_requested) {
+        spinlock_acquire(&thread_lock);
+        
+        // The timer may have fired before we got the lock
+        if (thread->sleep_expired || thread->wake_requested) {
+            spinlock_release(&thread_lock);
+            break;
+        }
+        
+        thread_block_locked(thread);
+        spinlock_release(&thread_lock);
+        thread_scheduler();
+    }
     
-    // Calculate end time
-    uint64_t start_time = hal_time_now_ns();
-    uint64_t end_time = start_time + (milliseconds * 1000000ULL);
+    // Drop a wakeup retry that may still be queued
+    ktimer_cancel(&thread->sleep_timer);
+    thread->wake_requested = 0;
+}
+
+/**
+ * Timer wheel callback ending a thread_sleep()
+ */
+static void thread_sleep_expired(ktimer_t* timer, void* data) {
+    thread_t* thread = (thread_t*)data;
+    
+    thread->sleep_expired = 1;
     
-    while (hal_time_now_ns() < end_time) {
-        // Yield to other threads while sleeping
-        thread_yield();
+    // Runs in interrupt context: never spin on a lock the interrupted code
+    // may hold, retry on the next millisecond instead
+    if (!spinlock_try_acquire(&thread_lock)) {
+        ktimer_arm(timer, 1);
+        return;
     }
+    thread_unblock_locked(thread);
+    spinlock_release(&thread_lock);
 }
 
 /**
@@ -445,8 +488,45 @@ void thread_sleep(uint32_t milliseconds) {
  * @return 0 on success, negative value on error
  */
 int thread_wake(thread_id_t thread_id) {
-    // TODO: Implement when proper sleep queue is added
-    return -1;
+    thread_t* thread = thread_get_by_id(thread_id);
+    if (!thread) {
+        return -1;
+    }
+    
+    // Only a thread with an armed sleep timer is sleeping
+    if (!ktimer_cancel(&thread->sleep_timer)) {
+        return -1;
+    }
+    
+    spinlock_acquire(&thread_lock);
+    thread->sleep_expired = 1;
+    thread_unblock_locked(thread);
+    spinlock_release(&thread_lock);
+    
+    return 0;
+}
+
+/**
+ * Wake up a sleeping thread from interrupt context
+ * 
+ * thread_lock may be held by the interrupted code, so instead of taking it
+ * the sleep timer is brought forward and its callback does the wakeup. The
+ * request is remembered if the thread is not asleep yet.
+ * 
+ * @param thread_id Thread ID to wake
+ * @return 0 on success, negative value on error
+ */
+int thread_wake_irq(thread_id_t thread_id) {
+    thread_t* thread = thread_get_by_id(thread_id);
+    if (!thread) {
+        return -1;
+    }
+    
+    thread->wake_requested = 1;
+    __sync_synchronize();
+    ktimer_expedite(&thread->sleep_timer);
+    
+    return 0;
 }
 
 /**
@@ -476,19 +556,7 @@ void thread_block(void) {
         return;
     }
     
-    // Change state to blocked
-    thread->state = THREAD_STATE_BLOCKED;
-    
-    // Remove from ready list
-    thread_remove_from_ready_list(thread);
-    
-    // Add to blocked list
-    thread->next = blocked_threads_head;
-    if (blocked_threads_head) {
-        blocked_threads_head->prev = thread;
-    }
-    thread->prev = NULL;
-    blocked_threads_head = thread;
+    thread_block_locked(thread);
     
     // Release thread lock
     spinlock_release(&thread_lock);
@@ -511,10 +579,39 @@ int thread_unblock(thread_id_t thread_id) {
     
     // Acquire thread lock
     spinlock_acquire(&thread_lock);
+    int result = thread_unblock_locked(thread);
+    spinlock_release(&thread_lock);
+    
+    return result;
+}
+
+/**
+ * Move the current thread to the blocked list (thread lock held)
+ */
+static void thread_block_locked(thread_t* thread) {
+    // Change state to blocked
+    thread->state = THREAD_STATE_BLOCKED;
+    
+    // Remove from ready list
+    thread_remove_from_ready_list(thread);
     
+    // Add to blocked list
+    thread->next = blocked_threads_head;
+    if (blocked_threads_head) {
+        blocked_threads_head->prev = thread;
+    }
+    thread->prev = NULL;
+    blocked_threads_head = thread;
+}
+
+/**
+ * Move a blocked thread back to the ready list (thread lock held)
+ * 
+ * @return 0 on success, -1 if the thread was not blocked
+ */
+static int thread_unblock_locked(thread_t* thread) {
     // Check if thread is blocked
     if (thread->state != THREAD_STATE_BLOCKED) {
-        spinlock_release(&thread_lock);
         return -1;
     }
     
@@ -535,9 +632,6 @@ int thread_unblock(thread_id_t thread_id) {
     // Add to ready list
     thread_add_to_ready_list(thread);
     
-    // Release thread lock
-    spinlock_release(&thread_lock);
-    
     return 0;
 }
 
@@ -878,6 +972,7 @@ static void thread_clean_up(thread_t* thread) {
     }
     
     // Remove from any lists
+    ktimer_cancel(&thread->sleep_timer);
     thread_remove_from_ready_list(thread);
     
     // Mark slot as free
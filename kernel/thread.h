@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include "sync.h"
+#include "ktimer.h"
 
 // Thread state definitions
 #define THREAD_STATE_NEW      0
@@ -73,6 +74,10 @@ typedef struct thread {
     int exit_code;                                // Exit code
     semaphore_t join_semaphore;                   // For thread join functionality
     
+    ktimer_t sleep_timer;                         // Ends a thread_sleep() early or on time
+    volatile int sleep_expired;                   // Set once the sleep period is over
+    volatile int wake_requested;                  // thread_wake_irq() called, ends the next sleep at once
+    
     struct thread* next;                          // Next thread in list
     struct thread* prev;                          // Previous thread in list
 } thread_t;
@@ -117,6 +122,10 @@ void thread_sleep(uint32_t milliseconds);
 // Wake up a sleeping thread
 int thread_wake(thread_id_t thread_id);
 
+// Wake up a sleeping thread from interrupt context (a thread not yet asleep
+// returns from its next thread_sleep() at once)
+int thread_wake_irq(thread_id_t thread_id);
+
 // Get thread state
 int thread_get_state(thread_id_t thread_id);
 
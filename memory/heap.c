@@ -1,5 +1,6 @@
 #include "heap.h"
 #include "paging.h"
+#include "slab.h"
 #include "../kernel/logging/log.h"
 #include <stdint.h>
 #include <string.h>
@@ -143,6 +144,10 @@ heap_t* heap_create(void* start, uint32_t size) {
     heap_stats.free_bytes = size;
     
     log_info("Heap: Initialized at %p with size %u bytes", heap->start, size);
+    
+    // Bring up the slab caches that front small allocations
+    slab_init();
+    
     return heap;
 }
 
@@ -501,6 +506,29 @@ void* heap_alloc(heap_t* heap, uint32_t size) {
         size = (size + HEAP_ALIGN) & ~(HEAP_ALIGN - 1);
     }
     
+    // Small allocations are served by the per-CPU slab magazines
+    if (size <= SLAB_MAX_OBJECT_SIZE && slab_is_initialized()) {
+        void* obj = kmem_alloc(size);
+        if (obj) {
+            heap_stats.total_allocations++;
+            heap_stats.current_allocations++;
+            heap_stats.allocated_bytes += kmem_object_size(obj);
+            
+            if (size > heap_stats.largest_allocation) {
+                heap_stats.largest_allocation = size;
+            }
+            
+            if (heap_stats.smallest_allocation == 0 || size < heap_stats.smallest_allocation) {
+                heap_stats.smallest_allocation = size;
+            }
+            
+            // Clear memory before returning (security)
+            memset(obj, 0, size);
+            return obj;
+        }
+        // Fall through to the block allocator if the slab layer is out of pages
+    }
+    
     // For large allocations, consider using guard pages
     if (USE_GUARD_PAGES && size >= PAGE_SIZE) {
         // Allocate directly from the page allocator with guard pages
@@ -585,6 +613,22 @@ void heap_free(heap_t* heap, void* ptr) {
         return;
     }
     
+    // Objects from the slab caches go back to their magazines
+    if (kmem_is_slab_object(ptr)) {
+        uint32_t object_size = kmem_object_size(ptr);
+        
+        if (POISON_FREED) {
+            memset(ptr, POISON_PATTERN, object_size);
+        }
+        
+        kmem_free(ptr);
+        
+        heap_stats.total_frees++;
+        heap_stats.current_allocations--;
+        heap_stats.allocated_bytes -= object_size;
+        return;
+    }
+    
     // Check if this is a large guarded allocation
     if (USE_GUARD_PAGES) {
         // Get page aligned address
@@ -663,6 +707,23 @@ void* heap_realloc(heap_t* heap, void* ptr, uint32_t size) {
         size = (size + HEAP_ALIGN) & ~(HEAP_ALIGN - 1);
     }
     
+    // Slab objects can grow in place up to their size-class
+    if (kmem_is_slab_object(ptr)) {
+        uint32_t current_size = kmem_object_size(ptr);
+        if (size <= current_size) {
+            return ptr;
+        }
+        
+        void* new_ptr = heap_alloc(heap, size);
+        if (!new_ptr) {
+            return NULL;
+        }
+        
+        memcpy(new_ptr, ptr, current_size);
+        heap_free(heap, ptr);
+        return new_ptr;
+    }
+    
     // Check if this is a large guarded allocation
     if (USE_GUARD_PAGES) {
         // Get page aligned address
@@ -769,6 +830,10 @@ uint32_t heap_get_size(void* ptr) {
         return 0;
     }
     
+    if (kmem_is_slab_object(ptr)) {
+        return kmem_object_size(ptr);
+    }
+    
     // Check if this is a large guarded allocation
     if (USE_GUARD_PAGES) {
         // Get page aligned address
@@ -843,6 +908,20 @@ void heap_dump_stats(heap_t* heap) {
     log_info("  Largest Allocation: %u bytes", heap_stats.largest_allocation);
     log_info("  Smallest Allocation: %u bytes", heap_stats.smallest_allocation);
     log_info("  Errors Detected: %u", heap_stats.error_count + heap->error_count);
+    
+    // Slab caches fronting small allocations
+    kmem_cache_stats_t slab_stats[SLAB_MAX_CACHES];
+    int caches = kmem_get_all_stats(slab_stats, SLAB_MAX_CACHES);
+    if (caches > 0) {
+        log_info("Slab Caches:");
+        for (int i = 0; i < caches; i++) {
+            log_info("  %s: %u bytes, %u slabs, %u in use, %u cached, %u hits, %u misses",
+                     slab_stats[i].name, slab_stats[i].object_size,
+                     slab_stats[i].slabs_total, slab_stats[i].objects_in_use,
+                     slab_stats[i].objects_cached, slab_stats[i].magazine_hits,
+                     slab_stats[i].magazine_misses);
+        }
+    }
 }
 
 // Get heap stats
@@ -852,6 +931,11 @@ void heap_get_stats(heap_stats_t* stats) {
     }
 }
 
+// Get slab cache stats for the caches fronting small allocations
+int heap_get_slab_stats(kmem_cache_stats_t* stats, int max_caches) {
+    return kmem_get_all_stats(stats, max_caches);
+}
+
 // Reset the heap statistics
 void heap_reset_stats() {
     // Keep total_size and free_bytes as they are
@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "slab.h"
 
 // Heap management functions
 void heap_init(void);
@@ -27,6 +28,9 @@ typedef struct {
 
 void heap_get_stats(heap_stats_t *stats);
 
+// Slab cache statistics for allocations <= SLAB_MAX_OBJECT_SIZE
+int heap_get_slab_stats(kmem_cache_stats_t *stats, int max_caches);
+
 // Debug functions
 void heap_dump(void);         // Dump heap layout for debugging
 void heap_check(void);        // Verify heap integrity
@@ -1,6 +1,7 @@
 #include "paging.h"
 #include "../kernel/logging/log.h"
 #include "../kernel/sync.h" // Add synchronization support
+#include "../kernel/thread.h"
 #include <stdint.h>
 #include <string.h>
 
@@ -16,11 +17,39 @@ typedef struct {
 // Memory management metadata
 typedef struct {
     uint8_t state;          // PAGE_FREE, PAGE_USED, PAGE_RESERVED
+    uint8_t order;          // Order of the free buddy block this frame heads
     uint16_t references;    // Reference count for shared pages
     uint32_t flags;         // Page flags/attributes
     uint32_t owner_pid;     // Process that owns this page
+    uint32_t buddy_next;    // Next free block of the same order
+    uint32_t buddy_prev;    // Previous free block of the same order
 } page_info_t;
 
+// Buddy allocator configuration
+#define BUDDY_MAX_ORDER   21          // Blocks from 1 page up to 2^20 pages (the whole 4GB space)
+#define BUDDY_NONE        0xFFFFFFFF  // End-of-list marker for page indices
+#define PAGING_MAX_CPUS   16          // Matches the scheduler's MAX_CPUS
+#define PCP_HIGH          32          // Hot pages cached per CPU
+#define PCP_BATCH         8           // Pages moved between a CPU cache and the buddy lists
+
+// Background zeroing configuration
+#define ZERO_POOL_SIZE    64          // Pre-zeroed frames kept ready for allocate_page()
+#define ZERO_REFILL_BATCH 8           // Frames zeroed per pass of the zeroing thread
+#define ZERO_IDLE_SLEEP   50          // Milliseconds the zeroing thread sleeps when the pool is full
+
+// Free area for one buddy order
+typedef struct {
+    uint32_t head;          // First free block (page index) or BUDDY_NONE
+    uint32_t count;         // Number of free blocks of this order
+    uint32_t* map;          // One bit per buddy pair, set when exactly one half is free
+} free_area_t;
+
+// Per-CPU cache of hot order-0 frames
+typedef struct {
+    uint32_t count;
+    uint32_t pages[PCP_HIGH];
+} pcp_cache_t;
+
 // Shadow page directory for copy-on-write operations
 static uint32_t shadow_page_directory[PAGE_DIRECTORY_ENTRIES];
 
@@ -28,8 +57,21 @@ static uint32_t shadow_page_directory[PAGE_DIRECTORY_ENTRIES];
 static uint32_t* current_page_directory = NULL;
 static page_info_t* page_info_array = NULL;
 static uint32_t total_pages = 0;
-static uint32_t free_pages = 0;
+static uint32_t free_page_count = 0;
 static mutex_t paging_mutex; // Mutex for thread-safe memory operations
+static lock_class_t paging_lock_class;
+
+// Buddy allocator state
+static free_area_t free_area[BUDDY_MAX_ORDER];
+static spinlock_t buddy_lock;                     // Protects free_area and its bitmaps
+static lock_class_t buddy_lock_class;
+static pcp_cache_t pcp_caches[PAGING_MAX_CPUS];   // Only touched by the owning CPU with IRQs off
+
+// Pool of free frames that are already zero-filled
+static uint32_t zero_pool[ZERO_POOL_SIZE];
+static uint32_t zero_pool_count = 0;
+static spinlock_t zero_pool_lock;                 // Protects zero_pool, taken with IRQs off
+static thread_id_t zero_thread_id = -1;
 
 // Memory protection
 #define MAX_PROTECTED_REGIONS 32  // Increased from 16
@@ -54,6 +96,9 @@ static struct {
     uint32_t cow_faults_handled;
     uint32_t demand_pages_loaded;
     uint32_t memory_mapped_regions;
+    uint32_t zero_pool_hits;        // Allocations served by a pre-zeroed frame
+    uint32_t zero_pool_misses;      // Allocations that had to zero synchronously
+    uint32_t pages_prezeroed;       // Frames zeroed by the background thread
 } memory_stats = {0};
 
 // Forward declarations of helper functions
@@ -61,6 +106,15 @@ static void flush_tlb_entry(void* addr);
 static void flush_entire_tlb(void);
 static uint32_t get_physical_address(void* virtual);
 static int handle_page_fault(void* fault_addr, int is_write, int is_user);
+static void buddy_init(void);
+static uint32_t buddy_alloc_block(uint32_t order);
+static void buddy_free_block(uint32_t page_index, uint32_t order);
+static uint32_t frame_alloc(void);
+static void frame_free(uint32_t page_index);
+static void pcp_drain(pcp_cache_t* pcp, uint32_t keep);
+static void zero_pool_drain(void);
+
+extern int scheduler_get_current_cpu(void);
 
 /**
  * Initialize the paging subsystem with improved memory management
@@ -68,11 +122,13 @@ static int handle_page_fault(void* fault_addr, int is_write, int is_user);
 void paging_init() {
     // Initialize the mutex for thread-safety
     mutex_init(&paging_mutex);
+    lock_class_init(&paging_lock_class, "paging");
+    mutex_set_class(&paging_mutex, &paging_lock_class);
     
     // Get memory size from the bootloader information
     extern uint32_t _bootinfo_memsize;
     total_pages = _bootinfo_memsize / PAGE_SIZE;
-    free_pages = total_pages;
+    free_page_count = total_pages;
     
     log_info("PAGING", "Initializing with %u KB total memory (%u pages)", 
              total_pages * (PAGE_SIZE / 1024), total_pages);
@@ -86,9 +142,12 @@ void paging_init() {
     for (uint32_t i = 0; i < kernel_pages; i++) {
         page_info_array[i].state = PAGE_RESERVED;
         page_info_array[i].flags = PAGE_FLAG_PRESENT | PAGE_FLAG_GLOBAL;
-        free_pages--;
+        free_page_count--;
     }
     
+    // Build the buddy free lists (also reserves the frames holding the metadata)
+    buddy_init();
+    
     // Create initial page directory at a fixed physical address
     current_page_directory = (uint32_t*)0x1000; // 4KB mark
     memset(current_page_directory, 0, PAGE_DIRECTORY_ENTRIES * sizeof(uint32_t));
@@ -141,45 +200,386 @@ void paging_init() {
     cr0 |= 0x80000000; // Enable paging bit
     asm volatile("movl %0, %%cr0" : : "r"(cr0));
     
-    log_info("PAGING", "Successfully enabled with %u free pages", free_pages);
+    log_info("PAGING", "Successfully enabled with %u free pages", free_page_count);
 }
 
 /**
- * Allocate a single page with improved tracking
+ * Disable local interrupts and return the previous EFLAGS
  */
-void* allocate_page() {
-    // Thread safety
-    mutex_lock(&paging_mutex);
+static inline uint32_t paging_irq_save(void) {
+    uint32_t eflags;
+    asm volatile("pushf\n\tpop %0\n\tcli" : "=r"(eflags) : : "memory");
+    return eflags;
+}
+
+/**
+ * Restore local interrupts from a saved EFLAGS value
+ */
+static inline void paging_irq_restore(uint32_t eflags) {
+    if (eflags & 0x200) {
+        asm volatile("sti" : : : "memory");
+    }
+}
+
+/**
+ * Get the hot page cache of the calling CPU (IRQs must be off)
+ */
+static inline pcp_cache_t* pcp_this_cpu(void) {
+    int cpu = scheduler_get_current_cpu();
+    if (cpu < 0 || cpu >= PAGING_MAX_CPUS) {
+        cpu = 0;
+    }
+    return &pcp_caches[cpu];
+}
+
+/**
+ * Smallest order whose block holds the given number of pages
+ */
+static inline uint32_t buddy_order_for(uint32_t num) {
+    uint32_t order = 0;
+    while ((1u << order) < num) {
+        order++;
+    }
+    return order;
+}
+
+/**
+ * Flip the pair bit for a block and return its new value (buddy_lock held)
+ */
+static inline int buddy_toggle_bit(uint32_t order, uint32_t page_index) {
+    uint32_t bit = page_index >> (order + 1);
+    uint32_t mask = 1u << (bit & 31);
+    uint32_t* word = &free_area[order].map[bit >> 5];
+    
+    *word ^= mask;
+    return (*word & mask) != 0;
+}
+
+/**
+ * Push a block onto the free list of its order (buddy_lock held)
+ */
+static void buddy_list_add(uint32_t order, uint32_t page_index) {
+    free_area_t* area = &free_area[order];
+    
+    page_info_array[page_index].order = (uint8_t)order;
+    page_info_array[page_index].buddy_prev = BUDDY_NONE;
+    page_info_array[page_index].buddy_next = area->head;
+    if (area->head != BUDDY_NONE) {
+        page_info_array[area->head].buddy_prev = page_index;
+    }
+    area->head = page_index;
+    area->count++;
+}
+
+/**
+ * Unlink a block from the free list of its order (buddy_lock held)
+ */
+static void buddy_list_del(uint32_t order, uint32_t page_index) {
+    free_area_t* area = &free_area[order];
+    page_info_t* info = &page_info_array[page_index];
+    
+    if (info->buddy_prev != BUDDY_NONE) {
+        page_info_array[info->buddy_prev].buddy_next = info->buddy_next;
+    } else {
+        area->head = info->buddy_next;
+    }
+    if (info->buddy_next != BUDDY_NONE) {
+        page_info_array[info->buddy_next].buddy_prev = info->buddy_prev;
+    }
+    
+    info->buddy_next = BUDDY_NONE;
+    info->buddy_prev = BUDDY_NONE;
+    area->count--;
+}
+
+/**
+ * Take a block of 2^order pages off the free lists, splitting larger
+ * blocks as needed (buddy_lock held). O(BUDDY_MAX_ORDER).
+ */
+static uint32_t buddy_alloc_block(uint32_t order) {
+    uint32_t current = order;
+    
+    while (current < BUDDY_MAX_ORDER && free_area[current].head == BUDDY_NONE) {
+        current++;
+    }
+    if (current >= BUDDY_MAX_ORDER) {
+        return BUDDY_NONE;
+    }
+    
+    uint32_t page_index = free_area[current].head;
+    buddy_list_del(current, page_index);
+    if (current < BUDDY_MAX_ORDER - 1) {
+        buddy_toggle_bit(current, page_index);
+    }
+    
+    // Hand the upper halves back until the block has the requested size
+    while (current > order) {
+        current--;
+        buddy_list_add(current, page_index + (1u << current));
+        buddy_toggle_bit(current, page_index);
+    }
+    
+    return page_index;
+}
+
+/**
+ * Return a block of 2^order pages, coalescing with free buddies
+ * (buddy_lock held). O(BUDDY_MAX_ORDER).
+ */
+static void buddy_free_block(uint32_t page_index, uint32_t order) {
+    while (order < BUDDY_MAX_ORDER - 1) {
+        // Bit becomes set when our buddy is still in use: stop merging
+        if (buddy_toggle_bit(order, page_index)) {
+            break;
+        }
+        
+        uint32_t buddy = page_index ^ (1u << order);
+        buddy_list_del(order, buddy);
+        page_index &= ~(1u << order);
+        order++;
+    }
+    
+    buddy_list_add(order, page_index);
+}
+
+/**
+ * Return an arbitrary run of pages to the buddy lists (buddy_lock held)
+ */
+static void buddy_free_range(uint32_t page_index, uint32_t num) {
+    while (num > 0) {
+        // Largest naturally aligned block that starts here and fits in the run
+        uint32_t order = 0;
+        while (order < BUDDY_MAX_ORDER - 1 &&
+               (page_index & ((2u << order) - 1)) == 0 &&
+               (2u << order) <= num) {
+            order++;
+        }
+        
+        buddy_free_block(page_index, order);
+        page_index += 1u << order;
+        num -= 1u << order;
+    }
+}
+
+/**
+ * Set up the free-area bitmaps and seed the free lists with every free frame
+ */
+static void buddy_init(void) {
+    spinlock_init(&buddy_lock);
+    lock_class_init(&buddy_lock_class, "buddy");
+    spinlock_set_class(&buddy_lock, &buddy_lock_class);
+    spinlock_init(&zero_pool_lock);
+    memset(pcp_caches, 0, sizeof(pcp_caches));
+    zero_pool_count = 0;
+    
+    // Bitmaps live right after page_info_array
+    uint32_t* map = (uint32_t*)((uint8_t*)page_info_array + total_pages * sizeof(page_info_t));
+    for (uint32_t order = 0; order < BUDDY_MAX_ORDER; order++) {
+        uint32_t pairs = (total_pages >> (order + 1)) + 1;
+        uint32_t words = (pairs + 31) / 32;
+        
+        free_area[order].head = BUDDY_NONE;
+        free_area[order].count = 0;
+        free_area[order].map = map;
+        memset(map, 0, words * sizeof(uint32_t));
+        map += words;
+    }
+    
+    // Keep the allocator from handing out its own metadata
+    uint32_t meta_first = (uint32_t)page_info_array / PAGE_SIZE;
+    uint32_t meta_last = ((uint32_t)map + PAGE_SIZE - 1) / PAGE_SIZE;
+    for (uint32_t i = meta_first; i < meta_last && i < total_pages; i++) {
+        if (page_info_array[i].state == PAGE_FREE) {
+            page_info_array[i].state = PAGE_RESERVED;
+            page_info_array[i].flags = PAGE_FLAG_PRESENT | PAGE_FLAG_GLOBAL;
+            free_page_count--;
+        }
+    }
     
-    // Find a free page
+    // Everything starts out "allocated"; freeing each frame builds the lists
     for (uint32_t i = 0; i < total_pages; i++) {
+        page_info_array[i].buddy_next = BUDDY_NONE;
+        page_info_array[i].buddy_prev = BUDDY_NONE;
         if (page_info_array[i].state == PAGE_FREE) {
-            // Mark page as used
-            page_info_array[i].state = PAGE_USED;
-            page_info_array[i].references = 1;
-            page_info_array[i].flags = PAGE_FLAG_PRESENT | PAGE_FLAG_WRITABLE;
-            
-            // Update process owner if we're in a process context
-            extern uint32_t current_process_id;
-            if (current_process_id != 0) {
-                page_info_array[i].owner_pid = current_process_id;
+            buddy_free_block(i, 0);
+        }
+    }
+    
+    log_info("PAGING", "Buddy allocator ready: %u free pages, %u max-order blocks",
+             free_page_count, free_area[BUDDY_MAX_ORDER - 1].count);
+}
+
+/**
+ * Move cached frames from a CPU cache back to the buddy lists until only
+ * 'keep' remain (IRQs off)
+ */
+static void pcp_drain(pcp_cache_t* pcp, uint32_t keep) {
+    if (pcp->count <= keep) {
+        return;
+    }
+    
+    spinlock_acquire(&buddy_lock);
+    while (pcp->count > keep) {
+        buddy_free_block(pcp->pages[--pcp->count], 0);
+    }
+    spinlock_release(&buddy_lock);
+}
+
+/**
+ * Take one frame from this CPU's hot cache, refilling it in a batch
+ * from the buddy lists when empty. O(1) on the cached path.
+ */
+static uint32_t frame_alloc(void) {
+    uint32_t page_index = BUDDY_NONE;
+    uint32_t eflags = paging_irq_save();
+    pcp_cache_t* pcp = pcp_this_cpu();
+    
+    if (pcp->count == 0) {
+        spinlock_acquire(&buddy_lock);
+        while (pcp->count < PCP_BATCH) {
+            uint32_t fresh = buddy_alloc_block(0);
+            if (fresh == BUDDY_NONE) {
+                break;
             }
-            
-            free_pages--;
-            memory_stats.pages_allocated++;
-            
-            // Zero out the page before returning it to prevent data leaks
-            void* page = (void*)(i * PAGE_SIZE);
-            memset(page, 0, PAGE_SIZE);
-            
-            mutex_unlock(&paging_mutex);
-            return page;
+            pcp->pages[pcp->count++] = fresh;
         }
+        spinlock_release(&buddy_lock);
     }
     
-    log_error("PAGING", "Failed to allocate page, out of memory!");
-    mutex_unlock(&paging_mutex);
-    return NULL; // Out of memory
+    if (pcp->count > 0) {
+        page_index = pcp->pages[--pcp->count];
+    }
+    
+    paging_irq_restore(eflags);
+    return page_index;
+}
+
+/**
+ * Put one frame into this CPU's hot cache, spilling a batch back to the
+ * buddy lists when the cache is full
+ */
+static void frame_free(uint32_t page_index) {
+    uint32_t eflags = paging_irq_save();
+    pcp_cache_t* pcp = pcp_this_cpu();
+    
+    if (pcp->count >= PCP_HIGH) {
+        pcp_drain(pcp, PCP_HIGH - PCP_BATCH);
+    }
+    pcp->pages[pcp->count++] = page_index;
+    
+    paging_irq_restore(eflags);
+}
+
+/**
+ * Record a freshly allocated frame in page_info_array
+ */
+static inline void frame_mark_used(uint32_t page_index) {
+    page_info_array[page_index].state = PAGE_USED;
+    page_info_array[page_index].references = 1;
+    page_info_array[page_index].flags = PAGE_FLAG_PRESENT | PAGE_FLAG_WRITABLE;
+    
+    // Update process owner if we're in a process context
+    extern uint32_t current_process_id;
+    if (current_process_id != 0) {
+        page_info_array[page_index].owner_pid = current_process_id;
+    }
+}
+
+/**
+ * Pop a frame from the pre-zeroed pool, or BUDDY_NONE if it is empty
+ */
+static uint32_t zero_pool_take(void) {
+    uint32_t page_index = BUDDY_NONE;
+    
+    // Unlocked peek: the pool is refilled in the background, a stale read only costs a memset
+    if (zero_pool_count == 0) {
+        return BUDDY_NONE;
+    }
+    
+    uint32_t eflags = paging_irq_save();
+    spinlock_acquire(&zero_pool_lock);
+    if (zero_pool_count > 0) {
+        page_index = zero_pool[--zero_pool_count];
+    }
+    spinlock_release(&zero_pool_lock);
+    paging_irq_restore(eflags);
+    
+    return page_index;
+}
+
+/**
+ * Give every pre-zeroed frame back to the buddy lists (used under memory pressure)
+ */
+static void zero_pool_drain(void) {
+    uint32_t eflags = paging_irq_save();
+    spinlock_acquire(&zero_pool_lock);
+    spinlock_acquire(&buddy_lock);
+    while (zero_pool_count > 0) {
+        buddy_free_block(zero_pool[--zero_pool_count], 0);
+    }
+    spinlock_release(&buddy_lock);
+    spinlock_release(&zero_pool_lock);
+    paging_irq_restore(eflags);
+}
+
+/**
+ * Allocate a single page
+ *
+ * Zeroed requests are served from the pre-zeroed pool when possible and
+ * only fall back to zeroing a frame synchronously when the pool is empty.
+ * ALLOC_FLAG_NOZERO requests take a hot (dirty) frame from the CPU cache
+ * and leave the pre-zeroed frames to callers that need them.
+ */
+void* allocate_page_flags(uint32_t flags) {
+    int zeroed = 0;
+    uint32_t page_index = BUDDY_NONE;
+    
+    if (!(flags & ALLOC_FLAG_NOZERO)) {
+        page_index = zero_pool_take();
+        zeroed = (page_index != BUDDY_NONE);
+    }
+    
+    if (page_index == BUDDY_NONE) {
+        page_index = frame_alloc();
+    }
+    
+    if (page_index == BUDDY_NONE) {
+        // Frames may be parked in this CPU's cache or the zero pool; give them back and retry once
+        uint32_t eflags = paging_irq_save();
+        pcp_drain(pcp_this_cpu(), 0);
+        paging_irq_restore(eflags);
+        zero_pool_drain();
+        
+        page_index = frame_alloc();
+        if (page_index == BUDDY_NONE) {
+            log_error("PAGING", "Failed to allocate page, out of memory!");
+            return NULL; // Out of memory
+        }
+    }
+    
+    // The frame is exclusively ours now, so its metadata needs no lock
+    frame_mark_used(page_index);
+    
+    __sync_fetch_and_sub(&free_page_count, 1);
+    __sync_fetch_and_add(&memory_stats.pages_allocated, 1);
+    
+    void* page = (void*)(page_index * PAGE_SIZE);
+    if (zeroed) {
+        __sync_fetch_and_add(&memory_stats.zero_pool_hits, 1);
+    } else if (!(flags & ALLOC_FLAG_NOZERO)) {
+        // Zero out the page before returning it to prevent data leaks
+        __sync_fetch_and_add(&memory_stats.zero_pool_misses, 1);
+        memset(page, 0, PAGE_SIZE);
+    }
+    
+    return page;
+}
+
+/**
+ * Allocate a single zero-filled page
+ */
+void* allocate_page() {
+    return allocate_page_flags(ALLOC_FLAG_NONE);
 }
 
 /**
@@ -225,74 +625,83 @@ void free_page(void* page) {
     page_info_array[page_index].flags = 0;
     page_info_array[page_index].owner_pid = 0;
     
-    free_pages++;
+    __sync_fetch_and_add(&free_page_count, 1);
     memory_stats.pages_freed++;
     
-    // Zero out the page to prevent data leaks
-    memset(page, 0, PAGE_SIZE);
-    
     mutex_unlock(&paging_mutex);
+    
+    // Hand the frame to this CPU's hot cache. It stays dirty: frames are
+    // zeroed on allocation or ahead of time by the zeroing thread.
+    frame_free(page_index);
 }
 
 /**
  * Allocate multiple contiguous pages with alignment support
  */
-void* allocate_pages(uint32_t num) {
+void* allocate_pages_flags(uint32_t num, uint32_t flags) {
     if (num == 0) return NULL;
-    if (num == 1) return allocate_page();
+    if (num == 1) return allocate_page_flags(flags);
     
-    mutex_lock(&paging_mutex);
+    if (num > free_page_count) {
+        log_error("PAGING", "Failed to allocate %u pages, only %u available", num, free_page_count);
+        return NULL;
+    }
     
-    if (num > free_pages) {
-        log_error("PAGING", "Failed to allocate %u pages, only %u available", num, free_pages);
-        mutex_unlock(&paging_mutex);
+    uint32_t order = buddy_order_for(num);
+    if (order >= BUDDY_MAX_ORDER) {
+        log_error("PAGING", "Cannot allocate %u contiguous pages (max %u)",
+                  num, 1u << (BUDDY_MAX_ORDER - 1));
         return NULL;
     }
     
-    // Find contiguous free pages
-    uint32_t start_page = 0;
-    uint32_t found_pages = 0;
+    uint32_t eflags = paging_irq_save();
+    spinlock_acquire(&buddy_lock);
+    uint32_t start_page = buddy_alloc_block(order);
+    spinlock_release(&buddy_lock);
+    
+    if (start_page == BUDDY_NONE) {
+        // Cached order-0 frames can prevent coalescing; flush them and retry
+        pcp_drain(pcp_this_cpu(), 0);
+        zero_pool_drain();
+        spinlock_acquire(&buddy_lock);
+        start_page = buddy_alloc_block(order);
+        spinlock_release(&buddy_lock);
+    }
     
-    for (uint32_t i = 0; i < total_pages; i++) {
-        if (page_info_array[i].state == PAGE_FREE) {
-            if (found_pages == 0) {
-                start_page = i;
-            }
-            found_pages++;
-            
-            if (found_pages == num) {
-                // Mark all pages as used
-                for (uint32_t j = 0; j < num; j++) {
-                    uint32_t page_idx = start_page + j;
-                    page_info_array[page_idx].state = PAGE_USED;
-                    page_info_array[page_idx].references = 1;
-                    page_info_array[page_idx].flags = PAGE_FLAG_PRESENT | PAGE_FLAG_WRITABLE;
-                    
-                    // Update process owner if in process context
-                    extern uint32_t current_process_id;
-                    if (current_process_id != 0) {
-                        page_info_array[page_idx].owner_pid = current_process_id;
-                    }
-                }
-                
-                free_pages -= num;
-                memory_stats.pages_allocated += num;
-                
-                void* result = (void*)(start_page * PAGE_SIZE);
-                memset(result, 0, num * PAGE_SIZE);
-                
-                mutex_unlock(&paging_mutex);
-                return result;
-            }
-        } else {
-            // Reset counter when we hit a used page
-            found_pages = 0;
-        }
+    if (start_page != BUDDY_NONE && (1u << order) > num) {
+        // Give the unused tail of the power-of-two block straight back
+        spinlock_acquire(&buddy_lock);
+        buddy_free_range(start_page + num, (1u << order) - num);
+        spinlock_release(&buddy_lock);
     }
+    paging_irq_restore(eflags);
     
-    log_error("PAGING", "Failed to find %u contiguous pages", num);
-    mutex_unlock(&paging_mutex);
-    return NULL; // Couldn't find enough contiguous pages
+    if (start_page == BUDDY_NONE) {
+        log_error("PAGING", "Failed to find %u contiguous pages", num);
+        return NULL; // Couldn't find enough contiguous pages
+    }
+    
+    // Mark all pages as used
+    for (uint32_t j = 0; j < num; j++) {
+        frame_mark_used(start_page + j);
+    }
+    
+    __sync_fetch_and_sub(&free_page_count, num);
+    __sync_fetch_and_add(&memory_stats.pages_allocated, num);
+    
+    void* result = (void*)(start_page * PAGE_SIZE);
+    if (!(flags & ALLOC_FLAG_NOZERO)) {
+        memset(result, 0, num * PAGE_SIZE);
+    }
+    
+    return result;
+}
+
+/**
+ * Allocate multiple zero-filled contiguous pages
+ */
+void* allocate_pages(uint32_t num) {
+    return allocate_pages_flags(num, ALLOC_FLAG_NONE);
 }
 
 /**
@@ -305,6 +714,206 @@ void free_pages(void* start, uint32_t num) {
     }
 }
 
+/**
+ * Zero up to 'max' free frames and park them in the pre-zeroed pool
+ *
+ * Frames come straight from the buddy lists rather than the per-CPU hot
+ * caches, so cache-warm frames stay available for immediate reuse. The
+ * memset runs with no lock held and interrupts enabled.
+ *
+ * @return Number of frames added to the pool
+ */
+uint32_t paging_zero_pool_refill(uint32_t max) {
+    uint32_t added = 0;
+    
+    while (added < max && zero_pool_count < ZERO_POOL_SIZE) {
+        uint32_t eflags = paging_irq_save();
+        spinlock_acquire(&buddy_lock);
+        uint32_t page_index = buddy_alloc_block(0);
+        spinlock_release(&buddy_lock);
+        paging_irq_restore(eflags);
+        
+        if (page_index == BUDDY_NONE) {
+            break; // Nothing left to pre-zero
+        }
+        
+        memset((void*)(page_index * PAGE_SIZE), 0, PAGE_SIZE);
+        
+        int stored = 0;
+        eflags = paging_irq_save();
+        spinlock_acquire(&zero_pool_lock);
+        if (zero_pool_count < ZERO_POOL_SIZE) {
+            zero_pool[zero_pool_count++] = page_index;
+            stored = 1;
+        }
+        spinlock_release(&zero_pool_lock);
+        
+        if (!stored) {
+            // Raced with another refill; the frame goes back to the free lists
+            spinlock_acquire(&buddy_lock);
+            buddy_free_block(page_index, 0);
+            spinlock_release(&buddy_lock);
+        }
+        paging_irq_restore(eflags);
+        
+        if (!stored) {
+            break;
+        }
+        added++;
+    }
+    
+    if (added > 0) {
+        __sync_fetch_and_add(&memory_stats.pages_prezeroed, added);
+    }
+    return added;
+}
+
+/**
+ * Idle-priority thread that keeps the pre-zeroed pool topped up
+ */
+static void paging_zero_thread(void* arg) {
+    (void)arg;
+    
+    for (;;) {
+        if (paging_zero_pool_refill(ZERO_REFILL_BATCH) > 0) {
+            // Give everything else a chance to run between batches
+            thread_yield();
+        } else {
+            thread_sleep(ZERO_IDLE_SLEEP);
+        }
+    }
+}
+
+/**
+ * Start the background page zeroing thread (needs the threading system)
+ */
+void paging_start_zero_thread(void) {
+    if (zero_thread_id >= 0) {
+        return;
+    }
+    
+    zero_thread_id = thread_create(paging_zero_thread, NULL, 0, THREAD_PRIORITY_LOWEST,
+                                   THREAD_FLAG_SYSTEM, "pagezero");
+    if (zero_thread_id < 0) {
+        log_warning("PAGING", "Could not start page zeroing thread, pages will be zeroed on demand");
+        return;
+    }
+    
+    log_info("PAGING", "Page zeroing thread started (pool of %u frames)", ZERO_POOL_SIZE);
+}
+
+/**
+ * Boot-time page allocator microbenchmark
+ *
+ * Compares the first-fit scan of page_info_array that allocate_page() and
+ * allocate_pages() used to perform against the buddy allocator with its
+ * per-CPU hot cache. Zeroing is excluded from both sides so only the cost
+ * of finding and returning frames is measured.
+ */
+#define PAGING_BENCH_PAGES  256
+#define PAGING_BENCH_RUN    8     // Pages per contiguous request
+
+static uint32_t bench_frames[PAGING_BENCH_PAGES];
+
+static uint32_t paging_bench_rate(uint32_t ops, uint64_t elapsed_ns) {
+    if (elapsed_ns == 0) {
+        elapsed_ns = 1;
+    }
+    return (uint32_t)(((uint64_t)ops * 1000000000ULL) / elapsed_ns);
+}
+
+void paging_run_benchmark(void) {
+    extern uint64_t hal_time_now_ns(void);
+    volatile uint32_t sink = 0;
+    
+    uint32_t count = PAGING_BENCH_PAGES;
+    if (count > free_page_count / 4) {
+        count = free_page_count / 4;
+    }
+    if (count == 0) {
+        log_warning("PAGING", "Not enough free memory to run the allocator benchmark");
+        return;
+    }
+    
+    // Baseline: the i-th allocation in a row had to skip i used frames
+    uint64_t start = hal_time_now_ns();
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t skip = i;
+        for (uint32_t p = 0; p < total_pages; p++) {
+            if (page_info_array[p].state == PAGE_FREE) {
+                if (skip == 0) {
+                    sink += p;
+                    break;
+                }
+                skip--;
+            }
+        }
+    }
+    uint64_t linear_single_ns = hal_time_now_ns() - start;
+    
+    // Baseline: first-fit search for a run of PAGING_BENCH_RUN free frames
+    start = hal_time_now_ns();
+    for (uint32_t i = 0; i < count / PAGING_BENCH_RUN; i++) {
+        uint32_t found = 0;
+        uint32_t skip = i;
+        for (uint32_t p = 0; p < total_pages; p++) {
+            if (page_info_array[p].state != PAGE_FREE) {
+                found = 0;
+                continue;
+            }
+            if (++found == PAGING_BENCH_RUN) {
+                if (skip == 0) {
+                    sink += p;
+                    break;
+                }
+                skip--;
+                found = 0;
+            }
+        }
+    }
+    uint64_t linear_multi_ns = hal_time_now_ns() - start;
+    
+    // Buddy allocator: order-0 through the per-CPU hot cache
+    start = hal_time_now_ns();
+    for (uint32_t i = 0; i < count; i++) {
+        bench_frames[i] = frame_alloc();
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (bench_frames[i] != BUDDY_NONE) {
+            frame_free(bench_frames[i]);
+        }
+    }
+    uint64_t buddy_single_ns = hal_time_now_ns() - start;
+    
+    // Buddy allocator: order-3 contiguous blocks
+    uint32_t order = buddy_order_for(PAGING_BENCH_RUN);
+    uint32_t eflags = paging_irq_save();
+    start = hal_time_now_ns();
+    spinlock_acquire(&buddy_lock);
+    for (uint32_t i = 0; i < count / PAGING_BENCH_RUN; i++) {
+        bench_frames[i] = buddy_alloc_block(order);
+    }
+    for (uint32_t i = 0; i < count / PAGING_BENCH_RUN; i++) {
+        if (bench_frames[i] != BUDDY_NONE) {
+            buddy_free_block(bench_frames[i], order);
+        }
+    }
+    spinlock_release(&buddy_lock);
+    uint64_t buddy_multi_ns = hal_time_now_ns() - start;
+    paging_irq_restore(eflags);
+    
+    (void)sink;
+    
+    log_info("PAGING", "Allocator benchmark (%u pages, %u total frames):", count, total_pages);
+    log_info("PAGING", "  single page : linear scan %u allocs/s, buddy %u allocs/s",
+             paging_bench_rate(count, linear_single_ns),
+             paging_bench_rate(count, buddy_single_ns));
+    log_info("PAGING", "  %u-page runs : linear scan %u allocs/s, buddy %u allocs/s",
+             PAGING_BENCH_RUN,
+             paging_bench_rate(count / PAGING_BENCH_RUN, linear_multi_ns),
+             paging_bench_rate(count / PAGING_BENCH_RUN, buddy_multi_ns));
+}
+
 /**
  * Map a physical page to a virtual address with specific flags
  */
@@ -332,8 +941,7 @@ int paging_map_page(void* physical, void* virtual, uint32_t flags) {
             return -1;
         }
         
-        // Zero new page table
-        memset(pt_physical, 0, PAGE_SIZE);
+        // New page table is already zero-filled by allocate_page()
         
         // Add to directory
         current_page_directory[pd_index] = (uint32_t)pt_physical | PAGE_FLAG_PRESENT | PAGE_FLAG_WRITABLE | 
@@ -482,8 +1090,7 @@ uint32_t paging_create_address_space(int kernel_accessible) {
         return 0;
     }
     
-    // Clear the directory
-    memset(new_dir_phys, 0, PAGE_SIZE);
+    // The directory comes back zero-filled from allocate_page()
     
     // If kernel should be accessible, copy kernel mappings
     if (kernel_accessible) {
@@ -599,7 +1206,8 @@ uint32_t paging_clone_address_space(int copy_on_write) {
                 dst_table->entries[pt_idx] = phys_addr | new_flags;
             } else {
                 // For full copy: Allocate new physical page and copy data
-                void* new_page = allocate_page(); // Already thread-safe
+                // (the memcpy below overwrites all of it, so skip zeroing)
+                void* new_page = allocate_page_flags(ALLOC_FLAG_NOZERO);
                 if (!new_page) {
                     // Handle allocation failure
                     // Clean up previously allocated resources
@@ -698,7 +1306,35 @@ int paging_map_user_memory(void* virtual, size_t size, int writable, int executa
  * Get free pages count
  */
 uint32_t get_free_pages_count() {
-    return free_pages;
+    return free_page_count;
+}
+
+/**
+ * Tag or untag a frame as backing a slab cache
+ */
+void paging_mark_slab_page(void* page, int is_slab) {
+    uint32_t page_index = (uint32_t)page / PAGE_SIZE;
+    if (page_index >= total_pages) {
+        return;
+    }
+    
+    if (is_slab) {
+        page_info_array[page_index].flags |= PAGE_FLAG_SLAB;
+    } else {
+        page_info_array[page_index].flags &= ~PAGE_FLAG_SLAB;
+    }
+}
+
+/**
+ * Check whether an address lies in a slab-backed frame
+ */
+int paging_is_slab_page(const void* addr) {
+    uint32_t page_index = (uint32_t)addr / PAGE_SIZE;
+    if (page_index >= total_pages) {
+        return 0;
+    }
+    
+    return (page_info_array[page_index].flags & PAGE_FLAG_SLAB) != 0;
 }
 
 /**
@@ -868,8 +1504,8 @@ static int handle_page_fault(void* fault_addr, int is_write, int is_user) {
         
         // Verify it's a COW page with multiple references
         if (page_info_array[page_idx].references > 1) {
-            // Allocate new physical page for this process
-            void* new_phys = allocate_page(); // Already thread-safe
+            // Allocate new physical page for this process (fully overwritten by the copy)
+            void* new_phys = allocate_page_flags(ALLOC_FLAG_NOZERO);
             if (!new_phys) {
                 log_error("PAGE FAULT", "Failed to allocate page for COW");
                 mutex_unlock(&paging_mutex);
@@ -910,8 +1546,8 @@ static int handle_page_fault(void* fault_addr, int is_write, int is_user) {
         // Check if this page exists in the shadow directory (for demand paging)
         page_table_t* shadow_pt = (page_table_t*)(shadow_page_directory[pd_idx] & ~0xFFF);
         if (shadow_pt && (shadow_pt->entries[pt_idx] & PAGE_FLAG_PRESENT)) {
-            // Allocate new physical page
-            void* new_phys = allocate_page(); // Already thread-safe
+            // Allocate new physical page (fully overwritten by the copy)
+            void* new_phys = allocate_page_flags(ALLOC_FLAG_NOZERO);
             if (!new_phys) {
                 log_error("PAGE FAULT", "Failed to allocate page for demand paging");
                 mutex_unlock(&paging_mutex);
@@ -2,6 +2,7 @@
 #define PAGING_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 // Page states
 #define PAGE_FREE      0
@@ -24,15 +25,33 @@
 #define PAGE_FLAG_DIRTY         0x40   // Page has been written to
 #define PAGE_FLAG_GLOBAL        0x100  // Page is global (not flushed from TLB)
 #define PAGE_FLAG_GUARD         0x200  // Guard page (not a standard x86 flag, used by our OS)
+#define PAGE_FLAG_SLAB          0x400  // Frame backs a slab cache (page_info only, never set in a PTE)
+
+// Allocation flags for allocate_page_flags()/allocate_pages_flags()
+#define ALLOC_FLAG_NONE         0x00
+#define ALLOC_FLAG_NOZERO       0x01   // Caller overwrites the whole page, skip zeroing
 
 // Memory management functions
 void paging_init();
 void* allocate_page();
+void* allocate_page_flags(uint32_t flags);
 void free_page(void* page);
 void* allocate_pages(uint32_t num);
+void* allocate_pages_flags(uint32_t num, uint32_t flags);
 void free_pages(void* start, uint32_t num);
 uint32_t get_free_pages_count();
 
+// Background page zeroing (pre-zeroed pool refilled by an idle-priority thread)
+void paging_start_zero_thread(void);
+uint32_t paging_zero_pool_refill(uint32_t max);
+
+// Boot-time allocator microbenchmark (needs a calibrated HAL timer)
+void paging_run_benchmark(void);
+
+// Slab page tracking (used by the slab allocator to recognise its own objects)
+void paging_mark_slab_page(void* page, int is_slab);
+int paging_is_slab_page(const void* addr);
+
 // Memory mapping functions
 void map_page(void* physical, void* virtual, uint32_t flags);
 void unmap_page(void* virtual);
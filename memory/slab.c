@@ -0,0 +1,770 @@
+#include "slab.h"
+#include "paging.h"
+#include "../kernel/sync.h"
+#include "../kernel/logging/log.h"
+#include <stdint.h>
+#include <string.h>
+
+#define SLAB_MAGIC          0x51AB51AB
+#define SLAB_DEFAULT_ALIGN  8
+#define SLAB_POISON_PATTERN 0x6B
+#define SLAB_MAX_FREE_SLABS 2   // Free pages kept per cache before reaping
+#define SLAB_DEPOT_MAX_FULL 8   // Full magazines kept in the depot before draining
+#define SLAB_SIZE_CLASSES   7   // 16, 32, 64, 128, 256, 512, 1024
+
+// Slab header, stored at the start of every slab page
+typedef struct kmem_slab {
+    uint32_t magic;                  // SLAB_MAGIC
+    struct kmem_cache* cache;        // Owning cache
+    struct kmem_slab* prev;          // Previous slab in the same list
+    struct kmem_slab* next;          // Next slab in the same list
+    void* free_list;                 // Embedded free-object list
+    uint32_t in_use;                 // Objects currently allocated
+    uint8_t* objects;                // First object in the page
+} kmem_slab_t;
+
+// A magazine is a fixed-size stack of object pointers
+typedef struct kmem_magazine {
+    struct kmem_magazine* next;      // Link in the depot lists
+    uint32_t rounds;                 // Number of objects currently loaded
+    void* objects[SLAB_MAGAZINE_SIZE];
+} kmem_magazine_t;
+
+// Per-CPU magazine pair; only ever touched by its own CPU with IRQs off
+typedef struct {
+    kmem_magazine_t* loaded;         // Magazine served first
+    kmem_magazine_t* previous;       // Backup magazine (full or empty)
+    uint32_t hits;                   // Fast-path operations on this CPU
+} kmem_cpu_cache_t;
+
+struct kmem_cache {
+    char name[SLAB_NAME_LENGTH];
+    uint32_t object_size;
+    uint32_t align;
+    uint32_t flags;
+    uint32_t objects_per_slab;
+    int in_use;                      // Slot in the static cache table is taken
+
+    spinlock_t lock;                 // Protects slab lists, depot and counters below
+    kmem_slab_t* partial_slabs;
+    kmem_slab_t* full_slabs;
+    kmem_slab_t* free_slabs;
+    uint32_t slabs_total;
+    uint32_t slabs_free;
+    uint32_t objects_in_use;
+
+    kmem_magazine_t* depot_full;     // Depot of full magazines
+    kmem_magazine_t* depot_empty;    // Depot of empty magazines
+    uint32_t depot_full_count;
+
+    uint32_t magazine_misses;
+    uint32_t depot_exchanges;
+    uint32_t slab_grows;
+    uint32_t slab_reaps;
+
+    kmem_cpu_cache_t cpu[SLAB_MAX_CPUS];
+};
+
+// Static cache table: caches are created before the heap can serve them
+static kmem_cache_t cache_table[SLAB_MAX_CACHES];
+static spinlock_t cache_table_lock;
+
+// Internal cache that backs the magazines themselves
+static kmem_cache_t* magazine_cache = NULL;
+
+// Size-class caches fronting heap_alloc
+static kmem_cache_t* size_caches[SLAB_SIZE_CLASSES];
+
+static int slab_initialized = 0;
+
+extern int scheduler_get_current_cpu(void);
+
+/**
+ * Disable local interrupts and return the previous EFLAGS
+ */
+static inline uint32_t slab_irq_save(void) {
+    uint32_t eflags;
+    asm volatile("pushf\n\tpop %0\n\tcli" : "=r"(eflags) : : "memory");
+    return eflags;
+}
+
+/**
+ * Restore local interrupts from a saved EFLAGS value
+ */
+static inline void slab_irq_restore(uint32_t eflags) {
+    if (eflags & 0x200) {
+        asm volatile("sti" : : : "memory");
+    }
+}
+
+/**
+ * Get the calling CPU's magazine pair
+ */
+static inline kmem_cpu_cache_t* slab_cpu_cache(kmem_cache_t* cache) {
+    int cpu = scheduler_get_current_cpu();
+    if (cpu < 0 || cpu >= SLAB_MAX_CPUS) {
+        cpu = 0;
+    }
+    return &cache->cpu[cpu];
+}
+
+/**
+ * Unlink a slab from a list
+ */
+static void slab_list_remove(kmem_slab_t** list, kmem_slab_t* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *list = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->prev = NULL;
+    slab->next = NULL;
+}
+
+/**
+ * Push a slab to the front of a list
+ */
+static void slab_list_push(kmem_slab_t** list, kmem_slab_t* slab) {
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list) {
+        (*list)->prev = slab;
+    }
+    *list = slab;
+}
+
+/**
+ * Allocate and carve a new slab page (cache lock held)
+ */
+static kmem_slab_t* slab_grow(kmem_cache_t* cache) {
+    void* page = allocate_page();
+    if (!page) {
+        log_error("SLAB", "Cache '%s': out of pages", cache->name);
+        return NULL;
+    }
+
+    kmem_slab_t* slab = (kmem_slab_t*)page;
+    slab->magic = SLAB_MAGIC;
+    slab->cache = cache;
+    slab->prev = NULL;
+    slab->next = NULL;
+    slab->in_use = 0;
+
+    uintptr_t first = (uintptr_t)page + sizeof(kmem_slab_t);
+    first = (first + cache->align - 1) & ~(uintptr_t)(cache->align - 1);
+    slab->objects = (uint8_t*)first;
+
+    // Thread every object onto the embedded free list
+    slab->free_list = NULL;
+    for (int i = (int)cache->objects_per_slab - 1; i >= 0; i--) {
+        void** obj = (void**)(slab->objects + (uint32_t)i * cache->object_size);
+        *obj = slab->free_list;
+        slab->free_list = obj;
+    }
+
+    paging_mark_slab_page(page, 1);
+
+    cache->slabs_total++;
+    cache->slab_grows++;
+    return slab;
+}
+
+/**
+ * Return a completely free slab page to the page allocator (cache lock held)
+ */
+static void slab_reap(kmem_cache_t* cache, kmem_slab_t* slab) {
+    slab->magic = 0;
+    paging_mark_slab_page(slab, 0);
+    free_page(slab);
+    cache->slabs_total--;
+    cache->slab_reaps++;
+}
+
+/**
+ * Take one object from the slab layer (cache lock held)
+ */
+static void* slab_alloc_object(kmem_cache_t* cache) {
+    kmem_slab_t* slab = cache->partial_slabs;
+
+    if (!slab) {
+        slab = cache->free_slabs;
+        if (slab) {
+            slab_list_remove(&cache->free_slabs, slab);
+            cache->slabs_free--;
+        } else {
+            slab = slab_grow(cache);
+            if (!slab) {
+                return NULL;
+            }
+        }
+        slab_list_push(&cache->partial_slabs, slab);
+    }
+
+    void** obj = (void**)slab->free_list;
+    slab->free_list = *obj;
+    slab->in_use++;
+    cache->objects_in_use++;
+
+    if (slab->in_use == cache->objects_per_slab) {
+        slab_list_remove(&cache->partial_slabs, slab);
+        slab_list_push(&cache->full_slabs, slab);
+    }
+
+    return obj;
+}
+
+/**
+ * Return one object to the slab layer (cache lock held)
+ */
+static void slab_free_object(kmem_cache_t* cache, void* obj) {
+    kmem_slab_t* slab = (kmem_slab_t*)((uintptr_t)obj & ~(uintptr_t)(PAGE_SIZE - 1));
+
+    if (slab->in_use == cache->objects_per_slab) {
+        slab_list_remove(&cache->full_slabs, slab);
+        slab_list_push(&cache->partial_slabs, slab);
+    }
+
+    *(void**)obj = slab->free_list;
+    slab->free_list = obj;
+    slab->in_use--;
+    cache->objects_in_use--;
+
+    if (slab->in_use == 0) {
+        slab_list_remove(&cache->partial_slabs, slab);
+        if (cache->slabs_free >= SLAB_MAX_FREE_SLABS) {
+            slab_reap(cache, slab);
+        } else {
+            slab_list_push(&cache->free_slabs, slab);
+            cache->slabs_free++;
+        }
+    }
+}
+
+/**
+ * Get an empty magazine from the depot or the magazine cache (cache lock held)
+ */
+static kmem_magazine_t* slab_get_empty_magazine(kmem_cache_t* cache) {
+    kmem_magazine_t* mag = cache->depot_empty;
+    if (mag) {
+        cache->depot_empty = mag->next;
+        mag->next = NULL;
+        return mag;
+    }
+
+    // The magazine cache never uses magazines, so this cannot recurse
+    mag = (kmem_magazine_t*)kmem_cache_alloc(magazine_cache);
+    if (mag) {
+        mag->next = NULL;
+        mag->rounds = 0;
+    }
+    return mag;
+}
+
+/**
+ * Return all objects in a magazine to the slab layer (cache lock held)
+ */
+static void slab_drain_magazine(kmem_cache_t* cache, kmem_magazine_t* mag) {
+    while (mag->rounds > 0) {
+        slab_free_object(cache, mag->objects[--mag->rounds]);
+    }
+}
+
+/**
+ * Slow allocation path: exchange with the depot or refill from slabs
+ */
+static void* kmem_cache_alloc_slow(kmem_cache_t* cache, kmem_cpu_cache_t* cc) {
+    void* obj = NULL;
+
+    spinlock_acquire(&cache->lock);
+    cache->magazine_misses++;
+
+    if (cache->depot_full) {
+        // Trade our empty backup magazine for a full one from the depot
+        if (cc->previous) {
+            cc->previous->next = cache->depot_empty;
+            cache->depot_empty = cc->previous;
+        }
+        cc->previous = cc->loaded;
+        cc->loaded = cache->depot_full;
+        cache->depot_full = cc->loaded->next;
+        cache->depot_full_count--;
+        cc->loaded->next = NULL;
+        cache->depot_exchanges++;
+
+        obj = cc->loaded->objects[--cc->loaded->rounds];
+        spinlock_release(&cache->lock);
+        return obj;
+    }
+
+    // Depot is dry: refill the loaded magazine from the slab layer in one batch
+    if (!cc->loaded) {
+        cc->loaded = slab_get_empty_magazine(cache);
+    }
+
+    if (cc->loaded) {
+        while (cc->loaded->rounds < SLAB_MAGAZINE_SIZE / 2) {
+            void* fresh = slab_alloc_object(cache);
+            if (!fresh) {
+                break;
+            }
+            cc->loaded->objects[cc->loaded->rounds++] = fresh;
+        }
+        if (cc->loaded->rounds > 0) {
+            obj = cc->loaded->objects[--cc->loaded->rounds];
+        }
+    } else {
+        obj = slab_alloc_object(cache);
+    }
+
+    spinlock_release(&cache->lock);
+    return obj;
+}
+
+/**
+ * Slow free path: push a full magazine to the depot and load an empty one
+ */
+static void kmem_cache_free_slow(kmem_cache_t* cache, kmem_cpu_cache_t* cc, void* obj) {
+    spinlock_acquire(&cache->lock);
+    cache->magazine_misses++;
+
+    kmem_magazine_t* empty = slab_get_empty_magazine(cache);
+    if (!empty) {
+        slab_free_object(cache, obj);
+        spinlock_release(&cache->lock);
+        return;
+    }
+
+    // Retire the full backup magazine to the depot
+    if (cc->previous) {
+        if (cache->depot_full_count >= SLAB_DEPOT_MAX_FULL) {
+            slab_drain_magazine(cache, cc->previous);
+            cc->previous->next = cache->depot_empty;
+            cache->depot_empty = cc->previous;
+        } else {
+            cc->previous->next = cache->depot_full;
+            cache->depot_full = cc->previous;
+            cache->depot_full_count++;
+        }
+        cache->depot_exchanges++;
+    }
+
+    cc->previous = cc->loaded;
+    cc->loaded = empty;
+    cc->loaded->objects[cc->loaded->rounds++] = obj;
+
+    spinlock_release(&cache->lock);
+}
+
+/**
+ * Find a free slot in the static cache table
+ */
+static kmem_cache_t* slab_alloc_cache_slot(void) {
+    kmem_cache_t* result = NULL;
+
+    spinlock_acquire(&cache_table_lock);
+    for (int i = 0; i < SLAB_MAX_CACHES; i++) {
+        if (!cache_table[i].in_use) {
+            memset(&cache_table[i], 0, sizeof(kmem_cache_t));
+            cache_table[i].in_use = 1;
+            result = &cache_table[i];
+            break;
+        }
+    }
+    spinlock_release(&cache_table_lock);
+
+    return result;
+}
+
+/**
+ * Initialize the slab allocator and the heap size-class caches
+ */
+void slab_init(void) {
+    if (slab_initialized) {
+        return;
+    }
+
+    spinlock_init(&cache_table_lock);
+    memset(cache_table, 0, sizeof(cache_table));
+
+    magazine_cache = kmem_cache_create("magazine", sizeof(kmem_magazine_t), 0,
+                                       SLAB_FLAG_NO_MAGAZINE);
+    if (!magazine_cache) {
+        log_error("SLAB", "Failed to create magazine cache");
+        return;
+    }
+
+    static const char* size_names[SLAB_SIZE_CLASSES] = {
+        "size-16", "size-32", "size-64", "size-128", "size-256", "size-512", "size-1024"
+    };
+
+    uint32_t size = SLAB_MIN_OBJECT_SIZE;
+    for (int i = 0; i < SLAB_SIZE_CLASSES; i++) {
+        size_caches[i] = kmem_cache_create(size_names[i], size, 16, SLAB_FLAG_NONE);
+        if (!size_caches[i]) {
+            log_error("SLAB", "Failed to create size-class cache %u", size);
+            return;
+        }
+        size <<= 1;
+    }
+
+    slab_initialized = 1;
+    log_info("SLAB", "Initialized %d size-class caches (%u-%u bytes, %u-slot magazines)",
+             SLAB_SIZE_CLASSES, SLAB_MIN_OBJECT_SIZE, SLAB_MAX_OBJECT_SIZE, SLAB_MAGAZINE_SIZE);
+}
+
+/**
+ * Check whether the slab allocator is ready
+ */
+int slab_is_initialized(void) {
+    return slab_initialized;
+}
+
+/**
+ * Create an object cache
+ */
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t object_size,
+                                uint32_t align, uint32_t flags) {
+    if (object_size == 0) {
+        return NULL;
+    }
+
+    if (align == 0) {
+        align = SLAB_DEFAULT_ALIGN;
+    }
+
+    // Alignment must be a power of two
+    if (align & (align - 1)) {
+        log_error("SLAB", "Cache '%s': invalid alignment %u", name ? name : "?", align);
+        return NULL;
+    }
+
+    // Objects must be able to hold the embedded free-list pointer
+    if (object_size < sizeof(void*)) {
+        object_size = sizeof(void*);
+    }
+    object_size = (object_size + align - 1) & ~(align - 1);
+
+    uint32_t header = (sizeof(kmem_slab_t) + align - 1) & ~(align - 1);
+    if (header + object_size > PAGE_SIZE) {
+        log_error("SLAB", "Cache '%s': object size %u does not fit in a slab",
+                  name ? name : "?", object_size);
+        return NULL;
+    }
+
+    kmem_cache_t* cache = slab_alloc_cache_slot();
+    if (!cache) {
+        log_error("SLAB", "No free cache slots for '%s'", name ? name : "?");
+        return NULL;
+    }
+
+    if (name) {
+        strncpy(cache->name, name, SLAB_NAME_LENGTH - 1);
+    }
+    cache->object_size = object_size;
+    cache->align = align;
+    cache->flags = flags;
+    cache->objects_per_slab = (PAGE_SIZE - header) / object_size;
+    spinlock_init(&cache->lock);
+
+    log_debug("SLAB", "Created cache '%s': %u-byte objects, %u per slab",
+              cache->name, cache->object_size, cache->objects_per_slab);
+    return cache;
+}
+
+/**
+ * Destroy an object cache
+ */
+int kmem_cache_destroy(kmem_cache_t* cache) {
+    if (!cache || !cache->in_use) {
+        return -1;
+    }
+
+    kmem_cache_shrink(cache);
+
+    spinlock_acquire(&cache->lock);
+    if (cache->objects_in_use > 0) {
+        log_error("SLAB", "Cache '%s' destroyed with %u objects in use",
+                  cache->name, cache->objects_in_use);
+        spinlock_release(&cache->lock);
+        return -1;
+    }
+    spinlock_release(&cache->lock);
+
+    spinlock_acquire(&cache_table_lock);
+    cache->in_use = 0;
+    spinlock_release(&cache_table_lock);
+    return 0;
+}
+
+/**
+ * Allocate an object from a cache
+ */
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    if (!cache) {
+        return NULL;
+    }
+
+    void* obj;
+
+    if (cache->flags & SLAB_FLAG_NO_MAGAZINE) {
+        spinlock_acquire(&cache->lock);
+        obj = slab_alloc_object(cache);
+        spinlock_release(&cache->lock);
+    } else {
+        // Fast path: pop from this CPU's magazines without taking a lock
+        uint32_t eflags = slab_irq_save();
+        kmem_cpu_cache_t* cc = slab_cpu_cache(cache);
+
+        if (cc->loaded && cc->loaded->rounds > 0) {
+            obj = cc->loaded->objects[--cc->loaded->rounds];
+            cc->hits++;
+        } else if (cc->previous && cc->previous->rounds > 0) {
+            kmem_magazine_t* tmp = cc->loaded;
+            cc->loaded = cc->previous;
+            cc->previous = tmp;
+            obj = cc->loaded->objects[--cc->loaded->rounds];
+            cc->hits++;
+        } else {
+            obj = kmem_cache_alloc_slow(cache, cc);
+        }
+
+        slab_irq_restore(eflags);
+    }
+
+    if (obj && (cache->flags & SLAB_FLAG_ZERO)) {
+        memset(obj, 0, cache->object_size);
+    }
+
+    return obj;
+}
+
+/**
+ * Free an object back to its cache
+ */
+void kmem_cache_free(kmem_cache_t* cache, void* obj) {
+    if (!cache || !obj) {
+        return;
+    }
+
+    kmem_slab_t* slab = (kmem_slab_t*)((uintptr_t)obj & ~(uintptr_t)(PAGE_SIZE - 1));
+    if (slab->magic != SLAB_MAGIC || slab->cache != cache) {
+        log_error("SLAB", "Cache '%s': freeing foreign object %p", cache->name, obj);
+        return;
+    }
+
+    if (cache->flags & SLAB_FLAG_POISON) {
+        memset(obj, SLAB_POISON_PATTERN, cache->object_size);
+    }
+
+    if (cache->flags & SLAB_FLAG_NO_MAGAZINE) {
+        spinlock_acquire(&cache->lock);
+        slab_free_object(cache, obj);
+        spinlock_release(&cache->lock);
+        return;
+    }
+
+    // Fast path: push onto this CPU's magazines without taking a lock
+    uint32_t eflags = slab_irq_save();
+    kmem_cpu_cache_t* cc = slab_cpu_cache(cache);
+
+    if (cc->loaded && cc->loaded->rounds < SLAB_MAGAZINE_SIZE) {
+        cc->loaded->objects[cc->loaded->rounds++] = obj;
+        cc->hits++;
+    } else if (cc->previous && cc->previous->rounds == 0) {
+        kmem_magazine_t* tmp = cc->loaded;
+        cc->loaded = cc->previous;
+        cc->previous = tmp;
+        cc->loaded->objects[cc->loaded->rounds++] = obj;
+        cc->hits++;
+    } else {
+        kmem_cache_free_slow(cache, cc, obj);
+    }
+
+    slab_irq_restore(eflags);
+}
+
+/**
+ * Drain all magazines and release free slabs
+ */
+uint32_t kmem_cache_shrink(kmem_cache_t* cache) {
+    if (!cache) {
+        return 0;
+    }
+
+    uint32_t eflags = slab_irq_save();
+    spinlock_acquire(&cache->lock);
+
+    uint32_t reaps_before = cache->slab_reaps;
+    kmem_magazine_t* released = NULL;
+
+    // Magazines of other CPUs are only drained here, at a quiescent point
+    for (int i = 0; i < SLAB_MAX_CPUS; i++) {
+        kmem_cpu_cache_t* cc = &cache->cpu[i];
+        kmem_magazine_t* mags[2] = { cc->loaded, cc->previous };
+        for (int j = 0; j < 2; j++) {
+            if (mags[j]) {
+                slab_drain_magazine(cache, mags[j]);
+                mags[j]->next = released;
+                released = mags[j];
+            }
+        }
+        cc->loaded = NULL;
+        cc->previous = NULL;
+    }
+
+    while (cache->depot_full) {
+        kmem_magazine_t* mag = cache->depot_full;
+        cache->depot_full = mag->next;
+        slab_drain_magazine(cache, mag);
+        mag->next = released;
+        released = mag;
+    }
+    cache->depot_full_count = 0;
+
+    while (cache->depot_empty) {
+        kmem_magazine_t* mag = cache->depot_empty;
+        cache->depot_empty = mag->next;
+        mag->next = released;
+        released = mag;
+    }
+
+    while (cache->free_slabs) {
+        kmem_slab_t* slab = cache->free_slabs;
+        slab_list_remove(&cache->free_slabs, slab);
+        slab_reap(cache, slab);
+    }
+    cache->slabs_free = 0;
+
+    uint32_t reaped = cache->slab_reaps - reaps_before;
+
+    spinlock_release(&cache->lock);
+
+    // Magazines go back to their own cache outside of this cache's lock
+    while (released) {
+        kmem_magazine_t* mag = released;
+        released = mag->next;
+        kmem_cache_free(magazine_cache, mag);
+    }
+
+    slab_irq_restore(eflags);
+    return reaped;
+}
+
+/**
+ * Get statistics for a single cache
+ */
+void kmem_cache_get_stats(kmem_cache_t* cache, kmem_cache_stats_t* stats) {
+    if (!cache || !stats) {
+        return;
+    }
+
+    memset(stats, 0, sizeof(kmem_cache_stats_t));
+
+    spinlock_acquire(&cache->lock);
+
+    strncpy(stats->name, cache->name, SLAB_NAME_LENGTH - 1);
+    stats->object_size = cache->object_size;
+    stats->objects_per_slab = cache->objects_per_slab;
+    stats->slabs_total = cache->slabs_total;
+    stats->slabs_free = cache->slabs_free;
+    stats->objects_in_use = cache->objects_in_use;
+    stats->magazine_misses = cache->magazine_misses;
+    stats->depot_exchanges = cache->depot_exchanges;
+    stats->slab_grows = cache->slab_grows;
+    stats->slab_reaps = cache->slab_reaps;
+
+    for (kmem_magazine_t* mag = cache->depot_full; mag; mag = mag->next) {
+        stats->objects_cached += mag->rounds;
+    }
+
+    // Per-CPU counters are read without their owner's cooperation; they are
+    // only statistics, so a slightly stale value is acceptable
+    for (int i = 0; i < SLAB_MAX_CPUS; i++) {
+        kmem_cpu_cache_t* cc = &cache->cpu[i];
+        stats->magazine_hits += cc->hits;
+        if (cc->loaded) stats->objects_cached += cc->loaded->rounds;
+        if (cc->previous) stats->objects_cached += cc->previous->rounds;
+    }
+
+    spinlock_release(&cache->lock);
+}
+
+/**
+ * Get statistics for all caches
+ */
+int kmem_get_all_stats(kmem_cache_stats_t* stats, int max_caches) {
+    if (!stats || max_caches <= 0) {
+        return 0;
+    }
+
+    int count = 0;
+    for (int i = 0; i < SLAB_MAX_CACHES && count < max_caches; i++) {
+        if (cache_table[i].in_use) {
+            kmem_cache_get_stats(&cache_table[i], &stats[count++]);
+        }
+    }
+    return count;
+}
+
+/**
+ * Map a request size to its size-class index
+ */
+static inline int slab_size_class(uint32_t size) {
+    int index = 0;
+    uint32_t class_size = SLAB_MIN_OBJECT_SIZE;
+
+    while (class_size < size) {
+        class_size <<= 1;
+        index++;
+    }
+    return index;
+}
+
+/**
+ * Allocate from the size-class cache that fits the request
+ */
+void* kmem_alloc(uint32_t size) {
+    if (!slab_initialized || size == 0 || size > SLAB_MAX_OBJECT_SIZE) {
+        return NULL;
+    }
+    return kmem_cache_alloc(size_caches[slab_size_class(size)]);
+}
+
+/**
+ * Free an object obtained from kmem_alloc()
+ */
+void kmem_free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    kmem_slab_t* slab = (kmem_slab_t*)((uintptr_t)ptr & ~(uintptr_t)(PAGE_SIZE - 1));
+    kmem_cache_free(slab->cache, ptr);
+}
+
+/**
+ * Check whether a pointer was handed out by a slab cache
+ */
+int kmem_is_slab_object(const void* ptr) {
+    if (!ptr || !paging_is_slab_page(ptr)) {
+        return 0;
+    }
+
+    const kmem_slab_t* slab = (const kmem_slab_t*)((uintptr_t)ptr & ~(uintptr_t)(PAGE_SIZE - 1));
+    return slab->magic == SLAB_MAGIC;
+}
+
+/**
+ * Get the usable size of a slab object
+ */
+uint32_t kmem_object_size(const void* ptr) {
+    if (!kmem_is_slab_object(ptr)) {
+        return 0;
+    }
+
+    const kmem_slab_t* slab = (const kmem_slab_t*)((uintptr_t)ptr & ~(uintptr_t)(PAGE_SIZE - 1));
+    return slab->cache->object_size;
+}
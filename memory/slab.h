@@ -0,0 +1,169 @@
+/**
+ * @file slab.h
+ * @brief Slab object caches with per-CPU magazines
+ *
+ * Small fixed-size kernel objects (network buffers, sleep/IPC nodes, ...)
+ * are served from page-sized slabs. Each cache keeps a pair of per-CPU
+ * magazines so that the common alloc/free path is a constant-time array
+ * push/pop with local interrupts disabled and no global lock. The cache
+ * lock is only taken when a magazine must be exchanged with the depot or
+ * refilled from the slab layer.
+ *
+ * heap_alloc() routes every request up to SLAB_MAX_OBJECT_SIZE through a
+ * set of power-of-two size-class caches built on this API.
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Slab allocator limits
+ */
+#define SLAB_MAX_CPUS          16    // Must be >= the scheduler's MAX_CPUS
+#define SLAB_MAX_CACHES        48    // Maximum number of caches in the system
+#define SLAB_MAGAZINE_SIZE     32    // Object slots per magazine
+#define SLAB_MIN_OBJECT_SIZE   16    // Smallest size-class
+#define SLAB_MAX_OBJECT_SIZE   1024  // Largest size-class fronting heap_alloc
+#define SLAB_NAME_LENGTH       24
+
+/**
+ * Cache creation flags
+ */
+#define SLAB_FLAG_NONE         0x00000000
+#define SLAB_FLAG_NO_MAGAZINE  0x00000001  // Bypass per-CPU magazines (internal caches)
+#define SLAB_FLAG_ZERO         0x00000002  // Zero objects on allocation
+#define SLAB_FLAG_POISON       0x00000004  // Poison objects on free
+
+/**
+ * Opaque cache handle
+ */
+typedef struct kmem_cache kmem_cache_t;
+
+/**
+ * Per-cache statistics
+ */
+typedef struct {
+    char name[SLAB_NAME_LENGTH];
+    uint32_t object_size;        // Size of each object (after alignment)
+    uint32_t objects_per_slab;   // Objects carved from a single page
+    uint32_t slabs_total;        // Pages currently owned by the cache
+    uint32_t slabs_free;         // Completely free pages kept for reuse
+    uint32_t objects_in_use;     // Objects handed out by the slab layer
+    uint32_t objects_cached;     // Objects parked in magazines (CPU + depot)
+    uint32_t magazine_hits;      // Allocations/frees served by a CPU magazine
+    uint32_t magazine_misses;    // Operations that had to take the cache lock
+    uint32_t depot_exchanges;    // Magazines swapped with the depot
+    uint32_t slab_grows;         // Pages requested from the page allocator
+    uint32_t slab_reaps;         // Pages returned to the page allocator
+} kmem_cache_stats_t;
+
+/**
+ * Initialize the slab allocator and the heap size-class caches
+ */
+void slab_init(void);
+
+/**
+ * Check whether the slab allocator is ready to serve allocations
+ *
+ * @return 1 if initialized, 0 otherwise
+ */
+int slab_is_initialized(void);
+
+/**
+ * Create an object cache
+ *
+ * @param name Name of the cache (for statistics and debugging)
+ * @param object_size Size of each object in bytes
+ * @param align Required object alignment (0 for the default of 8 bytes)
+ * @param flags SLAB_FLAG_* creation flags
+ * @return Cache handle, or NULL on failure
+ */
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t object_size,
+                                uint32_t align, uint32_t flags);
+
+/**
+ * Destroy an object cache, returning all of its pages
+ *
+ * All objects must have been freed back to the cache.
+ *
+ * @param cache Cache to destroy
+ * @return 0 on success, -1 if objects are still in use
+ */
+int kmem_cache_destroy(kmem_cache_t* cache);
+
+/**
+ * Allocate an object from a cache
+ *
+ * @param cache Cache to allocate from
+ * @return Pointer to the object, or NULL on failure
+ */
+void* kmem_cache_alloc(kmem_cache_t* cache);
+
+/**
+ * Free an object back to its cache
+ *
+ * @param cache Cache the object was allocated from
+ * @param obj Object to free
+ */
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+
+/**
+ * Drain all magazines and release free slabs back to the page allocator
+ *
+ * @param cache Cache to shrink
+ * @return Number of pages released
+ */
+uint32_t kmem_cache_shrink(kmem_cache_t* cache);
+
+/**
+ * Get statistics for a single cache
+ *
+ * @param cache Cache to query
+ * @param stats Output statistics
+ */
+void kmem_cache_get_stats(kmem_cache_t* cache, kmem_cache_stats_t* stats);
+
+/**
+ * Get statistics for all caches
+ *
+ * @param stats Output array
+ * @param max_caches Number of entries available in the output array
+ * @return Number of entries written
+ */
+int kmem_get_all_stats(kmem_cache_stats_t* stats, int max_caches);
+
+/**
+ * Allocate from the size-class cache that fits the request
+ *
+ * @param size Requested size (must be <= SLAB_MAX_OBJECT_SIZE)
+ * @return Pointer to the object, or NULL if no size-class fits
+ */
+void* kmem_alloc(uint32_t size);
+
+/**
+ * Free an object obtained from kmem_alloc()
+ *
+ * @param ptr Object to free
+ */
+void kmem_free(void* ptr);
+
+/**
+ * Check whether a pointer was handed out by a slab cache
+ *
+ * @param ptr Pointer to check
+ * @return 1 if the pointer lives in a slab page, 0 otherwise
+ */
+int kmem_is_slab_object(const void* ptr);
+
+/**
+ * Get the usable size of a slab object
+ *
+ * @param ptr Slab object
+ * @return Object size in bytes, or 0 if not a slab object
+ */
+uint32_t kmem_object_size(const void* ptr);
+
+#endif /* SLAB_H */
@@ -142,12 +142,6 @@ int dns_lookup_sync(const char* hostname, ipv4_address_t* ip, uint32_t timeout_m
  */
 int dns_process_packet(net_buffer_t* buffer);
 
-/**
- * DNS client task - handles timeouts and retries
- * Called periodically by the kernel
- */
-void dns_client_task(void);
-
 /**
  * Clear the DNS cache
  */
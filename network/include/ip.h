@@ -45,15 +45,15 @@ typedef struct ip_addr {
  * IP header constants
  */
 #define IP_HEADER_MIN_SIZE 20
-#define IP_VERSION(hdr)    (((hdr)->version_and_ihl >> 4) & 0x0F)
-#define IP_IHL(hdr)        ((hdr)->version_and_ihl & 0x0F)
+#define IP_VERSION(hdr)    (((hdr)->ver_ihl >> 4) & 0x0F)
+#define IP_IHL(hdr)        ((hdr)->ver_ihl & 0x0F)
 
 /**
  * IP flags
  */
-#define IP_FLAG_RESERVED        0x0
+#define IP_FLAG_RESERVED        0x4
 #define IP_FLAG_DONT_FRAGMENT   0x2
-#define IP_FLAG_MORE_FRAGMENTS  0x4
+#define IP_FLAG_MORE_FRAGMENTS  0x1
 
 /**
  * IP fragment offset mask
@@ -31,6 +31,26 @@ typedef struct ipv4_address {
     uint8_t addr[4];
 } __attribute__((packed)) ipv4_address_t;
 
+/**
+ * Byte order conversion (network order is big-endian, x86 is little-endian)
+ */
+static inline uint16_t htons(uint16_t value) {
+    return (uint16_t)((value >> 8) | (value << 8));
+}
+
+static inline uint16_t ntohs(uint16_t value) {
+    return htons(value);
+}
+
+static inline uint32_t htonl(uint32_t value) {
+    return ((value >> 24) & 0xFF) | ((value >> 8) & 0xFF00) |
+           ((value << 8) & 0xFF0000) | (value << 24);
+}
+
+static inline uint32_t ntohl(uint32_t value) {
+    return htonl(value);
+}
+
 /**
  * Network error codes
  */
@@ -56,10 +76,27 @@ typedef struct ipv4_address {
  * Network buffer flags
  */
 #define NET_BUF_FLAG_NONE       0x00
-#define NET_BUF_FLAG_ALLOC      0x01    // Buffer is allocated (free on release)
+#define NET_BUF_FLAG_ALLOC      0x01    // Data lives in the buffer's own allocation
 #define NET_BUF_FLAG_BROADCAST  0x02    // Broadcast packet
 #define NET_BUF_FLAG_MULTICAST  0x04    // Multicast packet
 
+/**
+ * Packet buffer pools
+ *
+ * Every allocated buffer has NET_BUF_HEADROOM bytes in front of its data,
+ * enough for Ethernet, IPv4 and TCP headers with options, so protocols
+ * prepend headers with net_buffer_push() without moving the payload.
+ */
+#define NET_BUF_HEADROOM        128     // Ethernet (14) + IPv4 (up to 60) + TCP (20 + options)
+#define NET_BUF_SMALL_SIZE      256     // Data capacity of the small class (ACKs, control packets)
+#define NET_BUF_MTU_SIZE        1536    // Data capacity of the MTU class (a full Ethernet frame)
+
+#define NET_BUF_POOL_HEADER     0       // Descriptor only (clones, frames received in place)
+#define NET_BUF_POOL_SMALL      1
+#define NET_BUF_POOL_MTU        2
+#define NET_BUF_POOL_COUNT      3
+#define NET_BUF_POOL_HEAP       0xFF    // Larger than any class, from the heap
+
 /**
  * Network device flags
  */
@@ -80,13 +117,16 @@ struct net_buffer;
 typedef struct net_buffer {
     uint8_t* data;              // Pointer to the current data position
     size_t len;                 // Length of data in the buffer
-    size_t size;                // Total size of the buffer
-    size_t offset;              // Offset from the start of allocation
+    size_t size;                // Total size of the data area, headroom included
+    size_t offset;              // Offset of data from the start of the data area
     uint8_t flags;              // Buffer flags
     uint8_t protocol;           // Protocol identifier
+    uint8_t pool;               // NET_BUF_POOL_* the structure came from
+    volatile uint32_t refcount; // References; the last net_buffer_free() releases it
     void* protocol_data;        // Protocol-specific data
     struct net_device* device;  // Associated network device
     struct net_buffer* next;    // Next buffer in a chain
+    struct net_buffer* shared;  // Buffer owning the data, for clones
 } net_buffer_t;
 
 /**
@@ -102,6 +142,7 @@ typedef struct net_device_stats {
     uint64_t rx_dropped;        // Dropped incoming packets
     uint64_t tx_dropped;        // Dropped outgoing packets
     uint64_t collisions;        // Detected collisions
+    uint64_t rx_copied_bytes;   // Received bytes the driver had to copy
 } net_device_stats_t;
 
 /**
@@ -114,6 +155,7 @@ typedef struct net_device_ops {
     int (*set_mac)(struct net_device* dev, const mac_address_t* mac);
     int (*set_mtu)(struct net_device* dev, uint16_t mtu);
     int (*set_flags)(struct net_device* dev, uint32_t flags);
+    int (*poll)(struct net_device* dev, int budget);
 } net_device_ops_t;
 
 /**
@@ -131,8 +173,22 @@ typedef struct net_device {
     net_device_ops_t ops;       // Device operations
     net_device_stats_t stats;   // Device statistics
     void* priv;                 // Device private data
+    struct net_device* poll_next; // Next device waiting to be polled
+    volatile int poll_scheduled;  // On the poll list
 } net_device_t;
 
+/**
+ * Deferred network work
+ *
+ * Timers and interrupt handlers must not run protocol code; they queue a
+ * work item instead, and the network thread calls it.
+ */
+typedef struct net_work {
+    void (*func)(struct net_work* work); // Called from the network thread
+    struct net_work* next;      // Next queued work item
+    volatile int queued;        // On the work list
+} net_work_t;
+
 /**
  * Initialize the network stack
  * 
@@ -148,6 +204,14 @@ int network_init();
  */
 int network_register_device(net_device_t* dev);
 
+/**
+ * Remove a network device from the stack (before its driver frees it)
+ * 
+ * @param dev Network device to remove
+ * @return 0 on success, error code if it was not registered
+ */
+int network_unregister_device(net_device_t* dev);
+
 /**
  * Find a network device by name
  * 
@@ -181,26 +245,98 @@ void network_set_default_device(net_device_t* dev);
 /**
  * Process incoming network packet
  * 
+ * The frame is not copied: it is wrapped in a receive descriptor and passed
+ * up the stack where it lies (usually the driver's DMA ring). Protocol
+ * handlers may modify it in place and must copy whatever they keep, since
+ * the memory is handed back to the driver when this returns.
+ * 
+ * Runs the whole protocol stack, so it must be called from thread context:
+ * drivers call it from their poll op, never from their interrupt handler.
+ * 
  * @param dev Device that received the packet
- * @param data Packet data
- * @param len Packet length
- * @return 0 on success, error code on failure
+ * @param data Ethernet frame, without FCS
+ * @param len Frame length
+ * @return Result of protocol processing, NET_ERR_NOMEM if no descriptor was free
  */
 int network_receive_packet(net_device_t* dev, const void* data, size_t len);
 
+/**
+ * Ask the network thread to poll a device (callable from interrupts)
+ * 
+ * The driver masks its receive interrupt before scheduling; its poll op
+ * passes up to budget frames to network_receive_packet(), and unmasks the
+ * interrupt and returns less than budget once the device is drained.
+ * 
+ * @param dev Device with a poll op
+ */
+void network_schedule_poll(net_device_t* dev);
+
+/**
+ * Prepare a work item before first use
+ * 
+ * @param work Work item
+ * @param func Function the network thread calls
+ */
+void net_work_init(net_work_t* work, void (*func)(net_work_t* work));
+
+/**
+ * Queue a work item for the network thread (callable from interrupts)
+ * 
+ * A work item already queued is not queued twice; it is dequeued before
+ * its function runs, so the function may queue it again.
+ * 
+ * @param work Initialized work item
+ */
+void net_work_schedule(net_work_t* work);
+
+/**
+ * Start the network thread, which polls devices and runs queued work
+ * 
+ * @return 0 on success, error code on failure
+ */
+int network_start_thread(void);
+
 /**
  * Allocate a network buffer
  * 
- * @param size Size of the buffer to allocate
- * @param reserve_header Space to reserve for headers
- * @return Pointer to the new buffer or NULL on failure
+ * Buffers up to NET_BUF_MTU_SIZE come from per-CPU slab magazines; the
+ * fixed NET_BUF_HEADROOM is always available in front of the data.
+ * 
+ * @param size Size of the buffer to allocate, reserve_header included
+ * @param reserve_header Space to reserve for headers beyond the fixed headroom
+ * @return Pointer to the new buffer (one reference) or NULL on failure
  */
 net_buffer_t* net_buffer_alloc(size_t size, size_t reserve_header);
 
 /**
- * Free a network buffer
+ * Take another reference to a network buffer
  * 
- * @param buffer Buffer to free
+ * The holder must not move the buffer's data or length while others use
+ * it; net_buffer_clone() gives a private view instead.
+ * 
+ * @param buffer Buffer to reference
+ * @return The buffer
+ */
+net_buffer_t* net_buffer_get(net_buffer_t* buffer);
+
+/**
+ * Make a second view of a buffer's data without copying it
+ * 
+ * The clone has its own data pointer, length and headroom position, so a
+ * segment kept for retransmission can be cloned and sent down the stack
+ * (which prepends headers to the clone) while the original stays intact.
+ * Headers pushed onto a clone land in the shared headroom.
+ * 
+ * @param buffer Buffer to clone
+ * @return New buffer sharing the data, or NULL on failure
+ */
+net_buffer_t* net_buffer_clone(net_buffer_t* buffer);
+
+/**
+ * Drop a reference to a network buffer (and to the rest of its chain);
+ * the last reference returns it to its pool
+ * 
+ * @param buffer Buffer to release
  */
 void net_buffer_free(net_buffer_t* buffer);
 
@@ -275,10 +411,18 @@ int network_get_device_count();
 net_device_t* network_get_device(int index);
 
 /**
- * Enhanced network initialization - sets up loopback device
+ * Enhanced network initialization - sets up the loopback device and the
+ * Ethernet, IP, ICMP, UDP and TCP protocol handlers
  * 
  * @return 0 on success, error code on failure
  */
 int network_init_enhanced();
 
+/**
+ * Push synthetic UDP frames through the loopback receive path and log
+ * packets per second, bytes copied per packet and the cost of a packet
+ * buffer allocation
+ */
+void network_run_rx_benchmark(void);
+
 #endif /* NETWORK_H */
\ No newline at end of file
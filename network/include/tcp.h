@@ -11,6 +11,8 @@
 
 #include "network.h"
 #include "ip.h"
+#include "../../kernel/ktimer.h"
+#include "../../kernel/sync.h"
 
 /**
  * TCP header size in bytes (without options)
@@ -32,6 +34,30 @@
  */
 #define TCP_DEFAULT_WINDOW 4096
 
+/**
+ * Out-of-order byte ranges a socket holds while waiting for a hole to fill
+ */
+#define TCP_OOO_RANGES 4
+
+/**
+ * Retransmission timeout bounds (milliseconds)
+ */
+#define TCP_RTO_MIN 200
+#define TCP_RTO_MAX 60000
+
+/**
+ * Duplicate ACKs that signal a lost segment (fast retransmit)
+ */
+#define TCP_DUPACK_THRESHOLD 3
+
+/**
+ * Sequence number comparisons that survive wraparound
+ */
+#define TCP_SEQ_LT(a, b)  ((int32_t)((a) - (b)) < 0)
+#define TCP_SEQ_LEQ(a, b) ((int32_t)((a) - (b)) <= 0)
+#define TCP_SEQ_GT(a, b)  ((int32_t)((a) - (b)) > 0)
+#define TCP_SEQ_GEQ(a, b) ((int32_t)((a) - (b)) >= 0)
+
 /**
  * TCP socket states
  */
@@ -65,6 +91,7 @@ typedef enum {
 #define TCP_OPT_NODELAY       0x01    // Disable Nagle algorithm
 #define TCP_OPT_KEEPALIVE     0x02    // Enable keep-alive packets
 #define TCP_OPT_REUSEADDR     0x04    // Allow reuse of local address
+#define TCP_OPT_CORK          0x08    // Hold back partial segments until uncorked
 
 /**
  * TCP header structure
@@ -101,8 +128,45 @@ typedef struct tcp_retransmit {
     uint32_t srtt;             // Smoothed round-trip time (milliseconds)
     uint32_t rttvar;           // Round-trip time variation (milliseconds)
     uint8_t  attempts;         // Number of retransmission attempts
+    uint8_t  rtt_timing;       // A segment is being timed
+    uint32_t rtt_seq;          // Sequence number whose ACK ends the measurement
+    uint64_t rtt_start;        // When the timed segment was sent (milliseconds)
 } tcp_retransmit_t;
 
+/**
+ * Congestion control states (RFC 5681, RFC 6582)
+ */
+typedef enum {
+    TCP_CA_OPEN,              // Slow start or congestion avoidance
+    TCP_CA_RECOVERY,          // Fast recovery after duplicate ACKs
+    TCP_CA_LOSS               // Resending after a retransmission timeout
+} tcp_ca_state_t;
+
+struct tcp_connection;
+
+/**
+ * Congestion control algorithm
+ *
+ * Loss detection and recovery are common code (tcp_cong_ack() and
+ * tcp_cong_rto()); an algorithm only decides how cwnd and ssthresh move.
+ */
+typedef struct tcp_cong_ops {
+    const char* name;
+    // Reset the algorithm's private state (also when switching algorithms)
+    void (*init)(struct tcp_connection* conn);
+    // New data acknowledged outside fast recovery
+    void (*on_ack)(struct tcp_connection* conn, uint32_t acked, uint64_t now_ms);
+    // Fast retransmit: set ssthresh and the post-recovery cwnd
+    void (*on_loss)(struct tcp_connection* conn);
+    // Retransmission timeout: set ssthresh, cwnd restarts from one segment
+    void (*on_rto)(struct tcp_connection* conn);
+} tcp_cong_ops_t;
+
+/**
+ * Words of algorithm-private state in each connection
+ */
+#define TCP_CONG_PRIV_WORDS 8
+
 /**
  * TCP connection information
  */
@@ -114,7 +178,18 @@ typedef struct tcp_connection {
     uint32_t rcv_wnd;          // Receive window
     uint16_t mss;              // Maximum segment size
     tcp_retransmit_t retransmit; // Retransmission parameters
-    net_buffer_t* retransmit_queue; // Queue of segments to retransmit
+    net_buffer_t* retransmit_queue; // Sent, unacknowledged segments, oldest first
+    net_buffer_t* retransmit_tail;  // Last segment in retransmit_queue
+    
+    // Congestion control
+    const tcp_cong_ops_t* cong; // Algorithm
+    uint32_t cwnd;             // Congestion window (bytes)
+    uint32_t ssthresh;         // Slow start threshold (bytes)
+    uint32_t bytes_acked;      // ACKed bytes not yet credited to cwnd in congestion avoidance
+    uint32_t recover;          // snd_nxt when the last loss recovery started
+    uint8_t  ca_state;         // tcp_ca_state_t
+    uint8_t  dup_acks;         // Consecutive duplicate ACKs
+    uint32_t cong_priv[TCP_CONG_PRIV_WORDS]; // Algorithm-private state
 } tcp_connection_t;
 
 /**
@@ -127,7 +202,7 @@ typedef struct tcp_listener {
 } tcp_listener_t;
 
 /**
- * TCP buffer structure for receive buffer
+ * TCP circular byte buffer (socket send and receive buffers)
  */
 typedef struct tcp_buffer {
     uint8_t* data;           // Buffer data
@@ -137,10 +212,43 @@ typedef struct tcp_buffer {
     uint32_t bytes_available; // Number of bytes available to read
 } tcp_buffer_t;
 
+/**
+ * Out-of-order data held in the receive buffer (sequence numbers, end exclusive)
+ */
+typedef struct tcp_ooo_range {
+    uint32_t start;
+    uint32_t end;
+} tcp_ooo_range_t;
+
+/**
+ * Timer events a socket's work item handles in the network thread
+ */
+#define TCP_EVENT_RETRANSMIT  0x01    // Retransmission timer expired
+#define TCP_EVENT_TIME_WAIT   0x02    // TIME_WAIT period is over
+#define TCP_EVENT_DELACK      0x04    // A held-back ACK is due
+
+/**
+ * Application callbacks owed, delivered once the socket lock is dropped
+ */
+#define TCP_NOTIFY_CONNECTED  0x01
+#define TCP_NOTIFY_SENT       0x02
+#define TCP_NOTIFY_DATA       0x04
+#define TCP_NOTIFY_CLOSED     0x08
+
 /**
  * TCP socket structure
+ *
+ * Everything from state on is protected by lock, which is taken with
+ * interrupts disabled. Timers only record an event and queue work, so
+ * protocol code runs in the network thread or in the caller's thread,
+ * never in interrupt context.
  */
 typedef struct tcp_socket {
+    // Kept when the slot is reused, so they stay valid while held or queued
+    spinlock_t lock;           // Protects the rest of the socket
+    net_work_t work;           // Handles timer events in the network thread
+    volatile uint8_t events;   // TCP_EVENT_* raised by timers, not yet handled
+    
     tcp_state_t state;         // Socket state
     uint16_t local_port;       // Local port
     uint16_t remote_port;      // Remote port
@@ -150,6 +258,11 @@ typedef struct tcp_socket {
     
     tcp_connection_t conn;     // Connection parameters
     
+    // Timers (run from the kernel timer wheel)
+    ktimer_t retransmit_timer; // Fires when outstanding data is not acknowledged in time
+    ktimer_t time_wait_timer;  // Ends the 2*MSL TIME_WAIT period
+    ktimer_t delack_timer;     // Sends an ACK that was held back to coalesce
+    
     // For listening sockets
     tcp_listener_t* listener;  // Listener data if this is a listening socket
     
@@ -158,12 +271,25 @@ typedef struct tcp_socket {
     
     // Receive buffer
     tcp_buffer_t rx_buffer;    // Circular buffer for received data
+    tcp_ooo_range_t rx_ooo[TCP_OOO_RANGES]; // Out-of-order data stored past rx_buffer's end, sorted
+    uint8_t rx_ooo_count;      // Ranges in use
+    uint8_t ack_pending;       // Full-sized segments received since our last ACK
+    uint32_t rcv_adv;          // Right edge of the window last advertised (sequence number)
+    uint32_t rx_copied;        // Bytes the application read in this autotuning period
+    uint64_t rx_period_start;  // Start of the autotuning period (ms, 0 = not started)
+    
+    // Send buffer
+    tcp_buffer_t tx_buffer;    // Data written by the application, not yet segmented
+    uint8_t fin_pending;       // Closed with data left in tx_buffer; FIN follows it
     
     // Callbacks
     void (*connected_callback)(struct tcp_socket* socket);
     void (*data_ready_callback)(struct tcp_socket* socket, size_t len);
     void (*sent_callback)(struct tcp_socket* socket, size_t len);
     void (*closed_callback)(struct tcp_socket* socket);
+    uint8_t notify;            // TCP_NOTIFY_* owed to the application
+    uint32_t notify_data;      // Bytes made readable since the last data_ready_callback
+    uint32_t notify_sent;      // Bytes acknowledged since the last sent_callback
     
     // User data pointer
     void* user_data;
@@ -241,6 +367,12 @@ int tcp_socket_connect(tcp_socket_t* socket, const ipv4_address_t* addr, uint16_
 /**
  * Send data through a TCP socket
  * 
+ * The data is copied into the socket's send buffer and goes out in
+ * MSS-sized segments as the peer's window allows. Small writes are held
+ * back while earlier data is unacknowledged (Nagle) unless TCP_OPT_NODELAY
+ * is set, and while TCP_OPT_CORK is set. Returns less than len, possibly 0,
+ * when the send buffer is full.
+ * 
  * @param socket Socket to send through
  * @param data Data to send
  * @param len Length of the data
@@ -251,6 +383,11 @@ int tcp_socket_send(tcp_socket_t* socket, const void* data, size_t len);
 /**
  * Receive data from a TCP socket
  * 
+ * Reading frees receive buffer space; the peer learns about the larger
+ * window once it has grown by at least an MSS (or half the buffer). The
+ * buffer itself grows, up to 64 KB, when the application drains more than
+ * half of it per round trip.
+ * 
  * @param socket Socket to receive from
  * @param buffer Buffer to store the data
  * @param len Maximum length of data to receive
@@ -272,9 +409,12 @@ size_t tcp_socket_available(tcp_socket_t* socket);
  * @param socket Socket to register callbacks for
  * @param connected_callback Called when connection is established
  * @param data_ready_callback Called when data is available to read
- * @param sent_callback Called when data has been sent
+ * @param sent_callback Called when the peer acknowledged data (with the byte count)
  * @param closed_callback Called when connection is closed
  * @return 0 on success, error code on failure
+ * 
+ * Callbacks run in the network thread or in the thread that called into the
+ * socket, after the socket lock is dropped, so they may use the socket API.
  */
 int tcp_socket_register_callbacks(tcp_socket_t* socket,
                                 void (*connected_callback)(tcp_socket_t*),
@@ -282,9 +422,22 @@ int tcp_socket_register_callbacks(tcp_socket_t* socket,
                                 void (*sent_callback)(tcp_socket_t*, size_t),
                                 void (*closed_callback)(tcp_socket_t*));
 
+/**
+ * Select the congestion control algorithm of a TCP socket
+ * 
+ * Can be changed at any time; the congestion window carries over.
+ * 
+ * @param socket Socket to configure
+ * @param name Algorithm name ("newreno" or "cubic")
+ * @return 0 on success, error code if there is no such algorithm
+ */
+int tcp_socket_set_congestion(tcp_socket_t* socket, const char* name);
+
 /**
  * Set options on a TCP socket
  * 
+ * Clearing TCP_OPT_CORK sends whatever it was holding back.
+ * 
  * @param socket Socket to configure
  * @param options Options to set
  * @return 0 on success, error code on failure
@@ -304,14 +457,6 @@ int tcp_socket_set_options(tcp_socket_t* socket, uint8_t options);
 uint16_t tcp_checksum(const tcp_header_t* header, const void* data, size_t data_len,
                      const ipv4_address_t* src_addr, const ipv4_address_t* dest_addr);
 
-/**
- * Process TCP timers (retransmission, keep-alive, etc.)
- * This should be called periodically by the network stack
- * 
- * @param msec Milliseconds since last call
- */
-void tcp_timer(uint32_t msec);
-
 /**
  * Get a free port for TCP
  * 
@@ -327,4 +472,69 @@ uint16_t tcp_get_free_port();
  */
 const char* tcp_state_to_str(tcp_state_t state);
 
+/**
+ * Fold a round-trip sample into SRTT and RTTVAR and recompute the RTO (RFC 6298)
+ * 
+ * @param rt Retransmission parameters of the connection
+ * @param rtt Measured round trip in milliseconds
+ */
+void tcp_rtt_update(tcp_retransmit_t* rt, uint32_t rtt);
+
+/**
+ * Congestion control algorithms
+ */
+extern const tcp_cong_ops_t tcp_cong_newreno;
+extern const tcp_cong_ops_t tcp_cong_cubic;
+
+/**
+ * Algorithm for new connections
+ */
+#define TCP_CONG_DEFAULT tcp_cong_newreno
+
+/**
+ * tcp_cong_ack() result: resend the oldest unacknowledged segment now
+ */
+#define TCP_CONG_RETRANSMIT 1
+
+/**
+ * Look up a congestion control algorithm by name
+ * 
+ * @param name Algorithm name
+ * @return The algorithm or NULL if unknown
+ */
+const tcp_cong_ops_t* tcp_cong_find(const char* name);
+
+/**
+ * Start congestion control on a connection (initial window, no loss history)
+ * 
+ * @param conn Connection, with mss and snd_una already set
+ * @param ops Algorithm (NULL for the default)
+ */
+void tcp_cong_init(tcp_connection_t* conn, const tcp_cong_ops_t* ops);
+
+/**
+ * Account for an incoming ACK, after snd_una moved past the acknowledged data
+ * 
+ * Counts duplicate ACKs, enters fast retransmit and NewReno fast recovery
+ * (RFC 6582) on the third one, and otherwise lets the algorithm grow cwnd.
+ * 
+ * @param conn Connection
+ * @param acked Bytes newly acknowledged, 0 for a duplicate ACK
+ * @param now_ms Current time in milliseconds
+ * @return TCP_CONG_RETRANSMIT if the oldest unacknowledged segment must be resent, else 0
+ */
+int tcp_cong_ack(tcp_connection_t* conn, uint32_t acked, uint64_t now_ms);
+
+/**
+ * Account for a retransmission timeout
+ * 
+ * @param conn Connection
+ */
+void tcp_cong_rto(tcp_connection_t* conn);
+
+/**
+ * Run every algorithm over emulated lossy links and log the goodput
+ */
+void tcp_cong_run_benchmark(void);
+
 #endif /* TCP_H */
\ No newline at end of file
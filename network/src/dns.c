@@ -6,9 +6,14 @@
 #include "../include/dns.h"
 #include "../include/udp.h"
 #include "../../kernel/logging/log.h"
+#include "../../kernel/ktimer.h"
+#include "../../kernel/thread.h"
 #include "../../hal/include/hal_timer.h"
 #include <string.h>
 
+#define DNS_QUERY_TIMEOUT_MS   3000   // Time to wait for a reply to each attempt
+#define DNS_QUERY_MAX_RETRIES  2      // Retries after the first attempt
+
 /* DNS query structure */
 typedef struct dns_query {
     char hostname[DNS_MAX_NAME_LENGTH + 1];   // Host name to resolve
@@ -18,6 +23,10 @@ typedef struct dns_query {
     dns_callback_t callback;                  // User callback
     void* user_data;                          // User data for callback
     int active;                               // Whether this query is active
+    ktimer_t timeout_timer;                   // Marks the query due for a retry
+    net_work_t timeout_work;                  // Retries or fails the query in the network thread
+    volatile int timed_out;                   // Set by the timer, cleared by the work item
+    volatile thread_id_t waiter;              // Thread blocked in dns_lookup_sync(), or -1
 } dns_query_t;
 
 /* Static variables */
@@ -33,6 +42,8 @@ static int dns_find_active_query(uint16_t id);
 static int dns_find_free_query_slot(void);
 static int dns_cache_entry(const char* hostname, const ipv4_address_t* ip, uint32_t ttl);
 static void dns_complete_query(int index, const ipv4_address_t* ip, int status);
+static void dns_query_timeout(ktimer_t* timer, void* data);
+static void dns_query_timeout_work(net_work_t* work);
 
 /**
  * Initialize the DNS client subsystem
@@ -44,7 +55,15 @@ int dns_init(void) {
     memset(dns_cache, 0, sizeof(dns_cache));
     
     // Clear active queries
+    for (int i = 0; i < sizeof(dns_queries) / sizeof(dns_queries[0]); i++) {
+        ktimer_cancel(&dns_queries[i].timeout_timer);
+    }
     memset(dns_queries, 0, sizeof(dns_queries));
+    for (int i = 0; i < sizeof(dns_queries) / sizeof(dns_queries[0]); i++) {
+        ktimer_init(&dns_queries[i].timeout_timer, dns_query_timeout, &dns_queries[i]);
+        net_work_init(&dns_queries[i].timeout_work, dns_query_timeout_work);
+        dns_queries[i].waiter = -1;
+    }
     
     // TODO: Register UDP port for DNS client when UDP port registration is available
     
@@ -120,13 +139,22 @@ int dns_lookup(const char* hostname, dns_callback_t callback, void* user_data) {
     query->id = dns_get_next_id();
     query->timestamp = hal_get_time_ms();
     query->retry_count = 0;
+    query->timed_out = 0;
     query->callback = callback;
     query->user_data = user_data;
+    query->waiter = -1;
     query->active = 1;
     
     // Send the query
     LOG(LOG_INFO, "Starting DNS lookup for %s", hostname);
-    return dns_send_query(hostname, query->id);
+    int result = dns_send_query(hostname, query->id);
+    if (result != 0) {
+        query->active = 0;
+        return result;
+    }
+    
+    ktimer_arm(&query->timeout_timer, DNS_QUERY_TIMEOUT_MS);
+    return 0;
 }
 
 /**
@@ -162,44 +190,46 @@ int dns_lookup_sync(const char* hostname, ipv4_address_t* ip, uint32_t timeout_m
     query->id = dns_get_next_id();
     query->timestamp = hal_get_time_ms();
     query->retry_count = 0;
+    query->timed_out = 0;
     query->callback = NULL;
     query->user_data = NULL;
+    query->waiter = thread_get_current_id();
     query->active = 1;
     
     // Send the query
     LOG(LOG_INFO, "Starting synchronous DNS lookup for %s", hostname);
     int result = dns_send_query(hostname, query->id);
     if (result != 0) {
+        query->waiter = -1;
         query->active = 0;
         return result;
     }
+    ktimer_arm(&query->timeout_timer, DNS_QUERY_TIMEOUT_MS);
     
-    // Wait for response or timeout
-    uint32_t start_time = hal_get_time_ms();
-    while (1) {
-        // Process any DNS tasks (like timeouts and retransmits)
-        dns_client_task();
-        
-        // Check if our query is still active
-        if (!query->active) {
-            // Query completed - check if we have a cached result
-            if (dns_get_cached(hostname, ip) == DNS_TTL_VALID) {
-                return 0;
-            }
-            return -1;
-        }
-        
-        // Check for timeout
-        if (hal_get_time_ms() - start_time >= timeout_ms) {
-            LOG(LOG_WARNING, "DNS lookup timeout for %s", hostname);
-            query->active = 0;
-            return -1;
+    // Block until the query completes (it wakes us) or the deadline passes;
+    // retries are driven by the query's own timer
+    uint64_t deadline = ktimer_now_ms() + timeout_ms;
+    while (query->active) {
+        uint64_t now = ktimer_now_ms();
+        if (now >= deadline) {
+            break;
         }
-        
-        // Sleep a bit to avoid hogging CPU
-        // TODO: Replace with proper sleep function when available
-        for (volatile int i = 0; i < 1000; i++);
+        thread_sleep((uint32_t)(deadline - now));
+    }
+    query->waiter = -1;
+    
+    if (query->active) {
+        LOG(LOG_WARNING, "DNS lookup timeout for %s", hostname);
+        ktimer_cancel(&query->timeout_timer);
+        query->active = 0;
+        return -1;
     }
+    
+    // Query completed - check if we have a cached result
+    if (dns_get_cached(hostname, ip) == DNS_TTL_VALID) {
+        return 0;
+    }
+    return -1;
 }
 
 /**
@@ -543,6 +573,10 @@ static void dns_complete_query(int index, const ipv4_address_t* ip, int status)
     }
     
     dns_query_t* query = &dns_queries[index];
+    if (!query->active) {
+        return;
+    }
+    ktimer_cancel(&query->timeout_timer);
     
     // If this query has a callback, invoke it
     if (query->callback) {
@@ -551,6 +585,13 @@ static void dns_complete_query(int index, const ipv4_address_t* ip, int status)
     
     // Mark the query as inactive
     query->active = 0;
+    
+    // Wake a dns_lookup_sync() caller. thread_wake_irq() remembers the wakeup
+    // if the caller has not gone to sleep yet, so it can't be lost.
+    thread_id_t waiter = query->waiter;
+    if (waiter >= 0) {
+        thread_wake_irq(waiter);
+    }
 }
 
 /**
@@ -643,31 +684,39 @@ void dns_clear_cache(void) {
 }
 
 /**
- * DNS client task - handles timeouts and retries
+ * Query timeout callback - runs in the timer interrupt, so it only marks
+ * the query due and leaves the resend to the network thread
  */
-void dns_client_task(void) {
-    uint32_t current_time = hal_get_time_ms();
+static void dns_query_timeout(ktimer_t* timer, void* data) {
+    dns_query_t* query = (dns_query_t*)data;
+    (void)timer;
     
-    for (int i = 0; i < sizeof(dns_queries) / sizeof(dns_queries[0]); i++) {
-        dns_query_t* query = &dns_queries[i];
-        
-        if (query->active) {
-            uint32_t elapsed_ms = current_time - query->timestamp;
-            
-            // Check for timeout (3 seconds per attempt, max 3 attempts)
-            if (elapsed_ms > 3000) {
-                if (query->retry_count < 2) {
-                    // Retry
-                    LOG(LOG_INFO, "DNS query timeout for %s, retrying (%d)", query->hostname, query->retry_count + 1);
-                    query->retry_count++;
-                    query->timestamp = current_time;
-                    dns_send_query(query->hostname, query->id);
-                } else {
-                    // Give up
-                    LOG(LOG_WARNING, "DNS query failed for %s after %d attempts", query->hostname, query->retry_count + 1);
-                    dns_complete_query(i, NULL, -1);
-                }
-            }
-        }
+    query->timed_out = 1;
+    net_work_schedule(&query->timeout_work);
+}
+
+/**
+ * Query timeout work - retries the query or gives up
+ */
+static void dns_query_timeout_work(net_work_t* work) {
+    dns_query_t* query = (dns_query_t*)((uint8_t*)work - offsetof(dns_query_t, timeout_work));
+    
+    // Answered, or restarted, since the timer fired
+    if (!query->timed_out || !query->active || ktimer_pending(&query->timeout_timer)) {
+        return;
+    }
+    query->timed_out = 0;
+    
+    if (query->retry_count < DNS_QUERY_MAX_RETRIES) {
+        // Retry
+        LOG(LOG_INFO, "DNS query timeout for %s, retrying (%d)", query->hostname, query->retry_count + 1);
+        query->retry_count++;
+        query->timestamp = hal_get_time_ms();
+        dns_send_query(query->hostname, query->id);
+        ktimer_arm(&query->timeout_timer, DNS_QUERY_TIMEOUT_MS);
+    } else {
+        // Give up
+        LOG(LOG_WARNING, "DNS query failed for %s after %d attempts", query->hostname, query->retry_count + 1);
+        dns_complete_query((int)(query - dns_queries), NULL, -1);
     }
 }
\ No newline at end of file
@@ -19,16 +19,19 @@ static int ethernet_handle_ip(net_buffer_t* buffer);
 static int ethernet_handle_arp(net_buffer_t* buffer);
 
 // Protocol handlers table
-static eth_protocol_handler_t protocol_handlers[] = {
-    [ETH_TYPE_IP >> 8]  = ethernet_handle_ip,
-    [ETH_TYPE_ARP >> 8] = ethernet_handle_arp
+static const struct {
+    uint16_t ethertype;
+    eth_protocol_handler_t handler;
+} protocol_handlers[] = {
+    { ETH_TYPE_IP,  ethernet_handle_ip },
+    { ETH_TYPE_ARP, ethernet_handle_arp }
 };
 
 /**
  * Initialize the Ethernet protocol handler
  */
 int ethernet_init() {
-    log_info("Initializing Ethernet protocol handler");
+    log_info("NET", "Initializing Ethernet protocol handler");
     // Nothing special to do here for now
     return 0;
 }
@@ -47,11 +50,17 @@ int ethernet_rx(net_buffer_t* buffer) {
     // Convert EtherType to host byte order
     uint16_t ethertype = (eth->ethertype >> 8) | ((eth->ethertype & 0xff) << 8);
     
-    // Check if we support this protocol
-    uint8_t proto_index = ethertype >> 8;
-    if (proto_index >= sizeof(protocol_handlers)/sizeof(protocol_handlers[0]) || 
-        !protocol_handlers[proto_index]) {
-        log_debug("Unsupported EtherType: 0x%04x", ethertype);
+    // Check if we support this protocol (IP and ARP share a high byte, so
+    // the table is searched rather than indexed)
+    eth_protocol_handler_t handler = NULL;
+    for (size_t i = 0; i < sizeof(protocol_handlers)/sizeof(protocol_handlers[0]); i++) {
+        if (protocol_handlers[i].ethertype == ethertype) {
+            handler = protocol_handlers[i].handler;
+            break;
+        }
+    }
+    if (!handler) {
+        log_debug("NET", "NET", "Unsupported EtherType: 0x%04x", ethertype);
         return NET_ERR_NOPROTO;
     }
     
@@ -69,7 +78,7 @@ int ethernet_rx(net_buffer_t* buffer) {
     }
     
     // Call the appropriate handler based on EtherType
-    return protocol_handlers[proto_index](buffer);
+    return handler(buffer);
 }
 
 /**
@@ -82,20 +91,20 @@ int ethernet_tx(net_device_t* dev, net_buffer_t* buffer, const mac_address_t* de
     
     // Check if the device is up
     if (!(dev->flags & NET_DEV_FLAG_UP)) {
-        log_error("Cannot send on down device: %s", dev->name);
+        log_error("NET", "Cannot send on down device: %s", dev->name);
         return NET_ERR_BUSY;
     }
     
     // Make sure we have enough headroom for the Ethernet header
     if (buffer->offset < ETH_HEADER_SIZE) {
-        log_error("Not enough headroom for Ethernet header");
+        log_error("NET", "Not enough headroom for Ethernet header");
         return NET_ERR_NOMEM;
     }
     
     // Add the Ethernet header
     eth_header_t* eth = (eth_header_t*)net_buffer_push(buffer, ETH_HEADER_SIZE);
     if (!eth) {
-        log_error("Failed to add Ethernet header to buffer");
+        log_error("NET", "Failed to add Ethernet header to buffer");
         return NET_ERR_NOMEM;
     }
     
@@ -122,7 +131,7 @@ int ethernet_tx(net_device_t* dev, net_buffer_t* buffer, const mac_address_t* de
         return result;
     }
     
-    log_error("Device %s does not support transmit operation", dev->name);
+    log_error("NET", "Device %s does not support transmit operation", dev->name);
     return NET_ERR_INVALID;
 }
 
@@ -130,11 +139,11 @@ int ethernet_tx(net_device_t* dev, net_buffer_t* buffer, const mac_address_t* de
  * Create a new Ethernet frame with space for payload
  */
 net_buffer_t* ethernet_alloc_frame(size_t payload_size) {
-    // Allocate a buffer with enough room for Ethernet header + payload
-    net_buffer_t* buffer = net_buffer_alloc(ETH_HEADER_SIZE + payload_size, ETH_HEADER_SIZE);
+    // The fixed headroom takes the Ethernet header
+    net_buffer_t* buffer = net_buffer_alloc(payload_size, 0);
     
     if (!buffer) {
-        log_error("Failed to allocate Ethernet frame buffer");
+        log_error("NET", "Failed to allocate Ethernet frame buffer");
         return NULL;
     }
     
@@ -160,7 +169,7 @@ static int ethernet_handle_arp(net_buffer_t* buffer) {
     buffer->protocol = NET_PROTO_ARP;
     
     // This would call the ARP handler, but it's not implemented yet
-    log_info("ARP packet received, but handling not implemented");
+    log_info("NET", "ARP packet received, but handling not implemented");
     
     return 0;
 }
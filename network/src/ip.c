@@ -13,21 +13,6 @@
 #include "../../kernel/logging/log.h"
 #include "../include/network.h"
 
-// IPv4 header structure
-typedef struct ip_header {
-    uint8_t  version_ihl;           // Version and IHL
-    uint8_t  type_of_service;       // Type of Service
-    uint16_t total_length;          // Total Length
-    uint16_t identification;        // Identification
-    uint16_t flags_fragment_offset; // Flags and Fragment Offset
-    uint8_t  ttl;                   // Time to Live
-    uint8_t  protocol;              // Protocol
-    uint16_t header_checksum;       // Header Checksum
-    uint8_t  source_ip[4];          // Source IP Address
-    uint8_t  dest_ip[4];            // Destination IP Address
-    // Options and padding...
-} __attribute__((packed)) ip_header_t;
-
 // Global IP state
 static struct {
     uint16_t next_id;               // Next IP identification value
@@ -50,7 +35,7 @@ static ip_addr_t default_gateway = {0};
  * Initialize the IP protocol handler
  */
 int ip_init() {
-    log_info("Initializing IP protocol handler");
+    log_info("NET", "Initializing IP protocol handler");
     
     // Initialize protocol handlers
     ip_protocol_count = 0;
@@ -60,14 +45,14 @@ int ip_init() {
     ip_str_to_addr("0.0.0.0", &subnet_mask);
     ip_str_to_addr("0.0.0.0", &default_gateway);
     
-    log_info("IP protocol handler initialized");
+    log_info("NET", "IP protocol handler initialized");
 
-    log_info("Initializing IPv4 protocol");
+    log_info("NET", "Initializing IPv4 protocol");
     
     // Initialize IP state
     ip_state.next_id = 1;
     
-    log_info("IPv4 protocol initialized");
+    log_info("NET", "IPv4 protocol initialized");
     return 0;
 }
 
@@ -76,19 +61,19 @@ int ip_init() {
  */
 int ip_register_protocol(uint8_t protocol, int (*handler)(net_buffer_t* buffer)) {
     if (handler == NULL) {
-        log_error("Cannot register NULL protocol handler");
+        log_error("NET", "Cannot register NULL protocol handler");
         return -1;
     }
     
     if (ip_protocol_count >= 8) {
-        log_error("Maximum number of IP protocol handlers reached");
+        log_error("NET", "Maximum number of IP protocol handlers reached");
         return -1;
     }
     
     // Check for duplicate protocol handler
     for (int i = 0; i < ip_protocol_count; i++) {
         if (ip_protocol_handlers[i].protocol == protocol) {
-            log_error("Protocol handler for IP protocol %u already registered", protocol);
+            log_error("NET", "Protocol handler for IP protocol %u already registered", protocol);
             return -1;
         }
     }
@@ -98,7 +83,7 @@ int ip_register_protocol(uint8_t protocol, int (*handler)(net_buffer_t* buffer))
     ip_protocol_handlers[ip_protocol_count].handler = (ip_protocol_handler_t)handler;
     ip_protocol_count++;
     
-    log_info("Registered IP protocol handler for protocol %u", protocol);
+    log_info("NET", "Registered IP protocol handler for protocol %u", protocol);
     return 0;
 }
 
@@ -116,10 +101,12 @@ static ip_protocol_handler_t ip_find_protocol_handler(uint8_t protocol) {
 }
 
 /**
- * Calculate the IP header checksum
+ * Calculate the IP header checksum (over the header as it stands, so the
+ * checksum field must be zero; the result is in network byte order)
  */
-static uint16_t ip_checksum(const void* data, size_t len) {
-    const uint16_t* buf = (const uint16_t*)data;
+uint16_t ip_checksum(const ip_header_t* header) {
+    const uint16_t* buf = (const uint16_t*)header;
+    size_t len = ip_get_header_length(header);
     uint32_t sum = 0;
     
     // Add up all 16-bit words
@@ -147,12 +134,12 @@ static uint16_t ip_checksum(const void* data, size_t len) {
  */
 int ip_rx(net_buffer_t* buffer) {
     if (buffer == NULL) {
-        log_error("Cannot process NULL buffer");
+        log_error("NET", "Cannot process NULL buffer");
         return -1;
     }
     
     if (buffer->len < IP_HEADER_MIN_SIZE) {
-        log_error("IP packet too short (%u bytes)", buffer->len);
+        log_error("NET", "IP packet too short (%u bytes)", buffer->len);
         return -1;
     }
     
@@ -160,21 +147,21 @@ int ip_rx(net_buffer_t* buffer) {
     ip_header_t* ip_hdr = (ip_header_t*)buffer->data;
     
     // Check IP version
-    if (IP_VERSION(ip_hdr) != 4) {
-        log_error("Unsupported IP version: %u", IP_VERSION(ip_hdr));
+    if (ip_get_version(ip_hdr) != 4) {
+        log_error("NET", "Unsupported IP version: %u", ip_get_version(ip_hdr));
         return -1;
     }
     
     // Get header length in bytes
-    uint8_t ihl = IP_IHL(ip_hdr);
+    uint8_t ihl = ip_get_ihl(ip_hdr);
     if (ihl < 5) {
-        log_error("Invalid IP header length: %u", ihl);
+        log_error("NET", "Invalid IP header length: %u", ihl);
         return -1;
     }
     
     uint16_t hdr_len = ihl * 4;
     if (buffer->len < hdr_len) {
-        log_error("IP packet too short for header (%u bytes, header %u bytes)", buffer->len, hdr_len);
+        log_error("NET", "IP packet too short for header (%u bytes, header %u bytes)", buffer->len, hdr_len);
         return -1;
     }
     
@@ -182,8 +169,8 @@ int ip_rx(net_buffer_t* buffer) {
     uint16_t checksum = ip_hdr->checksum;
     ip_hdr->checksum = 0;
     
-    if (checksum != ip_checksum(ip_hdr, hdr_len)) {
-        log_error("IP checksum verification failed");
+    if (checksum != ip_checksum(ip_hdr)) {
+        log_error("NET", "IP checksum verification failed");
         ip_hdr->checksum = checksum; // Restore original checksum
         return -1;
     }
@@ -191,166 +178,76 @@ int ip_rx(net_buffer_t* buffer) {
     ip_hdr->checksum = checksum; // Restore original checksum
     
     // Get total length
-    uint16_t total_len = ntohs(ip_hdr->total_length);
-    if (total_len > buffer->len) {
-        log_error("IP total length (%u) exceeds buffer length (%u)", total_len, buffer->len);
+    uint16_t total_len = ntohs(ip_hdr->length);
+    if (total_len < hdr_len || total_len > buffer->len) {
+        log_error("NET", "IP total length (%u) does not fit buffer length (%u)", total_len, buffer->len);
         return -1;
     }
     
-    // Trim the buffer to the actual packet length
-    if (total_len < buffer->len) {
-        netbuf_trim(buffer, buffer->len - total_len);
-    }
+    // Trim the buffer to the actual packet length (drops Ethernet padding)
+    buffer->len = total_len;
     
     // Check if packet is fragmented
-    uint16_t flags_and_offset = ntohs(ip_hdr->flags_and_fragment_offset);
+    uint16_t flags_and_offset = ntohs(ip_hdr->flags_offset);
     uint16_t offset = flags_and_offset & IP_FRAGMENT_OFFSET_MASK;
     uint8_t flags = (flags_and_offset >> 13) & 0x07;
     
     if (offset != 0 || (flags & IP_FLAG_MORE_FRAGMENTS)) {
-        log_error("IP fragmentation not supported");
+        log_error("NET", "IP fragmentation not supported");
         return -1;
     }
     
-    // Extract source and destination addresses
+    // Extract source and destination addresses; the transport handlers find
+    // them as a (source, destination) pair through protocol_data
+    ipv4_address_t addrs[2];
+    addrs[0] = ip_hdr->src_addr;
+    addrs[1] = ip_hdr->dst_addr;
+    
     ip_addr_t src_addr, dest_addr;
-    memcpy(&src_addr, &ip_hdr->src_addr, sizeof(ip_addr_t));
-    memcpy(&dest_addr, &ip_hdr->dest_addr, sizeof(ip_addr_t));
+    memcpy(&src_addr, &addrs[0], sizeof(ip_addr_t));
+    memcpy(&dest_addr, &addrs[1], sizeof(ip_addr_t));
     
     char src_str[16], dest_str[16];
-    log_debug("Received IP packet from %s to %s, protocol %u, length %u",
+    log_debug("NET", "Received IP packet from %s to %s, protocol %u, length %u",
               ip_addr_to_str(&src_addr, src_str),
               ip_addr_to_str(&dest_addr, dest_str),
               ip_hdr->protocol, total_len);
     
     // Check if the packet is addressed to us
     if (!ip_is_local_address(&dest_addr) && !ip_is_broadcast(&dest_addr)) {
-        log_debug("Ignoring IP packet not addressed to us");
+        log_debug("NET", "Ignoring IP packet not addressed to us");
         return -1;
     }
     
     // Find a protocol handler for this IP protocol
     ip_protocol_handler_t handler = ip_find_protocol_handler(ip_hdr->protocol);
     if (handler == NULL) {
-        log_debug("No handler for IP protocol %u", ip_hdr->protocol);
+        log_debug("NET", "No handler for IP protocol %u", ip_hdr->protocol);
         return -1;
     }
     
     // Skip the IP header
-    netbuf_pull(buffer, hdr_len);
+    net_buffer_pull(buffer, hdr_len);
+    buffer->protocol_data = addrs;
     
     // Call the protocol handler
-    return handler(buffer, &src_addr, &dest_addr);
+    int result = handler(buffer, &src_addr, &dest_addr);
+    
+    // The addresses live on this stack frame
+    buffer->protocol_data = NULL;
+    
+    return result;
 }
 
 /**
  * Handle incoming IPv4 packet
  */
 int ip_receive(net_buffer_t* buffer) {
-    if (!buffer || !buffer->data || buffer->len < sizeof(ip_header_t)) {
-        return NET_ERR_INVALID;
-    }
-    
-    // Get the IP header
-    ip_header_t* header = (ip_header_t*)buffer->data;
-    
-    // Verify header length
-    uint8_t ihl = header->version_ihl & 0x0F;
-    if (ihl < 5) {
-        log_warning("IP: Invalid header length: %d", ihl);
+    if (!buffer || !buffer->data) {
         return NET_ERR_INVALID;
     }
     
-    // Verify IP version
-    uint8_t version = (header->version_ihl >> 4) & 0x0F;
-    if (version != 4) {
-        log_warning("IP: Unsupported IP version: %d", version);
-        return NET_ERR_INVALID;
-    }
-    
-    // Verify checksum
-    uint16_t orig_checksum = header->header_checksum;
-    header->header_checksum = 0;
-    uint16_t calc_checksum = ip_checksum(header, ihl * 4);
-    header->header_checksum = orig_checksum;
-    
-    if (orig_checksum != calc_checksum) {
-        log_warning("IP: Invalid checksum");
-        return NET_ERR_INVALID;
-    }
-    
-    // Convert endianness for multi-byte fields
-    header->total_length = (header->total_length >> 8) | (header->total_length << 8);
-    header->identification = (header->identification >> 8) | (header->identification << 8);
-    header->flags_fragment_offset = (header->flags_fragment_offset >> 8) | (header->flags_fragment_offset << 8);
-    header->header_checksum = (header->header_checksum >> 8) | (header->header_checksum << 8);
-    
-    // Check if this packet is for us
-    int is_for_us = 0;
-    ipv4_address_t dest_ip;
-    memcpy(&dest_ip.addr, header->dest_ip, 4);
-    
-    // Check if destination IP matches any of our interfaces
-    net_device_t* dev = buffer->device;
-    if (memcmp(&dev->ip, &dest_ip, sizeof(ipv4_address_t)) == 0) {
-        is_for_us = 1;
-    }
-    
-    // Check for broadcast/multicast
-    if (!is_for_us) {
-        // Check for limited broadcast (255.255.255.255)
-        if (dest_ip.addr[0] == 255 && dest_ip.addr[1] == 255 &&
-            dest_ip.addr[2] == 255 && dest_ip.addr[3] == 255) {
-            is_for_us = 1;
-        }
-        
-        // Check for subnet broadcast
-        uint32_t ip_addr = (dest_ip.addr[0] << 24) | (dest_ip.addr[1] << 16) | 
-                           (dest_ip.addr[2] << 8) | dest_ip.addr[3];
-        uint32_t dev_ip = (dev->ip.addr[0] << 24) | (dev->ip.addr[1] << 16) |
-                          (dev->ip.addr[2] << 8) | dev->ip.addr[3];
-        uint32_t netmask = (dev->netmask.addr[0] << 24) | (dev->netmask.addr[1] << 16) |
-                           (dev->netmask.addr[2] << 8) | dev->netmask.addr[3];
-        uint32_t subnet = dev_ip & netmask;
-        uint32_t broadcast = subnet | (~netmask);
-        
-        if (ip_addr == broadcast) {
-            is_for_us = 1;
-        }
-    }
-    
-    // If not for us, drop the packet (we don't do routing yet)
-    if (!is_for_us) {
-        log_debug("IP: Packet not for us, dropping");
-        return NET_ERR_OK;
-    }
-    
-    // Skip the IP header
-    net_buffer_pull(buffer, ihl * 4);
-    
-    // Process based on the protocol
-    switch (header->protocol) {
-        case 1:  // ICMP
-            // Pass to ICMP handler
-            buffer->protocol = NET_PROTO_ICMP;
-            // icmp_receive(buffer);
-            break;
-        case 6:  // TCP
-            // Pass to TCP handler
-            buffer->protocol = NET_PROTO_TCP;
-            // tcp_receive(buffer);
-            break;
-        case 17: // UDP
-            // Pass to UDP handler
-            buffer->protocol = NET_PROTO_UDP;
-            // udp_receive(buffer);
-            break;
-        default:
-            log_debug("IP: Unsupported protocol: %d", header->protocol);
-            break;
-    }
-    
-    return NET_ERR_OK;
+    return ip_rx(buffer);
 }
 
 /**
@@ -358,37 +255,37 @@ int ip_receive(net_buffer_t* buffer) {
  */
 int ip_tx(net_device_t* dev, net_buffer_t* buffer, const ip_addr_t* dest_addr, uint8_t protocol) {
     if (dev == NULL || buffer == NULL || dest_addr == NULL) {
-        log_error("Invalid parameters for ip_tx");
+        log_error("NET", "Invalid parameters for ip_tx");
         return -1;
     }
     
     // Reserve space for the IP header
-    void* header = netbuf_push(buffer, IP_HEADER_MIN_SIZE);
+    void* header = net_buffer_push(buffer, IP_HEADER_MIN_SIZE);
     if (header == NULL) {
-        log_error("Failed to prepend IP header");
+        log_error("NET", "Failed to prepend IP header");
         return -1;
     }
     
     // Fill in the IP header
     ip_header_t* ip_hdr = (ip_header_t*)header;
-    ip_hdr->version_and_ihl = (4 << 4) | 5; // IPv4, header length 5 * 4 bytes
-    ip_hdr->type_of_service = 0;
-    ip_hdr->total_length = htons(buffer->len);
-    ip_hdr->identification = 0; // Not used for now
-    ip_hdr->flags_and_fragment_offset = htons(IP_FLAG_DONT_FRAGMENT << 13);
+    ip_hdr->ver_ihl = (4 << 4) | 5; // IPv4, header length 5 * 4 bytes
+    ip_hdr->tos = 0;
+    ip_hdr->length = htons(buffer->len);
+    ip_hdr->id = 0; // Not used for now
+    ip_hdr->flags_offset = htons(IP_FLAG_DONT_FRAGMENT << 13);
     ip_hdr->ttl = 64;
     ip_hdr->protocol = protocol;
     ip_hdr->checksum = 0; // Will be filled in later
     
     // Set source and destination addresses
     memcpy(&ip_hdr->src_addr, &local_ip, sizeof(ip_addr_t));
-    memcpy(&ip_hdr->dest_addr, dest_addr, sizeof(ip_addr_t));
+    memcpy(&ip_hdr->dst_addr, dest_addr, sizeof(ip_addr_t));
     
     // Calculate the checksum
-    ip_hdr->checksum = ip_checksum(ip_hdr, IP_HEADER_MIN_SIZE);
+    ip_hdr->checksum = ip_checksum(ip_hdr);
     
     char src_str[16], dest_str[16];
-    log_debug("Sending IP packet from %s to %s, protocol %u, length %u",
+    log_debug("NET", "Sending IP packet from %s to %s, protocol %u, length %u",
               ip_addr_to_str(&local_ip, src_str),
               ip_addr_to_str(dest_addr, dest_str),
               protocol, buffer->len);
@@ -402,7 +299,7 @@ int ip_tx(net_device_t* dev, net_buffer_t* buffer, const ip_addr_t* dest_addr, u
         // Otherwise, send to the default gateway
         memcpy(&next_hop, &default_gateway, sizeof(ip_addr_t));
         if (ip_is_zero_address(&next_hop)) {
-            log_error("No route to host");
+            log_error("NET", "No route to host");
             return -1;
         }
     }
@@ -411,12 +308,12 @@ int ip_tx(net_device_t* dev, net_buffer_t* buffer, const ip_addr_t* dest_addr, u
     mac_address_t next_hop_mac;
     // For this simple implementation, we'll use a dummy MAC address
     // In a real implementation, this would involve ARP
-    next_hop_mac.bytes[0] = 0x12;
-    next_hop_mac.bytes[1] = 0x34;
-    next_hop_mac.bytes[2] = 0x56;
-    next_hop_mac.bytes[3] = 0x78;
-    next_hop_mac.bytes[4] = 0x9A;
-    next_hop_mac.bytes[5] = 0xBC;
+    next_hop_mac.addr[0] = 0x12;
+    next_hop_mac.addr[1] = 0x34;
+    next_hop_mac.addr[2] = 0x56;
+    next_hop_mac.addr[3] = 0x78;
+    next_hop_mac.addr[4] = 0x9A;
+    next_hop_mac.addr[5] = 0xBC;
     
     // Send the Ethernet frame
     return ethernet_tx(dev, buffer, &next_hop_mac, ETH_TYPE_IP);
@@ -433,19 +330,19 @@ int ip_send(net_buffer_t* buffer, const ipv4_address_t* dest_ip, uint8_t protoco
     // Make room for the IP header
     ip_header_t* header = (ip_header_t*)net_buffer_push(buffer, sizeof(ip_header_t));
     if (!header) {
-        log_error("IP: Failed to add IP header to packet");
+        log_error("NET", "IP: Failed to add IP header to packet");
         return NET_ERR_NOMEM;
     }
     
     // Set up the header
-    header->version_ihl = 0x45;  // IPv4, 5 DWORDS (standard IP header)
-    header->type_of_service = 0;
-    header->total_length = buffer->len;
-    header->identification = ip_state.next_id++;
-    header->flags_fragment_offset = 0x4000;  // Don't fragment
+    header->ver_ihl = 0x45;  // IPv4, 5 DWORDS (standard IP header)
+    header->tos = 0;
+    header->length = htons(buffer->len);
+    header->id = htons(ip_state.next_id++);
+    header->flags_offset = htons(0x4000);  // Don't fragment
     header->ttl = 64;  // TTL
     header->protocol = protocol;
-    header->header_checksum = 0;
+    header->checksum = 0;
     
     // Find the best network device to use
     net_device_t* dev = NULL;
@@ -482,26 +379,20 @@ int ip_send(net_buffer_t* buffer, const ipv4_address_t* dest_ip, uint8_t protoco
     }
     
     if (!dev) {
-        log_error("IP: No suitable interface found for sending packet");
+        log_error("NET", "IP: No suitable interface found for sending packet");
         return NET_ERR_INVALID;
     }
     
     buffer->device = dev;
     
     // Set source IP address from the device
-    memcpy(header->source_ip, dev->ip.addr, 4);
+    header->src_addr = dev->ip;
     
     // Set destination IP address
-    memcpy(header->dest_ip, dest_ip->addr, 4);
-    
-    // Convert endianness for multi-byte fields
-    header->total_length = (header->total_length << 8) | (header->total_length >> 8);
-    header->identification = (header->identification << 8) | (header->identification >> 8);
-    header->flags_fragment_offset = (header->flags_fragment_offset << 8) | (header->flags_fragment_offset >> 8);
+    header->dst_addr = *dest_ip;
     
     // Calculate checksum
-    header->header_checksum = ip_checksum(header, sizeof(ip_header_t));
-    header->header_checksum = (header->header_checksum << 8) | (header->header_checksum >> 8);
+    header->checksum = ip_checksum(header);
     
     // Send the packet on the appropriate network interface
     // This will depend on the device type - for Ethernet, we need to add an Ethernet header
@@ -519,7 +410,7 @@ int ip_send(net_buffer_t* buffer, const ipv4_address_t* dest_ip, uint8_t protoco
     // For now, just log that we would send it
     char ip_str[16];
     ipv4_to_str(dest_ip, ip_str);
-    log_info("IP: Would send packet to %s via %s (protocol %d, %d bytes)",
+    log_info("NET", "IP: Would send packet to %s via %s (protocol %d, %d bytes)",
              ip_str, dev->name, protocol, buffer->len);
     
     return NET_ERR_OK;
@@ -529,19 +420,8 @@ int ip_send(net_buffer_t* buffer, const ipv4_address_t* dest_ip, uint8_t protoco
  * Create a new IP packet with space for payload
  */
 net_buffer_t* ip_alloc_packet(size_t payload_size) {
-    // Calculate the total size required for the IP packet
-    size_t total_size = IP_HEADER_MIN_SIZE + payload_size;
-    
-    // Allocate an Ethernet frame with space for the IP packet
-    net_buffer_t* buffer = ethernet_alloc_frame(total_size);
-    if (buffer == NULL) {
-        return NULL;
-    }
-    
-    // Reserve space for the IP header
-    netbuf_reserve(buffer, IP_HEADER_MIN_SIZE);
-    
-    return buffer;
+    // The IP and Ethernet headers go into the buffer's fixed headroom
+    return ethernet_alloc_frame(payload_size);
 }
 
 /**
@@ -712,7 +592,7 @@ void ip_configure(const ip_addr_t* ip, const ip_addr_t* mask, const ip_addr_t* g
     }
     
     char ip_str[16], mask_str[16], gateway_str[16];
-    log_info("IP configured: address %s, mask %s, gateway %s",
+    log_info("NET", "IP configured: address %s, mask %s, gateway %s",
              ip_addr_to_str(&local_ip, ip_str),
              ip_addr_to_str(&subnet_mask, mask_str),
              ip_addr_to_str(&default_gateway, gateway_str));
@@ -769,7 +649,7 @@ int ip_set_address(const char* interface, const ipv4_address_t* addr) {
     
     char ip_str[16];
     ipv4_to_str(addr, ip_str);
-    log_info("IP: Set address of %s to %s", interface, ip_str);
+    log_info("NET", "IP: Set address of %s to %s", interface, ip_str);
     
     return NET_ERR_OK;
 }
@@ -791,7 +671,7 @@ int ip_set_netmask(const char* interface, const ipv4_address_t* netmask) {
     
     char mask_str[16];
     ipv4_to_str(netmask, mask_str);
-    log_info("IP: Set netmask of %s to %s", interface, mask_str);
+    log_info("NET", "IP: Set netmask of %s to %s", interface, mask_str);
     
     return NET_ERR_OK;
 }
@@ -813,7 +693,7 @@ int ip_set_gateway(const char* interface, const ipv4_address_t* gateway) {
     
     char gw_str[16];
     ipv4_to_str(gateway, gw_str);
-    log_info("IP: Set gateway of %s to %s", interface, gw_str);
+    log_info("NET", "IP: Set gateway of %s to %s", interface, gw_str);
     
     return NET_ERR_OK;
 }
\ No newline at end of file
@@ -15,6 +15,10 @@
 // Array of TCP sockets
 static tcp_socket_t tcp_sockets[TCP_MAX_SOCKETS];
 
+// Protects slot allocation, connection lookup and port selection. Taken
+// before any socket lock; a socket lock holder never waits for it.
+static spinlock_t tcp_table_lock;
+
 // Dynamic port allocation starts from this number
 #define TCP_DYNAMIC_PORT_START 49152
 #define TCP_DYNAMIC_PORT_END   65535
@@ -33,128 +37,279 @@ static uint32_t tcp_initial_seq = 0;
 #define TCP_MAX_RETRANSMITS 5           // Maximum retransmission attempts
 
 #define TCP_DEFAULT_BUFFER_SIZE 8192  // Default buffer size (8KB)
+#define TCP_MAX_BUFFER_SIZE 65536     // Autotuning limit (no window scaling, so 64KB)
+#define TCP_AUTOTUNE_RTT 100          // Autotuning period before an RTT is measured (ms)
+#define TCP_DELACK_TIMEOUT 40         // Longest an ACK is held back (ms)
+
+// Disable local interrupts, returning the previous EFLAGS
+static inline uint32_t tcp_irq_save(void) {
+    uint32_t eflags;
+    asm volatile("pushf\n\tpop %0\n\tcli" : "=r"(eflags) : : "memory");
+    return eflags;
+}
+
+// Restore local interrupts from a saved EFLAGS value
+static inline void tcp_irq_restore(uint32_t eflags) {
+    if (eflags & 0x200) {
+        asm volatile("sti" : : : "memory");
+    }
+}
+
+/**
+ * Lock a socket, returning the EFLAGS to hand to tcp_unlock()
+ */
+static uint32_t tcp_lock(tcp_socket_t* socket) {
+    uint32_t eflags = tcp_irq_save();
+    spinlock_acquire(&socket->lock);
+    return eflags;
+}
+
+/**
+ * Unlock a socket, then deliver the callbacks owed to the application
+ *
+ * Callbacks run unlocked so they can use the socket API themselves.
+ */
+static void tcp_unlock(tcp_socket_t* socket, uint32_t eflags) {
+    uint8_t notify = socket->notify;
+    uint32_t data_len = socket->notify_data;
+    uint32_t sent_len = socket->notify_sent;
+    void (*connected_callback)(tcp_socket_t*) = socket->connected_callback;
+    void (*data_ready_callback)(tcp_socket_t*, size_t) = socket->data_ready_callback;
+    void (*sent_callback)(tcp_socket_t*, size_t) = socket->sent_callback;
+    void (*closed_callback)(tcp_socket_t*) = socket->closed_callback;
+    
+    socket->notify = 0;
+    socket->notify_data = 0;
+    socket->notify_sent = 0;
+    
+    spinlock_release(&socket->lock);
+    tcp_irq_restore(eflags);
+    
+    if ((notify & TCP_NOTIFY_CONNECTED) && connected_callback) {
+        connected_callback(socket);
+    }
+    if ((notify & TCP_NOTIFY_SENT) && sent_callback) {
+        sent_callback(socket, sent_len);
+    }
+    if ((notify & TCP_NOTIFY_DATA) && data_ready_callback) {
+        data_ready_callback(socket, data_len);
+    }
+    if ((notify & TCP_NOTIFY_CLOSED) && closed_callback) {
+        closed_callback(socket);
+    }
+}
 
-// Structure for TCP receive buffer
-typedef struct {
-    uint8_t* data;           // Buffer data
-    uint32_t size;           // Total buffer size
-    uint32_t start;          // Start position for reading
-    uint32_t end;            // End position for writing
-    uint32_t bytes_available; // Number of bytes available to read
-} tcp_buffer_t;
+/**
+ * Owe the application a callback (socket lock held)
+ */
+static void tcp_notify(tcp_socket_t* socket, uint8_t what, uint32_t len) {
+    socket->notify |= what;
+    if (what & TCP_NOTIFY_DATA) {
+        socket->notify_data += len;
+    }
+    if (what & TCP_NOTIFY_SENT) {
+        socket->notify_sent += len;
+    }
+}
 
-// Initialize a TCP receive buffer
-static int tcp_buffer_init(tcp_socket_t* socket, uint32_t size) {
-    if (!socket) return -1;
+// Initialize a TCP circular buffer
+static int tcp_buffer_init(tcp_buffer_t* buf, uint32_t size) {
+    if (!buf) return -1;
     
     // Allocate buffer memory
-    socket->rx_buffer.data = malloc(size);
-    if (!socket->rx_buffer.data) {
-        log_error("NET", "Failed to allocate TCP receive buffer");
+    buf->data = malloc(size);
+    if (!buf->data) {
+        log_error("NET", "Failed to allocate TCP socket buffer");
         return -1;
     }
     
     // Initialize buffer state
-    socket->rx_buffer.size = size;
-    socket->rx_buffer.start = 0;
-    socket->rx_buffer.end = 0;
-    socket->rx_buffer.bytes_available = 0;
+    buf->size = size;
+    buf->start = 0;
+    buf->end = 0;
+    buf->bytes_available = 0;
     
     return 0;
 }
 
-// Write data to the TCP receive buffer
-static int tcp_buffer_write(tcp_socket_t* socket, const uint8_t* data, uint32_t len) {
-    if (!socket || !socket->rx_buffer.data || !data) return -1;
+// Copy data into the buffer starting offset bytes past its end, in at most two spans
+static void tcp_buffer_copy_in(tcp_buffer_t* buf, uint32_t offset, const uint8_t* data, uint32_t len) {
+    uint32_t pos = (buf->end + offset) % buf->size;
+    uint32_t first = buf->size - pos;
+    if (first > len) {
+        first = len;
+    }
     
-    // Check if there's enough space
-    if (socket->rx_buffer.bytes_available + len > socket->rx_buffer.size) {
-        log_warning("NET", "TCP receive buffer overflow, dropping data");
-        return -1;
+    memcpy(buf->data + pos, data, first);
+    memcpy(buf->data, data + first, len - first);
+}
+
+// Copy data out from the start of the buffer, in at most two spans
+static void tcp_buffer_copy_out(const tcp_buffer_t* buf, uint8_t* data, uint32_t len) {
+    uint32_t first = buf->size - buf->start;
+    if (first > len) {
+        first = len;
     }
     
-    // Copy data to buffer, handling wrap-around
-    for (uint32_t i = 0; i < len; i++) {
-        socket->rx_buffer.data[socket->rx_buffer.end] = data[i];
-        socket->rx_buffer.end = (socket->rx_buffer.end + 1) % socket->rx_buffer.size;
+    memcpy(data, buf->data + buf->start, first);
+    memcpy(data + first, buf->data, len - first);
+}
+
+// Write data to a TCP circular buffer
+static int tcp_buffer_write(tcp_buffer_t* buf, const uint8_t* data, uint32_t len) {
+    if (!buf || !buf->data || !data) return -1;
+    
+    // Check if there's enough space
+    if (buf->bytes_available + len > buf->size) {
+        log_warning("NET", "TCP socket buffer overflow, dropping data");
+        return -1;
     }
     
-    // Update available bytes count
-    socket->rx_buffer.bytes_available += len;
+    tcp_buffer_copy_in(buf, 0, data, len);
+    buf->end = (buf->end + len) % buf->size;
+    buf->bytes_available += len;
     
     return len;
 }
 
-// Read data from the TCP receive buffer
-static int tcp_buffer_read(tcp_socket_t* socket, uint8_t* data, uint32_t len) {
-    if (!socket || !socket->rx_buffer.data || !data) return -1;
+// Store data past the end of a TCP circular buffer without making it readable yet
+static void tcp_buffer_store(tcp_buffer_t* buf, uint32_t offset, const uint8_t* data, uint32_t len) {
+    tcp_buffer_copy_in(buf, offset, data, len);
+}
+
+// Make len bytes stored past the end readable
+static void tcp_buffer_commit(tcp_buffer_t* buf, uint32_t len) {
+    buf->end = (buf->end + len) % buf->size;
+    buf->bytes_available += len;
+}
+
+// Read data from a TCP circular buffer
+static int tcp_buffer_read(tcp_buffer_t* buf, uint8_t* data, uint32_t len) {
+    if (!buf || !buf->data || !data) return -1;
     
     // Determine how much data we can actually read
     uint32_t read_len = len;
-    if (read_len > socket->rx_buffer.bytes_available) {
-        read_len = socket->rx_buffer.bytes_available;
+    if (read_len > buf->bytes_available) {
+        read_len = buf->bytes_available;
     }
     
     // No data available
     if (read_len == 0) return 0;
     
-    // Copy data from buffer, handling wrap-around
-    for (uint32_t i = 0; i < read_len; i++) {
-        data[i] = socket->rx_buffer.data[socket->rx_buffer.start];
-        socket->rx_buffer.start = (socket->rx_buffer.start + 1) % socket->rx_buffer.size;
-    }
-    
-    // Update available bytes count
-    socket->rx_buffer.bytes_available -= read_len;
+    tcp_buffer_copy_out(buf, data, read_len);
+    buf->start = (buf->start + read_len) % buf->size;
+    buf->bytes_available -= read_len;
     
     return read_len;
 }
 
 // Peek at data in the buffer without removing it
-static int tcp_buffer_peek(tcp_socket_t* socket, uint8_t* data, uint32_t len) {
-    if (!socket || !socket->rx_buffer.data || !data) return -1;
+static int tcp_buffer_peek(tcp_buffer_t* buf, uint8_t* data, uint32_t len) {
+    if (!buf || !buf->data || !data) return -1;
     
     // Determine how much data we can actually read
     uint32_t read_len = len;
-    if (read_len > socket->rx_buffer.bytes_available) {
-        read_len = socket->rx_buffer.bytes_available;
+    if (read_len > buf->bytes_available) {
+        read_len = buf->bytes_available;
     }
     
     // No data available
     if (read_len == 0) return 0;
     
-    // Copy data from buffer without updating pointers
-    uint32_t pos = socket->rx_buffer.start;
-    for (uint32_t i = 0; i < read_len; i++) {
-        data[i] = socket->rx_buffer.data[pos];
-        pos = (pos + 1) % socket->rx_buffer.size;
-    }
+    tcp_buffer_copy_out(buf, data, read_len);
     
     return read_len;
 }
 
-// Free the TCP receive buffer
-static void tcp_buffer_free(tcp_socket_t* socket) {
-    if (!socket || !socket->rx_buffer.data) return;
+// Move a TCP circular buffer to a larger allocation, keeping its contents
+// and the extra bytes stored past its end
+static int tcp_buffer_grow(tcp_buffer_t* buf, uint32_t size, uint32_t extra) {
+    uint8_t* data = malloc(size);
+    if (!data) {
+        return -1;
+    }
     
-    free(socket->rx_buffer.data);
-    socket->rx_buffer.data = NULL;
-    socket->rx_buffer.size = 0;
-    socket->rx_buffer.start = 0;
-    socket->rx_buffer.end = 0;
-    socket->rx_buffer.bytes_available = 0;
+    tcp_buffer_copy_out(buf, data, buf->bytes_available + extra);
+    
+    free(buf->data);
+    buf->data = data;
+    buf->size = size;
+    buf->start = 0;
+    buf->end = buf->bytes_available;
+    
+    return 0;
+}
+
+// Free a TCP circular buffer
+static void tcp_buffer_free(tcp_buffer_t* buf) {
+    if (!buf || !buf->data) return;
+    
+    free(buf->data);
+    buf->data = NULL;
+    buf->size = 0;
+    buf->start = 0;
+    buf->end = 0;
+    buf->bytes_available = 0;
+}
+
+static void tcp_retransmit_expired(ktimer_t* timer, void* data);
+static void tcp_time_wait_expired(ktimer_t* timer, void* data);
+static void tcp_delack_expired(ktimer_t* timer, void* data);
+static void tcp_socket_work(net_work_t* work);
+static void tcp_delack_timeout(tcp_socket_t* socket);
+
+/**
+ * Bind a socket's timers to their callbacks
+ */
+static void tcp_init_timers(tcp_socket_t* socket) {
+    ktimer_init(&socket->retransmit_timer, tcp_retransmit_expired, socket);
+    ktimer_init(&socket->time_wait_timer, tcp_time_wait_expired, socket);
+    ktimer_init(&socket->delack_timer, tcp_delack_expired, socket);
 }
 
-// Structure to track TIME_WAIT state
-typedef struct {
-    uint32_t start_time;     // When the timer started
-    uint32_t duration;       // How long to stay in TIME_WAIT (2*MSL)
-    tcp_socket_t* socket;    // The socket that is in TIME_WAIT
-} tcp_time_wait_t;
+/**
+ * Disarm a socket's timers (before it is closed or reused)
+ */
+static void tcp_stop_timers(tcp_socket_t* socket) {
+    ktimer_cancel(&socket->retransmit_timer);
+    ktimer_cancel(&socket->time_wait_timer);
+    ktimer_cancel(&socket->delack_timer);
+}
 
-// Array of TIME_WAIT timers
-#define TCP_MAX_TIME_WAIT_SOCKETS 32
-static tcp_time_wait_t time_wait_sockets[TCP_MAX_TIME_WAIT_SOCKETS];
+/**
+ * Free the send buffer and every unacknowledged segment (before the socket
+ * is closed or reused)
+ */
+static void tcp_drop_send_state(tcp_socket_t* socket) {
+    net_buffer_t* segment = socket->conn.retransmit_queue;
+    while (segment) {
+        net_buffer_t* next = segment->next;
+        segment->next = NULL;
+        net_buffer_free(segment);
+        segment = next;
+    }
+    socket->conn.retransmit_queue = NULL;
+    socket->conn.retransmit_tail = NULL;
+    socket->conn.retransmit.rtt_timing = 0;
+    
+    tcp_buffer_free(&socket->tx_buffer);
+    socket->fin_pending = 0;
+}
+
+/**
+ * Return a slot to its initial state for a new socket (socket lock held)
+ *
+ * The lock and the work item survive; a timer event still waiting for the
+ * old connection is dropped.
+ */
+static void tcp_socket_reset(tcp_socket_t* socket) {
+    tcp_stop_timers(socket);
+    tcp_drop_send_state(socket);
+    tcp_buffer_free(&socket->rx_buffer);
+    socket->events = 0;
+    memset(&socket->state, 0, sizeof(tcp_socket_t) - offsetof(tcp_socket_t, state));
+    tcp_init_timers(socket);
+}
 
 /**
  * Initialize the TCP protocol handler
@@ -162,14 +317,17 @@ static tcp_time_wait_t time_wait_sockets[TCP_MAX_TIME_WAIT_SOCKETS];
 int tcp_init() {
     log_info("NET", "Initializing TCP protocol handler");
     
+    spinlock_init(&tcp_table_lock);
+    
     // Initialize socket array
     for (int i = 0; i < TCP_MAX_SOCKETS; i++) {
+        spinlock_init(&tcp_sockets[i].lock);
+        net_work_init(&tcp_sockets[i].work, tcp_socket_work);
+        tcp_sockets[i].events = 0;
         tcp_sockets[i].state = TCP_STATE_CLOSED;
+        tcp_init_timers(&tcp_sockets[i]);
     }
     
-    // Initialize the TIME_WAIT tracker
-    tcp_init_time_wait();
-    
     // Register TCP as a protocol handler with IP
     int result = ip_register_protocol(IP_PROTO_TCP, tcp_rx);
     if (result != 0) {
@@ -187,46 +345,232 @@ int tcp_init() {
 }
 
 /**
- * Initialize the TIME_WAIT tracker
+ * Start the TIME_WAIT timer for a socket
  */
-static void tcp_init_time_wait() {
-    for (int i = 0; i < TCP_MAX_TIME_WAIT_SOCKETS; i++) {
-        time_wait_sockets[i].socket = NULL;
+static void tcp_start_time_wait(tcp_socket_t* socket) {
+    if (socket == NULL) {
+        return;
     }
+    
+    // Nothing is left to retransmit; hold the connection for 2*MSL as required by TCP spec
+    ktimer_cancel(&socket->retransmit_timer);
+    ktimer_arm(&socket->time_wait_timer, 2 * TCP_MSL);
+    
+    char addr_str[16];
+    ipv4_to_str(&socket->remote_addr, addr_str);
+    log_info("NET", "TCP connection to %s:%u entered TIME_WAIT state", 
+             addr_str, socket->remote_port);
 }
 
 /**
- * Start a TIME_WAIT timer for a socket
+ * Record a timer event and have the network thread handle it
  */
-static void tcp_start_time_wait(tcp_socket_t* socket) {
-    if (socket == NULL) {
+static void tcp_raise_event(tcp_socket_t* socket, uint8_t event) {
+    __sync_fetch_and_or(&socket->events, event);
+    net_work_schedule(&socket->work);
+}
+
+/**
+ * TIME_WAIT timer callback (interrupt context): defer to the network thread
+ */
+static void tcp_time_wait_expired(ktimer_t* timer, void* data) {
+    (void)timer;
+    tcp_raise_event((tcp_socket_t*)data, TCP_EVENT_TIME_WAIT);
+}
+
+/**
+ * TIME_WAIT is over: release the socket
+ */
+static void tcp_time_wait_timeout(tcp_socket_t* socket) {
+    // Re-armed since the event was raised
+    if (socket->state != TCP_STATE_TIME_WAIT || ktimer_pending(&socket->time_wait_timer)) {
         return;
     }
     
-    // Find an empty slot
-    int slot = -1;
-    for (int i = 0; i < TCP_MAX_TIME_WAIT_SOCKETS; i++) {
-        if (time_wait_sockets[i].socket == NULL) {
-            slot = i;
-            break;
+    char addr_str[16];
+    ipv4_to_str(&socket->remote_addr, addr_str);
+    log_info("NET", "TCP TIME_WAIT expired for connection to %s:%u",
+             addr_str, socket->remote_port);
+    
+    // Close the socket
+    tcp_drop_send_state(socket);
+    socket->state = TCP_STATE_CLOSED;
+}
+
+static int tcp_transmit(tcp_socket_t* socket, net_buffer_t* segment);
+static int tcp_output_segment(tcp_socket_t* socket, uint32_t len);
+
+/**
+ * Sequence space a queued segment occupies (payload plus SYN and FIN)
+ */
+static uint32_t tcp_segment_seq_len(const net_buffer_t* segment) {
+    const tcp_header_t* tcp = (const tcp_header_t*)segment->data;
+    uint32_t len = segment->len - TCP_HEADER_SIZE;
+    
+    if (tcp->flags & TCP_FLAG_SYN) len++;
+    if (tcp->flags & TCP_FLAG_FIN) len++;
+    
+    return len;
+}
+
+/**
+ * Retransmission timer callback (interrupt context): defer to the network thread
+ */
+static void tcp_retransmit_expired(ktimer_t* timer, void* data) {
+    (void)timer;
+    tcp_raise_event((tcp_socket_t*)data, TCP_EVENT_RETRANSMIT);
+}
+
+/**
+ * Retransmission timeout: resend the oldest unacknowledged segment with
+ * exponential backoff, probe a closed peer window, or give up
+ */
+static void tcp_retransmit_timeout(tcp_socket_t* socket) {
+    tcp_connection_t* conn = &socket->conn;
+    
+    // An ACK re-armed (or the socket closed) since the event was raised
+    if (socket->state == TCP_STATE_CLOSED || ktimer_pending(&socket->retransmit_timer)) {
+        return;
+    }
+    
+    net_buffer_t* segment = conn->retransmit_queue;
+    if (segment == NULL) {
+        // Nothing in flight but data is waiting: the peer's window is
+        // closed, so push one byte past it to learn when it reopens
+        if (socket->tx_buffer.bytes_available > 0) {
+            tcp_output_segment(socket, 1);
         }
+        return;
+    }
+    
+    // Window probes go on for as long as the peer keeps its window closed
+    if (conn->snd_wnd != 0) {
+        conn->retransmit.attempts++;
+    }
+    
+    conn->retransmit.rto *= 2; // Exponential backoff
+    if (conn->retransmit.rto > TCP_RTO_MAX) {
+        conn->retransmit.rto = TCP_RTO_MAX;
     }
     
-    if (slot == -1) {
-        log_warning("NET", "No free TIME_WAIT slots, closing socket immediately");
+    if (conn->retransmit.attempts > TCP_MAX_RETRANSMITS) {
+        log_warning("NET", "TCP connection timed out after %d attempts",
+                  conn->retransmit.attempts);
+        
+        // Reset the connection
+        tcp_stop_timers(socket);
+        tcp_drop_send_state(socket);
         socket->state = TCP_STATE_CLOSED;
+        
+        // Notify the application
+        tcp_notify(socket, TCP_NOTIFY_CLOSED, 0);
         return;
     }
     
-    // Setup the TIME_WAIT timer
-    time_wait_sockets[slot].socket = socket;
-    time_wait_sockets[slot].start_time = network_get_time_ms();
-    time_wait_sockets[slot].duration = 2 * TCP_MSL; // 2*MSL as required by TCP spec
+    // The ACK for a retransmitted segment is ambiguous, so it is never timed (Karn)
+    conn->retransmit.rtt_timing = 0;
+    tcp_cong_rto(conn);
     
-    char addr_str[16];
-    ipv4_to_str(&socket->remote_addr, addr_str);
-    log_info("NET", "TCP connection to %s:%u entered TIME_WAIT state", 
-             addr_str, socket->remote_port);
+    log_debug("NET", "TCP retransmitting seq %u (attempt %d/%d, rto %u ms)",
+            ntohl(((tcp_header_t*)segment->data)->seq_num),
+            conn->retransmit.attempts, TCP_MAX_RETRANSMITS, conn->retransmit.rto);
+    
+    tcp_transmit(socket, segment);
+    ktimer_arm(&socket->retransmit_timer, conn->retransmit.rto);
+}
+
+/**
+ * Work item of a socket: handle the timer events raised since it last ran
+ */
+static void tcp_socket_work(net_work_t* work) {
+    tcp_socket_t* socket = (tcp_socket_t*)((uint8_t*)work - offsetof(tcp_socket_t, work));
+    uint32_t eflags = tcp_lock(socket);
+    
+    uint8_t events = __sync_fetch_and_and(&socket->events, 0);
+    if (events & TCP_EVENT_RETRANSMIT) {
+        tcp_retransmit_timeout(socket);
+    }
+    if (events & TCP_EVENT_TIME_WAIT) {
+        tcp_time_wait_timeout(socket);
+    }
+    if (events & TCP_EVENT_DELACK) {
+        tcp_delack_timeout(socket);
+    }
+    
+    tcp_unlock(socket, eflags);
+}
+
+/**
+ * Fold a round-trip sample into SRTT and RTTVAR and recompute the RTO (RFC 6298)
+ */
+void tcp_rtt_update(tcp_retransmit_t* rt, uint32_t rtt) {
+    if (rt->srtt == 0) {
+        // First measurement
+        rt->srtt = rtt;
+        rt->rttvar = rtt / 2;
+    } else {
+        uint32_t delta = rt->srtt > rtt ? rt->srtt - rtt : rtt - rt->srtt;
+        rt->rttvar = (3 * rt->rttvar + delta) / 4;
+        rt->srtt = (7 * rt->srtt + rtt) / 8;
+    }
+    
+    // srtt == 0 means "no sample yet", so sub-millisecond paths round up
+    if (rt->srtt == 0) {
+        rt->srtt = 1;
+    }
+    
+    uint32_t rto = rt->srtt + 4 * rt->rttvar;
+    if (rto < TCP_RTO_MIN) rto = TCP_RTO_MIN;
+    if (rto > TCP_RTO_MAX) rto = TCP_RTO_MAX;
+    rt->rto = rto;
+}
+
+/**
+ * Release acknowledged segments, take an RTT sample and update the
+ * retransmission timer after snd_una advanced
+ */
+static void tcp_ack_advanced(tcp_socket_t* socket) {
+    tcp_connection_t* conn = &socket->conn;
+    uint32_t acked_data = 0;
+    
+    // Free every segment that is now acknowledged in full
+    while (conn->retransmit_queue) {
+        net_buffer_t* segment = conn->retransmit_queue;
+        uint32_t seq = ntohl(((tcp_header_t*)segment->data)->seq_num);
+        
+        if (TCP_SEQ_GT(seq + tcp_segment_seq_len(segment), conn->snd_una)) {
+            break;
+        }
+        
+        acked_data += segment->len - TCP_HEADER_SIZE;
+        conn->retransmit_queue = segment->next;
+        segment->next = NULL;
+        net_buffer_free(segment);
+    }
+    if (conn->retransmit_queue == NULL) {
+        conn->retransmit_tail = NULL;
+    }
+    
+    // The timed segment made it: new RTO from the measured round trip.
+    // Until then a backed-off RTO stays in force (Karn).
+    if (conn->retransmit.rtt_timing && TCP_SEQ_LEQ(conn->retransmit.rtt_seq, conn->snd_una)) {
+        conn->retransmit.rtt_timing = 0;
+        tcp_rtt_update(&conn->retransmit, (uint32_t)(ktimer_now_ms() - conn->retransmit.rtt_start));
+    }
+    
+    conn->retransmit.attempts = 0;
+    
+    if (conn->snd_una == conn->snd_nxt) {
+        // Everything is acknowledged
+        ktimer_cancel(&socket->retransmit_timer);
+    } else {
+        // Progress was made: restart the timer for the remaining data
+        ktimer_arm(&socket->retransmit_timer, conn->retransmit.rto);
+    }
+    
+    if (acked_data > 0) {
+        tcp_notify(socket, TCP_NOTIFY_SENT, acked_data);
+    }
 }
 
 /**
@@ -289,6 +633,8 @@ uint16_t tcp_checksum(const tcp_header_t* header, const void* data, size_t data_
  */
 static tcp_socket_t* tcp_find_socket(uint16_t local_port, const ipv4_address_t* local_addr,
                                    uint16_t remote_port, const ipv4_address_t* remote_addr) {
+    tcp_socket_t* listener = NULL;
+    
     for (int i = 0; i < TCP_MAX_SOCKETS; i++) {
         tcp_socket_t* socket = &tcp_sockets[i];
         
@@ -306,8 +652,10 @@ static tcp_socket_t* tcp_find_socket(uint16_t local_port, const ipv4_address_t*
             return socket;
         }
         
-        // Check for listening socket that matches local port
-        if (socket->state == TCP_STATE_LISTEN &&
+        // Remember a listening socket on the port, but keep looking: the
+        // connections it spawned may sit in later slots
+        if (listener == NULL &&
+            socket->state == TCP_STATE_LISTEN &&
             socket->local_port == local_port) {
             // If the socket is bound to a specific address, it must match
             if (!ip_addr_is_any(&socket->local_addr) &&
@@ -315,93 +663,363 @@ static tcp_socket_t* tcp_find_socket(uint16_t local_port, const ipv4_address_t*
                 continue;
             }
             
-            return socket;
+            listener = socket;
         }
     }
     
-    return NULL;
+    return listener;
 }
 
 /**
- * Send a TCP segment
+ * Allocate a segment and fill in its header; the caller adds the payload
  */
-static int tcp_send_segment(tcp_socket_t* socket, uint8_t flags,
-                          const void* data, size_t data_len) {
-    if (socket == NULL) {
-        log_error("NET", "Cannot send TCP segment on NULL socket");
-        return -1;
+static net_buffer_t* tcp_alloc_segment(tcp_socket_t* socket, uint32_t seq,
+                                     uint8_t flags, size_t data_len) {
+    net_buffer_t* segment = ip_alloc_packet(TCP_HEADER_SIZE + data_len);
+    if (!segment) {
+        log_error("NET", "Failed to allocate TCP segment buffer");
+        return NULL;
+    }
+    
+    tcp_header_t* tcp = (tcp_header_t*)segment->data;
+    tcp->src_port = htons(socket->local_port);
+    tcp->dest_port = htons(socket->remote_port);
+    tcp->seq_num = htonl(seq);
+    tcp->ack_num = 0;
+    
+    // Set data offset (in 32-bit words) and flags
+    tcp->data_offset = (TCP_HEADER_SIZE / 4) << 4;
+    tcp->flags = flags;
+    
+    tcp->window = 0;
+    tcp->checksum = 0;
+    tcp->urgent_ptr = 0;
+    
+    segment->len = TCP_HEADER_SIZE + data_len;
+    return segment;
+}
+
+/**
+ * How far the right edge of the receive window could move past the one
+ * last advertised
+ */
+static uint32_t tcp_rcv_window_growth(tcp_socket_t* socket) {
+    tcp_buffer_t* buf = &socket->rx_buffer;
+    uint32_t edge = socket->conn.rcv_nxt + (buf->size - buf->bytes_available);
+    
+    return TCP_SEQ_GT(edge, socket->rcv_adv) ? edge - socket->rcv_adv : 0;
+}
+
+/**
+ * Window to advertise: the free receive buffer space
+ *
+ * The right edge never moves back, and moves forward only in steps of at
+ * least an MSS or half the buffer, so the peer is not invited to send
+ * tiny segments (receiver-side silly window avoidance, RFC 1122).
+ */
+static uint16_t tcp_rcv_window(tcp_socket_t* socket) {
+    tcp_connection_t* conn = &socket->conn;
+    tcp_buffer_t* buf = &socket->rx_buffer;
+    
+    if (buf->data == NULL) {
+        return 0;
+    }
+    
+    if (TCP_SEQ_LT(socket->rcv_adv, conn->rcv_nxt)) {
+        socket->rcv_adv = conn->rcv_nxt;
+    }
+    
+    uint32_t threshold = buf->size / 2 < conn->mss ? buf->size / 2 : conn->mss;
+    uint32_t growth = tcp_rcv_window_growth(socket);
+    if (growth >= threshold) {
+        socket->rcv_adv += growth;
+    }
+    
+    uint32_t window = socket->rcv_adv - conn->rcv_nxt;
+    conn->rcv_wnd = window > 0xFFFF ? 0xFFFF : window;
+    return conn->rcv_wnd;
+}
+
+/**
+ * Stamp the current ACK and window on a segment and send it
+ *
+ * The segment stays with the caller (queued for retransmission, or to be
+ * freed); IP and Ethernet headers go onto a clone that shares its data.
+ */
+static int tcp_transmit(tcp_socket_t* socket, net_buffer_t* segment) {
+    tcp_header_t* tcp = (tcp_header_t*)segment->data;
+    size_t data_len = segment->len - TCP_HEADER_SIZE;
+    
+    if (tcp->flags & TCP_FLAG_ACK) {
+        tcp->ack_num = htonl(socket->conn.rcv_nxt);
+        
+        // This segment carries any ACK that was being held back
+        socket->ack_pending = 0;
+        ktimer_cancel(&socket->delack_timer);
+        __sync_fetch_and_and(&socket->events, (uint8_t)~TCP_EVENT_DELACK);
     }
+    tcp->window = htons(tcp_rcv_window(socket));
+    
+    tcp->checksum = 0;
+    tcp->checksum = tcp_checksum(tcp, segment->data + TCP_HEADER_SIZE, data_len,
+                               &socket->local_addr, &socket->remote_addr);
     
-    // Log the segment being sent
     char dest_str[16];
     ipv4_to_str(&socket->remote_addr, dest_str);
-    log_debug("NET", "Sending TCP segment to %s:%u, flags=0x%02x, len=%u",
-             dest_str, socket->remote_port, flags, data_len);
+    log_debug("NET", "Sending TCP segment to %s:%u, seq=%u, flags=0x%02x, len=%u",
+             dest_str, socket->remote_port, ntohl(tcp->seq_num), tcp->flags, data_len);
     
-    // Allocate a buffer for the TCP segment
-    size_t tcp_size = TCP_HEADER_SIZE + data_len;
-    net_buffer_t* buffer = ip_alloc_packet(tcp_size);
-    if (!buffer) {
-        log_error("NET", "Failed to allocate TCP segment buffer");
+    net_device_t* dev = network_get_default_device();
+    if (dev == NULL) {
+        log_error("NET", "No default network device");
         return -1;
     }
     
-    // Fill the TCP header
-    tcp_header_t* tcp = (tcp_header_t*)buffer->data;
-    tcp->src_port = htons(socket->local_port);
-    tcp->dest_port = htons(socket->remote_port);
+    net_buffer_t* packet = net_buffer_clone(segment);
+    if (packet == NULL) {
+        log_error("NET", "Failed to clone TCP segment for transmission");
+        return -1;
+    }
     
-    // Set sequence and acknowledgment numbers
-    tcp->seq_num = htonl(socket->conn.snd_nxt);
-    if (flags & TCP_FLAG_ACK) {
-        tcp->ack_num = htonl(socket->conn.rcv_nxt);
+    int result = ip_tx(dev, packet, (const ip_addr_t*)&socket->remote_addr, IP_PROTO_TCP);
+    net_buffer_free(packet);
+    
+    return result;
+}
+
+/**
+ * Put a sent segment on the retransmission queue and advance snd_nxt past it
+ */
+static void tcp_queue_segment(tcp_socket_t* socket, net_buffer_t* segment, uint32_t seq_len) {
+    tcp_connection_t* conn = &socket->conn;
+    
+    segment->next = NULL;
+    if (conn->retransmit_tail) {
+        conn->retransmit_tail->next = segment;
     } else {
-        tcp->ack_num = 0;
+        conn->retransmit_queue = segment;
     }
+    conn->retransmit_tail = segment;
     
-    // Set data offset (in 32-bit words) and flags
-    tcp->data_offset = (TCP_HEADER_SIZE / 4) << 4;
-    tcp->flags = flags;
+    conn->snd_nxt += seq_len;
     
-    // Set window size
-    tcp->window = htons(socket->conn.rcv_wnd);
+    // Time one segment per round trip
+    if (!conn->retransmit.rtt_timing) {
+        conn->retransmit.rtt_timing = 1;
+        conn->retransmit.rtt_seq = conn->snd_nxt;
+        conn->retransmit.rtt_start = ktimer_now_ms();
+    }
     
-    // Clear checksum and urgent pointer
-    tcp->checksum = 0;
-    tcp->urgent_ptr = 0;
+    // Time the oldest unacknowledged segment
+    if (!ktimer_pending(&socket->retransmit_timer)) {
+        ktimer_arm(&socket->retransmit_timer, conn->retransmit.rto);
+    }
+}
+
+/**
+ * Send a TCP segment at snd_nxt
+ *
+ * Used for control segments; application data goes through tcp_output().
+ * Segments that occupy sequence space (data, SYN, FIN) are kept until
+ * acknowledged.
+ */
+static int tcp_send_segment(tcp_socket_t* socket, uint8_t flags,
+                          const void* data, size_t data_len) {
+    if (socket == NULL) {
+        log_error("NET", "Cannot send TCP segment on NULL socket");
+        return -1;
+    }
+    
+    net_buffer_t* segment = tcp_alloc_segment(socket, socket->conn.snd_nxt, flags, data_len);
+    if (!segment) {
+        return -1;
+    }
     
     // Copy data if provided
     if (data != NULL && data_len > 0) {
-        memcpy(buffer->data + TCP_HEADER_SIZE, data, data_len);
+        memcpy(segment->data + TCP_HEADER_SIZE, data, data_len);
     }
     
-    // Calculate the checksum
-    tcp->checksum = tcp_checksum(tcp, data, data_len,
-                               &socket->local_addr, &socket->remote_addr);
+    int result = tcp_transmit(socket, segment);
     
-    // Set the buffer length
-    buffer->len = tcp_size;
+    uint32_t seq_len = tcp_segment_seq_len(segment);
+    if (seq_len > 0) {
+        tcp_queue_segment(socket, segment, seq_len);
+    } else {
+        net_buffer_free(segment);
+    }
     
-    // Update sequence number if we're sending data or SYN/FIN
-    if (data_len > 0 || (flags & (TCP_FLAG_SYN | TCP_FLAG_FIN))) {
-        socket->conn.snd_nxt += data_len;
-        
-        // SYN and FIN each consume a sequence number
-        if (flags & TCP_FLAG_SYN) socket->conn.snd_nxt++;
-        if (flags & TCP_FLAG_FIN) socket->conn.snd_nxt++;
+    return result;
+}
+
+/**
+ * Acknowledge everything received so far
+ */
+static void tcp_send_ack(tcp_socket_t* socket) {
+    tcp_send_segment(socket, TCP_FLAG_ACK, NULL, 0);
+}
+
+/**
+ * Acknowledge an in-order segment now, or hold the ACK back to coalesce it
+ * with the next one or ride on outgoing data
+ *
+ * At least every second full-sized segment is acknowledged (RFC 5681),
+ * and nothing waits longer than TCP_DELACK_TIMEOUT.
+ */
+static void tcp_delay_ack(tcp_socket_t* socket, uint32_t len) {
+    if (len >= socket->conn.mss && ++socket->ack_pending >= 2) {
+        tcp_send_ack(socket);
+        return;
+    }
+    
+    if (!ktimer_pending(&socket->delack_timer)) {
+        ktimer_arm(&socket->delack_timer, TCP_DELACK_TIMEOUT);
+    }
+}
+
+/**
+ * Delayed ACK timer callback (interrupt context): defer to the network thread
+ */
+static void tcp_delack_expired(ktimer_t* timer, void* data) {
+    (void)timer;
+    tcp_raise_event((tcp_socket_t*)data, TCP_EVENT_DELACK);
+}
+
+/**
+ * Delayed ACK timeout: send the ACK that was held back
+ */
+static void tcp_delack_timeout(tcp_socket_t* socket) {
+    // Already sent with other data, or held back again since
+    if (socket->state == TCP_STATE_CLOSED || socket->state == TCP_STATE_LISTEN ||
+        ktimer_pending(&socket->delack_timer)) {
+        return;
     }
     
-    // Send the TCP segment over IP
-    int result = ip_tx(buffer, &socket->local_addr, &socket->remote_addr, IP_PROTO_TCP, 64);
+    tcp_send_ack(socket);
+}
+
+/**
+ * Cut one segment of len bytes from the send buffer and send it
+ */
+static int tcp_output_segment(tcp_socket_t* socket, uint32_t len) {
+    uint8_t flags = TCP_FLAG_ACK;
     
-    // Free the buffer
-    net_buffer_free(buffer);
+    // Push when this empties the send buffer
+    if (len == socket->tx_buffer.bytes_available) {
+        flags |= TCP_FLAG_PSH;
+    }
+    
+    net_buffer_t* segment = tcp_alloc_segment(socket, socket->conn.snd_nxt, flags, len);
+    if (!segment) {
+        return -1;
+    }
+    
+    tcp_buffer_read(&socket->tx_buffer, segment->data + TCP_HEADER_SIZE, len);
+    
+    // Once cut, the data lives on the retransmission queue even if this send failed
+    int result = tcp_transmit(socket, segment);
+    tcp_queue_segment(socket, segment, len);
     
     return result;
 }
 
+/**
+ * Send as much buffered data as the windows, Nagle and cork allow
+ *
+ * Data is cut into MSS-sized segments. A segment shorter than the MSS goes
+ * out only when nothing is in flight (Nagle, unless TCP_OPT_NODELAY) and
+ * the socket is not corked. A FIN left pending by close() follows the last
+ * of the data.
+ */
+static void tcp_output(tcp_socket_t* socket) {
+    tcp_connection_t* conn = &socket->conn;
+    
+    if (socket->state != TCP_STATE_ESTABLISHED &&
+        socket->state != TCP_STATE_CLOSE_WAIT &&
+        !socket->fin_pending) {
+        return;
+    }
+    
+    // The peer's window and the congestion window both bound what is in flight
+    uint32_t window = conn->snd_wnd < conn->cwnd ? conn->snd_wnd : conn->cwnd;
+    
+    while (socket->tx_buffer.bytes_available > 0) {
+        uint32_t in_flight = conn->snd_nxt - conn->snd_una;
+        if (in_flight >= window) {
+            break; // Window is full
+        }
+        
+        uint32_t len = socket->tx_buffer.bytes_available;
+        if (len > conn->mss) {
+            len = conn->mss;
+        }
+        if (len > window - in_flight) {
+            len = window - in_flight;
+        }
+        
+        if (len < conn->mss) {
+            // Closing uncorks the socket
+            if ((socket->options & TCP_OPT_CORK) && !socket->fin_pending) {
+                break;
+            }
+            if (!(socket->options & TCP_OPT_NODELAY) && in_flight > 0) {
+                break; // Wait for the ACK to coalesce more data
+            }
+        }
+        
+        if (tcp_output_segment(socket, len) != 0) {
+            break;
+        }
+    }
+    
+    if (socket->fin_pending && socket->tx_buffer.bytes_available == 0) {
+        socket->fin_pending = 0;
+        tcp_send_segment(socket, TCP_FLAG_FIN | TCP_FLAG_ACK, NULL, 0);
+    }
+    
+    // Data is waiting on a closed window with nothing in flight to bring an
+    // update: the retransmission timer probes the window
+    if (socket->tx_buffer.bytes_available > 0 && conn->retransmit_queue == NULL &&
+        !ktimer_pending(&socket->retransmit_timer)) {
+        ktimer_arm(&socket->retransmit_timer, conn->retransmit.rto);
+    }
+}
+
+/**
+ * Resend the oldest unacknowledged segment (fast retransmit and recovery)
+ */
+static void tcp_retransmit_head(tcp_socket_t* socket) {
+    net_buffer_t* segment = socket->conn.retransmit_queue;
+    if (segment == NULL) {
+        return;
+    }
+    
+    log_debug("NET", "TCP fast retransmit of seq %u",
+            ntohl(((tcp_header_t*)segment->data)->seq_num));
+    
+    // Karn: no RTT sample from a retransmitted segment
+    socket->conn.retransmit.rtt_timing = 0;
+    tcp_transmit(socket, segment);
+}
+
+/**
+ * Send our FIN, or leave it to tcp_output() while buffered data goes first
+ */
+static int tcp_send_fin(tcp_socket_t* socket) {
+    if (socket->tx_buffer.bytes_available > 0) {
+        socket->fin_pending = 1;
+        tcp_output(socket);
+        return 0;
+    }
+    
+    return tcp_send_segment(socket, TCP_FLAG_FIN | TCP_FLAG_ACK, NULL, 0);
+}
+
 /**
  * Process a TCP SYN packet (connection request)
+ *
+ * Called with the table lock and the listener's lock held; the new
+ * connection's slot is locked while it is set up.
  */
 static int tcp_process_syn(tcp_socket_t* listening_socket,
                          const ipv4_address_t* src_addr, uint16_t src_port,
@@ -433,7 +1051,8 @@ static int tcp_process_syn(tcp_socket_t* listening_socket,
     }
     
     // Initialize the new socket
-    memset(new_socket, 0, sizeof(tcp_socket_t));
+    spinlock_acquire(&new_socket->lock);
+    tcp_socket_reset(new_socket);
     new_socket->state = TCP_STATE_SYN_RECEIVED;
     
     // Set local and remote information
@@ -446,6 +1065,7 @@ static int tcp_process_syn(tcp_socket_t* listening_socket,
     new_socket->conn.snd_una = tcp_initial_seq;
     new_socket->conn.snd_nxt = tcp_initial_seq;
     new_socket->conn.rcv_nxt = seq_num + 1; // Increment to account for the SYN
+    new_socket->rcv_adv = new_socket->conn.rcv_nxt;
     new_socket->conn.snd_wnd = window;
     new_socket->conn.rcv_wnd = TCP_DEFAULT_WINDOW;
     new_socket->conn.mss = TCP_DEFAULT_MSS;
@@ -454,9 +1074,14 @@ static int tcp_process_syn(tcp_socket_t* listening_socket,
     new_socket->conn.retransmit.rto = TCP_RETRANSMIT_TIMEOUT;
     new_socket->conn.retransmit.attempts = 0;
     
+    // Accepted connections use the listener's congestion control
+    tcp_cong_init(&new_socket->conn, listening_socket->conn.cong);
+    
     // Initialize receive buffer
-    if (tcp_buffer_init(new_socket, TCP_DEFAULT_BUFFER_SIZE) != 0) {
+    if (tcp_buffer_init(&new_socket->rx_buffer, TCP_DEFAULT_BUFFER_SIZE) != 0) {
         log_error("NET", "Failed to initialize TCP receive buffer");
+        new_socket->state = TCP_STATE_CLOSED;
+        spinlock_release(&new_socket->lock);
         return -1;
     }
     
@@ -470,30 +1095,58 @@ static int tcp_process_syn(tcp_socket_t* listening_socket,
     log_info("NET", "TCP connection request from %s:%u", src_str, src_port);
     
     // Send SYN+ACK
-    return tcp_send_segment(new_socket, TCP_FLAG_SYN | TCP_FLAG_ACK, NULL, 0);
+    int result = tcp_send_segment(new_socket, TCP_FLAG_SYN | TCP_FLAG_ACK, NULL, 0);
+    spinlock_release(&new_socket->lock);
+    
+    return result;
 }
 
 /**
  * Process a TCP ACK packet
+ * 
+ * seg_len is the sequence space the carrying segment occupies (data and
+ * FIN); only empty segments can be duplicate ACKs.
  */
-static int tcp_process_ack(tcp_socket_t* socket, uint32_t ack_num, uint16_t window) {
+static int tcp_process_ack(tcp_socket_t* socket, uint32_t ack_num, uint16_t window,
+                         uint32_t seg_len) {
+    tcp_connection_t* conn = &socket->conn;
+    uint32_t old_window = conn->snd_wnd;
+    
     // Update send window
-    socket->conn.snd_wnd = window;
+    conn->snd_wnd = window;
+    
+    // Duplicate ACK (RFC 5681): nothing new, no data, same window, data outstanding
+    if (ack_num == conn->snd_una) {
+        if (seg_len == 0 && window == old_window && conn->snd_una != conn->snd_nxt &&
+            tcp_cong_ack(conn, 0, ktimer_now_ms()) == TCP_CONG_RETRANSMIT) {
+            tcp_retransmit_head(socket);
+        }
+        return 0;
+    }
     
     // Check if the ACK is valid
-    if (ack_num <= socket->conn.snd_una || ack_num > socket->conn.snd_nxt) {
+    if (TCP_SEQ_LT(ack_num, conn->snd_una) || TCP_SEQ_GT(ack_num, conn->snd_nxt)) {
         // Ignore invalid ACKs
         return 0;
     }
     
     // Update the send unacknowledged pointer
-    socket->conn.snd_una = ack_num;
+    uint32_t acked = ack_num - conn->snd_una;
+    conn->snd_una = ack_num;
+    tcp_ack_advanced(socket);
+    
+    // Grow the congestion window, or fill the next hole during recovery
+    if (tcp_cong_ack(conn, acked, ktimer_now_ms()) == TCP_CONG_RETRANSMIT) {
+        tcp_retransmit_head(socket);
+    }
     
     // Handle state transitions based on ACK
     switch (socket->state) {
         case TCP_STATE_SYN_SENT:
             // Received ACK for our SYN, but no SYN from remote
             // This is not a normal transition, reset the connection
+            tcp_stop_timers(socket);
+            tcp_drop_send_state(socket);
             socket->state = TCP_STATE_CLOSED;
             tcp_send_segment(socket, TCP_FLAG_RST, NULL, 0);
             return -1;
@@ -504,9 +1157,7 @@ static int tcp_process_ack(tcp_socket_t* socket, uint32_t ack_num, uint16_t wind
             log_info("NET", "TCP connection established");
             
             // Notify the application
-            if (socket->connected_callback) {
-                socket->connected_callback(socket);
-            }
+            tcp_notify(socket, TCP_NOTIFY_CONNECTED, 0);
             return 0;
             
         case TCP_STATE_ESTABLISHED:
@@ -526,12 +1177,12 @@ static int tcp_process_ack(tcp_socket_t* socket, uint32_t ack_num, uint16_t wind
             
         case TCP_STATE_LAST_ACK:
             // FIN acknowledged, connection closed
+            tcp_stop_timers(socket);
+            tcp_drop_send_state(socket);
             socket->state = TCP_STATE_CLOSED;
             
             // Notify the application
-            if (socket->closed_callback) {
-                socket->closed_callback(socket);
-            }
+            tcp_notify(socket, TCP_NOTIFY_CLOSED, 0);
             return 0;
             
         default:
@@ -540,35 +1191,132 @@ static int tcp_process_ack(tcp_socket_t* socket, uint32_t ack_num, uint16_t wind
     }
 }
 
+/**
+ * Record out-of-order data [start, end), merging with the ranges it touches
+ *
+ * @return 0 on success, -1 if every range slot is taken by unrelated data
+ */
+static int tcp_ooo_insert(tcp_socket_t* socket, uint32_t start, uint32_t end) {
+    tcp_ooo_range_t* ranges = socket->rx_ooo;
+    int count = socket->rx_ooo_count;
+    
+    // Fold in every range that overlaps or abuts the new one
+    int i = 0;
+    while (i < count) {
+        if (TCP_SEQ_GT(ranges[i].start, end) || TCP_SEQ_LT(ranges[i].end, start)) {
+            i++;
+            continue;
+        }
+        if (TCP_SEQ_LT(ranges[i].start, start)) start = ranges[i].start;
+        if (TCP_SEQ_GT(ranges[i].end, end)) end = ranges[i].end;
+        
+        memmove(&ranges[i], &ranges[i + 1], (count - i - 1) * sizeof(tcp_ooo_range_t));
+        count--;
+    }
+    
+    if (count == TCP_OOO_RANGES) {
+        return -1;
+    }
+    
+    // Keep the ranges sorted by sequence number
+    i = count;
+    while (i > 0 && TCP_SEQ_GT(ranges[i - 1].start, start)) {
+        ranges[i] = ranges[i - 1];
+        i--;
+    }
+    ranges[i].start = start;
+    ranges[i].end = end;
+    socket->rx_ooo_count = count + 1;
+    
+    return 0;
+}
+
+/**
+ * In-order data now reaches end: absorb the held ranges it makes contiguous
+ *
+ * @return The new end of the in-order data
+ */
+static uint32_t tcp_ooo_advance(tcp_socket_t* socket, uint32_t end) {
+    tcp_ooo_range_t* ranges = socket->rx_ooo;
+    
+    while (socket->rx_ooo_count > 0 && TCP_SEQ_LEQ(ranges[0].start, end)) {
+        if (TCP_SEQ_GT(ranges[0].end, end)) {
+            end = ranges[0].end;
+        }
+        socket->rx_ooo_count--;
+        memmove(&ranges[0], &ranges[1], socket->rx_ooo_count * sizeof(tcp_ooo_range_t));
+    }
+    
+    return end;
+}
+
 /**
  * Process a TCP packet with data
+ *
+ * Data ahead of rcv_nxt is stored in the receive buffer at its final
+ * position, past the readable data, and becomes readable when the hole
+ * before it fills; nothing is copied twice.
  */
 static int tcp_process_data(tcp_socket_t* socket, const uint8_t* data, 
                           size_t data_len, uint32_t seq_num) {
-    // Check if the data is in sequence
-    if (seq_num != socket->conn.rcv_nxt) {
-        // Out of sequence, send duplicate ACK
-        // In a full implementation, we should buffer out-of-order segments
-        tcp_send_segment(socket, TCP_FLAG_ACK, NULL, 0);
+    tcp_connection_t* conn = &socket->conn;
+    tcp_buffer_t* buf = &socket->rx_buffer;
+    
+    if (buf->data == NULL) {
         return -1;
     }
     
-    // Update the next expected sequence number
-    socket->conn.rcv_nxt += data_len;
+    // Drop what we already have; a pure retransmission means our ACK was lost
+    if (TCP_SEQ_LT(seq_num, conn->rcv_nxt)) {
+        uint32_t duplicate = conn->rcv_nxt - seq_num;
+        if (duplicate >= data_len) {
+            tcp_send_ack(socket);
+            return 0;
+        }
+        data += duplicate;
+        data_len -= duplicate;
+        seq_num = conn->rcv_nxt;
+    }
     
-    // Write data to the receive buffer
-    if (tcp_buffer_write(socket, data, data_len) != data_len) {
-        log_warning("NET", "Failed to write data to TCP receive buffer");
+    // Trim to the free buffer space, which is what the window offered
+    uint32_t offset = seq_num - conn->rcv_nxt;
+    uint32_t space = buf->size - buf->bytes_available;
+    if (offset >= space) {
+        tcp_send_ack(socket);
         return -1;
     }
+    if (data_len > space - offset) {
+        data_len = space - offset;
+    }
     
-    // Notify the application that data is ready
-    if (socket->data_ready_callback) {
-        socket->data_ready_callback(socket, data_len);
+    if (offset > 0) {
+        // Out of order: hold it, and send a duplicate ACK at once so the
+        // sender can fast-retransmit the hole
+        if (tcp_ooo_insert(socket, seq_num, seq_num + data_len) == 0) {
+            tcp_buffer_store(buf, offset, data, data_len);
+        }
+        tcp_send_ack(socket);
+        return 0;
     }
     
-    // Send an ACK
-    tcp_send_segment(socket, TCP_FLAG_ACK, NULL, 0);
+    tcp_buffer_store(buf, 0, data, data_len);
+    
+    int filled_hole = socket->rx_ooo_count > 0;
+    uint32_t end = tcp_ooo_advance(socket, seq_num + data_len);
+    uint32_t readable = end - conn->rcv_nxt;
+    
+    tcp_buffer_commit(buf, readable);
+    conn->rcv_nxt = end;
+    
+    // Notify the application that data is ready
+    tcp_notify(socket, TCP_NOTIFY_DATA, readable);
+    
+    // Data after a hole is acknowledged at once (RFC 5681), the rest may wait
+    if (filled_hole) {
+        tcp_send_ack(socket);
+    } else {
+        tcp_delay_ack(socket, data_len);
+    }
     
     return 0;
 }
@@ -589,9 +1337,7 @@ static int tcp_process_fin(tcp_socket_t* socket, uint32_t seq_num) {
             tcp_send_segment(socket, TCP_FLAG_ACK, NULL, 0);
             
             // Notify the application that peer has closed
-            if (socket->closed_callback) {
-                socket->closed_callback(socket);
-            }
+            tcp_notify(socket, TCP_NOTIFY_CLOSED, 0);
             return 0;
             
         case TCP_STATE_FIN_WAIT_1:
@@ -615,8 +1361,93 @@ static int tcp_process_fin(tcp_socket_t* socket, uint32_t seq_num) {
         default:
             // Unexpected FIN in other states, still send ACK
             tcp_send_segment(socket, TCP_FLAG_ACK, NULL, 0);
-            return -1;
+            return -1;
+    }
+}
+
+/**
+ * Process a segment for a connection (socket lock held)
+ */
+static int tcp_process_segment(tcp_socket_t* socket, uint8_t flags, uint32_t seq_num,
+                             uint32_t ack_num, uint16_t window,
+                             const uint8_t* data, size_t data_len) {
+    // Handle RST packets (connection reset)
+    if (flags & TCP_FLAG_RST) {
+        log_warning("NET", "Connection reset by peer");
+        
+        // Move the socket to CLOSED state
+        tcp_stop_timers(socket);
+        tcp_drop_send_state(socket);
+        socket->state = TCP_STATE_CLOSED;
+        
+        // Notify the application
+        tcp_notify(socket, TCP_NOTIFY_CLOSED, 0);
+        return 0;
+    }
+    
+    // Handle SYN packets (connection establishment)
+    if (flags & TCP_FLAG_SYN) {
+        // Check if this is a SYN+ACK for a connection in progress
+        if ((flags & TCP_FLAG_ACK) && socket->state == TCP_STATE_SYN_SENT) {
+            // Validate the ACK
+            if (ack_num != socket->conn.snd_nxt) {
+                log_warning("NET", "Unexpected ACK in SYN+ACK: %u, expected: %u",
+                           ack_num, socket->conn.snd_nxt);
+                return -1;
+            }
+            
+            // Update socket state
+            socket->state = TCP_STATE_ESTABLISHED;
+            socket->conn.snd_una = ack_num;
+            tcp_ack_advanced(socket);
+            socket->conn.rcv_nxt = seq_num + 1;  // +1 for the SYN
+            socket->rcv_adv = socket->conn.rcv_nxt;
+            socket->conn.snd_wnd = window;
+            
+            // Send an ACK for the SYN+ACK
+            tcp_send_segment(socket, TCP_FLAG_ACK, NULL, 0);
+            
+            char addr_str[16];
+            ipv4_to_str(&socket->remote_addr, addr_str);
+            log_info("NET", "TCP connection established with %s:%u", addr_str, socket->remote_port);
+            
+            // Notify the application
+            tcp_notify(socket, TCP_NOTIFY_CONNECTED, 0);
+            
+            return 0;
+        }
+        
+        // No matching socket or not in appropriate state
+        log_warning("NET", "TCP SYN received but no listening socket on port %u", socket->local_port);
+        
+        // Send RST+ACK
+        // In a full implementation, we'd send an RST to reject the connection
+        return -1;
+    }
+    
+    // Handle ACK packets
+    if (flags & TCP_FLAG_ACK) {
+        tcp_process_ack(socket, ack_num, window, data_len + ((flags & TCP_FLAG_FIN) ? 1 : 0));
+    }
+    
+    // Handle data
+    if (data_len > 0) {
+        tcp_process_data(socket, data, data_len, seq_num);
+    }
+    
+    // Handle FIN packets (connection termination); a FIN ahead of missing
+    // data is ignored, the peer sends it again
+    if ((flags & TCP_FLAG_FIN) && seq_num + data_len == socket->conn.rcv_nxt) {
+        tcp_process_fin(socket, seq_num + data_len);
+    } else if ((flags & TCP_FLAG_FIN) && data_len == 0) {
+        // Early or retransmitted FIN: repeat what we have
+        tcp_send_ack(socket);
     }
+    
+    // The ACK may have opened the window or released Nagle-held data
+    tcp_output(socket);
+    
+    return 0;
 }
 
 /**
@@ -693,71 +1524,25 @@ int tcp_rx(net_buffer_t* buffer) {
     tcp->checksum = checksum;
     
     // Find the socket for this packet
+    uint32_t eflags = tcp_irq_save();
+    spinlock_acquire(&tcp_table_lock);
     tcp_socket_t* socket = tcp_find_socket(dest_port, dest_addr, src_port, src_addr);
     
-    // Handle RST packets (connection reset)
-    if (flags & TCP_FLAG_RST) {
-        if (socket != NULL) {
-            log_warning("NET", "Connection reset by peer");
-            
-            // Move the socket to CLOSED state
-            socket->state = TCP_STATE_CLOSED;
-            
-            // Notify the application
-            if (socket->closed_callback) {
-                socket->closed_callback(socket);
-            }
-        }
-        return 0;
-    }
-    
-    // Handle SYN packets (connection establishment)
-    if (flags & TCP_FLAG_SYN) {
-        // Check if this is a SYN+ACK for a connection in progress
-        if ((flags & TCP_FLAG_ACK) && socket != NULL && socket->state == TCP_STATE_SYN_SENT) {
-            // Validate the ACK
-            if (ack_num != socket->conn.snd_nxt) {
-                log_warning("NET", "Unexpected ACK in SYN+ACK: %u, expected: %u",
-                           ack_num, socket->conn.snd_nxt);
-                return -1;
-            }
-            
-            // Update socket state
-            socket->state = TCP_STATE_ESTABLISHED;
-            socket->conn.snd_una = ack_num;
-            socket->conn.rcv_nxt = seq_num + 1;  // +1 for the SYN
-            socket->conn.snd_wnd = window;
-            
-            // Send an ACK for the SYN+ACK
-            tcp_send_segment(socket, TCP_FLAG_ACK, NULL, 0);
-            
-            log_info("NET", "TCP connection established with %s:%u", src_str, src_port);
-            
-            // Notify the application
-            if (socket->connected_callback) {
-                socket->connected_callback(socket);
-            }
-            
+    if (socket == NULL) {
+        spinlock_release(&tcp_table_lock);
+        tcp_irq_restore(eflags);
+        
+        if (flags & TCP_FLAG_RST) {
             return 0;
         }
-        
-        // Check if we have a listening socket for this destination
-        if (socket != NULL && socket->state == TCP_STATE_LISTEN) {
-            // Process a new connection request
-            return tcp_process_syn(socket, src_addr, src_port, dest_addr, dest_port,
-                                 seq_num, window);
+        if (flags & TCP_FLAG_SYN) {
+            log_warning("NET", "TCP SYN received but no listening socket on port %u", dest_port);
+            
+            // Send RST+ACK
+            // In a full implementation, we'd send an RST to reject the connection
+            return -1;
         }
         
-        // No matching socket or not in appropriate state
-        log_warning("NET", "TCP SYN received but no listening socket on port %u", dest_port);
-        
-        // Send RST+ACK
-        // In a full implementation, we'd send an RST to reject the connection
-        return -1;
-    }
-    
-    // For all other packets, we need an existing socket
-    if (socket == NULL) {
         log_warning("NET", "TCP packet for non-existent socket: %s:%u -> %s:%u",
                   src_str, src_port, dest_str, dest_port);
         
@@ -766,23 +1551,23 @@ int tcp_rx(net_buffer_t* buffer) {
         return -1;
     }
     
-    // Handle ACK packets
-    if (flags & TCP_FLAG_ACK) {
-        tcp_process_ack(socket, ack_num, window);
-    }
-    
-    // Handle data
-    size_t data_len = buffer->len - hdr_size;
-    if (data_len > 0) {
-        tcp_process_data(socket, buffer->data + hdr_size, data_len, seq_num);
-    }
+    spinlock_acquire(&socket->lock);
     
-    // Handle FIN packets (connection termination)
-    if (flags & TCP_FLAG_FIN) {
-        tcp_process_fin(socket, seq_num + data_len);
+    int result;
+    if (!(flags & TCP_FLAG_RST) && (flags & TCP_FLAG_SYN) && socket->state == TCP_STATE_LISTEN) {
+        // Process a new connection request; it takes a free slot, so the
+        // table stays locked
+        result = tcp_process_syn(socket, src_addr, src_port, dest_addr, dest_port,
+                               seq_num, window);
+        spinlock_release(&tcp_table_lock);
+    } else {
+        spinlock_release(&tcp_table_lock);
+        result = tcp_process_segment(socket, flags, seq_num, ack_num, window,
+                                   buffer->data + hdr_size, buffer->len - hdr_size);
     }
     
-    return 0;
+    tcp_unlock(socket, eflags);
+    return result;
 }
 
 /**
@@ -825,25 +1610,12 @@ uint16_t tcp_get_free_port() {
 }
 
 /**
- * Create a TCP socket
+ * Prepare a free slot as a new socket (table and socket locks held)
  */
-tcp_socket_t* tcp_socket_create(const ipv4_address_t* local_addr, uint16_t local_port) {
-    // Find a free socket slot
-    tcp_socket_t* socket = NULL;
-    for (int i = 0; i < TCP_MAX_SOCKETS; i++) {
-        if (tcp_sockets[i].state == TCP_STATE_CLOSED) {
-            socket = &tcp_sockets[i];
-            break;
-        }
-    }
-    
-    if (socket == NULL) {
-        log_error("NET", "No free TCP socket slots");
-        return NULL;
-    }
-    
+static int tcp_socket_setup(tcp_socket_t* socket, const ipv4_address_t* local_addr,
+                          uint16_t local_port) {
     // Initialize the socket
-    memset(socket, 0, sizeof(tcp_socket_t));
+    tcp_socket_reset(socket);
     socket->state = TCP_STATE_CLOSED;  // Will be changed by connect or listen
     
     // Set address if provided, otherwise use any (0.0.0.0)
@@ -877,7 +1649,7 @@ tcp_socket_t* tcp_socket_create(const ipv4_address_t* local_addr, uint16_t local
         
         if (port_in_use) {
             log_error("NET", "TCP port %u already in use", local_port);
-            return NULL;
+            return -1;
         }
         
         socket->local_port = local_port;
@@ -886,7 +1658,7 @@ tcp_socket_t* tcp_socket_create(const ipv4_address_t* local_addr, uint16_t local
         socket->local_port = tcp_get_free_port();
         if (socket->local_port == 0) {
             log_error("NET", "Failed to allocate a dynamic TCP port");
-            return NULL;
+            return -1;
         }
     }
     
@@ -895,23 +1667,52 @@ tcp_socket_t* tcp_socket_create(const ipv4_address_t* local_addr, uint16_t local
     socket->conn.mss = TCP_DEFAULT_MSS;
     
     // Initialize receive buffer
-    if (tcp_buffer_init(socket, TCP_DEFAULT_BUFFER_SIZE) != 0) {
+    if (tcp_buffer_init(&socket->rx_buffer, TCP_DEFAULT_BUFFER_SIZE) != 0) {
         log_error("NET", "Failed to initialize TCP receive buffer");
-        return NULL;
+        return -1;
     }
     
-    return socket;
+    return 0;
 }
 
 /**
- * Bind a TCP socket to a specific address and port
+ * Create a TCP socket
  */
-int tcp_socket_bind(tcp_socket_t* socket, const ipv4_address_t* addr, uint16_t port) {
+tcp_socket_t* tcp_socket_create(const ipv4_address_t* local_addr, uint16_t local_port) {
+    uint32_t eflags = tcp_irq_save();
+    spinlock_acquire(&tcp_table_lock);
+    
+    // Find a free socket slot
+    tcp_socket_t* socket = NULL;
+    for (int i = 0; i < TCP_MAX_SOCKETS; i++) {
+        if (tcp_sockets[i].state == TCP_STATE_CLOSED) {
+            socket = &tcp_sockets[i];
+            break;
+        }
+    }
+    
     if (socket == NULL) {
-        log_error("NET", "Cannot bind NULL TCP socket");
-        return -1;
+        log_error("NET", "No free TCP socket slots");
+    } else {
+        spinlock_acquire(&socket->lock);
+        int result = tcp_socket_setup(socket, local_addr, local_port);
+        spinlock_release(&socket->lock);
+        
+        if (result != 0) {
+            socket = NULL;
+        }
     }
     
+    spinlock_release(&tcp_table_lock);
+    tcp_irq_restore(eflags);
+    
+    return socket;
+}
+
+/**
+ * Bind a TCP socket (table and socket locks held)
+ */
+static int tcp_bind_locked(tcp_socket_t* socket, const ipv4_address_t* addr, uint16_t port) {
     if (socket->state != TCP_STATE_CLOSED) {
         log_error("NET", "Cannot bind TCP socket in non-CLOSED state");
         return -1;
@@ -964,6 +1765,26 @@ int tcp_socket_bind(tcp_socket_t* socket, const ipv4_address_t* addr, uint16_t p
     return 0;
 }
 
+/**
+ * Bind a TCP socket to a specific address and port
+ */
+int tcp_socket_bind(tcp_socket_t* socket, const ipv4_address_t* addr, uint16_t port) {
+    if (socket == NULL) {
+        log_error("NET", "Cannot bind NULL TCP socket");
+        return -1;
+    }
+    
+    uint32_t eflags = tcp_irq_save();
+    spinlock_acquire(&tcp_table_lock);
+    spinlock_acquire(&socket->lock);
+    
+    int result = tcp_bind_locked(socket, addr, port);
+    
+    spinlock_release(&tcp_table_lock);
+    tcp_unlock(socket, eflags);
+    return result;
+}
+
 /**
  * Start listening for connections on a socket
  */
@@ -973,7 +1794,10 @@ int tcp_socket_listen(tcp_socket_t* socket, uint16_t backlog) {
         return -1;
     }
     
+    uint32_t eflags = tcp_lock(socket);
+    
     if (socket->state != TCP_STATE_CLOSED) {
+        tcp_unlock(socket, eflags);
         log_error("NET", "Cannot listen on TCP socket in non-CLOSED state");
         return -1;
     }
@@ -981,6 +1805,7 @@ int tcp_socket_listen(tcp_socket_t* socket, uint16_t backlog) {
     // Allocate listener structure
     tcp_listener_t* listener = (tcp_listener_t*)malloc(sizeof(tcp_listener_t));
     if (listener == NULL) {
+        tcp_unlock(socket, eflags);
         log_error("NET", "Failed to allocate TCP listener");
         return -1;
     }
@@ -999,6 +1824,7 @@ int tcp_socket_listen(tcp_socket_t* socket, uint16_t backlog) {
     log_info("NET", "TCP socket listening on %s:%u with backlog %u",
             addr_str, socket->local_port, backlog);
     
+    tcp_unlock(socket, eflags);
     return 0;
 }
 
@@ -1011,13 +1837,17 @@ tcp_socket_t* tcp_socket_accept(tcp_socket_t* socket) {
         return NULL;
     }
     
+    uint32_t eflags = tcp_lock(socket);
+    
     if (socket->state != TCP_STATE_LISTEN || socket->listener == NULL) {
+        tcp_unlock(socket, eflags);
         log_error("NET", "Cannot accept on non-listening TCP socket");
         return NULL;
     }
     
     // Check if there are any pending connections
     if (socket->listener->pending_connections == NULL) {
+        tcp_unlock(socket, eflags);
         return NULL; // No pending connections
     }
     
@@ -1028,9 +1858,14 @@ tcp_socket_t* tcp_socket_accept(tcp_socket_t* socket) {
     socket->listener->pending_count--;
     
     // Move the socket to ESTABLISHED state if it was in SYN_RECEIVED
+    // (listener before connection is the lock order tcp_process_syn uses)
+    spinlock_acquire(&accepted->lock);
     if (accepted->state == TCP_STATE_SYN_RECEIVED) {
         accepted->state = TCP_STATE_ESTABLISHED;
     }
+    spinlock_release(&accepted->lock);
+    
+    tcp_unlock(socket, eflags);
     
     char addr_str[16];
     ipv4_to_str(&accepted->remote_addr, addr_str);
@@ -1041,14 +1876,9 @@ tcp_socket_t* tcp_socket_accept(tcp_socket_t* socket) {
 }
 
 /**
- * Connect to a remote host
+ * Start connecting (table and socket locks held)
  */
-int tcp_socket_connect(tcp_socket_t* socket, const ipv4_address_t* addr, uint16_t port) {
-    if (socket == NULL || addr == NULL) {
-        log_error("NET", "Invalid parameters for tcp_socket_connect");
-        return -1;
-    }
-    
+static int tcp_connect_locked(tcp_socket_t* socket, const ipv4_address_t* addr, uint16_t port) {
     if (socket->state != TCP_STATE_CLOSED) {
         log_error("NET", "Cannot connect TCP socket in non-CLOSED state");
         return -1;
@@ -1092,8 +1922,12 @@ int tcp_socket_connect(tcp_socket_t* socket, const ipv4_address_t* addr, uint16_
     socket->conn.retransmit.rto = TCP_RETRANSMIT_TIMEOUT;
     socket->conn.retransmit.attempts = 0;
     
-    // Initialize receive buffer
-    if (tcp_buffer_init(socket, TCP_DEFAULT_BUFFER_SIZE) != 0) {
+    // Keep the algorithm chosen before connecting, if any
+    tcp_cong_init(&socket->conn, socket->conn.cong);
+    
+    // Initialize receive buffer (normally done by tcp_socket_create)
+    if (socket->rx_buffer.data == NULL &&
+        tcp_buffer_init(&socket->rx_buffer, TCP_DEFAULT_BUFFER_SIZE) != 0) {
         log_error("NET", "Failed to initialize TCP receive buffer");
         return -1;
     }
@@ -1107,14 +1941,30 @@ int tcp_socket_connect(tcp_socket_t* socket, const ipv4_address_t* addr, uint16_
 }
 
 /**
- * Close a TCP socket
+ * Connect to a remote host
  */
-int tcp_socket_close(tcp_socket_t* socket) {
-    if (socket == NULL) {
-        log_error("NET", "Cannot close NULL TCP socket");
+int tcp_socket_connect(tcp_socket_t* socket, const ipv4_address_t* addr, uint16_t port) {
+    if (socket == NULL || addr == NULL) {
+        log_error("NET", "Invalid parameters for tcp_socket_connect");
         return -1;
     }
     
+    // The table lock covers picking a dynamic port
+    uint32_t eflags = tcp_irq_save();
+    spinlock_acquire(&tcp_table_lock);
+    spinlock_acquire(&socket->lock);
+    
+    int result = tcp_connect_locked(socket, addr, port);
+    
+    spinlock_release(&tcp_table_lock);
+    tcp_unlock(socket, eflags);
+    return result;
+}
+
+/**
+ * Close a TCP socket (socket lock held)
+ */
+static int tcp_close_locked(tcp_socket_t* socket) {
     // Check current state and perform appropriate action
     switch (socket->state) {
         case TCP_STATE_CLOSED:
@@ -1128,28 +1978,32 @@ int tcp_socket_close(tcp_socket_t* socket) {
                 free(socket->listener);
                 socket->listener = NULL;
             }
+            tcp_stop_timers(socket);
+            tcp_drop_send_state(socket);
             socket->state = TCP_STATE_CLOSED;
             return 0;
             
         case TCP_STATE_SYN_SENT:
             // Connection attempt not completed, just close
+            tcp_stop_timers(socket);
+            tcp_drop_send_state(socket);
             socket->state = TCP_STATE_CLOSED;
             return 0;
             
         case TCP_STATE_SYN_RECEIVED:
             // Send FIN and move to FIN_WAIT_1
             socket->state = TCP_STATE_FIN_WAIT_1;
-            return tcp_send_segment(socket, TCP_FLAG_FIN | TCP_FLAG_ACK, NULL, 0);
+            return tcp_send_fin(socket);
             
         case TCP_STATE_ESTABLISHED:
-            // Send FIN and move to FIN_WAIT_1
+            // Send FIN (after any buffered data) and move to FIN_WAIT_1
             socket->state = TCP_STATE_FIN_WAIT_1;
-            return tcp_send_segment(socket, TCP_FLAG_FIN | TCP_FLAG_ACK, NULL, 0);
+            return tcp_send_fin(socket);
             
         case TCP_STATE_CLOSE_WAIT:
-            // Send FIN and move to LAST_ACK
+            // Send FIN (after any buffered data) and move to LAST_ACK
             socket->state = TCP_STATE_LAST_ACK;
-            return tcp_send_segment(socket, TCP_FLAG_FIN | TCP_FLAG_ACK, NULL, 0);
+            return tcp_send_fin(socket);
             
         default:
             // Other states shouldn't call close
@@ -1159,6 +2013,22 @@ int tcp_socket_close(tcp_socket_t* socket) {
     }
 }
 
+/**
+ * Close a TCP socket
+ */
+int tcp_socket_close(tcp_socket_t* socket) {
+    if (socket == NULL) {
+        log_error("NET", "Cannot close NULL TCP socket");
+        return -1;
+    }
+    
+    uint32_t eflags = tcp_lock(socket);
+    int result = tcp_close_locked(socket);
+    tcp_unlock(socket, eflags);
+    
+    return result;
+}
+
 /**
  * Send data through a TCP socket
  */
@@ -1168,23 +2038,85 @@ int tcp_socket_send(tcp_socket_t* socket, const void* data, size_t len) {
         return -1;
     }
     
-    if (socket->state != TCP_STATE_ESTABLISHED) {
-        log_error("NET", "Cannot send on TCP socket in non-ESTABLISHED state");
+    uint32_t eflags = tcp_lock(socket);
+    
+    if (socket->state != TCP_STATE_ESTABLISHED && socket->state != TCP_STATE_CLOSE_WAIT) {
+        tcp_state_t state = socket->state;
+        tcp_unlock(socket, eflags);
+        log_error("NET", "Cannot send on TCP socket in state %s", tcp_state_to_str(state));
+        return -1;
+    }
+    
+    // The send buffer is allocated on first use
+    if (socket->tx_buffer.data == NULL &&
+        tcp_buffer_init(&socket->tx_buffer, TCP_DEFAULT_BUFFER_SIZE) != 0) {
+        tcp_unlock(socket, eflags);
         return -1;
     }
     
-    // In a full implementation, we'd buffer the data and send based on window size
-    // For this implementation, we'll just send it directly
+    // Queue what fits; the caller retries the rest once ACKs free space
+    uint32_t space = socket->tx_buffer.size - socket->tx_buffer.bytes_available;
+    if (len > space) {
+        len = space;
+    }
+    if (len > 0) {
+        tcp_buffer_write(&socket->tx_buffer, data, len);
+    }
+    
+    tcp_output(socket);
+    
+    tcp_unlock(socket, eflags);
+    return len;
+}
+
+/**
+ * Grow the receive buffer when the application keeps up with the sender
+ *
+ * Whatever the application reads within one round trip, the window must
+ * be able to hold twice over, or the sender stalls waiting for it
+ * (dynamic right-sizing). Called with the socket lock held, which keeps
+ * tcp_rx from storing into the buffer while it moves.
+ */
+static void tcp_rcvbuf_autotune(tcp_socket_t* socket, uint32_t copied) {
+    tcp_buffer_t* buf = &socket->rx_buffer;
+    uint64_t now = ktimer_now_ms();
+    
+    if (socket->rx_period_start == 0) {
+        socket->rx_period_start = now;
+        socket->rx_copied = 0;
+    }
+    socket->rx_copied += copied;
+    
+    uint32_t rtt = socket->conn.retransmit.srtt ? socket->conn.retransmit.srtt : TCP_AUTOTUNE_RTT;
+    if (now - socket->rx_period_start < rtt) {
+        return;
+    }
+    
+    uint32_t wanted = 2 * socket->rx_copied;
+    socket->rx_period_start = now;
+    socket->rx_copied = 0;
     
-    // Send data with the PSH and ACK flags
-    int result = tcp_send_segment(socket, TCP_FLAG_PSH | TCP_FLAG_ACK, data, len);
+    if (wanted <= buf->size || buf->size >= TCP_MAX_BUFFER_SIZE) {
+        return;
+    }
+    
+    uint32_t size = buf->size;
+    while (size < wanted && size < TCP_MAX_BUFFER_SIZE) {
+        size *= 2;
+    }
+    if (size > TCP_MAX_BUFFER_SIZE) {
+        size = TCP_MAX_BUFFER_SIZE;
+    }
     
-    // Notify sent callback if registered
-    if (result == 0 && socket->sent_callback) {
-        socket->sent_callback(socket, len);
+    // Out-of-order data past the end moves along with the readable data
+    uint32_t held = 0;
+    if (socket->rx_ooo_count > 0) {
+        held = socket->rx_ooo[socket->rx_ooo_count - 1].end - socket->conn.rcv_nxt;
     }
     
-    return result == 0 ? len : result;
+    if (tcp_buffer_grow(buf, size, held) == 0) {
+        log_debug("NET", "TCP receive buffer grown to %u bytes", size);
+    }
 }
 
 /**
@@ -1196,33 +2128,45 @@ int tcp_socket_recv(tcp_socket_t* socket, void* buffer, size_t len) {
         return -1;
     }
     
+    uint32_t eflags = tcp_lock(socket);
+    
     if (socket->state != TCP_STATE_ESTABLISHED && 
         socket->state != TCP_STATE_FIN_WAIT_1 &&
         socket->state != TCP_STATE_FIN_WAIT_2 &&
         socket->state != TCP_STATE_CLOSE_WAIT) {
-        log_error("NET", "Cannot receive on TCP socket in state %s",
-                 tcp_state_to_str(socket->state));
+        tcp_state_t state = socket->state;
+        tcp_unlock(socket, eflags);
+        log_error("NET", "Cannot receive on TCP socket in state %s", tcp_state_to_str(state));
         return -1;
     }
     
     // Try to read data from the receive buffer
-    int bytes_read = tcp_buffer_read(socket, buffer, len);
+    int bytes_read = tcp_buffer_read(&socket->rx_buffer, buffer, len);
     
-    // Update the receive window if needed
     if (bytes_read > 0) {
-        // In a more sophisticated implementation, we would adjust the receive window
-        // based on buffer space and send a window update if necessary
+        tcp_rcvbuf_autotune(socket, bytes_read);
+        
+        // Tell a sender that is still sending once the window opened usefully
+        tcp_buffer_t* buf = &socket->rx_buffer;
+        uint32_t threshold = buf->size / 2 < socket->conn.mss ? buf->size / 2 : socket->conn.mss;
+        if ((socket->state == TCP_STATE_ESTABLISHED ||
+             socket->state == TCP_STATE_FIN_WAIT_1 ||
+             socket->state == TCP_STATE_FIN_WAIT_2) &&
+            tcp_rcv_window_growth(socket) >= threshold) {
+            tcp_send_ack(socket);
+        }
     }
     
+    tcp_unlock(socket, eflags);
     return bytes_read;
 }
 
 /**
  * Check if there's data available to read from a TCP socket
  */
-int tcp_socket_available(tcp_socket_t* socket) {
+size_t tcp_socket_available(tcp_socket_t* socket) {
     if (socket == NULL) {
-        return -1;
+        return 0;
     }
     
     return socket->rx_buffer.bytes_available;
@@ -1248,80 +2192,6 @@ const char* tcp_state_to_str(tcp_state_t state) {
     }
 }
 
-/**
- * Process TCP timers
- */
-void tcp_timer(uint32_t msec) {
-    uint32_t current_time = network_get_time_ms();
-
-    // Process TIME_WAIT timers
-    for (int i = 0; i < TCP_MAX_TIME_WAIT_SOCKETS; i++) {
-        if (time_wait_sockets[i].socket != NULL) {
-            // Check if TIME_WAIT period has expired
-            if (current_time - time_wait_sockets[i].start_time >= time_wait_sockets[i].duration) {
-                char addr_str[16];
-                ipv4_to_str(&time_wait_sockets[i].socket->remote_addr, addr_str);
-                log_info("NET", "TCP TIME_WAIT expired for connection to %s:%u",
-                      addr_str, time_wait_sockets[i].socket->remote_port);
-                
-                // Close the socket
-                time_wait_sockets[i].socket->state = TCP_STATE_CLOSED;
-                
-                // Free the slot
-                time_wait_sockets[i].socket = NULL;
-            }
-        }
-    }
-    
-    // Iterate through all TCP sockets
-    for (int i = 0; i < TCP_MAX_SOCKETS; i++) {
-        tcp_socket_t* socket = &tcp_sockets[i];
-        
-        // Skip closed sockets
-        if (socket->state == TCP_STATE_CLOSED) {
-            continue;
-        }
-        
-        // Handle retransmissions for SYN_SENT, SYN_RECEIVED, and ESTABLISHED states
-        if (socket->state == TCP_STATE_SYN_SENT || 
-            socket->state == TCP_STATE_SYN_RECEIVED ||
-            socket->state == TCP_STATE_ESTABLISHED) {
-            
-            // Check if retransmission timer expired
-            if (socket->conn.retransmit.timer > 0) {
-                socket->conn.retransmit.timer -= msec;
-                
-                if (socket->conn.retransmit.timer <= 0) {
-                    // Timer expired, retransmit
-                    socket->conn.retransmit.attempts++;
-                    socket->conn.retransmit.rto *= 2; // Exponential backoff
-                    
-                    if (socket->conn.retransmit.attempts > TCP_MAX_RETRANSMITS) {
-                        log_warning("NET", "TCP connection timed out after %d attempts",
-                                  socket->conn.retransmit.attempts);
-                        
-                        // Reset the connection
-                        socket->state = TCP_STATE_CLOSED;
-                        
-                        // Notify the application
-                        if (socket->closed_callback) {
-                            socket->closed_callback(socket);
-                        }
-                    } else {
-                        // Retransmit the last segment
-                        // In a full implementation, we would retransmit from a queue
-                        log_debug("NET", "TCP retransmitting (attempt %d/%d)",
-                                socket->conn.retransmit.attempts, TCP_MAX_RETRANSMITS);
-                        
-                        // Reset the timer for next attempt
-                        socket->conn.retransmit.timer = socket->conn.retransmit.rto;
-                    }
-                }
-            }
-        }
-    }
-}
-
 /**
  * Register callbacks for a TCP socket
  */
@@ -1335,10 +2205,36 @@ int tcp_socket_register_callbacks(tcp_socket_t* socket,
         return -1;
     }
     
+    uint32_t eflags = tcp_lock(socket);
     socket->connected_callback = connected_callback;
     socket->data_ready_callback = data_ready_callback;
     socket->sent_callback = sent_callback;
     socket->closed_callback = closed_callback;
+    tcp_unlock(socket, eflags);
+    
+    return 0;
+}
+
+/**
+ * Select the congestion control algorithm of a TCP socket
+ */
+int tcp_socket_set_congestion(tcp_socket_t* socket, const char* name) {
+    if (socket == NULL || name == NULL) {
+        log_error("NET", "Invalid parameters for tcp_socket_set_congestion");
+        return -1;
+    }
+    
+    const tcp_cong_ops_t* ops = tcp_cong_find(name);
+    if (ops == NULL) {
+        log_error("NET", "Unknown TCP congestion control algorithm: %s", name);
+        return -1;
+    }
+    
+    uint32_t eflags = tcp_lock(socket);
+    socket->conn.cong = ops;
+    memset(socket->conn.cong_priv, 0, sizeof(socket->conn.cong_priv));
+    ops->init(&socket->conn);
+    tcp_unlock(socket, eflags);
     
     return 0;
 }
@@ -1352,6 +2248,11 @@ int tcp_socket_set_options(tcp_socket_t* socket, uint8_t options) {
         return -1;
     }
     
+    uint32_t eflags = tcp_lock(socket);
     socket->options = options;
+    
+    // Uncorking (or setting NODELAY) may release held-back data
+    tcp_output(socket);
+    tcp_unlock(socket, eflags);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,566 @@
+/**
+ * @file tcp_cong.c
+ * @brief TCP congestion control for uintOS
+ *
+ * Loss detection and recovery are shared by every algorithm: the third
+ * duplicate ACK triggers a fast retransmit and NewReno fast recovery
+ * (RFC 6582), a retransmission timeout restarts from one segment. The
+ * algorithms (NewReno, CUBIC) only decide how cwnd and ssthresh move.
+ */
+
+#include <string.h>
+#include "../include/tcp.h"
+#include "../../kernel/logging/log.h"
+
+static const tcp_cong_ops_t* const tcp_cong_algorithms[] = {
+    &tcp_cong_newreno,
+    &tcp_cong_cubic,
+};
+
+#define TCP_CONG_ALGORITHM_COUNT (sizeof(tcp_cong_algorithms) / sizeof(tcp_cong_algorithms[0]))
+
+/**
+ * Initial window (RFC 3390)
+ */
+static uint32_t tcp_cong_initial_window(uint32_t mss) {
+    uint32_t window = 2 * mss > 4380 ? 2 * mss : 4380;
+    return window < 4 * mss ? window : 4 * mss;
+}
+
+/**
+ * Half the data in flight, at least two segments (RFC 5681 ssthresh)
+ */
+static uint32_t tcp_cong_half_flight(const tcp_connection_t* conn) {
+    uint32_t half = (conn->snd_nxt - conn->snd_una) / 2;
+    return half > 2u * conn->mss ? half : 2u * conn->mss;
+}
+
+/**
+ * Slow start: one segment per ACK at most (RFC 3465, L = 1)
+ */
+static void tcp_cong_slow_start(tcp_connection_t* conn, uint32_t acked) {
+    conn->cwnd += acked < conn->mss ? acked : conn->mss;
+}
+
+const tcp_cong_ops_t* tcp_cong_find(const char* name) {
+    if (name == NULL) {
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < TCP_CONG_ALGORITHM_COUNT; i++) {
+        if (strcmp(tcp_cong_algorithms[i]->name, name) == 0) {
+            return tcp_cong_algorithms[i];
+        }
+    }
+    return NULL;
+}
+
+void tcp_cong_init(tcp_connection_t* conn, const tcp_cong_ops_t* ops) {
+    conn->cong = ops ? ops : &TCP_CONG_DEFAULT;
+    conn->cwnd = tcp_cong_initial_window(conn->mss);
+    conn->ssthresh = 0xFFFFFFFF;
+    conn->bytes_acked = 0;
+    conn->recover = conn->snd_una;
+    conn->ca_state = TCP_CA_OPEN;
+    conn->dup_acks = 0;
+
+    memset(conn->cong_priv, 0, sizeof(conn->cong_priv));
+    conn->cong->init(conn);
+}
+
+int tcp_cong_ack(tcp_connection_t* conn, uint32_t acked, uint64_t now_ms) {
+    if (acked == 0) {
+        conn->dup_acks++;
+
+        // Every further duplicate means another segment left the network
+        if (conn->ca_state == TCP_CA_RECOVERY) {
+            conn->cwnd += conn->mss;
+            return 0;
+        }
+
+        // Fast retransmit, unless this loss belongs to a recovery already done
+        if (conn->dup_acks == TCP_DUPACK_THRESHOLD && conn->ca_state == TCP_CA_OPEN &&
+            TCP_SEQ_GT(conn->snd_una, conn->recover)) {
+            conn->cong->on_loss(conn);
+            conn->cwnd = conn->ssthresh + TCP_DUPACK_THRESHOLD * conn->mss;
+            conn->bytes_acked = 0;
+            conn->recover = conn->snd_nxt;
+            conn->ca_state = TCP_CA_RECOVERY;
+            return TCP_CONG_RETRANSMIT;
+        }
+        return 0;
+    }
+
+    conn->dup_acks = 0;
+
+    switch (conn->ca_state) {
+        case TCP_CA_RECOVERY:
+            if (TCP_SEQ_GEQ(conn->snd_una, conn->recover)) {
+                // Full ACK: deflate the window and leave recovery
+                uint32_t flight = conn->snd_nxt - conn->snd_una;
+                conn->cwnd = flight + conn->mss < conn->ssthresh ? flight + conn->mss : conn->ssthresh;
+                conn->ca_state = TCP_CA_OPEN;
+                return 0;
+            }
+
+            // Partial ACK: the next segment was lost too. Deflate by what
+            // was acknowledged, keep one segment's worth of credit
+            conn->cwnd = (conn->cwnd > acked ? conn->cwnd - acked : 0) + conn->mss;
+            return TCP_CONG_RETRANSMIT;
+
+        case TCP_CA_LOSS:
+            // Slow start back up, resending the holes left before the timeout
+            conn->cong->on_ack(conn, acked, now_ms);
+            if (TCP_SEQ_LT(conn->snd_una, conn->recover)) {
+                return TCP_CONG_RETRANSMIT;
+            }
+            conn->ca_state = TCP_CA_OPEN;
+            return 0;
+
+        default:
+            conn->cong->on_ack(conn, acked, now_ms);
+            return 0;
+    }
+}
+
+void tcp_cong_rto(tcp_connection_t* conn) {
+    // Repeated timeouts for the same data do not lower ssthresh again
+    if (conn->ca_state != TCP_CA_LOSS) {
+        conn->cong->on_rto(conn);
+    }
+
+    conn->cwnd = conn->mss;
+    conn->bytes_acked = 0;
+    conn->recover = conn->snd_nxt;
+    conn->ca_state = TCP_CA_LOSS;
+    conn->dup_acks = 0;
+}
+
+/*
+ * NewReno (RFC 5681, RFC 6582): slow start, then one segment per window
+ * of ACKed data; halve on loss.
+ */
+
+static void newreno_init(tcp_connection_t* conn) {
+    (void)conn;
+}
+
+static void newreno_on_ack(tcp_connection_t* conn, uint32_t acked, uint64_t now_ms) {
+    (void)now_ms;
+
+    if (conn->cwnd < conn->ssthresh) {
+        tcp_cong_slow_start(conn, acked);
+        return;
+    }
+
+    // Congestion avoidance with appropriate byte counting (RFC 3465)
+    conn->bytes_acked += acked;
+    if (conn->bytes_acked >= conn->cwnd) {
+        conn->bytes_acked -= conn->cwnd;
+        conn->cwnd += conn->mss;
+    }
+}
+
+static void newreno_on_loss(tcp_connection_t* conn) {
+    conn->ssthresh = tcp_cong_half_flight(conn);
+    conn->cwnd = conn->ssthresh;
+}
+
+static void newreno_on_rto(tcp_connection_t* conn) {
+    conn->ssthresh = tcp_cong_half_flight(conn);
+}
+
+const tcp_cong_ops_t tcp_cong_newreno = {
+    .name = "newreno",
+    .init = newreno_init,
+    .on_ack = newreno_on_ack,
+    .on_loss = newreno_on_loss,
+    .on_rto = newreno_on_rto,
+};
+
+/*
+ * CUBIC (RFC 9438): after a reduction the window follows
+ * W(t) = C * (t - K)^3 + W_max, flattening out around the window where
+ * the last loss happened, and never grows slower than Reno would.
+ * Windows are counted in segments, times in milliseconds.
+ */
+
+#define CUBIC_BETA_NUM       7            // Multiplicative decrease 0.7
+#define CUBIC_BETA_DEN       10
+#define CUBIC_K_SCALE        2500000000ULL // K^3 = (W_max - cwnd) / C, C = 0.4, in ms^3
+#define CUBIC_T_MAX          1000000      // Clamp on |t - K| (ms), keeps t^3 in 64 bits
+#define CUBIC_RENO_ALPHA     34691        // 3 * (1 - beta) / (1 + beta) = 0.529, << 16
+
+// Lives in tcp_connection_t.cong_priv, so at most TCP_CONG_PRIV_WORDS words
+typedef struct cubic_state {
+    uint32_t w_max;           // Window before the last reduction (segments)
+    uint32_t epoch_start;     // Start of the current growth epoch (ms, 0 = none)
+    uint32_t origin;          // Window the curve plateaus at (segments)
+    uint32_t k;               // Time from epoch start to the plateau (ms)
+    uint32_t ack_cnt;         // Segments ACKed toward the next increase
+    uint32_t reno_est;        // Window Reno would have now (segments << 16)
+} cubic_state_t;
+
+static cubic_state_t* cubic_state(tcp_connection_t* conn) {
+    return (cubic_state_t*)conn->cong_priv;
+}
+
+/**
+ * Integer cube root, rounded down
+ */
+static uint32_t cubic_root(uint64_t value) {
+    uint32_t root = 0;
+
+    for (int bit = 20; bit >= 0; bit--) {
+        uint32_t candidate = root | (1u << bit);
+        if ((uint64_t)candidate * candidate * candidate <= value) {
+            root = candidate;
+        }
+    }
+    return root;
+}
+
+static void cubic_init(tcp_connection_t* conn) {
+    memset(cubic_state(conn), 0, sizeof(cubic_state_t));
+}
+
+static void cubic_on_ack(tcp_connection_t* conn, uint32_t acked, uint64_t now_ms) {
+    cubic_state_t* ca = cubic_state(conn);
+
+    if (conn->cwnd < conn->ssthresh) {
+        tcp_cong_slow_start(conn, acked);
+        return;
+    }
+
+    uint32_t cwnd = conn->cwnd / conn->mss;
+    if (cwnd == 0) {
+        cwnd = 1;
+    }
+    uint32_t acked_segments = acked / conn->mss;
+    if (acked_segments == 0) {
+        acked_segments = 1;
+    }
+
+    uint32_t now = (uint32_t)now_ms;
+    if (now == 0) {
+        now = 1;
+    }
+
+    if (ca->epoch_start == 0) {
+        ca->epoch_start = now;
+        ca->ack_cnt = 0;
+        ca->reno_est = cwnd << 16;
+        if (ca->w_max > cwnd) {
+            ca->k = cubic_root((uint64_t)(ca->w_max - cwnd) * CUBIC_K_SCALE);
+            ca->origin = ca->w_max;
+        } else {
+            ca->k = 0;
+            ca->origin = cwnd;
+        }
+    }
+
+    // Where the curve will be one round trip from now
+    int64_t t = (int64_t)(now - ca->epoch_start) + conn->retransmit.srtt - ca->k;
+    uint64_t offset = t < 0 ? -t : t;
+    if (offset > CUBIC_T_MAX) {
+        offset = CUBIC_T_MAX;
+    }
+    uint64_t delta = 2 * offset * offset * offset / 5000000000ULL;   // 0.4 * (offset / 1000)^3
+    if (delta > 0xFFFF) {
+        delta = 0xFFFF;
+    }
+
+    uint32_t target;
+    if (t < 0) {
+        target = delta < ca->origin ? ca->origin - (uint32_t)delta : 1;
+    } else {
+        target = ca->origin + (uint32_t)delta;
+    }
+
+    // ACKed segments per one-segment increase
+    uint32_t cnt = target > cwnd ? cwnd / (target - cwnd) : 100 * cwnd;
+
+    // Reno-friendly region: grow at least as fast as Reno with the same beta
+    ca->reno_est += (uint32_t)((uint64_t)acked_segments * CUBIC_RENO_ALPHA / cwnd);
+    uint32_t reno = ca->reno_est >> 16;
+    if (reno > cwnd) {
+        uint32_t reno_cnt = cwnd / (reno - cwnd);
+        if (reno_cnt < cnt) {
+            cnt = reno_cnt;
+        }
+    }
+    if (cnt == 0) {
+        cnt = 1;
+    }
+
+    ca->ack_cnt += acked_segments;
+    if (ca->ack_cnt >= cnt) {
+        uint32_t increase = ca->ack_cnt / cnt;
+        ca->ack_cnt -= increase * cnt;
+        conn->cwnd += increase * conn->mss;
+    }
+}
+
+/**
+ * Multiplicative decrease, remembering where the loss happened
+ */
+static void cubic_reduce(tcp_connection_t* conn) {
+    cubic_state_t* ca = cubic_state(conn);
+    uint32_t cwnd = conn->cwnd / conn->mss;
+
+    // Fast convergence: a plateau that keeps dropping gives way to newer flows
+    if (cwnd < ca->w_max) {
+        ca->w_max = cwnd * (CUBIC_BETA_DEN + CUBIC_BETA_NUM) / (2 * CUBIC_BETA_DEN);
+    } else {
+        ca->w_max = cwnd;
+    }
+    ca->epoch_start = 0;
+
+    uint32_t ssthresh = conn->cwnd / CUBIC_BETA_DEN * CUBIC_BETA_NUM;
+    conn->ssthresh = ssthresh > 2u * conn->mss ? ssthresh : 2u * conn->mss;
+}
+
+static void cubic_on_loss(tcp_connection_t* conn) {
+    cubic_reduce(conn);
+    conn->cwnd = conn->ssthresh;
+}
+
+static void cubic_on_rto(tcp_connection_t* conn) {
+    cubic_reduce(conn);
+}
+
+const tcp_cong_ops_t tcp_cong_cubic = {
+    .name = "cubic",
+    .init = cubic_init,
+    .on_ack = cubic_on_ack,
+    .on_loss = cubic_on_loss,
+    .on_rto = cubic_on_rto,
+};
+
+/*
+ * Link emulator
+ *
+ * A bulk sender drives tcp_cong_ack()/tcp_cong_rto() and the RTO estimator
+ * exactly as tcp.c does, over a simulated path: a drop-tail bottleneck
+ * queue, fixed propagation delay each way, and random loss from a fixed
+ * seed. The receiver buffers out-of-order segments and ACKs every one.
+ * Time is simulated, so every run gives the same result.
+ */
+
+#define EMU_MSS              1460
+#define EMU_STEP_US          100          // Simulation tick
+#define EMU_DURATION_MS      10000        // Simulated time per run
+#define EMU_RWND_SEGMENTS    512          // Receiver window
+#define EMU_PIPE_SLOTS       2048         // Segments or ACKs on one direction of the path
+#define EMU_SEED             0x2545F491
+
+typedef struct tcp_emu_link {
+    const char* name;
+    uint32_t rate_kbps;       // Bottleneck bandwidth
+    uint32_t delay_ms;        // One-way propagation delay
+    uint32_t queue;           // Bottleneck buffer (segments)
+    uint32_t loss_ppm;        // Random loss (parts per million)
+} tcp_emu_link_t;
+
+static const tcp_emu_link_t tcp_emu_links[] = {
+    { "10 Mbit/s, 20 ms RTT, 16-segment queue",  10000, 10, 16,  0     },
+    { "10 Mbit/s, 20 ms RTT, 1% loss",           10000, 10, 64,  10000 },
+    { "50 Mbit/s, 60 ms RTT, 0.01% loss",        50000, 30, 256, 100   },
+};
+
+typedef struct tcp_emu_slot {
+    uint32_t value;           // Segment number (data) or next expected segment (ACK)
+    uint32_t due_us;          // Arrival time at the far end
+} tcp_emu_slot_t;
+
+typedef struct tcp_emu_pipe {
+    tcp_emu_slot_t slots[EMU_PIPE_SLOTS];
+    uint32_t head;
+    uint32_t count;
+} tcp_emu_pipe_t;
+
+static struct {
+    const tcp_emu_link_t* link;
+    tcp_emu_pipe_t data;              // Sender to receiver
+    tcp_emu_pipe_t acks;              // Receiver to sender
+    uint8_t received[EMU_RWND_SEGMENTS]; // Out-of-order segments held by the receiver
+    uint32_t rcv_next;                // Next segment the receiver expects
+    uint32_t link_busy_until;         // When the bottleneck drains its queue (us)
+    uint32_t seed;
+    uint32_t segments_sent;
+    uint32_t retransmits;
+    uint32_t timeouts;
+    uint32_t drops;
+} tcp_emu;
+
+static int tcp_emu_push(tcp_emu_pipe_t* pipe, uint32_t value, uint32_t due_us) {
+    if (pipe->count == EMU_PIPE_SLOTS) {
+        return -1;
+    }
+    tcp_emu_slot_t* slot = &pipe->slots[(pipe->head + pipe->count) % EMU_PIPE_SLOTS];
+    slot->value = value;
+    slot->due_us = due_us;
+    pipe->count++;
+    return 0;
+}
+
+static int tcp_emu_pop(tcp_emu_pipe_t* pipe, uint32_t now_us, uint32_t* value) {
+    if (pipe->count == 0 || pipe->slots[pipe->head].due_us > now_us) {
+        return 0;
+    }
+    *value = pipe->slots[pipe->head].value;
+    pipe->head = (pipe->head + 1) % EMU_PIPE_SLOTS;
+    pipe->count--;
+    return 1;
+}
+
+/**
+ * Put one segment on the path: random loss, then the bottleneck queue
+ */
+static void tcp_emu_send(uint32_t segment, uint32_t now_us) {
+    const tcp_emu_link_t* link = tcp_emu.link;
+    tcp_emu.segments_sent++;
+
+    tcp_emu.seed = tcp_emu.seed * 1103515245 + 12345;
+    if ((tcp_emu.seed >> 8) % 1000000 < link->loss_ppm) {
+        tcp_emu.drops++;
+        return;
+    }
+
+    uint32_t tx_us = EMU_MSS * 8 * 1000 / link->rate_kbps;
+    uint32_t start = tcp_emu.link_busy_until > now_us ? tcp_emu.link_busy_until : now_us;
+    if ((start - now_us) / tx_us >= link->queue) {
+        tcp_emu.drops++; // Drop-tail
+        return;
+    }
+
+    if (tcp_emu_push(&tcp_emu.data, segment, start + tx_us + link->delay_ms * 1000) != 0) {
+        tcp_emu.drops++;
+        return;
+    }
+    tcp_emu.link_busy_until = start + tx_us;
+}
+
+/**
+ * Receiver: take in arrived segments and ACK each one cumulatively
+ */
+static void tcp_emu_receive(uint32_t now_us) {
+    uint32_t segment;
+
+    while (tcp_emu_pop(&tcp_emu.data, now_us, &segment)) {
+        if (segment >= tcp_emu.rcv_next && segment < tcp_emu.rcv_next + EMU_RWND_SEGMENTS) {
+            tcp_emu.received[segment % EMU_RWND_SEGMENTS] = 1;
+            while (tcp_emu.received[tcp_emu.rcv_next % EMU_RWND_SEGMENTS]) {
+                tcp_emu.received[tcp_emu.rcv_next % EMU_RWND_SEGMENTS] = 0;
+                tcp_emu.rcv_next++;
+            }
+        }
+        tcp_emu_push(&tcp_emu.acks, tcp_emu.rcv_next, now_us + tcp_emu.link->delay_ms * 1000);
+    }
+}
+
+/**
+ * Run one bulk transfer and return the goodput in kbit/s
+ */
+static uint32_t tcp_emu_run(const tcp_emu_link_t* link, const tcp_cong_ops_t* ops) {
+    memset(&tcp_emu, 0, sizeof(tcp_emu));
+    tcp_emu.link = link;
+    tcp_emu.seed = EMU_SEED;
+
+    tcp_connection_t conn;
+    memset(&conn, 0, sizeof(conn));
+    conn.mss = EMU_MSS;
+    conn.snd_wnd = EMU_RWND_SEGMENTS * EMU_MSS;
+    conn.retransmit.rto = 1000; // RFC 6298 initial RTO
+    tcp_cong_init(&conn, ops);
+
+    uint32_t rto_due_us = 0;
+
+    for (uint32_t now_us = 0; now_us < EMU_DURATION_MS * 1000; now_us += EMU_STEP_US) {
+        uint64_t now_ms = now_us / 1000;
+        uint32_t ack;
+
+        tcp_emu_receive(now_us);
+
+        // Sender: ACKs first, as tcp_process_ack() handles them
+        while (tcp_emu_pop(&tcp_emu.acks, now_us, &ack)) {
+            uint32_t ack_num = ack * EMU_MSS;
+            int action = 0;
+
+            if (ack_num == conn.snd_una) {
+                if (conn.snd_una != conn.snd_nxt) {
+                    action = tcp_cong_ack(&conn, 0, now_ms);
+                }
+            } else if (TCP_SEQ_GT(ack_num, conn.snd_una)) {
+                uint32_t acked = ack_num - conn.snd_una;
+                conn.snd_una = ack_num;
+
+                if (conn.retransmit.rtt_timing && TCP_SEQ_LEQ(conn.retransmit.rtt_seq, conn.snd_una)) {
+                    conn.retransmit.rtt_timing = 0;
+                    tcp_rtt_update(&conn.retransmit, (uint32_t)(now_ms - conn.retransmit.rtt_start));
+                }
+                rto_due_us = now_us + conn.retransmit.rto * 1000;
+
+                action = tcp_cong_ack(&conn, acked, now_ms);
+            }
+
+            if (action == TCP_CONG_RETRANSMIT) {
+                conn.retransmit.rtt_timing = 0;
+                tcp_emu_send(conn.snd_una / EMU_MSS, now_us);
+                tcp_emu.retransmits++;
+            }
+        }
+
+        // Retransmission timeout with backoff
+        if (conn.snd_una != conn.snd_nxt && now_us >= rto_due_us) {
+            conn.retransmit.rto *= 2;
+            if (conn.retransmit.rto > TCP_RTO_MAX) {
+                conn.retransmit.rto = TCP_RTO_MAX;
+            }
+            conn.retransmit.rtt_timing = 0;
+            tcp_cong_rto(&conn);
+
+            tcp_emu_send(conn.snd_una / EMU_MSS, now_us);
+            tcp_emu.retransmits++;
+            tcp_emu.timeouts++;
+            rto_due_us = now_us + conn.retransmit.rto * 1000;
+        }
+
+        // New data, as tcp_output() sends it
+        uint32_t window = conn.snd_wnd < conn.cwnd ? conn.snd_wnd : conn.cwnd;
+        while (conn.snd_nxt - conn.snd_una + EMU_MSS <= window) {
+            if (conn.snd_una == conn.snd_nxt) {
+                rto_due_us = now_us + conn.retransmit.rto * 1000;
+            }
+            tcp_emu_send(conn.snd_nxt / EMU_MSS, now_us);
+            conn.snd_nxt += EMU_MSS;
+
+            if (!conn.retransmit.rtt_timing) {
+                conn.retransmit.rtt_timing = 1;
+                conn.retransmit.rtt_seq = conn.snd_nxt;
+                conn.retransmit.rtt_start = now_ms;
+            }
+        }
+    }
+
+    // Bytes per millisecond times 8 is kbit/s
+    return (uint32_t)((uint64_t)conn.snd_una * 8 / EMU_DURATION_MS);
+}
+
+void tcp_cong_run_benchmark(void) {
+    log_info("NET", "TCP congestion control emulation (%u s bulk transfer per run):",
+             EMU_DURATION_MS / 1000);
+
+    for (uint32_t i = 0; i < sizeof(tcp_emu_links) / sizeof(tcp_emu_links[0]); i++) {
+        const tcp_emu_link_t* link = &tcp_emu_links[i];
+        log_info("NET", "  %s", link->name);
+
+        for (uint32_t j = 0; j < TCP_CONG_ALGORITHM_COUNT; j++) {
+            uint32_t goodput = tcp_emu_run(link, tcp_cong_algorithms[j]);
+            log_info("NET", "    %-8s: %u kbit/s goodput (%u%% of link), %u retransmits, %u timeouts",
+                     tcp_cong_algorithms[j]->name, goodput,
+                     (uint32_t)((uint64_t)goodput * 100 / link->rate_kbps),
+                     tcp_emu.retransmits, tcp_emu.timeouts);
+        }
+    }
+}